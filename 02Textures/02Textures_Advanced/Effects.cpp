@@ -5,7 +5,7 @@
 #include "Effects.h"
 
 #pragma region Effect
-Effect::Effect(ID3D11Device* device, const std::wstring& filename)
+Effect::Effect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename)
 	: mFX(0)
 {
 	DWORD shaderFlags = 0;
@@ -31,21 +31,20 @@ Effect::Effect(ID3D11Device* device, const std::wstring& filename)
 		DXTrace(__FILE__, (DWORD)__LINE__, hr,
 			L"D3DX11CompileFromFile", true);
 	}
-	HR(D3DX11CreateEffectFromMemory(
-		compiledShader->GetBufferPointer(),
-		compiledShader->GetBufferSize(),
-		0, device, &mFX));
+	mEffect = RegistryResources::CreateEffect(device, registry,
+		compiledShader->GetBufferPointer(), compiledShader->GetBufferSize());
+	mFX = mEffect.Get();
+	ReleaseCOM(compiledShader);
 }
 
 Effect::~Effect()
 {
-	ReleaseCOM(mFX);
 }
 #pragma endregion
 
 #pragma region BasicEffect
-BasicEffect::BasicEffect(ID3D11Device* device, const std::wstring& filename)
-	: Effect(device, filename)
+BasicEffect::BasicEffect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename)
+	: Effect(device, registry, filename), mPerFrame(&mUploads), mPerObject(&mUploads)
 {
 	Light1Tech    = mFX->GetTechniqueByName("Light1");
 	Light2Tech    = mFX->GetTechniqueByName("Light2");
@@ -61,6 +60,9 @@ BasicEffect::BasicEffect(ID3D11Device* device, const std::wstring& filename)
 	WorldInvTranspose = mFX->GetVariableByName("gWorldInvTranspose")->AsMatrix();
 	TexTransform      = mFX->GetVariableByName("gTexTransform")->AsMatrix();
 	EyePosW           = mFX->GetVariableByName("gEyePosW")->AsVector();
+	FogColor          = mFX->GetVariableByName("gFogColor")->AsVector();
+	FogStart          = mFX->GetVariableByName("gFogStart")->AsScalar();
+	FogRange          = mFX->GetVariableByName("gFogRange")->AsScalar();
 	DirLights         = mFX->GetVariableByName("gDirLights");
 	Mat               = mFX->GetVariableByName("gMaterial");
 	Texture01		  = mFX->GetVariableByName("gTexture01")->AsShaderResource();
@@ -70,15 +72,39 @@ BasicEffect::BasicEffect(ID3D11Device* device, const std::wstring& filename)
 BasicEffect::~BasicEffect()
 {
 }
+
+void BasicEffect::SetPerFrame(const CBPerFrame& cb)
+{
+	if (!mPerFrame.Update(cb))
+		return;
+
+	DirLights->SetRawValue(cb.DirLights, 0, 3*sizeof(DirectionalLight));
+	EyePosW->SetRawValue(&cb.EyePosW, 0, sizeof(XMFLOAT3));
+	FogStart->SetFloat(cb.FogStart);
+	FogRange->SetFloat(cb.FogRange);
+	FogColor->SetFloatVector(reinterpret_cast<const float*>(&cb.FogColor));
+}
+
+void BasicEffect::SetPerObject(const CBPerObject& cb)
+{
+	if (!mPerObject.Update(cb))
+		return;
+
+	World->SetMatrix(reinterpret_cast<const float*>(&cb.World));
+	WorldInvTranspose->SetMatrix(reinterpret_cast<const float*>(&cb.WorldInvTranspose));
+	WorldViewProj->SetMatrix(reinterpret_cast<const float*>(&cb.WorldViewProj));
+	TexTransform->SetMatrix(reinterpret_cast<const float*>(&cb.TexTransform));
+	Mat->SetRawValue(&cb.Mat, 0, sizeof(Material));
+}
 #pragma endregion
 
 #pragma region Effects
 
 BasicEffect* Effects::BasicFX = 0;
 
-void Effects::InitAll(ID3D11Device* device)
+void Effects::InitAll(ID3D11Device* device, ResourceRegistry& registry)
 {
-	BasicFX = new BasicEffect(device, L"FX/Basic.fx");
+	BasicFX = new BasicEffect(device, registry, L"FX/Basic.fx");
 }
 
 void Effects::DestroyAll()
@@ -9,40 +9,74 @@
 #define EFFECTS_H
 
 #include "d3dUtil.h"
+#include "D3D11/RegistryResources.h"
+#include "ConstantBuffer.h"
 
 #pragma region Effect
 class Effect
 {
 public:
-	Effect(ID3D11Device* device, const std::wstring& filename);
+	// The effect comes from the registry, shared with any effect of the same bytes.
+	Effect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename);
 	virtual ~Effect();
 
 private:
 	Effect(const Effect& rhs);
 	Effect& operator=(const Effect& rhs);
 
+	ResourceHandle<ID3DX11Effect> mEffect;
+
 protected:
 	ID3DX11Effect* mFX;
 };
 #pragma endregion
 
+#pragma region ConstantBuffers
+// CPU mirrors of the cbuffers in Basic.fx, padded to HLSL packing rules.
+struct CBPerFrame
+{
+	DirectionalLight DirLights[3];
+	XMFLOAT3 EyePosW;
+	float FogStart;
+	float FogRange;
+	float Pad[3];
+	XMFLOAT4 FogColor;
+};
+
+struct CBPerObject
+{
+	XMFLOAT4X4 World;
+	XMFLOAT4X4 WorldInvTranspose;
+	XMFLOAT4X4 WorldViewProj;
+	XMFLOAT4X4 TexTransform;
+	Material Mat;
+};
+#pragma endregion
+
 #pragma region BasicEffect
 class BasicEffect : public Effect
 {
 public:
-	BasicEffect(ID3D11Device* device, const std::wstring& filename);
+	BasicEffect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename);
 	~BasicEffect();
 
-	void SetWorldViewProj(CXMMATRIX M)                  { WorldViewProj->SetMatrix(reinterpret_cast<const float*>(&M)); }
-	void SetWorld(CXMMATRIX M)                          { World->SetMatrix(reinterpret_cast<const float*>(&M)); }
-	void SetWorldInvTranspose(CXMMATRIX M)              { WorldInvTranspose->SetMatrix(reinterpret_cast<const float*>(&M)); }
-	void SetTexTransform(CXMMATRIX M)                   { TexTransform->SetMatrix(reinterpret_cast<const float*>(&M)); }
-	void SetEyePosW(const XMFLOAT3& v)                  { EyePosW->SetRawValue(&v, 0, sizeof(XMFLOAT3)); }
-	void SetDirLights(const DirectionalLight* lights)   { DirLights->SetRawValue(lights, 0, 3*sizeof(DirectionalLight)); }
-	void SetMaterial(const Material& mat)               { Mat->SetRawValue(&mat, 0, sizeof(Material)); }
+	void SetWorldViewProj(CXMMATRIX M)                  { mPerObject.Invalidate(); WorldViewProj->SetMatrix(reinterpret_cast<const float*>(&M)); }
+	void SetWorld(CXMMATRIX M)                          { mPerObject.Invalidate(); World->SetMatrix(reinterpret_cast<const float*>(&M)); }
+	void SetWorldInvTranspose(CXMMATRIX M)              { mPerObject.Invalidate(); WorldInvTranspose->SetMatrix(reinterpret_cast<const float*>(&M)); }
+	void SetTexTransform(CXMMATRIX M)                   { mPerObject.Invalidate(); TexTransform->SetMatrix(reinterpret_cast<const float*>(&M)); }
+	void SetEyePosW(const XMFLOAT3& v)                  { mPerFrame.Invalidate(); EyePosW->SetRawValue(&v, 0, sizeof(XMFLOAT3)); }
+	void SetDirLights(const DirectionalLight* lights)   { mPerFrame.Invalidate(); DirLights->SetRawValue(lights, 0, 3*sizeof(DirectionalLight)); }
+	void SetMaterial(const Material& mat)               { mPerObject.Invalidate(); Mat->SetRawValue(&mat, 0, sizeof(Material)); }
 	void SetTexture01(ID3D11ShaderResourceView* tex) { Texture01->SetResource(tex); }
 	void SetTexture02(ID3D11ShaderResourceView* tex) { Texture02->SetResource(tex); }
 
+	// Write a whole cbuffer at once. The effect variables are only touched, and the
+	// cbuffer only re-uploaded on the next Apply, when the contents changed.
+	void SetPerFrame(const CBPerFrame& cb);
+	void SetPerObject(const CBPerObject& cb);
+
+	UploadStats& Uploads()                              { return mUploads; }
+
 	ID3DX11EffectTechnique* Light1Tech;
 	ID3DX11EffectTechnique* Light2Tech;
 	ID3DX11EffectTechnique* Light3Tech;
@@ -57,12 +91,20 @@ public:
 	ID3DX11EffectMatrixVariable* WorldInvTranspose;
 	ID3DX11EffectMatrixVariable* TexTransform;
 	ID3DX11EffectVectorVariable* EyePosW;
+	ID3DX11EffectScalarVariable* FogStart;
+	ID3DX11EffectScalarVariable* FogRange;
+	ID3DX11EffectVectorVariable* FogColor;
 	ID3DX11EffectVariable* DirLights;
 	ID3DX11EffectVariable* Mat;
 
 	// define two textures: one for screen, one for phone
 	ID3DX11EffectShaderResourceVariable* Texture01;
 	ID3DX11EffectShaderResourceVariable* Texture02;
+
+private:
+	UploadStats mUploads;
+	ConstantBuffer<CBPerFrame> mPerFrame;
+	ConstantBuffer<CBPerObject> mPerObject;
 };
 #pragma endregion
 
@@ -70,7 +112,8 @@ public:
 class Effects
 {
 public:
-	static void InitAll(ID3D11Device* device);
+	// The effects are created through registry, which must outlive them.
+	static void InitAll(ID3D11Device* device, ResourceRegistry& registry);
 	static void DestroyAll();
 
 	static BasicEffect* BasicFX;
@@ -1,4 +1,5 @@
 #include "TexturesApp.h"
+#include "MeshBuilder.h"
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 				   PSTR cmdLine, int showCmd)
@@ -22,7 +23,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 /// <param name="hInstance">The h instance.</param>
 TexturesApp::TexturesApp(HINSTANCE hInstance)
 : D3DApp(hInstance), _vertexBuffer(0), _indexBuffer(0), _phoneMapSRV(0), mEyePosW(0.0f, 0.0f, 0.0f),
-  mTheta(1.0f*MathHelper::Pi), mPhi(0.5f*MathHelper::Pi), mRadius(20.0f), _offscreenSRV(0), _renderTargetTexture(0), _offscreenRTV(0)
+  mTheta(1.0f*MathHelper::Pi), mPhi(0.5f*MathHelper::Pi), mRadius(20.0f), _screenTarget(0), _offscreenSRV(0),
+  _objectRing(ObjectRingSize*sizeof(CBPerObject)), _phoneCB(0), _renderQueue(16)
 {
 	mMainWndCaption = L"Textures Application";
 	
@@ -41,6 +43,13 @@ TexturesApp::TexturesApp(HINSTANCE hInstance)
 	_dirLights[1].Specular = XMFLOAT4(0.3f, 0.3f, 0.3f, 16.0f);
 	_dirLights[1].Direction = XMFLOAT3(-0.707f, 0.0f, 0.707f);
 
+	// Zero the per frame constants first, so their padding compares equal every frame.
+	ZeroMemory(&_perFrame, sizeof(_perFrame));
+	for (int i = 0; i < 2; ++i) {
+		_perFrame.DirLights[i] = _dirLights[i];
+		_perFrame.DirLights[i].Pad = 0.0f;
+	}
+
 	SetMaterials();
 }
 
@@ -51,11 +60,10 @@ TexturesApp::~TexturesApp()
 {
 	ReleaseCOM(_vertexBuffer);
 	ReleaseCOM(_indexBuffer);
-	ReleaseCOM(_phoneMapSRV);
 
-	ReleaseCOM(_offscreenRTV);
-	ReleaseCOM(_offscreenSRV);
-	ReleaseCOM(_renderTargetTexture);
+	// leave where the frames of this run went, for chrome://tracing
+	Telemetry::WriteChromeTrace("frame_trace.json");
+	OutputDebugStringA(Telemetry::Summary().c_str());
 
 	Effects::DestroyAll();
 	InputLayouts::DestroyAll();
@@ -65,6 +73,8 @@ TexturesApp::~TexturesApp()
 /// Builds the matrices for positioning and rotating.
 /// </summary>
 void TexturesApp::BuildMatrices() {
+	TELEMETRY_SCOPE("BuildMatrices");
+
 	XMMATRIX I = XMMatrixIdentity();
 	XMStoreFloat4x4(&_world, I);
 	XMStoreFloat4x4(&_texTransform, I);
@@ -116,12 +126,12 @@ bool TexturesApp::Init()
 		return false;
 
 	// Must init Effects first since InputLayouts depend on shader signatures.
-	Effects::InitAll(md3dDevice);
-	InputLayouts::InitAll(md3dDevice);
+	Effects::InitAll(md3dDevice, _resources);
+	InputLayouts::InitAll(md3dDevice, _resources);
 
 	// only define the texture for the phone itself, since other will be drawn on runtime
-	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice,
-		L"MyPhone.png", 0, 0, &_phoneMapSRV, 0));
+	_phoneMap = RegistryResources::LoadTexture(md3dDevice, _resources, L"MyPhone.png");
+	_phoneMapSRV = _phoneMap.Get();
 
 	BuildGeometryBuffers();
 
@@ -135,7 +145,7 @@ void TexturesApp::OnResize()
 {
 	D3DApp::OnResize();
 
-	BuildOffscreenViews();
+	BuildFrameGraph();
 
 	XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
 	XMStoreFloat4x4(&_proj, P);
@@ -147,6 +157,8 @@ void TexturesApp::OnResize()
 /// <param name="dt">The deltatime.</param>
 void TexturesApp::UpdateScene(float dt)
 {
+	TELEMETRY_SCOPE("UpdateScene");
+
 	// Convert Spherical to Cartesian coordinates.
 	float x = mRadius*sinf(mPhi)*cosf(mTheta);
 	float z = mRadius*sinf(mPhi)*sinf(mTheta);
@@ -172,29 +184,46 @@ void TexturesApp::UpdateScene(float dt)
 /// </summary>
 void TexturesApp::DrawScene()
 {
-	// set the SRV for the screen so that I can render to it
-	ID3D11RenderTargetView* renderTargets[1] = { _offscreenRTV };
-	md3dImmediateContext->OMSetRenderTargets(1, renderTargets, mDepthStencilView);
+	TELEMETRY_SCOPE("DrawScene");
 
-	// clear views
-	md3dImmediateContext->ClearRenderTargetView(_offscreenRTV, reinterpret_cast<const float*>(&Colors::Silver));
-	md3dImmediateContext->ClearDepthStencilView(mDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+	// Start a new frame of constant buffer records and upload counters.
+	_objectRing.BeginFrame();
+	Effects::BasicFX->Uploads().BeginFrame();
+	_draws.clear();
 
-	// draw everything in the scene except from the phone
-	DrawStart();
+	// Both passes see the walls and grid from the same camera, so their per object
+	// constants are packed once and shared.
+	XMMATRIX viewProj = XMLoadFloat4x4(&_view)*XMLoadFloat4x4(&_proj);
+	XMMATRIX texTransform = XMLoadFloat4x4(&_texTransform);
 
-	// set SRV to the default render target, the back buffer
-	renderTargets[0] = mRenderTargetView;
-	md3dImmediateContext->OMSetRenderTargets(1, renderTargets, mDepthStencilView);
+	_phoneCB = PushObject(_phoneWorld, viewProj, texTransform, _phoneMaterial);
+	for (int i = 0; i < 4; ++i)
+		_wallsCB[i] = PushObject(_wallsWorld[i], viewProj, texTransform, _material2);
+	for (int i = 0; i < 1; ++i)
+		_gridsCB[i] = PushObject(_gridsWorld[i], viewProj, texTransform, _material);
 
-	// clear views
-	md3dImmediateContext->ClearRenderTargetView(mRenderTargetView, reinterpret_cast<const float*>(&Colors::LightSteelBlue));
-	md3dImmediateContext->ClearDepthStencilView(mDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+	_perFrame.EyePosW = mEyePosW;
 
-	// draw everything, including phone with screen texture
-	DrawFinish();
+	// the screen of the phone first, then everything including the phone
+	_frameGraph.Execute([this](const FrameGraph::Transition& transition)
+	{
+		// a target about to be rendered to may still be bound as a texture from the last frame
+		if (_frameGraph.IsTransient(transition.Resource) && transition.After != FrameGraph::ShaderRead)
+		{
+			ID3D11ShaderResourceView* none[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
+			md3dImmediateContext->PSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, none);
+		}
+	});
 
-	HR(mSwapChain->Present(0, 0));
+	{
+		TELEMETRY_SCOPE("Present");
+		HR(mSwapChain->Present(0, 0));
+	}
+
+	_targets.EndFrame();
+	_resources.EndFrame();
+
+	Telemetry::EndFrame();
 }
 
 /// <summary>
@@ -202,154 +231,154 @@ void TexturesApp::DrawScene()
 /// </summary>
 void TexturesApp::DrawStart()
 {
-	md3dImmediateContext->IASetInputLayout(InputLayouts::Basic32);
-	md3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	TELEMETRY_SCOPE("DrawStart");
 
-	UINT stride = sizeof(Vertex::Basic32);
-	UINT offset = 0;
+	// render to the screen target
+	ID3D11RenderTargetView* renderTargets[1] = { _targets.Get(_frameGraph, _screenTarget).RTVs[0] };
+	md3dImmediateContext->OMSetRenderTargets(1, renderTargets, mDepthStencilView);
 
-	XMMATRIX view = XMLoadFloat4x4(&_view);
-	XMMATRIX proj = XMLoadFloat4x4(&_proj);
-	XMMATRIX viewProj = view*proj;
+	// clear views
+	md3dImmediateContext->ClearRenderTargetView(renderTargets[0], reinterpret_cast<const float*>(&Colors::Silver));
+	md3dImmediateContext->ClearDepthStencilView(mDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
 	// Set per frame constants.
-	Effects::BasicFX->SetDirLights(_dirLights);
-	Effects::BasicFX->SetEyePosW(mEyePosW);
+	Effects::BasicFX->SetPerFrame(_perFrame);
 
-	// Draw the box.
-	XMMATRIX world = XMLoadFloat4x4(&_world);
-	XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
-	XMMATRIX worldViewProj = world*view*proj;
+	_renderQueue.Clear();
+	for (int i = 0; i < 4; ++i)
+		QueueDraw(TechLight2, NoTexture, WallMaterial, _wallsRange, _wallsCB[i], _wallsWorld[i]);
+	for (int i = 0; i < 1; ++i)
+		QueueDraw(TechLight2, NoTexture, GridMaterial, _gridsRange, _gridsCB[i], _gridsWorld[i]);
 
-	Effects::BasicFX->SetWorld(world);
-	Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-	Effects::BasicFX->SetWorldViewProj(worldViewProj);
+	SubmitQueue();
+}
 
-	ID3DX11EffectTechnique* activeTech = Effects::BasicFX->Light2Tech;
+/// <summary>
+/// Draws the scene including phone.
+/// </summary>
+void TexturesApp::DrawFinish() {
+	TELEMETRY_SCOPE("DrawFinish");
 
-	D3DX11_TECHNIQUE_DESC techDesc;
-	activeTech->GetDesc(&techDesc);
-	for (UINT p = 0; p < techDesc.Passes; ++p)
-	{
-		md3dImmediateContext->IASetVertexBuffers(0, 1, &_vertexBuffer, &stride, &offset);
-		md3dImmediateContext->IASetIndexBuffer(_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	// set the render target to the back buffer
+	ID3D11RenderTargetView* renderTargets[1] = { mRenderTargetView };
+	md3dImmediateContext->OMSetRenderTargets(1, renderTargets, mDepthStencilView);
 
-		for (int i = 0; i < 4; ++i) {
-			XMMATRIX world = XMLoadFloat4x4(&_wallsWorld[i]);
-			XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
-			XMMATRIX worldViewProj = world*view*proj;
+	// clear views
+	md3dImmediateContext->ClearRenderTargetView(mRenderTargetView, reinterpret_cast<const float*>(&Colors::LightSteelBlue));
+	md3dImmediateContext->ClearDepthStencilView(mDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
-			Effects::BasicFX->SetWorld(world);
-			Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-			Effects::BasicFX->SetWorldViewProj(worldViewProj);
-			Effects::BasicFX->SetMaterial(_material2);
+	// the phone shows what the screen pass rendered
+	_offscreenSRV = _targets.Get(_frameGraph, _screenTarget).SRV;
 
-			activeTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-			md3dImmediateContext->DrawIndexed(_wallsIndexCount, _wallsIndexOffset, _wallsVertexOffset);
-		}
+	// Set per frame constants. They were uploaded by DrawStart already, so this is skipped.
+	Effects::BasicFX->SetPerFrame(_perFrame);
 
-		for (int i = 0; i < 1; ++i) {
-			XMMATRIX world = XMLoadFloat4x4(&_gridsWorld[i]);
-			XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
-			XMMATRIX worldViewProj = world*view*proj;
+	// The phone is the only textured object. Queueing it with the others lets the sort
+	// group the untextured draws, instead of switching technique halfway through a pass.
+	_renderQueue.Clear();
+	QueueDraw(TechLight2Tex, PhoneTexture, PhoneMaterial, _phoneRange, _phoneCB, _phoneWorld);
+	for (int i = 0; i < 4; ++i)
+		QueueDraw(TechLight2, NoTexture, WallMaterial, _wallsRange, _wallsCB[i], _wallsWorld[i]);
+	for (int i = 0; i < 1; ++i)
+		QueueDraw(TechLight2, NoTexture, GridMaterial, _gridsRange, _gridsCB[i], _gridsWorld[i]);
 
-			Effects::BasicFX->SetWorld(world);
-			Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-			Effects::BasicFX->SetWorldViewProj(worldViewProj);
-			Effects::BasicFX->SetMaterial(_material);
+	SubmitQueue();
+}
 
-			activeTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-			md3dImmediateContext->DrawIndexed(_gridsIndexCount, _gridsIndexOffset, _gridsVertexOffset);
-		}
+/// <summary>
+/// Queues a draw under its sort key.
+/// </summary>
+/// <param name="tech">The technique.</param>
+/// <param name="texture">The id of the textures.</param>
+/// <param name="material">The id of the material.</param>
+/// <param name="range">Where the mesh is in the vertex and index buffer.</param>
+/// <param name="objectCB">The offset of the per object constants in the object ring.</param>
+/// <param name="world">The world matrix, used for the depth part of the key.</param>
+void TexturesApp::QueueDraw(UINT tech, UINT texture, UINT material,
+	const DrawRange<Vertex::Basic32>& range, size_t objectCB, const XMFLOAT4X4& world)
+{
+	QueuedDraw draw;
+	draw.IndexCount = range.IndexCount;
+	draw.StartIndex = range.StartIndex;
+	draw.BaseVertex = range.BaseVertex;
+	draw.ObjectCB = objectCB;
 
-	}
+	XMVECTOR centerV = XMVector3TransformCoord(XMVectorSet(world._41, world._42, world._43, 1.0f), XMLoadFloat4x4(&_view));
+	uint32_t depth = RenderKey::QuantizeDepth(XMVectorGetZ(centerV), 1000.0f);
+
+	_renderQueue.Push(RenderKey::Make(0, tech, texture, material, depth), (uint32_t)_draws.size());
+	_draws.push_back(draw);
 }
 
 /// <summary>
-/// Draws the scene including phone.
+/// Sorts the queued draws and submits them, skipping redundant binds.
 /// </summary>
-void TexturesApp::DrawFinish() {
+void TexturesApp::SubmitQueue()
+{
+	TELEMETRY_SCOPE("SubmitQueue");
+
+	_renderQueue.Sort();
+
 	md3dImmediateContext->IASetInputLayout(InputLayouts::Basic32);
 	md3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
+	// Everything lives in one vertex and index buffer.
 	UINT stride = sizeof(Vertex::Basic32);
 	UINT offset = 0;
+	md3dImmediateContext->IASetVertexBuffers(0, 1, &_vertexBuffer, &stride, &offset);
+	md3dImmediateContext->IASetIndexBuffer(_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
 
-	XMMATRIX view = XMLoadFloat4x4(&_view);
-	XMMATRIX proj = XMLoadFloat4x4(&_proj);
-	XMMATRIX viewProj = view*proj;
-
-	// Set per frame constants.
-	Effects::BasicFX->SetDirLights(_dirLights);
-	Effects::BasicFX->SetEyePosW(mEyePosW);
-
-	// Draw the box.
-	XMMATRIX world = XMLoadFloat4x4(&_world);
-	XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
-	XMMATRIX worldViewProj = world*view*proj;
-
-	Effects::BasicFX->SetWorld(world);
-	Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-	Effects::BasicFX->SetWorldViewProj(worldViewProj);
-	Effects::BasicFX->SetTexTransform(XMLoadFloat4x4(&_texTransform));
-	Effects::BasicFX->SetMaterial(_phoneMaterial);
-	Effects::BasicFX->SetTexture01(_phoneMapSRV);		// sets first texture
-	Effects::BasicFX->SetTexture02(_offscreenSRV);		// sets second texture
-
-	ID3DX11EffectTechnique* activeTech = Effects::BasicFX->Light2TexTech;
-
+	ID3DX11EffectTechnique* activeTech = 0;
 	D3DX11_TECHNIQUE_DESC techDesc;
-	activeTech->GetDesc(&techDesc);
-	for (UINT p = 0; p < techDesc.Passes; ++p)
-	{
-		md3dImmediateContext->IASetVertexBuffers(0, 1, &_vertexBuffer, &stride, &offset);
-		md3dImmediateContext->IASetIndexBuffer(_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-
-		XMMATRIX world = XMLoadFloat4x4(&_phoneWorld);
-		XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
-		XMMATRIX worldViewProj = world*view*proj;
-		
-		Effects::BasicFX->SetWorld(world);
-		Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-		Effects::BasicFX->SetWorldViewProj(worldViewProj);
-
-		activeTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-		md3dImmediateContext->DrawIndexed(_phoneIndexCount, _phoneIndexOffset, _phoneVertexOffset);
-
-		// other objects don't have textures. 
-		activeTech = Effects::BasicFX->Light2Tech;
-		activeTech->GetDesc(&techDesc);
-
-		for (int i = 0; i < 4; ++i) {
-			world = XMLoadFloat4x4(&_wallsWorld[i]);
-			worldInvTranspose = MathHelper::InverseTranspose(world);
-			worldViewProj = world*view*proj;
-
-			Effects::BasicFX->SetWorld(world);
-			Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-			Effects::BasicFX->SetWorldViewProj(worldViewProj);
-			Effects::BasicFX->SetMaterial(_material2);
 
-			activeTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-			md3dImmediateContext->DrawIndexed(_wallsIndexCount, _wallsIndexOffset, _wallsVertexOffset);
+	_stateCache.Reset();
+	for (size_t i = 0; i < _renderQueue.Size(); ++i) {
+		uint64_t key = _renderQueue[i].Key;
+		const QueuedDraw& draw = _draws[_renderQueue[i].Payload];
+
+		if (_stateCache.Bind(RenderStateCache::Technique, RenderKey::Technique(key))) {
+			activeTech = RenderKey::Technique(key) == TechLight2Tex ? Effects::BasicFX->Light2TexTech : Effects::BasicFX->Light2Tech;
+			activeTech->GetDesc(&techDesc);
 		}
 
-		for (int i = 0; i < 1; ++i) {
-			XMMATRIX world = XMLoadFloat4x4(&_gridsWorld[i]);
-			XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
-			XMMATRIX worldViewProj = world*view*proj;
+		if (RenderKey::Texture(key) == PhoneTexture && _stateCache.Bind(RenderStateCache::Texture, PhoneTexture)) {
+			Effects::BasicFX->SetTexture01(_phoneMapSRV);		// sets first texture
+			Effects::BasicFX->SetTexture02(_offscreenSRV);		// sets second texture
+		}
 
-			Effects::BasicFX->SetWorld(world);
-			Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-			Effects::BasicFX->SetWorldViewProj(worldViewProj);
-			Effects::BasicFX->SetMaterial(_material);
+		Effects::BasicFX->SetPerObject(_objectRing.At<CBPerObject>(draw.ObjectCB));
 
+		for (UINT p = 0; p < techDesc.Passes; ++p) {
 			activeTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-			md3dImmediateContext->DrawIndexed(_gridsIndexCount, _gridsIndexOffset, _gridsVertexOffset);
+			md3dImmediateContext->DrawIndexed(draw.IndexCount, draw.StartIndex, draw.BaseVertex);
 		}
 	}
 }
 
+/// <summary>
+/// Packs the per object constants of one draw into the object ring.
+/// </summary>
+/// <param name="world">The world matrix.</param>
+/// <param name="viewProj">The view projection matrix.</param>
+/// <param name="texTransform">The texture transform.</param>
+/// <param name="mat">The material.</param>
+/// <returns>The offset of the record in the ring.</returns>
+size_t TexturesApp::PushObject(const XMFLOAT4X4& world, CXMMATRIX viewProj, CXMMATRIX texTransform, const Material& mat)
+{
+	CBPerObject cb;
+
+	XMMATRIX W = XMLoadFloat4x4(&world);
+	cb.World = world;
+	XMStoreFloat4x4(&cb.WorldInvTranspose, MathHelper::InverseTranspose(W));
+	XMStoreFloat4x4(&cb.WorldViewProj, W*viewProj);
+	XMStoreFloat4x4(&cb.TexTransform, texTransform);
+	cb.Mat = mat;
+
+	size_t offset = _objectRing.Push(cb);
+	assert(offset != ConstantRing::InvalidOffset);
+	return offset;
+}
+
 void TexturesApp::OnMouseDown(WPARAM btnState, int x, int y)
 {
 	mLastMousePos.x = x;
@@ -400,6 +429,8 @@ void TexturesApp::OnMouseMove(WPARAM btnState, int x, int y)
 /// </summary>
 void TexturesApp::BuildGeometryBuffers()
 {
+	TELEMETRY_SCOPE("BuildGeometryBuffers");
+
 	Vertex::Basic32 phoneVertices[] =
 	{
 		// back
@@ -451,148 +482,105 @@ void TexturesApp::BuildGeometryBuffers()
 		{ XMFLOAT3(-3.65f, 0.8f, -7.35f), XMFLOAT3(-1.0f, 0.0f, 0.0f), XMFLOAT2(0.944f, 0.943f), XMFLOAT2(0,0) }
 	};
 
-	GeometryGenerator::MeshData wall;
-	GeometryGenerator::MeshData grid;
-	GeometryGenerator geoGen;
-
-	geoGen.CreateBox(200, 100, 10.0f, wall);
-	geoGen.CreateGrid(200, 200, 10, 10, grid);
-
-	_phoneVertexOffset = 0;
-	_wallsVertexOffset = 36;
-	_gridsVertexOffset = wall.Vertices.size() + _wallsVertexOffset;
-
-	_phoneIndexCount = 36;
-	_wallsIndexCount = wall.Indices.size();
-	_gridsIndexCount = grid.Indices.size();
-
-	_phoneIndexOffset = 0;
-	_wallsIndexOffset = _phoneIndexCount;
-	_gridsIndexOffset = _wallsIndexCount + _wallsIndexOffset;
+	//
+	// Lay out every mesh in one vertex and index buffer. The phone is moved in, the
+	// box and grid are generated straight into the arena's staging block.
+	//
+	GeometryArena<Vertex::Basic32> arena;
+	arena.Reserve(3);
 
-	_vertexCount = 36 + wall.Vertices.size() + grid.Vertices.size();
+	UINT phoneIndices[36];
+	for (UINT i = 0; i < 36; ++i)
+		phoneIndices[i] = i;
 
-	_indexCount = _phoneIndexCount +_wallsIndexCount + _gridsIndexCount;
+	_phoneRange = arena.Add(std::vector<Vertex::Basic32>(phoneVertices, phoneVertices + 36),
+		std::vector<UINT>(phoneIndices, phoneIndices + 36));
 
-	std::vector<Vertex::Basic32> vertices(_vertexCount);
-
-	UINT k = 0;
-	for (size_t i = 0; i < 36; ++i, ++k)
-	{
-		vertices[k] = phoneVertices[i];
-	}
-	for (size_t i = 0; i < wall.Vertices.size(); ++i, ++k)
+	MeshBuilder::Counts wall = MeshBuilder::BoxCounts();
+	_wallsRange = arena.Add(wall.Vertices, wall.Indices, [](Vertex::Basic32* vertices, UINT* indices)
 	{
-		vertices[k].Pos = wall.Vertices[i].Position;
-		vertices[k].Normal = XMFLOAT3(0, 0, 1);
-	}
-	for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
+		MeshBuilder::CreateBox(200, 100, 10.0f, vertices, indices, [](Vertex::Basic32& v, const MeshBuilder::Attributes& a)
+		{
+			v.Pos = XMFLOAT3(a.Position[0], a.Position[1], a.Position[2]);
+			v.Normal = XMFLOAT3(0, 0, 1);
+			v.Tex01 = XMFLOAT2(0, 0);
+			v.Tex02 = XMFLOAT2(0, 0);
+		});
+	});
+
+	MeshBuilder::Counts grid = MeshBuilder::GridCounts(10, 10);
+	_gridsRange = arena.Add(grid.Vertices, grid.Indices, [](Vertex::Basic32* vertices, UINT* indices)
 	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Normal = XMFLOAT3(0, 1, 0);
-	}
+		MeshBuilder::CreateGrid(200, 200, 10, 10, vertices, indices, [](Vertex::Basic32& v, const MeshBuilder::Attributes& a)
+		{
+			v.Pos = XMFLOAT3(a.Position[0], a.Position[1], a.Position[2]);
+			v.Normal = XMFLOAT3(0, 1, 0);
+			v.Tex01 = XMFLOAT2(0, 0);
+			v.Tex02 = XMFLOAT2(0, 0);
+		});
+	});
+
+	arena.Build();
 
 	D3D11_BUFFER_DESC vbd;
 	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex::Basic32) * _vertexCount;
+	vbd.ByteWidth = (UINT)arena.VertexBytes();
 	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	vbd.CPUAccessFlags = 0;
 	vbd.MiscFlags = 0;
 	D3D11_SUBRESOURCE_DATA vinitData;
-	vinitData.pSysMem = &vertices[0];
+	vinitData.pSysMem = arena.VertexData();
 	HR(md3dDevice->CreateBuffer(&vbd, &vinitData, &_vertexBuffer));
 
-	// Create the index buffer
-	UINT phoneIndices[] =
-	{
-		// back
-		0, 1, 2,
-		3, 4, 5,
-
-		// front
-		6, 7, 8,
-		9, 10, 11,
-
-		// bottom
-		12, 13, 14,
-		15, 16, 17,
-
-		// right side
-		18, 19, 20,
-		21, 22, 23,
-
-		// top
-		24, 25, 26,
-		27, 28, 29,
-
-		// left side
-		30, 31, 32,
-		33, 34, 35
-	};
-
-	std::vector<UINT> indices;
-	// the convertion trick from array to vector didn't seem to work for the indices.. ? it did for the vertices.
-	for (int i = 0; i < 36; ++i) {
-		indices.push_back(phoneIndices[i]);
-	}
-	indices.insert(indices.end(), wall.Indices.begin(), wall.Indices.end());
-	indices.insert(indices.end(), grid.Indices.begin(), grid.Indices.end());
-
 	D3D11_BUFFER_DESC ibd;
 	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * _indexCount;
+	ibd.ByteWidth = (UINT)arena.IndexBytes();
 	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	ibd.CPUAccessFlags = 0;
 	ibd.MiscFlags = 0;
 	ibd.StructureByteStride = 0;
 	D3D11_SUBRESOURCE_DATA iinitData;
-	iinitData.pSysMem = &indices[0];
+	iinitData.pSysMem = arena.IndexData();
 	HR(md3dDevice->CreateBuffer(&ibd, &iinitData, &_indexBuffer));
 }
  
 /// <summary>
-/// Builds the resources for the screen rendering.
+/// Builds the frame graph for the current size of the window and binds its targets.
 /// </summary>
-void TexturesApp::BuildOffscreenViews()
+void TexturesApp::BuildFrameGraph()
 {
-	ReleaseCOM(_offscreenSRV);
-	ReleaseCOM(_offscreenRTV);
-	ReleaseCOM(_renderTargetTexture);
-
-	// describe the texture to render to
-	D3D11_TEXTURE2D_DESC texDesc;
-	ZeroMemory(&texDesc, sizeof(texDesc));
-	texDesc.Width = mClientWidth;
-	texDesc.Height = mClientHeight;
-	texDesc.MipLevels = 1;
-	texDesc.ArraySize = 1;
-	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	texDesc.SampleDesc.Count = 1;
-	texDesc.SampleDesc.Quality = 0;
-	texDesc.Usage = D3D11_USAGE_DEFAULT;
-	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	texDesc.CPUAccessFlags = 0;
-	texDesc.MiscFlags = 0;
-
-	// create the texture 
-	HR(md3dDevice->CreateTexture2D(&texDesc, NULL, &_renderTargetTexture));
-
-	// describe render target view
-	D3D11_RENDER_TARGET_VIEW_DESC renderTargetViewDesc;
-	renderTargetViewDesc.Format = texDesc.Format;
-	renderTargetViewDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-	renderTargetViewDesc.Texture2D.MipSlice = 0;
-	
-	// create the render target view
-	HR(md3dDevice->CreateRenderTargetView(_renderTargetTexture, &renderTargetViewDesc, &_offscreenRTV));
-
-	// describe shader resource view
-	D3D11_SHADER_RESOURCE_VIEW_DESC shaderResourceViewDesc;
-	shaderResourceViewDesc.Format = texDesc.Format;
-	shaderResourceViewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	shaderResourceViewDesc.Texture2D.MostDetailedMip = 0;
-	shaderResourceViewDesc.Texture2D.MipLevels = 1;
-
-	// create shader resource view
-	HR(md3dDevice->CreateShaderResourceView(_renderTargetTexture, &shaderResourceViewDesc, &_offscreenSRV));
+	TELEMETRY_SCOPE("BuildFrameGraph");
+
+	_frameGraph.Reset();
+
+	// describe the texture to render the screen to
+	TransientDesc screenDesc;
+	screenDesc.Width = mClientWidth;
+	screenDesc.Height = mClientHeight;
+	screenDesc.ArraySize = 1;
+	screenDesc.MipLevels = 1;
+	screenDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	screenDesc.BytesPerTexel = 4;
+	screenDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	screenDesc.MiscFlags = 0;
+
+	_screenTarget = _frameGraph.CreateTransient("PhoneScreen", screenDesc);
+	FrameGraph::ResourceId backBuffer = _frameGraph.Import("BackBuffer");
+	FrameGraph::ResourceId depthStencil = _frameGraph.Import("DepthStencil");
+
+	// draw everything in the scene except from the phone
+	FrameGraph::PassId screenPass = _frameGraph.AddPass("PhoneScreen", [this]() { DrawStart(); });
+	_frameGraph.Write(screenPass, _screenTarget);
+	_frameGraph.Write(screenPass, depthStencil, FrameGraph::DepthWrite);
+
+	// draw everything, including phone with screen texture
+	FrameGraph::PassId mainPass = _frameGraph.AddPass("Main", [this]() { DrawFinish(); });
+	_frameGraph.Read(mainPass, _screenTarget);
+	_frameGraph.Write(mainPass, backBuffer);
+	_frameGraph.Write(mainPass, depthStencil, FrameGraph::DepthWrite);
+
+	_frameGraph.Compile();
+	_targets.Bind(md3dDevice, _frameGraph);
+
+	OutputDebugStringA(_frameGraph.Report().c_str());
 }
\ No newline at end of file
@@ -6,6 +6,12 @@
 #include "LightHelper.h"
 #include "Effects.h"
 #include "Vertex.h"
+#include "RenderQueue.h"
+#include "GeometryArena.h"
+#include "Telemetry.h"
+#include "FrameGraph.h"
+#include "D3D11/RenderTargetPool.h"
+#include "ResourceRegistry.h"
 
 class TexturesApp : public D3DApp
 {
@@ -26,26 +32,63 @@ private:
 	void DrawStart();
 	void DrawFinish();
 	void BuildGeometryBuffers();
-	void BuildOffscreenViews();
+	void BuildFrameGraph();
 	void BuildMatrices();
 	void SetMaterials();
+	size_t PushObject(const XMFLOAT4X4& world, CXMMATRIX viewProj, CXMMATRIX texTransform, const Material& mat);
+	void QueueDraw(UINT tech, UINT texture, UINT material,
+		const DrawRange<Vertex::Basic32>& range, size_t objectCB, const XMFLOAT4X4& world);
+	void SubmitQueue();
 
 private:
+	// ids used in the render queue sort keys
+	enum TechniqueId { TechLight2, TechLight2Tex };
+	enum TextureId { NoTexture, PhoneTexture };
+	enum MaterialId { PhoneMaterial, WallMaterial, GridMaterial };
+
+	// what a queued draw needs beyond its sort key
+	struct QueuedDraw
+	{
+		UINT IndexCount;
+		UINT StartIndex;
+		int BaseVertex;
+		size_t ObjectCB;
+	};
+
 	// buffers containing geometry
 	ID3D11Buffer* _vertexBuffer;
 	ID3D11Buffer* _indexBuffer;
 
+	// creates the effect, the input layout and the phone texture; declared before
+	// the handles, so it outlives them
+	ResourceRegistry _resources;
+
 	// texture for the phone itself
+	ResourceHandle<ID3D11ShaderResourceView> _phoneMap;
 	ID3D11ShaderResourceView* _phoneMapSRV;
 
-	// render-to-texture variables to render the screen
-	ID3D11ShaderResourceView* _offscreenSRV;				
-	ID3D11Texture2D* _renderTargetTexture;					
-	ID3D11RenderTargetView* _offscreenRTV;
+	// the screen of the phone, rendered to a transient target of the frame graph
+	FrameGraph _frameGraph;
+	RenderTargetPool _targets;
+	FrameGraph::ResourceId _screenTarget;
+	ID3D11ShaderResourceView* _offscreenSRV;
 
 	// lights
 	DirectionalLight _dirLights[3];
 
+	// constant buffer records, packed once per frame
+	static const int ObjectRingSize = 16;
+	ConstantRing _objectRing;
+	CBPerFrame _perFrame;
+	size_t _phoneCB;
+	size_t _wallsCB[4];
+	size_t _gridsCB[2];
+
+	// draws of the current frame, sorted per pass
+	std::vector<QueuedDraw> _draws;
+	RenderQueue _renderQueue;
+	RenderStateCache _stateCache;
+
 	// materials
 	Material _phoneMaterial;
 	Material _material;
@@ -60,20 +103,9 @@ private:
 	XMFLOAT4X4 _view;
 	XMFLOAT4X4 _proj;
 
-	UINT _indexCount;
-	UINT _vertexCount;
-
-	int _phoneVertexOffset;
-	int _wallsVertexOffset;
-	int _gridsVertexOffset;
-
-	UINT _phoneIndexOffset;
-	UINT _wallsIndexOffset;
-	UINT _gridsIndexOffset;
-
-	UINT _phoneIndexCount;
-	UINT _wallsIndexCount;
-	UINT _gridsIndexCount;
+	DrawRange<Vertex::Basic32> _phoneRange;
+	DrawRange<Vertex::Basic32> _wallsRange;
+	DrawRange<Vertex::Basic32> _gridsRange;
 
 	XMFLOAT3 mEyePosW;
 
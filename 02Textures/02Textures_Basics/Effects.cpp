@@ -5,32 +5,28 @@
 #include "Effects.h"
 
 #pragma region Effect
-Effect::Effect(ID3D11Device* device, const std::wstring& filename)
+Effect::Effect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename)
 	: mFX(0)
 {
-	std::ifstream fin(filename, std::ios::binary);
+	std::vector<char> compiledShader;
+	if (!RegistryResources::ReadFile(filename, compiledShader))
+	{
+		DXTrace(__FILE__, (DWORD)__LINE__, E_FAIL, filename.c_str(), true);
+		return;
+	}
 
-	fin.seekg(0, std::ios_base::end);
-	int size = (int)fin.tellg();
-	fin.seekg(0, std::ios_base::beg);
-	std::vector<char> compiledShader(size);
-
-	fin.read(&compiledShader[0], size);
-	fin.close();
-	
-	HR(D3DX11CreateEffectFromMemory(&compiledShader[0], size, 
-		0, device, &mFX));
+	mEffect = RegistryResources::CreateEffect(device, registry, &compiledShader[0], compiledShader.size());
+	mFX = mEffect.Get();
 }
 
 Effect::~Effect()
 {
-	ReleaseCOM(mFX);
 }
 #pragma endregion
 
 #pragma region BasicEffect
-BasicEffect::BasicEffect(ID3D11Device* device, const std::wstring& filename)
-	: Effect(device, filename)
+BasicEffect::BasicEffect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename)
+	: Effect(device, registry, filename)
 {
 	Light1Tech    = mFX->GetTechniqueByName("Light1");
 	Light2Tech    = mFX->GetTechniqueByName("Light2");
@@ -60,9 +56,9 @@ BasicEffect::~BasicEffect()
 
 BasicEffect* Effects::BasicFX = 0;
 
-void Effects::InitAll(ID3D11Device* device)
+void Effects::InitAll(ID3D11Device* device, ResourceRegistry& registry)
 {
-	BasicFX = new BasicEffect(device, L"FX/Basic.fxo");
+	BasicFX = new BasicEffect(device, registry, L"FX/Basic.fxo");
 }
 
 void Effects::DestroyAll()
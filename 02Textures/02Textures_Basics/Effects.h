@@ -9,18 +9,22 @@
 #define EFFECTS_H
 
 #include "d3dUtil.h"
+#include "D3D11/RegistryResources.h"
 
 #pragma region Effect
 class Effect
 {
 public:
-	Effect(ID3D11Device* device, const std::wstring& filename);
+	// The effect comes from the registry, shared with any effect of the same bytes.
+	Effect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename);
 	virtual ~Effect();
 
 private:
 	Effect(const Effect& rhs);
 	Effect& operator=(const Effect& rhs);
 
+	ResourceHandle<ID3DX11Effect> mEffect;
+
 protected:
 	ID3DX11Effect* mFX;
 };
@@ -30,7 +34,7 @@ protected:
 class BasicEffect : public Effect
 {
 public:
-	BasicEffect(ID3D11Device* device, const std::wstring& filename);
+	BasicEffect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename);
 	~BasicEffect();
 
 	void SetWorldViewProj(CXMMATRIX M)                  { WorldViewProj->SetMatrix(reinterpret_cast<const float*>(&M)); }
@@ -67,7 +71,8 @@ public:
 class Effects
 {
 public:
-	static void InitAll(ID3D11Device* device);
+	// The effects are created through registry, which must outlive them.
+	static void InitAll(ID3D11Device* device, ResourceRegistry& registry);
 	static void DestroyAll();
 
 	static BasicEffect* BasicFX;
@@ -62,7 +62,6 @@ TexturesApp::~TexturesApp()
 {
 	ReleaseCOM(mBoxVB);
 	ReleaseCOM(mBoxIB);
-	ReleaseCOM(mDiffuseMapSRV);
 
 	Effects::DestroyAll();
 	InputLayouts::DestroyAll();
@@ -78,11 +77,11 @@ bool TexturesApp::Init()
 		return false;
 
 	// Must init Effects first since InputLayouts depend on shader signatures.
-	Effects::InitAll(md3dDevice);
-	InputLayouts::InitAll(md3dDevice);
+	Effects::InitAll(md3dDevice, mResources);
+	InputLayouts::InitAll(md3dDevice, mResources);
 
-	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-		L"MyPhone.png", 0, 0, &mDiffuseMapSRV, 0 ));
+	mDiffuseMap = RegistryResources::LoadTexture(md3dDevice, mResources, L"MyPhone.png");
+	mDiffuseMapSRV = mDiffuseMap.Get();
  
 	BuildGeometryBuffers();
 
@@ -170,6 +169,8 @@ void TexturesApp::DrawScene()
     }
 
 	HR(mSwapChain->Present(0, 0));
+
+	mResources.EndFrame();
 }
 
 /// <summary>
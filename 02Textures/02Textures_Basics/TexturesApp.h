@@ -7,6 +7,7 @@
 #include "LightHelper.h"
 #include "Effects.h"
 #include "Vertex.h"
+#include "ResourceRegistry.h"
 
 class TexturesApp : public D3DApp
 {
@@ -30,6 +31,10 @@ private:
 	ID3D11Buffer* mBoxVB;
 	ID3D11Buffer* mBoxIB;
 
+	// Declared before the handles, so it outlives them.
+	ResourceRegistry mResources;
+
+	ResourceHandle<ID3D11ShaderResourceView> mDiffuseMap;
 	ID3D11ShaderResourceView* mDiffuseMapSRV;
 
 	DirectionalLight mDirLights[3];
@@ -16,7 +16,13 @@ const D3D11_INPUT_ELEMENT_DESC InputLayoutDesc::Basic32[3] =
 
 ID3D11InputLayout* InputLayouts::Basic32 = 0;
 
-void InputLayouts::InitAll(ID3D11Device* device)
+namespace
+{
+	// The registry reference behind the layout.
+	ResourceHandle<ID3D11InputLayout> Basic32Layout;
+}
+
+void InputLayouts::InitAll(ID3D11Device* device, ResourceRegistry& registry)
 {
 	D3DX11_PASS_DESC passDesc;
 
@@ -25,13 +31,14 @@ void InputLayouts::InitAll(ID3D11Device* device)
 	//
 
 	Effects::BasicFX->Light1Tech->GetPassByIndex(0)->GetDesc(&passDesc);
-	HR(device->CreateInputLayout(InputLayoutDesc::Basic32, 3, passDesc.pIAInputSignature, 
-		passDesc.IAInputSignatureSize, &Basic32));
+	Basic32Layout = RegistryResources::CreateInputLayout(device, registry, InputLayoutDesc::Basic32, 3, passDesc);
+	Basic32 = Basic32Layout.Get();
 }
 
 void InputLayouts::DestroyAll()
 {
-	ReleaseCOM(Basic32);
+	Basic32Layout.Reset();
+	Basic32 = 0;
 }
 
 #pragma endregion
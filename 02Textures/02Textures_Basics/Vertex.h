@@ -8,6 +8,7 @@
 #define VERTEX_H
 
 #include "d3dUtil.h"
+#include "ResourceRegistry.h"
 
 namespace Vertex
 {
@@ -30,7 +31,8 @@ public:
 class InputLayouts
 {
 public:
-	static void InitAll(ID3D11Device* device);
+	// The layouts are created through registry, which must outlive them.
+	static void InitAll(ID3D11Device* device, ResourceRegistry& registry);
 	static void DestroyAll();
 
 	static ID3D11InputLayout* Basic32;
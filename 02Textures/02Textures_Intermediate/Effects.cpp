@@ -5,7 +5,7 @@
 #include "Effects.h"
 
 #pragma region Effect
-Effect::Effect(ID3D11Device* device, const std::wstring& filename)
+Effect::Effect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename)
 	: mFX(0)
 {
 	DWORD shaderFlags = 0;
@@ -31,21 +31,20 @@ Effect::Effect(ID3D11Device* device, const std::wstring& filename)
 		DXTrace(__FILE__, (DWORD)__LINE__, hr,
 			L"D3DX11CompileFromFile", true);
 	}
-	HR(D3DX11CreateEffectFromMemory(
-		compiledShader->GetBufferPointer(),
-		compiledShader->GetBufferSize(),
-		0, device, &mFX));
+	mEffect = RegistryResources::CreateEffect(device, registry,
+		compiledShader->GetBufferPointer(), compiledShader->GetBufferSize());
+	mFX = mEffect.Get();
+	ReleaseCOM(compiledShader);
 }
 
 Effect::~Effect()
 {
-	ReleaseCOM(mFX);
 }
 #pragma endregion
 
 #pragma region BasicEffect
-BasicEffect::BasicEffect(ID3D11Device* device, const std::wstring& filename)
-	: Effect(device, filename)
+BasicEffect::BasicEffect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename)
+	: Effect(device, registry, filename)
 {
 	Light1Tech    = mFX->GetTechniqueByName("Light1");
 	Light2Tech    = mFX->GetTechniqueByName("Light2");
@@ -76,9 +75,9 @@ BasicEffect::~BasicEffect()
 
 BasicEffect* Effects::BasicFX = 0;
 
-void Effects::InitAll(ID3D11Device* device)
+void Effects::InitAll(ID3D11Device* device, ResourceRegistry& registry)
 {
-	BasicFX = new BasicEffect(device, L"FX/Basic.fx");
+	BasicFX = new BasicEffect(device, registry, L"FX/Basic.fx");
 }
 
 void Effects::DestroyAll()
@@ -74,8 +74,8 @@ bool TexturesApp::Init()
 		return false;
 
 	// Must init Effects first since InputLayouts depend on shader signatures.
-	Effects::InitAll(md3dDevice);
-	InputLayouts::InitAll(md3dDevice);
+	Effects::InitAll(md3dDevice, _resources);
+	InputLayouts::InitAll(md3dDevice, _resources);
 
 	// build vector with all file names used as textures
 	std::vector<std::wstring> phoneFileNames;
@@ -169,6 +169,8 @@ void TexturesApp::DrawScene()
     }
 
 	HR(mSwapChain->Present(0, 0));
+
+	_resources.EndFrame();
 }
 
 void TexturesApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -6,6 +6,7 @@
 #include "LightHelper.h"
 #include "Effects.h"
 #include "Vertex.h"
+#include "ResourceRegistry.h"
 
 class TexturesApp : public D3DApp
 {
@@ -26,6 +27,9 @@ private:
 	void BuildGeometryBuffers();
 
 private:
+	// Creates the effect and the input layout; declared first, so it outlives them.
+	ResourceRegistry _resources;
+
 	ID3D11Buffer* _vertexBuffer;
 	ID3D11Buffer* _indexBuffer;
 
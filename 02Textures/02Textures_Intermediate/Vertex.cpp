@@ -17,7 +17,13 @@ const D3D11_INPUT_ELEMENT_DESC InputLayoutDesc::Basic32[4] =
 
 ID3D11InputLayout* InputLayouts::Basic32 = 0;
 
-void InputLayouts::InitAll(ID3D11Device* device)
+namespace
+{
+	// The registry reference behind the layout.
+	ResourceHandle<ID3D11InputLayout> Basic32Layout;
+}
+
+void InputLayouts::InitAll(ID3D11Device* device, ResourceRegistry& registry)
 {
 	D3DX11_PASS_DESC passDesc;
 
@@ -26,13 +32,14 @@ void InputLayouts::InitAll(ID3D11Device* device)
 	//
 
 	Effects::BasicFX->Light1Tech->GetPassByIndex(0)->GetDesc(&passDesc);
-	HR(device->CreateInputLayout(InputLayoutDesc::Basic32, 4, passDesc.pIAInputSignature, 
-		passDesc.IAInputSignatureSize, &Basic32));
+	Basic32Layout = RegistryResources::CreateInputLayout(device, registry, InputLayoutDesc::Basic32, 4, passDesc);
+	Basic32 = Basic32Layout.Get();
 }
 
 void InputLayouts::DestroyAll()
 {
-	ReleaseCOM(Basic32);
+	Basic32Layout.Reset();
+	Basic32 = 0;
 }
 
 #pragma endregion
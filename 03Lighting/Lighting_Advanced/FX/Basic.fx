@@ -47,6 +47,7 @@ struct VertexIn
 	float3 PosL    : POSITION;
 	float3 NormalL : NORMAL;
 	float2 Tex     : TEXCOORD;
+	float4 Baked   : COLOR;
 };
 
 struct VertexOut
@@ -57,6 +58,7 @@ struct VertexOut
     float3 NormalW : NORMAL;
 	float2 Tex     : TEXCOORD;
     float3 LightPos : TEXCOORD2;
+	float4 Baked   : COLOR;
 };
 
 VertexOut VS(VertexIn vin)
@@ -76,10 +78,12 @@ VertexOut VS(VertexIn vin)
 
     vout.LightPos = gPointLight.Position.xyz - vout.PosW.xyz;
 
+	vout.Baked = vin.Baked;
+
 	return vout;
 }
  
-float4 PS(VertexOut pin, uniform int gLightCount, uniform bool gUseTexure) : SV_Target
+float4 PS(VertexOut pin, uniform int gLightCount, uniform bool gUseTexure, uniform bool gBaked) : SV_Target
 {
     float brightness = 4.0f;
     float lightIntensity;
@@ -132,7 +136,13 @@ float4 PS(VertexOut pin, uniform int gLightCount, uniform bool gUseTexure) : SV_
 	//
 
 	float4 litColor = texColor;
-	if( gLightCount > 0  )
+	if( gBaked )
+	{
+		// The directional lights have no specular color, so their ambient and
+		// diffuse light baked into the vertices is all they contribute.
+		litColor = texColor*pin.Baked;
+	}
+	else if( gLightCount > 0  )
 	{  
 		// Start with a sum of zero. 
 		float4 ambient = float4(0.0f, 0.0f, 0.0f, 0.0f);
@@ -213,7 +223,7 @@ technique11 Light1
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, false, false) ) );
     }
 }
 
@@ -223,7 +233,7 @@ technique11 Light2
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, false, false) ) );
     }
 }
 
@@ -233,7 +243,7 @@ technique11 Light3
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false) ) );
     }
 }
 
@@ -243,7 +253,7 @@ technique11 Light0Tex
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(0, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(0, true, false) ) );
     }
 }
 
@@ -253,7 +263,7 @@ technique11 Light1Tex
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, true, false) ) );
     }
 }
 
@@ -263,7 +273,7 @@ technique11 Light2Tex
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, true, false) ) );
     }
 }
 
@@ -273,6 +283,16 @@ technique11 Light3Tex
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false) ) );
+    }
+}
+
+technique11 Light3TexBaked
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, true) ) );
     }
 }
@@ -1,4 +1,9 @@
 #include "LightingApp.h"
+#include "MeshBuilder.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 				   PSTR cmdLine, int showCmd)
@@ -9,6 +14,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 #endif
 	AllocConsole();
 	LightingApp theApp(hInstance);
+
+	// "-gpubudget MB" caps the video memory the demo keeps.
+	const char* budget = strstr(cmdLine, "-gpubudget");
+	if (budget)
+		theApp.SetGpuBudget((UINT64)atoi(budget + strlen("-gpubudget"))*1024*1024);
 	
 	if( !theApp.Init() )
 		return 0;
@@ -22,11 +32,14 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 /// </summary>
 /// <param name="hInstance">The h instance.</param>
 LightingApp::LightingApp(HINSTANCE hInstance)
-: D3DApp(hInstance), _vertexBuffer(0), _indexBuffer(0),
-  mFX(0), mTech(0), mfxWorld(0), mfxWorldInvTranspose(0), mfxEyePosW(0), 
+: D3DApp(hInstance), _vertexBuffer(0), _indexBuffer(0), _gridResolution(1000),
+  _waterVertexBuffer(0), _waterIndexBuffer(0), _transparentBS(0), _waterIndexCount(0), _waveDisturbTime(0.0f),
+  mFX(0), mTech(0), mWaterTech(0), mfxWorld(0), mfxWorldInvTranspose(0), mfxEyePosW(0), 
   mfxDirLight(0), mfxPointLight(0), mfxSpotLight(0), mfxMaterial(0),
   mfxWorldViewProj(0), _waterTexOffset(0.0f, 0.0f),
-  mInputLayout(0), mEyePosW(0.0f, 0.0f, 0.0f), mTheta(1.5f*MathHelper::Pi), mPhi(0.45f*MathHelper::Pi), mRadius(30.0f)
+  mInputLayout(0), mEyePosW(0.0f, 0.0f, 0.0f), mTheta(1.5f*MathHelper::Pi), mPhi(0.45f*MathHelper::Pi), mRadius(30.0f),
+  mPerFrame(&mUploads),
+  mWaves(160, 160, 1.0f, 0.03f, 3.25f, 0.4f, sizeof(Vertex))
 {
 	mMainWndCaption = L"Laser Light";
 	
@@ -43,6 +56,10 @@ LightingApp::LightingApp(HINSTANCE hInstance)
 
 	XMStoreFloat4x4(&_gridsWorld, XMMatrixTranslation(0.0f, -5.0f, 0.0f));
 
+	// The water floats a few units above the sand.
+	XMStoreFloat4x4(&_waterWorld, XMMatrixTranslation(0.0f, -2.0f, 0.0f));
+	XMStoreFloat4x4(&_waterTexTransform, XMMatrixScaling(5.0f, 5.0f, 0.0f));
+
 	XMMATRIX lightRotate = XMMatrixLookAtLH(XMVectorSet(0.1f, 5.0f, 0.0f, 1.0f), XMVectorSet(0.0f, -10.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
 	XMStoreFloat4x4(&_lightView, lightRotate);
 
@@ -75,6 +92,10 @@ LightingApp::LightingApp(HINSTANCE hInstance)
 	_gridMaterial.Ambient  = XMFLOAT4(0.1f, 0.1f, 0.1f, 1.0f);
 	_gridMaterial.Diffuse  = XMFLOAT4(0.1f, 0.1f, 0.1f, 1.0f);
 	_gridMaterial.Specular = XMFLOAT4(0.2f, 0.2f, 0.2f, 16.0f);
+
+	_waterMaterial.Ambient  = XMFLOAT4(0.5f, 0.5f, 0.5f, 1.0f);
+	_waterMaterial.Diffuse  = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.5f);
+	_waterMaterial.Specular = XMFLOAT4(0.8f, 0.8f, 0.8f, 32.0f);
 }
 
 /// <summary>
@@ -82,11 +103,26 @@ LightingApp::LightingApp(HINSTANCE hInstance)
 /// </summary>
 LightingApp::~LightingApp()
 {
+	// Nothing may stay bound once the tracked resources are released below.
+	if (md3dImmediateContext)
+		md3dImmediateContext->ClearState();
+
 	ReleaseCOM(_vertexBuffer);
 	ReleaseCOM(_indexBuffer);
+	ReleaseCOM(_waterVertexBuffer);
+	ReleaseCOM(_waterIndexBuffer);
+	ReleaseCOM(_transparentBS);
+	ReleaseCOM(_sandMapSRV);
+	ReleaseCOM(_waterMapSRV);
 
 	ReleaseCOM(mFX);
 	ReleaseCOM(mInputLayout);
+
+	std::ofstream gpuMemory("gpu_memory.json");
+	gpuMemory << _gpuMemory.Snapshot();
+
+	if (AllocationProfiler::Enabled())
+		OutputDebugStringA(AllocationProfiler::Report().c_str());
 }
 
 /// <summary>
@@ -104,10 +140,20 @@ bool LightingApp::Init()
 	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice,
 		L"water.png", 0, 0, &_waterMapSRV, 0));
 
+	GpuResources::Track(_gpuMemory, TextureMemory, "sand.png", _sandMapSRV);
+	GpuResources::Track(_gpuMemory, TextureMemory, "water.png", _waterMapSRV);
+
 	BuildGeometryBuffers();
+	BuildWaterBuffers();
 	BuildFX();
 	BuildVertexLayout();
 
+	// The staging memory is only needed again if the grid is rebuilt.
+	_scratch.Trim();
+
+	// Over the budget, the sand grid halves its resolution, one step a frame.
+	_gpuMemory.AddDowngrade(GeometryMemory, [this]() { return ReduceGridDetail(); });
+
 	return true;
 }
 
@@ -146,6 +192,33 @@ void LightingApp::UpdateScene(float dt)
 	// Translate texture over time.	
 	offsetWater += 0.05f*dt;
 	if (offsetWater > 1.0f) offsetWater = 0;
+
+	// Every quarter second, generate a random wave.
+	if ((mTimer.TotalTime() - _waveDisturbTime) >= 0.25f)
+	{
+		_waveDisturbTime += 0.25f;
+
+		DWORD i = 5 + rand() % (mWaves.RowCount() - 10);
+		DWORD j = 5 + rand() % (mWaves.ColumnCount() - 10);
+
+		float r = MathHelper::RandF(1.0f, 2.0f);
+
+		mWaves.Disturb(i, j, r);
+	}
+
+	// The step writes the back staging area while the front one, written by the
+	// previous step, is copied into the dynamic buffer.
+	const void* front = mWaves.FrontVertices();
+
+	JobCounter stepped;
+	mJobs.Submit([this, dt]() { mWaves.Update(dt, &mJobs); }, &stepped);
+
+	D3D11_MAPPED_SUBRESOURCE mappedData;
+	HR(md3dImmediateContext->Map(_waterVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData));
+	memcpy(mappedData.pData, front, mWaves.VertexCount()*sizeof(Vertex));
+	md3dImmediateContext->Unmap(_waterVertexBuffer, 0);
+
+	mJobs.Wait(stepped);
 }
 
 /// <summary>
@@ -172,43 +245,98 @@ void LightingApp::DrawScene()
 
 	XMMATRIX viewProj = view*proj;
 
-	// Set per frame constants.
-	mfxDirLight->SetRawValue(&mDirLights, 0, sizeof(mDirLights));
-	mfxPointLight->SetRawValue(&pointLight, 0, sizeof(pointLight));
-	mfxOffset->SetFloat(offsetWater);
+	mUploads.BeginFrame();
+
+	// Set per frame constants. Zeroed first, so the padding compares equal every frame.
+	CBPerFrame perFrame;
+	ZeroMemory(&perFrame, sizeof(perFrame));
+	for (int i = 0; i < 3; ++i)
+	{
+		perFrame.DirLights[i] = mDirLights[i];
+		perFrame.DirLights[i].Pad = 0.0f;
+	}
+	perFrame.EyePosW = mEyePosW;
+	perFrame.FogStart = 10.0f;
+	perFrame.FogRange = 200.0f;
+	perFrame.FogColor = XMFLOAT4(0.015f, 0.152f, 0.247f, 1.0f);
+	perFrame.Point = pointLight;
+	perFrame.Point.Pad = 0.0f;
+	perFrame.Offset = offsetWater;
+
+	if (mPerFrame.Update(perFrame))
+	{
+		mfxDirLight->SetRawValue(perFrame.DirLights, 0, sizeof(perFrame.DirLights));
+		mfxPointLight->SetRawValue(&perFrame.Point, 0, sizeof(perFrame.Point));
+		mfxOffset->SetFloat(perFrame.Offset);
+		mfxEyePosW->SetRawValue(&perFrame.EyePosW, 0, sizeof(perFrame.EyePosW));
+		FogColor->SetFloatVector(reinterpret_cast<const float*>(&perFrame.FogColor));
+		FogStart->SetFloat(perFrame.FogStart);
+		FogRange->SetFloat(perFrame.FogRange);
+	}
 
 	mfxProjectionMap->SetResource(_waterMapSRV);
 
-	XMMATRIX pointViewProj = XMLoadFloat4x4(&_lightView) * XMLoadFloat4x4(&_lightProj);
-	mfxPointViewProj->SetMatrix(reinterpret_cast<float*>(&pointViewProj));
-	mfxEyePosW->SetRawValue(&mEyePosW, 0, sizeof(mEyePosW));
-	
-	FogColor->SetFloatVector(reinterpret_cast<const float*>(&XMFLOAT4(0.015f, 0.152f, 0.247f, 1.0f)));
-	FogStart->SetFloat(10.0f);
-	FogRange->SetFloat(200.0f);
+	// Set per object constants. The grid and the water share these variables, so they
+	// are set for each draw.
+	XMMATRIX world = XMLoadFloat4x4(&_gridsWorld);
+	XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
+	XMMATRIX worldViewProj = world*viewProj;
+	XMMATRIX lightViewProj = lightview*lightproj;
+	mfxWorld->SetMatrix(reinterpret_cast<float*>(&world));
+	mfxWorldInvTranspose->SetMatrix(reinterpret_cast<float*>(&worldInvTranspose));
+	mfxWorldViewProj->SetMatrix(reinterpret_cast<float*>(&worldViewProj));
+	mfxPointViewProj->SetMatrix(reinterpret_cast<float*>(&lightViewProj));
+	mfxTexTransform->SetMatrix(reinterpret_cast<const float*>(&_sandTexTransform));
+	mfxMaterial->SetRawValue(&_gridMaterial, 0, sizeof(_gridMaterial));
+
+	mfxDiffuseMap->SetResource(_sandMapSRV);
 
     D3DX11_TECHNIQUE_DESC techDesc;
     mTech->GetDesc( &techDesc );
     for(UINT p = 0; p < techDesc.Passes; ++p)
     {
-		// grid 1
-		// Set per object constants.
-		XMMATRIX world = XMLoadFloat4x4(&_gridsWorld);
-		XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
-		XMMATRIX worldViewProj = world*view*proj;
-
-		mfxWorld->SetMatrix(reinterpret_cast<float*>(&world));
-		mfxWorldInvTranspose->SetMatrix(reinterpret_cast<float*>(&worldInvTranspose));
-		mfxWorldViewProj->SetMatrix(reinterpret_cast<float*>(&worldViewProj));
-		mfxTexTransform->SetMatrix(reinterpret_cast<float*>(&_sandTexTransform));
-		mfxMaterial->SetRawValue(&_gridMaterial, 0, sizeof(_gridMaterial));
-		mfxDiffuseMap->SetResource(_sandMapSRV);
-
 		mTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
 		md3dImmediateContext->DrawIndexed(_gridsIndexCount, _gridsIndexOffset, _gridsVertexOffset);
     }
 
+	//
+	// Draw the water over the sand. Its normals change every step, so it is lit in the
+	// pixel shader instead of baked.
+	//
+	md3dImmediateContext->IASetVertexBuffers(0, 1, &_waterVertexBuffer, &stride, &offset);
+	md3dImmediateContext->IASetIndexBuffer(_waterIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+
+	XMMATRIX waterWorld = XMLoadFloat4x4(&_waterWorld);
+	XMMATRIX waterWorldInvTranspose = MathHelper::InverseTranspose(waterWorld);
+	XMMATRIX waterWorldViewProj = waterWorld*viewProj;
+	mfxWorld->SetMatrix(reinterpret_cast<float*>(&waterWorld));
+	mfxWorldInvTranspose->SetMatrix(reinterpret_cast<float*>(&waterWorldInvTranspose));
+	mfxWorldViewProj->SetMatrix(reinterpret_cast<float*>(&waterWorldViewProj));
+	mfxPointViewProj->SetMatrix(reinterpret_cast<float*>(&lightViewProj));
+	mfxTexTransform->SetMatrix(reinterpret_cast<const float*>(&_waterTexTransform));
+	mfxMaterial->SetRawValue(&_waterMaterial, 0, sizeof(_waterMaterial));
+	mfxDiffuseMap->SetResource(_waterMapSRV);
+
+	float blendFactor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	md3dImmediateContext->OMSetBlendState(_transparentBS, blendFactor, 0xffffffff);
+
+	mWaterTech->GetDesc(&techDesc);
+	for (UINT p = 0; p < techDesc.Passes; ++p)
+	{
+		mWaterTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
+		md3dImmediateContext->DrawIndexed(_waterIndexCount, 0, 0);
+	}
+
+	md3dImmediateContext->OMSetBlendState(0, blendFactor, 0xffffffff);
+
 	HR(mSwapChain->Present(0, 0));
+
+	UINT downgrades = _gpuMemory.Total().Downgrades;
+	_gpuMemory.EndFrame();
+	if (_gpuMemory.Total().Downgrades != downgrades)
+		OutputDebugStringA(_gpuMemory.Snapshot().c_str());
+
+	AllocationProfiler::EndFrame();
 }
 
 /// <summary>
@@ -267,37 +395,40 @@ void LightingApp::OnMouseMove(WPARAM btnState, int x, int y)
 /// </summary>
 void LightingApp::BuildGeometryBuffers()
 {
-	GeometryGenerator::MeshData grid;
-	GeometryGenerator geoGen;
-
-	geoGen.CreateGrid(1000, 1000, 1000, 1000, grid);
+	ALLOCATION_PHASE("BuildGeometryBuffers");
+	ALLOCATION_TAG("Geometry");
 
 	// Cache the vertex offsets to each object in the concatenated vertex buffer.
 	_gridsVertexOffset = 0;
 
+	// The grid, a million vertices at full resolution, is generated straight into the
+	// vertex and index arrays, which are sized once up front.
+	MeshBuilder::Counts gridCounts = MeshBuilder::GridCounts(_gridResolution, _gridResolution);
+
 	// Cache the index count of each object.
-	_gridsIndexCount = grid.Indices.size();
+	_gridsIndexCount = gridCounts.Indices;
 
 	// Cache the starting index for each object in the concatenated index buffer.
 	_gridsIndexOffset = 0;
 
-	UINT totalVertexCount = grid.Vertices.size();
+	UINT totalVertexCount = gridCounts.Vertices;
 
 	_indexCount = _gridsIndexCount;
 
-	//
-	// Extract the vertex elements we are interested and apply the height function to
-	// each vertex.  
-	//
-	std::vector<Vertex> vertices(totalVertexCount);
+	// Staged in scratch memory, which the water and any later rebuild reuse.
+	ScopedScratch staging(_scratch);
+	StagingVector<Vertex> vertices(totalVertexCount, Vertex(), StagingAllocator<Vertex>(&_scratch));
+	StagingVector<UINT> indices(_indexCount, 0, StagingAllocator<UINT>(&_scratch));
 
-	UINT k = 0;
-	for(size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Normal = XMFLOAT3(0,1,0);
-		vertices[k].Texture = grid.Vertices[i].TexC;
-	}
+	MeshBuilder::CreateGrid(1000, 1000, _gridResolution, _gridResolution, &vertices[0], &indices[0],
+		[](Vertex& v, const MeshBuilder::Attributes& a)
+		{
+			v.Pos = XMFLOAT3(a.Position[0], a.Position[1], a.Position[2]);
+			v.Normal = XMFLOAT3(0, 1, 0);
+			v.Texture = XMFLOAT2(a.TexC[0], a.TexC[1]);
+		}, &mJobs);
+
+	BakeStaticLight(&vertices[0], vertices.size());
 
     D3D11_BUFFER_DESC vbd;
     vbd.Usage = D3D11_USAGE_IMMUTABLE;
@@ -307,13 +438,7 @@ void LightingApp::BuildGeometryBuffers()
     vbd.MiscFlags = 0;
     D3D11_SUBRESOURCE_DATA vinitData;
     vinitData.pSysMem = &vertices[0];
-    HR(md3dDevice->CreateBuffer(&vbd, &vinitData, &_vertexBuffer));
-
-	//
-	// Pack the indices of all the meshes into one index buffer.
-	//
-	std::vector<UINT> indices;
-	indices.insert(indices.end(), grid.Indices.begin(), grid.Indices.end());
+    HR(GpuResources::CreateBuffer(md3dDevice, _gpuMemory, GeometryMemory, "Sand grid vertices", &vbd, &vinitData, &_vertexBuffer));
 
 	D3D11_BUFFER_DESC ibd;
     ibd.Usage = D3D11_USAGE_IMMUTABLE;
@@ -323,7 +448,127 @@ void LightingApp::BuildGeometryBuffers()
     ibd.MiscFlags = 0;
     D3D11_SUBRESOURCE_DATA iinitData;
 	iinitData.pSysMem = &indices[0];
-    HR(md3dDevice->CreateBuffer(&ibd, &iinitData, &_indexBuffer));
+    HR(GpuResources::CreateBuffer(md3dDevice, _gpuMemory, GeometryMemory, "Sand grid indices", &ibd, &iinitData, &_indexBuffer));
+}
+
+/// <summary>
+/// Rebuilds the sand grid at half its resolution. The old buffers go once the
+/// device lets go of them, when the next frame binds the new ones.
+/// </summary>
+/// <returns>False once the grid is at the coarsest resolution allowed.</returns>
+bool LightingApp::ReduceGridDetail()
+{
+	if (_gridResolution / 2 < MinGridResolution)
+		return false;
+
+	_gridResolution /= 2;
+
+	ReleaseCOM(_vertexBuffer);
+	ReleaseCOM(_indexBuffer);
+	BuildGeometryBuffers();
+	_scratch.Trim();
+	return true;
+}
+
+/// <summary>
+/// Sets the video memory the demo may use.
+/// </summary>
+/// <param name="bytes">The budget; 0 for none.</param>
+void LightingApp::SetGpuBudget(UINT64 bytes)
+{
+	_gpuMemory.SetTotalBudget(bytes);
+}
+
+/// <summary>
+/// Builds the dynamic water buffers, which the wave solver fills every frame.
+/// </summary>
+void LightingApp::BuildWaterBuffers()
+{
+	ALLOCATION_PHASE("BuildWaterBuffers");
+	ALLOCATION_TAG("Water");
+
+	UINT m = mWaves.RowCount();
+	UINT n = mWaves.ColumnCount();
+
+	// The solver writes positions and normals; texture coordinates and colors are
+	// filled in once in both of its staging areas.
+	for (UINT s = 0; s < 2; ++s)
+	{
+		Vertex* vertices = reinterpret_cast<Vertex*>(mWaves.StagingVertices(s));
+		for (UINT i = 0; i < m; ++i)
+		{
+			for (UINT j = 0; j < n; ++j)
+			{
+				vertices[i*n + j].Texture = XMFLOAT2(j/(n - 1.0f), i/(m - 1.0f));
+				vertices[i*n + j].Color = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+			}
+		}
+	}
+
+	D3D11_BUFFER_DESC vbd;
+	vbd.Usage = D3D11_USAGE_DYNAMIC;
+	vbd.ByteWidth = sizeof(Vertex) * mWaves.VertexCount();
+	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vbd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	vbd.MiscFlags = 0;
+	HR(GpuResources::CreateBuffer(md3dDevice, _gpuMemory, DynamicMemory, "Water vertices", &vbd, 0, &_waterVertexBuffer));
+
+	// The solver's vertices are laid out like CreateGrid's, so they take its indices.
+	_waterIndexCount = MeshBuilder::GridCounts(m, n).Indices;
+	ScopedScratch staging(_scratch);
+	StagingVector<UINT> indices(_waterIndexCount, 0, StagingAllocator<UINT>(&_scratch));
+	MeshBuilder::GridIndices(m, n, &indices[0]);
+
+	D3D11_BUFFER_DESC ibd;
+	ibd.Usage = D3D11_USAGE_IMMUTABLE;
+	ibd.ByteWidth = sizeof(UINT) * _waterIndexCount;
+	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	ibd.CPUAccessFlags = 0;
+	ibd.MiscFlags = 0;
+	D3D11_SUBRESOURCE_DATA iinitData;
+	iinitData.pSysMem = &indices[0];
+	HR(GpuResources::CreateBuffer(md3dDevice, _gpuMemory, GeometryMemory, "Water indices", &ibd, &iinitData, &_waterIndexBuffer));
+
+	D3D11_BLEND_DESC transparentDesc = { 0 };
+	transparentDesc.AlphaToCoverageEnable = false;
+	transparentDesc.IndependentBlendEnable = false;
+	transparentDesc.RenderTarget[0].BlendEnable = true;
+	transparentDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+	transparentDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	transparentDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	transparentDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	transparentDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+	transparentDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	transparentDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	HR(md3dDevice->CreateBlendState(&transparentDesc, &_transparentBS));
+}
+
+/// <summary>
+/// Bakes the light of the directional lights into the vertex colors of the grid. The
+/// lights never move, so only the laser light is left for the pixel shader.
+/// </summary>
+/// <param name="vertices">The grid vertices.</param>
+/// <param name="count">The number of vertices.</param>
+void LightingApp::BakeStaticLight(Vertex* vertices, size_t count)
+{
+	LightBaker baker;
+	for (int i = 0; i < 3; ++i)
+		baker.AddLight(LightModel::FromLayout<LightModel::DirectionalLight>(mDirLights[i]));
+
+	LightBaker::Surface surface;
+	surface.Positions = &vertices[0].Pos.x;
+	surface.Normals = &vertices[0].Normal.x;
+	surface.Stride = sizeof(Vertex);
+	surface.Count = count;
+	surface.World = &_gridsWorld._11;
+	surface.Material = LightModel::FromLayout<LightModel::Material>(_gridMaterial);
+	surface.Colors = &vertices[0].Color.x;
+	surface.ColorStride = sizeof(Vertex);
+
+	baker.Bake(surface, &mJobs);
+
+	// Check a sample of the vertices against the plain one-at-a-time evaluation.
+	assert(baker.MaxError(surface, 997) < 1e-4f);
 }
 
 /// <summary>
@@ -331,6 +576,9 @@ void LightingApp::BuildGeometryBuffers()
 /// </summary>
 void LightingApp::BuildFX()
 {
+	ALLOCATION_PHASE("BuildFX");
+	ALLOCATION_TAG("Effects");
+
 	DWORD shaderFlags = 0;
 #if defined( DEBUG ) || defined( _DEBUG )
 	shaderFlags |= D3D10_SHADER_DEBUG;
@@ -361,7 +609,8 @@ void LightingApp::BuildFX()
 	// Done with compiled shader.
 	ReleaseCOM(compiledShader);
 
-	mTech                = mFX->GetTechniqueByName("Light3Tex");
+	mTech                = mFX->GetTechniqueByName("Light3TexBaked");
+	mWaterTech           = mFX->GetTechniqueByName("Light3Tex");
 	mfxWorldViewProj     = mFX->GetVariableByName("gWorldViewProj")->AsMatrix();
 	mfxPointViewProj	 = mFX->GetVariableByName("gWorldViewProj2")->AsMatrix();
 
@@ -394,12 +643,13 @@ void LightingApp::BuildVertexLayout()
 	{
 		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
 		{"NORMAL",    0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"TEXCOORD", 0,  DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+		{"TEXCOORD", 0,  DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{"COLOR",    0,  DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 	};
 
 	// Create the input layout
     D3DX11_PASS_DESC passDesc;
     mTech->GetPassByIndex(0)->GetDesc(&passDesc);
-	HR(md3dDevice->CreateInputLayout(vertexDesc, 3, passDesc.pIAInputSignature, 
+	HR(md3dDevice->CreateInputLayout(vertexDesc, 4, passDesc.pIAInputSignature, 
 		passDesc.IAInputSignatureSize, &mInputLayout));
 }
\ No newline at end of file
@@ -5,12 +5,35 @@
 #include "LightHelper.h"
 #include "Waves.h"
 #include "d3dApp.h"
+#include "ConstantBuffer.h"
+#include "JobSystem.h"
+#include "LightBaker.h"
+#include "WaveSolver.h"
+#include "GpuBudget.h"
+#include "D3D11/GpuResources.h"
+#include "AllocationProfiler.h"
+#include "FrameMemory.h"
 
 struct Vertex
 {
 	XMFLOAT3 Pos;
 	XMFLOAT3 Normal;
 	XMFLOAT2 Texture;
+	XMFLOAT4 Color;		// baked light of the directional lights
+};
+
+// CPU mirror of the per frame cbuffer in FX/Basic.fx, padded to HLSL packing rules.
+struct CBPerFrame
+{
+	DirectionalLight DirLights[3];
+	XMFLOAT3 EyePosW;
+	float FogStart;
+	float FogRange;
+	float Pad[3];
+	XMFLOAT4 FogColor;
+	PointLight Point;
+	float Offset;
+	float Pad2[3];
 };
 
 class LightingApp : public D3DApp
@@ -28,22 +51,43 @@ public:
 	void OnMouseUp(WPARAM btnState, int x, int y);
 	void OnMouseMove(WPARAM btnState, int x, int y);
 
+	// Video memory the demo may use; over it, the sand grid gets coarser.
+	void SetGpuBudget(UINT64 bytes);
 
 private:
 	void BuildGeometryBuffers();
+	bool ReduceGridDetail();
+	void BuildWaterBuffers();
+	void BakeStaticLight(Vertex* vertices, size_t count);
 	void BuildFX();
 	void BuildVertexLayout();
 
 private:
+	// Declared first, so every resource tracked with it is gone before it.
+	GpuBudget _gpuMemory;
+
 	ID3D11Buffer* _vertexBuffer;
 	ID3D11Buffer* _indexBuffer;
 
+	// Dynamic buffer filled from the wave solver's front staging area every frame.
+	ID3D11Buffer* _waterVertexBuffer;
+	ID3D11Buffer* _waterIndexBuffer;
+	ID3D11BlendState* _transparentBS;
+
+	// Staging of the meshes while they are built; emptied once they are uploaded.
+	ScratchAllocator _scratch;
+
+	// Vertices along each side of the sand grid, halved when over the budget.
+	UINT _gridResolution;
+	static const UINT MinGridResolution = 125;
+
 	UINT gridSize;
 	UINT wallHeight;
 
 	DirectionalLight mDirLights[3];
 	PointLight pointLight;
 	Material _gridMaterial;
+	Material _waterMaterial;
 
 	ID3D11ShaderResourceView* _sandMapSRV;
 	ID3D11ShaderResourceView* _waterMapSRV;
@@ -51,6 +95,7 @@ private:
 
 	ID3DX11Effect* mFX;
 	ID3DX11EffectTechnique* mTech;
+	ID3DX11EffectTechnique* mWaterTech;
 	ID3DX11EffectMatrixVariable* mfxWorldViewProj;
 	ID3DX11EffectMatrixVariable* mfxPointViewProj;
 
@@ -72,6 +117,10 @@ private:
 
 	ID3DX11EffectScalarVariable* mfxOffset;
 
+	// Shadow of the per frame cbuffer, so unchanged constants are not uploaded again.
+	UploadStats mUploads;
+	ConstantBuffer<CBPerFrame> mPerFrame;
+
 	ID3D11InputLayout* mInputLayout;
 
 	// Define transformations from local spaces to world space.
@@ -80,6 +129,8 @@ private:
 	XMFLOAT4X4 mProj;
 	XMFLOAT4X4 _gridsWorld;
 	XMFLOAT4X4 _sandTexTransform;
+	XMFLOAT4X4 _waterWorld;
+	XMFLOAT4X4 _waterTexTransform;
 
 	XMFLOAT4X4 _lightView;
 	XMFLOAT4X4 _lightProj;
@@ -88,6 +139,8 @@ private:
 	UINT _gridsIndexOffset;
 	UINT _gridsIndexCount;
 	XMFLOAT2 _waterTexOffset;
+	UINT _waterIndexCount;
+	float _waveDisturbTime;
 
 	XMFLOAT3 mEyePosW;
 
@@ -96,4 +149,7 @@ private:
 	float mRadius;
 
 	POINT mLastMousePos;
+
+	JobSystem mJobs;
+	WaveSolver mWaves;
 };
@@ -1,4 +1,5 @@
 #include "LightingApp.h"
+#include "Heightfield.h"
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 				   PSTR cmdLine, int showCmd)
@@ -276,25 +277,6 @@ void LightingApp::OnMouseMove(WPARAM btnState, int x, int y)
 	_lastMousePos.y = y;
 }
 
-/// <summary>
-/// Gets the normal vector.
-/// </summary>
-/// <param name="x">The x.</param>
-/// <param name="z">The z.</param>
-/// <returns></returns>
-XMFLOAT3 LightingApp::GetNormal(float x, float z)const
-{
-	XMFLOAT3 n(
-		-0.03f*z*cosf(0.1f*x) - 0.3f*cosf(0.1f*z),
-		1.0f,
-		-0.3f*sinf(0.1f*x) + 0.03f*x*sinf(0.1f*z));
-
-	XMVECTOR unitNormal = XMVector3Normalize(XMLoadFloat3(&n));
-	XMStoreFloat3(&n, unitNormal);
-
-	return n;
-}
-
 /// <summary>
 /// Builds the geometry buffers.
 /// </summary>
@@ -342,21 +324,23 @@ void LightingApp::BuildGeometryBuffers()
 
 	UINT k = 0;
 	for (size_t i = 0; i < _vertexCountWand; ++i, ++k)
-	{
 		vertices[k].Pos = _wand.Vertices[i].Position;
-		vertices[k].Normal = GetNormal(vertices[k].Pos.x, vertices[k].Pos.z);
-	}
 
 	for (size_t i = 0; i < _vertexCountWall; ++i, ++k)
-	{
 		vertices[k].Pos = wall.Vertices[i].Position;
-		vertices[k].Normal = GetNormal(vertices[k].Pos.x, vertices[k].Pos.z);
-	}
 
-	for (size_t i = 0; i < _vertexCountGrid; ++i, ++k) {
+	for (size_t i = 0; i < _vertexCountGrid; ++i, ++k)
 		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Normal = GetNormal(vertices[k].Pos.x, vertices[k].Pos.z);
-	}
+
+	// Every vertex takes the normal of the hills at its x and z; the positions are
+	// left as they are.
+	Heightfield::Mesh mesh;
+	mesh.Positions = &vertices[0].Pos.x;
+	mesh.Stride = sizeof(Vertex);
+	mesh.Count = totalVertexCount;
+	mesh.Normals = &vertices[0].Normal.x;
+	mesh.NormalStride = sizeof(Vertex);
+	Heightfield::Evaluate(Heightfield::Hills(), mesh, &_jobs);
 
     D3D11_BUFFER_DESC vbd;
     vbd.Usage = D3D11_USAGE_IMMUTABLE;
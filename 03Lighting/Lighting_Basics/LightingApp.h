@@ -4,6 +4,7 @@
 #include "MathHelper.h"
 #include "LightHelper.h"
 #include "GeometryGenerator.h"
+#include "JobSystem.h"
 
 struct Vertex
 {
@@ -30,7 +31,6 @@ private:
 	void BuildGeometryBuffers();
 	void BuildFX();
 	void BuildVertexLayout();
-	XMFLOAT3 GetNormal(float x, float z)const;
 
 private:
 	GeometryGenerator::MeshData _wand;
@@ -90,4 +90,6 @@ private:
 	float _radius;
 
 	POINT _lastMousePos;
+
+	JobSystem _jobs;
 };
\ No newline at end of file
@@ -26,6 +26,7 @@ struct VertexIn
 {
 	float3 PosL    : POSITION;
 	float3 NormalL : NORMAL;
+	float4 Baked   : COLOR;
 };
 
 struct VertexOut
@@ -33,6 +34,7 @@ struct VertexOut
 	float4 PosH    : SV_POSITION;
     float3 PosW    : POSITION;
     float3 NormalW : NORMAL;
+	float4 Baked   : COLOR;
 };
 
 VertexOut VS(VertexIn vin)
@@ -45,11 +47,13 @@ VertexOut VS(VertexIn vin)
 		
 	// Transform to homogeneous clip space.
 	vout.PosH = mul(float4(vin.PosL, 1.0f), gWorldViewProj);
+
+	vout.Baked = vin.Baked;
 	
 	return vout;
 }
   
-float4 PS(VertexOut pin) : SV_Target
+float4 PS(VertexOut pin, uniform bool gBaked) : SV_Target
 {
 	// Interpolating normal can unnormalize it, so normalize it.
     pin.NormalW = normalize(pin.NormalW); 
@@ -65,10 +69,21 @@ float4 PS(VertexOut pin) : SV_Target
 	float4 A, D, S;
 
 	ComputeDirectionalLight(gMaterial, gDirLight, pin.NormalW, toEyeW, A, D, S);
-	ambient += A;  
-	diffuse += D;
 	spec    += S;
 
+	// The ambient and diffuse light of the directional light are either baked into
+	// the vertices or computed here; its specular light depends on the eye, so it
+	// is never baked.
+	if( gBaked )
+	{
+		ambient += pin.Baked;
+	}
+	else
+	{
+		ambient += A;  
+		diffuse += D;
+	}
+
 	ComputePointLight(gMaterial, gPointLight, pin.PosW, pin.NormalW, toEyeW, A, D, S);
 	ambient += A;
 	diffuse += D;
@@ -93,7 +108,17 @@ technique11 LightTech
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS() ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(false) ) );
+    }
+}
+
+technique11 BakedLightTech
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(true) ) );
     }
 }
 
@@ -1,4 +1,5 @@
 #include "LightingApp.h"
+#include "MeshBuilder.h"
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 				   PSTR cmdLine, int showCmd)
@@ -194,7 +195,7 @@ void LightingApp::DrawScene()
 			mfxMaterial->SetRawValue(&_gridMaterial, 0, sizeof(_gridMaterial));
 
 			mTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-			md3dImmediateContext->DrawIndexed(_gridsIndexCount, _gridsIndexOffset, _gridsVertexOffset);
+			md3dImmediateContext->DrawIndexed(_gridsRange.IndexCount, _gridsRange.StartIndex, _gridsRange.BaseVertex);
 		}
 		
 		for (int i = 0; i < 4; ++i) {
@@ -208,7 +209,7 @@ void LightingApp::DrawScene()
 			mfxMaterial->SetRawValue(&_wallMaterial, 0, sizeof(_wallMaterial));
 
 			mTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-			md3dImmediateContext->DrawIndexed(_wallsIndexCount, 0, 0);
+			md3dImmediateContext->DrawIndexed(_wallsRange[i].IndexCount, _wallsRange[i].StartIndex, _wallsRange[i].BaseVertex);
 		}
     }
 
@@ -302,77 +303,97 @@ void LightingApp::BoundInputParams()
 /// </summary>
 void LightingApp::BuildGeometryBuffers()
 {
-	GeometryGenerator::MeshData wall;
-	GeometryGenerator::MeshData grid;
-	GeometryGenerator geoGen;
-
-	geoGen.CreateBox(200, wallHeight, 10.0f, wall);
-	geoGen.CreateGrid(200, 200, 200, 200, grid);
-
-	// Cache the vertex offsets to each object in the concatenated vertex buffer.
-	_wallsVertexOffset = 0;
-	_gridsVertexOffset = wall.Vertices.size();
-
-	// Cache the index count of each object.
-	_wallsIndexCount = wall.Indices.size();
-	_gridsIndexCount = grid.Indices.size();
-
-	// Cache the starting index for each object in the concatenated index buffer.
-	_wallsIndexOffset = 0;
-	_gridsIndexOffset = _wallsIndexCount;
-
-	UINT totalVertexCount =
-		wall.Vertices.size() +
-		grid.Vertices.size();
-
-	_indexCount = _wallsIndexCount + _gridsIndexCount;
-
 	//
-	// Extract the vertex elements we are interested and apply the height function to
-	// each vertex.  
+	// Lay out every mesh in one vertex and index buffer; the meshes are generated
+	// straight into the arena's staging block when it is built.
 	//
-	std::vector<Vertex> vertices(totalVertexCount);
+	GeometryArena<Vertex> arena;
+	arena.Reserve(5);
 
-	UINT k = 0;
-	for (size_t i = 0; i < wall.Vertices.size(); ++i, ++k)
+	MeshBuilder::Counts wall = MeshBuilder::BoxCounts();
+	MeshBuilder::Counts grid = MeshBuilder::GridCounts(200, 200);
+	float height = (float)wallHeight;
+
+	for (int w = 0; w < 4; ++w)
 	{
-		vertices[k].Pos = wall.Vertices[i].Position;
-		vertices[k].Normal = XMFLOAT3(0, 0, 1);
+		_wallsRange[w] = arena.Add(wall.Vertices, wall.Indices, [height](Vertex* vertices, UINT* indices)
+		{
+			MeshBuilder::CreateBox(200, height, 10.0f, vertices, indices,
+				[](Vertex& v, const MeshBuilder::Attributes& a)
+				{
+					v.Pos = XMFLOAT3(a.Position[0], a.Position[1], a.Position[2]);
+					v.Normal = XMFLOAT3(0, 0, 1);
+				});
+		});
 	}
-	for(size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
+
+	_gridsRange = arena.Add(grid.Vertices, grid.Indices, [this](Vertex* vertices, UINT* indices)
 	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Normal = XMFLOAT3(0,1,0);
-	}
+		MeshBuilder::CreateGrid(200, 200, 200, 200, vertices, indices,
+			[](Vertex& v, const MeshBuilder::Attributes& a)
+			{
+				v.Pos = XMFLOAT3(a.Position[0], a.Position[1], a.Position[2]);
+				v.Normal = XMFLOAT3(0, 1, 0);
+			}, &mJobs);
+	});
+
+	arena.Build();
+
+	// The directional light never moves, so its ambient and diffuse light is baked into
+	// the vertex colors once here instead of being computed for every pixel.
+	for (int w = 0; w < 4; ++w)
+		BakeStaticLight(arena.Vertices(_wallsRange[w]), _wallsRange[w].VertexCount, _wallsWorld[w], _wallMaterial);
+	BakeStaticLight(arena.Vertices(_gridsRange), _gridsRange.VertexCount, _gridsWorld[0], _gridMaterial);
 
     D3D11_BUFFER_DESC vbd;
     vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * totalVertexCount;
+	vbd.ByteWidth = (UINT)arena.VertexBytes();
     vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
     vbd.CPUAccessFlags = 0;
     vbd.MiscFlags = 0;
     D3D11_SUBRESOURCE_DATA vinitData;
-    vinitData.pSysMem = &vertices[0];
+    vinitData.pSysMem = arena.VertexData();
     HR(md3dDevice->CreateBuffer(&vbd, &vinitData, &_vertexBuffer));
 
-	//
-	// Pack the indices of all the meshes into one index buffer.
-	//
-	std::vector<UINT> indices;
-	indices.insert(indices.end(), wall.Indices.begin(), wall.Indices.end());
-	indices.insert(indices.end(), grid.Indices.begin(), grid.Indices.end());
-
 	D3D11_BUFFER_DESC ibd;
     ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * _indexCount;
+	ibd.ByteWidth = (UINT)arena.IndexBytes();
     ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
     ibd.CPUAccessFlags = 0;
     ibd.MiscFlags = 0;
     D3D11_SUBRESOURCE_DATA iinitData;
-	iinitData.pSysMem = &indices[0];
+	iinitData.pSysMem = arena.IndexData();
     HR(md3dDevice->CreateBuffer(&ibd, &iinitData, &_indexBuffer));
 }
 
+/// <summary>
+/// Bakes the light of the directional light into the colors of the given vertices.
+/// </summary>
+/// <param name="vertices">The vertices.</param>
+/// <param name="count">The vertex count.</param>
+/// <param name="world">The world matrix the vertices are drawn with.</param>
+/// <param name="material">The material the vertices are drawn with.</param>
+void LightingApp::BakeStaticLight(Vertex* vertices, UINT count, const XMFLOAT4X4& world, const Material& material)
+{
+	LightBaker baker;
+	baker.AddLight(LightModel::FromLayout<LightModel::DirectionalLight>(_dirLight));
+
+	LightBaker::Surface surface;
+	surface.Positions = &vertices[0].Pos.x;
+	surface.Normals = &vertices[0].Normal.x;
+	surface.Stride = sizeof(Vertex);
+	surface.Count = count;
+	surface.World = &world._11;
+	surface.Material = LightModel::FromLayout<LightModel::Material>(material);
+	surface.Colors = &vertices[0].Color.x;
+	surface.ColorStride = sizeof(Vertex);
+
+	baker.Bake(surface, &mJobs);
+
+	// Check a sample of the vertices against the plain one-at-a-time evaluation.
+	assert(baker.MaxError(surface, 7) < 1e-4f);
+}
+
 /// <summary>
 /// Builds the fx.
 /// </summary>
@@ -391,7 +412,7 @@ void LightingApp::BuildFX()
 	HR(D3DX11CreateEffectFromMemory(&compiledShader[0], size, 
 		0, md3dDevice, &mFX));
 
-	mTech                = mFX->GetTechniqueByName("LightTech");
+	mTech                = mFX->GetTechniqueByName("BakedLightTech");
 	mfxWorldViewProj     = mFX->GetVariableByName("gWorldViewProj")->AsMatrix();
 	mfxWorld             = mFX->GetVariableByName("gWorld")->AsMatrix();
 	mfxWorldInvTranspose = mFX->GetVariableByName("gWorldInvTranspose")->AsMatrix();
@@ -410,12 +431,13 @@ void LightingApp::BuildVertexLayout()
 	D3D11_INPUT_ELEMENT_DESC vertexDesc[] =
 	{
 		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"NORMAL",    0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0}
+		{"NORMAL",    0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+		{"COLOR",     0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0}
 	};
 
 	// Create the input layout
     D3DX11_PASS_DESC passDesc;
     mTech->GetPassByIndex(0)->GetDesc(&passDesc);
-	HR(md3dDevice->CreateInputLayout(vertexDesc, 2, passDesc.pIAInputSignature, 
+	HR(md3dDevice->CreateInputLayout(vertexDesc, 3, passDesc.pIAInputSignature, 
 		passDesc.IAInputSignatureSize, &mInputLayout));
 }
\ No newline at end of file
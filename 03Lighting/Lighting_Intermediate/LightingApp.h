@@ -5,11 +5,15 @@
 #include "LightHelper.h"
 #include "Waves.h"
 #include "d3dApp.h"
+#include "GeometryArena.h"
+#include "JobSystem.h"
+#include "LightBaker.h"
 
 struct Vertex
 {
 	XMFLOAT3 Pos;
 	XMFLOAT3 Normal;
+	XMFLOAT4 Color;		// baked light of the directional light
 };
 
 class LightingApp : public D3DApp
@@ -31,6 +35,7 @@ public:
 
 private:
 	void BuildGeometryBuffers();
+	void BakeStaticLight(Vertex* vertices, UINT count, const XMFLOAT4X4& world, const Material& material);
 	void BuildFX();
 	void BuildVertexLayout();
 
@@ -68,13 +73,9 @@ private:
 	XMFLOAT4X4 _wallsWorld[4];
 	XMFLOAT4X4 _gridsWorld[2];
 
-	UINT _indexCount;
-	int _wallsVertexOffset;
-	int _gridsVertexOffset;
-	UINT _wallsIndexOffset;
-	UINT _gridsIndexOffset;
-	UINT _wallsIndexCount;
-	UINT _gridsIndexCount;
+	// Every wall has its own copy of the box, so it can have its own baked colors.
+	DrawRange<Vertex> _wallsRange[4];
+	DrawRange<Vertex> _gridsRange;
 
 	XMFLOAT3 mEyePosW;
 
@@ -83,4 +84,6 @@ private:
 	float mRadius;
 
 	POINT mLastMousePos;
+
+	JobSystem mJobs;
 };
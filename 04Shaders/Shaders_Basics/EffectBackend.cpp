@@ -0,0 +1,94 @@
+//***************************************************************************************
+// EffectBackend.cpp
+//***************************************************************************************
+
+#include "EffectBackend.h"
+
+// The scene records its constants with the layout of the effect's.
+static_assert(sizeof(ShadersScene::PerFrame) == sizeof(CBPerFrame), "ShadersScene::PerFrame must mirror CBPerFrame");
+static_assert(sizeof(ShadersScene::PerObject) == sizeof(CBPerObject), "ShadersScene::PerObject must mirror CBPerObject");
+
+EffectBackend::EffectBackend()
+	: mContext(0), mTech(0)
+{
+}
+
+void EffectBackend::RegisterGeometry(uint32_t id, ID3D11Buffer* vb, ID3D11Buffer* ib, UINT stride)
+{
+	if (id >= mGeometry.size())
+	{
+		Geometry empty = { 0, 0, 0 };
+		mGeometry.resize(id + 1, empty);
+	}
+
+	Geometry geometry = { vb, ib, stride };
+	mGeometry[id] = geometry;
+}
+
+void EffectBackend::RegisterResource(uint32_t id, ID3D11ShaderResourceView* srv)
+{
+	if (id >= mResources.size())
+		mResources.resize(id + 1, 0);
+
+	mResources[id] = srv;
+}
+
+void EffectBackend::Begin(ID3D11DeviceContext* context)
+{
+	mContext = context;
+	mTech = 0;
+}
+
+void EffectBackend::SetConstants(uint32_t slot, const void* data, size_t size)
+{
+	switch (slot)
+	{
+	case PerFrameConstants:
+		assert(size == sizeof(CBPerFrame));
+		Effects::BasicFX->SetPerFrame(*static_cast<const CBPerFrame*>(data));
+		break;
+	case PerObjectConstants:
+		assert(size == sizeof(CBPerObject));
+		Effects::BasicFX->SetPerObject(*static_cast<const CBPerObject*>(data));
+		break;
+	}
+}
+
+void EffectBackend::BindTechnique(uint32_t id)
+{
+	// Draws with a technique that failed to build are skipped.
+	mTech = Effects::BasicFX->GetTech(PermutationKey(id));
+	if (mTech)
+		mTech->GetDesc(&mTechDesc);
+	else
+		mTechDesc.Passes = 0;
+}
+
+void EffectBackend::BindResource(uint32_t slot, uint32_t id)
+{
+	ID3D11ShaderResourceView* srv = id < mResources.size() ? mResources[id] : 0;
+
+	if (slot == DiffuseMapSlot)
+		Effects::BasicFX->SetDiffuseMap(srv);
+	else if (slot == CubeMapSlot)
+		Effects::BasicFX->SetCubeMap(srv);
+}
+
+void EffectBackend::BindGeometry(uint32_t id)
+{
+	const Geometry& geometry = mGeometry[id];
+
+	UINT offset = 0;
+	mContext->IASetVertexBuffers(0, 1, &geometry.VB, &geometry.Stride, &offset);
+	mContext->IASetIndexBuffer(geometry.IB, DXGI_FORMAT_R32_UINT, 0);
+}
+
+void EffectBackend::DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex)
+{
+	// The effect applies the constants and resources set since the last draw.
+	for (UINT p = 0; p < mTechDesc.Passes; ++p)
+	{
+		mTech->GetPassByIndex(p)->Apply(0, mContext);
+		mContext->DrawIndexed(indexCount, startIndex, baseVertex);
+	}
+}
@@ -0,0 +1,49 @@
+//***************************************************************************************
+// EffectBackend.h
+//
+// Replays recorded command buffers through the BasicEffect on the immediate context.
+// Ids in the commands are resolved through the tables registered here.
+//***************************************************************************************
+
+#ifndef EFFECTBACKEND_H
+#define EFFECTBACKEND_H
+
+#include "d3dUtil.h"
+#include "CommandBuffer.h"
+#include "Effects.h"
+#include "ShadersScene.h"
+
+class EffectBackend : public CommandBackend
+{
+public:
+	EffectBackend();
+
+	void RegisterGeometry(uint32_t id, ID3D11Buffer* vb, ID3D11Buffer* ib, UINT stride);
+	void RegisterResource(uint32_t id, ID3D11ShaderResourceView* srv);
+
+	// Call before replaying into a new render target; forgets the bound technique.
+	void Begin(ID3D11DeviceContext* context);
+
+	void SetConstants(uint32_t slot, const void* data, size_t size);
+	void BindTechnique(uint32_t id);
+	void BindResource(uint32_t slot, uint32_t id);
+	void BindGeometry(uint32_t id);
+	void DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex);
+
+private:
+	struct Geometry
+	{
+		ID3D11Buffer* VB;
+		ID3D11Buffer* IB;
+		UINT Stride;
+	};
+
+	ID3D11DeviceContext* mContext;
+	ID3DX11EffectTechnique* mTech;
+	D3DX11_TECHNIQUE_DESC mTechDesc;
+
+	std::vector<Geometry> mGeometry;
+	std::vector<ID3D11ShaderResourceView*> mResources;
+};
+
+#endif // EFFECTBACKEND_H
@@ -5,89 +5,30 @@
 #include "Effects.h"
 
 #pragma region Effect
-Effect::Effect(ID3D11Device* device, const std::wstring& filename)
+Effect::Effect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename)
 	: mFX(0)
 {
-	std::ifstream fin(filename, std::ios::binary);
-
-	fin.seekg(0, std::ios_base::end);
-	int size = (int)fin.tellg();
-	fin.seekg(0, std::ios_base::beg);
-	std::vector<char> compiledShader(size);
-
-	fin.read(&compiledShader[0], size);
-	fin.close();
-	
-	HR(D3DX11CreateEffectFromMemory(&compiledShader[0], size, 
-		0, device, &mFX));
+	std::vector<char> compiledShader;
+	if (!RegistryResources::ReadFile(filename, compiledShader))
+	{
+		DXTrace(__FILE__, (DWORD)__LINE__, E_FAIL, filename.c_str(), true);
+		return;
+	}
+
+	mEffect = RegistryResources::CreateEffect(device, registry, &compiledShader[0], compiledShader.size());
+	mFX = mEffect.Get();
 }
 
 Effect::~Effect()
 {
-	ReleaseCOM(mFX);
 }
 #pragma endregion
 
 #pragma region BasicEffect
-BasicEffect::BasicEffect(ID3D11Device* device, const std::wstring& filename)
-	: Effect(device, filename)
+BasicEffect::BasicEffect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename)
+	: Effect(device, registry, filename), mTechs([this](PermutationKey key) { return CompileTech(key); }),
+	mPerFrame(&mUploads), mPerObject(&mUploads)
 {
-	Light1Tech    = mFX->GetTechniqueByName("Light1");
-	Light2Tech    = mFX->GetTechniqueByName("Light2");
-	Light3Tech    = mFX->GetTechniqueByName("Light3");
-
-	Light0TexTech = mFX->GetTechniqueByName("Light0Tex");
-	Light1TexTech = mFX->GetTechniqueByName("Light1Tex");
-	Light2TexTech = mFX->GetTechniqueByName("Light2Tex");
-	Light3TexTech = mFX->GetTechniqueByName("Light3Tex");
-
-	Light0TexAlphaClipTech = mFX->GetTechniqueByName("Light0TexAlphaClip");
-	Light1TexAlphaClipTech = mFX->GetTechniqueByName("Light1TexAlphaClip");
-	Light2TexAlphaClipTech = mFX->GetTechniqueByName("Light2TexAlphaClip");
-	Light3TexAlphaClipTech = mFX->GetTechniqueByName("Light3TexAlphaClip");
-
-	Light1FogTech    = mFX->GetTechniqueByName("Light1Fog");
-	Light2FogTech    = mFX->GetTechniqueByName("Light2Fog");
-	Light3FogTech    = mFX->GetTechniqueByName("Light3Fog");
-
-	Light0TexFogTech = mFX->GetTechniqueByName("Light0TexFog");
-	Light1TexFogTech = mFX->GetTechniqueByName("Light1TexFog");
-	Light2TexFogTech = mFX->GetTechniqueByName("Light2TexFog");
-	Light3TexFogTech = mFX->GetTechniqueByName("Light3TexFog");
-
-	Light0TexAlphaClipFogTech = mFX->GetTechniqueByName("Light0TexAlphaClipFog");
-	Light1TexAlphaClipFogTech = mFX->GetTechniqueByName("Light1TexAlphaClipFog");
-	Light2TexAlphaClipFogTech = mFX->GetTechniqueByName("Light2TexAlphaClipFog");
-	Light3TexAlphaClipFogTech = mFX->GetTechniqueByName("Light3TexAlphaClipFog");
-
-	Light1ReflectTech    = mFX->GetTechniqueByName("Light1Reflect");
-	Light2ReflectTech    = mFX->GetTechniqueByName("Light2Reflect");
-	Light3ReflectTech    = mFX->GetTechniqueByName("Light3Reflect");
-
-	Light0TexReflectTech = mFX->GetTechniqueByName("Light0TexReflect");
-	Light1TexReflectTech = mFX->GetTechniqueByName("Light1TexReflect");
-	Light2TexReflectTech = mFX->GetTechniqueByName("Light2TexReflect");
-	Light3TexReflectTech = mFX->GetTechniqueByName("Light3TexReflect");
-
-	Light0TexAlphaClipReflectTech = mFX->GetTechniqueByName("Light0TexAlphaClipReflect");
-	Light1TexAlphaClipReflectTech = mFX->GetTechniqueByName("Light1TexAlphaClipReflect");
-	Light2TexAlphaClipReflectTech = mFX->GetTechniqueByName("Light2TexAlphaClipReflect");
-	Light3TexAlphaClipReflectTech = mFX->GetTechniqueByName("Light3TexAlphaClipReflect");
-
-	Light1FogReflectTech    = mFX->GetTechniqueByName("Light1FogReflect");
-	Light2FogReflectTech    = mFX->GetTechniqueByName("Light2FogReflect");
-	Light3FogReflectTech    = mFX->GetTechniqueByName("Light3FogReflect");
-
-	Light0TexFogReflectTech = mFX->GetTechniqueByName("Light0TexFogReflect");
-	Light1TexFogReflectTech = mFX->GetTechniqueByName("Light1TexFogReflect");
-	Light2TexFogReflectTech = mFX->GetTechniqueByName("Light2TexFogReflect");
-	Light3TexFogReflectTech = mFX->GetTechniqueByName("Light3TexFogReflect");
-
-	Light0TexAlphaClipFogReflectTech = mFX->GetTechniqueByName("Light0TexAlphaClipFogReflect");
-	Light1TexAlphaClipFogReflectTech = mFX->GetTechniqueByName("Light1TexAlphaClipFogReflect");
-	Light2TexAlphaClipFogReflectTech = mFX->GetTechniqueByName("Light2TexAlphaClipFogReflect");
-	Light3TexAlphaClipFogReflectTech = mFX->GetTechniqueByName("Light3TexAlphaClipFogReflect");
-
 	WorldViewProj     = mFX->GetVariableByName("gWorldViewProj")->AsMatrix();
 	World             = mFX->GetVariableByName("gWorld")->AsMatrix();
 	WorldInvTranspose = mFX->GetVariableByName("gWorldInvTranspose")->AsMatrix();
@@ -100,16 +41,80 @@ BasicEffect::BasicEffect(ID3D11Device* device, const std::wstring& filename)
 	Mat               = mFX->GetVariableByName("gMaterial");
 	DiffuseMap        = mFX->GetVariableByName("gDiffuseMap")->AsShaderResource();
 	CubeMap           = mFX->GetVariableByName("gCubeMap")->AsShaderResource();
+
+	Clusters            = mFX->GetConstantBufferByName("cbClusters");
+	ClusterLights       = mFX->GetVariableByName("gClusterLights")->AsShaderResource();
+	ClusterRanges       = mFX->GetVariableByName("gClusterRanges")->AsShaderResource();
+	ClusterLightIndices = mFX->GetVariableByName("gClusterLightIndices")->AsShaderResource();
 }
 
 BasicEffect::~BasicEffect()
 {
 }
+
+void BasicEffect::SetClusterBuffers(ID3D11ShaderResourceView* lights, ID3D11ShaderResourceView* ranges, ID3D11ShaderResourceView* indices)
+{
+	ClusterLights->SetResource(lights);
+	ClusterRanges->SetResource(ranges);
+	ClusterLightIndices->SetResource(indices);
+}
+
+void BasicEffect::SetPerFrame(const CBPerFrame& cb)
+{
+	if (!mPerFrame.Update(cb))
+		return;
+
+	DirLights->SetRawValue(cb.DirLights, 0, 3*sizeof(DirectionalLight));
+	EyePosW->SetRawValue(&cb.EyePosW, 0, sizeof(XMFLOAT3));
+	FogStart->SetFloat(cb.FogStart);
+	FogRange->SetFloat(cb.FogRange);
+	FogColor->SetFloatVector(reinterpret_cast<const float*>(&cb.FogColor));
+}
+
+void BasicEffect::SetPerObject(const CBPerObject& cb)
+{
+	if (!mPerObject.Update(cb))
+		return;
+
+	World->SetMatrix(reinterpret_cast<const float*>(&cb.World));
+	WorldInvTranspose->SetMatrix(reinterpret_cast<const float*>(&cb.WorldInvTranspose));
+	WorldViewProj->SetMatrix(reinterpret_cast<const float*>(&cb.WorldViewProj));
+	TexTransform->SetMatrix(reinterpret_cast<const float*>(&cb.TexTransform));
+	Mat->SetRawValue(&cb.Mat, 0, sizeof(Material));
+}
+
+void BasicEffect::WarmUp(const std::string& filename)
+{
+	WarmupList list;
+	if (list.Load(filename))
+		mTechs.Warm(list);
+}
+
+void BasicEffect::SaveWarmupList(const std::string& filename)const
+{
+	mTechs.UsedKeys().Save(filename);
+}
+
+ID3DX11EffectTechnique* BasicEffect::CompileTech(PermutationKey key)
+{
+	// The technique objects are created together with the effect, so building a
+	// permutation here means looking it up and validating its passes once.
+	std::string name = key.TechniqueName();
+	ID3DX11EffectTechnique* tech = mFX->GetTechniqueByName(name.c_str());
+
+	if (!key.IsValid() || !tech->IsValid())
+	{
+		MessageBoxA(0, (name + " is not a technique in Basic.fx.").c_str(), 0, 0);
+		return 0;
+	}
+
+	return tech;
+}
 #pragma endregion
 
 #pragma region SkyEffect
-SkyEffect::SkyEffect(ID3D11Device* device, const std::wstring& filename)
-	: Effect(device, filename)
+SkyEffect::SkyEffect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename)
+	: Effect(device, registry, filename)
 {
 	SkyTech       = mFX->GetTechniqueByName("SkyTech");
 	WorldViewProj = mFX->GetVariableByName("gWorldViewProj")->AsMatrix();
@@ -126,10 +131,10 @@ SkyEffect::~SkyEffect()
 BasicEffect* Effects::BasicFX = 0;
 SkyEffect*   Effects::SkyFX   = 0;
 
-void Effects::InitAll(ID3D11Device* device)
+void Effects::InitAll(ID3D11Device* device, ResourceRegistry& registry)
 {
-	BasicFX = new BasicEffect(device, L"FX/Basic.fxo");
-	SkyFX   = new SkyEffect(device, L"FX/Sky.fxo");
+	BasicFX = new BasicEffect(device, registry, L"FX/Basic.fxo");
+	SkyFX   = new SkyEffect(device, registry, L"FX/Sky.fxo");
 }
 
 void Effects::DestroyAll()
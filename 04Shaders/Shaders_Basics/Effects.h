@@ -9,98 +9,103 @@
 #define EFFECTS_H
 
 #include "d3dUtil.h"
+#include "ShaderPermutation.h"
+#include "ConstantBuffer.h"
+#include "D3D11/RegistryResources.h"
 
 #pragma region Effect
 class Effect
 {
 public:
-	Effect(ID3D11Device* device, const std::wstring& filename);
+	// The compiled effect comes from the registry, shared with any effect of the same file.
+	Effect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename);
 	virtual ~Effect();
 
 private:
 	Effect(const Effect& rhs);
 	Effect& operator=(const Effect& rhs);
 
+	ResourceHandle<ID3DX11Effect> mEffect;
+
 protected:
 	ID3DX11Effect* mFX;
 };
 #pragma endregion
 
+#pragma region ConstantBuffers
+// CPU mirrors of the cbuffers in Basic.fx, padded to HLSL packing rules.
+struct CBPerFrame
+{
+	DirectionalLight DirLights[3];
+	XMFLOAT3 EyePosW;
+	float FogStart;
+	float FogRange;
+	float Pad[3];
+	XMFLOAT4 FogColor;
+};
+
+struct CBPerObject
+{
+	XMFLOAT4X4 World;
+	XMFLOAT4X4 WorldInvTranspose;
+	XMFLOAT4X4 WorldViewProj;
+	XMFLOAT4X4 TexTransform;
+	Material Mat;
+};
+
+// Mirror of cbClusters in ClusteredLighting.fx.
+struct CBClusters
+{
+	UINT ClusterDims[3];
+	float SliceScale;
+	XMFLOAT2 TileScale;
+	float SliceBias;
+	float Pad;
+};
+#pragma endregion
+
 #pragma region BasicEffect
 class BasicEffect : public Effect
 {
 public:
-	BasicEffect(ID3D11Device* device, const std::wstring& filename);
+	BasicEffect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename);
 	~BasicEffect();
 
-	void SetWorldViewProj(CXMMATRIX M)                  { WorldViewProj->SetMatrix(reinterpret_cast<const float*>(&M)); }
-	void SetWorld(CXMMATRIX M)                          { World->SetMatrix(reinterpret_cast<const float*>(&M)); }
-	void SetWorldInvTranspose(CXMMATRIX M)              { WorldInvTranspose->SetMatrix(reinterpret_cast<const float*>(&M)); }
-	void SetTexTransform(CXMMATRIX M)                   { TexTransform->SetMatrix(reinterpret_cast<const float*>(&M)); }
-	void SetEyePosW(const XMFLOAT3& v)                  { EyePosW->SetRawValue(&v, 0, sizeof(XMFLOAT3)); }
-	void SetFogColor(const FXMVECTOR v)                 { FogColor->SetFloatVector(reinterpret_cast<const float*>(&v)); }
-	void SetFogStart(float f)                           { FogStart->SetFloat(f); }
-	void SetFogRange(float f)                           { FogRange->SetFloat(f); }
-	void SetDirLights(const DirectionalLight* lights)   { DirLights->SetRawValue(lights, 0, 3*sizeof(DirectionalLight)); }
-	void SetMaterial(const Material& mat)               { Mat->SetRawValue(&mat, 0, sizeof(Material)); }
+	void SetWorldViewProj(CXMMATRIX M)                  { mPerObject.Invalidate(); WorldViewProj->SetMatrix(reinterpret_cast<const float*>(&M)); }
+	void SetWorld(CXMMATRIX M)                          { mPerObject.Invalidate(); World->SetMatrix(reinterpret_cast<const float*>(&M)); }
+	void SetWorldInvTranspose(CXMMATRIX M)              { mPerObject.Invalidate(); WorldInvTranspose->SetMatrix(reinterpret_cast<const float*>(&M)); }
+	void SetTexTransform(CXMMATRIX M)                   { mPerObject.Invalidate(); TexTransform->SetMatrix(reinterpret_cast<const float*>(&M)); }
+	void SetEyePosW(const XMFLOAT3& v)                  { mPerFrame.Invalidate(); EyePosW->SetRawValue(&v, 0, sizeof(XMFLOAT3)); }
+	void SetFogColor(const FXMVECTOR v)                 { mPerFrame.Invalidate(); FogColor->SetFloatVector(reinterpret_cast<const float*>(&v)); }
+	void SetFogStart(float f)                           { mPerFrame.Invalidate(); FogStart->SetFloat(f); }
+	void SetFogRange(float f)                           { mPerFrame.Invalidate(); FogRange->SetFloat(f); }
+	void SetDirLights(const DirectionalLight* lights)   { mPerFrame.Invalidate(); DirLights->SetRawValue(lights, 0, 3*sizeof(DirectionalLight)); }
+	void SetMaterial(const Material& mat)               { mPerObject.Invalidate(); Mat->SetRawValue(&mat, 0, sizeof(Material)); }
 	void SetDiffuseMap(ID3D11ShaderResourceView* tex)   { DiffuseMap->SetResource(tex); }
 	void SetCubeMap(ID3D11ShaderResourceView* tex)      { CubeMap->SetResource(tex); }
 
-	ID3DX11EffectTechnique* Light1Tech;
-	ID3DX11EffectTechnique* Light2Tech;
-	ID3DX11EffectTechnique* Light3Tech;
-
-	ID3DX11EffectTechnique* Light0TexTech;
-	ID3DX11EffectTechnique* Light1TexTech;
-	ID3DX11EffectTechnique* Light2TexTech;
-	ID3DX11EffectTechnique* Light3TexTech;
-
-	ID3DX11EffectTechnique* Light0TexAlphaClipTech;
-	ID3DX11EffectTechnique* Light1TexAlphaClipTech;
-	ID3DX11EffectTechnique* Light2TexAlphaClipTech;
-	ID3DX11EffectTechnique* Light3TexAlphaClipTech;
-
-	ID3DX11EffectTechnique* Light1FogTech;
-	ID3DX11EffectTechnique* Light2FogTech;
-	ID3DX11EffectTechnique* Light3FogTech;
-
-	ID3DX11EffectTechnique* Light0TexFogTech;
-	ID3DX11EffectTechnique* Light1TexFogTech;
-	ID3DX11EffectTechnique* Light2TexFogTech;
-	ID3DX11EffectTechnique* Light3TexFogTech;
-
-	ID3DX11EffectTechnique* Light0TexAlphaClipFogTech;
-	ID3DX11EffectTechnique* Light1TexAlphaClipFogTech;
-	ID3DX11EffectTechnique* Light2TexAlphaClipFogTech;
-	ID3DX11EffectTechnique* Light3TexAlphaClipFogTech;
-
-	ID3DX11EffectTechnique* Light1ReflectTech;
-	ID3DX11EffectTechnique* Light2ReflectTech;
-	ID3DX11EffectTechnique* Light3ReflectTech;
-
-	ID3DX11EffectTechnique* Light0TexReflectTech;
-	ID3DX11EffectTechnique* Light1TexReflectTech;
-	ID3DX11EffectTechnique* Light2TexReflectTech;
-	ID3DX11EffectTechnique* Light3TexReflectTech;
-
-	ID3DX11EffectTechnique* Light0TexAlphaClipReflectTech;
-	ID3DX11EffectTechnique* Light1TexAlphaClipReflectTech;
-	ID3DX11EffectTechnique* Light2TexAlphaClipReflectTech;
-	ID3DX11EffectTechnique* Light3TexAlphaClipReflectTech;
-
-	ID3DX11EffectTechnique* Light1FogReflectTech;
-	ID3DX11EffectTechnique* Light2FogReflectTech;
-	ID3DX11EffectTechnique* Light3FogReflectTech;
-
-	ID3DX11EffectTechnique* Light0TexFogReflectTech;
-	ID3DX11EffectTechnique* Light1TexFogReflectTech;
-	ID3DX11EffectTechnique* Light2TexFogReflectTech;
-	ID3DX11EffectTechnique* Light3TexFogReflectTech;
-
-	ID3DX11EffectTechnique* Light0TexAlphaClipFogReflectTech;
-	ID3DX11EffectTechnique* Light1TexAlphaClipFogReflectTech;
-	ID3DX11EffectTechnique* Light2TexAlphaClipFogReflectTech;
-	ID3DX11EffectTechnique* Light3TexAlphaClipFogReflectTech;
+	// Inputs of the Clustered permutations: the light grid layout, the lights, the
+	// light range of every cluster and the light index list the ranges point into.
+	void SetClusters(const CBClusters& cb)              { Clusters->SetRawValue(&cb, 0, sizeof(CBClusters)); }
+	void SetClusterBuffers(ID3D11ShaderResourceView* lights, ID3D11ShaderResourceView* ranges, ID3D11ShaderResourceView* indices);
+
+	// Write a whole cbuffer at once. The effect variables are left untouched, and so
+	// FX11 does not re-upload the cbuffer on the next Apply, when the contents are
+	// unchanged since the previous call.
+	void SetPerFrame(const CBPerFrame& cb);
+	void SetPerObject(const CBPerObject& cb);
+
+	UploadStats& Uploads()                              { return mUploads; }
+
+	// Returns the technique for a Light0..3 x Tex x AlphaClip x Fog x Reflect x Clustered permutation,
+	// resolving it the first time it is requested. Null if Basic.fx has no such
+	// technique; that is reported and not cached.
+	ID3DX11EffectTechnique* GetTech(PermutationKey key)  { return mTechs.Get(key); }
+
+	// Resolves the permutations listed in a warm-up file ahead of the first frame, and
+	// writes the permutations this run requested so the next startup can do the same.
+	void WarmUp(const std::string& filename);
+	void SaveWarmupList(const std::string& filename)const;
 
 	ID3DX11EffectMatrixVariable* WorldViewProj;
 	ID3DX11EffectMatrixVariable* World;
@@ -115,6 +120,20 @@ public:
 
 	ID3DX11EffectShaderResourceVariable* DiffuseMap;
 	ID3DX11EffectShaderResourceVariable* CubeMap;
+
+	ID3DX11EffectConstantBuffer* Clusters;
+	ID3DX11EffectShaderResourceVariable* ClusterLights;
+	ID3DX11EffectShaderResourceVariable* ClusterRanges;
+	ID3DX11EffectShaderResourceVariable* ClusterLightIndices;
+
+private:
+	ID3DX11EffectTechnique* CompileTech(PermutationKey key);
+
+	PermutationCache<ID3DX11EffectTechnique*> mTechs;
+
+	UploadStats mUploads;
+	ConstantBuffer<CBPerFrame> mPerFrame;
+	ConstantBuffer<CBPerObject> mPerObject;
 };
 #pragma endregion
 
@@ -122,7 +141,7 @@ public:
 class SkyEffect : public Effect
 {
 public:
-	SkyEffect(ID3D11Device* device, const std::wstring& filename);
+	SkyEffect(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& filename);
 	~SkyEffect();
 
 	void SetWorldViewProj(CXMMATRIX M)                  { WorldViewProj->SetMatrix(reinterpret_cast<const float*>(&M)); }
@@ -140,7 +159,8 @@ public:
 class Effects
 {
 public:
-	static void InitAll(ID3D11Device* device);
+	// The effects are created through registry, which must outlive them.
+	static void InitAll(ID3D11Device* device, ResourceRegistry& registry);
 	static void DestroyAll();
 
 	static BasicEffect* BasicFX;
@@ -5,6 +5,7 @@
 //=============================================================================
 
 #include "LightHelper.fx"
+#include "ClusteredLighting.fx"
  
 cbuffer cbPerFrame
 {
@@ -75,7 +76,8 @@ float4 PS(VertexOut pin,
 		  uniform bool gUseTexure, 
 		  uniform bool gAlphaClip, 
 		  uniform bool gFogEnabled, 
-		  uniform bool gReflectionEnabled) : SV_Target
+		  uniform bool gReflectionEnabled,
+		  uniform bool gClustered) : SV_Target
 {
 	// Interpolating normal can unnormalize it, so normalize it.
     pin.NormalW = normalize(pin.NormalW);
@@ -130,6 +132,12 @@ float4 PS(VertexOut pin,
 			spec    += S;
 		}
 
+		// Add the point and spot lights of this pixel's cluster.
+		if( gClustered )
+		{
+			ComputeClusteredLights(gMaterial, pin.PosH, pin.PosW, pin.NormalW, toEye, diffuse, spec);
+		}
+
 		litColor = texColor*(ambient + diffuse) + spec;
 
 		if( gReflectionEnabled )
@@ -166,7 +174,7 @@ technique11 Light1
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, false, false, false, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, false, false, false, false, false) ) );
     }
 }
 
@@ -176,7 +184,7 @@ technique11 Light2
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, false, false, false, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, false, false, false, false, false) ) );
     }
 }
 
@@ -186,7 +194,7 @@ technique11 Light3
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false, false, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false, false, false, false) ) );
     }
 }
 
@@ -196,7 +204,7 @@ technique11 Light0Tex
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(0, true, false, false, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(0, true, false, false, false, false) ) );
     }
 }
 
@@ -206,7 +214,7 @@ technique11 Light1Tex
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, true, false, false, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, true, false, false, false, false) ) );
     }
 }
 
@@ -216,7 +224,7 @@ technique11 Light2Tex
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, true, false, false, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, true, false, false, false, false) ) );
     }
 }
 
@@ -226,7 +234,7 @@ technique11 Light3Tex
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false, false) ) );
     }
 }
 
@@ -236,7 +244,7 @@ technique11 Light0TexAlphaClip
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(0, true, true, false, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(0, true, true, false, false, false) ) );
     }
 }
 
@@ -246,7 +254,7 @@ technique11 Light1TexAlphaClip
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, true, true, false, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, true, true, false, false, false) ) );
     }
 }
 
@@ -256,7 +264,7 @@ technique11 Light2TexAlphaClip
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, true, true, false, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, true, true, false, false, false) ) );
     }
 }
 
@@ -266,7 +274,7 @@ technique11 Light3TexAlphaClip
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, true, true, false, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, true, false, false, false) ) );
     }
 }
 
@@ -276,7 +284,7 @@ technique11 Light1Fog
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, false, false, true, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, false, false, true, false, false) ) );
     }
 }
 
@@ -286,7 +294,7 @@ technique11 Light2Fog
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, false, false, true, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, false, false, true, false, false) ) );
     }
 }
 
@@ -296,7 +304,7 @@ technique11 Light3Fog
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false, true, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false, true, false, false) ) );
     }
 }
 
@@ -306,7 +314,7 @@ technique11 Light0TexFog
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(0, true, false, true, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(0, true, false, true, false, false) ) );
     }
 }
 
@@ -316,7 +324,7 @@ technique11 Light1TexFog
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, true, false, true, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, true, false, true, false, false) ) );
     }
 }
 
@@ -326,7 +334,7 @@ technique11 Light2TexFog
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, true, false, true, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, true, false, true, false, false) ) );
     }
 }
 
@@ -336,7 +344,7 @@ technique11 Light3TexFog
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, true, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, true, false, false) ) );
     }
 }
 
@@ -346,7 +354,7 @@ technique11 Light0TexAlphaClipFog
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(0, true, true, true, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(0, true, true, true, false, false) ) );
     }
 }
 
@@ -356,7 +364,7 @@ technique11 Light1TexAlphaClipFog
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, true, true, true, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, true, true, true, false, false) ) );
     }
 }
 
@@ -366,7 +374,7 @@ technique11 Light2TexAlphaClipFog
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, true, true, true, false) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, true, true, true, false, false) ) );
     }
 }
 
@@ -376,7 +384,7 @@ technique11 Light3TexAlphaClipFog
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, true, true, true, false) ) ); 
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, true, true, false, false) ) ); 
     }
 }
 
@@ -386,7 +394,7 @@ technique11 Light1Reflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, false, false, false, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, false, false, false, true, false) ) );
     }
 }
 
@@ -396,7 +404,7 @@ technique11 Light2Reflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, false, false, false, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, false, false, false, true, false) ) );
     }
 }
 
@@ -406,7 +414,7 @@ technique11 Light3Reflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false, false, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false, false, true, false) ) );
     }
 }
 
@@ -416,7 +424,7 @@ technique11 Light0TexReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(0, true, false, false, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(0, true, false, false, true, false) ) );
     }
 }
 
@@ -426,7 +434,7 @@ technique11 Light1TexReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, true, false, false, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, true, false, false, true, false) ) );
     }
 }
 
@@ -436,7 +444,7 @@ technique11 Light2TexReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, true, false, false, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, true, false, false, true, false) ) );
     }
 }
 
@@ -446,7 +454,7 @@ technique11 Light3TexReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, true, false) ) );
     }
 }
 
@@ -456,7 +464,7 @@ technique11 Light0TexAlphaClipReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(0, true, true, false, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(0, true, true, false, true, false) ) );
     }
 }
 
@@ -466,7 +474,7 @@ technique11 Light1TexAlphaClipReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, true, true, false, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, true, true, false, true, false) ) );
     }
 }
 
@@ -476,7 +484,7 @@ technique11 Light2TexAlphaClipReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, true, true, false, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, true, true, false, true, false) ) );
     }
 }
 
@@ -486,7 +494,7 @@ technique11 Light3TexAlphaClipReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, true, true, false, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, true, false, true, false) ) );
     }
 }
 
@@ -496,7 +504,7 @@ technique11 Light1FogReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, false, false, true, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, false, false, true, true, false) ) );
     }
 }
 
@@ -506,7 +514,7 @@ technique11 Light2FogReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, false, false, true, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, false, false, true, true, false) ) );
     }
 }
 
@@ -516,7 +524,7 @@ technique11 Light3FogReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false, true, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false, true, true, false) ) );
     }
 }
 
@@ -526,7 +534,7 @@ technique11 Light0TexFogReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(0, true, false, true, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(0, true, false, true, true, false) ) );
     }
 }
 
@@ -536,7 +544,7 @@ technique11 Light1TexFogReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, true, false, true, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, true, false, true, true, false) ) );
     }
 }
 
@@ -546,7 +554,7 @@ technique11 Light2TexFogReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, true, false, true, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, true, false, true, true, false) ) );
     }
 }
 
@@ -556,7 +564,7 @@ technique11 Light3TexFogReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, true, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, true, true, false) ) );
     }
 }
 
@@ -566,7 +574,7 @@ technique11 Light0TexAlphaClipFogReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(0, true, true, true, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(0, true, true, true, true, false) ) );
     }
 }
 
@@ -576,7 +584,7 @@ technique11 Light1TexAlphaClipFogReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(1, true, true, true, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, true, true, true, true, false) ) );
     }
 }
 
@@ -586,7 +594,7 @@ technique11 Light2TexAlphaClipFogReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(2, true, true, true, true) ) );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, true, true, true, true, false) ) );
     }
 }
 
@@ -596,6 +604,126 @@ technique11 Light3TexAlphaClipFogReflect
     {
         SetVertexShader( CompileShader( vs_5_0, VS() ) );
 		SetGeometryShader( NULL );
-        SetPixelShader( CompileShader( ps_5_0, PS(3, true, true, true, true) ) ); 
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, true, true, true, false) ) ); 
+    }
+}
+
+technique11 Light1Clustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, false, false, false, false, true) ) );
+    }
+}
+
+technique11 Light2Clustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, false, false, false, false, true) ) );
+    }
+}
+
+technique11 Light3Clustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false, false, false, true) ) );
+    }
+}
+
+technique11 Light1TexClustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, true, false, false, false, true) ) );
+    }
+}
+
+technique11 Light2TexClustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, true, false, false, false, true) ) );
+    }
+}
+
+technique11 Light3TexClustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false, true) ) );
+    }
+}
+
+technique11 Light1ReflectClustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, false, false, false, true, true) ) );
+    }
+}
+
+technique11 Light2ReflectClustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, false, false, false, true, true) ) );
+    }
+}
+
+technique11 Light3ReflectClustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false, false, true, true) ) );
     }
-}
\ No newline at end of file
+}
+
+technique11 Light1TexReflectClustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(1, true, false, false, true, true) ) );
+    }
+}
+
+technique11 Light2TexReflectClustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(2, true, false, false, true, true) ) );
+    }
+}
+
+technique11 Light3TexReflectClustered
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, true, true) ) );
+    }
+}
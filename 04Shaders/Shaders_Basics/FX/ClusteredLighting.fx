@@ -0,0 +1,87 @@
+//***************************************************************************************
+// ClusteredLighting.fx
+//
+// Point and spot lights culled into a view space froxel grid on the CPU (see
+// Framework/LightGrid.h). A pixel finds its cluster from its screen position and
+// view depth and only shades the lights listed for that cluster.
+//***************************************************************************************
+
+struct ClusterLight
+{
+	float3 Position;
+	float  Range;
+
+	float3 Direction;
+	float  SpotCos;		// cosine of the cone half-angle, -1 for point lights
+
+	float3 Color;
+	float  pad;
+};
+
+cbuffer cbClusters
+{
+	uint3  gClusterDims;	// tiles in x, tiles in y, depth slices
+	float  gSliceScale;
+	float2 gTileScale;		// tiles per pixel
+	float  gSliceBias;
+	float  gClusterPad;
+};
+
+StructuredBuffer<ClusterLight> gClusterLights;
+StructuredBuffer<uint2>        gClusterRanges;		// first light index, light count
+StructuredBuffer<uint>         gClusterLightIndices;
+
+//---------------------------------------------------------------------------------------
+// Returns the cluster of a pixel. SV_Position holds the pixel position in xy and the
+// view space depth in w.
+//---------------------------------------------------------------------------------------
+uint ClusterIndex(float4 posH)
+{
+	uint2 tile  = min(uint2(posH.xy * gTileScale), gClusterDims.xy - 1);
+	uint  slice = (uint)clamp(log(posH.w) * gSliceScale + gSliceBias, 0.0f, gClusterDims.z - 1.0f);
+
+	return (slice * gClusterDims.y + tile.y) * gClusterDims.x + tile.x;
+}
+
+//---------------------------------------------------------------------------------------
+// Adds the diffuse and specular terms of every light in the pixel's cluster. The
+// lights fade out smoothly towards their range, and spot lights towards the edge of
+// their cone.
+//---------------------------------------------------------------------------------------
+void ComputeClusteredLights(Material mat, float4 posH, float3 pos, float3 normal, float3 toEye,
+                            inout float4 diffuse,
+                            inout float4 spec)
+{
+	uint2 range = gClusterRanges[ClusterIndex(posH)];
+
+	for(uint i = 0; i < range.y; ++i)
+	{
+		ClusterLight L = gClusterLights[gClusterLightIndices[range.x + i]];
+
+		float3 lightVec = L.Position - pos;
+		float d = length(lightVec);
+		if( d >= L.Range )
+			continue;
+
+		lightVec /= d;
+
+		float falloff = saturate(1.0f - (d*d) / (L.Range*L.Range));
+		float att = falloff*falloff;
+
+		if( L.SpotCos > -1.0f )
+			att *= smoothstep(L.SpotCos, lerp(L.SpotCos, 1.0f, 0.2f), dot(-lightVec, L.Direction));
+
+		float diffuseFactor = dot(lightVec, normal);
+
+		// Flatten to avoid dynamic branching.
+		[flatten]
+		if( diffuseFactor > 0.0f )
+		{
+			float3 v         = reflect(-lightVec, normal);
+			float specFactor = pow(max(dot(v, toEye), 0.0f), mat.Specular.w);
+
+			diffuse += att * diffuseFactor * mat.Diffuse * float4(L.Color, 1.0f);
+			spec    += att * specFactor * mat.Specular * float4(L.Color, 1.0f);
+		}
+	}
+}
@@ -1,5 +1,11 @@
 #include "ShadersApp.h"
 
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 	PSTR cmdLine, int showCmd)
 {
@@ -13,9 +19,81 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 	if (!theApp.Init())
 		return 0;
 
+	// "-bench N" measures N frames of the scene against the null backend instead of
+	// running the demo.
+	const char* bench = strstr(cmdLine, "-bench");
+	if (bench)
+	{
+		int frames = atoi(bench + strlen("-bench"));
+		return theApp.RunBenchmark(frames > 0 ? frames : 1000, "bench.json") ? 0 : 1;
+	}
+
+	// "-gpubudget MB" caps the video memory the demo keeps.
+	const char* budget = strstr(cmdLine, "-gpubudget");
+	if (budget)
+		theApp.SetGpuBudget((UINT64)atoi(budget + strlen("-gpubudget"))*1024*1024);
+
+	// "-simthread HZ" animates the scene on its own thread at HZ ticks a second.
+	const char* simThread = strstr(cmdLine, "-simthread");
+	if (simThread)
+	{
+		int ticks = atoi(simThread + strlen("-simthread"));
+		theApp.StartSimulation(ticks > 0 ? (float)ticks : 60.0f);
+	}
+
 	return theApp.Run();
 }
 
+#pragma region Benchmark
+namespace
+{
+	// This demo for the benchmark harness; see ShadersApp::BenchFrame.
+	class ShadersBenchScene : public Bench::Scene
+	{
+	public:
+		explicit ShadersBenchScene(ShadersApp& app) : mApp(app) {}
+
+		const char* Name()const { return "Shaders_Basics"; }
+
+		void Frame(float dt, const Bench::CameraPose& camera, CommandBackend& backend)
+		{
+			mApp.BenchFrame(dt, camera, backend);
+		}
+
+	private:
+		ShadersApp& mApp;
+	};
+
+	// The textures of the scene, from FloorTexture on.
+	const wchar_t* TextureFiles[3] = { L"Textures/floor.dds", L"Textures/stone.dds", L"Textures/bricks.dds" };
+	const char* TextureNames[3] = { "floor.dds", "stone.dds", "bricks.dds" };
+
+	// The matrices of a camera, as the scene records with them.
+	ShadersScene::Camera SceneCamera(const Camera& camera)
+	{
+		ShadersScene::Camera c;
+		XMFLOAT3 position = camera.GetPosition();
+		c.Position[0] = position.x;
+		c.Position[1] = position.y;
+		c.Position[2] = position.z;
+
+		XMFLOAT4X4 m;
+		XMStoreFloat4x4(&m, camera.View());
+		memcpy(c.View, &m, sizeof(c.View));
+		XMStoreFloat4x4(&m, camera.Proj());
+		memcpy(c.Proj, &m, sizeof(c.Proj));
+		XMStoreFloat4x4(&m, camera.ViewProj());
+		memcpy(c.ViewProj, &m, sizeof(c.ViewProj));
+
+		c.NearZ = camera.GetNearZ();
+		c.FarZ = camera.GetFarZ();
+		return c;
+	}
+}
+#pragma endregion
+
+const char* ShadersApp::WarmupListFile = "FX/Basic.warmup";
+
 /// <summary>
 /// Initializes a new instance of the <see cref="ShadersApp"/> class.
 /// </summary>
@@ -23,9 +101,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 ShadersApp::ShadersApp(HINSTANCE hInstance)
 	: D3DApp(hInstance), mSky(0),
 	mShapesVB(0), mShapesIB(0), mSkullVB(0), mSkullIB(0),
-	mFloorTexSRV(0), mStoneTexSRV(0), mBrickTexSRV(0),
-	mDynamicCubeMapDSV(0), mDynamicCubeMapSRV(0),
-	mSkullIndexCount(0), mLightCount(3),
+	mFloorTexSRV(0), mStoneTexSRV(0), mBrickTexSRV(0), mTextureMipBias(0),
+	mDynamicCubeMap(0), mDynamicCubeMapDepth(0), mScene(mJobs), mFramesDrawn(0),
+	mBenchTime(0.0), mBenchmarking(false), mSkullIndexCount(0),
 	reflectionAmount(0.8f), minReflection(0.0f), maxReflection(1.0f)
 {
 	mMainWndCaption = L"Reflective Chrome";
@@ -37,77 +115,13 @@ ShadersApp::ShadersApp(HINSTANCE hInstance)
 
 	BuildCubeFaceCamera(0.0f, 2.0f, 0.0f);
 
-	for (int i = 0; i < 6; ++i)
-	{
-		mDynamicCubeMapRTV[i] = 0;
-	}
-
-	XMMATRIX I = XMMatrixIdentity();
-	XMStoreFloat4x4(&mGridWorld, I);
-
-	XMMATRIX boxScale = XMMatrixScaling(3.0f, 1.0f, 3.0f);
-	XMMATRIX boxOffset = XMMatrixTranslation(0.0f, 0.5f, 0.0f);
-	XMStoreFloat4x4(&mBoxWorld, XMMatrixMultiply(boxScale, boxOffset));
-
-	XMMATRIX centerSphereScale = XMMatrixScaling(2.0f, 2.0f, 2.0f);
-	XMMATRIX centerSphereOffset = XMMatrixTranslation(0.0f, 2.0f, 0.0f);
-	XMStoreFloat4x4(&mCenterSphereWorld, XMMatrixMultiply(centerSphereScale, centerSphereOffset));
-
-	for (int i = 0; i < 5; ++i)
-	{
-		XMStoreFloat4x4(&mCylWorld[i * 2 + 0], XMMatrixTranslation(-5.0f, 1.5f, -10.0f + i*5.0f));
-		XMStoreFloat4x4(&mCylWorld[i * 2 + 1], XMMatrixTranslation(+5.0f, 1.5f, -10.0f + i*5.0f));
-
-		XMStoreFloat4x4(&mSphereWorld[i * 2 + 0], XMMatrixTranslation(-5.0f, 3.5f, -10.0f + i*5.0f));
-		XMStoreFloat4x4(&mSphereWorld[i * 2 + 1], XMMatrixTranslation(+5.0f, 3.5f, -10.0f + i*5.0f));
-	}
-
-	mDirLights[0].Ambient = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
-	mDirLights[0].Diffuse = XMFLOAT4(0.5f, 0.5f, 0.5f, 1.0f);
-	mDirLights[0].Specular = XMFLOAT4(0.5f, 0.5f, 0.5f, 1.0f);
-	mDirLights[0].Direction = XMFLOAT3(0.57735f, -0.57735f, 0.57735f);
-
-	mDirLights[1].Ambient = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
-	mDirLights[1].Diffuse = XMFLOAT4(0.20f, 0.20f, 0.20f, 1.0f);
-	mDirLights[1].Specular = XMFLOAT4(0.25f, 0.25f, 0.25f, 1.0f);
-	mDirLights[1].Direction = XMFLOAT3(-0.57735f, -0.57735f, 0.57735f);
-
-	mDirLights[2].Ambient = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
-	mDirLights[2].Diffuse = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
-	mDirLights[2].Specular = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
-	mDirLights[2].Direction = XMFLOAT3(0.0f, -0.707f, -0.707f);
-
-	mGridMat.Ambient = XMFLOAT4(0.8f, 0.8f, 0.8f, 1.0f);
-	mGridMat.Diffuse = XMFLOAT4(0.8f, 0.8f, 0.8f, 1.0f);
-	mGridMat.Specular = XMFLOAT4(0.8f, 0.8f, 0.8f, 16.0f);
-	mGridMat.Reflect = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
-
-	mCylinderMat.Ambient = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	mCylinderMat.Diffuse = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	mCylinderMat.Specular = XMFLOAT4(0.8f, 0.8f, 0.8f, 16.0f);
-	mCylinderMat.Reflect = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
-
-	mSphereMat.Ambient = XMFLOAT4(0.6f, 0.8f, 1.0f, 1.0f);
-	mSphereMat.Diffuse = XMFLOAT4(0.6f, 0.8f, 1.0f, 1.0f);
-	mSphereMat.Specular = XMFLOAT4(0.9f, 0.9f, 0.9f, 16.0f);
-	mSphereMat.Reflect = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
-
-	mBoxMat.Ambient = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	mBoxMat.Diffuse = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	mBoxMat.Specular = XMFLOAT4(0.8f, 0.8f, 0.8f, 16.0f);
-	mBoxMat.Reflect = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
-
-	mSkullMat.Ambient = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
-	mSkullMat.Diffuse = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
-	mSkullMat.Specular = XMFLOAT4(0.8f, 0.8f, 0.8f, 16.0f);
-	mSkullMat.Reflect = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
-
-	mCenterSphereMat.Ambient = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
-	mCenterSphereMat.Diffuse = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
-	mCenterSphereMat.Specular = XMFLOAT4(0.6f, 0.6f, 0.6f, 16.0f);
+	DynamicBuffer empty = { 0, 0, 0 };
+	mClusterLightsBuffer = empty;
+	mClusterRangesBuffer = empty;
+	mClusterIndicesBuffer = empty;
 
 	// set the reflection amount of the center sphere 
-	mCenterSphereMat.Reflect = XMFLOAT4(reflectionAmount, reflectionAmount, reflectionAmount, 1.0f);
+	mScene.SetReflection(reflectionAmount);
 }
 
 /// <summary>
@@ -115,19 +129,39 @@ ShadersApp::ShadersApp(HINSTANCE hInstance)
 /// </summary>
 ShadersApp::~ShadersApp()
 {
+	mSimulation.Stop();
+
+	// Nothing may stay bound once the tracked resources are released below.
+	if (md3dImmediateContext)
+		md3dImmediateContext->ClearState();
+
 	SafeDelete(mSky);
 
 	ReleaseCOM(mShapesVB);
 	ReleaseCOM(mShapesIB);
 	ReleaseCOM(mSkullVB);
 	ReleaseCOM(mSkullIB);
-	ReleaseCOM(mFloorTexSRV);
-	ReleaseCOM(mStoneTexSRV);
-	ReleaseCOM(mBrickTexSRV);
-	ReleaseCOM(mDynamicCubeMapDSV);
-	ReleaseCOM(mDynamicCubeMapSRV);
-	for (int i = 0; i < 6; ++i)
-		ReleaseCOM(mDynamicCubeMapRTV[i]);
+
+	DynamicBuffer* clusterBuffers[] = { &mClusterLightsBuffer, &mClusterRangesBuffer, &mClusterIndicesBuffer };
+	for (int i = 0; i < 3; ++i)
+	{
+		ReleaseCOM(clusterBuffers[i]->SRV);
+		ReleaseCOM(clusterBuffers[i]->Buffer);
+	}
+
+	// Leave where the frames of this run went, for chrome://tracing.
+	Telemetry::WriteChromeTrace("frame_trace.json");
+	OutputDebugStringA(Telemetry::Summary().c_str());
+
+	std::ofstream gpuMemory("gpu_memory.json");
+	gpuMemory << mGpuMemory.Snapshot();
+
+	if (AllocationProfiler::Enabled())
+		OutputDebugStringA(AllocationProfiler::Report().c_str());
+
+	// Remember which technique permutations this run used for the next startup.
+	if (Effects::BasicFX)
+		Effects::BasicFX->SaveWarmupList(WarmupListFile);
 
 	Effects::DestroyAll();
 	InputLayouts::DestroyAll();
@@ -142,25 +176,121 @@ bool ShadersApp::Init()
 	if (!D3DApp::Init())
 		return false;
 
+	// Reading files and generating meshes run as jobs; everything that creates
+	// device objects runs on this thread.
+	typedef StartupGraph Graph;
+	Graph startup;
+
+	std::vector<char> textureFiles[3];
+	std::vector<Vertex::Basic32> shapeVertices, skullVertices;
+	std::vector<UINT> shapeIndices, skullIndices;
+	bool skullLoaded = false;
+
 	// Must init Effects first since InputLayouts depend on shader signatures.
-	Effects::InitAll(md3dDevice);
-	InputLayouts::InitAll(md3dDevice);
+	Graph::StepId effects = startup.Add("Effects::InitAll", [this]()
+	{
+		Effects::InitAll(md3dDevice, mResources);
+		Effects::BasicFX->WarmUp(WarmupListFile);
+	}, Graph::OwningThread);
+
+	Graph::StepId layouts = startup.Add("InputLayouts::InitAll", [this]() { InputLayouts::InitAll(md3dDevice, mResources); }, Graph::OwningThread);
+	startup.DependsOn(layouts, effects);
+
+	startup.Add("Sky", [this]()
+	{
+		mSky = new Sky(md3dDevice, mResources, L"Textures/sunsetcube1024.dds", 5000.0f);
+		GpuResources::Track(mGpuMemory, TextureMemory, "sunsetcube1024.dds", mSky->CubeMapSRV());
+	}, Graph::OwningThread);
+
+	const wchar_t* missingTexture = 0;
+	Graph::StepId readTextures = startup.Add("ReadTextures", [&textureFiles, &missingTexture]()
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			if (!RegistryResources::ReadFile(TextureFiles[i], textureFiles[i]))
+				missingTexture = TextureFiles[i];
+		}
+	});
 
-	mSky = new Sky(md3dDevice, L"Textures/sunsetcube1024.dds", 5000.0f);
+	Graph::StepId textures = startup.Add("CreateTextures", [&]()
+	{
+		if (missingTexture)
+		{
+			MessageBox(0, (std::wstring(missingTexture) + L" not found or empty.").c_str(), 0, 0);
+			return;
+		}
 
-	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice,
-		L"Textures/floor.dds", 0, 0, &mFloorTexSRV, 0));
+		CreateTextures(textureFiles);
+	}, Graph::OwningThread);
+	startup.DependsOn(textures, readTextures);
 
-	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice,
-		L"Textures/stone.dds", 0, 0, &mStoneTexSRV, 0));
+	Graph::StepId frameGraph = startup.Add("BuildFrameGraph", [this]() { BuildFrameGraph(); }, Graph::OwningThread);
+
+	Graph::StepId generateShapes = startup.Add("GenerateShapeGeometry", [&]() { GenerateShapeGeometry(shapeVertices, shapeIndices); });
+	Graph::StepId shapes = startup.Add("CreateShapeBuffers", [&]()
+	{
+		CreateGeometryBuffers("Shapes", shapeVertices, shapeIndices, &mShapesVB, &mShapesIB);
+	}, Graph::OwningThread);
+	startup.DependsOn(shapes, generateShapes);
+
+	Graph::StepId shapePickMeshes = startup.Add("BuildShapePickMeshes", [&]()
+	{
+		UINT vertexCount = shapeVertices.size();
+		BuildPickMesh(ShadersScene::BoxMesh, shapeVertices, mBoxVertexOffset, mGridVertexOffset - mBoxVertexOffset,
+			shapeIndices, mBoxIndexOffset, mBoxIndexCount);
+		BuildPickMesh(ShadersScene::GridMesh, shapeVertices, mGridVertexOffset, mSphereVertexOffset - mGridVertexOffset,
+			shapeIndices, mGridIndexOffset, mGridIndexCount);
+		BuildPickMesh(ShadersScene::SphereMesh, shapeVertices, mSphereVertexOffset, mCylinderVertexOffset - mSphereVertexOffset,
+			shapeIndices, mSphereIndexOffset, mSphereIndexCount);
+		BuildPickMesh(ShadersScene::CylinderMesh, shapeVertices, mCylinderVertexOffset, vertexCount - mCylinderVertexOffset,
+			shapeIndices, mCylinderIndexOffset, mCylinderIndexCount);
+	});
+	startup.DependsOn(shapePickMeshes, generateShapes);
+
+	Graph::StepId loadSkull = startup.Add("LoadSkullGeometry", [&]() { skullLoaded = LoadSkullGeometry(skullVertices, skullIndices); });
+	Graph::StepId skull = startup.Add("CreateSkullBuffers", [&]()
+	{
+		if (!skullLoaded)
+		{
+			MessageBox(0, L"Models/skull.txt not found or invalid.", 0, 0);
+			return;
+		}
+
+		mSkullIndexCount = skullIndices.size();
+		CreateGeometryBuffers("Skull", skullVertices, skullIndices, &mSkullVB, &mSkullIB);
+	}, Graph::OwningThread);
+	startup.DependsOn(skull, loadSkull);
+
+	Graph::StepId skullPickMesh = startup.Add("BuildSkullPickMesh", [&]()
+	{
+		if (skullLoaded)
+			BuildPickMesh(ShadersScene::SkullMesh, skullVertices, 0, skullVertices.size(), skullIndices, 0, skullIndices.size());
+	});
+	startup.DependsOn(skullPickMesh, loadSkull);
+
+	// Tell the replay backend what the ids in the recorded commands refer to.
+	Graph::StepId registerResources = startup.Add("RegisterResources", [this]()
+	{
+		mBackend.RegisterGeometry(ShadersScene::ShapesGeometry, mShapesVB, mShapesIB, sizeof(Vertex::Basic32));
+		mBackend.RegisterGeometry(ShadersScene::SkullGeometry, mSkullVB, mSkullIB, sizeof(Vertex::Basic32));
+	}, Graph::OwningThread);
+	startup.DependsOn(registerResources, textures);
+	startup.DependsOn(registerResources, frameGraph);
+	startup.DependsOn(registerResources, shapes);
+	startup.DependsOn(registerResources, skull);
 
-	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice,
-		L"Textures/bricks.dds", 0, 0, &mBrickTexSRV, 0));
+	{
+		// Each step's allocations are tagged with its name.
+		ALLOCATION_PHASE("Startup");
+		startup.Run(mJobs);
+	}
+	OutputDebugStringA(startup.Report().c_str());
 
-	BuildDynamicCubeMapViews();
+	SetSceneMeshes();
+	BuildPickScene();
 
-	BuildShapeGeometryBuffers();
-	BuildSkullGeometryBuffers();
+	// Over the budget, textures give up their top mip, one level a frame.
+	mGpuMemory.AddDowngrade(TextureMemory, [this]() { return ReduceTextureDetail(); });
 
 	return true;
 }
@@ -181,6 +311,8 @@ void ShadersApp::OnResize()
 /// <param name="dt">The deltatime.</param>
 void ShadersApp::UpdateScene(float dt)
 {
+	TELEMETRY_SCOPE("UpdateScene");
+
 	//
 	// Control the camera.
 	//
@@ -205,17 +337,24 @@ void ShadersApp::UpdateScene(float dt)
 	if (reflectionAmount < 0) reflectionAmount = 0.0f;
 	if (reflectionAmount > 1.0f) reflectionAmount = 1.0f;
 
-	mCenterSphereMat.Reflect = XMFLOAT4(reflectionAmount, reflectionAmount, reflectionAmount, 1.0f);
+	mScene.SetReflection(reflectionAmount);
 
 	//
-	// Animate the skull around the center sphere.
+	// Animate the skull around the center sphere, and move the clustered lights
+	// along their orbits: at this frame's time, or, with a simulation thread, between
+	// its last two ticks. A benchmark steps a time of its own, since the timer only
+	// runs once Run starts.
 	//
 
-	XMMATRIX skullScale = XMMatrixScaling(0.2f, 0.2f, 0.2f);
-	XMMATRIX skullOffset = XMMatrixTranslation(3.0f, 2.0f, 0.0f);
-	XMMATRIX skullLocalRotate = XMMatrixRotationY(2.0f*mTimer.TotalTime());
-	XMMATRIX skullGlobalRotate = XMMatrixRotationY(0.5f*mTimer.TotalTime());
-	XMStoreFloat4x4(&mSkullWorld, skullScale*skullLocalRotate*skullOffset*skullGlobalRotate);
+	if (mSimulation.Running())
+	{
+		float alpha = mSimulation.Sample();
+		mScene.Animate(mSimulation.Previous(), mSimulation.Current(), alpha);
+	}
+	else
+	{
+		mScene.Animate(mBenchmarking ? mBenchTime : mTimer.TotalTime());
+	}
 
 	mCam.UpdateViewMatrix();
 }
@@ -225,39 +364,95 @@ void ShadersApp::UpdateScene(float dt)
 /// </summary>
 void ShadersApp::DrawScene()
 {
-	ID3D11RenderTargetView* renderTargets[1];
+	TELEMETRY_SCOPE("DrawScene");
 
-	// Generate the cube map.
-	md3dImmediateContext->RSSetViewports(1, &mCubeMapViewport);
-	for (int i = 0; i < 6; ++i)
+	Effects::BasicFX->Uploads().BeginFrame();
+
+	mScene.Record(SceneCamera(mCam));
+
+	UploadClusters();
+
+	mFrameGraph.Execute([this](const FrameGraph::Transition& transition)
 	{
-		// Clear cube map face and depth buffer.
-		md3dImmediateContext->ClearRenderTargetView(mDynamicCubeMapRTV[i], reinterpret_cast<const float*>(&Colors::Silver));
-		md3dImmediateContext->ClearDepthStencilView(mDynamicCubeMapDSV, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+		// A target about to be rendered to may still be bound as a texture from the last frame.
+		if (mFrameGraph.IsTransient(transition.Resource) && transition.After != FrameGraph::ShaderRead)
+		{
+			ID3D11ShaderResourceView* none[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
+			md3dImmediateContext->PSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, none);
+		}
+	});
+
+	{
+		TELEMETRY_SCOPE("Present");
+		HR(mSwapChain->Present(0, 0));
+	}
+
+	// Textures nothing holds anymore go only now, after the frame that last used them.
+	mResources.EndFrame();
+	mTargets.EndFrame();
 
-		// Bind cube map face as render target.
-		renderTargets[0] = mDynamicCubeMapRTV[i];
-		md3dImmediateContext->OMSetRenderTargets(1, renderTargets, mDynamicCubeMapDSV);
+	UINT downgrades = mGpuMemory.Total().Downgrades;
+	mGpuMemory.EndFrame();
+	if (mGpuMemory.Total().Downgrades != downgrades)
+		OutputDebugStringA(mGpuMemory.Snapshot().c_str());
 
-		// Draw the scene with the exception of the center sphere to this cube map face.
-		DrawScene(mCubeMapCamera[i], false);
+	AllocationProfiler::FrameStats heap = AllocationProfiler::EndFrame();
+	if (++mFramesDrawn > WarmupFrames && heap.Allocations > 0)
+	{
+		char message[128];
+		sprintf_s(message, "Frame %u made %llu heap allocations (%llu bytes)\n", mFramesDrawn,
+			(unsigned long long)heap.Allocations, (unsigned long long)heap.Bytes);
+		OutputDebugStringA(message);
 	}
 
-	// Restore old viewport and render targets.
-	md3dImmediateContext->RSSetViewports(1, &mScreenViewport);
-	renderTargets[0] = mRenderTargetView;
-	md3dImmediateContext->OMSetRenderTargets(1, renderTargets, mDepthStencilView);
+	Telemetry::EndFrame();
+}
 
-	// Have hardware generate lower mipmap levels of cube map.
-	md3dImmediateContext->GenerateMips(mDynamicCubeMapSRV);
+/// <summary>
+/// One frame for the benchmark harness: the update and the recording of every
+/// view, replayed into the harness' backend instead of the device. The scene is
+/// animated on the time the harness steps.
+/// </summary>
+/// <param name="dt">The deltatime.</param>
+/// <param name="camera">Where the camera is this frame.</param>
+/// <param name="backend">The backend to replay into.</param>
+void ShadersApp::BenchFrame(float dt, const Bench::CameraPose& camera, CommandBackend& backend)
+{
+	mCam.LookAt(XMFLOAT3(camera.Eye[0], camera.Eye[1], camera.Eye[2]),
+		XMFLOAT3(camera.Target[0], camera.Target[1], camera.Target[2]), XMFLOAT3(0.0f, 1.0f, 0.0f));
 
-	// Now draw the scene as normal, but with the center sphere.
-	md3dImmediateContext->ClearRenderTargetView(mRenderTargetView, reinterpret_cast<const float*>(&Colors::Silver));
-	md3dImmediateContext->ClearDepthStencilView(mDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+	mBenchTime += dt;
+	UpdateScene(dt);
+	mScene.Record(SceneCamera(mCam));
 
-	DrawScene(mCam, true);
+	for (int i = 0; i < ShadersScene::ViewCount; ++i)
+		mScene.Commands(i).Replay(backend);
 
-	HR(mSwapChain->Present(0, 0));
+	AllocationProfiler::EndFrame();
+	Telemetry::EndFrame();
+}
+
+/// <summary>
+/// Runs the scene headless along an orbit around the center sphere and writes the
+/// measurements as JSON.
+/// </summary>
+/// <param name="frames">The number of frames to measure.</param>
+/// <param name="path">The file to write.</param>
+/// <returns>Whether the file was written.</returns>
+bool ShadersApp::RunBenchmark(unsigned int frames, const char* path)
+{
+	ShadersBenchScene scene(*this);
+	mBenchTime = 0.0;
+	mBenchmarking = true;
+
+	float center[3] = { 0.0f, 2.0f, 0.0f };
+	std::vector<Bench::Result> results;
+	results.push_back(Bench::Run(scene, Bench::CameraPath::Orbit(center, 15.0f, 0.0f), frames));
+	mBenchmarking = false;
+
+	std::ofstream fout(path);
+	Bench::WriteJson(fout, results);
+	return fout.good();
 }
 
 /// <summary>
@@ -271,6 +466,9 @@ void ShadersApp::OnMouseDown(WPARAM btnState, int x, int y)
 	mLastMousePos.x = x;
 	mLastMousePos.y = y;
 
+	if ((btnState & MK_RBUTTON) != 0)
+		Pick(x, y);
+
 	SetCapture(mhMainWnd);
 }
 
@@ -308,183 +506,95 @@ void ShadersApp::OnMouseMove(WPARAM btnState, int x, int y)
 }
 
 /// <summary>
-/// Draws the scene.
+/// Uploads the clustered lights and the light grid built for this frame, and binds
+/// them to the effect.
 /// </summary>
-/// <param name="camera">The camera.</param>
-/// <param name="drawCenterSphere">if set to <c>true</c> [draw center sphere].</param>
-void ShadersApp::DrawScene(const Camera& camera, bool drawCenterSphere)
+void ShadersApp::UploadClusters()
 {
-	md3dImmediateContext->IASetInputLayout(InputLayouts::Basic32);
-	md3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-	UINT stride = sizeof(Vertex::Basic32);
-	UINT offset = 0;
-
-	XMMATRIX view = camera.View();
-	XMMATRIX proj = camera.Proj();
-	XMMATRIX viewProj = camera.ViewProj();
-
-	float blendFactor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-
-	// Set per frame constants.
-	Effects::BasicFX->SetDirLights(mDirLights);
-	Effects::BasicFX->SetEyePosW(mCam.GetPosition());
-
-	// Figure out which technique to use.   
-
-	ID3DX11EffectTechnique* activeTexTech = Effects::BasicFX->Light1TexTech;
-	ID3DX11EffectTechnique* activeSkullTech = Effects::BasicFX->Light1Tech;
-	ID3DX11EffectTechnique* activeReflectTech = Effects::BasicFX->Light1ReflectTech;
-	switch (mLightCount)
-	{
-	case 1:
-		activeTexTech = Effects::BasicFX->Light1TexTech;
-		activeSkullTech = Effects::BasicFX->Light1Tech;
-		activeReflectTech = Effects::BasicFX->Light1ReflectTech;
-		break;
-	case 2:
-		activeTexTech = Effects::BasicFX->Light2TexTech;
-		activeSkullTech = Effects::BasicFX->Light2Tech;
-		activeReflectTech = Effects::BasicFX->Light2ReflectTech;
-		break;
-	case 3:
-		activeTexTech = Effects::BasicFX->Light3TexTech;
-		activeSkullTech = Effects::BasicFX->Light3Tech;
-		activeReflectTech = Effects::BasicFX->Light3ReflectTech;
-		break;
-	}
-
-	XMMATRIX world;
-	XMMATRIX worldInvTranspose;
-	XMMATRIX worldViewProj;
+	TELEMETRY_SCOPE("UploadClusters");
+
+	const LightGrid& grid = mScene.Lights();
+	const std::vector<ClusterLight>& lights = mScene.ClusterLights();
+	const std::vector<LightGrid::Range>& ranges = grid.Ranges();
+	const std::vector<uint32_t>& indices = grid.LightIndices();
+
+	UploadStructured("ClusterLights", mClusterLightsBuffer, &lights[0], (UINT)lights.size(), sizeof(ClusterLight));
+	UploadStructured("ClusterRanges", mClusterRangesBuffer, &ranges[0], (UINT)ranges.size(), sizeof(LightGrid::Range));
+	UploadStructured("ClusterIndices", mClusterIndicesBuffer, indices.empty() ? 0 : &indices[0], (UINT)indices.size(), sizeof(uint32_t));
+
+	CBClusters cb;
+	cb.ClusterDims[0] = grid.TilesX();
+	cb.ClusterDims[1] = grid.TilesY();
+	cb.ClusterDims[2] = grid.Slices();
+	cb.SliceScale = grid.SliceScale();
+	cb.TileScale = XMFLOAT2((float)grid.TilesX() / mClientWidth, (float)grid.TilesY() / mClientHeight);
+	cb.SliceBias = grid.SliceBias();
+	cb.Pad = 0.0f;
+
+	Effects::BasicFX->SetClusters(cb);
+	Effects::BasicFX->SetClusterBuffers(mClusterLightsBuffer.SRV, mClusterRangesBuffer.SRV, mClusterIndicesBuffer.SRV);
+}
 
-	//
-	// Draw the skull.
-	//
-	D3DX11_TECHNIQUE_DESC techDesc;
-	activeSkullTech->GetDesc(&techDesc);
-	for (UINT p = 0; p < techDesc.Passes; ++p)
+/// <summary>
+/// Writes data to a dynamic structured buffer, recreating it larger when it does not fit.
+/// </summary>
+/// <param name="name">The name of the buffer in the GPU memory budget.</param>
+/// <param name="target">The buffer.</param>
+/// <param name="data">The elements.</param>
+/// <param name="count">The number of elements.</param>
+/// <param name="stride">The size of one element.</param>
+void ShadersApp::UploadStructured(const char* name, DynamicBuffer& target, const void* data, UINT count, UINT stride)
+{
+	if (!target.Buffer || count > target.Capacity)
 	{
-		md3dImmediateContext->IASetVertexBuffers(0, 1, &mSkullVB, &stride, &offset);
-		md3dImmediateContext->IASetIndexBuffer(mSkullIB, DXGI_FORMAT_R32_UINT, 0);
-
-		world = XMLoadFloat4x4(&mSkullWorld);
-		worldInvTranspose = MathHelper::InverseTranspose(world);
-		worldViewProj = world*view*proj;
-
-		Effects::BasicFX->SetWorld(world);
-		Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-		Effects::BasicFX->SetWorldViewProj(worldViewProj);
-		Effects::BasicFX->SetTexTransform(XMMatrixIdentity());
-		Effects::BasicFX->SetMaterial(mSkullMat);
-
-		activeSkullTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-		md3dImmediateContext->DrawIndexed(mSkullIndexCount, 0, 0);
+		ReleaseCOM(target.SRV);
+		ReleaseCOM(target.Buffer);
+
+		// Grow geometrically so a slowly rising light count does not recreate it every frame.
+		UINT capacity = MathHelper::Max(MathHelper::Max(count, 2 * target.Capacity), 1u);
+
+		D3D11_BUFFER_DESC desc;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.ByteWidth = stride * capacity;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		desc.StructureByteStride = stride;
+		HR(GpuResources::CreateBuffer(md3dDevice, mGpuMemory, DynamicMemory, name, &desc, 0, &target.Buffer));
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = capacity;
+		HR(md3dDevice->CreateShaderResourceView(target.Buffer, &srvDesc, &target.SRV));
+
+		target.Capacity = capacity;
 	}
 
-	md3dImmediateContext->IASetVertexBuffers(0, 1, &mShapesVB, &stride, &offset);
-	md3dImmediateContext->IASetIndexBuffer(mShapesIB, DXGI_FORMAT_R32_UINT, 0);
+	if (count == 0)
+		return;
 
-	//
-	// Draw the grid, cylinders, spheres and box without any cubemap reflection.
-	// 
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HR(md3dImmediateContext->Map(target.Buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+	memcpy(mapped.pData, data, count * stride);
+	md3dImmediateContext->Unmap(target.Buffer, 0);
+}
 
-	activeTexTech->GetDesc(&techDesc);
-	for (UINT p = 0; p < techDesc.Passes; ++p)
-	{
-		// Draw the grid.
-		world = XMLoadFloat4x4(&mGridWorld);
-		worldInvTranspose = MathHelper::InverseTranspose(world);
-		worldViewProj = world*view*proj;
-
-		Effects::BasicFX->SetWorld(world);
-		Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-		Effects::BasicFX->SetWorldViewProj(worldViewProj);
-		Effects::BasicFX->SetTexTransform(XMMatrixScaling(6.0f, 8.0f, 1.0f));
-		Effects::BasicFX->SetMaterial(mGridMat);
-		Effects::BasicFX->SetDiffuseMap(mFloorTexSRV);
-
-		activeTexTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-		md3dImmediateContext->DrawIndexed(mGridIndexCount, mGridIndexOffset, mGridVertexOffset);
-
-		// Draw the box.
-		world = XMLoadFloat4x4(&mBoxWorld);
-		worldInvTranspose = MathHelper::InverseTranspose(world);
-		worldViewProj = world*view*proj;
-
-		Effects::BasicFX->SetWorld(world);
-		Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-		Effects::BasicFX->SetWorldViewProj(worldViewProj);
-		Effects::BasicFX->SetTexTransform(XMMatrixIdentity());
-		Effects::BasicFX->SetMaterial(mBoxMat);
-		Effects::BasicFX->SetDiffuseMap(mStoneTexSRV);
-
-		activeTexTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-		md3dImmediateContext->DrawIndexed(mBoxIndexCount, mBoxIndexOffset, mBoxVertexOffset);
-
-		// Draw the cylinders.
-		for (int i = 0; i < 10; ++i)
-		{
-			world = XMLoadFloat4x4(&mCylWorld[i]);
-			worldInvTranspose = MathHelper::InverseTranspose(world);
-			worldViewProj = world*view*proj;
-
-			Effects::BasicFX->SetWorld(world);
-			Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-			Effects::BasicFX->SetWorldViewProj(worldViewProj);
-			Effects::BasicFX->SetTexTransform(XMMatrixIdentity());
-			Effects::BasicFX->SetMaterial(mCylinderMat);
-			Effects::BasicFX->SetDiffuseMap(mBrickTexSRV);
-
-			activeTexTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-			md3dImmediateContext->DrawIndexed(mCylinderIndexCount, mCylinderIndexOffset, mCylinderVertexOffset);
-		}
+/// <summary>
+/// Replays the recorded draws of one view, followed by the sky.
+/// </summary>
+/// <param name="view">The view, numbered as in ShadersScene.</param>
+/// <param name="camera">The camera.</param>
+void ShadersApp::ReplayScene(int view, const Camera& camera)
+{
+	TELEMETRY_SCOPE("ReplayScene");
 
-		// Draw the spheres.
-		for (int i = 0; i < 10; ++i)
-		{
-			world = XMLoadFloat4x4(&mSphereWorld[i]);
-			worldInvTranspose = MathHelper::InverseTranspose(world);
-			worldViewProj = world*view*proj;
-
-			Effects::BasicFX->SetWorld(world);
-			Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-			Effects::BasicFX->SetWorldViewProj(worldViewProj);
-			Effects::BasicFX->SetTexTransform(XMMatrixIdentity());
-			Effects::BasicFX->SetMaterial(mSphereMat);
-			Effects::BasicFX->SetDiffuseMap(mStoneTexSRV);
-
-			activeTexTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-			md3dImmediateContext->DrawIndexed(mSphereIndexCount, mSphereIndexOffset, mSphereVertexOffset);
-		}
-	}
+	md3dImmediateContext->IASetInputLayout(InputLayouts::Basic32);
+	md3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	//
-	// Draw the center sphere with the dynamic cube map.
-	//
-	if (drawCenterSphere)
-	{
-		activeReflectTech->GetDesc(&techDesc);
-		for (UINT p = 0; p < techDesc.Passes; ++p)
-		{
-			// Draw the center sphere.
-
-			world = XMLoadFloat4x4(&mCenterSphereWorld);
-			worldInvTranspose = MathHelper::InverseTranspose(world);
-			worldViewProj = world*view*proj;
-
-			Effects::BasicFX->SetWorld(world);
-			Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-			Effects::BasicFX->SetWorldViewProj(worldViewProj);
-			Effects::BasicFX->SetTexTransform(XMMatrixIdentity());
-			Effects::BasicFX->SetMaterial(mCenterSphereMat);
-			Effects::BasicFX->SetDiffuseMap(mStoneTexSRV);
-			Effects::BasicFX->SetCubeMap(mDynamicCubeMapSRV);
-
-			activeReflectTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-			md3dImmediateContext->DrawIndexed(mSphereIndexCount, mSphereIndexOffset, mSphereVertexOffset);
-		}
-	}
+	mBackend.Begin(md3dImmediateContext);
+	mScene.Commands(view).Replay(mBackend);
 
 	mSky->Draw(md3dImmediateContext, camera);
 
@@ -501,6 +611,8 @@ void ShadersApp::DrawScene(const Camera& camera, bool drawCenterSphere)
 /// <param name="z">The z.</param>
 void ShadersApp::BuildCubeFaceCamera(float x, float y, float z)
 {
+	TELEMETRY_SCOPE("BuildCubeFaceCamera");
+
 	// Generate the cube map about the given position.
 	XMFLOAT3 center(x, y, z);
 	XMFLOAT3 worldUp(0.0f, 1.0f, 0.0f);
@@ -537,91 +649,109 @@ void ShadersApp::BuildCubeFaceCamera(float x, float y, float z)
 }
 
 /// <summary>
-/// Builds the dynamic cube map views.
+/// Builds the frame graph: the cube map faces, their mipmaps and the main view, and binds its targets.
 /// </summary>
-void ShadersApp::BuildDynamicCubeMapViews()
+void ShadersApp::BuildFrameGraph()
 {
+	TELEMETRY_SCOPE("BuildFrameGraph");
+
+	mFrameGraph.Reset();
+
 	//
 	// Cubemap is a special texture array with 6 elements.
 	//
 
-	D3D11_TEXTURE2D_DESC texDesc;
-	texDesc.Width = CubeMapSize;
-	texDesc.Height = CubeMapSize;
-	texDesc.MipLevels = 0;
-	texDesc.ArraySize = 6;
-	texDesc.SampleDesc.Count = 1;
-	texDesc.SampleDesc.Quality = 0;
-	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	texDesc.Usage = D3D11_USAGE_DEFAULT;
-	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	texDesc.CPUAccessFlags = 0;
-	texDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS | D3D11_RESOURCE_MISC_TEXTURECUBE;
-
-	ID3D11Texture2D* cubeTex = 0;
-	HR(md3dDevice->CreateTexture2D(&texDesc, 0, &cubeTex));
+	TransientDesc cubeDesc;
+	cubeDesc.Width = CubeMapSize;
+	cubeDesc.Height = CubeMapSize;
+	cubeDesc.ArraySize = 6;
+	cubeDesc.MipLevels = 0;
+	cubeDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	cubeDesc.BytesPerTexel = 4;
+	cubeDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	cubeDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS | D3D11_RESOURCE_MISC_TEXTURECUBE;
 
 	//
-	// Create a render target view to each cube map face 
-	// (i.e., each element in the texture array).
-	// 
+	// We need a depth texture for rendering the scene into the cubemap
+	// that has the same resolution as the cubemap faces.  
+	//
 
-	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc;
-	rtvDesc.Format = texDesc.Format;
-	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
-	rtvDesc.Texture2DArray.ArraySize = 1;
-	rtvDesc.Texture2DArray.MipSlice = 0;
+	TransientDesc depthDesc;
+	depthDesc.Width = CubeMapSize;
+	depthDesc.Height = CubeMapSize;
+	depthDesc.ArraySize = 1;
+	depthDesc.MipLevels = 1;
+	depthDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	depthDesc.BytesPerTexel = 4;
+	depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	depthDesc.MiscFlags = 0;
+
+	mDynamicCubeMap = mFrameGraph.CreateTransient("DynamicCubeMap", cubeDesc);
+	mDynamicCubeMapDepth = mFrameGraph.CreateTransient("DynamicCubeMapDepth", depthDesc);
+	FrameGraph::ResourceId backBuffer = mFrameGraph.Import("BackBuffer");
+	FrameGraph::ResourceId depthStencil = mFrameGraph.Import("DepthStencil");
 
-	for (int i = 0; i < 6; ++i)
+	// Generate the cube map.
+	FrameGraph::PassId faces = mFrameGraph.AddPass("CubeMapFaces", [this]()
 	{
-		rtvDesc.Texture2DArray.FirstArraySlice = i;
-		HR(md3dDevice->CreateRenderTargetView(cubeTex, &rtvDesc, &mDynamicCubeMapRTV[i]));
-	}
+		const RenderTargetPool::Target& cubeMap = mTargets.Get(mFrameGraph, mDynamicCubeMap);
+		ID3D11DepthStencilView* depth = mTargets.Get(mFrameGraph, mDynamicCubeMapDepth).DSV;
 
-	//
-	// Create a shader resource view to the cube map.
-	//
+		md3dImmediateContext->RSSetViewports(1, &mCubeMapViewport);
+		for (int i = 0; i < 6; ++i)
+		{
+			TELEMETRY_SCOPE("CubeMapFace");
 
-	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
-	srvDesc.Format = texDesc.Format;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-	srvDesc.TextureCube.MostDetailedMip = 0;
-	srvDesc.TextureCube.MipLevels = -1;
+			// Clear cube map face and depth buffer.
+			md3dImmediateContext->ClearRenderTargetView(cubeMap.RTVs[i], reinterpret_cast<const float*>(&Colors::Silver));
+			md3dImmediateContext->ClearDepthStencilView(depth, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
-	HR(md3dDevice->CreateShaderResourceView(cubeTex, &srvDesc, &mDynamicCubeMapSRV));
+			// Bind cube map face as render target.
+			ID3D11RenderTargetView* renderTargets[1] = { cubeMap.RTVs[i] };
+			md3dImmediateContext->OMSetRenderTargets(1, renderTargets, depth);
 
-	ReleaseCOM(cubeTex);
+			// Draw the scene with the exception of the center sphere to this cube map face.
+			ReplayScene(i, mCubeMapCamera[i]);
+		}
+	});
+	mFrameGraph.Write(faces, mDynamicCubeMap);
+	mFrameGraph.Write(faces, mDynamicCubeMapDepth, FrameGraph::DepthWrite);
 
-	//
-	// We need a depth texture for rendering the scene into the cubemap
-	// that has the same resolution as the cubemap faces.  
-	//
+	// Have hardware generate lower mipmap levels of cube map.
+	FrameGraph::PassId mips = mFrameGraph.AddPass("GenerateMips", [this]()
+	{
+		TELEMETRY_SCOPE("GenerateMips");
+
+		// Restore old viewport and render targets, which unbinds the cube map.
+		md3dImmediateContext->RSSetViewports(1, &mScreenViewport);
+		ID3D11RenderTargetView* renderTargets[1] = { mRenderTargetView };
+		md3dImmediateContext->OMSetRenderTargets(1, renderTargets, mDepthStencilView);
+
+		md3dImmediateContext->GenerateMips(mTargets.Get(mFrameGraph, mDynamicCubeMap).SRV);
+	});
+	mFrameGraph.Write(mips, mDynamicCubeMap);
+
+	// Now draw the scene as normal, but with the center sphere.
+	FrameGraph::PassId mainView = mFrameGraph.AddPass("MainView", [this]()
+	{
+		TELEMETRY_SCOPE("MainView");
+
+		md3dImmediateContext->ClearRenderTargetView(mRenderTargetView, reinterpret_cast<const float*>(&Colors::Silver));
+		md3dImmediateContext->ClearDepthStencilView(mDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+
+		mBackend.RegisterResource(ShadersScene::CubeMapTexture, mTargets.Get(mFrameGraph, mDynamicCubeMap).SRV);
+		ReplayScene(ShadersScene::MainView, mCam);
+	});
+	mFrameGraph.Read(mainView, mDynamicCubeMap);
+	mFrameGraph.Write(mainView, backBuffer);
+	mFrameGraph.Write(mainView, depthStencil, FrameGraph::DepthWrite);
 
-	D3D11_TEXTURE2D_DESC depthTexDesc;
-	depthTexDesc.Width = CubeMapSize;
-	depthTexDesc.Height = CubeMapSize;
-	depthTexDesc.MipLevels = 1;
-	depthTexDesc.ArraySize = 1;
-	depthTexDesc.SampleDesc.Count = 1;
-	depthTexDesc.SampleDesc.Quality = 0;
-	depthTexDesc.Format = DXGI_FORMAT_D32_FLOAT;
-	depthTexDesc.Usage = D3D11_USAGE_DEFAULT;
-	depthTexDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-	depthTexDesc.CPUAccessFlags = 0;
-	depthTexDesc.MiscFlags = 0;
-
-	ID3D11Texture2D* depthTex = 0;
-	HR(md3dDevice->CreateTexture2D(&depthTexDesc, 0, &depthTex));
-
-	// Create the depth stencil view for the entire cube
-	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc;
-	dsvDesc.Format = depthTexDesc.Format;
-	dsvDesc.Flags = 0;
-	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	dsvDesc.Texture2D.MipSlice = 0;
-	HR(md3dDevice->CreateDepthStencilView(depthTex, &dsvDesc, &mDynamicCubeMapDSV));
-
-	ReleaseCOM(depthTex);
+	mFrameGraph.Compile();
+	mTargets.Bind(md3dDevice, mFrameGraph);
+	GpuResources::Track(mGpuMemory, RenderTargetMemory, "DynamicCubeMap", mTargets.Get(mFrameGraph, mDynamicCubeMap).Texture);
+	GpuResources::Track(mGpuMemory, RenderTargetMemory, "DynamicCubeMapDepth", mTargets.Get(mFrameGraph, mDynamicCubeMapDepth).Texture);
+
+	OutputDebugStringA(mFrameGraph.Report().c_str());
 
 	//
 	// Viewport for drawing into cubemap.
@@ -636,20 +766,24 @@ void ShadersApp::BuildDynamicCubeMapViews()
 }
 
 /// <summary>
-/// Builds the shape geometry buffers.
+/// Generates the shapes and packs them into one vertex and one index array.
 /// </summary>
-void ShadersApp::BuildShapeGeometryBuffers()
+/// <param name="vertices">The packed vertices.</param>
+/// <param name="indices">The packed indices.</param>
+void ShadersApp::GenerateShapeGeometry(std::vector<Vertex::Basic32>& vertices, std::vector<UINT>& indices)
 {
 	GeometryGenerator::MeshData box;
 	GeometryGenerator::MeshData grid;
 	GeometryGenerator::MeshData sphere;
 	GeometryGenerator::MeshData cylinder;
 
-	GeometryGenerator geoGen;
-	geoGen.CreateBox(1.0f, 1.0f, 1.0f, box);
-	geoGen.CreateGrid(20.0f, 30.0f, 60, 40, grid);
-	geoGen.CreateSphere(0.5f, 20, 20, sphere);
-	geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20, cylinder);
+	// The generators share no state, so every mesh is built by its own job.
+	JobCounter generated;
+	mJobs.Submit([&box]()      { GeometryGenerator().CreateBox(1.0f, 1.0f, 1.0f, box); }, &generated);
+	mJobs.Submit([&grid]()     { GeometryGenerator().CreateGrid(20.0f, 30.0f, 60, 40, grid); }, &generated);
+	mJobs.Submit([&sphere]()   { GeometryGenerator().CreateSphere(0.5f, 20, 20, sphere); }, &generated);
+	mJobs.Submit([&cylinder]() { GeometryGenerator().CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20, cylinder); }, &generated);
+	mJobs.Wait(generated);
 
 	// Cache the vertex offsets to each object in the concatenated vertex buffer.
 	mBoxVertexOffset = 0;
@@ -686,130 +820,298 @@ void ShadersApp::BuildShapeGeometryBuffers()
 	// vertices of all the meshes into one vertex buffer.
 	//
 
-	std::vector<Vertex::Basic32> vertices(totalVertexCount);
+	vertices.resize(totalVertexCount);
 
-	UINT k = 0;
-	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = box.Vertices[i].Position;
-		vertices[k].Normal = box.Vertices[i].Normal;
-		vertices[k].Tex = box.Vertices[i].TexC;
-	}
+	const GeometryGenerator::MeshData* meshes[] = { &box, &grid, &sphere, &cylinder };
+	const int offsets[] = { mBoxVertexOffset, mGridVertexOffset, mSphereVertexOffset, mCylinderVertexOffset };
 
-	for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
+	for (int m = 0; m < 4; ++m)
 	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Normal = grid.Vertices[i].Normal;
-		vertices[k].Tex = grid.Vertices[i].TexC;
-	}
+		const std::vector<GeometryGenerator::Vertex>& source = meshes[m]->Vertices;
+		Vertex::Basic32* target = &vertices[offsets[m]];
 
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Normal = sphere.Vertices[i].Normal;
-		vertices[k].Tex = sphere.Vertices[i].TexC;
+		mJobs.ParallelFor(0, source.size(), [&source, target](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				target[i].Pos = source[i].Position;
+				target[i].Normal = source[i].Normal;
+				target[i].Tex = source[i].TexC;
+			}
+		});
 	}
 
-	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
+	//
+	// Pack the indices of all the meshes into one index buffer.
+	//
+
+	indices.reserve(totalIndexCount);
+	indices.insert(indices.end(), box.Indices.begin(), box.Indices.end());
+	indices.insert(indices.end(), grid.Indices.begin(), grid.Indices.end());
+	indices.insert(indices.end(), sphere.Indices.begin(), sphere.Indices.end());
+	indices.insert(indices.end(), cylinder.Indices.begin(), cylinder.Indices.end());
+}
+
+/// <summary>
+/// Loads the skull model.
+/// </summary>
+/// <param name="vertices">The skull vertices.</param>
+/// <param name="indices">The skull indices.</param>
+/// <returns>False if the model is missing or invalid.</returns>
+bool ShadersApp::LoadSkullGeometry(std::vector<Vertex::Basic32>& vertices, std::vector<UINT>& indices)
+{
+	TextModel skull;
+	if (!LoadTextModel("Models/skull.txt", mJobs, skull))
+		return false;
+
+	UINT vcount = skull.Vertices.size();
+
+	vertices.resize(vcount);
+	mJobs.ParallelFor(0, vcount, [&](size_t begin, size_t end)
 	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Normal = cylinder.Vertices[i].Normal;
-		vertices[k].Tex = cylinder.Vertices[i].TexC;
-	}
+		for (size_t i = begin; i < end; ++i)
+		{
+			const TextModelVertex& source = skull.Vertices[i];
+			vertices[i].Pos = XMFLOAT3(source.Position);
+			vertices[i].Normal = XMFLOAT3(source.Normal);
+		}
+	});
 
+	indices.swap(skull.Indices);
+	return true;
+}
+
+/// <summary>
+/// Creates an immutable vertex and index buffer.
+/// </summary>
+/// <param name="name">The name of the geometry in the GPU memory budget.</param>
+/// <param name="vertices">The vertices.</param>
+/// <param name="indices">The indices.</param>
+/// <param name="vb">The vertex buffer created.</param>
+/// <param name="ib">The index buffer created.</param>
+void ShadersApp::CreateGeometryBuffers(const char* name, const std::vector<Vertex::Basic32>& vertices,
+	const std::vector<UINT>& indices, ID3D11Buffer** vb, ID3D11Buffer** ib)
+{
 	D3D11_BUFFER_DESC vbd;
 	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex::Basic32) * totalVertexCount;
+	vbd.ByteWidth = sizeof(Vertex::Basic32) * vertices.size();
 	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	vbd.CPUAccessFlags = 0;
 	vbd.MiscFlags = 0;
 	D3D11_SUBRESOURCE_DATA vinitData;
 	vinitData.pSysMem = &vertices[0];
-	HR(md3dDevice->CreateBuffer(&vbd, &vinitData, &mShapesVB));
-
-	//
-	// Pack the indices of all the meshes into one index buffer.
-	//
-
-	std::vector<UINT> indices;
-	indices.insert(indices.end(), box.Indices.begin(), box.Indices.end());
-	indices.insert(indices.end(), grid.Indices.begin(), grid.Indices.end());
-	indices.insert(indices.end(), sphere.Indices.begin(), sphere.Indices.end());
-	indices.insert(indices.end(), cylinder.Indices.begin(), cylinder.Indices.end());
+	HR(GpuResources::CreateBuffer(md3dDevice, mGpuMemory, GeometryMemory, std::string(name) + " vertices", &vbd, &vinitData, vb));
 
 	D3D11_BUFFER_DESC ibd;
 	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * totalIndexCount;
+	ibd.ByteWidth = sizeof(UINT) * indices.size();
 	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	ibd.CPUAccessFlags = 0;
 	ibd.MiscFlags = 0;
 	D3D11_SUBRESOURCE_DATA iinitData;
 	iinitData.pSysMem = &indices[0];
-	HR(md3dDevice->CreateBuffer(&ibd, &iinitData, &mShapesIB));
+	HR(GpuResources::CreateBuffer(md3dDevice, mGpuMemory, GeometryMemory, std::string(name) + " indices", &ibd, &iinitData, ib));
+}
+
+/// <summary>
+/// Creates the floor, stone and brick textures at the current mip bias and hands them to the replay backend.
+/// </summary>
+/// <param name="files">The contents of the texture files.</param>
+void ShadersApp::CreateTextures(const std::vector<char> files[3])
+{
+	mFloorTex = LoadTexture(TextureNames[0], files[0]);
+	mStoneTex = LoadTexture(TextureNames[1], files[1]);
+	mBrickTex = LoadTexture(TextureNames[2], files[2]);
+
+	mFloorTexSRV = mFloorTex.Get();
+	mStoneTexSRV = mStoneTex.Get();
+	mBrickTexSRV = mBrickTex.Get();
+
+	mBackend.RegisterResource(ShadersScene::FloorTexture, mFloorTexSRV);
+	mBackend.RegisterResource(ShadersScene::StoneTexture, mStoneTexSRV);
+	mBackend.RegisterResource(ShadersScene::BrickTexture, mBrickTexSRV);
+}
+
+/// <summary>
+/// Creates a texture through the resource registry, so files with the same content share one view.
+/// The top mTextureMipBias mips are skipped.
+/// </summary>
+/// <param name="name">The name of the texture in the GPU memory budget.</param>
+/// <param name="data">The contents of a DDS file.</param>
+/// <returns>The shared view.</returns>
+ResourceHandle<ID3D11ShaderResourceView> ShadersApp::LoadTexture(const char* name, const std::vector<char>& data)
+{
+	ResourceHandle<ID3D11ShaderResourceView> texture =
+		RegistryResources::CreateTexture(md3dDevice, mResources, &data[0], data.size(), mTextureMipBias);
+
+	// A texture shared with an earlier load is tracked already, and stays as it is.
+	GpuResources::Track(mGpuMemory, TextureMemory, name, texture.Get());
+	return texture;
 }
 
 /// <summary>
-/// Builds the skull geometry buffers.
+/// Reloads the textures one mip smaller. The old ones go once the registry lets them go, after this frame.
 /// </summary>
-void ShadersApp::BuildSkullGeometryBuffers()
+/// <returns>False once the textures are at the smallest size allowed, or if a file cannot be read.</returns>
+bool ShadersApp::ReduceTextureDetail()
 {
-	std::ifstream fin("Models/skull.txt");
+	if (mTextureMipBias == MaxTextureMipBias)
+		return false;
 
-	if (!fin)
+	// Keep the textures there are if one of the files went missing meanwhile.
+	std::vector<char> files[3];
+	for (int i = 0; i < 3; ++i)
 	{
-		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
-		return;
+		if (!RegistryResources::ReadFile(TextureFiles[i], files[i]))
+		{
+			OutputDebugStringW((std::wstring(TextureFiles[i]) + L" not found or empty.\n").c_str());
+			return false;
+		}
 	}
 
-	UINT vcount = 0;
-	UINT tcount = 0;
-	std::string ignore;
+	++mTextureMipBias;
+	CreateTextures(files);
+	return true;
+}
 
-	fin >> ignore >> vcount;
-	fin >> ignore >> tcount;
-	fin >> ignore >> ignore >> ignore >> ignore;
+/// <summary>
+/// Sets the video memory the demo may use.
+/// </summary>
+/// <param name="bytes">The budget; 0 for none.</param>
+void ShadersApp::SetGpuBudget(UINT64 bytes)
+{
+	mGpuMemory.SetTotalBudget(bytes);
+}
 
-	std::vector<Vertex::Basic32> vertices(vcount);
-	for (UINT i = 0; i < vcount; ++i)
+/// <summary>
+/// Moves the animation to a thread of its own, ticking at a fixed rate from the
+/// current time. Camera and input stay on the render thread.
+/// </summary>
+/// <param name="ticksPerSecond">The simulation rate.</param>
+void ShadersApp::StartSimulation(float ticksPerSecond)
+{
+	ShadersScene::Snapshot initial;
+	mScene.Simulate(mTimer.TotalTime(), initial);
+
+	mSimulation.Start(1.0f/ticksPerSecond, initial, [this](ShadersScene::Snapshot& state, float dt)
 	{
-		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
-	}
+		mScene.Simulate(state.Time + dt, state);
+	});
+}
 
-	fin >> ignore;
-	fin >> ignore;
-	fin >> ignore;
+/// <summary>
+/// Builds the tree a mesh is picked with, from its part of a packed vertex and
+/// index array.
+/// </summary>
+/// <param name="mesh">The mesh.</param>
+/// <param name="vertices">The packed vertices.</param>
+/// <param name="firstVertex">The first vertex of the mesh.</param>
+/// <param name="vertexCount">The vertices of the mesh.</param>
+/// <param name="indices">The packed indices, relative to the first vertex.</param>
+/// <param name="firstIndex">The first index of the mesh.</param>
+/// <param name="indexCount">The indices of the mesh.</param>
+void ShadersApp::BuildPickMesh(ShadersScene::Mesh mesh, const std::vector<Vertex::Basic32>& vertices, UINT firstVertex, UINT vertexCount,
+	const std::vector<UINT>& indices, UINT firstIndex, UINT indexCount)
+{
+	TELEMETRY_SCOPE("BuildPickMesh");
+
+	mPickMeshes[mesh].Build(&vertices[firstVertex].Pos.x, sizeof(Vertex::Basic32), vertexCount,
+		&indices[firstIndex], indexCount/3, &mJobs);
+}
 
-	mSkullIndexCount = 3 * tcount;
-	std::vector<UINT> indices(mSkullIndexCount);
-	for (UINT i = 0; i < tcount; ++i)
+/// <summary>
+/// Places every pickable object in the pick scene.
+/// </summary>
+void ShadersApp::BuildPickScene()
+{
+	for (UINT object = 0; object < ShadersScene::ObjectCount; ++object)
+		mPickScene.Add(&mPickMeshes[ShadersScene::MeshOf(object)], &ObjectWorld(object)._11, object);
+}
+
+/// <summary>
+/// The world matrix an object is drawn with.
+/// </summary>
+/// <param name="object">The object.</param>
+/// <returns>The world matrix.</returns>
+const XMFLOAT4X4& ShadersApp::ObjectWorld(UINT object)const
+{
+	// The scene keeps its matrices as 16 floats, laid out as in XMFLOAT4X4.
+	return *reinterpret_cast<const XMFLOAT4X4*>(mScene.ObjectWorld(object));
+}
+
+/// <summary>
+/// Traces a ray through the pixel against the triangles of the scene and names
+/// what it hit in the window caption.
+/// </summary>
+/// <param name="x">The x of the pixel.</param>
+/// <param name="y">The y of the pixel.</param>
+void ShadersApp::Pick(int x, int y)
+{
+	TELEMETRY_SCOPE("Pick");
+
+	// The skull moves, so every object is placed where it is now.
+	for (UINT object = 0; object < ShadersScene::ObjectCount; ++object)
+		mPickScene.SetWorld(object, &ObjectWorld(object)._11);
+
+	// Through the pixel on the view plane at distance 1, in world space.
+	XMFLOAT4X4 proj;
+	XMStoreFloat4x4(&proj, mCam.Proj());
+	float vx = (+2.0f*x/mClientWidth - 1.0f)/proj._11;
+	float vy = (-2.0f*y/mClientHeight + 1.0f)/proj._22;
+
+	XMFLOAT3 origin = mCam.GetPosition();
+	XMFLOAT3 right = mCam.GetRight();
+	XMFLOAT3 up = mCam.GetUp();
+	XMFLOAT3 look = mCam.GetLook();
+
+	BvhRay ray;
+	ray.Origin[0] = origin.x;
+	ray.Origin[1] = origin.y;
+	ray.Origin[2] = origin.z;
+	ray.Direction[0] = vx*right.x + vy*up.x + look.x;
+	ray.Direction[1] = vx*right.y + vy*up.y + look.y;
+	ray.Direction[2] = vx*right.z + vy*up.z + look.z;
+	ray.MaxT = FLT_MAX;
+
+	std::wostringstream caption;
+	caption << L"Reflective Chrome";
+
+	BvhHit hit;
+	if (mPickScene.Intersect(ray, hit))
 	{
-		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+		const wchar_t* names[] = { L"grid", L"box", L"center sphere", L"skull" };
+
+		caption << L" - ";
+		if (hit.Object < ShadersScene::FirstSphereObject)
+			caption << names[hit.Object];
+		else if (hit.Object < ShadersScene::FirstCylinderObject)
+			caption << L"sphere " << hit.Object - ShadersScene::FirstSphereObject;
+		else
+			caption << L"cylinder " << hit.Object - ShadersScene::FirstCylinderObject;
+		caption << L", triangle " << hit.Triangle;
 	}
 
-	fin.close();
+	mMainWndCaption = caption.str();
+}
 
-	D3D11_BUFFER_DESC vbd;
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex::Basic32) * vcount;
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vbd.CPUAccessFlags = 0;
-	vbd.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA vinitData;
-	vinitData.pSysMem = &vertices[0];
-	HR(md3dDevice->CreateBuffer(&vbd, &vinitData, &mSkullVB));
+/// <summary>
+/// Gives the scene where each mesh is in the vertex and index buffers and the bounds
+/// of its pick tree, and puts the objects in the scene's grid.
+/// </summary>
+void ShadersApp::SetSceneMeshes()
+{
+	const UINT indexCounts[] = { mBoxIndexCount, mGridIndexCount, mSphereIndexCount, mCylinderIndexCount, mSkullIndexCount };
+	const UINT startIndices[] = { mBoxIndexOffset, mGridIndexOffset, mSphereIndexOffset, mCylinderIndexOffset, 0 };
+	const int baseVertices[] = { mBoxVertexOffset, mGridVertexOffset, mSphereVertexOffset, mCylinderVertexOffset, 0 };
 
-	//
-	// Pack the indices of all the meshes into one index buffer.
-	//
+	for (int mesh = 0; mesh < ShadersScene::MeshCount; ++mesh)
+	{
+		// A mesh that did not load is a point at the object's origin.
+		const TriangleBvh& tree = mPickMeshes[mesh];
+		const float origin[3] = { 0.0f, 0.0f, 0.0f };
+		mScene.SetMesh((ShadersScene::Mesh)mesh, indexCounts[mesh], startIndices[mesh], baseVertices[mesh],
+			tree.Empty() ? origin : tree.Min(), tree.Empty() ? origin : tree.Max());
+	}
 
-	D3D11_BUFFER_DESC ibd;
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * mSkullIndexCount;
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA iinitData;
-	iinitData.pSysMem = &indices[0];
-	HR(md3dDevice->CreateBuffer(&ibd, &iinitData, &mSkullIB));
-}
\ No newline at end of file
+	mScene.BuildObjectGrid();
+}
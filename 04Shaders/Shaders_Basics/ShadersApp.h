@@ -9,6 +9,27 @@
 #include "Vertex.h"
 #include "Camera.h"
 #include "Sky.h"
+#include "RenderQueue.h"
+#include "CommandBuffer.h"
+#include "JobSystem.h"
+#include "TextModel.h"
+#include "LightGrid.h"
+#include "Telemetry.h"
+#include "BenchHarness.h"
+#include "ResourceRegistry.h"
+#include "StartupGraph.h"
+#include "FrameGraph.h"
+#include "D3D11/RenderTargetPool.h"
+#include "GpuBudget.h"
+#include "D3D11/GpuResources.h"
+#include "AllocationProfiler.h"
+#include "FrameMemory.h"
+#include "TriangleBvh.h"
+#include "SpatialGrid.h"
+#include "TransformHierarchy.h"
+#include "SimulationLoop.h"
+#include "EffectBackend.h"
+#include "ShadersScene.h"
 
 class ShadersApp : public D3DApp
 {
@@ -25,16 +46,56 @@ public:
 	void OnMouseUp(WPARAM btnState, int x, int y);
 	void OnMouseMove(WPARAM btnState, int x, int y);
 
+	void BenchFrame(float dt, const Bench::CameraPose& camera, CommandBackend& backend);
+	bool RunBenchmark(unsigned int frames, const char* path);
+
+	// Video memory the demo may use; over it, textures drop their top mips.
+	void SetGpuBudget(UINT64 bytes);
+
+	// Animates the scene on a thread of its own at a fixed tick; frames draw it
+	// between the last two ticks.
+	void StartSimulation(float ticksPerSecond);
+
 private:
-	void DrawScene(const Camera& camera, bool drawSkull);
 	void BuildCubeFaceCamera(float x, float y, float z);
-	void BuildDynamicCubeMapViews();
-	void BuildShapeGeometryBuffers();
-	void BuildSkullGeometryBuffers();
+	void BuildFrameGraph();
+	void GenerateShapeGeometry(std::vector<Vertex::Basic32>& vertices, std::vector<UINT>& indices);
+	bool LoadSkullGeometry(std::vector<Vertex::Basic32>& vertices, std::vector<UINT>& indices);
+	void CreateGeometryBuffers(const char* name, const std::vector<Vertex::Basic32>& vertices,
+		const std::vector<UINT>& indices, ID3D11Buffer** vb, ID3D11Buffer** ib);
+	void CreateTextures(const std::vector<char> files[3]);
+	ResourceHandle<ID3D11ShaderResourceView> LoadTexture(const char* name, const std::vector<char>& data);
+	bool ReduceTextureDetail();
+
+	// Every mesh of the scene can be picked; the objects of the scene are the
+	// instances of the pick scene, in their order.
+	void BuildPickMesh(ShadersScene::Mesh mesh, const std::vector<Vertex::Basic32>& vertices, UINT firstVertex, UINT vertexCount,
+		const std::vector<UINT>& indices, UINT firstIndex, UINT indexCount);
+	void BuildPickScene();
+	const XMFLOAT4X4& ObjectWorld(UINT object)const;
+	void Pick(int x, int y);
+	void SetSceneMeshes();
 
 	void GetInput();
 
 private:
+	// A dynamic structured buffer that grows to fit what is uploaded into it.
+	struct DynamicBuffer
+	{
+		ID3D11Buffer* Buffer;
+		ID3D11ShaderResourceView* SRV;
+		UINT Capacity;
+	};
+
+	void UploadClusters();
+	void UploadStructured(const char* name, DynamicBuffer& target, const void* data, UINT count, UINT stride);
+
+	void ReplayScene(int view, const Camera& camera);
+
+private:
+	// Declared first, so every resource tracked with it is gone before it.
+	GpuBudget mGpuMemory;
+
 	// input parameters
 	float reflectionAmount, minReflection, maxReflection;
 
@@ -46,32 +107,56 @@ private:
 	ID3D11Buffer* mSkullVB;
 	ID3D11Buffer* mSkullIB;
 
+	// Declared before the handles, so it outlives them.
+	ResourceRegistry mResources;
+
+	ResourceHandle<ID3D11ShaderResourceView> mFloorTex;
+	ResourceHandle<ID3D11ShaderResourceView> mStoneTex;
+	ResourceHandle<ID3D11ShaderResourceView> mBrickTex;
+
 	ID3D11ShaderResourceView* mFloorTexSRV;
 	ID3D11ShaderResourceView* mStoneTexSRV;
 	ID3D11ShaderResourceView* mBrickTexSRV;
 
-	ID3D11DepthStencilView* mDynamicCubeMapDSV;
-	ID3D11RenderTargetView* mDynamicCubeMapRTV[6];
-	ID3D11ShaderResourceView* mDynamicCubeMapSRV;
+	// Mips skipped when loading the textures, raised when over the budget.
+	UINT mTextureMipBias;
+	static const UINT MaxTextureMipBias = 3;
+
+	// The dynamic cube map and its depth buffer are transients of the frame graph.
+	FrameGraph mFrameGraph;
+	RenderTargetPool mTargets;
+	FrameGraph::ResourceId mDynamicCubeMap;
+	FrameGraph::ResourceId mDynamicCubeMapDepth;
 	D3D11_VIEWPORT mCubeMapViewport;
 
 	static const int CubeMapSize = 256;
+	static const char* WarmupListFile;
+
+	JobSystem mJobs;
+
+	// The objects, their animation and the recording of every view; see ShadersScene.h.
+	ShadersScene mScene;
+
+	// Frames drawn so far. The first WarmupFrames size the arenas and caches;
+	// after them a frame should not allocate from the heap.
+	UINT mFramesDrawn;
+	static const UINT WarmupFrames = 10;
+	EffectBackend mBackend;
 
-	DirectionalLight mDirLights[3];
-	Material mGridMat;
-	Material mBoxMat;
-	Material mCylinderMat;
-	Material mSphereMat;
-	Material mSkullMat;
-	Material mCenterSphereMat;
-
-	// Define transformations from local spaces to world space.
-	XMFLOAT4X4 mSphereWorld[10];
-	XMFLOAT4X4 mCylWorld[10];
-	XMFLOAT4X4 mBoxWorld;
-	XMFLOAT4X4 mGridWorld;
-	XMFLOAT4X4 mSkullWorld;
-	XMFLOAT4X4 mCenterSphereWorld;
+	// Seconds of animation a benchmark has stepped; UpdateScene animates on them
+	// instead of the timer while mBenchmarking.
+	double mBenchTime;
+	bool mBenchmarking;
+
+	TriangleBvh mPickMeshes[ShadersScene::MeshCount];
+	BvhScene mPickScene;
+
+	DynamicBuffer mClusterLightsBuffer;
+	DynamicBuffer mClusterRangesBuffer;
+	DynamicBuffer mClusterIndicesBuffer;
+
+	// Declared after everything its ticks read, so it stops first.
+	SimulationLoop<ShadersScene::Snapshot> mSimulation;
 
 	int mBoxVertexOffset;
 	int mGridVertexOffset;
@@ -90,8 +175,6 @@ private:
 
 	UINT mSkullIndexCount;
 
-	UINT mLightCount;
-
 	Camera mCam;
 	Camera mCubeMapCamera[6];
 
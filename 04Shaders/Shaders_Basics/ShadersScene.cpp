@@ -0,0 +1,567 @@
+//***************************************************************************************
+// ShadersScene.cpp
+//***************************************************************************************
+
+#include "ShadersScene.h"
+#include "ShaderPermutation.h"
+#include "Telemetry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+namespace
+{
+	const float Pi = 3.1415926535f;
+
+	const size_t FrameMemorySize = 64*1024;
+
+	// Ambient, diffuse, specular and reflect of each material, from GridMaterial on.
+	const float Materials[ShadersScene::MaterialCount][16] =
+	{
+		{ 0.8f, 0.8f, 0.8f, 1.0f,  0.8f, 0.8f, 0.8f, 1.0f,  0.8f, 0.8f, 0.8f, 16.0f,  0.0f, 0.0f, 0.0f, 1.0f },
+		{ 1.0f, 1.0f, 1.0f, 1.0f,  1.0f, 1.0f, 1.0f, 1.0f,  0.8f, 0.8f, 0.8f, 16.0f,  0.0f, 0.0f, 0.0f, 1.0f },
+		{ 1.0f, 1.0f, 1.0f, 1.0f,  1.0f, 1.0f, 1.0f, 1.0f,  0.8f, 0.8f, 0.8f, 16.0f,  0.0f, 0.0f, 0.0f, 1.0f },
+		{ 0.6f, 0.8f, 1.0f, 1.0f,  0.6f, 0.8f, 1.0f, 1.0f,  0.9f, 0.9f, 0.9f, 16.0f,  0.0f, 0.0f, 0.0f, 1.0f },
+		{ 0.2f, 0.2f, 0.2f, 1.0f,  0.2f, 0.2f, 0.2f, 1.0f,  0.8f, 0.8f, 0.8f, 16.0f,  0.0f, 0.0f, 0.0f, 1.0f },
+		{ 0.2f, 0.2f, 0.2f, 1.0f,  0.2f, 0.2f, 0.2f, 1.0f,  0.6f, 0.6f, 0.6f, 16.0f,  0.8f, 0.8f, 0.8f, 1.0f }
+	};
+
+	// Ambient, diffuse, specular and direction of the three directional lights.
+	const float DirLights[3][16] =
+	{
+		{ 0.2f, 0.2f, 0.2f, 1.0f,  0.5f, 0.5f, 0.5f, 1.0f,    0.5f, 0.5f, 0.5f, 1.0f,    0.57735f, -0.57735f, 0.57735f, 0.0f },
+		{ 0.0f, 0.0f, 0.0f, 1.0f,  0.20f, 0.20f, 0.20f, 1.0f, 0.25f, 0.25f, 0.25f, 1.0f, -0.57735f, -0.57735f, 0.57735f, 0.0f },
+		{ 0.0f, 0.0f, 0.0f, 1.0f,  0.2f, 0.2f, 0.2f, 1.0f,    0.0f, 0.0f, 0.0f, 1.0f,    0.0f, -0.707f, -0.707f, 0.0f }
+	};
+
+	void Identity(float m[16])
+	{
+		memset(m, 0, 16*sizeof(float));
+		m[0] = m[5] = m[10] = m[15] = 1.0f;
+	}
+
+	void Scaling(float x, float y, float z, float m[16])
+	{
+		Identity(m);
+		m[0] = x;
+		m[5] = y;
+		m[10] = z;
+	}
+
+	void Translation(float x, float y, float z, float m[16])
+	{
+		Identity(m);
+		m[12] = x;
+		m[13] = y;
+		m[14] = z;
+	}
+
+	void RotationY(float angle, float m[16])
+	{
+		Identity(m);
+		float c = cosf(angle);
+		float s = sinf(angle);
+		m[0] = c;
+		m[2] = -s;
+		m[8] = s;
+		m[10] = c;
+	}
+
+	// out = a*b; out may not be a or b.
+	void Multiply(const float a[16], const float b[16], float out[16])
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int j = 0; j < 4; ++j)
+			{
+				out[i*4 + j] = a[i*4 + 0]*b[0*4 + j] + a[i*4 + 1]*b[1*4 + j] +
+					a[i*4 + 2]*b[2*4 + j] + a[i*4 + 3]*b[3*4 + j];
+			}
+		}
+	}
+
+	void Normalize(float v[3])
+	{
+		float length = sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+		v[0] /= length;
+		v[1] /= length;
+		v[2] /= length;
+	}
+
+	void Cross(const float a[3], const float b[3], float out[3])
+	{
+		out[0] = a[1]*b[2] - a[2]*b[1];
+		out[1] = a[2]*b[0] - a[0]*b[2];
+		out[2] = a[0]*b[1] - a[1]*b[0];
+	}
+
+	float Dot(const float a[3], const float b[3])
+	{
+		return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+	}
+
+	// The longest axis of a world matrix, which stretches a bounding sphere the most.
+	float MaxScale(const float w[16])
+	{
+		float scale = 0.0f;
+		for (int r = 0; r < 3; ++r)
+			scale = std::max(scale, sqrtf(w[r*4 + 0]*w[r*4 + 0] + w[r*4 + 1]*w[r*4 + 1] + w[r*4 + 2]*w[r*4 + 2]));
+		return scale;
+	}
+}
+
+#pragma region Camera
+void ShadersScene::Camera::LookAt(const float eye[3], const float target[3], const float up[3])
+{
+	float look[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+	Normalize(look);
+	float right[3];
+	Cross(up, look, right);
+	Normalize(right);
+	float newUp[3];
+	Cross(look, right, newUp);
+
+	memcpy(Position, eye, sizeof(Position));
+	Identity(View);
+	for (int i = 0; i < 3; ++i)
+	{
+		View[i*4 + 0] = right[i];
+		View[i*4 + 1] = newUp[i];
+		View[i*4 + 2] = look[i];
+	}
+	View[12] = -Dot(right, eye);
+	View[13] = -Dot(newUp, eye);
+	View[14] = -Dot(look, eye);
+
+	Multiply(View, Proj, ViewProj);
+}
+
+void ShadersScene::Camera::SetLens(float fovY, float aspect, float nearZ, float farZ)
+{
+	NearZ = nearZ;
+	FarZ = farZ;
+
+	float h = 1.0f/tanf(0.5f*fovY);
+	memset(Proj, 0, sizeof(Proj));
+	Proj[0] = h/aspect;
+	Proj[5] = h;
+	Proj[10] = farZ/(farZ - nearZ);
+	Proj[11] = 1.0f;
+	Proj[14] = -nearZ*farZ/(farZ - nearZ);
+}
+#pragma endregion
+
+ShadersScene::ShadersScene(JobSystem& jobs)
+	: mJobs(jobs), mFrameMemory(FrameMemorySize), mObjectGrid(8.0f)
+{
+	// Zero the per frame constants first, so their padding compares equal every frame.
+	memset(&mPerFrame, 0, sizeof(mPerFrame));
+	memcpy(mPerFrame.DirLights, DirLights, sizeof(DirLights));
+	memcpy(mMaterials, Materials, sizeof(Materials));
+	memset(mMeshes, 0, sizeof(mMeshes));
+
+	// Generate the cube map about the center sphere, looking along each coordinate
+	// axis. Looking down +Y or -Y needs an up vector other than the world's.
+	const float center[3] = { 0.0f, 2.0f, 0.0f };
+	const float axes[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const float ups[6][3] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+	for (int i = 0; i < 6; ++i)
+	{
+		float target[3] = { center[0] + axes[i][0], center[1] + axes[i][1], center[2] + axes[i][2] };
+		mCubeMapCamera[i].SetLens(0.5f*Pi, 1.0f, 0.1f, 1000.0f);
+		mCubeMapCamera[i].LookAt(center, target, ups[i]);
+	}
+
+	BuildObjects();
+	BuildClusterLights();
+}
+
+/// <summary>
+/// Places every object and says how it is drawn.
+/// </summary>
+void ShadersScene::BuildObjects()
+{
+	ObjectDraw grid = { OpaquePass, FloorTexture, GridMaterial, false };
+	ObjectDraw box = { OpaquePass, StoneTexture, BoxMaterial, false };
+	ObjectDraw sphere = { OpaquePass, StoneTexture, SphereMaterial, false };
+	ObjectDraw cylinder = { OpaquePass, BrickTexture, CylinderMaterial, false };
+	ObjectDraw skull = { OpaquePass, NoTexture, SkullMaterial, false };
+
+	// The center sphere samples the dynamic cube map, so it is drawn after everything else.
+	ObjectDraw centerSphere = { ReflectPass, StoneTexture, CenterSphereMaterial, true };
+
+	mObjects[GridObject] = grid;
+	mObjects[BoxObject] = box;
+	mObjects[CenterSphereObject] = centerSphere;
+	mObjects[SkullObject] = skull;
+
+	float I[16], a[16], b[16], m[16];
+	Identity(I);
+	TransformHierarchy::Node root = TransformHierarchy::None;
+	mObjectNodes[GridObject] = mTransforms.Add(root, I);
+
+	Scaling(3.0f, 1.0f, 3.0f, a);
+	Translation(0.0f, 0.5f, 0.0f, b);
+	Multiply(a, b, m);
+	mObjectNodes[BoxObject] = mTransforms.Add(root, m);
+
+	Scaling(2.0f, 2.0f, 2.0f, a);
+	Translation(0.0f, 2.0f, 0.0f, b);
+	Multiply(a, b, m);
+	mObjectNodes[CenterSphereObject] = mTransforms.Add(root, m);
+
+	for (int i = 0; i < 5; ++i)
+	{
+		for (int side = 0; side < 2; ++side)
+		{
+			float x = side ? 5.0f : -5.0f;
+			float z = -10.0f + i*5.0f;
+
+			mObjects[FirstCylinderObject + i*2 + side] = cylinder;
+			Translation(x, 1.5f, z, m);
+			mObjectNodes[FirstCylinderObject + i*2 + side] = mTransforms.Add(root, m);
+
+			mObjects[FirstSphereObject + i*2 + side] = sphere;
+			Translation(x, 3.5f, z, m);
+			mObjectNodes[FirstSphereObject + i*2 + side] = mTransforms.Add(root, m);
+		}
+	}
+
+	// The skull spins in place, offset from the center of its orbit; Animate turns
+	// the orbit and the spin.
+	mSkullOrbitNode = mTransforms.Add(root, I);
+	Translation(3.0f, 2.0f, 0.0f, m);
+	TransformHierarchy::Node skullOffset = mTransforms.Add(mSkullOrbitNode, m);
+	Scaling(0.2f, 0.2f, 0.2f, m);
+	mObjectNodes[SkullObject] = mTransforms.Add(skullOffset, m);
+	mTransforms.Update();
+}
+
+/// <summary>
+/// Places the clustered point and spot lights on orbits above the floor, from a
+/// fixed seed so that every run shows the same scene.
+/// </summary>
+void ShadersScene::BuildClusterLights()
+{
+	std::minstd_rand random(1);
+	auto randF = [&random](float a, float b)
+	{
+		return a + (b - a)*std::uniform_real_distribution<float>(0.0f, 1.0f)(random);
+	};
+
+	mClusterLights.resize(ClusterLightCount);
+	mLightOrbits.resize(ClusterLightCount);
+
+	for (int i = 0; i < ClusterLightCount; ++i)
+	{
+		LightOrbit& orbit = mLightOrbits[i];
+		orbit.Radius = randF(2.0f, 14.0f);
+		orbit.Angle = randF(0.0f, 2.0f*Pi);
+		orbit.Speed = randF(-0.5f, 0.5f);
+		orbit.Height = randF(0.3f, 4.0f);
+
+		ClusterLight& light = mClusterLights[i];
+		memset(&light, 0, sizeof(light));
+		light.Range = randF(1.0f, 3.0f);
+		light.Color[0] = randF(0.1f, 1.0f);
+		light.Color[1] = randF(0.1f, 1.0f);
+		light.Color[2] = randF(0.1f, 1.0f);
+
+		// Every fourth light is a spot light shining down.
+		if (i % 4 == 0)
+		{
+			light.Direction[1] = -1.0f;
+			light.SpotCos = cosf(randF(0.3f, 0.8f));
+			light.Range *= 2.0f;
+		}
+		else
+		{
+			light.SpotCos = -1.0f;
+		}
+	}
+}
+
+void ShadersScene::SetMesh(Mesh mesh, unsigned int indexCount, unsigned int startIndex, int baseVertex,
+	const float min[3], const float max[3])
+{
+	MeshRange& range = mMeshes[mesh];
+	range.IndexCount = indexCount;
+	range.StartIndex = startIndex;
+	range.BaseVertex = baseVertex;
+
+	float diagonal = 0.0f;
+	for (int k = 0; k < 3; ++k)
+	{
+		range.Bounds[k] = 0.5f*(min[k] + max[k]);
+		diagonal += (max[k] - min[k])*(max[k] - min[k]);
+	}
+	range.Bounds[3] = 0.5f*sqrtf(diagonal);
+}
+
+/// <summary>
+/// Puts the bounds of every object in the object grid.
+/// </summary>
+void ShadersScene::BuildObjectGrid()
+{
+	float spheres[ObjectCount][4];
+	for (unsigned int object = 0; object < ObjectCount; ++object)
+		ObjectBounds(object, spheres[object]);
+
+	mObjectGrid.Build(spheres[0], sizeof(spheres[0]), ObjectCount);
+}
+
+void ShadersScene::SetReflection(float amount)
+{
+	float* reflect = &mMaterials[CenterSphereMaterial][12];
+	reflect[0] = reflect[1] = reflect[2] = amount;
+}
+
+const float* ShadersScene::ObjectWorld(unsigned int object)const
+{
+	return mTransforms.World(mObjectNodes[object]);
+}
+
+ShadersScene::Mesh ShadersScene::MeshOf(unsigned int object)
+{
+	switch (object)
+	{
+	case GridObject:         return GridMesh;
+	case BoxObject:          return BoxMesh;
+	case CenterSphereObject: return SphereMesh;
+	case SkullObject:        return SkullMesh;
+	default:                 return object < FirstCylinderObject ? SphereMesh : CylinderMesh;
+	}
+}
+
+/// <summary>
+/// The world space bounding sphere of an object.
+/// </summary>
+/// <param name="object">The object.</param>
+/// <param name="sphere">The center and radius.</param>
+void ShadersScene::ObjectBounds(unsigned int object, float sphere[4])const
+{
+	const float* w = ObjectWorld(object);
+	const float* c = mMeshes[MeshOf(object)].Bounds;
+
+	for (int k = 0; k < 3; ++k)
+		sphere[k] = c[0]*w[0*4 + k] + c[1]*w[1*4 + k] + c[2]*w[2*4 + k] + w[3*4 + k];
+	sphere[3] = c[3]*MaxScale(w);
+}
+
+void ShadersScene::Simulate(double time, Snapshot& state)const
+{
+	state.Time = time;
+	state.SkullSpin = (float)(2.0*time);
+	state.SkullOrbit = (float)(0.5*time);
+
+	state.LightPositions.resize(3*mLightOrbits.size());
+	for (size_t i = 0; i < mLightOrbits.size(); ++i)
+	{
+		const LightOrbit& orbit = mLightOrbits[i];
+		float angle = orbit.Angle + (float)(orbit.Speed*time);
+
+		state.LightPositions[3*i + 0] = orbit.Radius*cosf(angle);
+		state.LightPositions[3*i + 1] = orbit.Height;
+		state.LightPositions[3*i + 2] = orbit.Radius*sinf(angle);
+	}
+}
+
+void ShadersScene::Animate(double time)
+{
+	TELEMETRY_SCOPE("AnimateScene");
+
+	mJobs.ParallelFor(0, mClusterLights.size(), [this, time](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const LightOrbit& orbit = mLightOrbits[i];
+			float angle = orbit.Angle + (float)(orbit.Speed*time);
+
+			mClusterLights[i].Position[0] = orbit.Radius*cosf(angle);
+			mClusterLights[i].Position[1] = orbit.Height;
+			mClusterLights[i].Position[2] = orbit.Radius*sinf(angle);
+		}
+	});
+
+	PlaceSkull((float)(2.0*time), (float)(0.5*time));
+}
+
+void ShadersScene::Animate(const Snapshot& from, const Snapshot& to, float alpha)
+{
+	TELEMETRY_SCOPE("AnimateScene");
+
+	for (size_t i = 0; i < mClusterLights.size(); ++i)
+	{
+		const float* a = &from.LightPositions[3*i];
+		const float* b = &to.LightPositions[3*i];
+
+		for (int k = 0; k < 3; ++k)
+			mClusterLights[i].Position[k] = a[k] + alpha*(b[k] - a[k]);
+	}
+
+	PlaceSkull(from.SkullSpin + alpha*(to.SkullSpin - from.SkullSpin),
+		from.SkullOrbit + alpha*(to.SkullOrbit - from.SkullOrbit));
+}
+
+/// <summary>
+/// Turns the skull and its orbit, and updates the world matrices and the skull's
+/// place in the object grid.
+/// </summary>
+/// <param name="spin">The angle of the skull about its own axis.</param>
+/// <param name="orbit">The angle of the skull around the center sphere.</param>
+void ShadersScene::PlaceSkull(float spin, float orbit)
+{
+	float scale[16], rotate[16], m[16];
+	Scaling(0.2f, 0.2f, 0.2f, scale);
+	RotationY(spin, rotate);
+	Multiply(scale, rotate, m);
+	mTransforms.SetLocal(mObjectNodes[SkullObject], m);
+	RotationY(orbit, m);
+	mTransforms.SetLocal(mSkullOrbitNode, m);
+	mTransforms.Update(&mJobs);
+
+	// The skull is the one object that moves.
+	float skull[4];
+	ObjectBounds(SkullObject, skull);
+	mObjectGrid.Move(SkullObject, skull, skull[3]);
+}
+
+/// <summary>
+/// Records the six cube map faces and the main view in parallel, and culls the
+/// clustered lights meanwhile. Recording only reads the scene and writes the view's
+/// own command buffer.
+/// </summary>
+/// <param name="camera">The camera of the main view.</param>
+void ShadersScene::Record(const Camera& camera)
+{
+	mFrameMemory.BeginFrame();
+
+	memcpy(mPerFrame.EyePosW, camera.Position, sizeof(mPerFrame.EyePosW));
+
+	JobCounter recorded;
+	for (int i = 0; i < 6; ++i)
+		mJobs.Submit([this, i]() { RecordView(mViews[i], mCubeMapCamera[i], false); }, &recorded);
+	mJobs.Submit([this, &camera]() { RecordView(mViews[MainView], camera, true); }, &recorded);
+
+	// Cull the clustered lights for the main camera meanwhile.
+	mLightGrid.SetView(camera.View, camera.Proj[0], camera.Proj[5], camera.NearZ, camera.FarZ);
+	mJobs.Submit([this]()
+	{
+		TELEMETRY_SCOPE("LightGrid::Build");
+		mLightGrid.Build(&mClusterLights[0], mClusterLights.size(), &mJobs, &mFrameMemory);
+	}, &recorded);
+
+	{
+		TELEMETRY_SCOPE("WaitRecorded");
+		mJobs.Wait(recorded);
+	}
+}
+
+/// <summary>
+/// Records the draws of one view into its command buffer. Runs on a job thread.
+/// </summary>
+/// <param name="view">The view to record into.</param>
+/// <param name="camera">The camera.</param>
+/// <param name="mainView">if set to <c>true</c> the view draws the center sphere and shades the
+/// clustered lights, which are only culled for the main camera.</param>
+void ShadersScene::RecordView(SceneView& view, const Camera& camera, bool mainView)
+{
+	TELEMETRY_SCOPE("RecordScene");
+
+	view.Draws.clear();
+	view.Queue.Clear();
+	view.Commands.Reset();
+
+	// Leave out the objects the camera cannot see.
+	SpatialGrid::Frustum frustum;
+	frustum.Set(camera.ViewProj);
+
+	view.Visible.clear();
+	mObjectGrid.QueryFrustum(frustum, view.Visible);
+
+	// Set per frame constants. Only the first view replayed in a frame actually uploads them.
+	view.Commands.SetConstants(PerFrameConstants, mPerFrame);
+
+	// Figure out which technique to use, for the three directional lights.
+	PermutationKey lightKey = PermutationKey::Make(3);
+	if (mainView)
+		lightKey = lightKey.With(PermutationKey::Clustered);
+
+	PermutationKey texKey = lightKey.With(PermutationKey::Texture);
+	PermutationKey reflectKey = lightKey.With(PermutationKey::Reflect);
+
+	float texScale[16];
+	Scaling(6.0f, 8.0f, 1.0f, texScale);
+
+	//
+	// Queue every draw of this view with its per object constants, in any order;
+	// the sort below groups them by technique, texture and material.
+	//
+	for (size_t i = 0; i < view.Visible.size(); ++i)
+	{
+		unsigned int object = view.Visible[i];
+		const ObjectDraw& od = mObjects[object];
+
+		// The center sphere is not part of the cube map it reflects.
+		if (od.Reflective && !mainView)
+			continue;
+
+		const MeshRange& mesh = mMeshes[MeshOf(object)];
+		PermutationKey tech = od.Texture == NoTexture ? lightKey : od.Reflective ? reflectKey : texKey;
+
+		SceneDraw draw;
+		draw.Geometry = object == SkullObject ? SkullGeometry : ShapesGeometry;
+		draw.Reflective = od.Reflective;
+		draw.IndexCount = mesh.IndexCount;
+		draw.StartIndex = mesh.StartIndex;
+		draw.BaseVertex = mesh.BaseVertex;
+
+		PerObject& cb = draw.Constants;
+		const float* world = ObjectWorld(object);
+		memcpy(cb.World, world, sizeof(cb.World));
+		memcpy(cb.WorldInvTranspose, mTransforms.WorldInvTranspose(mObjectNodes[object]), sizeof(cb.WorldInvTranspose));
+		Multiply(world, camera.ViewProj, cb.WorldViewProj);
+		if (object == GridObject)
+			memcpy(cb.TexTransform, texScale, sizeof(cb.TexTransform));
+		else
+			Identity(cb.TexTransform);
+		memcpy(cb.Material, mMaterials[od.Material], sizeof(cb.Material));
+
+		// Sort front to back on the view depth of the object's origin.
+		const float* v = camera.View;
+		float viewZ = world[12]*v[2] + world[13]*v[6] + world[14]*v[10] + v[14];
+		uint32_t depth = RenderKey::QuantizeDepth(viewZ, 1000.0f);
+
+		view.Queue.Push(RenderKey::Make(od.Pass, tech.Bits, od.Texture, od.Material, depth), (uint32_t)view.Draws.size());
+		view.Draws.push_back(draw);
+	}
+
+	view.Queue.Sort();
+
+	//
+	// Record in key order, leaving out binds of state that is already bound.
+	//
+	view.States.Reset();
+	for (size_t i = 0; i < view.Queue.Size(); ++i)
+	{
+		uint64_t key = view.Queue[i].Key;
+		const SceneDraw& draw = view.Draws[view.Queue[i].Payload];
+
+		if (view.States.Bind(RenderStateCache::Technique, RenderKey::Technique(key)))
+			view.Commands.BindTechnique(RenderKey::Technique(key));
+
+		if (view.States.Bind(RenderStateCache::Geometry, draw.Geometry))
+			view.Commands.BindGeometry(draw.Geometry);
+
+		if (RenderKey::Texture(key) != NoTexture && view.States.Bind(RenderStateCache::Texture, RenderKey::Texture(key)))
+			view.Commands.BindResource(DiffuseMapSlot, RenderKey::Texture(key));
+
+		if (draw.Reflective && view.States.Bind(RenderStateCache::CubeMap, CubeMapTexture))
+			view.Commands.BindResource(CubeMapSlot, CubeMapTexture);
+
+		view.Commands.SetConstants(PerObjectConstants, draw.Constants);
+		view.Commands.DrawIndexed(draw.IndexCount, draw.StartIndex, draw.BaseVertex);
+	}
+}
@@ -0,0 +1,221 @@
+//***************************************************************************************
+// ShadersScene.h
+//
+// The scene of Shaders_Basics and its per-frame CPU work, without D3D, so that the
+// demo and the benchmark harness run the same code. It places the objects in a
+// transform hierarchy and their bounds in a spatial grid, animates the skull and the
+// clustered lights, and records the six cube map faces and the main view into
+// command buffers as parallel jobs while the light grid is built. ShadersApp replays
+// the buffers through its EffectBackend; FrameworkBench replays them into a
+// NullBackend.
+//
+// Matrices are row-major and applied as p*M, as XNA Math does, so the constants
+// recorded here have the layout of cbPerFrame and cbPerObject in Basic.fx.
+//***************************************************************************************
+
+#ifndef SHADERSSCENE_H
+#define SHADERSSCENE_H
+
+#include "CommandBuffer.h"
+#include "FrameMemory.h"
+#include "JobSystem.h"
+#include "LightGrid.h"
+#include "RenderQueue.h"
+#include "SpatialGrid.h"
+#include "TransformHierarchy.h"
+
+#include <vector>
+
+// Constant and resource slots used by the scene recordings.
+enum ConstantSlot { PerFrameConstants, PerObjectConstants };
+enum ResourceSlot { DiffuseMapSlot, CubeMapSlot };
+
+class ShadersScene
+{
+public:
+	// Ids used in the render queue sort keys; the backend resolves the texture and
+	// geometry ids.
+	enum RenderPass { OpaquePass, ReflectPass };
+	enum TextureId { NoTexture, FloorTexture, StoneTexture, BrickTexture, CubeMapTexture };
+	enum MaterialId { GridMaterial, BoxMaterial, CylinderMaterial, SphereMaterial, SkullMaterial, CenterSphereMaterial, MaterialCount };
+	enum GeometryId { ShapesGeometry, SkullGeometry };
+
+	// The meshes, and the objects drawn with them, in this order.
+	enum Mesh { BoxMesh, GridMesh, SphereMesh, CylinderMesh, SkullMesh, MeshCount };
+	enum Object { GridObject, BoxObject, CenterSphereObject, SkullObject, FirstSphereObject,
+		FirstCylinderObject = FirstSphereObject + 10, ObjectCount = FirstCylinderObject + 10 };
+
+	// The six cube map faces come first.
+	static const int MainView = 6;
+	static const int ViewCount = 7;
+
+	static const int ClusterLightCount = 1024;
+
+	// CPU mirrors of cbPerFrame and cbPerObject in Basic.fx.
+	struct PerFrame
+	{
+		float DirLights[3][16];
+		float EyePosW[3];
+		float FogStart;
+		float FogRange;
+		float Pad[3];
+		float FogColor[4];
+	};
+
+	struct PerObject
+	{
+		float World[16];
+		float WorldInvTranspose[16];
+		float WorldViewProj[16];
+		float TexTransform[16];
+		float Material[16];
+	};
+
+	// The matrices of a camera, as Camera in Common builds them.
+	struct Camera
+	{
+		float Position[3];
+		float View[16];
+		float Proj[16];
+		float ViewProj[16];
+		float NearZ;
+		float FarZ;
+
+		// Call SetLens first; LookAt sets ViewProj from both.
+		void LookAt(const float eye[3], const float target[3], const float up[3]);
+		void SetLens(float fovY, float aspect, float nearZ, float farZ);
+	};
+
+	// The animated state at a time: the skull's angles and the position of every
+	// clustered light, three floats each.
+	struct Snapshot
+	{
+		double Time;
+		float SkullSpin;
+		float SkullOrbit;
+		std::vector<float> LightPositions;
+	};
+
+	// Jobs record the views and animate the lights; the jobs must outlive the scene.
+	explicit ShadersScene(JobSystem& jobs);
+
+	// Where a mesh is in the buffers of its geometry, and its bounding box in object
+	// space; a mesh that did not load is a box of zero size at the origin. Call
+	// BuildObjectGrid once every mesh is set.
+	void SetMesh(Mesh mesh, unsigned int indexCount, unsigned int startIndex, int baseVertex,
+		const float min[3], const float max[3]);
+	void BuildObjectGrid();
+
+	// How much of the dynamic cube map the center sphere reflects, from 0 to 1.
+	void SetReflection(float amount);
+
+	// The state at a time. Reads only what stays fixed after construction, so a
+	// simulation thread may call it while frames are recorded.
+	void Simulate(double time, Snapshot& state)const;
+
+	// Moves the skull and the lights to where they are at a time, or between two
+	// snapshots, and updates the world matrices and the object grid.
+	void Animate(double time);
+	void Animate(const Snapshot& from, const Snapshot& to, float alpha);
+
+	// Records every view, the main one seen from camera, and builds the light grid
+	// for it. Returns once all are done; the buffers stay valid until the next call.
+	void Record(const Camera& camera);
+
+	const CommandBuffer& Commands(int view)const     { return mViews[view].Commands; }
+	const std::vector<ClusterLight>& ClusterLights()const { return mClusterLights; }
+	const LightGrid& Lights()const                   { return mLightGrid; }
+
+	// 16 floats, laid out as in XMFLOAT4X4.
+	const float* ObjectWorld(unsigned int object)const;
+
+	static Mesh MeshOf(unsigned int object);
+
+private:
+	// How an object is drawn, besides its mesh.
+	struct ObjectDraw
+	{
+		unsigned int Pass;
+		unsigned int Texture;
+		unsigned int Material;
+		bool Reflective;
+	};
+
+	struct MeshRange
+	{
+		unsigned int IndexCount;
+		unsigned int StartIndex;
+		int BaseVertex;
+
+		// Bounding sphere in object space.
+		float Bounds[4];
+	};
+
+	// What a queued draw needs beyond its sort key.
+	struct SceneDraw
+	{
+		unsigned int Geometry;
+		bool Reflective;
+		unsigned int IndexCount;
+		unsigned int StartIndex;
+		int BaseVertex;
+		PerObject Constants;
+	};
+
+	// Everything one camera records; each view is recorded by one job.
+	struct SceneView
+	{
+		std::vector<SceneDraw> Draws;
+		RenderQueue Queue;
+		RenderStateCache States;
+		CommandBuffer Commands;
+
+		// Objects whose bounds reach into the camera's view volume.
+		std::vector<SpatialGrid::Handle> Visible;
+	};
+
+	// Path of one clustered light around the center of the scene.
+	struct LightOrbit
+	{
+		float Radius;
+		float Angle;
+		float Speed;
+		float Height;
+	};
+
+	void BuildObjects();
+	void BuildClusterLights();
+	void ObjectBounds(unsigned int object, float sphere[4])const;
+	void PlaceSkull(float spin, float orbit);
+	void RecordView(SceneView& view, const Camera& camera, bool mainView);
+
+private:
+	JobSystem& mJobs;
+
+	// Temporaries of one frame; they stay valid until the frame after it ends.
+	FrameArena mFrameMemory;
+
+	// Define transformations from local spaces to world space. The skull hangs off
+	// an orbit around the center sphere; every other object is a root.
+	TransformHierarchy mTransforms;
+	TransformHierarchy::Node mObjectNodes[ObjectCount];
+	TransformHierarchy::Node mSkullOrbitNode;
+
+	ObjectDraw mObjects[ObjectCount];
+	MeshRange mMeshes[MeshCount];
+	float mMaterials[MaterialCount][16];
+
+	// Bounding spheres of the objects, for culling each view; the handle of an
+	// object is its Object.
+	SpatialGrid mObjectGrid;
+
+	std::vector<ClusterLight> mClusterLights;
+	std::vector<LightOrbit> mLightOrbits;
+	LightGrid mLightGrid;
+
+	Camera mCubeMapCamera[6];
+	SceneView mViews[ViewCount];
+	PerFrame mPerFrame;
+};
+
+#endif // SHADERSSCENE_H
@@ -7,10 +7,12 @@
 #include "Camera.h"
 #include "Vertex.h"
 #include "Effects.h"
+#include "D3D11/RegistryResources.h"
 
-Sky::Sky(ID3D11Device* device, const std::wstring& cubemapFilename, float skySphereRadius)
+Sky::Sky(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& cubemapFilename, float skySphereRadius)
 {
-	HR(D3DX11CreateShaderResourceViewFromFile(device, cubemapFilename.c_str(), 0, 0, &mCubeMapSRV, 0));
+	mCubeMap = RegistryResources::LoadTexture(device, registry, cubemapFilename);
+	mCubeMapSRV = mCubeMap.Get();
 
 	GeometryGenerator::MeshData sphere;
 	GeometryGenerator geoGen;
@@ -60,7 +62,6 @@ Sky::~Sky()
 {
 	ReleaseCOM(mVB);
 	ReleaseCOM(mIB);
-	ReleaseCOM(mCubeMapSRV);
 }
 
 ID3D11ShaderResourceView* Sky::CubeMapSRV()
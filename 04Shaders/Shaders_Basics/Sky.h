@@ -8,13 +8,15 @@
 #define SKY_H
 
 #include "d3dUtil.h"
+#include "ResourceRegistry.h"
 
 class Camera;
 
 class Sky
 {
 public:
-	Sky(ID3D11Device* device, const std::wstring& cubemapFilename, float skySphereRadius);
+	// The cube map comes from the registry, which must outlive the sky.
+	Sky(ID3D11Device* device, ResourceRegistry& registry, const std::wstring& cubemapFilename, float skySphereRadius);
 	~Sky();
 
 	ID3D11ShaderResourceView* CubeMapSRV();
@@ -29,6 +31,7 @@ private:
 	ID3D11Buffer* mVB;
 	ID3D11Buffer* mIB;
 
+	ResourceHandle<ID3D11ShaderResourceView> mCubeMap;
 	ID3D11ShaderResourceView* mCubeMapSRV;
 
 	UINT mIndexCount;
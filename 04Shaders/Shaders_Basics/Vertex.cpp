@@ -22,7 +22,14 @@ const D3D11_INPUT_ELEMENT_DESC InputLayoutDesc::Basic32[3] =
 ID3D11InputLayout* InputLayouts::Pos = 0;
 ID3D11InputLayout* InputLayouts::Basic32 = 0;
 
-void InputLayouts::InitAll(ID3D11Device* device)
+namespace
+{
+	// The registry references behind the layouts.
+	ResourceHandle<ID3D11InputLayout> PosLayout;
+	ResourceHandle<ID3D11InputLayout> Basic32Layout;
+}
+
+void InputLayouts::InitAll(ID3D11Device* device, ResourceRegistry& registry)
 {
 	D3DX11_PASS_DESC passDesc;
 
@@ -31,22 +38,24 @@ void InputLayouts::InitAll(ID3D11Device* device)
 	//
 
 	Effects::SkyFX->SkyTech->GetPassByIndex(0)->GetDesc(&passDesc);
-	HR(device->CreateInputLayout(InputLayoutDesc::Pos, 1, passDesc.pIAInputSignature, 
-		passDesc.IAInputSignatureSize, &Pos));
+	PosLayout = RegistryResources::CreateInputLayout(device, registry, InputLayoutDesc::Pos, 1, passDesc);
+	Pos = PosLayout.Get();
 
 	//
 	// Basic32
 	//
 
-	Effects::BasicFX->Light1Tech->GetPassByIndex(0)->GetDesc(&passDesc);
-	HR(device->CreateInputLayout(InputLayoutDesc::Basic32, 3, passDesc.pIAInputSignature, 
-		passDesc.IAInputSignatureSize, &Basic32));
+	Effects::BasicFX->GetTech(PermutationKey::Make(1))->GetPassByIndex(0)->GetDesc(&passDesc);
+	Basic32Layout = RegistryResources::CreateInputLayout(device, registry, InputLayoutDesc::Basic32, 3, passDesc);
+	Basic32 = Basic32Layout.Get();
 }
 
 void InputLayouts::DestroyAll()
 {
-	ReleaseCOM(Pos);
-	ReleaseCOM(Basic32);
+	PosLayout.Reset();
+	Basic32Layout.Reset();
+	Pos = 0;
+	Basic32 = 0;
 }
 
 #pragma endregion
@@ -22,6 +22,9 @@ cbuffer cbPerFrame
 
     float2 gResolution;
     float gGlobalTime;
+
+    // Lattice cells per side of gNoiseVolume.
+    float gNoisePeriod;
 };
 
 cbuffer cbPerObject
@@ -32,6 +35,18 @@ cbuffer cbPerObject
 	Material gMaterial;
 };
 
+// noise() baked on the CPU (NoiseVolume), tiling every gNoisePeriod lattice cells.
+Texture3D gNoiseVolume;
+
+SamplerState samNoise
+{
+	Filter = MIN_MAG_MIP_LINEAR;
+
+	AddressU = WRAP;
+	AddressV = WRAP;
+	AddressW = WRAP;
+};
+
 struct VertexIn
 {
 	float3 PosL    : POSITION;
@@ -130,10 +145,22 @@ float4 PS(VertexOut pin) : SV_Target
 }
 
 // Noise pixel shader
-float4 PSNoise(VertexOut pin) : SV_Target
+float4 PSNoise(VertexOut pin, uniform bool gUseVolume) : SV_Target
 {
     pin.PosW *= 8.0f / gResolution.y;
-    float n = noise(float3(pin.PosW.xy, 0.1f * gGlobalTime));
+    float3 x = float3(pin.PosW.xy, 0.1f * gGlobalTime);
+
+    float n;
+    if (gUseVolume)
+    {
+        // One trilinear fetch instead of sixteen hashes.
+        n = gNoiseVolume.Sample(samNoise, x / gNoisePeriod).r;
+    }
+    else
+    {
+        n = noise(x);
+    }
+
     float v = sin(6.28f * 10.0f * n);
     v = smoothstep(0.0f, 1.0f, 0.7f * abs(v) / fwidth(v));
     n = floor(n * 20.0f) / 20.0f;
@@ -157,6 +184,16 @@ technique11 NoiseTech
     {
         SetVertexShader(CompileShader(vs_5_0, VS()));
         SetGeometryShader(NULL);
-        SetPixelShader(CompileShader(ps_5_0, PSNoise()));
+        SetPixelShader(CompileShader(ps_5_0, PSNoise(false)));
+    }
+}
+
+technique11 NoiseVolumeTech
+{
+    pass P0
+    {
+        SetVertexShader(CompileShader(vs_5_0, VS()));
+        SetGeometryShader(NULL);
+        SetPixelShader(CompileShader(ps_5_0, PSNoise(true)));
     }
 }
@@ -23,7 +23,7 @@ ShadersApp::ShadersApp(HINSTANCE hInstance)
 	: D3DApp(hInstance), _vertexBuffer(0), _indexBuffer(0),
 	mFX(0), mTech(0), mfxWorld(0), mfxWorldInvTranspose(0), mfxEyePosW(0),
 	mfxDirLight(0), mfxPointLight(0), mfxSpotLight(0), mfxMaterial(0),
-	mfxWorldViewProj(0),
+	mfxWorldViewProj(0), mfxNoisePeriod(0), mfxNoiseVolume(0), mNoiseVolumeSRV(0), mNoisePeriod(0.0f),
 	mInputLayout(0), mEyePosW(0.0f, 0.0f, 0.0f), mTheta(1.5f*MathHelper::Pi), mPhi(0.45f*MathHelper::Pi), mRadius(500.0f)
 {
 	mMainWndCaption = L"Noisy Balls";
@@ -49,16 +49,18 @@ ShadersApp::ShadersApp(HINSTANCE hInstance)
 	float dx = width / (5 - 1);
 	float dy = height / (5 - 1);
 	float dz = depth / (5 - 1);
-	for (int k = 0; k < 5; ++k)
+
+	// One slice of 5x5 spheres per job.
+	mJobs.ParallelFor(0, 125, [&](size_t begin, size_t end)
 	{
-		for (int i = 0; i < 5; ++i)
+		for (size_t n = begin; n < end; ++n)
 		{
-			for (int j = 0; j < 5; ++j)
-			{
-				XMStoreFloat4x4(&mSphereWorld[k * 5 * 5 + i * 5 + j], XMMatrixTranslation(x + j*dx, y + i*dy, z + k*dz));
-			}
+			int k = (int)(n / 25);
+			int i = (int)(n / 5) % 5;
+			int j = (int)(n % 5);
+			XMStoreFloat4x4(&mSphereWorld[n], XMMatrixTranslation(x + j*dx, y + i*dy, z + k*dz));
 		}
-	}
+	}, 25);
 
 	// Directional light.
 	_dirLight.Ambient = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
@@ -79,6 +81,8 @@ ShadersApp::~ShadersApp()
 	ReleaseCOM(_vertexBuffer);
 	ReleaseCOM(_indexBuffer);
 
+	ReleaseCOM(mNoiseVolumeSRV);
+
 	ReleaseCOM(mFX);
 	ReleaseCOM(mInputLayout);
 }
@@ -95,6 +99,7 @@ bool ShadersApp::Init()
 	BuildGeometryBuffers();
 	BuildFX();
 	BuildVertexLayout();
+	BuildNoiseVolume();
 
 	return true;
 }
@@ -158,6 +163,8 @@ void ShadersApp::DrawScene()
 	mfxEyePosW->SetRawValue(&mEyePosW, 0, sizeof(mEyePosW));
 	mfxResolution->SetRawValue(&mResolution, 0, sizeof(mResolution));
 	mfxGlobalTime->SetFloat(mTimer.TotalTime());
+	mfxNoisePeriod->SetFloat(mNoisePeriod);
+	mfxNoiseVolume->SetResource(mNoiseVolumeSRV);
 
 	D3DX11_TECHNIQUE_DESC techDesc;
 	mTech->GetDesc(&techDesc);
@@ -344,7 +351,7 @@ void ShadersApp::BuildFX()
 	// Done with compiled shader.
 	ReleaseCOM(compiledShader);
 
-	mTech = mFX->GetTechniqueByName("NoiseTech");
+	mTech = mFX->GetTechniqueByName("NoiseVolumeTech");
 	mfxWorldViewProj = mFX->GetVariableByName("gWorldViewProj")->AsMatrix();
 	mfxWorld = mFX->GetVariableByName("gWorld")->AsMatrix();
 	mfxWorldInvTranspose = mFX->GetVariableByName("gWorldInvTranspose")->AsMatrix();
@@ -354,6 +361,8 @@ void ShadersApp::BuildFX()
 	mfxMaterial = mFX->GetVariableByName("gMaterial");
 	mfxResolution = mFX->GetVariableByName("gResolution")->AsVector();
 	mfxGlobalTime = mFX->GetVariableByName("gGlobalTime")->AsScalar();
+	mfxNoisePeriod = mFX->GetVariableByName("gNoisePeriod")->AsScalar();
+	mfxNoiseVolume = mFX->GetVariableByName("gNoiseVolume")->AsShaderResource();
 }
 
 /// <summary>
@@ -373,4 +382,47 @@ void ShadersApp::BuildVertexLayout()
 	mTech->GetPassByIndex(0)->GetDesc(&passDesc);
 	HR(md3dDevice->CreateInputLayout(vertexDesc, 2, passDesc.pIAInputSignature,
 		passDesc.IAInputSignatureSize, &mInputLayout));
-}
\ No newline at end of file
+}
+
+/// <summary>
+/// Bakes the noise of the noise shader into a tileable 3D texture.
+/// </summary>
+void ShadersApp::BuildNoiseVolume()
+{
+	// 8 cells of 16 texels per side; the spheres only span about 2.5 cells in x and y,
+	// and the time axis repeats seamlessly every 80 seconds.
+	NoiseVolume volume(8, 16);
+	volume.Bake(&mJobs);
+
+	// The baked noise should match the shader's noise() evaluated at the texel centres.
+	assert(volume.MaxError(97) < 1e-5f);
+
+	std::vector<unsigned short> texels;
+	volume.ToUNorm16(texels);
+
+	UINT size = volume.Size();
+	mNoisePeriod = (float)volume.Period();
+
+	D3D11_TEXTURE3D_DESC texDesc;
+	texDesc.Width = size;
+	texDesc.Height = size;
+	texDesc.Depth = size;
+	texDesc.MipLevels = 1;
+	texDesc.Format = DXGI_FORMAT_R16_UNORM;
+	texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	texDesc.CPUAccessFlags = 0;
+	texDesc.MiscFlags = 0;
+
+	D3D11_SUBRESOURCE_DATA initData;
+	initData.pSysMem = &texels[0];
+	initData.SysMemPitch = size*sizeof(unsigned short);
+	initData.SysMemSlicePitch = size*size*sizeof(unsigned short);
+
+	ID3D11Texture3D* texture = 0;
+	HR(md3dDevice->CreateTexture3D(&texDesc, &initData, &texture));
+	HR(md3dDevice->CreateShaderResourceView(texture, 0, &mNoiseVolumeSRV));
+
+	// The view holds its own reference.
+	ReleaseCOM(texture);
+}
@@ -6,6 +6,8 @@
 #include "LightHelper.h"
 #include "Waves.h"
 #include "d3dApp.h"
+#include "JobSystem.h"
+#include "NoiseVolume.h"
 
 struct Vertex
 {
@@ -32,6 +34,7 @@ private:
 	void BuildGeometryBuffers();
 	void BuildFX();
 	void BuildVertexLayout();
+	void BuildNoiseVolume();
 
 private:
 	ID3D11Buffer* _vertexBuffer;
@@ -54,6 +57,11 @@ private:
 	// These variables are needed for the noise shader
 	ID3DX11EffectVectorVariable* mfxResolution;		// resolution 
 	ID3DX11EffectScalarVariable* mfxGlobalTime;		// current game time
+	ID3DX11EffectScalarVariable* mfxNoisePeriod;	// lattice cells per side of the noise volume
+	ID3DX11EffectShaderResourceVariable* mfxNoiseVolume;
+
+	ID3D11ShaderResourceView* mNoiseVolumeSRV;
+	float mNoisePeriod;
 
 	ID3D11InputLayout* mInputLayout;
 
@@ -74,6 +82,8 @@ private:
 
 	XMFLOAT3 mEyePosW;
 
+	JobSystem mJobs;
+
 	float mTheta;
 	float mPhi;
 	float mRadius;
@@ -0,0 +1,496 @@
+//***************************************************************************************
+// AllocationProfiler.cpp
+//***************************************************************************************
+
+#include "AllocationProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#pragma intrinsic(_ReturnAddress)
+#define ALLOCATION_CALLSITE() _ReturnAddress()
+#else
+#define ALLOCATION_CALLSITE() __builtin_return_address(0)
+#endif
+
+#if defined(__GNUC__) && !defined(_WIN32)
+#include <cxxabi.h>
+#include <dlfcn.h>
+#define ALLOCATION_SYMBOLS
+#endif
+
+using namespace AllocationProfiler;
+
+namespace
+{
+	// In front of every block; 16 bytes keep the block as aligned as malloc made it.
+	struct Header
+	{
+		uint64_t Size;
+		uint32_t Tag;
+		uint32_t Callsite;
+	};
+
+	// Counted by one thread, read by any; adding is a plain load and store, not a
+	// locked instruction.
+	typedef std::atomic<uint64_t> Counter;
+
+	inline void Add(Counter& counter, uint64_t value)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	// What one thread allocated, and freed; a block allocated on one thread and
+	// freed on another leaves each with half of it, and their sum is right. Live
+	// counts wrap below zero for the same reason.
+	struct ThreadCounters
+	{
+		Counter Allocations[MaxTags];
+		Counter Frees[MaxTags];
+		Counter Bytes[MaxTags];
+		Counter Live[MaxTags];
+
+		Counter CallsiteAllocations[MaxCallsites];
+		Counter CallsiteBytes[MaxCallsites];
+
+		ThreadCounters* Next;
+	};
+
+	// Zero before any constructor runs, so allocations made during static
+	// initialization are counted too.
+	std::atomic<const char*> gTagNames[MaxTags];
+	std::atomic<const void*> gCallsiteAddresses[MaxCallsites];
+	std::atomic<uint32_t> gCallsiteTags[MaxCallsites];
+
+	// Counters of every thread that allocated; they outlive their threads.
+	std::atomic<ThreadCounters*> gThreads;
+
+	// The one count every thread shares, since the peaks need it.
+	std::atomic<uint64_t> gLive;
+	std::atomic<uint64_t> gPeak;
+	std::atomic<uint64_t> gPhasePeak;
+
+	// Closed frames and phases; a frame's counts are the totals less those at the
+	// end of the frame before.
+	std::mutex gMutex;
+	FrameStats gFrameStart;
+	uint64_t gFrames;
+	uint64_t gFramesAllocations;
+	uint64_t gFramesBytes;
+	uint64_t gMaxFrameAllocations;
+	std::vector<PhaseStats> gPhases;
+
+	thread_local uint32_t tTag = 0;
+	thread_local ThreadCounters* tCounters = 0;
+
+	ThreadCounters& Counters()
+	{
+		if (!tCounters)
+		{
+			// From malloc, since operator new would come back here.
+			tCounters = new (calloc(1, sizeof(ThreadCounters))) ThreadCounters();
+
+			ThreadCounters* head = gThreads.load(std::memory_order_relaxed);
+			do
+			{
+				tCounters->Next = head;
+			} while (!gThreads.compare_exchange_weak(head, tCounters, std::memory_order_release, std::memory_order_relaxed));
+		}
+		return *tCounters;
+	}
+
+	void RaisePeak(std::atomic<uint64_t>& peak, uint64_t value)
+	{
+		uint64_t current = peak.load(std::memory_order_relaxed);
+		while (current < value && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	uint32_t TagIndex(const char* name)
+	{
+		// Slot 0 holds untagged allocations and the tags that do not fit.
+		for (uint32_t i = 1; i < MaxTags; ++i)
+		{
+			const char* slot = gTagNames[i].load(std::memory_order_acquire);
+			if (!slot && gTagNames[i].compare_exchange_strong(slot, name, std::memory_order_acq_rel))
+				return i;
+
+			// The same literal may have a different address in another translation unit.
+			if (slot == name || strcmp(slot, name) == 0)
+				return i;
+		}
+		return 0;
+	}
+
+	uint32_t CallsiteIndex(const void* address, uint32_t tag)
+	{
+		// Open addressing over a short probe; slot 0 holds what does not fit.
+		uint32_t start = (uint32_t)(((uint64_t)(uintptr_t)address*0x9E3779B97F4A7C15ull) >> 40);
+		for (uint32_t probe = 0; probe < 32; ++probe)
+		{
+			uint32_t i = (start + probe) & (MaxCallsites - 1);
+			if (i == 0)
+				continue;
+
+			const void* slot = gCallsiteAddresses[i].load(std::memory_order_acquire);
+			if (slot == address)
+				return i;
+
+			if (!slot)
+			{
+				if (gCallsiteAddresses[i].compare_exchange_strong(slot, address, std::memory_order_acq_rel))
+				{
+					gCallsiteTags[i].store(tag, std::memory_order_relaxed);
+					return i;
+				}
+				if (slot == address)
+					return i;
+			}
+		}
+		return 0;
+	}
+
+	FrameStats Totals()
+	{
+		FrameStats totals = {};
+		for (ThreadCounters* t = gThreads.load(std::memory_order_acquire); t; t = t->Next)
+		{
+			for (uint32_t i = 0; i < MaxTags; ++i)
+			{
+				totals.Allocations += t->Allocations[i].load(std::memory_order_relaxed);
+				totals.Frees += t->Frees[i].load(std::memory_order_relaxed);
+				totals.Bytes += t->Bytes[i].load(std::memory_order_relaxed);
+			}
+		}
+		return totals;
+	}
+
+	const char* TagName(uint32_t tag)
+	{
+		const char* name = gTagNames[tag].load(std::memory_order_acquire);
+		return name ? name : "untagged";
+	}
+
+	std::string Symbol(const void* address)
+	{
+		char text[128];
+		snprintf(text, sizeof(text), "%p", address);
+
+#if defined(ALLOCATION_SYMBOLS)
+		Dl_info info;
+		if (dladdr(address, &info))
+		{
+			if (info.dli_sname)
+			{
+				int status = 0;
+				char* demangled = abi::__cxa_demangle(info.dli_sname, 0, 0, &status);
+				snprintf(text, sizeof(text), "%.96s+0x%lx", status == 0 ? demangled : info.dli_sname,
+					(unsigned long)((const char*)address - (const char*)info.dli_saddr));
+				free(demangled);
+			}
+			else if (info.dli_fname)
+			{
+				const char* module = strrchr(info.dli_fname, '/');
+				snprintf(text, sizeof(text), "%s+0x%lx", module ? module + 1 : info.dli_fname,
+					(unsigned long)((const char*)address - (const char*)info.dli_fbase));
+			}
+		}
+#endif
+		return text;
+	}
+}
+
+#if defined(ALLOCATION_PROFILER)
+void* operator new(size_t size)
+{
+	void* p = AllocationProfiler::Allocate(size ? size : 1, ALLOCATION_CALLSITE());
+	if (p == 0)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	void* p = AllocationProfiler::Allocate(size ? size : 1, ALLOCATION_CALLSITE());
+	if (p == 0)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()
+{
+	return AllocationProfiler::Allocate(size ? size : 1, ALLOCATION_CALLSITE());
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) throw()
+{
+	return AllocationProfiler::Allocate(size ? size : 1, ALLOCATION_CALLSITE());
+}
+
+void operator delete(void* p) throw()
+{
+	AllocationProfiler::Free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	AllocationProfiler::Free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw()
+{
+	AllocationProfiler::Free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw()
+{
+	AllocationProfiler::Free(p);
+}
+
+bool AllocationProfiler::Enabled()
+{
+	return true;
+}
+#else
+bool AllocationProfiler::Enabled()
+{
+	return false;
+}
+#endif
+
+void* AllocationProfiler::Allocate(size_t size, const void* callsite)
+{
+	Header* header = static_cast<Header*>(malloc(sizeof(Header) + size));
+	if (!header)
+		return 0;
+
+	uint32_t tag = tTag;
+	header->Size = size;
+	header->Tag = tag;
+	header->Callsite = CallsiteIndex(callsite, tag);
+
+	ThreadCounters& counters = Counters();
+	Add(counters.Allocations[tag], 1);
+	Add(counters.Bytes[tag], size);
+	Add(counters.Live[tag], size);
+	Add(counters.CallsiteAllocations[header->Callsite], 1);
+	Add(counters.CallsiteBytes[header->Callsite], size);
+
+	uint64_t live = gLive.fetch_add(size, std::memory_order_relaxed) + size;
+	RaisePeak(gPeak, live);
+	RaisePeak(gPhasePeak, live);
+
+	return header + 1;
+}
+
+void AllocationProfiler::Free(void* p)
+{
+	if (!p)
+		return;
+
+	Header* header = static_cast<Header*>(p) - 1;
+
+	ThreadCounters& counters = Counters();
+	Add(counters.Frees[header->Tag], 1);
+	Add(counters.Live[header->Tag], 0 - header->Size);
+
+	gLive.fetch_sub(header->Size, std::memory_order_relaxed);
+
+	free(header);
+}
+
+#pragma region Scopes
+AllocationProfiler::ScopedTag::ScopedTag(const char* name)
+	: mPrevious(tTag)
+{
+	tTag = TagIndex(name);
+}
+
+AllocationProfiler::ScopedTag::~ScopedTag()
+{
+	tTag = mPrevious;
+}
+
+AllocationProfiler::ScopedPhase::ScopedPhase(const char* name)
+	: mName(name)
+{
+	FrameStats totals = Totals();
+	mAllocations = totals.Allocations;
+	mBytes = totals.Bytes;
+	mStartBytes = gLive.load(std::memory_order_relaxed);
+
+	// The peak of an enclosing phase is put back, raised by this one, at the end.
+	mOuterPeak = gPhasePeak.exchange(mStartBytes, std::memory_order_relaxed);
+}
+
+AllocationProfiler::ScopedPhase::~ScopedPhase()
+{
+	uint64_t peak = gPhasePeak.load(std::memory_order_relaxed);
+	RaisePeak(gPhasePeak, mOuterPeak);
+
+	FrameStats totals = Totals();
+
+	PhaseStats phase;
+	phase.Name = mName;
+	phase.Allocations = totals.Allocations - mAllocations;
+	phase.Bytes = totals.Bytes - mBytes;
+	phase.StartBytes = mStartBytes;
+	phase.PeakGrowth = peak > mStartBytes ? peak - mStartBytes : 0;
+	phase.RetainedBytes = (int64_t)gLive.load(std::memory_order_relaxed) - (int64_t)mStartBytes;
+
+	std::lock_guard<std::mutex> lock(gMutex);
+	gPhases.push_back(phase);
+}
+#pragma endregion
+
+FrameStats AllocationProfiler::EndFrame()
+{
+	FrameStats totals = Totals();
+
+	std::lock_guard<std::mutex> lock(gMutex);
+
+	FrameStats frame;
+	frame.Allocations = totals.Allocations - gFrameStart.Allocations;
+	frame.Frees = totals.Frees - gFrameStart.Frees;
+	frame.Bytes = totals.Bytes - gFrameStart.Bytes;
+	gFrameStart = totals;
+
+	++gFrames;
+	gFramesAllocations += frame.Allocations;
+	gFramesBytes += frame.Bytes;
+	gMaxFrameAllocations = std::max(gMaxFrameAllocations, frame.Allocations);
+	return frame;
+}
+
+uint64_t AllocationProfiler::LiveBytes()
+{
+	return gLive.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocationProfiler::PeakBytes()
+{
+	return gPeak.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocationProfiler::TotalAllocations()
+{
+	return Totals().Allocations;
+}
+
+std::vector<TagStats> AllocationProfiler::Tags()
+{
+	std::vector<TagStats> tags;
+	for (uint32_t i = 0; i < MaxTags; ++i)
+	{
+		TagStats tag = { TagName(i), 0, 0, 0, 0 };
+		for (ThreadCounters* t = gThreads.load(std::memory_order_acquire); t; t = t->Next)
+		{
+			tag.Allocations += t->Allocations[i].load(std::memory_order_relaxed);
+			tag.Frees += t->Frees[i].load(std::memory_order_relaxed);
+			tag.Bytes += t->Bytes[i].load(std::memory_order_relaxed);
+			tag.LiveBytes += t->Live[i].load(std::memory_order_relaxed);
+		}
+
+		if (tag.Allocations > 0)
+			tags.push_back(tag);
+	}
+	return tags;
+}
+
+std::vector<CallsiteStats> AllocationProfiler::Callsites(unsigned int largest)
+{
+	std::vector<CallsiteStats> sites;
+	for (uint32_t i = 0; i < MaxCallsites; ++i)
+	{
+		CallsiteStats site;
+		site.Address = gCallsiteAddresses[i].load(std::memory_order_acquire);
+		site.Tag = TagName(gCallsiteTags[i].load(std::memory_order_relaxed));
+		site.Allocations = 0;
+		site.Bytes = 0;
+
+		for (ThreadCounters* t = gThreads.load(std::memory_order_acquire); t; t = t->Next)
+		{
+			site.Allocations += t->CallsiteAllocations[i].load(std::memory_order_relaxed);
+			site.Bytes += t->CallsiteBytes[i].load(std::memory_order_relaxed);
+		}
+
+		if (site.Allocations > 0)
+			sites.push_back(site);
+	}
+
+	size_t count = std::min<size_t>(largest, sites.size());
+	std::partial_sort(sites.begin(), sites.begin() + count, sites.end(), [](const CallsiteStats& a, const CallsiteStats& b)
+	{
+		return a.Bytes > b.Bytes;
+	});
+	sites.resize(count);
+	return sites;
+}
+
+std::vector<PhaseStats> AllocationProfiler::Phases()
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	return gPhases;
+}
+
+std::string AllocationProfiler::Report(unsigned int callsites)
+{
+	const double MB = 1024.0*1024.0;
+
+	std::string report;
+	char line[320];
+
+	FrameStats totals = Totals();
+	snprintf(line, sizeof(line), "%llu allocations, %.2f MB; %.2f MB live, %.2f MB at the peak\n",
+		(unsigned long long)totals.Allocations, totals.Bytes/MB, LiveBytes()/MB, PeakBytes()/MB);
+	report += line;
+
+	{
+		std::lock_guard<std::mutex> lock(gMutex);
+		if (gFrames > 0)
+		{
+			snprintf(line, sizeof(line), "%llu frames: %.1f allocations, %.0f bytes a frame on average, %llu allocations at most\n",
+				(unsigned long long)gFrames, (double)gFramesAllocations/gFrames, (double)gFramesBytes/gFrames,
+				(unsigned long long)gMaxFrameAllocations);
+			report += line;
+		}
+	}
+
+	std::vector<TagStats> tags = Tags();
+	snprintf(line, sizeof(line), "%-28s %12s %12s %10s %10s\n", "tag", "allocations", "frees", "MB", "live MB");
+	report += line;
+	for (size_t i = 0; i < tags.size(); ++i)
+	{
+		snprintf(line, sizeof(line), "%-28s %12llu %12llu %10.2f %10.2f\n", tags[i].Name,
+			(unsigned long long)tags[i].Allocations, (unsigned long long)tags[i].Frees, tags[i].Bytes/MB,
+			tags[i].LiveBytes/MB);
+		report += line;
+	}
+
+	std::vector<CallsiteStats> sites = Callsites(callsites);
+	for (size_t i = 0; i < sites.size(); ++i)
+	{
+		snprintf(line, sizeof(line), "callsite %-60s %-20s %10llu allocations %10.2f MB\n",
+			sites[i].Address ? Symbol(sites[i].Address).c_str() : "(others)", sites[i].Tag,
+			(unsigned long long)sites[i].Allocations, sites[i].Bytes/MB);
+		report += line;
+	}
+
+	std::vector<PhaseStats> phases = Phases();
+	for (size_t i = 0; i < phases.size(); ++i)
+	{
+		snprintf(line, sizeof(line), "phase %-24s %10llu allocations %10.2f MB, peak %.2f MB above start, %.2f MB retained\n",
+			phases[i].Name, (unsigned long long)phases[i].Allocations, phases[i].Bytes/MB, phases[i].PeakGrowth/MB,
+			phases[i].RetainedBytes/MB);
+		report += line;
+	}
+	return report;
+}
@@ -0,0 +1,143 @@
+//***************************************************************************************
+// AllocationProfiler.h
+//
+// Where the heap allocations of the process come from. Built with
+// ALLOCATION_PROFILER defined, AllocationProfiler.cpp replaces the global operator
+// new and delete; every allocation then carries a small header with its size, the
+// tag that was current on its thread and the callsite that made it, and is counted
+// against all three until it is freed.
+//
+// A ScopedTag (or ALLOCATION_TAG) names what the allocations of its thread are for
+// while it lives; tags nest, and the innermost wins. The callsite is the return
+// address of operator new, which in an optimized build is usually the function
+// that grew the container, since the standard allocator is inlined into it.
+//
+// Each thread counts into counters of its own, so the hooked path takes one
+// locked instruction, for the live total the peaks are measured on.
+//
+// EndFrame closes the per-frame counts. A ScopedPhase measures a stretch of
+// startup: what it allocated, and how far the live heap rose above where it was
+// when the phase began. Phases nest, and count the allocations of every thread.
+//
+// Without ALLOCATION_PROFILER nothing is hooked and every count stays 0. The
+// profiler never allocates on the hooked path; tags and callsites beyond the
+// fixed tables are counted under the first entry of each.
+//
+// Tag and phase names must outlive the profiler; string literals are the intended
+// use.
+//***************************************************************************************
+
+#ifndef ALLOCATIONPROFILER_H
+#define ALLOCATIONPROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AllocationProfiler
+{
+	static const unsigned int MaxTags = 64;
+	static const unsigned int MaxCallsites = 4096;
+
+	struct TagStats
+	{
+		const char* Name;
+		uint64_t Allocations;
+		uint64_t Frees;
+		uint64_t Bytes;
+		uint64_t LiveBytes;
+	};
+
+	struct CallsiteStats
+	{
+		const void* Address;
+
+		// The tag of the first allocation made there.
+		const char* Tag;
+
+		uint64_t Allocations;
+		uint64_t Bytes;
+	};
+
+	struct FrameStats
+	{
+		uint64_t Allocations;
+		uint64_t Frees;
+		uint64_t Bytes;
+	};
+
+	struct PhaseStats
+	{
+		const char* Name;
+		uint64_t Allocations;
+		uint64_t Bytes;
+
+		// The live heap when the phase began, and its highest point above that.
+		uint64_t StartBytes;
+		uint64_t PeakGrowth;
+
+		// Live bytes the phase left behind; negative when it freed more.
+		int64_t RetainedBytes;
+	};
+
+	// Whether operator new is hooked.
+	bool Enabled();
+
+	// The hooked operators come here; an app with an operator new of its own can
+	// forward to them instead. Free takes only pointers Allocate returned.
+	void* Allocate(size_t size, const void* callsite);
+	void Free(void* p);
+
+	class ScopedTag
+	{
+	public:
+		explicit ScopedTag(const char* name);
+		~ScopedTag();
+
+	private:
+		ScopedTag(const ScopedTag& rhs);
+		ScopedTag& operator=(const ScopedTag& rhs);
+
+		uint32_t mPrevious;
+	};
+
+	class ScopedPhase
+	{
+	public:
+		explicit ScopedPhase(const char* name);
+		~ScopedPhase();
+
+	private:
+		ScopedPhase(const ScopedPhase& rhs);
+		ScopedPhase& operator=(const ScopedPhase& rhs);
+
+		const char* mName;
+		uint64_t mAllocations;
+		uint64_t mBytes;
+		uint64_t mStartBytes;
+		uint64_t mOuterPeak;
+	};
+
+	// Once per frame; returns the counts of the frame it closes.
+	FrameStats EndFrame();
+
+	uint64_t LiveBytes();
+	uint64_t PeakBytes();
+	uint64_t TotalAllocations();
+
+	// Tags that saw allocations, and the callsites that allocated the most bytes.
+	std::vector<TagStats> Tags();
+	std::vector<CallsiteStats> Callsites(unsigned int largest);
+	std::vector<PhaseStats> Phases();
+
+	// Tags, the busiest callsites, phases and the per-frame averages, as text.
+	std::string Report(unsigned int callsites = 16);
+}
+
+#define ALLOCATION_CONCAT_(a, b) a##b
+#define ALLOCATION_CONCAT(a, b) ALLOCATION_CONCAT_(a, b)
+#define ALLOCATION_TAG(name) AllocationProfiler::ScopedTag ALLOCATION_CONCAT(allocationTag, __LINE__)(name)
+#define ALLOCATION_PHASE(name) AllocationProfiler::ScopedPhase ALLOCATION_CONCAT(allocationPhase, __LINE__)(name)
+
+#endif // ALLOCATIONPROFILER_H
@@ -0,0 +1,57 @@
+//***************************************************************************************
+// BenchMain.cpp
+//***************************************************************************************
+
+#include "BenchHarness.h"
+#include "ShadersBasicsScene.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+// FrameworkBench [frames] [results.json]: runs every headless scene along an orbit
+// and writes the results as JSON, to the file or else to the standard output.
+int main(int argc, char* argv[])
+{
+	unsigned int frames = argc > 1 ? (unsigned int)atoi(argv[1]) : 600;
+	if (frames == 0)
+	{
+		printf("usage: FrameworkBench [frames] [results.json]\n");
+		return 1;
+	}
+
+	std::vector<Bench::Result> results;
+	{
+		// The orbit ShadersApp::RunBenchmark uses.
+		ShadersBasicsScene scene;
+		float center[3] = { 0.0f, 2.0f, 0.0f };
+		results.push_back(Bench::Run(scene, Bench::CameraPath::Orbit(center, 15.0f, 0.0f), frames));
+	}
+
+	bool drew = true;
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const Bench::Result& r = results[i];
+		printf("%s: %.0f fps, %.1f draws, %.1f binds, %.0f bytes uploaded, %.2f allocations per frame\n",
+			r.Scene.c_str(), r.FramesPerSecond, r.DrawsPerFrame, r.BindsPerFrame, r.UploadBytesPerFrame, r.AllocationsPerFrame);
+		drew = drew && r.DrawsPerFrame > 0.0;
+	}
+
+	if (argc > 2)
+	{
+		std::ofstream out(argv[2]);
+		if (!out)
+		{
+			printf("cannot write %s\n", argv[2]);
+			return 1;
+		}
+		Bench::WriteJson(out, results);
+	}
+	else
+	{
+		Bench::WriteJson(std::cout, results);
+	}
+
+	return drew ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+//***************************************************************************************
+// ShadersBasicsScene.cpp
+//***************************************************************************************
+
+#include "ShadersBasicsScene.h"
+#include "MeshBuilder.h"
+#include "TextModel.h"
+
+#include <algorithm>
+
+namespace
+{
+	const float Pi = 3.1415926535f;
+
+	// The window ShadersApp opens.
+	const float ClientAspect = 800.0f/600.0f;
+
+	// The skull's index count and extent when its model cannot be read.
+	const unsigned int ApproximateSkullIndices = 181017;
+	const float ApproximateSkullExtent = 7.0f;
+}
+
+ShadersBasicsScene::ShadersBasicsScene()
+	: mScene(mJobs), mTime(0.0)
+{
+	mCam.SetLens(0.25f*Pi, ClientAspect, 1.0f, 1000.0f);
+
+	SetMeshes();
+	mScene.BuildObjectGrid();
+}
+
+/// <summary>
+/// Gives the scene the meshes ShadersApp::GenerateShapeGeometry packs: a unit box, a
+/// 20 x 30 grid, a sphere of radius 0.5 and a cylinder 3 high, in this order, and
+/// the skull in a buffer of its own.
+/// </summary>
+void ShadersBasicsScene::SetMeshes()
+{
+	MeshBuilder::Counts box = MeshBuilder::BoxCounts();
+	MeshBuilder::Counts grid = MeshBuilder::GridCounts(60, 40);
+	MeshBuilder::Counts sphere = MeshBuilder::SphereCounts(20, 20);
+	MeshBuilder::Counts cylinder = MeshBuilder::CylinderCounts(20, 20);
+
+	const float boxMin[3] = { -0.5f, -0.5f, -0.5f }, boxMax[3] = { 0.5f, 0.5f, 0.5f };
+	const float gridMin[3] = { -10.0f, 0.0f, -15.0f }, gridMax[3] = { 10.0f, 0.0f, 15.0f };
+	const float sphereMin[3] = { -0.5f, -0.5f, -0.5f }, sphereMax[3] = { 0.5f, 0.5f, 0.5f };
+	const float cylinderMin[3] = { -0.5f, -1.5f, -0.5f }, cylinderMax[3] = { 0.5f, 1.5f, 0.5f };
+
+	unsigned int start = 0;
+	int base = 0;
+	mScene.SetMesh(ShadersScene::BoxMesh, (unsigned int)box.Indices, start, base, boxMin, boxMax);
+	start += (unsigned int)box.Indices;
+	base += (int)box.Vertices;
+	mScene.SetMesh(ShadersScene::GridMesh, (unsigned int)grid.Indices, start, base, gridMin, gridMax);
+	start += (unsigned int)grid.Indices;
+	base += (int)grid.Vertices;
+	mScene.SetMesh(ShadersScene::SphereMesh, (unsigned int)sphere.Indices, start, base, sphereMin, sphereMax);
+	start += (unsigned int)sphere.Indices;
+	base += (int)sphere.Vertices;
+	mScene.SetMesh(ShadersScene::CylinderMesh, (unsigned int)cylinder.Indices, start, base, cylinderMin, cylinderMax);
+
+	TextModel skull;
+	if (LoadTextModel(SHADERS_BASICS_DIR "/Models/skull.txt", mJobs, skull) && !skull.Vertices.empty())
+	{
+		float skullMin[3], skullMax[3];
+		for (int k = 0; k < 3; ++k)
+			skullMin[k] = skullMax[k] = skull.Vertices[0].Position[k];
+		for (size_t i = 1; i < skull.Vertices.size(); ++i)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				skullMin[k] = std::min(skullMin[k], skull.Vertices[i].Position[k]);
+				skullMax[k] = std::max(skullMax[k], skull.Vertices[i].Position[k]);
+			}
+		}
+		mScene.SetMesh(ShadersScene::SkullMesh, (unsigned int)skull.Indices.size(), 0, 0, skullMin, skullMax);
+	}
+	else
+	{
+		const float e = ApproximateSkullExtent;
+		const float skullMin[3] = { -e, -e, -e }, skullMax[3] = { e, e, e };
+		mScene.SetMesh(ShadersScene::SkullMesh, ApproximateSkullIndices, 0, 0, skullMin, skullMax);
+	}
+}
+
+size_t ShadersBasicsScene::MainViewDraws()const
+{
+	return mScene.Commands(ShadersScene::MainView).DrawCount();
+}
+
+void ShadersBasicsScene::Frame(float dt, const Bench::CameraPose& camera, CommandBackend& backend)
+{
+	float up[3] = { 0.0f, 1.0f, 0.0f };
+	mCam.LookAt(camera.Eye, camera.Target, up);
+
+	mTime += dt;
+	mScene.Animate(mTime);
+	mScene.Record(mCam);
+
+	for (int i = 0; i < ShadersScene::ViewCount; ++i)
+		mScene.Commands(i).Replay(backend);
+}
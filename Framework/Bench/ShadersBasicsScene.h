@@ -0,0 +1,44 @@
+//***************************************************************************************
+// ShadersBasicsScene.h
+//
+// Shaders_Basics for the benchmark harness, on any platform. The scene, its animation
+// and the recording of its views are the demo's own ShadersScene; this only stands in
+// for what the demo loads through D3D. The shapes are given the index ranges and
+// bounds of the demo's packed shapes buffer, and the skull is read from the demo's
+// model file, or is given an approximate size when that is missing.
+//***************************************************************************************
+
+#ifndef SHADERSBASICSSCENE_H
+#define SHADERSBASICSSCENE_H
+
+#include "BenchHarness.h"
+#include "JobSystem.h"
+#include "ShadersScene.h"
+
+class ShadersBasicsScene : public Bench::Scene
+{
+public:
+	ShadersBasicsScene();
+
+	const char* Name()const { return "Shaders_Basics"; }
+
+	// Animates the scene on the time the harness steps, then records every view and
+	// replays them, as ShadersApp::BenchFrame does.
+	void Frame(float dt, const Bench::CameraPose& camera, CommandBackend& backend);
+
+	// Draws of the main view recorded in the last frame.
+	size_t MainViewDraws()const;
+
+private:
+	void SetMeshes();
+
+private:
+	// Declared first, so it outlives the scene that submits to it.
+	JobSystem mJobs;
+	ShadersScene mScene;
+	ShadersScene::Camera mCam;
+
+	double mTime;
+};
+
+#endif // SHADERSBASICSSCENE_H
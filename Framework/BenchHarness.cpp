@@ -0,0 +1,204 @@
+//***************************************************************************************
+// BenchHarness.cpp
+//***************************************************************************************
+
+#include "BenchHarness.h"
+#include "AllocationProfiler.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+
+#if defined(ALLOCATION_PROFILER)
+// The profiler replaces operator new already.
+size_t Bench::AllocationCount()
+{
+	return (size_t)AllocationProfiler::TotalAllocations();
+}
+
+bool Bench::CountsAllocations()
+{
+	return true;
+}
+#elif defined(BENCH_COUNT_ALLOCATIONS)
+namespace
+{
+	std::atomic<size_t> gAllocations(0);
+}
+
+void* operator new(size_t size)
+{
+	gAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (p == 0)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	free(p);
+}
+
+size_t Bench::AllocationCount()
+{
+	return gAllocations.load(std::memory_order_relaxed);
+}
+
+bool Bench::CountsAllocations()
+{
+	return true;
+}
+#else
+size_t Bench::AllocationCount()
+{
+	return 0;
+}
+
+bool Bench::CountsAllocations()
+{
+	return false;
+}
+#endif
+
+#pragma region CameraPath
+void Bench::CameraPath::Add(const CameraPose& key)
+{
+	mKeys.push_back(key);
+}
+
+Bench::CameraPose Bench::CameraPath::At(float t)const
+{
+	assert(!mKeys.empty());
+
+	if (mKeys.size() == 1 || t <= 0.0f)
+		return mKeys.front();
+	if (t >= 1.0f)
+		return mKeys.back();
+
+	float x = t*(mKeys.size() - 1);
+	size_t i = (size_t)x;
+	float s = x - i;
+
+	const CameraPose& a = mKeys[i];
+	const CameraPose& b = mKeys[i + 1];
+
+	CameraPose pose;
+	for (int k = 0; k < 3; ++k)
+	{
+		pose.Eye[k] = a.Eye[k] + s*(b.Eye[k] - a.Eye[k]);
+		pose.Target[k] = a.Target[k] + s*(b.Target[k] - a.Target[k]);
+	}
+	return pose;
+}
+
+Bench::CameraPath Bench::CameraPath::Orbit(const float target[3], float radius, float height, unsigned int keys)
+{
+	assert(keys >= 2);
+
+	CameraPath path;
+	for (unsigned int i = 0; i < keys; ++i)
+	{
+		float angle = 6.283185307f*i/(keys - 1);
+
+		CameraPose pose;
+		pose.Eye[0] = target[0] + radius*cosf(angle);
+		pose.Eye[1] = target[1] + height;
+		pose.Eye[2] = target[2] + radius*sinf(angle);
+		pose.Target[0] = target[0];
+		pose.Target[1] = target[1];
+		pose.Target[2] = target[2];
+		path.Add(pose);
+	}
+	return path;
+}
+#pragma endregion
+
+Bench::Result Bench::Run(Scene& scene, const CameraPath& path, unsigned int frames,
+	unsigned int warmupFrames, float dt)
+{
+	assert(frames > 0);
+
+	NullBackend backend;
+	for (unsigned int i = 0; i < warmupFrames; ++i)
+		scene.Frame(dt, path.At(0.0f), backend);
+	backend.ResetStats();
+
+	size_t allocations = AllocationCount();
+	unsigned int allocatingFrames = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (unsigned int i = 0; i < frames; ++i)
+	{
+		float t = frames > 1 ? (float)i/(frames - 1) : 0.0f;
+		size_t before = AllocationCount();
+		scene.Frame(dt, path.At(t), backend);
+		if (AllocationCount() != before)
+			++allocatingFrames;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	allocations = AllocationCount() - allocations;
+
+	const NullBackend::Stats& stats = backend.GetStats();
+
+	Result result;
+	result.Scene = scene.Name();
+	result.Frames = frames;
+	result.Seconds = seconds;
+	result.FramesPerSecond = seconds > 0.0 ? frames/seconds : 0.0;
+	result.DrawsPerFrame = (double)stats.Draws/frames;
+	result.BindsPerFrame = (double)stats.Binds/frames;
+	result.UploadBytesPerFrame = (double)stats.ConstantBytes/frames;
+	result.AllocationsPerFrame = CountsAllocations() ? (double)allocations/frames : -1.0;
+	result.AllocatingFrames = allocatingFrames;
+	return result;
+}
+
+void Bench::WriteJson(std::ostream& out, const std::vector<Result>& results)
+{
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(3);
+
+	out << "{\n  \"scenes\": [";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const Result& r = results[i];
+
+		// Scene names are the demos' own identifiers, so they need no escaping.
+		out << (i > 0 ? "," : "") << "\n    {";
+		out << "\"scene\": \"" << r.Scene << "\", ";
+		out << "\"frames\": " << r.Frames << ", ";
+		out << "\"seconds\": " << std::setprecision(6) << r.Seconds << std::setprecision(3) << ", ";
+		out << "\"framesPerSecond\": " << r.FramesPerSecond << ", ";
+		out << "\"drawsPerFrame\": " << r.DrawsPerFrame << ", ";
+		out << "\"bindsPerFrame\": " << r.BindsPerFrame << ", ";
+		out << "\"uploadBytesPerFrame\": " << r.UploadBytesPerFrame << ", ";
+		out << "\"allocationsPerFrame\": ";
+		if (r.AllocationsPerFrame < 0.0)
+			out << "null";
+		else
+			out << r.AllocationsPerFrame;
+		out << ", \"allocatingFrames\": " << r.AllocatingFrames;
+		out << "}";
+	}
+	out << "\n  ]\n}\n";
+
+	out.flags(flags);
+	out.precision(precision);
+}
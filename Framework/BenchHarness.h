@@ -0,0 +1,93 @@
+//***************************************************************************************
+// BenchHarness.h
+//
+// CPU-side frame cost of a scene without a GPU. A Bench::Scene runs the per-frame
+// logic of a demo (update, culling, recording) for a given camera and replays what
+// it recorded into the backend it is handed; Run hands it a NullBackend, drives the
+// camera along a fixed path for a number of frames and reports frames per second,
+// draws, binds, bytes of constants uploaded and heap allocations per frame, and how
+// many frames allocated at all; a steady state should have none.
+// WriteJson writes the results of several scenes as one JSON document, so runs can
+// be compared over time.
+//
+// Allocations are counted by a replacement of the global operator new, compiled in
+// only when BENCH_COUNT_ALLOCATIONS is defined for BenchHarness.cpp, or taken from
+// the allocation profiler when ALLOCATION_PROFILER is; without either
+// AllocationsPerFrame is reported as null.
+//***************************************************************************************
+
+#ifndef BENCHHARNESS_H
+#define BENCHHARNESS_H
+
+#include "CommandBuffer.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Bench
+{
+	struct CameraPose
+	{
+		float Eye[3];
+		float Target[3];
+	};
+
+	// Keyframes visited at even spacing, interpolated linearly.
+	class CameraPath
+	{
+	public:
+		void Add(const CameraPose& key);
+
+		// t in [0, 1] from the first key to the last.
+		CameraPose At(float t)const;
+
+		// One circle of the given radius at the given height above target, looking at it.
+		static CameraPath Orbit(const float target[3], float radius, float height, unsigned int keys = 16);
+
+	private:
+		std::vector<CameraPose> mKeys;
+	};
+
+	class Scene
+	{
+	public:
+		virtual ~Scene() {}
+
+		virtual const char* Name()const = 0;
+
+		// One frame seen from camera, everything it draws replayed into backend.
+		virtual void Frame(float dt, const CameraPose& camera, CommandBackend& backend) = 0;
+	};
+
+	struct Result
+	{
+		std::string Scene;
+		unsigned int Frames;
+		double Seconds;
+
+		double FramesPerSecond;
+		double DrawsPerFrame;
+		double BindsPerFrame;
+		double UploadBytesPerFrame;
+
+		// Negative when allocations are not counted.
+		double AllocationsPerFrame;
+
+		// Measured frames that allocated; 0 when allocations are not counted.
+		unsigned int AllocatingFrames;
+	};
+
+	// Runs warmupFrames unmeasured frames first, so one-time allocations and cold
+	// caches don't count.
+	Result Run(Scene& scene, const CameraPath& path, unsigned int frames,
+		unsigned int warmupFrames = 10, float dt = 1.0f/60.0f);
+
+	void WriteJson(std::ostream& out, const std::vector<Result>& results);
+
+	// Heap allocations so far, or 0 when they are not counted.
+	size_t AllocationCount();
+	bool CountsAllocations();
+}
+
+#endif // BENCHHARNESS_H
@@ -0,0 +1,217 @@
+//***************************************************************************************
+// CommandBuffer.cpp
+//***************************************************************************************
+
+#include "CommandBuffer.h"
+
+#include <cassert>
+#include <cstring>
+
+#pragma region CommandBuffer
+namespace
+{
+	struct BindArgs
+	{
+		uint32_t Slot;
+		uint32_t Id;
+	};
+
+	struct DrawArgs
+	{
+		uint32_t IndexCount;
+		uint32_t StartIndex;
+		int32_t BaseVertex;
+	};
+
+	// The slot of a constants command is padded to 8 bytes so the data itself
+	// stays 8 byte aligned.
+	const size_t ConstantsPrefix = 8;
+
+	size_t Align8(size_t size)
+	{
+		return (size + 7) & ~size_t(7);
+	}
+}
+
+CommandBuffer::CommandBuffer(size_t reserveBytes)
+	: mCommands(0), mDraws(0)
+{
+	mData.reserve(reserveBytes);
+}
+
+void CommandBuffer::Reset()
+{
+	mData.clear();
+	mCommands = 0;
+	mDraws = 0;
+}
+
+unsigned char* CommandBuffer::Append(Opcode op, size_t size)
+{
+	size_t offset = mData.size();
+	mData.resize(offset + sizeof(Header) + Align8(size));
+
+	Header header = { (uint32_t)op, (uint32_t)size };
+	std::memcpy(&mData[offset], &header, sizeof(Header));
+
+	++mCommands;
+	return &mData[offset + sizeof(Header)];
+}
+
+void CommandBuffer::SetConstants(uint32_t slot, const void* data, size_t size)
+{
+	unsigned char* args = Append(OpSetConstants, ConstantsPrefix + size);
+	std::memcpy(args, &slot, sizeof(uint32_t));
+	std::memcpy(args + ConstantsPrefix, data, size);
+}
+
+void CommandBuffer::BindTechnique(uint32_t id)
+{
+	BindArgs args = { 0, id };
+	std::memcpy(Append(OpBindTechnique, sizeof(args)), &args, sizeof(args));
+}
+
+void CommandBuffer::BindResource(uint32_t slot, uint32_t id)
+{
+	BindArgs args = { slot, id };
+	std::memcpy(Append(OpBindResource, sizeof(args)), &args, sizeof(args));
+}
+
+void CommandBuffer::BindGeometry(uint32_t id)
+{
+	BindArgs args = { 0, id };
+	std::memcpy(Append(OpBindGeometry, sizeof(args)), &args, sizeof(args));
+}
+
+void CommandBuffer::DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex)
+{
+	DrawArgs args = { indexCount, startIndex, baseVertex };
+	std::memcpy(Append(OpDrawIndexed, sizeof(args)), &args, sizeof(args));
+	++mDraws;
+}
+
+void CommandBuffer::Replay(CommandBackend& backend)const
+{
+	size_t offset = 0;
+	while (offset < mData.size())
+	{
+		Header header;
+		std::memcpy(&header, &mData[offset], sizeof(Header));
+		const unsigned char* args = &mData[offset + sizeof(Header)];
+
+		switch (header.Op)
+		{
+		case OpSetConstants:
+		{
+			uint32_t slot;
+			std::memcpy(&slot, args, sizeof(uint32_t));
+			backend.SetConstants(slot, args + ConstantsPrefix, header.Size - ConstantsPrefix);
+			break;
+		}
+		case OpBindTechnique:
+		case OpBindResource:
+		case OpBindGeometry:
+		{
+			BindArgs bind;
+			std::memcpy(&bind, args, sizeof(bind));
+			if (header.Op == OpBindTechnique)     backend.BindTechnique(bind.Id);
+			else if (header.Op == OpBindResource) backend.BindResource(bind.Slot, bind.Id);
+			else                                  backend.BindGeometry(bind.Id);
+			break;
+		}
+		case OpDrawIndexed:
+		{
+			DrawArgs draw;
+			std::memcpy(&draw, args, sizeof(draw));
+			backend.DrawIndexed(draw.IndexCount, draw.StartIndex, draw.BaseVertex);
+			break;
+		}
+		default:
+			assert(false && "Unknown command");
+			return;
+		}
+
+		offset += sizeof(Header) + Align8(header.Size);
+	}
+}
+#pragma endregion
+
+#pragma region NullBackend
+void NullBackend::SetConstants(uint32_t, const void*, size_t size)
+{
+	++mStats.Commands;
+	++mStats.ConstantUpdates;
+	mStats.ConstantBytes += size;
+}
+
+void NullBackend::BindTechnique(uint32_t)
+{
+	++mStats.Commands;
+	++mStats.Binds;
+}
+
+void NullBackend::BindResource(uint32_t, uint32_t)
+{
+	++mStats.Commands;
+	++mStats.Binds;
+}
+
+void NullBackend::BindGeometry(uint32_t)
+{
+	++mStats.Commands;
+	++mStats.Binds;
+}
+
+void NullBackend::DrawIndexed(uint32_t indexCount, uint32_t, int32_t)
+{
+	++mStats.Commands;
+	++mStats.Draws;
+	mStats.Indices += indexCount;
+}
+#pragma endregion
+
+#pragma region RecordingBackend
+bool RecordingBackend::Command::operator==(const Command& rhs)const
+{
+	return Op == rhs.Op && Args[0] == rhs.Args[0] && Args[1] == rhs.Args[1] &&
+		Args[2] == rhs.Args[2] && Data == rhs.Data;
+}
+
+void RecordingBackend::Add(CommandBuffer::Opcode op, uint32_t a, uint32_t b, uint32_t c)
+{
+	Command command;
+	command.Op = op;
+	command.Args[0] = a;
+	command.Args[1] = b;
+	command.Args[2] = c;
+	mCommands.push_back(command);
+}
+
+void RecordingBackend::SetConstants(uint32_t slot, const void* data, size_t size)
+{
+	Add(CommandBuffer::OpSetConstants, slot, (uint32_t)size, 0);
+
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	mCommands.back().Data.assign(bytes, bytes + size);
+}
+
+void RecordingBackend::BindTechnique(uint32_t id)
+{
+	Add(CommandBuffer::OpBindTechnique, id, 0, 0);
+}
+
+void RecordingBackend::BindResource(uint32_t slot, uint32_t id)
+{
+	Add(CommandBuffer::OpBindResource, slot, id, 0);
+}
+
+void RecordingBackend::BindGeometry(uint32_t id)
+{
+	Add(CommandBuffer::OpBindGeometry, id, 0, 0);
+}
+
+void RecordingBackend::DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex)
+{
+	Add(CommandBuffer::OpDrawIndexed, indexCount, startIndex, (uint32_t)baseVertex);
+}
+#pragma endregion
@@ -0,0 +1,149 @@
+//***************************************************************************************
+// CommandBuffer.h
+//
+// Backend-agnostic command recording. A CommandBuffer is a linear byte stream of
+// small commands (set constants, bind, draw) that any thread can fill without
+// touching the device; Replay() later hands the commands, in recording order, to
+// a CommandBackend on the thread that owns the device.
+//
+// NullBackend only counts what it is given and RecordingBackend keeps a copy of
+// every command, so recording and replay can be measured and compared without a
+// GPU.
+//***************************************************************************************
+
+#ifndef COMMANDBUFFER_H
+#define COMMANDBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#pragma region CommandBackend
+class CommandBackend
+{
+public:
+	virtual ~CommandBackend() {}
+
+	// The data pointer is only valid for the duration of the call.
+	virtual void SetConstants(uint32_t slot, const void* data, size_t size) = 0;
+	virtual void BindTechnique(uint32_t id) = 0;
+	virtual void BindResource(uint32_t slot, uint32_t id) = 0;
+	virtual void BindGeometry(uint32_t id) = 0;
+	virtual void DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex) = 0;
+};
+#pragma endregion
+
+#pragma region CommandBuffer
+class CommandBuffer
+{
+public:
+	enum Opcode
+	{
+		OpSetConstants,
+		OpBindTechnique,
+		OpBindResource,
+		OpBindGeometry,
+		OpDrawIndexed
+	};
+
+	explicit CommandBuffer(size_t reserveBytes = 0);
+
+	// Drops the recorded commands but keeps the memory for the next recording.
+	void Reset();
+
+	void SetConstants(uint32_t slot, const void* data, size_t size);
+	void BindTechnique(uint32_t id);
+	void BindResource(uint32_t slot, uint32_t id);
+	void BindGeometry(uint32_t id);
+	void DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex);
+
+	template <typename T>
+	void SetConstants(uint32_t slot, const T& data)   { SetConstants(slot, &data, sizeof(T)); }
+
+	void Replay(CommandBackend& backend)const;
+
+	size_t CommandCount()const             { return mCommands; }
+	size_t DrawCount()const                { return mDraws; }
+	size_t SizeBytes()const                { return mData.size(); }
+
+private:
+	// Every command starts with a header and is padded to a multiple of 8 bytes, so
+	// headers and the arguments following them stay aligned.
+	struct Header
+	{
+		uint32_t Op;
+		uint32_t Size;				// bytes of arguments following the header
+	};
+
+	unsigned char* Append(Opcode op, size_t size);
+
+	std::vector<unsigned char> mData;
+	size_t mCommands;
+	size_t mDraws;
+};
+#pragma endregion
+
+#pragma region NullBackend
+// Discards every command but counts them.
+class NullBackend : public CommandBackend
+{
+public:
+	struct Stats
+	{
+		Stats() : Commands(0), ConstantUpdates(0), ConstantBytes(0), Binds(0), Draws(0), Indices(0) {}
+
+		size_t Commands;
+		size_t ConstantUpdates;
+		size_t ConstantBytes;
+		size_t Binds;
+		size_t Draws;
+		size_t Indices;
+	};
+
+	void SetConstants(uint32_t slot, const void* data, size_t size);
+	void BindTechnique(uint32_t id);
+	void BindResource(uint32_t slot, uint32_t id);
+	void BindGeometry(uint32_t id);
+	void DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex);
+
+	const Stats& GetStats()const           { return mStats; }
+	void ResetStats()                      { mStats = Stats(); }
+
+private:
+	Stats mStats;
+};
+#pragma endregion
+
+#pragma region RecordingBackend
+// Keeps a copy of every command it is given, e.g. to check that a multithreaded
+// recording replays to the same stream as a serial one.
+class RecordingBackend : public CommandBackend
+{
+public:
+	struct Command
+	{
+		CommandBuffer::Opcode Op;
+		uint32_t Args[3];
+		std::vector<unsigned char> Data;	// constants, for OpSetConstants
+
+		bool operator==(const Command& rhs)const;
+		bool operator!=(const Command& rhs)const { return !(*this == rhs); }
+	};
+
+	void SetConstants(uint32_t slot, const void* data, size_t size);
+	void BindTechnique(uint32_t id);
+	void BindResource(uint32_t slot, uint32_t id);
+	void BindGeometry(uint32_t id);
+	void DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex);
+
+	const std::vector<Command>& Commands()const { return mCommands; }
+	void Clear()                                { mCommands.clear(); }
+
+private:
+	void Add(CommandBuffer::Opcode op, uint32_t a, uint32_t b, uint32_t c);
+
+	std::vector<Command> mCommands;
+};
+#pragma endregion
+
+#endif // COMMANDBUFFER_H
@@ -0,0 +1,65 @@
+//***************************************************************************************
+// ConstantBuffer.cpp
+//***************************************************************************************
+
+#include "ConstantBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#pragma region ConstantRing
+ConstantRing::ConstantRing(size_t capacity, size_t alignment, size_t framesInFlight)
+	: mStorage(capacity), mAlignment(alignment), mFramesInFlight(framesInFlight),
+	mHead(0), mLive(0), mFrameBytes(0), mHighWater(0), mOverflows(0)
+{
+	// Alignment must be a power of two for the round-up below.
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+}
+
+void ConstantRing::BeginFrame()
+{
+	mRetained.push_back(mFrameBytes);
+	mFrameBytes = 0;
+
+	while (mRetained.size() > mFramesInFlight)
+	{
+		mLive -= mRetained.front();
+		mRetained.pop_front();
+	}
+
+	// Nothing is live anymore, so start again at the front and keep records of
+	// the next frame contiguous.
+	if (mLive == 0)
+		mHead = 0;
+}
+
+size_t ConstantRing::Push(const void* data, size_t size)
+{
+	size_t capacity = mStorage.size();
+	size_t offset = (mHead + mAlignment - 1) & ~(mAlignment - 1);
+	size_t used = offset - mHead;
+
+	// Records never straddle the end; skip the tail and wrap to the front.
+	if (offset + size > capacity)
+	{
+		used = capacity - mHead;
+		offset = 0;
+	}
+
+	if (size > capacity || mLive + used + size > capacity)
+	{
+		++mOverflows;
+		return InvalidOffset;
+	}
+
+	std::memcpy(&mStorage[offset], data, size);
+
+	used += size;
+	mHead = offset + size;
+	mLive += used;
+	mFrameBytes += used;
+	mHighWater = std::max(mHighWater, mLive);
+
+	return offset;
+}
+#pragma endregion
@@ -0,0 +1,137 @@
+//***************************************************************************************
+// ConstantBuffer.h
+//
+// Typed shadows of shader constant buffers. A ConstantBuffer<T> keeps a copy of the
+// contents it last uploaded so callers can skip the upload when nothing changed,
+// and a ConstantRing packs per-object records back to back so draws can refer to
+// them by offset. UploadStats counts what was actually sent each frame.
+//
+// The types mirror cbuffer layouts but never talk to Direct3D themselves.
+//***************************************************************************************
+
+#ifndef CONSTANTBUFFER_H
+#define CONSTANTBUFFER_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#pragma region UploadStats
+class UploadStats
+{
+public:
+	struct Frame
+	{
+		Frame() : Uploads(0), BytesUploaded(0), Skipped(0), BytesSkipped(0) {}
+
+		size_t Uploads;
+		size_t BytesUploaded;
+		size_t Skipped;			// uploads avoided because the contents were unchanged
+		size_t BytesSkipped;
+	};
+
+	// Closes the running frame; its totals become LastFrame().
+	void BeginFrame()                      { mLast = mCurrent; mCurrent = Frame(); }
+
+	void RecordUpload(size_t bytes)        { ++mCurrent.Uploads; mCurrent.BytesUploaded += bytes; }
+	void RecordSkip(size_t bytes)          { ++mCurrent.Skipped; mCurrent.BytesSkipped += bytes; }
+
+	const Frame& Current()const            { return mCurrent; }
+	const Frame& LastFrame()const          { return mLast; }
+
+private:
+	Frame mCurrent;
+	Frame mLast;
+};
+#pragma endregion
+
+#pragma region ConstantBuffer
+template <typename T>
+class ConstantBuffer
+{
+public:
+	explicit ConstantBuffer(UploadStats* stats = 0)
+		: mData(), mValid(false), mStats(stats) {}
+
+	void SetStats(UploadStats* stats)      { mStats = stats; }
+
+	// Stores the contents and returns true if they differ from the last upload,
+	// in which case the caller is expected to upload Data(). The contents are
+	// compared bytewise, so callers must make sure padding is initialized.
+	bool Update(const T& data)
+	{
+		if (mValid && std::memcmp(&data, &mData, sizeof(T)) == 0)
+		{
+			if (mStats) mStats->RecordSkip(sizeof(T));
+			return false;
+		}
+
+		mData  = data;
+		mValid = true;
+		if (mStats) mStats->RecordUpload(sizeof(T));
+		return true;
+	}
+
+	// Forces the next Update() to report a change, e.g. after the values were
+	// written through some other path.
+	void Invalidate()                      { mValid = false; }
+
+	const T& Data()const                   { return mData; }
+
+private:
+	T mData;
+	bool mValid;
+	UploadStats* mStats;
+};
+#pragma endregion
+
+#pragma region ConstantRing
+// Ring suballocator for per-object constants. Records pushed during a frame stay
+// valid until framesInFlight further frames have begun, then their space is reused.
+class ConstantRing
+{
+public:
+	static const size_t InvalidOffset = ~(size_t)0;
+
+	ConstantRing(size_t capacity, size_t alignment = 16, size_t framesInFlight = 0);
+
+	void BeginFrame();
+
+	// Returns the offset of the copied record, or InvalidOffset if the ring is full.
+	size_t Push(const void* data, size_t size);
+
+	template <typename T>
+	size_t Push(const T& data)             { return Push(&data, sizeof(T)); }
+
+	template <typename T>
+	const T& At(size_t offset)const
+	{
+		assert(offset + sizeof(T) <= mStorage.size());
+		return *reinterpret_cast<const T*>(&mStorage[offset]);
+	}
+
+	size_t Capacity()const                 { return mStorage.size(); }
+	size_t LiveBytes()const                { return mLive; }
+	size_t FrameBytes()const               { return mFrameBytes; }
+	size_t HighWater()const                { return mHighWater; }
+	size_t Overflows()const                { return mOverflows; }
+
+private:
+	std::vector<unsigned char> mStorage;
+	size_t mAlignment;
+	size_t mFramesInFlight;
+
+	size_t mHead;					// next free byte
+	size_t mLive;					// bytes owned by retained frames plus the current one
+	size_t mFrameBytes;				// bytes (including padding) used by the current frame
+	std::deque<size_t> mRetained;	// bytes used by each frame still in flight
+
+	size_t mHighWater;
+	size_t mOverflows;
+};
+#pragma endregion
+
+#endif // CONSTANTBUFFER_H
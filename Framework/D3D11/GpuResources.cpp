@@ -0,0 +1,283 @@
+//***************************************************************************************
+// GpuResources.cpp
+//***************************************************************************************
+
+#include "GpuResources.h"
+
+namespace
+{
+	// {6F1C3E52-8A4B-4C1D-9E27-3B5D0F8A7C14}
+	const GUID TrackedAllocationGuid = { 0x6f1c3e52, 0x8a4b, 0x4c1d, { 0x9e, 0x27, 0x3b, 0x5d, 0x0f, 0x8a, 0x7c, 0x14 } };
+
+	// Held only by the resource it is attached to, so its last release is the
+	// resource being destroyed.
+	class ReleaseToken : public IUnknown
+	{
+	public:
+		ReleaseToken(GpuBudget& budget, GpuBudget::AllocationId id)
+			: mBudget(budget), mId(id), mRefs(1)
+		{
+		}
+
+		HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object)
+		{
+			if (!object)
+				return E_POINTER;
+
+			if (riid != __uuidof(IUnknown))
+			{
+				*object = 0;
+				return E_NOINTERFACE;
+			}
+
+			AddRef();
+			*object = static_cast<IUnknown*>(this);
+			return S_OK;
+		}
+
+		ULONG STDMETHODCALLTYPE AddRef()
+		{
+			return InterlockedIncrement(&mRefs);
+		}
+
+		ULONG STDMETHODCALLTYPE Release()
+		{
+			ULONG refs = InterlockedDecrement(&mRefs);
+			if (refs == 0)
+			{
+				mBudget.Release(mId);
+				delete this;
+			}
+			return refs;
+		}
+
+	private:
+		GpuBudget& mBudget;
+		GpuBudget::AllocationId mId;
+		LONG mRefs;
+	};
+}
+
+UINT GpuResources::BitsPerPixel(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+	case DXGI_FORMAT_R32G32B32A32_UINT:
+	case DXGI_FORMAT_R32G32B32A32_SINT:
+		return 128;
+
+	case DXGI_FORMAT_R32G32B32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32_FLOAT:
+	case DXGI_FORMAT_R32G32B32_UINT:
+	case DXGI_FORMAT_R32G32B32_SINT:
+		return 96;
+
+	case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_UINT:
+	case DXGI_FORMAT_R16G16B16A16_SNORM:
+	case DXGI_FORMAT_R16G16B16A16_SINT:
+	case DXGI_FORMAT_R32G32_TYPELESS:
+	case DXGI_FORMAT_R32G32_FLOAT:
+	case DXGI_FORMAT_R32G32_UINT:
+	case DXGI_FORMAT_R32G32_SINT:
+	case DXGI_FORMAT_R32G8X24_TYPELESS:
+	case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+	case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+	case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+		return 64;
+
+	case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+	case DXGI_FORMAT_R10G10B10A2_UINT:
+	case DXGI_FORMAT_R11G11B10_FLOAT:
+	case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_R8G8B8A8_UINT:
+	case DXGI_FORMAT_R8G8B8A8_SNORM:
+	case DXGI_FORMAT_R8G8B8A8_SINT:
+	case DXGI_FORMAT_R16G16_TYPELESS:
+	case DXGI_FORMAT_R16G16_FLOAT:
+	case DXGI_FORMAT_R16G16_UNORM:
+	case DXGI_FORMAT_R16G16_UINT:
+	case DXGI_FORMAT_R16G16_SNORM:
+	case DXGI_FORMAT_R16G16_SINT:
+	case DXGI_FORMAT_R32_TYPELESS:
+	case DXGI_FORMAT_D32_FLOAT:
+	case DXGI_FORMAT_R32_FLOAT:
+	case DXGI_FORMAT_R32_UINT:
+	case DXGI_FORMAT_R32_SINT:
+	case DXGI_FORMAT_R24G8_TYPELESS:
+	case DXGI_FORMAT_D24_UNORM_S8_UINT:
+	case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+	case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+	case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+		return 32;
+
+	case DXGI_FORMAT_R8G8_TYPELESS:
+	case DXGI_FORMAT_R8G8_UNORM:
+	case DXGI_FORMAT_R8G8_UINT:
+	case DXGI_FORMAT_R8G8_SNORM:
+	case DXGI_FORMAT_R8G8_SINT:
+	case DXGI_FORMAT_R16_TYPELESS:
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_D16_UNORM:
+	case DXGI_FORMAT_R16_UNORM:
+	case DXGI_FORMAT_R16_UINT:
+	case DXGI_FORMAT_R16_SNORM:
+	case DXGI_FORMAT_R16_SINT:
+	case DXGI_FORMAT_B5G6R5_UNORM:
+	case DXGI_FORMAT_B5G5R5A1_UNORM:
+		return 16;
+
+	case DXGI_FORMAT_R8_TYPELESS:
+	case DXGI_FORMAT_R8_UNORM:
+	case DXGI_FORMAT_R8_UINT:
+	case DXGI_FORMAT_R8_SNORM:
+	case DXGI_FORMAT_R8_SINT:
+	case DXGI_FORMAT_A8_UNORM:
+	case DXGI_FORMAT_BC2_TYPELESS:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 8;
+
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+		return 4;
+
+	case DXGI_FORMAT_R1_UNORM:
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+UINT64 GpuResources::TextureBytes(const D3D11_TEXTURE2D_DESC& desc)
+{
+	bool compressed = desc.Format >= DXGI_FORMAT_BC1_TYPELESS && desc.Format <= DXGI_FORMAT_BC5_SNORM ||
+		desc.Format >= DXGI_FORMAT_BC6H_TYPELESS && desc.Format <= DXGI_FORMAT_BC7_UNORM_SRGB;
+	UINT bits = BitsPerPixel(desc.Format);
+
+	UINT levels = desc.MipLevels;
+	if (levels == 0)
+	{
+		levels = 1;
+		for (UINT size = MathHelper::Max(desc.Width, desc.Height); size > 1; size /= 2)
+			++levels;
+	}
+
+	UINT64 bytes = 0;
+	UINT w = desc.Width;
+	UINT h = desc.Height;
+	for (UINT i = 0; i < levels; ++i)
+	{
+		if (compressed)
+			bytes += (UINT64)((w + 3)/4)*((h + 3)/4)*bits*16/8;
+		else
+			bytes += ((UINT64)w*h*bits + 7)/8;
+
+		w = MathHelper::Max(w/2, 1u);
+		h = MathHelper::Max(h/2, 1u);
+	}
+	return bytes*desc.ArraySize*MathHelper::Max(desc.SampleDesc.Count, 1u);
+}
+
+void GpuResources::Track(GpuBudget& budget, GpuSubsystem subsystem, const std::string& name, ID3D11Resource* resource)
+{
+	if (!resource)
+		return;
+
+	// GetPrivateData adds a reference to a token it returns.
+	IUnknown* existing = 0;
+	UINT size = sizeof(existing);
+	if (SUCCEEDED(resource->GetPrivateData(TrackedAllocationGuid, &size, &existing)) && existing)
+	{
+		existing->Release();
+		return;
+	}
+
+	D3D11_RESOURCE_DIMENSION dimension;
+	resource->GetType(&dimension);
+
+	UINT64 bytes = 0;
+	if (dimension == D3D11_RESOURCE_DIMENSION_BUFFER)
+	{
+		D3D11_BUFFER_DESC desc;
+		static_cast<ID3D11Buffer*>(resource)->GetDesc(&desc);
+		bytes = desc.ByteWidth;
+	}
+	else if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		static_cast<ID3D11Texture2D*>(resource)->GetDesc(&desc);
+		bytes = TextureBytes(desc);
+	}
+	else
+	{
+		return;
+	}
+
+	ReleaseToken* token = new ReleaseToken(budget, budget.Track(subsystem, name, bytes));
+	HR(resource->SetPrivateDataInterface(TrackedAllocationGuid, token));
+	token->Release();
+
+#if defined(DEBUG) | defined(_DEBUG)
+	resource->SetPrivateData(WKPDID_D3DDebugObjectName, (UINT)name.size(), name.c_str());
+#endif
+}
+
+void GpuResources::Track(GpuBudget& budget, GpuSubsystem subsystem, const std::string& name, ID3D11View* view)
+{
+	if (!view)
+		return;
+
+	ID3D11Resource* resource = 0;
+	view->GetResource(&resource);
+	Track(budget, subsystem, name, resource);
+	ReleaseCOM(resource);
+}
+
+HRESULT GpuResources::CreateBuffer(ID3D11Device* device, GpuBudget& budget, GpuSubsystem subsystem, const std::string& name,
+	const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Buffer** buffer)
+{
+	HRESULT hr = device->CreateBuffer(desc, initialData, buffer);
+	if (SUCCEEDED(hr))
+		Track(budget, subsystem, name, *buffer);
+	return hr;
+}
+
+HRESULT GpuResources::CreateTexture2D(ID3D11Device* device, GpuBudget& budget, GpuSubsystem subsystem, const std::string& name,
+	const D3D11_TEXTURE2D_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Texture2D** texture)
+{
+	HRESULT hr = device->CreateTexture2D(desc, initialData, texture);
+	if (SUCCEEDED(hr))
+		Track(budget, subsystem, name, *texture);
+	return hr;
+}
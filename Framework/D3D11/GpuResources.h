@@ -0,0 +1,38 @@
+//***************************************************************************************
+// GpuResources.h
+//
+// The Direct3D side of the GPU budget: sizes of buffers and textures from their
+// descriptions, and creation functions that track what they create. A tracked
+// resource carries a token as private data, which the resource releases when it is
+// destroyed, whoever held the last reference; that takes it off the budget. The
+// budget must therefore outlive every resource tracked with it.
+//***************************************************************************************
+
+#ifndef GPURESOURCES_H
+#define GPURESOURCES_H
+
+#include "d3dUtil.h"
+#include "GpuBudget.h"
+
+namespace GpuResources
+{
+	UINT BitsPerPixel(DXGI_FORMAT format);
+
+	// Every mip of every slice; block compressed levels round up to whole blocks.
+	UINT64 TextureBytes(const D3D11_TEXTURE2D_DESC& desc);
+
+	// Tracks a buffer or 2D texture until it is destroyed; a resource tracked
+	// already is left as it is.
+	void Track(GpuBudget& budget, GpuSubsystem subsystem, const std::string& name, ID3D11Resource* resource);
+
+	// Tracks the resource the view is of.
+	void Track(GpuBudget& budget, GpuSubsystem subsystem, const std::string& name, ID3D11View* view);
+
+	HRESULT CreateBuffer(ID3D11Device* device, GpuBudget& budget, GpuSubsystem subsystem, const std::string& name,
+		const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Buffer** buffer);
+
+	HRESULT CreateTexture2D(ID3D11Device* device, GpuBudget& budget, GpuSubsystem subsystem, const std::string& name,
+		const D3D11_TEXTURE2D_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Texture2D** texture);
+}
+
+#endif // GPURESOURCES_H
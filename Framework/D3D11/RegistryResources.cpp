@@ -0,0 +1,108 @@
+//***************************************************************************************
+// RegistryResources.cpp
+//***************************************************************************************
+
+#include "RegistryResources.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	// Hashes the bytes into key and counts them into size.
+	void HashInto(uint64_t& key, uint64_t& size, const void* data, size_t bytes)
+	{
+		key = ContentHash(data, bytes, key);
+		size += bytes;
+	}
+}
+
+void RegistryResources::ReleaseUnknown(void* resource)
+{
+	static_cast<IUnknown*>(resource)->Release();
+}
+
+bool RegistryResources::ReadFile(const std::wstring& filename, std::vector<char>& data)
+{
+	data.clear();
+
+	std::ifstream fin(filename, std::ios::binary);
+	if (!fin)
+		return false;
+
+	fin.seekg(0, std::ios_base::end);
+	int size = (int)fin.tellg();
+	fin.seekg(0, std::ios_base::beg);
+	if (size <= 0)
+		return false;
+	data.resize(size);
+
+	fin.read(&data[0], size);
+	fin.close();
+	return true;
+}
+
+ResourceHandle<ID3DX11Effect> RegistryResources::CreateEffect(ID3D11Device* device, ResourceRegistry& registry,
+	const void* compiled, size_t size)
+{
+	uint64_t key = ContentKey(EffectResource, compiled, size);
+
+	return registry.Acquire<ID3DX11Effect>(key, size, [&]()
+	{
+		ID3DX11Effect* fx = 0;
+		HR(D3DX11CreateEffectFromMemory(compiled, size, 0, device, &fx));
+		return fx;
+	}, ReleaseUnknown);
+}
+
+ResourceHandle<ID3D11ShaderResourceView> RegistryResources::CreateTexture(ID3D11Device* device, ResourceRegistry& registry,
+	const void* data, size_t size, UINT firstMip)
+{
+	uint64_t key = ContentKey(TextureResource, data, size);
+	key = ContentHash(&firstMip, sizeof(firstMip), key);
+
+	return registry.Acquire<ID3D11ShaderResourceView>(key, size, [&]()
+	{
+		D3DX11_IMAGE_LOAD_INFO loadInfo;
+		loadInfo.FirstMipLevel = firstMip;
+
+		ID3D11ShaderResourceView* srv = 0;
+		HR(D3DX11CreateShaderResourceViewFromMemory(device, data, size, &loadInfo, 0, &srv, 0));
+		return srv;
+	}, ReleaseUnknown);
+}
+
+ResourceHandle<ID3D11ShaderResourceView> RegistryResources::LoadTexture(ID3D11Device* device, ResourceRegistry& registry,
+	const std::wstring& filename)
+{
+	std::vector<char> data;
+	if (!ReadFile(filename, data))
+		return ResourceHandle<ID3D11ShaderResourceView>();
+
+	return CreateTexture(device, registry, &data[0], data.size());
+}
+
+ResourceHandle<ID3D11InputLayout> RegistryResources::CreateInputLayout(ID3D11Device* device, ResourceRegistry& registry,
+	const D3D11_INPUT_ELEMENT_DESC* elements, UINT count, const D3DX11_PASS_DESC& pass)
+{
+	// The semantic names by their text, not where the strings happen to be.
+	uint32_t kind = InputLayoutResource;
+	uint64_t key = ContentHash(&kind, sizeof(kind));
+	uint64_t size = 0;
+	for (UINT i = 0; i < count; ++i)
+	{
+		const D3D11_INPUT_ELEMENT_DESC& e = elements[i];
+		UINT fields[6] = { e.SemanticIndex, (UINT)e.Format, e.InputSlot, e.AlignedByteOffset,
+			(UINT)e.InputSlotClass, e.InstanceDataStepRate };
+		HashInto(key, size, e.SemanticName, strlen(e.SemanticName) + 1);
+		HashInto(key, size, fields, sizeof(fields));
+	}
+	HashInto(key, size, pass.pIAInputSignature, pass.IAInputSignatureSize);
+
+	return registry.Acquire<ID3D11InputLayout>(key, size, [&]()
+	{
+		ID3D11InputLayout* layout = 0;
+		HR(device->CreateInputLayout(elements, count, pass.pIAInputSignature, pass.IAInputSignatureSize, &layout));
+		return layout;
+	}, ReleaseUnknown);
+}
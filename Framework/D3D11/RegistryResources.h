@@ -0,0 +1,45 @@
+//***************************************************************************************
+// RegistryResources.h
+//
+// The Direct3D side of the resource registry: effects, textures and input layouts
+// created through a ResourceRegistry, keyed on the content they are made from, so
+// that everything loading the same bytes shares one device object. The registry
+// must outlive the device objects' handles and be destroyed before the device.
+//
+// Effects made from the same bytes share one ID3DX11Effect and so its variables;
+// the wrappers of one app each load a different effect file.
+//***************************************************************************************
+
+#ifndef REGISTRYRESOURCES_H
+#define REGISTRYRESOURCES_H
+
+#include "d3dUtil.h"
+#include "ResourceRegistry.h"
+
+namespace RegistryResources
+{
+	// Destroy function for registry entries holding a COM object.
+	void ReleaseUnknown(void* resource);
+
+	// Returns false, with data empty, if the file cannot be opened or is empty.
+	bool ReadFile(const std::wstring& filename, std::vector<char>& data);
+
+	// An effect from its compiled bytes.
+	ResourceHandle<ID3DX11Effect> CreateEffect(ID3D11Device* device, ResourceRegistry& registry,
+		const void* compiled, size_t size);
+
+	// A texture from the contents of an image file, its top firstMip mips skipped;
+	// the same file at another firstMip is another texture.
+	ResourceHandle<ID3D11ShaderResourceView> CreateTexture(ID3D11Device* device, ResourceRegistry& registry,
+		const void* data, size_t size, UINT firstMip = 0);
+
+	// Null if the file cannot be read.
+	ResourceHandle<ID3D11ShaderResourceView> LoadTexture(ID3D11Device* device, ResourceRegistry& registry,
+		const std::wstring& filename);
+
+	// An input layout, keyed on its elements and the input signature of the pass.
+	ResourceHandle<ID3D11InputLayout> CreateInputLayout(ID3D11Device* device, ResourceRegistry& registry,
+		const D3D11_INPUT_ELEMENT_DESC* elements, UINT count, const D3DX11_PASS_DESC& pass);
+}
+
+#endif // REGISTRYRESOURCES_H
@@ -0,0 +1,178 @@
+//***************************************************************************************
+// RenderTargetPool.cpp
+//***************************************************************************************
+
+#include "RenderTargetPool.h"
+
+RenderTargetPool::RenderTargetPool()
+	: mFrame(0), mCreated(0)
+{
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+	for (size_t i = 0; i < mTargets.size(); ++i)
+		Destroy(mTargets[i]);
+}
+
+void RenderTargetPool::Bind(ID3D11Device* device, const FrameGraph& graph)
+{
+	for (size_t i = 0; i < mTargets.size(); ++i)
+		mTargets[i]->Bound = false;
+
+	mBound.assign(graph.PhysicalCount(), 0);
+	for (UINT p = 0; p < graph.PhysicalCount(); ++p)
+	{
+		const TransientDesc& desc = graph.PhysicalDesc(p);
+
+		for (size_t i = 0; i < mTargets.size() && !mBound[p]; ++i)
+		{
+			if (!mTargets[i]->Bound && mTargets[i]->Desc == desc)
+				mBound[p] = mTargets[i];
+		}
+
+		if (!mBound[p])
+		{
+			mBound[p] = Create(device, desc);
+			mTargets.push_back(mBound[p]);
+		}
+
+		mBound[p]->Bound = true;
+		mBound[p]->LastUsedFrame = mFrame;
+	}
+}
+
+const RenderTargetPool::Target& RenderTargetPool::Get(const FrameGraph& graph, FrameGraph::ResourceId resource)const
+{
+	return *mBound[graph.Physical(resource)];
+}
+
+void RenderTargetPool::EndFrame()
+{
+	++mFrame;
+
+	for (size_t i = 0; i < mTargets.size(); )
+	{
+		Target* target = mTargets[i];
+		if (target->Bound)
+			target->LastUsedFrame = mFrame;
+
+		if (mFrame - target->LastUsedFrame > EvictAfterFrames)
+		{
+			Destroy(target);
+			mTargets[i] = mTargets.back();
+			mTargets.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+UINT64 RenderTargetPool::PooledBytes()const
+{
+	UINT64 bytes = 0;
+	for (size_t i = 0; i < mTargets.size(); ++i)
+		bytes += mTargets[i]->Desc.Bytes();
+	return bytes;
+}
+
+RenderTargetPool::Target* RenderTargetPool::Create(ID3D11Device* device, const TransientDesc& desc)
+{
+	Target* target = mRecords.Create();
+	target->Desc = desc;
+	target->Texture = 0;
+	target->SRV = 0;
+	target->DSV = 0;
+	target->LastUsedFrame = mFrame;
+	target->Bound = false;
+
+	D3D11_TEXTURE2D_DESC texDesc;
+	texDesc.Width = desc.Width;
+	texDesc.Height = desc.Height;
+	texDesc.MipLevels = desc.MipLevels;
+	texDesc.ArraySize = desc.ArraySize;
+	texDesc.Format = (DXGI_FORMAT)desc.Format;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = desc.BindFlags;
+	texDesc.CPUAccessFlags = 0;
+	texDesc.MiscFlags = desc.MiscFlags;
+	HR(device->CreateTexture2D(&texDesc, 0, &target->Texture));
+
+	if (desc.BindFlags & D3D11_BIND_SHADER_RESOURCE)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+		srvDesc.Format = texDesc.Format;
+		if (desc.MiscFlags & D3D11_RESOURCE_MISC_TEXTURECUBE)
+		{
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+			srvDesc.TextureCube.MostDetailedMip = 0;
+			srvDesc.TextureCube.MipLevels = -1;
+		}
+		else if (desc.ArraySize > 1)
+		{
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+			srvDesc.Texture2DArray.MostDetailedMip = 0;
+			srvDesc.Texture2DArray.MipLevels = -1;
+			srvDesc.Texture2DArray.FirstArraySlice = 0;
+			srvDesc.Texture2DArray.ArraySize = desc.ArraySize;
+		}
+		else
+		{
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+			srvDesc.Texture2D.MostDetailedMip = 0;
+			srvDesc.Texture2D.MipLevels = -1;
+		}
+		HR(device->CreateShaderResourceView(target->Texture, &srvDesc, &target->SRV));
+	}
+
+	if (desc.BindFlags & D3D11_BIND_RENDER_TARGET)
+	{
+		target->RTVs.resize(desc.ArraySize, 0);
+
+		D3D11_RENDER_TARGET_VIEW_DESC rtvDesc;
+		rtvDesc.Format = texDesc.Format;
+		for (UINT i = 0; i < desc.ArraySize; ++i)
+		{
+			if (desc.ArraySize > 1)
+			{
+				rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
+				rtvDesc.Texture2DArray.MipSlice = 0;
+				rtvDesc.Texture2DArray.FirstArraySlice = i;
+				rtvDesc.Texture2DArray.ArraySize = 1;
+			}
+			else
+			{
+				rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+				rtvDesc.Texture2D.MipSlice = 0;
+			}
+			HR(device->CreateRenderTargetView(target->Texture, &rtvDesc, &target->RTVs[i]));
+		}
+	}
+
+	if (desc.BindFlags & D3D11_BIND_DEPTH_STENCIL)
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+		dsvDesc.Format = texDesc.Format;
+		dsvDesc.Flags = 0;
+		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+		dsvDesc.Texture2D.MipSlice = 0;
+		HR(device->CreateDepthStencilView(target->Texture, &dsvDesc, &target->DSV));
+	}
+
+	++mCreated;
+	return target;
+}
+
+void RenderTargetPool::Destroy(Target* target)
+{
+	for (size_t i = 0; i < target->RTVs.size(); ++i)
+		ReleaseCOM(target->RTVs[i]);
+	ReleaseCOM(target->DSV);
+	ReleaseCOM(target->SRV);
+	ReleaseCOM(target->Texture);
+	mRecords.Destroy(target);
+}
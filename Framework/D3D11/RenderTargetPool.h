@@ -0,0 +1,68 @@
+//***************************************************************************************
+// RenderTargetPool.h
+//
+// The Direct3D side of the frame graph: a texture and its views for every physical
+// target of a compiled graph. Textures stay in the pool by description once created
+// and go to the next graph that asks for one alike, so recompiling the graph, on a
+// resize say, only creates what the pool lacks, and a size the window returns to
+// finds its targets still there. A texture no graph has used for EvictAfterFrames
+// frames is released. The records of the targets are recycled through a pool.
+//***************************************************************************************
+
+#ifndef RENDERTARGETPOOL_H
+#define RENDERTARGETPOOL_H
+
+#include "d3dUtil.h"
+#include "FrameGraph.h"
+#include "FrameMemory.h"
+
+class RenderTargetPool
+{
+public:
+	struct Target
+	{
+		TransientDesc Desc;
+		ID3D11Texture2D* Texture;
+
+		// Each only if the bind flags ask for it; one render target view per slice.
+		ID3D11ShaderResourceView* SRV;
+		ID3D11DepthStencilView* DSV;
+		std::vector<ID3D11RenderTargetView*> RTVs;
+
+		UINT LastUsedFrame;
+		bool Bound;
+	};
+
+	static const UINT EvictAfterFrames = 120;
+
+	RenderTargetPool();
+	~RenderTargetPool();
+
+	// Gives every physical target of the compiled graph a pooled texture.
+	void Bind(ID3D11Device* device, const FrameGraph& graph);
+
+	// Texture of a transient of the graph bound last.
+	const Target& Get(const FrameGraph& graph, FrameGraph::ResourceId resource)const;
+
+	// Once per frame, after the graph executed.
+	void EndFrame();
+
+	// Textures created over the life of the pool, and bytes held now.
+	UINT CreatedCount()const              { return mCreated; }
+	UINT64 PooledBytes()const;
+
+private:
+	RenderTargetPool(const RenderTargetPool& rhs);
+	RenderTargetPool& operator=(const RenderTargetPool& rhs);
+
+	Target* Create(ID3D11Device* device, const TransientDesc& desc);
+	void Destroy(Target* target);
+
+	Pool<Target> mRecords;
+	std::vector<Target*> mTargets;
+	std::vector<Target*> mBound;
+	UINT mFrame;
+	UINT mCreated;
+};
+
+#endif // RENDERTARGETPOOL_H
@@ -0,0 +1,399 @@
+//***************************************************************************************
+// FrameGraph.cpp
+//***************************************************************************************
+
+#include "FrameGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+#pragma region TransientDesc
+uint64_t TransientDesc::Bytes()const
+{
+	unsigned int levels = MipLevels;
+	if (levels == 0)
+	{
+		levels = 1;
+		for (unsigned int size = std::max(Width, Height); size > 1; size /= 2)
+			++levels;
+	}
+
+	uint64_t bytes = 0;
+	unsigned int w = Width;
+	unsigned int h = Height;
+	for (unsigned int i = 0; i < levels; ++i)
+	{
+		bytes += (uint64_t)w*h*BytesPerTexel;
+		w = std::max(w/2, 1u);
+		h = std::max(h/2, 1u);
+	}
+	return bytes*ArraySize;
+}
+
+bool TransientDesc::operator==(const TransientDesc& rhs)const
+{
+	return Width == rhs.Width && Height == rhs.Height && ArraySize == rhs.ArraySize &&
+		MipLevels == rhs.MipLevels && Format == rhs.Format && BytesPerTexel == rhs.BytesPerTexel &&
+		BindFlags == rhs.BindFlags && MiscFlags == rhs.MiscFlags;
+}
+#pragma endregion
+
+FrameGraph::FrameGraph()
+	: mHeapBytes(0)
+{
+}
+
+void FrameGraph::Reset()
+{
+	mPasses.clear();
+	mResources.clear();
+	mPhysical.clear();
+	mHeapBytes = 0;
+}
+
+FrameGraph::ResourceId FrameGraph::CreateTransient(const char* name, const TransientDesc& desc)
+{
+	Resource resource;
+	resource.Name = name;
+	resource.Transient = true;
+	resource.Desc = desc;
+	resource.FirstUse = 0;
+	resource.LastUse = 0;
+	resource.Physical = 0;
+	resource.HeapOffset = 0;
+
+	mResources.push_back(resource);
+	return (ResourceId)mResources.size() - 1;
+}
+
+FrameGraph::ResourceId FrameGraph::Import(const char* name)
+{
+	TransientDesc none = {};
+	ResourceId id = CreateTransient(name, none);
+	mResources[id].Transient = false;
+	return id;
+}
+
+FrameGraph::PassId FrameGraph::AddPass(const char* name, const PassFunction& execute)
+{
+	Pass pass;
+	pass.Name = name;
+	pass.Execute = execute;
+	pass.Culled = false;
+
+	mPasses.push_back(pass);
+	return (PassId)mPasses.size() - 1;
+}
+
+void FrameGraph::Read(PassId pass, ResourceId resource, Access access)
+{
+	Use use = { resource, access, false };
+	mPasses[pass].Uses.push_back(use);
+}
+
+void FrameGraph::Write(PassId pass, ResourceId resource, Access access)
+{
+	Use use = { resource, access, true };
+	mPasses[pass].Uses.push_back(use);
+}
+
+void FrameGraph::Compile()
+{
+	Cull();
+	ComputeLifetimes();
+	AssignPhysical();
+	PlaceInHeap();
+	ComputeTransitions();
+}
+
+void FrameGraph::Execute(const TransitionFunction& transition)const
+{
+	for (size_t i = 0; i < mPasses.size(); ++i)
+	{
+		const Pass& pass = mPasses[i];
+		if (pass.Culled)
+			continue;
+
+		if (transition)
+		{
+			for (size_t t = 0; t < pass.Transitions.size(); ++t)
+				transition(pass.Transitions[t]);
+		}
+
+		if (pass.Execute)
+			pass.Execute();
+	}
+}
+
+bool FrameGraph::IsCulled(PassId pass)const
+{
+	return mPasses[pass].Culled;
+}
+
+bool FrameGraph::IsTransient(ResourceId resource)const
+{
+	return mResources[resource].Transient;
+}
+
+unsigned int FrameGraph::Physical(ResourceId resource)const
+{
+	assert(mResources[resource].Transient && "Only transients are placed");
+	return mResources[resource].Physical;
+}
+
+FrameGraph::PassId FrameGraph::FirstUse(ResourceId resource)const
+{
+	return mResources[resource].FirstUse;
+}
+
+FrameGraph::PassId FrameGraph::LastUse(ResourceId resource)const
+{
+	return mResources[resource].LastUse;
+}
+
+uint64_t FrameGraph::HeapOffset(ResourceId resource)const
+{
+	return mResources[resource].HeapOffset;
+}
+
+const std::vector<FrameGraph::Transition>& FrameGraph::Transitions(PassId pass)const
+{
+	return mPasses[pass].Transitions;
+}
+
+void FrameGraph::Cull()
+{
+	// Walking back from the last pass, a resource is needed once a kept pass reads
+	// it; every earlier pass writing it is kept in turn.
+	std::vector<bool> needed(mResources.size(), false);
+
+	for (size_t i = mPasses.size(); i-- > 0; )
+	{
+		Pass& pass = mPasses[i];
+
+		bool keep = false;
+		for (size_t u = 0; u < pass.Uses.size() && !keep; ++u)
+		{
+			const Use& use = pass.Uses[u];
+			keep = use.Writes && (!mResources[use.Resource].Transient || needed[use.Resource]);
+		}
+
+		pass.Culled = !keep;
+		if (!keep)
+			continue;
+
+		for (size_t u = 0; u < pass.Uses.size(); ++u)
+		{
+			if (!pass.Uses[u].Writes)
+				needed[pass.Uses[u].Resource] = true;
+		}
+	}
+}
+
+void FrameGraph::ComputeLifetimes()
+{
+	PassId none = (PassId)mPasses.size();
+	for (size_t r = 0; r < mResources.size(); ++r)
+	{
+		mResources[r].FirstUse = none;
+		mResources[r].LastUse = 0;
+	}
+
+	for (PassId i = 0; i < mPasses.size(); ++i)
+	{
+		const Pass& pass = mPasses[i];
+		if (pass.Culled)
+			continue;
+
+		for (size_t u = 0; u < pass.Uses.size(); ++u)
+		{
+			Resource& resource = mResources[pass.Uses[u].Resource];
+			resource.FirstUse = std::min(resource.FirstUse, i);
+			resource.LastUse = std::max(resource.LastUse, i);
+		}
+	}
+}
+
+void FrameGraph::AssignPhysical()
+{
+	mPhysical.clear();
+
+	// Physical targets that are free again, by the pass after which they are.
+	std::vector<PassId> freeAfter;
+
+	// Transients in order of their first use, so each takes a target released by a
+	// transient that ended before it started.
+	std::vector<ResourceId> order;
+	for (ResourceId r = 0; r < mResources.size(); ++r)
+	{
+		if (mResources[r].Transient && mResources[r].FirstUse < mPasses.size())
+			order.push_back(r);
+	}
+	std::stable_sort(order.begin(), order.end(), [this](ResourceId a, ResourceId b)
+	{
+		return mResources[a].FirstUse < mResources[b].FirstUse;
+	});
+
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		Resource& resource = mResources[order[i]];
+
+		unsigned int physical = (unsigned int)mPhysical.size();
+		for (unsigned int p = 0; p < mPhysical.size(); ++p)
+		{
+			if (freeAfter[p] < resource.FirstUse && mPhysical[p] == resource.Desc)
+			{
+				physical = p;
+				break;
+			}
+		}
+
+		if (physical == mPhysical.size())
+		{
+			mPhysical.push_back(resource.Desc);
+			freeAfter.push_back(0);
+		}
+
+		resource.Physical = physical;
+		freeAfter[physical] = resource.LastUse;
+	}
+}
+
+void FrameGraph::PlaceInHeap()
+{
+	// Largest first, each at the lowest aligned offset that overlaps no placed
+	// transient alive at the same time.
+	std::vector<ResourceId> order;
+	for (ResourceId r = 0; r < mResources.size(); ++r)
+	{
+		if (mResources[r].Transient && mResources[r].FirstUse < mPasses.size())
+			order.push_back(r);
+	}
+	std::stable_sort(order.begin(), order.end(), [this](ResourceId a, ResourceId b)
+	{
+		return mResources[a].Desc.Bytes() > mResources[b].Desc.Bytes();
+	});
+
+	mHeapBytes = 0;
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		Resource& resource = mResources[order[i]];
+		uint64_t size = (resource.Desc.Bytes() + HeapAlignment - 1)/HeapAlignment*HeapAlignment;
+
+		// Candidate offsets are 0 and the ends of the placed transients.
+		uint64_t best = ~0ull;
+		for (size_t c = 0; c <= i; ++c)
+		{
+			uint64_t offset = 0;
+			if (c < i)
+			{
+				const Resource& other = mResources[order[c]];
+				offset = other.HeapOffset + (other.Desc.Bytes() + HeapAlignment - 1)/HeapAlignment*HeapAlignment;
+			}
+			if (offset >= best)
+				continue;
+
+			bool fits = true;
+			for (size_t o = 0; o < i && fits; ++o)
+			{
+				const Resource& other = mResources[order[o]];
+				bool liveTogether = other.FirstUse <= resource.LastUse && resource.FirstUse <= other.LastUse;
+				uint64_t otherEnd = other.HeapOffset + other.Desc.Bytes();
+				fits = !liveTogether || offset + size <= other.HeapOffset || otherEnd <= offset;
+			}
+
+			if (fits)
+				best = offset;
+		}
+
+		resource.HeapOffset = best;
+		mHeapBytes = std::max(mHeapBytes, best + size);
+	}
+}
+
+void FrameGraph::ComputeTransitions()
+{
+	// Transients start every frame undefined, since their memory may have held
+	// another transient; imported targets start where the last frame left them,
+	// which the graph doesn't know either.
+	std::vector<Access> state(mResources.size(), Undefined);
+
+	for (size_t i = 0; i < mPasses.size(); ++i)
+	{
+		Pass& pass = mPasses[i];
+		pass.Transitions.clear();
+		if (pass.Culled)
+			continue;
+
+		for (size_t u = 0; u < pass.Uses.size(); ++u)
+		{
+			const Use& use = pass.Uses[u];
+			if (state[use.Resource] == use.Mode)
+				continue;
+
+			Transition transition = { use.Resource, state[use.Resource], use.Mode };
+			pass.Transitions.push_back(transition);
+			state[use.Resource] = use.Mode;
+		}
+	}
+}
+
+FrameGraph::MemoryStats FrameGraph::Memory()const
+{
+	MemoryStats stats = {};
+	stats.PhysicalTargets = (unsigned int)mPhysical.size();
+	stats.Heap = mHeapBytes;
+
+	for (size_t r = 0; r < mResources.size(); ++r)
+	{
+		if (!mResources[r].Transient)
+			continue;
+
+		++stats.Transients;
+		stats.Unaliased += mResources[r].Desc.Bytes();
+	}
+
+	for (size_t p = 0; p < mPhysical.size(); ++p)
+		stats.Pooled += mPhysical[p].Bytes();
+
+	return stats;
+}
+
+std::string FrameGraph::Report()const
+{
+	std::string report;
+	char line[256];
+
+	for (size_t i = 0; i < mPasses.size(); ++i)
+	{
+		snprintf(line, sizeof(line), "pass %-24s %s\n", mPasses[i].Name, mPasses[i].Culled ? "culled" : "");
+		report += line;
+	}
+
+	for (size_t r = 0; r < mResources.size(); ++r)
+	{
+		const Resource& resource = mResources[r];
+		if (!resource.Transient)
+			continue;
+
+		if (resource.FirstUse >= mPasses.size())
+		{
+			snprintf(line, sizeof(line), "transient %-19s unused\n", resource.Name);
+		}
+		else
+		{
+			snprintf(line, sizeof(line), "transient %-19s passes %u-%u  target %u  heap offset %.2f MB  %.2f MB\n",
+				resource.Name, resource.FirstUse, resource.LastUse, resource.Physical,
+				resource.HeapOffset/(1024.0*1024.0), resource.Desc.Bytes()/(1024.0*1024.0));
+		}
+		report += line;
+	}
+
+	MemoryStats stats = Memory();
+	snprintf(line, sizeof(line), "%u transients: %.2f MB unaliased, %.2f MB in %u pooled targets, %.2f MB as one heap\n",
+		stats.Transients, stats.Unaliased/(1024.0*1024.0), stats.Pooled/(1024.0*1024.0), stats.PhysicalTargets,
+		stats.Heap/(1024.0*1024.0));
+	report += line;
+	return report;
+}
@@ -0,0 +1,172 @@
+//***************************************************************************************
+// FrameGraph.h
+//
+// The render passes of a frame and the targets they read and write. Targets that
+// only live within the frame are declared as transients with a description instead
+// of being created up front; targets that outlive it (the back buffer, the main
+// depth buffer) are imported.
+//
+// Compile
+//  - culls the passes whose output nothing uses: a pass is kept if it writes an
+//    imported target, or a transient a kept pass reads later,
+//  - finds the first and last kept pass that uses each transient,
+//  - places transients whose lifetimes don't overlap and whose descriptions match
+//    in the same physical target, so an API without placed resources can alias
+//    them too; the caller creates (or pools) one resource per physical target,
+//  - lists the state transitions every pass needs before it runs, in pass order.
+//
+// It also sizes the heap the transients would need if they could be placed at any
+// offset, as with placed resources, for the memory report.
+//
+// Nothing here knows the graphics API: formats and flags are opaque numbers that
+// only have to compare equal for two transients to share a target.
+//***************************************************************************************
+
+#ifndef FRAMEGRAPH_H
+#define FRAMEGRAPH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct TransientDesc
+{
+	unsigned int Width;
+	unsigned int Height;
+	unsigned int ArraySize;
+
+	// 0 for the full chain.
+	unsigned int MipLevels;
+
+	unsigned int Format;
+	unsigned int BytesPerTexel;
+	unsigned int BindFlags;
+	unsigned int MiscFlags;
+
+	// Size of every mip of every slice.
+	uint64_t Bytes()const;
+
+	bool operator==(const TransientDesc& rhs)const;
+	bool operator!=(const TransientDesc& rhs)const    { return !(*this == rhs); }
+};
+
+class FrameGraph
+{
+public:
+	typedef unsigned int ResourceId;
+	typedef unsigned int PassId;
+	typedef std::function<void()> PassFunction;
+
+	enum Access { Undefined, ShaderRead, RenderTargetWrite, DepthWrite };
+
+	struct Transition
+	{
+		ResourceId Resource;
+		Access Before;
+		Access After;
+	};
+
+	typedef std::function<void(const Transition&)> TransitionFunction;
+
+	struct MemoryStats
+	{
+		unsigned int Transients;
+		unsigned int PhysicalTargets;
+
+		// Every transient in its own target, what the demo allocated before.
+		uint64_t Unaliased;
+
+		// One target per physical target.
+		uint64_t Pooled;
+
+		// Transients placed at offsets in one heap.
+		uint64_t Heap;
+	};
+
+	// Placement alignment of the heap estimate.
+	static const uint64_t HeapAlignment = 64*1024;
+
+	FrameGraph();
+
+	// Drops every pass and resource, to describe a different frame.
+	void Reset();
+
+	ResourceId CreateTransient(const char* name, const TransientDesc& desc);
+	ResourceId Import(const char* name);
+
+	// Passes run in the order they are added.
+	PassId AddPass(const char* name, const PassFunction& execute);
+	void Read(PassId pass, ResourceId resource, Access access = ShaderRead);
+	void Write(PassId pass, ResourceId resource, Access access = RenderTargetWrite);
+
+	void Compile();
+
+	// Runs the kept passes in order, handing each pass's transitions to transition
+	// before the pass, if given.
+	void Execute(const TransitionFunction& transition = TransitionFunction())const;
+
+	bool IsCulled(PassId pass)const;
+	bool IsTransient(ResourceId resource)const;
+
+	// Compiled placement of a transient.
+	unsigned int Physical(ResourceId resource)const;
+	unsigned int PhysicalCount()const                     { return (unsigned int)mPhysical.size(); }
+	const TransientDesc& PhysicalDesc(unsigned int physical)const { return mPhysical[physical]; }
+
+	// Kept passes using the resource; the first is past the last if none does.
+	PassId FirstUse(ResourceId resource)const;
+	PassId LastUse(ResourceId resource)const;
+
+	uint64_t HeapOffset(ResourceId resource)const;
+
+	const std::vector<Transition>& Transitions(PassId pass)const;
+
+	MemoryStats Memory()const;
+
+	// Passes kept and culled, transients with their lifetimes and placement, and
+	// the memory stats.
+	std::string Report()const;
+
+private:
+	struct Use
+	{
+		ResourceId Resource;
+		Access Mode;
+		bool Writes;
+	};
+
+	struct Pass
+	{
+		const char* Name;
+		PassFunction Execute;
+		std::vector<Use> Uses;
+		std::vector<Transition> Transitions;
+		bool Culled;
+	};
+
+	struct Resource
+	{
+		const char* Name;
+		bool Transient;
+		TransientDesc Desc;
+
+		PassId FirstUse;
+		PassId LastUse;
+		unsigned int Physical;
+		uint64_t HeapOffset;
+	};
+
+	void Cull();
+	void ComputeLifetimes();
+	void AssignPhysical();
+	void PlaceInHeap();
+	void ComputeTransitions();
+
+	std::vector<Pass> mPasses;
+	std::vector<Resource> mResources;
+	std::vector<TransientDesc> mPhysical;
+	uint64_t mHeapBytes;
+};
+
+#endif // FRAMEGRAPH_H
@@ -0,0 +1,207 @@
+//***************************************************************************************
+// FrameMemory.cpp
+//***************************************************************************************
+
+#include "FrameMemory.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace
+{
+	char* AlignUp(char* p, size_t alignment)
+	{
+		uintptr_t address = reinterpret_cast<uintptr_t>(p);
+		return reinterpret_cast<char*>((address + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	}
+}
+
+#pragma region LinearArena
+LinearArena::LinearArena(size_t capacity)
+	: mBlock(0), mCapacity(capacity), mOffset(0), mOverflowBytes(0), mHighWater(0), mOverflows(0)
+{
+	if (mCapacity > 0)
+		mBlock = static_cast<char*>(malloc(mCapacity));
+
+	// Room for a few spills without growing the list while allocating.
+	mOverflow.reserve(16);
+}
+
+LinearArena::~LinearArena()
+{
+	for (size_t i = 0; i < mOverflow.size(); ++i)
+		free(mOverflow[i]);
+	free(mBlock);
+}
+
+void* LinearArena::Allocate(size_t size, size_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	// Reserving the worst case padding up front lets one add claim the range.
+	size_t reserved = size + alignment - 1;
+	size_t offset = mOffset.fetch_add(reserved, std::memory_order_relaxed);
+	if (offset + reserved <= mCapacity)
+		return AlignUp(mBlock + offset, alignment);
+
+	return AllocateOverflow(size, alignment);
+}
+
+void* LinearArena::AllocateOverflow(size_t size, size_t alignment)
+{
+	char* block = static_cast<char*>(malloc(size + alignment - 1));
+	if (!block)
+		return 0;
+
+	std::lock_guard<std::mutex> lock(mOverflowMutex);
+	mOverflow.push_back(block);
+	mOverflowBytes += size + alignment - 1;
+	return AlignUp(block, alignment);
+}
+
+void LinearArena::Reset()
+{
+	size_t used = Used();
+	if (used > mHighWater)
+		mHighWater = used;
+
+	if (!mOverflow.empty())
+	{
+		for (size_t i = 0; i < mOverflow.size(); ++i)
+			free(mOverflow[i]);
+		mOverflow.clear();
+		mOverflowBytes = 0;
+		++mOverflows;
+
+		// Grown to the most any round has needed, with room to spare, so the
+		// block is replaced a handful of times at most.
+		size_t capacity = mCapacity*2;
+		if (capacity < mHighWater + mHighWater/2)
+			capacity = mHighWater + mHighWater/2;
+
+		free(mBlock);
+		mBlock = static_cast<char*>(malloc(capacity));
+		mCapacity = mBlock ? capacity : 0;
+	}
+
+	mOffset.store(0, std::memory_order_relaxed);
+}
+
+size_t LinearArena::Used()const
+{
+	// Claims that overflowed also moved the offset past the end.
+	size_t offset = mOffset.load(std::memory_order_relaxed);
+	return (offset < mCapacity ? offset : mCapacity) + mOverflowBytes;
+}
+#pragma endregion
+
+#pragma region FrameArena
+FrameArena::FrameArena(size_t capacityPerFrame)
+	: mEven(capacityPerFrame), mOdd(capacityPerFrame), mCurrent(&mEven)
+{
+}
+
+void FrameArena::BeginFrame()
+{
+	mCurrent = mCurrent == &mEven ? &mOdd : &mEven;
+	mCurrent->Reset();
+}
+#pragma endregion
+
+#pragma region ScratchAllocator
+ScratchAllocator::ScratchAllocator(size_t blockSize)
+	: mBlockSize(blockSize), mCurrent(0), mOffset(0), mHighWater(0)
+{
+	assert(blockSize > 0);
+}
+
+ScratchAllocator::~ScratchAllocator()
+{
+	for (size_t i = 0; i < mBlocks.size(); ++i)
+		free(mBlocks[i].Data);
+}
+
+void* ScratchAllocator::Allocate(size_t size, size_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	size_t needed = size + alignment - 1;
+	if (mBlocks.empty() || mOffset + needed > mBlocks[mCurrent].Size)
+	{
+		// The next block is reused when it is large enough; otherwise a new one
+		// goes in its place, so a large request does not strand smaller blocks.
+		size_t next = mBlocks.empty() ? 0 : mCurrent + 1;
+		if (next == mBlocks.size() || mBlocks[next].Size < needed)
+		{
+			Block block;
+			block.Size = needed > mBlockSize ? needed : mBlockSize;
+			block.Data = static_cast<char*>(malloc(block.Size));
+			if (!block.Data)
+				return 0;
+			mBlocks.insert(mBlocks.begin() + next, block);
+		}
+
+		mCurrent = next;
+		mOffset = 0;
+	}
+
+	char* p = AlignUp(mBlocks[mCurrent].Data + mOffset, alignment);
+	mOffset = (p - mBlocks[mCurrent].Data) + size;
+
+	size_t used = Used();
+	if (used > mHighWater)
+		mHighWater = used;
+	return p;
+}
+
+ScratchAllocator::Marker ScratchAllocator::Mark()const
+{
+	Marker marker;
+	marker.Block = mCurrent;
+	marker.Offset = mOffset;
+	return marker;
+}
+
+void ScratchAllocator::Rewind(const Marker& marker)
+{
+	assert(marker.Block < mCurrent || (marker.Block == mCurrent && marker.Offset <= mOffset));
+
+	mCurrent = marker.Block;
+	mOffset = marker.Offset;
+}
+
+void ScratchAllocator::Trim()
+{
+	size_t keep = mBlocks.empty() ? 0 : mCurrent + 1;
+
+	// An empty allocator keeps nothing.
+	if (mCurrent == 0 && mOffset == 0)
+		keep = 0;
+
+	for (size_t i = keep; i < mBlocks.size(); ++i)
+		free(mBlocks[i].Data);
+	mBlocks.resize(keep);
+
+	if (mBlocks.empty())
+	{
+		std::vector<Block> none;
+		mBlocks.swap(none);
+	}
+}
+
+size_t ScratchAllocator::Used()const
+{
+	size_t used = mOffset;
+	for (size_t i = 0; i < mCurrent; ++i)
+		used += mBlocks[i].Size;
+	return used;
+}
+
+size_t ScratchAllocator::Reserved()const
+{
+	size_t reserved = 0;
+	for (size_t i = 0; i < mBlocks.size(); ++i)
+		reserved += mBlocks[i].Size;
+	return reserved;
+}
+#pragma endregion
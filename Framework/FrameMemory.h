@@ -0,0 +1,335 @@
+//***************************************************************************************
+// FrameMemory.h
+//
+// Allocators for memory whose lifetime is known up front, so it need not go through
+// the heap one block at a time:
+//
+// - LinearArena hands out memory by bumping an offset, from any thread, and takes
+//   it all back at once on Reset. A round that outgrows the block spills onto the
+//   heap; the next Reset grows the block to fit, so a steady load settles into
+//   no heap allocations at all.
+// - FrameArena is two linear arenas used on alternate frames. What a frame
+//   allocates stays valid through the next frame, long enough for jobs and uploads
+//   that finish a frame late.
+// - Pool<T> recycles fixed-size records (render targets, draw packets) through a
+//   free list, growing a chunk at a time.
+// - ScratchAllocator is a stack for load-time staging: Mark before building a mesh,
+//   Rewind once it is uploaded, Trim once loading is over.
+//
+// ArenaAllocator makes any of them a standard allocator, so staging vectors can
+// draw from them (FrameVector, StagingVector). Freeing through it returns nothing
+// to an arena; growing a vector there leaves its old buffer behind until the
+// arena is reset, so vectors in arenas are best sized once.
+//
+// Only LinearArena and FrameArena may be allocated from by several threads; Reset,
+// BeginFrame, Pool and ScratchAllocator are for one thread at a time.
+//***************************************************************************************
+
+#ifndef FRAMEMEMORY_H
+#define FRAMEMEMORY_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Enough for XMVECTOR and XMMATRIX.
+static const size_t DefaultArenaAlignment = 16;
+
+#pragma region LinearArena
+class LinearArena
+{
+public:
+	explicit LinearArena(size_t capacity);
+	~LinearArena();
+
+	// Thread-safe. Null only when the heap is exhausted.
+	void* Allocate(size_t size, size_t alignment = DefaultArenaAlignment);
+	void Deallocate(void*, size_t) {}
+
+	template<class T>
+	T* Allocate(size_t count)
+	{
+		return static_cast<T*>(Allocate(count*sizeof(T), std::alignment_of<T>::value > DefaultArenaAlignment ?
+			std::alignment_of<T>::value : DefaultArenaAlignment));
+	}
+
+	// Takes everything back. No allocation may be in flight.
+	void Reset();
+
+	size_t Used()const;
+	size_t Capacity()const                { return mCapacity; }
+	size_t HighWater()const               { return mHighWater; }
+
+	// Rounds that spilled onto the heap.
+	unsigned int Overflows()const         { return mOverflows; }
+
+private:
+	LinearArena(const LinearArena& rhs);
+	LinearArena& operator=(const LinearArena& rhs);
+
+	void* AllocateOverflow(size_t size, size_t alignment);
+
+	char* mBlock;
+	size_t mCapacity;
+	std::atomic<size_t> mOffset;
+
+	// Heap blocks of this round that did not fit.
+	std::mutex mOverflowMutex;
+	std::vector<void*> mOverflow;
+	size_t mOverflowBytes;
+
+	size_t mHighWater;
+	unsigned int mOverflows;
+};
+#pragma endregion
+
+#pragma region FrameArena
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t capacityPerFrame);
+
+	// Once a frame, before the frame allocates: takes back what the frame before
+	// last allocated.
+	void BeginFrame();
+
+	void* Allocate(size_t size, size_t alignment = DefaultArenaAlignment) { return Current().Allocate(size, alignment); }
+	void Deallocate(void*, size_t) {}
+
+	template<class T>
+	T* Allocate(size_t count)             { return Current().Allocate<T>(count); }
+
+	LinearArena& Current()                { return *mCurrent; }
+	const LinearArena& Current()const     { return *mCurrent; }
+	const LinearArena& Previous()const    { return mCurrent == &mEven ? mOdd : mEven; }
+
+private:
+	LinearArena mEven;
+	LinearArena mOdd;
+	LinearArena* mCurrent;
+};
+#pragma endregion
+
+#pragma region Pool
+template<class T>
+class Pool
+{
+public:
+	explicit Pool(size_t recordsPerChunk = 64)
+		: mFree(0), mLive(0), mChunkSize(recordsPerChunk)
+	{
+		assert(recordsPerChunk > 0);
+	}
+
+	// Records still live are not destroyed.
+	~Pool()
+	{
+		assert(mLive == 0 && "Records outlive their pool");
+		for (size_t i = 0; i < mChunks.size(); ++i)
+			delete[] mChunks[i];
+	}
+
+	template<class... Args>
+	T* Create(Args&&... args)
+	{
+		return new (Allocate()) T(std::forward<Args>(args)...);
+	}
+
+	void Destroy(T* record)
+	{
+		if (!record)
+			return;
+
+		record->~T();
+		Free(record);
+	}
+
+	// Uninitialized room for one record.
+	void* Allocate()
+	{
+		if (!mFree)
+			Grow();
+
+		Slot* slot = mFree;
+		mFree = slot->Next;
+		++mLive;
+		return slot;
+	}
+
+	void Free(void* p)
+	{
+		Slot* slot = static_cast<Slot*>(p);
+		slot->Next = mFree;
+		mFree = slot;
+		--mLive;
+	}
+
+	size_t Live()const                    { return mLive; }
+	size_t Capacity()const                { return mChunks.size()*mChunkSize; }
+
+private:
+	Pool(const Pool& rhs);
+	Pool& operator=(const Pool& rhs);
+
+	union Slot
+	{
+		Slot* Next;
+		typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type Storage;
+	};
+
+	void Grow()
+	{
+		Slot* chunk = new Slot[mChunkSize];
+		mChunks.push_back(chunk);
+
+		for (size_t i = mChunkSize; i-- > 0; )
+		{
+			chunk[i].Next = mFree;
+			mFree = &chunk[i];
+		}
+	}
+
+	std::vector<Slot*> mChunks;
+	Slot* mFree;
+	size_t mLive;
+	size_t mChunkSize;
+};
+#pragma endregion
+
+#pragma region ScratchAllocator
+class ScratchAllocator
+{
+public:
+	struct Marker
+	{
+		size_t Block;
+		size_t Offset;
+	};
+
+	explicit ScratchAllocator(size_t blockSize = 1 << 20);
+	~ScratchAllocator();
+
+	// Null only when the heap is exhausted.
+	void* Allocate(size_t size, size_t alignment = DefaultArenaAlignment);
+	void Deallocate(void*, size_t) {}
+
+	template<class T>
+	T* Allocate(size_t count)
+	{
+		return static_cast<T*>(Allocate(count*sizeof(T), std::alignment_of<T>::value > DefaultArenaAlignment ?
+			std::alignment_of<T>::value : DefaultArenaAlignment));
+	}
+
+	// Rewind takes back everything allocated since the mark.
+	Marker Mark()const;
+	void Rewind(const Marker& marker);
+
+	// Releases the blocks beyond the one in use.
+	void Trim();
+
+	size_t Used()const;
+	size_t Reserved()const;
+	size_t HighWater()const               { return mHighWater; }
+
+private:
+	ScratchAllocator(const ScratchAllocator& rhs);
+	ScratchAllocator& operator=(const ScratchAllocator& rhs);
+
+	struct Block
+	{
+		char* Data;
+		size_t Size;
+	};
+
+	std::vector<Block> mBlocks;
+	size_t mBlockSize;
+	size_t mCurrent;
+	size_t mOffset;
+	size_t mHighWater;
+};
+
+// Rewinds the scratch allocator to where it was when constructed.
+class ScopedScratch
+{
+public:
+	explicit ScopedScratch(ScratchAllocator& scratch) : mScratch(scratch), mMarker(scratch.Mark()) {}
+	~ScopedScratch()                      { mScratch.Rewind(mMarker); }
+
+private:
+	ScopedScratch(const ScopedScratch& rhs);
+	ScopedScratch& operator=(const ScopedScratch& rhs);
+
+	ScratchAllocator& mScratch;
+	ScratchAllocator::Marker mMarker;
+};
+#pragma endregion
+
+#pragma region ArenaAllocator
+// A standard allocator drawing from an arena; without one, from the heap.
+template<class T, class Arena>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	template<class U>
+	struct rebind
+	{
+		typedef ArenaAllocator<U, Arena> other;
+	};
+
+	explicit ArenaAllocator(Arena* arena = 0) : mArena(arena) {}
+
+	template<class U>
+	ArenaAllocator(const ArenaAllocator<U, Arena>& other) : mArena(other.GetArena()) {}
+
+	T* allocate(size_t count)
+	{
+		if (!mArena)
+			return static_cast<T*>(::operator new(count*sizeof(T)));
+
+		T* p = mArena->template Allocate<T>(count);
+		if (!p)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	void deallocate(T* p, size_t count)
+	{
+		if (!mArena)
+			::operator delete(p);
+		else
+			mArena->Deallocate(p, count*sizeof(T));
+	}
+
+	Arena* GetArena()const                { return mArena; }
+
+	template<class U>
+	bool operator==(const ArenaAllocator<U, Arena>& rhs)const { return mArena == rhs.GetArena(); }
+
+	template<class U>
+	bool operator!=(const ArenaAllocator<U, Arena>& rhs)const { return mArena != rhs.GetArena(); }
+
+private:
+	Arena* mArena;
+};
+
+template<class T>
+using FrameAllocator = ArenaAllocator<T, FrameArena>;
+
+template<class T>
+using FrameVector = std::vector<T, FrameAllocator<T> >;
+
+template<class T>
+using StagingAllocator = ArenaAllocator<T, ScratchAllocator>;
+
+template<class T>
+using StagingVector = std::vector<T, StagingAllocator<T> >;
+#pragma endregion
+
+#endif // FRAMEMEMORY_H
@@ -0,0 +1,49 @@
+//***************************************************************************************
+// GeometryArena.cpp
+//***************************************************************************************
+
+#include "GeometryArena.h"
+
+#include <cstdint>
+#include <new>
+
+StagingBlock::StagingBlock()
+	: mRaw(0), mData(0), mSize(0)
+{
+}
+
+StagingBlock::~StagingBlock()
+{
+	Free();
+}
+
+void StagingBlock::Allocate(size_t bytes, size_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	Free();
+
+	// Over-allocate and align by hand; an empty block still gets a valid pointer.
+	mRaw = ::operator new(bytes + alignment);
+	uintptr_t address = reinterpret_cast<uintptr_t>(mRaw);
+	mData = reinterpret_cast<unsigned char*>((address + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	mSize = bytes;
+}
+
+void StagingBlock::Free()
+{
+	::operator delete(mRaw);
+	mRaw = 0;
+	mData = 0;
+	mSize = 0;
+}
+
+unsigned char* StagingBlock::Data()const
+{
+	return mData;
+}
+
+size_t StagingBlock::Size()const
+{
+	return mSize;
+}
@@ -0,0 +1,251 @@
+//***************************************************************************************
+// GeometryArena.h
+//
+// Packs the meshes of a scene into one vertex and one index buffer. Meshes are added
+// first, either by moving their vertex and index vectors in or as counts and a
+// function that writes the mesh in place (e.g. MeshBuilder). Each Add hands back the
+// DrawRange to pass to DrawIndexed, so offsets are never computed by hand.
+//
+// Build then allocates one aligned staging block holding all vertices followed by all
+// indices, writes every mesh into it once and releases the vectors moved in. The
+// block is what the immutable buffers are created from.
+//
+// Per mesh, a Placement can align where its vertices and indices start, and rebase
+// its indices by the first vertex so it draws with a base vertex of 0.
+//***************************************************************************************
+
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+// What DrawIndexed(IndexCount, StartIndex, BaseVertex) draws. The vertex type only
+// ties a range to the arena it came from.
+template<class V>
+struct DrawRange
+{
+	DrawRange() : IndexCount(0), StartIndex(0), BaseVertex(0), FirstVertex(0), VertexCount(0) {}
+
+	unsigned int IndexCount;
+	unsigned int StartIndex;
+	int BaseVertex;
+
+	// Where the vertices of the mesh are in the vertex buffer. Equal to BaseVertex
+	// unless the indices were rebased.
+	unsigned int FirstVertex;
+	unsigned int VertexCount;
+};
+
+struct Placement
+{
+	Placement() : VertexAlignment(1), IndexAlignment(1), Rebase(false) {}
+
+	// In vertices and indices, not bytes.
+	unsigned int VertexAlignment;
+	unsigned int IndexAlignment;
+
+	// Add FirstVertex to every index and draw with a base vertex of 0.
+	bool Rebase;
+};
+
+// One aligned allocation. Not copyable.
+class StagingBlock
+{
+public:
+	StagingBlock();
+	~StagingBlock();
+
+	// Frees the previous block, if any. The new block is uninitialized.
+	void Allocate(size_t bytes, size_t alignment);
+	void Free();
+
+	unsigned char* Data()const;
+	size_t Size()const;
+
+private:
+	StagingBlock(const StagingBlock& rhs);
+	StagingBlock& operator=(const StagingBlock& rhs);
+
+	void* mRaw;
+	unsigned char* mData;
+	size_t mSize;
+};
+
+template<class V>
+class GeometryArena
+{
+public:
+	typedef std::function<void(V* vertices, unsigned int* indices)> FillFunction;
+
+	// Alignment of the staging block and of the index part within it.
+	static const size_t BlockAlignment = 16;
+
+	GeometryArena() : mVertexCount(0), mIndexCount(0), mIndexByteOffset(0), mBuilt(false) {}
+
+	// How many meshes will be added, to size the bookkeeping once.
+	void Reserve(size_t meshCount)
+	{
+		mMeshes.reserve(meshCount);
+	}
+
+	DrawRange<V> Add(std::vector<V>&& vertices, std::vector<unsigned int>&& indices,
+		const Placement& placement = Placement())
+	{
+		Mesh mesh;
+		mesh.Range = Place((unsigned int)vertices.size(), (unsigned int)indices.size(), placement);
+		mesh.Vertices.swap(vertices);
+		mesh.Indices.swap(indices);
+		mesh.Rebase = placement.Rebase;
+		mMeshes.push_back(std::move(mesh));
+		return mMeshes.back().Range;
+	}
+
+	// fill(vertices, indices) writes vertexCount vertices and indexCount indices
+	// relative to the first vertex during Build.
+	DrawRange<V> Add(unsigned int vertexCount, unsigned int indexCount, const FillFunction& fill,
+		const Placement& placement = Placement())
+	{
+		Mesh mesh;
+		mesh.Range = Place(vertexCount, indexCount, placement);
+		mesh.Fill = fill;
+		mesh.Rebase = placement.Rebase;
+		mMeshes.push_back(std::move(mesh));
+		return mMeshes.back().Range;
+	}
+
+	void Build()
+	{
+		assert(!mBuilt);
+
+		mIndexByteOffset = RoundUp(mVertexCount*sizeof(V), BlockAlignment);
+		mBlock.Allocate(mIndexByteOffset + mIndexCount*sizeof(unsigned int), BlockAlignment);
+
+		// Alignment padding is zeroed, everything else is written exactly once.
+		unsigned int vertexEnd = 0, indexEnd = 0;
+		for (size_t m = 0; m < mMeshes.size(); ++m)
+		{
+			Mesh& mesh = mMeshes[m];
+			const DrawRange<V>& range = mesh.Range;
+
+			memset(Vertices(vertexEnd), 0, (range.FirstVertex - vertexEnd)*sizeof(V));
+			memset(Indices(indexEnd), 0, (range.StartIndex - indexEnd)*sizeof(unsigned int));
+			vertexEnd = range.FirstVertex + range.VertexCount;
+			indexEnd = range.StartIndex + range.IndexCount;
+
+			V* vertices = Vertices(range.FirstVertex);
+			unsigned int* indices = Indices(range.StartIndex);
+			if (mesh.Fill)
+			{
+				mesh.Fill(vertices, indices);
+				mesh.Fill = FillFunction();
+			}
+			else
+			{
+				if (range.VertexCount > 0)
+					memcpy(vertices, &mesh.Vertices[0], range.VertexCount*sizeof(V));
+				if (range.IndexCount > 0)
+					memcpy(indices, &mesh.Indices[0], range.IndexCount*sizeof(unsigned int));
+				std::vector<V>().swap(mesh.Vertices);
+				std::vector<unsigned int>().swap(mesh.Indices);
+			}
+
+			if (mesh.Rebase)
+			{
+				for (unsigned int i = 0; i < range.IndexCount; ++i)
+					indices[i] += range.FirstVertex;
+			}
+		}
+		memset(Vertices(vertexEnd), 0, mIndexByteOffset - vertexEnd*sizeof(V));
+
+		mBuilt = true;
+	}
+
+	// The vertices and indices of a mesh in the staging block, after Build.
+	V* Vertices(const DrawRange<V>& range)const
+	{
+		assert(mBuilt);
+		return Vertices(range.FirstVertex);
+	}
+
+	unsigned int* Indices(const DrawRange<V>& range)const
+	{
+		assert(mBuilt);
+		return Indices(range.StartIndex);
+	}
+
+	const void* VertexData()const { return mBlock.Data(); }
+	size_t VertexBytes()const { return mVertexCount*sizeof(V); }
+	unsigned int VertexCount()const { return mVertexCount; }
+
+	const void* IndexData()const { return mBlock.Data() + mIndexByteOffset; }
+	size_t IndexBytes()const { return mIndexCount*sizeof(unsigned int); }
+	unsigned int IndexCount()const { return mIndexCount; }
+
+	// Frees the staging block once the buffers have been created from it.
+	void Release()
+	{
+		mBlock.Free();
+		std::vector<Mesh>().swap(mMeshes);
+	}
+
+private:
+	struct Mesh
+	{
+		DrawRange<V> Range;
+		std::vector<V> Vertices;
+		std::vector<unsigned int> Indices;
+		FillFunction Fill;
+		bool Rebase;
+	};
+
+	static size_t RoundUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1)/alignment*alignment;
+	}
+
+	DrawRange<V> Place(unsigned int vertexCount, unsigned int indexCount, const Placement& placement)
+	{
+		assert(!mBuilt);
+		assert(placement.VertexAlignment > 0 && placement.IndexAlignment > 0);
+
+		DrawRange<V> range;
+		range.FirstVertex = (unsigned int)RoundUp(mVertexCount, placement.VertexAlignment);
+		range.VertexCount = vertexCount;
+		range.StartIndex = (unsigned int)RoundUp(mIndexCount, placement.IndexAlignment);
+		range.IndexCount = indexCount;
+		range.BaseVertex = placement.Rebase ? 0 : (int)range.FirstVertex;
+
+		mVertexCount = range.FirstVertex + vertexCount;
+		mIndexCount = range.StartIndex + indexCount;
+		return range;
+	}
+
+	V* Vertices(unsigned int first)const
+	{
+		return reinterpret_cast<V*>(mBlock.Data()) + first;
+	}
+
+	unsigned int* Indices(unsigned int first)const
+	{
+		return reinterpret_cast<unsigned int*>(mBlock.Data() + mIndexByteOffset) + first;
+	}
+
+private:
+	GeometryArena(const GeometryArena& rhs);
+	GeometryArena& operator=(const GeometryArena& rhs);
+
+	std::vector<Mesh> mMeshes;
+
+	unsigned int mVertexCount;
+	unsigned int mIndexCount;
+	size_t mIndexByteOffset;
+	bool mBuilt;
+
+	StagingBlock mBlock;
+};
+
+#endif // GEOMETRYARENA_H
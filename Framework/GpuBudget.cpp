@@ -0,0 +1,234 @@
+//***************************************************************************************
+// GpuBudget.cpp
+//***************************************************************************************
+
+#include "GpuBudget.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+GpuBudget::GpuBudget()
+	: mFrame(0)
+{
+	memset(mUsage, 0, sizeof(mUsage));
+	memset(&mTotal, 0, sizeof(mTotal));
+	memset(mSnapshot, 0, sizeof(mSnapshot));
+
+	for (int i = 0; i < GpuSubsystemCount; ++i)
+		mDowngrades[i].Next = 0;
+}
+
+const char* GpuBudget::Name(GpuSubsystem subsystem)
+{
+	static const char* names[GpuSubsystemCount] = { "geometry", "textures", "renderTargets", "dynamic" };
+	return names[subsystem];
+}
+
+GpuBudget::AllocationId GpuBudget::Track(GpuSubsystem subsystem, const std::string& name, uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	AllocationId id;
+	if (mFreeIds.empty())
+	{
+		id = (AllocationId)mAllocations.size();
+		mAllocations.push_back(Allocation());
+	}
+	else
+	{
+		id = mFreeIds.back();
+		mFreeIds.pop_back();
+	}
+
+	Allocation& allocation = mAllocations[id];
+	allocation.Name = name;
+	allocation.Bytes = bytes;
+	allocation.Subsystem = subsystem;
+	allocation.Live = true;
+
+	Usage* usages[2] = { &mUsage[subsystem], &mTotal };
+	for (int i = 0; i < 2; ++i)
+	{
+		usages[i]->Live += bytes;
+		usages[i]->HighWater = std::max(usages[i]->HighWater, usages[i]->Live);
+		++usages[i]->Allocations;
+	}
+
+	return id;
+}
+
+void GpuBudget::Release(AllocationId id)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	Allocation& allocation = mAllocations[id];
+	assert(allocation.Live && "Allocation released twice");
+
+	Usage* usages[2] = { &mUsage[allocation.Subsystem], &mTotal };
+	for (int i = 0; i < 2; ++i)
+	{
+		usages[i]->Live -= allocation.Bytes;
+		--usages[i]->Allocations;
+	}
+
+	allocation.Live = false;
+	allocation.Name.clear();
+	mFreeIds.push_back(id);
+}
+
+void GpuBudget::SetBudget(GpuSubsystem subsystem, uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mUsage[subsystem].Budget = bytes;
+}
+
+void GpuBudget::SetTotalBudget(uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mTotal.Budget = bytes;
+}
+
+void GpuBudget::AddDowngrade(GpuSubsystem subsystem, const DowngradeFunction& downgrade)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mDowngrades[subsystem].Functions.push_back(downgrade);
+}
+
+void GpuBudget::EndFrame()
+{
+	bool downgraded[GpuSubsystemCount] = {};
+
+	for (int i = 0; i < GpuSubsystemCount; ++i)
+	{
+		GpuSubsystem subsystem = (GpuSubsystem)i;
+		if (OverBudget(subsystem))
+			downgraded[i] = Downgrade(subsystem);
+	}
+
+	if (OverTotalBudget())
+	{
+		// The largest subsystem that has something left and gave nothing this frame.
+		int order[GpuSubsystemCount];
+		for (int i = 0; i < GpuSubsystemCount; ++i)
+			order[i] = i;
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			std::sort(order, order + GpuSubsystemCount, [this](int a, int b) { return mUsage[a].Live > mUsage[b].Live; });
+		}
+
+		for (int i = 0; i < GpuSubsystemCount; ++i)
+		{
+			if (!downgraded[order[i]] && Downgrade((GpuSubsystem)order[i]))
+				break;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	memcpy(mSnapshot, mUsage, sizeof(mUsage));
+	mSnapshot[GpuSubsystemCount] = mTotal;
+	++mFrame;
+}
+
+bool GpuBudget::Downgrade(GpuSubsystem subsystem)
+{
+	// Called without the lock, so the downgrade can create and release resources.
+	Downgrades& downgrades = mDowngrades[subsystem];
+
+	while (downgrades.Next < downgrades.Functions.size())
+	{
+		if (downgrades.Functions[downgrades.Next]())
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			++mUsage[subsystem].Downgrades;
+			++mTotal.Downgrades;
+			return true;
+		}
+		++downgrades.Next;
+	}
+	return false;
+}
+
+GpuBudget::Usage GpuBudget::GetUsage(GpuSubsystem subsystem)const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mUsage[subsystem];
+}
+
+GpuBudget::Usage GpuBudget::Total()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mTotal;
+}
+
+bool GpuBudget::OverBudget(GpuSubsystem subsystem)const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mUsage[subsystem].Budget > 0 && mUsage[subsystem].Live > mUsage[subsystem].Budget;
+}
+
+bool GpuBudget::OverTotalBudget()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mTotal.Budget > 0 && mTotal.Live > mTotal.Budget;
+}
+
+std::string GpuBudget::Snapshot(unsigned int largest)const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	std::string json;
+	char line[512];
+
+	snprintf(line, sizeof(line), "{\n  \"frame\": %llu,\n  \"subsystems\": {", (unsigned long long)mFrame);
+	json += line;
+
+	for (int i = 0; i <= GpuSubsystemCount; ++i)
+	{
+		const Usage& usage = mSnapshot[i];
+		const char* name = i < GpuSubsystemCount ? Name((GpuSubsystem)i) : "total";
+
+		snprintf(line, sizeof(line),
+			"%s\n    \"%s\": {\"live\": %llu, \"highWater\": %llu, \"budget\": %llu, \"allocations\": %u, \"downgrades\": %u}",
+			i > 0 ? "," : "", name, (unsigned long long)usage.Live, (unsigned long long)usage.HighWater,
+			(unsigned long long)usage.Budget, usage.Allocations, usage.Downgrades);
+		json += line;
+	}
+	json += "\n  },\n  \"largest\": [";
+
+	std::vector<AllocationId> live;
+	for (AllocationId id = 0; id < mAllocations.size(); ++id)
+	{
+		if (mAllocations[id].Live)
+			live.push_back(id);
+	}
+
+	size_t count = std::min<size_t>(largest, live.size());
+	std::partial_sort(live.begin(), live.begin() + count, live.end(), [this](AllocationId a, AllocationId b)
+	{
+		return mAllocations[a].Bytes > mAllocations[b].Bytes;
+	});
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Allocation& allocation = mAllocations[live[i]];
+
+		// Debug names are file and variable names, so only quotes and backslashes
+		// need escaping.
+		std::string name;
+		for (size_t c = 0; c < allocation.Name.size(); ++c)
+		{
+			if (allocation.Name[c] == '"' || allocation.Name[c] == '\\')
+				name += '\\';
+			name += allocation.Name[c];
+		}
+
+		snprintf(line, sizeof(line), "%s\n    {\"name\": \"%s\", \"subsystem\": \"%s\", \"bytes\": %llu}",
+			i > 0 ? "," : "", name.c_str(), Name(allocation.Subsystem), (unsigned long long)allocation.Bytes);
+		json += line;
+	}
+	json += "\n  ]\n}\n";
+	return json;
+}
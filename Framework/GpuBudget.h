@@ -0,0 +1,122 @@
+//***************************************************************************************
+// GpuBudget.h
+//
+// Video memory accounting. Every buffer and texture an app creates is tracked with
+// the subsystem it belongs to and a debug name, from creation until it is
+// destroyed; the budget keeps live bytes and high-water marks per subsystem and in
+// total, and compares them against configurable limits.
+//
+// A subsystem that can make do with less (a coarser mesh, textures without their
+// top mip) registers a downgrade. EndFrame runs one downgrade of every subsystem
+// over its budget, and one of the largest subsystem while the total is over: one
+// step per frame, since the memory a downgrade frees may only be released once the
+// device lets go of it. Downgrades never run from inside Track or Release, so they
+// are free to create and release resources.
+//
+// EndFrame also takes a snapshot of the usage, which Snapshot writes as JSON.
+//
+// Nothing here knows the graphics API; the app computes the sizes of its resources
+// from their descriptions.
+//***************************************************************************************
+
+#ifndef GPUBUDGET_H
+#define GPUBUDGET_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum GpuSubsystem
+{
+	GeometryMemory,
+	TextureMemory,
+	RenderTargetMemory,
+	DynamicMemory,
+	GpuSubsystemCount
+};
+
+class GpuBudget
+{
+public:
+	typedef uint32_t AllocationId;
+
+	// Frees or shrinks something of its subsystem; returns false once it has
+	// nothing left to give.
+	typedef std::function<bool()> DowngradeFunction;
+
+	struct Usage
+	{
+		uint64_t Live;
+		uint64_t HighWater;
+
+		// 0 for none.
+		uint64_t Budget;
+
+		uint32_t Allocations;
+		uint32_t Downgrades;
+	};
+
+	GpuBudget();
+
+	static const char* Name(GpuSubsystem subsystem);
+
+	// Thread-safe. The id is only valid until it is released.
+	AllocationId Track(GpuSubsystem subsystem, const std::string& name, uint64_t bytes);
+	void Release(AllocationId id);
+
+	// 0 removes the budget.
+	void SetBudget(GpuSubsystem subsystem, uint64_t bytes);
+	void SetTotalBudget(uint64_t bytes);
+
+	// Downgrades of a subsystem run in the order they were added, one per frame.
+	void AddDowngrade(GpuSubsystem subsystem, const DowngradeFunction& downgrade);
+
+	// Once per frame, from the thread that renders.
+	void EndFrame();
+
+	Usage GetUsage(GpuSubsystem subsystem)const;
+	Usage Total()const;
+	bool OverBudget(GpuSubsystem subsystem)const;
+	bool OverTotalBudget()const;
+
+	// The usage at the last EndFrame, and the largest live allocations now.
+	std::string Snapshot(unsigned int largest = 16)const;
+
+private:
+	GpuBudget(const GpuBudget& rhs);
+	GpuBudget& operator=(const GpuBudget& rhs);
+
+	struct Allocation
+	{
+		std::string Name;
+		uint64_t Bytes;
+		GpuSubsystem Subsystem;
+		bool Live;
+	};
+
+	struct Downgrades
+	{
+		std::vector<DowngradeFunction> Functions;
+
+		// The next to try; those before it have nothing left.
+		size_t Next;
+	};
+
+	bool Downgrade(GpuSubsystem subsystem);
+
+	std::vector<Allocation> mAllocations;
+	std::vector<AllocationId> mFreeIds;
+
+	Usage mUsage[GpuSubsystemCount];
+	Usage mTotal;
+	Downgrades mDowngrades[GpuSubsystemCount];
+
+	Usage mSnapshot[GpuSubsystemCount + 1];
+	uint64_t mFrame;
+
+	mutable std::mutex mMutex;
+};
+
+#endif // GPUBUDGET_H
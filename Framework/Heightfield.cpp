@@ -0,0 +1,168 @@
+//***************************************************************************************
+// Heightfield.cpp
+//***************************************************************************************
+
+#include "Heightfield.h"
+
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define HEIGHTFIELD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// pi/2 in three parts, the first two exact in few bits, so that x - k*pi/2 loses
+	// nothing for the k that matter here (Cody and Waite).
+	const float HalfPi1 = 1.5703125f;
+	const float HalfPi2 = 4.837512969970703125e-4f;
+	const float HalfPi3 = 7.54978995489188216e-8f;
+	const float TwoOverPi = 0.636619772f;
+
+	// Minimax polynomials on [-pi/4, pi/4], from Cephes.
+	float SinPoly(float r, float r2)
+	{
+		return r + r*r2*((-1.9515295891e-4f*r2 + 8.3321608736e-3f)*r2 - 1.6666654611e-1f);
+	}
+
+	float CosPoly(float r2)
+	{
+		return 1.0f - 0.5f*r2 + r2*r2*((2.443315711809948e-5f*r2 - 1.388731625493765e-3f)*r2 + 4.166664568298827e-2f);
+	}
+
+	void ScalarSinCos(float x, float& s, float& c)
+	{
+		float k = floorf(x*TwoOverPi + 0.5f);
+		float r = ((x - k*HalfPi1) - k*HalfPi2) - k*HalfPi3;
+		float r2 = r*r;
+
+		float sinR = SinPoly(r, r2);
+		float cosR = CosPoly(r2);
+
+		// sin(r + q*pi/2) and cos(r + q*pi/2) for the quadrant q.
+		switch ((int)k & 3)
+		{
+		case 0: s =  sinR; c =  cosR; break;
+		case 1: s =  cosR; c = -sinR; break;
+		case 2: s = -sinR; c = -cosR; break;
+		default: s = -cosR; c = sinR; break;
+		}
+	}
+}
+
+void Heightfield::SinCos(const float* x, size_t count, float* s, float* c)
+{
+	size_t i = 0;
+#if defined(HEIGHTFIELD_SSE2)
+	const __m128 twoOverPi = _mm_set1_ps(TwoOverPi);
+	const __m128 halfPi1 = _mm_set1_ps(HalfPi1);
+	const __m128 halfPi2 = _mm_set1_ps(HalfPi2);
+	const __m128 halfPi3 = _mm_set1_ps(HalfPi3);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128i one32 = _mm_set1_epi32(1);
+	const __m128i two32 = _mm_set1_epi32(2);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 v = _mm_loadu_ps(x + i);
+
+		// cvtps rounds to nearest under the default rounding mode.
+		__m128i q = _mm_cvtps_epi32(_mm_mul_ps(v, twoOverPi));
+		__m128 k = _mm_cvtepi32_ps(q);
+
+		__m128 r = _mm_sub_ps(v, _mm_mul_ps(k, halfPi1));
+		r = _mm_sub_ps(r, _mm_mul_ps(k, halfPi2));
+		r = _mm_sub_ps(r, _mm_mul_ps(k, halfPi3));
+		__m128 r2 = _mm_mul_ps(r, r);
+
+		__m128 sinR = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), r2), _mm_set1_ps(8.3321608736e-3f));
+		sinR = _mm_add_ps(_mm_mul_ps(sinR, r2), _mm_set1_ps(-1.6666654611e-1f));
+		sinR = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), sinR));
+
+		__m128 cosR = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), r2), _mm_set1_ps(-1.388731625493765e-3f));
+		cosR = _mm_add_ps(_mm_mul_ps(cosR, r2), _mm_set1_ps(4.166664568298827e-2f));
+		cosR = _mm_add_ps(_mm_sub_ps(one, _mm_mul_ps(half, r2)), _mm_mul_ps(_mm_mul_ps(r2, r2), cosR));
+
+		// Odd quadrants swap sine and cosine; quadrants 2 and 3 negate the sine,
+		// quadrants 1 and 2 the cosine.
+		__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one32), one32));
+		__m128 sinSign = _mm_and_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two32), 30)), signBit);
+		__m128 cosSign = _mm_and_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one32), two32), 30)), signBit);
+
+		__m128 sinV = _mm_or_ps(_mm_and_ps(swap, cosR), _mm_andnot_ps(swap, sinR));
+		__m128 cosV = _mm_or_ps(_mm_and_ps(swap, sinR), _mm_andnot_ps(swap, cosR));
+
+		_mm_storeu_ps(s + i, _mm_xor_ps(sinV, sinSign));
+		_mm_storeu_ps(c + i, _mm_xor_ps(cosV, cosSign));
+	}
+#endif
+	for (; i < count; ++i)
+		ScalarSinCos(x[i], s[i], c[i]);
+}
+
+void Heightfield::Normals(const float* dfdx, const float* dfdz, size_t count, float* nx, float* ny, float* nz)
+{
+	size_t i = 0;
+#if defined(HEIGHTFIELD_SSE2)
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_sub_ps(zero, _mm_loadu_ps(dfdx + i));
+		__m128 z = _mm_sub_ps(zero, _mm_loadu_ps(dfdz + i));
+		__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), one), _mm_mul_ps(z, z))));
+
+		_mm_storeu_ps(nx + i, _mm_mul_ps(x, invLength));
+		_mm_storeu_ps(ny + i, invLength);
+		_mm_storeu_ps(nz + i, _mm_mul_ps(z, invLength));
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		float invLength = 1.0f/sqrtf(dfdx[i]*dfdx[i] + 1.0f + dfdz[i]*dfdz[i]);
+		nx[i] = -dfdx[i]*invLength;
+		ny[i] = invLength;
+		nz[i] = -dfdz[i]*invLength;
+	}
+}
+
+void Heightfield::Hills::operator()(const Span& span)const
+{
+	HEIGHTFIELD_ALIGN16 float ax[ChunkSize], az[ChunkSize];
+	HEIGHTFIELD_ALIGN16 float sinX[ChunkSize], cosX[ChunkSize];
+	HEIGHTFIELD_ALIGN16 float sinZ[ChunkSize], cosZ[ChunkSize];
+
+	for (size_t first = 0; first < span.Count; first += ChunkSize)
+	{
+		size_t count = std::min(ChunkSize, span.Count - first);
+		const float* x = span.X + first;
+		const float* z = span.Z + first;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			ax[i] = 0.1f*x[i];
+			az[i] = 0.1f*z[i];
+		}
+
+		SinCos(ax, count, sinX, cosX);
+		SinCos(az, count, sinZ, cosZ);
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			span.Height[first + i] = 0.3f*(z[i]*sinX[i] + x[i]*cosZ[i]);
+			span.DfDx[first + i] = 0.03f*z[i]*cosX[i] + 0.3f*cosZ[i];
+			span.DfDz[first + i] = 0.3f*sinX[i] - 0.03f*x[i]*sinZ[i];
+		}
+	}
+}
+
+void Heightfield::Hills::Evaluate(float x, float z, float& height, float& dfdx, float& dfdz)
+{
+	height = 0.3f*(z*sinf(0.1f*x) + x*cosf(0.1f*z));
+	dfdx = 0.03f*z*cosf(0.1f*x) + 0.3f*cosf(0.1f*z);
+	dfdz = 0.3f*sinf(0.1f*x) - 0.03f*x*sinf(0.1f*z);
+}
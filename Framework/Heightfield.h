@@ -0,0 +1,168 @@
+//***************************************************************************************
+// Heightfield.h
+//
+// Heights and normals of meshes lying on a height function y = f(x, z), evaluated a
+// chunk of vertices at a time instead of one call per vertex.
+//
+// A height function is a functor taking a Span: the x and z of a run of points, one
+// array per component, and arrays to write f, df/dx and df/dz to. Functors can
+// build on SinCos, which evaluates sine and cosine four at a time with SSE2
+// polynomial approximations; PointFunction adapts a functor for a single point.
+// Hills is the hill function of the book's demos.
+//
+// Evaluate transposes the vertices of a mesh into chunks, calls the functor on each
+// chunk, turns the gradients into unit normals (-df/dx, 1, -df/dz) and writes them
+// back. Chunks are spread over a job system when one is given.
+//***************************************************************************************
+
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#if defined(_MSC_VER)
+#define HEIGHTFIELD_ALIGN16 __declspec(align(16))
+#else
+#define HEIGHTFIELD_ALIGN16 __attribute__((aligned(16)))
+#endif
+
+namespace Heightfield
+{
+	// A run of points for a height function, which reads X and Z and writes Height,
+	// DfDx and DfDz for each of the Count points.
+	struct Span
+	{
+		const float* X;
+		const float* Z;
+		size_t Count;
+
+		float* Height;
+		float* DfDx;
+		float* DfDz;
+	};
+
+	// sin(x[i]) and cos(x[i]) for a run of values, accurate to a few ulps for |x| up
+	// to a few thousand.
+	void SinCos(const float* x, size_t count, float* s, float* c);
+
+	// (-dfdx, 1, -dfdz) normalized, one array per component.
+	void Normals(const float* dfdx, const float* dfdz, size_t count, float* nx, float* ny, float* nz);
+
+	// y = 0.3*(z*sin(0.1*x) + x*cos(0.1*z))
+	struct Hills
+	{
+		void operator()(const Span& span)const;
+
+		// One point with the C library's sinf and cosf, for checking the batch version.
+		static void Evaluate(float x, float z, float& height, float& dfdx, float& dfdz);
+	};
+
+	// Adapts a functor f(x, z, height, dfdx, dfdz) that evaluates one point.
+	template<class F>
+	struct PointFunction
+	{
+		explicit PointFunction(const F& function) : Function(function) {}
+
+		void operator()(const Span& span)const
+		{
+			for (size_t i = 0; i < span.Count; ++i)
+				Function(span.X[i], span.Z[i], span.Height[i], span.DfDx[i], span.DfDz[i]);
+		}
+
+		F Function;
+	};
+
+	template<class F>
+	PointFunction<F> MakePointFunction(const F& function)
+	{
+		return PointFunction<F>(function);
+	}
+
+	// Positions are read as three floats Stride bytes apart. With WriteHeights the
+	// height replaces the y of each position; normals are written as three floats
+	// NormalStride bytes apart unless Normals is null.
+	struct Mesh
+	{
+		Mesh() : Positions(0), Stride(0), Count(0), WriteHeights(false), Normals(0), NormalStride(0) {}
+
+		float* Positions;
+		size_t Stride;
+		size_t Count;
+
+		bool WriteHeights;
+
+		float* Normals;
+		size_t NormalStride;
+	};
+
+	static const size_t ChunkSize = 256;
+
+	template<class F>
+	void EvaluateChunk(const F& function, const Mesh& mesh, size_t first)
+	{
+		size_t count = std::min(ChunkSize, mesh.Count - first);
+
+		HEIGHTFIELD_ALIGN16 float x[ChunkSize];
+		HEIGHTFIELD_ALIGN16 float z[ChunkSize];
+		for (size_t i = 0; i < count; ++i)
+		{
+			const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(mesh.Positions) + (first + i)*mesh.Stride);
+			x[i] = p[0];
+			z[i] = p[2];
+		}
+
+		HEIGHTFIELD_ALIGN16 float height[ChunkSize];
+
+		// Zeroed so that the compiler, which cannot see the functor's writes through
+		// the span, knows Normals reads no uninitialized gradient.
+		HEIGHTFIELD_ALIGN16 float dfdx[ChunkSize] = {};
+		HEIGHTFIELD_ALIGN16 float dfdz[ChunkSize] = {};
+
+		Span span = { x, z, count, height, dfdx, dfdz };
+		function(span);
+
+		if (mesh.WriteHeights)
+		{
+			for (size_t i = 0; i < count; ++i)
+				reinterpret_cast<float*>(reinterpret_cast<char*>(mesh.Positions) + (first + i)*mesh.Stride)[1] = height[i];
+		}
+
+		if (mesh.Normals)
+		{
+			HEIGHTFIELD_ALIGN16 float n[3][ChunkSize];
+			Normals(dfdx, dfdz, count, n[0], n[1], n[2]);
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				float* out = reinterpret_cast<float*>(reinterpret_cast<char*>(mesh.Normals) + (first + i)*mesh.NormalStride);
+				out[0] = n[0][i];
+				out[1] = n[1][i];
+				out[2] = n[2][i];
+			}
+		}
+	}
+
+	template<class F>
+	void Evaluate(const F& function, const Mesh& mesh, JobSystem* jobs = 0)
+	{
+		size_t chunks = (mesh.Count + ChunkSize - 1)/ChunkSize;
+
+		if (jobs == 0)
+		{
+			for (size_t i = 0; i < chunks; ++i)
+				EvaluateChunk(function, mesh, i*ChunkSize);
+			return;
+		}
+
+		jobs->ParallelFor(0, chunks, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+				EvaluateChunk(function, mesh, i*ChunkSize);
+		});
+	}
+}
+
+#endif // HEIGHTFIELD_H
@@ -0,0 +1,338 @@
+//***************************************************************************************
+// JobSystem.cpp
+//***************************************************************************************
+
+#include "JobSystem.h"
+
+#include <cassert>
+
+namespace
+{
+	// The system whose worker runs on this thread, if any, and the worker's index.
+	thread_local const JobSystem* tSystem = 0;
+	thread_local unsigned int tThreadIndex = 0;
+}
+
+#pragma region WorkDeque
+// The deque follows "Correct and Efficient Work-Stealing for Weak Memory Models"
+// (Le et al. 2013), without growing: the capacity equals the job pool size, so a
+// thread can never have more jobs queued than fit.
+JobSystem::WorkDeque::WorkDeque(unsigned int capacity)
+	: mJobs(capacity), mMask(capacity - 1), mTop(0), mBottom(0)
+{
+	assert((capacity & (capacity - 1)) == 0 && "Capacity must be a power of two");
+}
+
+void JobSystem::WorkDeque::Push(Job* job)
+{
+	// Every queued job holds a pool slot, so the deque cannot fill up.
+	int64_t b = mBottom.load(std::memory_order_relaxed);
+	assert(b - mTop.load(std::memory_order_relaxed) <= mMask && "Work deque overflow");
+
+	mJobs[b & mMask].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	mBottom.store(b + 1, std::memory_order_relaxed);
+}
+
+JobSystem::Job* JobSystem::WorkDeque::Pop()
+{
+	int64_t b = mBottom.load(std::memory_order_relaxed) - 1;
+	mBottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = mTop.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		// Empty.
+		mBottom.store(b + 1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	Job* job = mJobs[b & mMask].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// Last job: race the thieves for it.
+		if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = 0;
+		mBottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+JobSystem::Job* JobSystem::WorkDeque::Steal()
+{
+	int64_t t = mTop.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = mBottom.load(std::memory_order_acquire);
+
+	if (t >= b)
+		return 0;
+
+	Job* job = mJobs[t & mMask].load(std::memory_order_relaxed);
+	if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return 0;
+
+	return job;
+}
+
+#pragma endregion
+
+#pragma region JobSystem
+JobSystem::JobSystem(unsigned int workerCount)
+	: mOwner(std::this_thread::get_id()), mQueued(0), mSleepers(0), mQuit(false)
+{
+	if (workerCount == 0)
+	{
+		unsigned int hardware = std::thread::hardware_concurrency();
+		workerCount = hardware > 1 ? hardware - 1 : 1;
+	}
+
+	// Worker 0 is the creating thread, 1..N are the threads started here.
+	for (unsigned int i = 0; i <= workerCount; ++i)
+		mWorkers.push_back(new Worker());
+
+	for (unsigned int i = 1; i <= workerCount; ++i)
+		mThreads.push_back(std::thread(&JobSystem::WorkerMain, this, i));
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+
+	for (size_t i = 0; i < mThreads.size(); ++i)
+		mThreads[i].join();
+
+	for (size_t i = 0; i < mWorkers.size(); ++i)
+		delete mWorkers[i];
+}
+
+unsigned int JobSystem::ThreadIndex()const
+{
+	if (tSystem == this)
+		return tThreadIndex;
+
+	assert(std::this_thread::get_id() == mOwner && "Jobs can only be used from the owning thread or a worker");
+	return 0;
+}
+
+JobSystem::Job* JobSystem::Allocate()
+{
+	unsigned int index = ThreadIndex();
+	Worker& worker = *mWorkers[index];
+
+	// A slot comes around again after JobPoolSize allocations. One whose job is
+	// still in flight is passed over; when all of them are, this thread runs queued
+	// jobs until one finishes.
+	for (;;)
+	{
+		for (unsigned int i = 0; i < JobPoolSize; ++i)
+		{
+			Job* job = &worker.Pool[worker.NextJob++ & (JobPoolSize - 1)];
+			if (job->Unfinished.load(std::memory_order_acquire) == 0)
+				return job;
+		}
+
+		if (!TryRun(index))
+			std::this_thread::yield();
+	}
+}
+
+JobSystem::Job* JobSystem::CreateJob(const JobFunction& function)
+{
+	Job* job = Allocate();
+	job->Function = function;
+	job->Range = 0;
+	job->Parent = 0;
+	job->Counter = 0;
+	job->Unfinished.store(1, std::memory_order_relaxed);
+
+	return job;
+}
+
+JobSystem::Job* JobSystem::CreateChild(Job* parent, const JobFunction& function)
+{
+	parent->Unfinished.fetch_add(1, std::memory_order_relaxed);
+
+	Job* job = CreateJob(function);
+	job->Parent = parent;
+
+	return job;
+}
+
+void JobSystem::Run(Job* job)
+{
+	mWorkers[ThreadIndex()]->Deque.Push(job);
+	mQueued.fetch_add(1, std::memory_order_seq_cst);
+
+	// A worker raises mSleepers before it checks mQueued under the sleep mutex, so
+	// either it sees the new job or we see it and wake it through the mutex. The
+	// mutex is only taken while someone sleeps.
+	if (mSleepers.load(std::memory_order_seq_cst) > 0)
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mWake.notify_one();
+	}
+}
+
+bool JobSystem::IsFinished(const Job* job)const
+{
+	return job->Unfinished.load(std::memory_order_acquire) == 0;
+}
+
+void JobSystem::Wait(const Job* job)
+{
+	unsigned int index = ThreadIndex();
+
+	while (!IsFinished(job))
+	{
+		if (!TryRun(index))
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::Submit(const JobFunction& function, JobCounter* counter)
+{
+	Job* job = CreateJob(function);
+
+	if (counter)
+	{
+		counter->mPending.fetch_add(1, std::memory_order_relaxed);
+		job->Counter = counter;
+	}
+
+	Run(job);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	unsigned int index = ThreadIndex();
+
+	while (!counter.Done())
+	{
+		if (!TryRun(index))
+			std::this_thread::yield();
+	}
+}
+
+bool JobSystem::RunPending()
+{
+	return TryRun(ThreadIndex());
+}
+
+void JobSystem::ParallelFor(size_t begin, size_t end, const RangeFunction& func, size_t grain)
+{
+	if (begin >= end)
+		return;
+
+	if (grain == 0)
+	{
+		grain = (end - begin) / (ThreadCount() * 8);
+		if (grain == 0)
+			grain = 1;
+	}
+
+	if (end - begin <= grain)
+	{
+		func(begin, end);
+		return;
+	}
+
+	// The root only gathers the range jobs; this thread runs the first half itself
+	// and helps with the rest while waiting.
+	Job* root = CreateJob(JobFunction());
+	SplitRange(root, begin, end, &func, grain);
+	Finish(root);
+	Wait(root);
+}
+
+void JobSystem::SplitRange(Job* root, size_t begin, size_t end, const RangeFunction* func, size_t grain)
+{
+	// Hand off the upper halves and keep the lowest chunk. A thief that takes an
+	// upper half splits it further the same way, so the range spreads out in
+	// log(n) steps instead of one thread queueing every chunk.
+	while (end - begin > grain)
+	{
+		size_t middle = begin + (end - begin) / 2;
+		Job* half = CreateChild(root, JobFunction());
+		half->Range = func;
+		half->Begin = middle;
+		half->End = end;
+		half->Grain = grain;
+		Run(half);
+		end = middle;
+	}
+
+	(*func)(begin, end);
+}
+
+void JobSystem::Execute(Job* job)
+{
+	mQueued.fetch_sub(1, std::memory_order_relaxed);
+
+	if (job->Range)
+		SplitRange(job->Parent, job->Begin, job->End, job->Range, job->Grain);
+	else if (job->Function)
+		job->Function();
+
+	Finish(job);
+}
+
+void JobSystem::Finish(Job* job)
+{
+	// Read the links first: once the count drops to zero the owner may reuse the slot.
+	Job* parent = job->Parent;
+	JobCounter* counter = job->Counter;
+
+	if (job->Unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	if (counter)
+		counter->mPending.fetch_sub(1, std::memory_order_release);
+
+	if (parent)
+		Finish(parent);
+}
+
+void JobSystem::WorkerMain(unsigned int index)
+{
+	tSystem = this;
+	tThreadIndex = index;
+
+	for (;;)
+	{
+		if (TryRun(index))
+			continue;
+
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mSleepers.fetch_add(1, std::memory_order_seq_cst);
+		mWake.wait(lock, [this]() { return mQuit || mQueued.load(std::memory_order_seq_cst) > 0; });
+		mSleepers.fetch_sub(1, std::memory_order_relaxed);
+
+		if (mQuit)
+			return;
+	}
+}
+
+bool JobSystem::TryRun(unsigned int index)
+{
+	// Own jobs newest first: they are the most likely to still be in this core's
+	// cache. Stolen jobs oldest first, which leaves the owner the work it queued last
+	// and hands thieves the biggest pieces of a split range.
+	Job* job = mWorkers[index]->Deque.Pop();
+
+	unsigned int count = (unsigned int)mWorkers.size();
+	for (unsigned int i = 1; !job && i < count; ++i)
+		job = mWorkers[(index + i) % count]->Deque.Steal();
+
+	if (!job)
+		return false;
+
+	Execute(job);
+	return true;
+}
+#pragma endregion
@@ -0,0 +1,176 @@
+//***************************************************************************************
+// JobSystem.h
+//
+// Work-stealing job scheduler. Every thread owns a lock-free Chase-Lev deque: the
+// owner pushes and pops at the bottom, newest first, and idle threads steal the
+// oldest job from the top of someone else's deque. Threads that wait on a job or
+// a JobCounter keep running jobs meanwhile, so the submitting thread takes part
+// in the work instead of blocking.
+//
+// A job can be created as the child of another; the parent only counts as
+// finished once all of its children have finished, so waiting on a parent waits
+// on the whole tree. ParallelFor builds such a tree by splitting its range.
+//
+// Only the thread that created the system and its own workers may create and
+// submit jobs, since each deque has a single owner.
+//***************************************************************************************
+
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#pragma region JobCounter
+// Counts the unfinished jobs of one batch. Must outlive the jobs it counts.
+class JobCounter
+{
+public:
+	JobCounter() : mPending(0) {}
+
+	bool Done()const                       { return mPending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	JobCounter(const JobCounter& rhs);
+	JobCounter& operator=(const JobCounter& rhs);
+
+	std::atomic<int> mPending;
+};
+#pragma endregion
+
+#pragma region JobSystem
+class JobSystem
+{
+public:
+	typedef std::function<void()> JobFunction;
+	typedef std::function<void(size_t begin, size_t end)> RangeFunction;
+
+	struct Job;
+
+	// Jobs come from a ring of this many per thread. A thread with this many jobs
+	// in flight waits for one of them to finish before it creates another, running
+	// queued jobs meanwhile; jobs created but not run yet cannot finish, so there
+	// must never be this many of those.
+	static const unsigned int JobPoolSize = 4096;
+
+	// workerCount 0 picks one worker per hardware thread besides the calling one.
+	explicit JobSystem(unsigned int workerCount = 0);
+	~JobSystem();
+
+	// Creates a job without queueing it. A child keeps its parent unfinished until
+	// the child has run; it must be created before the parent finishes, i.e. by
+	// the parent itself or before the parent is queued.
+	Job* CreateJob(const JobFunction& function);
+	Job* CreateChild(Job* parent, const JobFunction& function);
+
+	void Run(Job* job);
+
+	// Runs queued jobs until the job and all of its children have finished.
+	void Wait(const Job* job);
+	bool IsFinished(const Job* job)const;
+
+	// Queues a job on the calling thread's deque. The counter, if any, is
+	// decremented once the job has run.
+	void Submit(const JobFunction& function, JobCounter* counter = 0);
+
+	// Runs queued jobs until every job counted by the counter has finished.
+	void Wait(JobCounter& counter);
+
+	// Runs one queued job, if there is one; returns false if there was none. For
+	// threads that wait on something other than a job.
+	bool RunPending();
+
+	// Calls func on disjoint subranges covering [begin, end) and returns once all
+	// have run. Ranges are split in halves down to the grain; grain 0 picks one
+	// that gives every thread about eight chunks, which leaves room to rebalance
+	// through stealing without paying for a job per element.
+	void ParallelFor(size_t begin, size_t end, const RangeFunction& func, size_t grain = 0);
+
+	// Worker threads plus the thread that created the system.
+	unsigned int ThreadCount()const        { return (unsigned int)mThreads.size() + 1; }
+
+	// Index of the calling thread in this system: 0 for the creating thread, 1..N
+	// for the workers.
+	unsigned int ThreadIndex()const;
+
+private:
+	JobSystem(const JobSystem& rhs);
+	JobSystem& operator=(const JobSystem& rhs);
+
+	// Chase-Lev deque of job pointers with a fixed capacity. Push and Pop may only
+	// be called by the owning thread, Steal by any thread.
+	class WorkDeque
+	{
+	public:
+		explicit WorkDeque(unsigned int capacity);
+
+		void Push(Job* job);
+		Job* Pop();
+		Job* Steal();
+
+	private:
+		std::vector<std::atomic<Job*> > mJobs;
+		int64_t mMask;
+		std::atomic<int64_t> mTop;
+		std::atomic<int64_t> mBottom;
+	};
+
+	struct Worker
+	{
+		Worker() : Deque(JobPoolSize), Pool(JobPoolSize), NextJob(0) {}
+
+		WorkDeque Deque;
+		std::vector<Job> Pool;
+		unsigned int NextJob;
+	};
+
+	Job* Allocate();
+	void Execute(Job* job);
+	void Finish(Job* job);
+
+	void WorkerMain(unsigned int index);
+
+	// Pops a job of the given thread or steals one; returns false if none was found.
+	bool TryRun(unsigned int index);
+
+	void SplitRange(Job* parent, size_t begin, size_t end, const RangeFunction* func, size_t grain);
+
+	std::vector<Worker*> mWorkers;
+	std::vector<std::thread> mThreads;
+	std::thread::id mOwner;
+
+	std::atomic<int> mQueued;
+	std::atomic<int> mSleepers;
+	std::atomic<bool> mQuit;
+	std::mutex mSleepMutex;
+	std::condition_variable mWake;
+};
+
+struct JobSystem::Job
+{
+	Job() : Range(0), Begin(0), End(0), Grain(0), Parent(0), Counter(0), Unfinished(0) {}
+
+	JobFunction Function;
+
+	// Set instead of Function on the pieces ParallelFor splits its range into, so
+	// they need no closure that std::function would have to allocate for.
+	const RangeFunction* Range;
+	size_t Begin;
+	size_t End;
+	size_t Grain;
+
+	Job* Parent;
+	JobCounter* Counter;
+	std::atomic<int> Unfinished;	// this job plus its unfinished children
+};
+#pragma endregion
+
+#endif // JOBSYSTEM_H
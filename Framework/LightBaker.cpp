@@ -0,0 +1,299 @@
+//***************************************************************************************
+// LightBaker.cpp
+//***************************************************************************************
+
+#include "LightBaker.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(_MSC_VER)
+#define LIGHTBAKER_ALIGN64 __declspec(align(64))
+#else
+#define LIGHTBAKER_ALIGN64 __attribute__((aligned(64)))
+#endif
+
+namespace
+{
+	// Rows of the upper 3x3 of the world matrix and of its inverse transpose, which
+	// takes normals to world space.
+	struct SurfaceTransform
+	{
+		explicit SurfaceTransform(const float* world)
+		{
+			static const float identity[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+			if (world == 0)
+				world = identity;
+
+			for (int i = 0; i < 4; ++i)
+			{
+				for (int j = 0; j < 3; ++j)
+					M[i][j] = world[i*4 + j];
+			}
+
+			// The inverse of a matrix with rows r0, r1, r2 has the columns
+			// r1 x r2, r2 x r0 and r0 x r1 over the determinant, so those are the rows
+			// of the inverse transpose.
+			for (int i = 0; i < 3; ++i)
+			{
+				const float* a = M[(i + 1) % 3];
+				const float* b = M[(i + 2) % 3];
+				N[i][0] = a[1]*b[2] - a[2]*b[1];
+				N[i][1] = a[2]*b[0] - a[0]*b[2];
+				N[i][2] = a[0]*b[1] - a[1]*b[0];
+			}
+
+			float det = M[0][0]*N[0][0] + M[0][1]*N[0][1] + M[0][2]*N[0][2];
+			for (int i = 0; i < 3; ++i)
+			{
+				for (int j = 0; j < 3; ++j)
+					N[i][j] /= det;
+			}
+		}
+
+		void Transform(const float* position, const float* normal, float worldPos[3], float worldNormal[3])const
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				worldPos[j] = position[0]*M[0][j] + position[1]*M[1][j] + position[2]*M[2][j] + M[3][j];
+				worldNormal[j] = normal[0]*N[0][j] + normal[1]*N[1][j] + normal[2]*N[2][j];
+			}
+		}
+
+		float M[4][3];
+		float N[3][3];
+	};
+
+	const float* Element(const float* base, size_t stride, size_t index)
+	{
+		return reinterpret_cast<const float*>(reinterpret_cast<const char*>(base) + stride*index);
+	}
+
+	float* Element(float* base, size_t stride, size_t index)
+	{
+		return reinterpret_cast<float*>(reinterpret_cast<char*>(base) + stride*index);
+	}
+}
+
+LightBaker::Surface::Surface()
+	: Positions(0), Normals(0), Stride(0), Count(0), World(0), Colors(0), ColorStride(0)
+{
+	LightModel::Material black = { { 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 } };
+	Material = black;
+}
+
+LightBaker::LightBaker()
+	: mSpecular(false)
+{
+	mEye[0] = mEye[1] = mEye[2] = 0.0f;
+}
+
+void LightBaker::AddLight(const LightModel::DirectionalLight& light)
+{
+	mDirectionalLights.push_back(light);
+}
+
+void LightBaker::AddLight(const LightModel::PointLight& light)
+{
+	mPointLights.push_back(light);
+}
+
+void LightBaker::AddLight(const LightModel::SpotLight& light)
+{
+	mSpotLights.push_back(light);
+}
+
+void LightBaker::ClearLights()
+{
+	mDirectionalLights.clear();
+	mPointLights.clear();
+	mSpotLights.clear();
+}
+
+void LightBaker::SetEye(const float* eyePos)
+{
+	mSpecular = eyePos != 0;
+	for (int i = 0; i < 3; ++i)
+		mEye[i] = mSpecular ? eyePos[i] : 0.0f;
+}
+
+void LightBaker::Bake(const Surface& surface, JobSystem* jobs)const
+{
+	assert(surface.Positions && surface.Normals && surface.Colors);
+
+	size_t chunks = (surface.Count + ChunkSize - 1)/ChunkSize;
+
+	if (jobs == 0)
+	{
+		for (size_t i = 0; i < chunks; ++i)
+			BakeChunk(surface, i*ChunkSize);
+		return;
+	}
+
+	jobs->ParallelFor(0, chunks, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+			BakeChunk(surface, i*ChunkSize);
+	});
+}
+
+void LightBaker::BakeReference(const Surface& surface)const
+{
+	for (size_t i = 0; i < surface.Count; ++i)
+		ReferenceColor(surface, i, Element(surface.Colors, surface.ColorStride, i));
+}
+
+float LightBaker::MaxError(const Surface& surface, size_t step)const
+{
+	float maxError = 0.0f;
+	for (size_t i = 0; i < surface.Count; i += std::max<size_t>(step, 1))
+	{
+		float expected[4];
+		ReferenceColor(surface, i, expected);
+
+		const float* color = Element(surface.Colors, surface.ColorStride, i);
+		for (int j = 0; j < 4; ++j)
+			maxError = std::max(maxError, fabsf(color[j] - expected[j]));
+	}
+
+	return maxError;
+}
+
+void LightBaker::BakeChunk(const Surface& surface, size_t first)const
+{
+	SurfaceTransform transform(surface.World);
+
+	size_t count = std::min<size_t>(ChunkSize, surface.Count - first);
+
+	// Transpose the chunk into one array per component.
+	LIGHTBAKER_ALIGN64 float position[3][ChunkSize];
+	LIGHTBAKER_ALIGN64 float normal[3][ChunkSize];
+	LIGHTBAKER_ALIGN64 float toEye[3][ChunkSize];
+	for (size_t i = 0; i < count; ++i)
+	{
+		float p[3], n[3];
+		transform.Transform(Element(surface.Positions, surface.Stride, first + i),
+			Element(surface.Normals, surface.Stride, first + i), p, n);
+
+		float invLength = 1.0f/sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		for (int j = 0; j < 3; ++j)
+		{
+			position[j][i] = p[j];
+			normal[j][i] = n[j]*invLength;
+		}
+
+		if (mSpecular)
+		{
+			float e[3] = { mEye[0] - p[0], mEye[1] - p[1], mEye[2] - p[2] };
+			float invDistance = 1.0f/sqrtf(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+			for (int j = 0; j < 3; ++j)
+				toEye[j][i] = e[j]*invDistance;
+		}
+	}
+
+	LightModel::PointBatch points;
+	for (int j = 0; j < 3; ++j)
+	{
+		points.Position[j] = position[j];
+		points.Normal[j] = normal[j];
+		points.ToEye[j] = toEye[j];
+	}
+	points.Count = count;
+
+	LIGHTBAKER_ALIGN64 float ambient[4][ChunkSize];
+	LIGHTBAKER_ALIGN64 float diffuse[4][ChunkSize];
+	LIGHTBAKER_ALIGN64 float spec[4][ChunkSize];
+
+	LightModel::TermBatch terms;
+	for (int c = 0; c < 4; ++c)
+	{
+		terms.Ambient[c] = ambient[c];
+		terms.Diffuse[c] = diffuse[c];
+		terms.Spec[c] = mSpecular ? spec[c] : 0;
+	}
+
+	LIGHTBAKER_ALIGN64 float color[3][ChunkSize] = {};
+
+	size_t lightCount = mDirectionalLights.size() + mPointLights.size() + mSpotLights.size();
+	for (size_t l = 0; l < lightCount; ++l)
+	{
+		size_t point = l - mDirectionalLights.size();
+		size_t spot = point - mPointLights.size();
+
+		if (l < mDirectionalLights.size())
+			LightModel::BatchDirectionalLight(surface.Material, mDirectionalLights[l], points, terms);
+		else if (point < mPointLights.size())
+			LightModel::BatchPointLight(surface.Material, mPointLights[point], points, terms);
+		else
+			LightModel::BatchSpotLight(surface.Material, mSpotLights[spot], points, terms);
+
+		for (int c = 0; c < 3; ++c)
+		{
+			for (size_t i = 0; i < count; ++i)
+				color[c][i] += ambient[c][i] + diffuse[c][i] + (mSpecular ? spec[c][i] : 0.0f);
+		}
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		float* out = Element(surface.Colors, surface.ColorStride, first + i);
+		out[0] = color[0][i];
+		out[1] = color[1][i];
+		out[2] = color[2][i];
+		out[3] = surface.Material.Diffuse.w;
+	}
+}
+
+void LightBaker::ReferenceColor(const Surface& surface, size_t vertex, float color[4])const
+{
+	SurfaceTransform transform(surface.World);
+
+	float p[3], n[3];
+	transform.Transform(Element(surface.Positions, surface.Stride, vertex),
+		Element(surface.Normals, surface.Stride, vertex), p, n);
+
+	float length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+	LightModel::Float3 pos = { p[0], p[1], p[2] };
+	LightModel::Float3 normal = { n[0]/length, n[1]/length, n[2]/length };
+
+	LightModel::Float3 toEye = { 0.0f, 0.0f, 0.0f };
+	if (mSpecular)
+	{
+		float e[3] = { mEye[0] - p[0], mEye[1] - p[1], mEye[2] - p[2] };
+		float distance = sqrtf(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+		toEye.x = e[0]/distance;
+		toEye.y = e[1]/distance;
+		toEye.z = e[2]/distance;
+	}
+
+	LightModel::Float4 sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+	LightModel::Float4 A, D, S;
+
+	size_t lightCount = mDirectionalLights.size() + mPointLights.size() + mSpotLights.size();
+	for (size_t i = 0; i < lightCount; ++i)
+	{
+		size_t point = i - mDirectionalLights.size();
+		size_t spot = point - mPointLights.size();
+
+		if (i < mDirectionalLights.size())
+			LightModel::ComputeDirectionalLight(surface.Material, mDirectionalLights[i], normal, toEye, A, D, S);
+		else if (point < mPointLights.size())
+			LightModel::ComputePointLight(surface.Material, mPointLights[point], pos, normal, toEye, A, D, S);
+		else
+			LightModel::ComputeSpotLight(surface.Material, mSpotLights[spot], pos, normal, toEye, A, D, S);
+
+		if (!mSpecular)
+			S.x = S.y = S.z = 0.0f;
+
+		sum.x += A.x + D.x + S.x;
+		sum.y += A.y + D.y + S.y;
+		sum.z += A.z + D.z + S.z;
+	}
+
+	color[0] = sum.x;
+	color[1] = sum.y;
+	color[2] = sum.z;
+	color[3] = surface.Material.Diffuse.w;
+}
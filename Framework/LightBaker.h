@@ -0,0 +1,84 @@
+//***************************************************************************************
+// LightBaker.h
+//
+// Bakes the contribution of static lights on static geometry into vertex colors, using
+// the lighting model of LightHelper.fx (see LightModel.h). The shader then only has to
+// add the lights that move.
+//
+// Vertices are transformed into structure-of-arrays chunks and lit with the batch
+// functions of LightModel, so a chunk is lit 4, 8 or 16 vertices at a time depending
+// on the CPU. Chunks are spread over a job system when one is given. The specular term depends on the viewer, so it
+// is only baked when a fixed eye position has been set; otherwise the colors hold the
+// ambient and diffuse terms and specular is left to the shader.
+//***************************************************************************************
+
+#ifndef LIGHTBAKER_H
+#define LIGHTBAKER_H
+
+#include "LightModel.h"
+
+#include <cstddef>
+#include <vector>
+
+class JobSystem;
+
+class LightBaker
+{
+public:
+	// A mesh to bake. Positions and normals are read as three floats and colors are
+	// written as four floats (rgb plus the material's diffuse alpha, which is what the
+	// demos output), each Stride or ColorStride bytes apart, so they can point into an
+	// interleaved vertex array.
+	struct Surface
+	{
+		Surface();
+
+		const float* Positions;
+		const float* Normals;
+		size_t Stride;
+		size_t Count;
+
+		// Object to world transform, row-major and applied as p*W as in XNA Math;
+		// 0 for geometry that is already in world space.
+		const float* World;
+
+		LightModel::Material Material;
+
+		float* Colors;
+		size_t ColorStride;
+	};
+
+	LightBaker();
+
+	void AddLight(const LightModel::DirectionalLight& light);
+	void AddLight(const LightModel::PointLight& light);
+	void AddLight(const LightModel::SpotLight& light);
+	void ClearLights();
+
+	// Bakes specular as seen from eyePos (three floats); 0 leaves specular out.
+	void SetEye(const float* eyePos);
+
+	void Bake(const Surface& surface, JobSystem* jobs = 0)const;
+
+	// Lights one vertex at a time with the LightModel functions.
+	void BakeReference(const Surface& surface)const;
+
+	// Largest difference between the colors in surface.Colors and the reference
+	// result, checking every step-th vertex.
+	float MaxError(const Surface& surface, size_t step = 1)const;
+
+private:
+	static const unsigned int ChunkSize = 256;
+
+	void BakeChunk(const Surface& surface, size_t first)const;
+	void ReferenceColor(const Surface& surface, size_t vertex, float color[4])const;
+
+	std::vector<LightModel::DirectionalLight> mDirectionalLights;
+	std::vector<LightModel::PointLight> mPointLights;
+	std::vector<LightModel::SpotLight> mSpotLights;
+
+	bool mSpecular;
+	float mEye[3];
+};
+
+#endif // LIGHTBAKER_H
@@ -0,0 +1,393 @@
+//***************************************************************************************
+// LightGrid.cpp
+//***************************************************************************************
+
+#include "LightGrid.h"
+#include "FrameMemory.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define LIGHTGRID_SSE
+#include <xmmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#define LIGHTGRID_ALIGN16 __declspec(align(16))
+#else
+#define LIGHTGRID_ALIGN16 __attribute__((aligned(16)))
+#endif
+
+namespace
+{
+	// Squared distance from p to the interval [min, max], for count (a multiple of 4)
+	// intervals at once.
+	void SquaredDistances(const float* minValues, const float* maxValues, float p, float* out, unsigned int count)
+	{
+#ifdef LIGHTGRID_SSE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 pos = _mm_set1_ps(p);
+		for (unsigned int i = 0; i < count; i += 4)
+		{
+			__m128 below = _mm_sub_ps(_mm_load_ps(minValues + i), pos);
+			__m128 above = _mm_sub_ps(pos, _mm_load_ps(maxValues + i));
+			__m128 d = _mm_max_ps(_mm_max_ps(below, above), zero);
+			_mm_store_ps(out + i, _mm_mul_ps(d, d));
+		}
+#else
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			float d = std::max(std::max(minValues[i] - p, p - maxValues[i]), 0.0f);
+			out[i] = d*d;
+		}
+#endif
+	}
+
+	// Bit i is set when values[i] <= limit, for four values.
+	int LessEqualMask(const float* values, float limit)
+	{
+#ifdef LIGHTGRID_SSE
+		return _mm_movemask_ps(_mm_cmple_ps(_mm_load_ps(values), _mm_set1_ps(limit)));
+#else
+		int mask = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			if (values[i] <= limit)
+				mask |= 1 << i;
+		}
+		return mask;
+#endif
+	}
+
+	float SquaredDistance(float minValue, float maxValue, float p)
+	{
+		float d = std::max(std::max(minValue - p, p - maxValue), 0.0f);
+		return d*d;
+	}
+}
+
+LightGrid::LightGrid(unsigned int tilesX, unsigned int tilesY, unsigned int slices)
+	: mTilesX(tilesX), mTilesY(tilesY), mSlices(slices),
+	mProjScaleX(1.0f), mProjScaleY(1.0f), mPlaneScaleX(1.0f), mPlaneScaleY(1.0f), mNear(1.0f), mFar(1000.0f),
+	mSliceScale(0.0f), mSliceBias(0.0f), mScratch(slices)
+{
+	assert(tilesX > 0 && tilesX <= MaxTiles && tilesY > 0 && tilesY <= MaxTiles && slices > 0);
+
+	static const float identity[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+	SetView(identity, 1.0f, 1.0f, 1.0f, 1000.0f);
+}
+
+void LightGrid::SetView(const float* view, float projScaleX, float projScaleY, float nearZ, float farZ)
+{
+	std::copy(view, view + 16, mView);
+	mProjScaleX = projScaleX;
+	mProjScaleY = projScaleY;
+	mNear = nearZ;
+	mFar = farZ;
+	mPlaneScaleX = std::sqrt(projScaleX*projScaleX + 1.0f);
+	mPlaneScaleY = std::sqrt(projScaleY*projScaleY + 1.0f);
+
+	// Slice i starts at near*(far/near)^(i/slices), which keeps the clusters roughly
+	// cube shaped at every depth.
+	float logRatio = std::log(farZ / nearZ);
+	mSliceScale = mSlices / logRatio;
+	mSliceBias = -mSlices*std::log(nearZ) / logRatio;
+
+	mSliceDepths.resize(mSlices + 1);
+	for (unsigned int i = 0; i <= mSlices; ++i)
+		mSliceDepths[i] = nearZ*std::pow(farZ / nearZ, (float)i / mSlices);
+}
+
+int LightGrid::Slice(float viewZ)const
+{
+	if (viewZ <= mNear)
+		return 0;
+
+	int slice = (int)std::floor(std::log(viewZ)*mSliceScale + mSliceBias);
+	slice = std::min(std::max(slice, 0), (int)mSlices - 1);
+
+	// Settle rounding at the boundaries against the exact slice depths.
+	while (slice > 0 && viewZ < mSliceDepths[slice])
+		--slice;
+	while (slice + 1 < (int)mSlices && viewZ >= mSliceDepths[slice + 1])
+		++slice;
+
+	return slice;
+}
+
+void LightGrid::TransformLight(const ClusterLight& light, ViewLight& out, int& firstSlice, int& lastSlice)const
+{
+	const float* p = light.Position;
+	const float* d = light.Direction;
+	const float* v = mView;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		out.Position[i] = p[0]*v[i] + p[1]*v[4 + i] + p[2]*v[8 + i] + v[12 + i];
+		out.Direction[i] = d[0]*v[i] + d[1]*v[4 + i] + d[2]*v[8 + i];
+	}
+
+	out.Range = light.Range;
+
+	// Cones of 90 degrees and wider are culled as their bounding sphere.
+	out.Spot = light.SpotCos > 0.0f;
+	out.SpotCos = light.SpotCos;
+	out.SpotSin = out.Spot ? std::sqrt(1.0f - light.SpotCos*light.SpotCos) : 1.0f;
+
+	// Outside the near or far plane, or more than the range outside one of the side
+	// planes, e.g. x*projScaleX - z > range*sqrt(projScaleX^2 + 1) for the right one.
+	float x = out.Position[0];
+	float y = out.Position[1];
+	float z = out.Position[2];
+	if (z + light.Range < mNear || z - light.Range > mFar ||
+		std::fabs(x)*mProjScaleX - z > light.Range*mPlaneScaleX ||
+		std::fabs(y)*mProjScaleY - z > light.Range*mPlaneScaleY)
+	{
+		firstSlice = 1;
+		lastSlice = 0;
+		return;
+	}
+
+	firstSlice = Slice(z - light.Range);
+	lastSlice = Slice(z + light.Range);
+}
+
+void LightGrid::Build(const ClusterLight* lights, size_t count, JobSystem* jobs, FrameArena* frame)
+{
+	mViewLights.resize(count);
+	mLightSlices.resize(2*count);
+
+	JobSystem::RangeFunction transform = [this, lights](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+			TransformLight(lights[i], mViewLights[i], mLightSlices[2*i], mLightSlices[2*i + 1]);
+	};
+
+	if (jobs)
+		jobs->ParallelFor(0, count, transform);
+	else
+		transform(0, count);
+
+	//
+	// Bucket the lights by the slices they overlap, so a slice only looks at its own.
+	//
+
+	mSliceStarts.assign(mSlices + 1, 0);
+	for (size_t i = 0; i < count; ++i)
+	{
+		for (int s = mLightSlices[2*i]; s <= mLightSlices[2*i + 1]; ++s)
+			++mSliceStarts[s + 1];
+	}
+
+	for (unsigned int s = 0; s < mSlices; ++s)
+		mSliceStarts[s + 1] += mSliceStarts[s];
+
+	FrameAllocator<uint32_t> temporary(frame);
+
+	mSliceLights.resize(mSliceStarts[mSlices]);
+	FrameVector<uint32_t> cursor(mSliceStarts.begin(), mSliceStarts.end() - 1, temporary);
+	for (size_t i = 0; i < count; ++i)
+	{
+		for (int s = mLightSlices[2*i]; s <= mLightSlices[2*i + 1]; ++s)
+			mSliceLights[cursor[s]++] = (uint32_t)i;
+	}
+
+	//
+	// Test every slice on its own, then concatenate their light lists.
+	//
+
+	mRanges.resize(ClusterCount());
+
+	JobSystem::RangeFunction build = [this](size_t begin, size_t end)
+	{
+		for (size_t s = begin; s < end; ++s)
+			BuildSlice((unsigned int)s);
+	};
+
+	if (jobs)
+		jobs->ParallelFor(0, mSlices, build, 1);
+	else
+		build(0, mSlices);
+
+	FrameVector<uint32_t> bases(mSlices + 1, 0, temporary);
+	for (unsigned int s = 0; s < mSlices; ++s)
+		bases[s + 1] = bases[s] + (uint32_t)mScratch[s].Indices.size();
+
+	mLightIndices.resize(bases[mSlices]);
+
+	JobSystem::RangeFunction gather = [this, &bases](size_t begin, size_t end)
+	{
+		for (size_t s = begin; s < end; ++s)
+			GatherSlice((unsigned int)s, bases[s]);
+	};
+
+	if (jobs)
+		jobs->ParallelFor(0, mSlices, gather, 1);
+	else
+		gather(0, mSlices);
+}
+
+void LightGrid::BuildSlice(unsigned int slice)
+{
+	SliceScratch& scratch = mScratch[slice];
+	scratch.Hits.clear();
+
+	const float nearZ = mSliceDepths[slice];
+	const float farZ = mSliceDepths[slice + 1];
+	const float centerZ = 0.5f*(nearZ + farZ);
+	const float extentZ = 0.5f*(farZ - nearZ);
+
+	//
+	// View space bounds of the tile columns and rows within this slice. The columns
+	// are padded to whole SSE vectors with bounds no light can reach.
+	//
+
+	const unsigned int columns = (mTilesX + 3) & ~3u;
+
+	LIGHTGRID_ALIGN16 float minX[MaxTiles];
+	LIGHTGRID_ALIGN16 float maxX[MaxTiles];
+	LIGHTGRID_ALIGN16 float centerX[MaxTiles];
+	LIGHTGRID_ALIGN16 float extentX2[MaxTiles];
+	LIGHTGRID_ALIGN16 float distanceX2[MaxTiles];
+
+	for (unsigned int x = 0; x < columns; ++x)
+	{
+		if (x < mTilesX)
+		{
+			float left = -1.0f + 2.0f*x / mTilesX;
+			float right = -1.0f + 2.0f*(x + 1) / mTilesX;
+			minX[x] = std::min(left*nearZ, left*farZ) / mProjScaleX;
+			maxX[x] = std::max(right*nearZ, right*farZ) / mProjScaleX;
+
+			float extent = 0.5f*(maxX[x] - minX[x]);
+			centerX[x] = 0.5f*(minX[x] + maxX[x]);
+			extentX2[x] = extent*extent;
+		}
+		else
+		{
+			minX[x] = FLT_MAX;
+			maxX[x] = -FLT_MAX;
+			centerX[x] = 0.0f;
+			extentX2[x] = 0.0f;
+		}
+	}
+
+	float minY[MaxTiles];
+	float maxY[MaxTiles];
+	float centerY[MaxTiles];
+	float extentY2[MaxTiles];
+
+	for (unsigned int y = 0; y < mTilesY; ++y)
+	{
+		// Row 0 is at the top of the screen.
+		float top = 1.0f - 2.0f*y / mTilesY;
+		float bottom = 1.0f - 2.0f*(y + 1) / mTilesY;
+		minY[y] = std::min(bottom*nearZ, bottom*farZ) / mProjScaleY;
+		maxY[y] = std::max(top*nearZ, top*farZ) / mProjScaleY;
+
+		float extent = 0.5f*(maxY[y] - minY[y]);
+		centerY[y] = 0.5f*(minY[y] + maxY[y]);
+		extentY2[y] = extent*extent;
+	}
+
+	//
+	// Sphere against cluster box: the squared distances along the axes add up, so the
+	// x distances are computed once per light and reused for every row.
+	//
+
+	for (uint32_t i = mSliceStarts[slice]; i < mSliceStarts[slice + 1]; ++i)
+	{
+		const uint32_t index = mSliceLights[i];
+		const ViewLight& light = mViewLights[index];
+		const float* p = light.Position;
+
+		const float range2 = light.Range*light.Range;
+		const float dz2 = SquaredDistance(nearZ, farZ, p[2]);
+		if (dz2 > range2)
+			continue;
+
+		SquaredDistances(minX, maxX, p[0], distanceX2, columns);
+
+		for (unsigned int y = 0; y < mTilesY; ++y)
+		{
+			float remaining = range2 - dz2 - SquaredDistance(minY[y], maxY[y], p[1]);
+			if (remaining < 0.0f)
+				continue;
+
+			for (unsigned int x0 = 0; x0 < columns; x0 += 4)
+			{
+				int mask = LessEqualMask(distanceX2 + x0, remaining);
+				if (mask == 0)
+					continue;
+
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					if (!(mask & (1 << lane)))
+						continue;
+
+					unsigned int x = x0 + lane;
+
+					// Cone against the bounding sphere of the cluster: cull when the
+					// sphere lies entirely outside the cone's angle, in front of its
+					// range or behind its apex.
+					if (light.Spot)
+					{
+						float v[3] = { centerX[x] - p[0], centerY[y] - p[1], centerZ - p[2] };
+						float radius = std::sqrt(extentX2[x] + extentY2[y] + extentZ*extentZ);
+
+						float length2 = v[0]*v[0] + v[1]*v[1] + v[2]*v[2];
+						float along = v[0]*light.Direction[0] + v[1]*light.Direction[1] + v[2]*light.Direction[2];
+						float closest = light.SpotCos*std::sqrt(std::max(length2 - along*along, 0.0f)) - along*light.SpotSin;
+
+						if (closest > radius || along > radius + light.Range || along < -radius)
+							continue;
+					}
+
+					Hit hit = { y*mTilesX + x, index };
+					scratch.Hits.push_back(hit);
+				}
+			}
+		}
+	}
+
+	//
+	// Counting sort of the hits by cluster. Lights were visited in index order, so
+	// every cluster lists its lights in that order too.
+	//
+
+	const unsigned int clusters = mTilesX*mTilesY;
+	Range* ranges = &mRanges[slice*clusters];
+
+	scratch.Counts.assign(clusters, 0);
+	for (size_t i = 0; i < scratch.Hits.size(); ++i)
+		++scratch.Counts[scratch.Hits[i].Cluster];
+
+	uint32_t offset = 0;
+	for (unsigned int c = 0; c < clusters; ++c)
+	{
+		ranges[c].Offset = offset;
+		ranges[c].Count = scratch.Counts[c];
+		scratch.Counts[c] = offset;
+		offset += ranges[c].Count;
+	}
+
+	scratch.Indices.resize(scratch.Hits.size());
+	for (size_t i = 0; i < scratch.Hits.size(); ++i)
+		scratch.Indices[scratch.Counts[scratch.Hits[i].Cluster]++] = scratch.Hits[i].Light;
+}
+
+void LightGrid::GatherSlice(unsigned int slice, uint32_t base)
+{
+	const SliceScratch& scratch = mScratch[slice];
+	if (!scratch.Indices.empty())
+		std::copy(scratch.Indices.begin(), scratch.Indices.end(), mLightIndices.begin() + base);
+
+	const unsigned int clusters = mTilesX*mTilesY;
+	Range* ranges = &mRanges[slice*clusters];
+	for (unsigned int c = 0; c < clusters; ++c)
+		ranges[c].Offset += base;
+}
@@ -0,0 +1,135 @@
+//***************************************************************************************
+// LightGrid.h
+//
+// Clustered light culling. The view frustum is split into a grid of froxels: screen
+// tiles in x and y and exponentially spaced slices in view depth. Build() lists, for
+// every cluster, the point and spot lights whose volume touches it, so a pixel shader
+// only has to shade the lights of the cluster it falls in.
+//
+// The cluster bounds are separable (x only depends on the tile column and slice, y on
+// the tile row and slice), so a sphere test per cluster is a sum of three squared
+// axis distances; four tile columns are tested per SSE instruction. Spot lights that
+// pass the sphere test are tested once more against the cone.
+//
+// The grid uses the Direct3D conventions of the demos: left-handed view space looking
+// down +z, tile row 0 at the top of the screen.
+//***************************************************************************************
+
+#ifndef LIGHTGRID_H
+#define LIGHTGRID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class FrameArena;
+class JobSystem;
+
+// Laid out like the ClusterLight structured buffer in ClusteredLighting.fx, so an
+// array of these can be uploaded as is.
+struct ClusterLight
+{
+	float Position[3];		// world space
+	float Range;
+	float Direction[3];		// spot lights: normalized cone axis
+	float SpotCos;			// cosine of the cone half-angle; -1 for point lights
+	float Color[3];
+	float Pad;
+};
+
+class LightGrid
+{
+public:
+	struct Range
+	{
+		uint32_t Offset;	// first entry in LightIndices()
+		uint32_t Count;
+	};
+
+	static const unsigned int MaxTiles = 64;
+
+	LightGrid(unsigned int tilesX = 16, unsigned int tilesY = 8, unsigned int slices = 24);
+
+	// view is the world-to-view matrix, row-major and applied as p*V as in XNA Math;
+	// projScaleX and projScaleY are the _11 and _22 entries of the projection matrix.
+	void SetView(const float* view, float projScaleX, float projScaleY, float nearZ, float farZ);
+
+	// Rebuilds the light lists for the current view. Slices are built in parallel
+	// when a job system is given; the temporaries of the build come from the frame
+	// arena when one is given, and from the heap otherwise.
+	void Build(const ClusterLight* lights, size_t count, JobSystem* jobs = 0, FrameArena* frame = 0);
+
+	unsigned int TilesX()const             { return mTilesX; }
+	unsigned int TilesY()const             { return mTilesY; }
+	unsigned int Slices()const             { return mSlices; }
+	unsigned int ClusterCount()const       { return mTilesX*mTilesY*mSlices; }
+
+	unsigned int ClusterIndex(unsigned int x, unsigned int y, unsigned int slice)const
+	{
+		return (slice*mTilesY + y)*mTilesX + x;
+	}
+
+	// slice = log(viewZ)*SliceScale() + SliceBias(), which is what the shader evaluates.
+	float SliceScale()const                { return mSliceScale; }
+	float SliceBias()const                 { return mSliceBias; }
+	int Slice(float viewZ)const;
+
+	const std::vector<Range>& Ranges()const          { return mRanges; }
+	const std::vector<uint32_t>& LightIndices()const { return mLightIndices; }
+
+private:
+	// A light transformed to view space with the slices it overlaps.
+	struct ViewLight
+	{
+		float Position[3];
+		float Range;
+		float Direction[3];
+		float SpotCos;
+		float SpotSin;
+		bool Spot;
+	};
+
+	struct Hit
+	{
+		uint32_t Cluster;		// within the slice
+		uint32_t Light;
+	};
+
+	// Per slice output, so slices can be built without sharing anything.
+	struct SliceScratch
+	{
+		std::vector<Hit> Hits;
+		std::vector<uint32_t> Counts;
+		std::vector<uint32_t> Indices;
+	};
+
+	void TransformLight(const ClusterLight& light, ViewLight& out, int& firstSlice, int& lastSlice)const;
+	void BuildSlice(unsigned int slice);
+	void GatherSlice(unsigned int slice, uint32_t base);
+
+	unsigned int mTilesX;
+	unsigned int mTilesY;
+	unsigned int mSlices;
+
+	float mView[16];
+	float mProjScaleX;
+	float mProjScaleY;
+	float mPlaneScaleX;		// length of the side plane normals (projScale, -1)
+	float mPlaneScaleY;
+	float mNear;
+	float mFar;
+	float mSliceScale;
+	float mSliceBias;
+	std::vector<float> mSliceDepths;	// mSlices + 1 boundaries
+
+	std::vector<ViewLight> mViewLights;
+	std::vector<int> mLightSlices;			// first and last slice per light
+	std::vector<uint32_t> mSliceStarts;		// into mSliceLights, per slice + 1
+	std::vector<uint32_t> mSliceLights;		// light indices bucketed by slice
+	std::vector<SliceScratch> mScratch;
+
+	std::vector<Range> mRanges;
+	std::vector<uint32_t> mLightIndices;
+};
+
+#endif // LIGHTGRID_H
@@ -0,0 +1,363 @@
+//***************************************************************************************
+// LightModel.cpp
+//***************************************************************************************
+
+#include "LightModel.h"
+#include "LightModelSimd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define LIGHTMODEL_CPUID
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define LIGHTMODEL_CPUID
+#include <cpuid.h>
+#endif
+
+namespace
+{
+	using LightModel::Float3;
+	using LightModel::Float4;
+
+	const Float4 Zero = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	float Dot(const Float3& a, const Float3& b)
+	{
+		return a.x*b.x + a.y*b.y + a.z*b.z;
+	}
+
+	Float3 Scale(const Float3& v, float s)
+	{
+		Float3 r = { v.x*s, v.y*s, v.z*s };
+		return r;
+	}
+
+	Float3 Subtract(const Float3& a, const Float3& b)
+	{
+		Float3 r = { a.x - b.x, a.y - b.y, a.z - b.z };
+		return r;
+	}
+
+	Float4 Modulate(const Float4& a, const Float4& b)
+	{
+		Float4 r = { a.x*b.x, a.y*b.y, a.z*b.z, a.w*b.w };
+		return r;
+	}
+
+	Float4 Scale(const Float4& v, float s)
+	{
+		Float4 r = { v.x*s, v.y*s, v.z*s, v.w*s };
+		return r;
+	}
+
+	// HLSL reflect(i, n) = i - 2*dot(i, n)*n.
+	Float3 Reflect(const Float3& i, const Float3& n)
+	{
+		return Subtract(i, Scale(n, 2.0f*Dot(i, n)));
+	}
+
+	// The diffuse and specular terms shared by all three light types; lightVec points
+	// from the surface to the light.
+	void ComputeDiffuseSpecular(const LightModel::Material& mat, const Float4& lightDiffuse, const Float4& lightSpecular,
+		const Float3& lightVec, const Float3& normal, const Float3& toEye, Float4& diffuse, Float4& spec)
+	{
+		float diffuseFactor = Dot(lightVec, normal);
+
+		if (diffuseFactor > 0.0f)
+		{
+			Float3 v = Reflect(Scale(lightVec, -1.0f), normal);
+			float specFactor = powf(std::max(Dot(v, toEye), 0.0f), mat.Specular.w);
+
+			diffuse = Scale(Modulate(mat.Diffuse, lightDiffuse), diffuseFactor);
+			spec = Scale(Modulate(mat.Specular, lightSpecular), specFactor);
+		}
+	}
+
+#pragma region Dispatch
+#ifdef LIGHTMODEL_CPUID
+	void Cpuid(int leaf, int regs[4])
+	{
+#if defined(_MSC_VER)
+		__cpuidex(regs, leaf, 0);
+#else
+		unsigned int a, b, c, d;
+		__cpuid_count(leaf, 0, a, b, c, d);
+		regs[0] = (int)a;
+		regs[1] = (int)b;
+		regs[2] = (int)c;
+		regs[3] = (int)d;
+#endif
+	}
+
+	// The register state the operating system saves on a context switch.
+	unsigned long long EnabledStateMask()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned int low, high;
+		__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		return ((unsigned long long)high << 32) | low;
+#endif
+	}
+#endif
+
+	LightModel::SimdLevel DetectSimdLevel()
+	{
+		LightModel::SimdLevel level = LightModel::SimdScalar;
+
+#ifdef LIGHTMODEL_CPUID
+		int regs[4];
+		Cpuid(0, regs);
+		int maxLeaf = regs[0];
+
+		Cpuid(1, regs);
+		bool sse2 = (regs[3] & (1 << 26)) != 0;
+		bool osxsave = (regs[2] & (1 << 27)) != 0;
+		bool avx = (regs[2] & (1 << 28)) != 0;
+
+		bool avx2 = false;
+		bool avx512 = false;
+		if (maxLeaf >= 7)
+		{
+			Cpuid(7, regs);
+			avx2 = (regs[1] & (1 << 5)) != 0;
+			avx512 = (regs[1] & (1 << 16)) != 0;
+		}
+
+		// The CPU having the instructions is not enough; the operating system must also
+		// save the wider registers: SSE and AVX state (bits 1 and 2) and for AVX-512 the
+		// opmask and upper register state (bits 5 to 7).
+		unsigned long long state = osxsave ? EnabledStateMask() : 0;
+		bool ymm = (state & 0x06) == 0x06;
+		bool zmm = (state & 0xE6) == 0xE6;
+
+		if (sse2 && LightModelSimd::SSE2Kernels())
+			level = LightModel::SimdSSE2;
+		if (avx && avx2 && ymm && LightModelSimd::AVX2Kernels())
+			level = LightModel::SimdAVX2;
+		if (avx512 && zmm && LightModelSimd::AVX512Kernels())
+			level = LightModel::SimdAVX512;
+#endif
+
+		return level;
+	}
+
+	std::atomic<int>& ActiveLevel()
+	{
+		static std::atomic<int> level(DetectSimdLevel());
+		return level;
+	}
+
+	const LightModelSimd::Kernels* ActiveKernels()
+	{
+		switch (ActiveLevel().load(std::memory_order_relaxed))
+		{
+		case LightModel::SimdSSE2:   return LightModelSimd::SSE2Kernels();
+		case LightModel::SimdAVX2:   return LightModelSimd::AVX2Kernels();
+		case LightModel::SimdAVX512: return LightModelSimd::AVX512Kernels();
+		default:                     return 0;
+		}
+	}
+
+	// The points a kernel can take in whole vectors; the rest are left to the
+	// reference functions.
+	size_t VectorCount(const LightModelSimd::Kernels* kernels, const LightModel::PointBatch& points)
+	{
+		return kernels ? points.Count - points.Count % kernels->Width : 0;
+	}
+
+	Float3 Read(const float* const arrays[3], size_t i)
+	{
+		Float3 r = { arrays[0][i], arrays[1][i], arrays[2][i] };
+		return r;
+	}
+
+	void Write(float* const arrays[4], size_t i, const Float4& v)
+	{
+		arrays[0][i] = v.x;
+		arrays[1][i] = v.y;
+		arrays[2][i] = v.z;
+		arrays[3][i] = v.w;
+	}
+
+	void WriteTerms(const LightModel::TermBatch& out, size_t i, const Float4& ambient, const Float4& diffuse, const Float4& spec)
+	{
+		Write(out.Ambient, i, ambient);
+		Write(out.Diffuse, i, diffuse);
+		if (out.Spec[0])
+			Write(out.Spec, i, spec);
+	}
+
+	Float3 ToEye(const LightModel::PointBatch& points, const LightModel::TermBatch& out, size_t i)
+	{
+		if (out.Spec[0])
+			return Read(points.ToEye, i);
+
+		Float3 none = { 0.0f, 0.0f, 0.0f };
+		return none;
+	}
+#pragma endregion
+}
+
+void LightModel::ComputeDirectionalLight(const Material& mat, const DirectionalLight& L,
+	const Float3& normal, const Float3& toEye,
+	Float4& ambient, Float4& diffuse, Float4& spec)
+{
+	diffuse = Zero;
+	spec = Zero;
+
+	// The light vector aims opposite the direction the light rays travel.
+	Float3 lightVec = Scale(L.Direction, -1.0f);
+
+	ambient = Modulate(mat.Ambient, L.Ambient);
+
+	ComputeDiffuseSpecular(mat, L.Diffuse, L.Specular, lightVec, normal, toEye, diffuse, spec);
+}
+
+void LightModel::ComputePointLight(const Material& mat, const PointLight& L,
+	const Float3& pos, const Float3& normal, const Float3& toEye,
+	Float4& ambient, Float4& diffuse, Float4& spec)
+{
+	ambient = Zero;
+	diffuse = Zero;
+	spec = Zero;
+
+	Float3 lightVec = Subtract(L.Position, pos);
+	float d = sqrtf(Dot(lightVec, lightVec));
+
+	if (d > L.Range)
+		return;
+
+	lightVec = Scale(lightVec, 1.0f/d);
+
+	ambient = Modulate(mat.Ambient, L.Ambient);
+
+	ComputeDiffuseSpecular(mat, L.Diffuse, L.Specular, lightVec, normal, toEye, diffuse, spec);
+
+	float att = 1.0f/(L.Att.x + L.Att.y*d + L.Att.z*d*d);
+
+	diffuse = Scale(diffuse, att);
+	spec = Scale(spec, att);
+}
+
+void LightModel::ComputeSpotLight(const Material& mat, const SpotLight& L,
+	const Float3& pos, const Float3& normal, const Float3& toEye,
+	Float4& ambient, Float4& diffuse, Float4& spec)
+{
+	ambient = Zero;
+	diffuse = Zero;
+	spec = Zero;
+
+	Float3 lightVec = Subtract(L.Position, pos);
+	float d = sqrtf(Dot(lightVec, lightVec));
+
+	if (d > L.Range)
+		return;
+
+	lightVec = Scale(lightVec, 1.0f/d);
+
+	ambient = Modulate(mat.Ambient, L.Ambient);
+
+	ComputeDiffuseSpecular(mat, L.Diffuse, L.Specular, lightVec, normal, toEye, diffuse, spec);
+
+	float spot = powf(std::max(-Dot(lightVec, L.Direction), 0.0f), L.Spot);
+	float att = spot/(L.Att.x + L.Att.y*d + L.Att.z*d*d);
+
+	ambient = Scale(ambient, spot);
+	diffuse = Scale(diffuse, att);
+	spec = Scale(spec, att);
+}
+
+LightModel::SimdLevel LightModel::SupportedSimdLevel()
+{
+	static const SimdLevel level = DetectSimdLevel();
+	return level;
+}
+
+LightModel::SimdLevel LightModel::CurrentSimdLevel()
+{
+	return (SimdLevel)ActiveLevel().load(std::memory_order_relaxed);
+}
+
+void LightModel::SetSimdLevel(SimdLevel level)
+{
+	ActiveLevel().store(std::min(level, SupportedSimdLevel()), std::memory_order_relaxed);
+}
+
+const char* LightModel::SimdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdSSE2:   return "SSE2";
+	case SimdAVX2:   return "AVX2";
+	case SimdAVX512: return "AVX-512";
+	default:         return "Scalar";
+	}
+}
+
+void LightModel::BatchDirectionalLight(const Material& mat, const DirectionalLight& L,
+	const PointBatch& points, const TermBatch& out)
+{
+	const LightModelSimd::Kernels* kernels = ActiveKernels();
+	size_t vectorCount = VectorCount(kernels, points);
+
+	if (vectorCount > 0)
+	{
+		PointBatch head = points;
+		head.Count = vectorCount;
+		kernels->Directional(mat, L, head, out);
+	}
+
+	for (size_t i = vectorCount; i < points.Count; ++i)
+	{
+		Float4 A, D, S;
+		ComputeDirectionalLight(mat, L, Read(points.Normal, i), ToEye(points, out, i), A, D, S);
+		WriteTerms(out, i, A, D, S);
+	}
+}
+
+void LightModel::BatchPointLight(const Material& mat, const PointLight& L,
+	const PointBatch& points, const TermBatch& out)
+{
+	const LightModelSimd::Kernels* kernels = ActiveKernels();
+	size_t vectorCount = VectorCount(kernels, points);
+
+	if (vectorCount > 0)
+	{
+		PointBatch head = points;
+		head.Count = vectorCount;
+		kernels->Point(mat, L, head, out);
+	}
+
+	for (size_t i = vectorCount; i < points.Count; ++i)
+	{
+		Float4 A, D, S;
+		ComputePointLight(mat, L, Read(points.Position, i), Read(points.Normal, i), ToEye(points, out, i), A, D, S);
+		WriteTerms(out, i, A, D, S);
+	}
+}
+
+void LightModel::BatchSpotLight(const Material& mat, const SpotLight& L,
+	const PointBatch& points, const TermBatch& out)
+{
+	const LightModelSimd::Kernels* kernels = ActiveKernels();
+	size_t vectorCount = VectorCount(kernels, points);
+
+	if (vectorCount > 0)
+	{
+		PointBatch head = points;
+		head.Count = vectorCount;
+		kernels->Spot(mat, L, head, out);
+	}
+
+	for (size_t i = vectorCount; i < points.Count; ++i)
+	{
+		Float4 A, D, S;
+		ComputeSpotLight(mat, L, Read(points.Position, i), Read(points.Normal, i), ToEye(points, out, i), A, D, S);
+		WriteTerms(out, i, A, D, S);
+	}
+}
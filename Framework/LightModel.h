@@ -0,0 +1,149 @@
+//***************************************************************************************
+// LightModel.h
+//
+// C++ port of the lighting equations in LightHelper.fx. The structs are laid out like
+// their HLSL counterparts (and like the XNA Math mirrors in Common/LightHelper.h), so
+// the lights and materials of a demo can be copied over as they are.
+//
+// The Compute* functions light one point at a time and are the reference. The Batch*
+// functions light many points in structure-of-arrays form, 4, 8 or 16 at once with
+// SSE2, AVX2 or AVX-512, whichever the CPU supports; see LightModelSimd.h. Their pow
+// is a polynomial approximation, so results agree with the reference to within a
+// small relative tolerance rather than bit for bit.
+//***************************************************************************************
+
+#ifndef LIGHTMODEL_H
+#define LIGHTMODEL_H
+
+#include <cstddef>
+#include <cstring>
+
+namespace LightModel
+{
+	struct Float3
+	{
+		float x, y, z;
+	};
+
+	struct Float4
+	{
+		float x, y, z, w;
+	};
+
+	struct DirectionalLight
+	{
+		Float4 Ambient;
+		Float4 Diffuse;
+		Float4 Specular;
+		Float3 Direction;
+		float Pad;
+	};
+
+	struct PointLight
+	{
+		Float4 Ambient;
+		Float4 Diffuse;
+		Float4 Specular;
+
+		Float3 Position;
+		float Range;
+
+		Float3 Att;
+		float Pad;
+	};
+
+	struct SpotLight
+	{
+		Float4 Ambient;
+		Float4 Diffuse;
+		Float4 Specular;
+
+		Float3 Position;
+		float Range;
+
+		Float3 Direction;
+		float Spot;
+
+		Float3 Att;
+		float Pad;
+	};
+
+	struct Material
+	{
+		Float4 Ambient;
+		Float4 Diffuse;
+		Float4 Specular;	// w = SpecPower
+		Float4 Reflect;
+	};
+
+	// Copies a struct with the same layout, such as the XNA Math mirrors.
+	template<typename T, typename Source>
+	T FromLayout(const Source& source)
+	{
+		static_assert(sizeof(T) == sizeof(Source), "FromLayout needs structs of the same layout");
+
+		T result;
+		memcpy(&result, &source, sizeof(result));
+		return result;
+	}
+
+	// Same arguments and results as the HLSL functions; normal and toEye are unit length.
+	void ComputeDirectionalLight(const Material& mat, const DirectionalLight& L,
+		const Float3& normal, const Float3& toEye,
+		Float4& ambient, Float4& diffuse, Float4& spec);
+
+	void ComputePointLight(const Material& mat, const PointLight& L,
+		const Float3& pos, const Float3& normal, const Float3& toEye,
+		Float4& ambient, Float4& diffuse, Float4& spec);
+
+	void ComputeSpotLight(const Material& mat, const SpotLight& L,
+		const Float3& pos, const Float3& normal, const Float3& toEye,
+		Float4& ambient, Float4& diffuse, Float4& spec);
+
+	// Count surface points, one array per component.
+	struct PointBatch
+	{
+		const float* Position[3];
+		const float* Normal[3];		// unit length
+		const float* ToEye[3];		// unit length; unused when no specular is asked for
+		size_t Count;
+	};
+
+	// Where the batch functions write their results, one array per channel. Spec
+	// may be left null when only ambient and diffuse light is needed.
+	struct TermBatch
+	{
+		float* Ambient[4];
+		float* Diffuse[4];
+		float* Spec[4];
+	};
+
+	enum SimdLevel
+	{
+		SimdScalar,		// the reference functions, point by point
+		SimdSSE2,		// 4 points at once
+		SimdAVX2,		// 8
+		SimdAVX512		// 16
+	};
+
+	// The widest level both this CPU and the build support.
+	SimdLevel SupportedSimdLevel();
+
+	// Level the batch functions use; defaults to SupportedSimdLevel(). Levels above
+	// the supported one are clamped.
+	SimdLevel CurrentSimdLevel();
+	void SetSimdLevel(SimdLevel level);
+
+	const char* SimdLevelName(SimdLevel level);
+
+	void BatchDirectionalLight(const Material& mat, const DirectionalLight& L,
+		const PointBatch& points, const TermBatch& out);
+
+	void BatchPointLight(const Material& mat, const PointLight& L,
+		const PointBatch& points, const TermBatch& out);
+
+	void BatchSpotLight(const Material& mat, const SpotLight& L,
+		const PointBatch& points, const TermBatch& out);
+}
+
+#endif // LIGHTMODEL_H
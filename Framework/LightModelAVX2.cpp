@@ -0,0 +1,83 @@
+//***************************************************************************************
+// LightModelAVX2.cpp
+//
+// LightModelSimd kernels eight points at a time. Built with /arch:AVX2 (-mavx2); the
+// kernels are only used once LightModel has checked that the CPU supports AVX2.
+//***************************************************************************************
+
+#include "LightModelSimd.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace
+{
+	struct Mask8
+	{
+		__m256 Bits;
+	};
+
+	struct Vec8
+	{
+		typedef Mask8 Mask;
+		static const unsigned int Width = 8;
+
+		static Vec8 Make(__m256 v)               { Vec8 r = { v }; return r; }
+		static Vec8 Set(float v)                 { return Make(_mm256_set1_ps(v)); }
+		static Vec8 Load(const float* p)         { return Make(_mm256_loadu_ps(p)); }
+
+		__m256 V;
+	};
+
+	Mask8 MakeMask(__m256 bits)                  { Mask8 r = { bits }; return r; }
+
+	void Store(float* p, Vec8 a)                 { _mm256_storeu_ps(p, a.V); }
+
+	Vec8 operator+(Vec8 a, Vec8 b)               { return Vec8::Make(_mm256_add_ps(a.V, b.V)); }
+	Vec8 operator-(Vec8 a, Vec8 b)               { return Vec8::Make(_mm256_sub_ps(a.V, b.V)); }
+	Vec8 operator*(Vec8 a, Vec8 b)               { return Vec8::Make(_mm256_mul_ps(a.V, b.V)); }
+	Vec8 operator/(Vec8 a, Vec8 b)               { return Vec8::Make(_mm256_div_ps(a.V, b.V)); }
+	Vec8 Min(Vec8 a, Vec8 b)                     { return Vec8::Make(_mm256_min_ps(a.V, b.V)); }
+	Vec8 Max(Vec8 a, Vec8 b)                     { return Vec8::Make(_mm256_max_ps(a.V, b.V)); }
+	Vec8 Sqrt(Vec8 a)                            { return Vec8::Make(_mm256_sqrt_ps(a.V)); }
+
+	Mask8 Greater(Vec8 a, Vec8 b)                { return MakeMask(_mm256_cmp_ps(a.V, b.V, _CMP_GT_OQ)); }
+	Mask8 LessEqual(Vec8 a, Vec8 b)              { return MakeMask(_mm256_cmp_ps(a.V, b.V, _CMP_LE_OQ)); }
+	Mask8 And(Mask8 a, Mask8 b)                  { return MakeMask(_mm256_and_ps(a.Bits, b.Bits)); }
+	bool Any(Mask8 m)                            { return _mm256_movemask_ps(m.Bits) != 0; }
+
+	Vec8 Select(Mask8 m, Vec8 a)                 { return Vec8::Make(_mm256_and_ps(m.Bits, a.V)); }
+	Vec8 Blend(Mask8 m, Vec8 a, Vec8 b)          { return Vec8::Make(_mm256_blendv_ps(b.V, a.V, m.Bits)); }
+
+	Vec8 Exponent(Vec8 x)
+	{
+		__m256i bits = _mm256_srli_epi32(_mm256_castps_si256(x.V), 23);
+		return Vec8::Make(_mm256_cvtepi32_ps(_mm256_sub_epi32(bits, _mm256_set1_epi32(127))));
+	}
+
+	Vec8 Mantissa(Vec8 x)
+	{
+		__m256 fraction = _mm256_and_ps(x.V, _mm256_castsi256_ps(_mm256_set1_epi32(0x007FFFFF)));
+		return Vec8::Make(_mm256_or_ps(fraction, _mm256_set1_ps(1.0f)));
+	}
+
+	// cvtps rounds to nearest under the default rounding mode.
+	Vec8 Round(Vec8 x)                           { return Vec8::Make(_mm256_cvtepi32_ps(_mm256_cvtps_epi32(x.V))); }
+
+	Vec8 Pow2(Vec8 n)
+	{
+		__m256i exponent = _mm256_add_epi32(_mm256_cvtps_epi32(n.V), _mm256_set1_epi32(127));
+		return Vec8::Make(_mm256_castsi256_ps(_mm256_slli_epi32(exponent, 23)));
+	}
+}
+
+const LightModelSimd::Kernels* LightModelSimd::AVX2Kernels()
+{
+	return MakeKernels<Vec8>();
+}
+#else
+const LightModelSimd::Kernels* LightModelSimd::AVX2Kernels()
+{
+	return 0;
+}
+#endif
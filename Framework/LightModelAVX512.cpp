@@ -0,0 +1,70 @@
+//***************************************************************************************
+// LightModelAVX512.cpp
+//
+// LightModelSimd kernels sixteen points at a time. Built with /arch:AVX512
+// (-mavx512f); the kernels are only used once LightModel has checked that the CPU
+// supports AVX-512F. Compilers without AVX-512 support build this file empty.
+//***************************************************************************************
+
+#include "LightModelSimd.h"
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+
+namespace
+{
+	struct Mask16
+	{
+		__mmask16 Bits;
+	};
+
+	struct Vec16
+	{
+		typedef Mask16 Mask;
+		static const unsigned int Width = 16;
+
+		static Vec16 Make(__m512 v)              { Vec16 r = { v }; return r; }
+		static Vec16 Set(float v)                { return Make(_mm512_set1_ps(v)); }
+		static Vec16 Load(const float* p)        { return Make(_mm512_loadu_ps(p)); }
+
+		__m512 V;
+	};
+
+	Mask16 MakeMask(__mmask16 bits)              { Mask16 r = { bits }; return r; }
+
+	void Store(float* p, Vec16 a)                { _mm512_storeu_ps(p, a.V); }
+
+	Vec16 operator+(Vec16 a, Vec16 b)            { return Vec16::Make(_mm512_add_ps(a.V, b.V)); }
+	Vec16 operator-(Vec16 a, Vec16 b)            { return Vec16::Make(_mm512_sub_ps(a.V, b.V)); }
+	Vec16 operator*(Vec16 a, Vec16 b)            { return Vec16::Make(_mm512_mul_ps(a.V, b.V)); }
+	Vec16 operator/(Vec16 a, Vec16 b)            { return Vec16::Make(_mm512_div_ps(a.V, b.V)); }
+	Vec16 Min(Vec16 a, Vec16 b)                  { return Vec16::Make(_mm512_min_ps(a.V, b.V)); }
+	Vec16 Max(Vec16 a, Vec16 b)                  { return Vec16::Make(_mm512_max_ps(a.V, b.V)); }
+	Vec16 Sqrt(Vec16 a)                          { return Vec16::Make(_mm512_sqrt_ps(a.V)); }
+
+	Mask16 Greater(Vec16 a, Vec16 b)             { return MakeMask(_mm512_cmp_ps_mask(a.V, b.V, _CMP_GT_OQ)); }
+	Mask16 LessEqual(Vec16 a, Vec16 b)           { return MakeMask(_mm512_cmp_ps_mask(a.V, b.V, _CMP_LE_OQ)); }
+	Mask16 And(Mask16 a, Mask16 b)               { return MakeMask((__mmask16)(a.Bits & b.Bits)); }
+	bool Any(Mask16 m)                           { return m.Bits != 0; }
+
+	Vec16 Select(Mask16 m, Vec16 a)              { return Vec16::Make(_mm512_maskz_mov_ps(m.Bits, a.V)); }
+	Vec16 Blend(Mask16 m, Vec16 a, Vec16 b)      { return Vec16::Make(_mm512_mask_blend_ps(m.Bits, b.V, a.V)); }
+
+	// getexp and getmant do the bit manipulation of the SSE2 and AVX2 versions.
+	Vec16 Exponent(Vec16 x)                      { return Vec16::Make(_mm512_getexp_ps(x.V)); }
+	Vec16 Mantissa(Vec16 x)                      { return Vec16::Make(_mm512_getmant_ps(x.V, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero)); }
+
+	Vec16 Round(Vec16 x)                         { return Vec16::Make(_mm512_roundscale_ps(x.V, _MM_FROUND_TO_NEAREST_INT)); }
+	Vec16 Pow2(Vec16 n)                          { return Vec16::Make(_mm512_scalef_ps(_mm512_set1_ps(1.0f), n.V)); }
+}
+
+const LightModelSimd::Kernels* LightModelSimd::AVX512Kernels()
+{
+	return MakeKernels<Vec16>();
+}
+#else
+const LightModelSimd::Kernels* LightModelSimd::AVX512Kernels()
+{
+	return 0;
+}
+#endif
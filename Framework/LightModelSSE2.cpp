@@ -0,0 +1,86 @@
+//***************************************************************************************
+// LightModelSSE2.cpp
+//
+// LightModelSimd kernels four points at a time. SSE2 is part of every x64 CPU, so this
+// needs no special compiler flags.
+//***************************************************************************************
+
+#include "LightModelSimd.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+
+namespace
+{
+	struct Mask4
+	{
+		__m128 Bits;
+	};
+
+	struct Vec4
+	{
+		typedef Mask4 Mask;
+		static const unsigned int Width = 4;
+
+		static Vec4 Make(__m128 v)               { Vec4 r = { v }; return r; }
+		static Vec4 Set(float v)                 { return Make(_mm_set1_ps(v)); }
+		static Vec4 Load(const float* p)         { return Make(_mm_loadu_ps(p)); }
+
+		__m128 V;
+	};
+
+	Mask4 MakeMask(__m128 bits)                  { Mask4 r = { bits }; return r; }
+
+	void Store(float* p, Vec4 a)                 { _mm_storeu_ps(p, a.V); }
+
+	Vec4 operator+(Vec4 a, Vec4 b)               { return Vec4::Make(_mm_add_ps(a.V, b.V)); }
+	Vec4 operator-(Vec4 a, Vec4 b)               { return Vec4::Make(_mm_sub_ps(a.V, b.V)); }
+	Vec4 operator*(Vec4 a, Vec4 b)               { return Vec4::Make(_mm_mul_ps(a.V, b.V)); }
+	Vec4 operator/(Vec4 a, Vec4 b)               { return Vec4::Make(_mm_div_ps(a.V, b.V)); }
+	Vec4 Min(Vec4 a, Vec4 b)                     { return Vec4::Make(_mm_min_ps(a.V, b.V)); }
+	Vec4 Max(Vec4 a, Vec4 b)                     { return Vec4::Make(_mm_max_ps(a.V, b.V)); }
+	Vec4 Sqrt(Vec4 a)                            { return Vec4::Make(_mm_sqrt_ps(a.V)); }
+
+	Mask4 Greater(Vec4 a, Vec4 b)                { return MakeMask(_mm_cmpgt_ps(a.V, b.V)); }
+	Mask4 LessEqual(Vec4 a, Vec4 b)              { return MakeMask(_mm_cmple_ps(a.V, b.V)); }
+	Mask4 And(Mask4 a, Mask4 b)                  { return MakeMask(_mm_and_ps(a.Bits, b.Bits)); }
+	bool Any(Mask4 m)                            { return _mm_movemask_ps(m.Bits) != 0; }
+
+	Vec4 Select(Mask4 m, Vec4 a)                 { return Vec4::Make(_mm_and_ps(m.Bits, a.V)); }
+	Vec4 Blend(Mask4 m, Vec4 a, Vec4 b)
+	{
+		return Vec4::Make(_mm_or_ps(_mm_and_ps(m.Bits, a.V), _mm_andnot_ps(m.Bits, b.V)));
+	}
+
+	Vec4 Exponent(Vec4 x)
+	{
+		__m128i bits = _mm_srli_epi32(_mm_castps_si128(x.V), 23);
+		return Vec4::Make(_mm_cvtepi32_ps(_mm_sub_epi32(bits, _mm_set1_epi32(127))));
+	}
+
+	Vec4 Mantissa(Vec4 x)
+	{
+		__m128 fraction = _mm_and_ps(x.V, _mm_castsi128_ps(_mm_set1_epi32(0x007FFFFF)));
+		return Vec4::Make(_mm_or_ps(fraction, _mm_set1_ps(1.0f)));
+	}
+
+	// cvtps rounds to nearest under the default rounding mode.
+	Vec4 Round(Vec4 x)                           { return Vec4::Make(_mm_cvtepi32_ps(_mm_cvtps_epi32(x.V))); }
+
+	Vec4 Pow2(Vec4 n)
+	{
+		__m128i exponent = _mm_add_epi32(_mm_cvtps_epi32(n.V), _mm_set1_epi32(127));
+		return Vec4::Make(_mm_castsi128_ps(_mm_slli_epi32(exponent, 23)));
+	}
+}
+
+const LightModelSimd::Kernels* LightModelSimd::SSE2Kernels()
+{
+	return MakeKernels<Vec4>();
+}
+#else
+const LightModelSimd::Kernels* LightModelSimd::SSE2Kernels()
+{
+	return 0;
+}
+#endif
@@ -0,0 +1,281 @@
+//***************************************************************************************
+// LightModelSimd.h
+//
+// The batch kernels behind LightModel::Batch*. They are written once against a small
+// vector interface and compiled once per instruction set, in LightModelSSE2.cpp,
+// LightModelAVX2.cpp and LightModelAVX512.cpp, each built with the compiler flags
+// for its instruction set. LightModel.cpp picks one at run time.
+//
+// A vector type V has a Width, a Mask type for comparison results and
+//   static V Set(float), static V Load(const float*), Store(float*, V),
+//   + - * /, Min, Max, Sqrt, Greater, LessEqual, And(Mask, Mask), Any(Mask),
+//   Select(Mask, V) (zero where the mask is clear), Blend(Mask, a, b),
+//   Exponent(x) and Mantissa(x) (x = Mantissa*2^Exponent with Mantissa in [1, 2)
+//   for positive normal x), Round(x) to the nearest integer and Pow2(n) = 2^n for
+//   integral n.
+// Loads and stores are unaligned.
+//***************************************************************************************
+
+#ifndef LIGHTMODELSIMD_H
+#define LIGHTMODELSIMD_H
+
+#include "LightModel.h"
+
+namespace LightModelSimd
+{
+	struct Kernels
+	{
+		unsigned int Width;
+
+		// Count in the batch must be a multiple of Width.
+		void (*Directional)(const LightModel::Material& mat, const LightModel::DirectionalLight& L,
+			const LightModel::PointBatch& points, const LightModel::TermBatch& out);
+		void (*Point)(const LightModel::Material& mat, const LightModel::PointLight& L,
+			const LightModel::PointBatch& points, const LightModel::TermBatch& out);
+		void (*Spot)(const LightModel::Material& mat, const LightModel::SpotLight& L,
+			const LightModel::PointBatch& points, const LightModel::TermBatch& out);
+	};
+
+	// Null when the build left that instruction set out.
+	const Kernels* SSE2Kernels();
+	const Kernels* AVX2Kernels();
+	const Kernels* AVX512Kernels();
+
+	// Everything below is compiled with a different instruction set by each file that
+	// includes it, so none of it may be shared between them by the linker.
+	namespace
+	{
+#pragma region Math
+		// log2(x) for positive x. The mantissa is brought into [sqrt(1/2), sqrt(2)) and
+		// log2(m) = 2/ln(2)*atanh(s) with s = (m - 1)/(m + 1), |s| < 0.172, summed to s^9.
+		template<class V>
+		V Log2(V x)
+		{
+			const V one = V::Set(1.0f);
+
+			V e = Exponent(x);
+			V m = Mantissa(x);
+
+			typename V::Mask high = Greater(m, V::Set(1.41421356f));
+			m = Blend(high, m*V::Set(0.5f), m);
+			e = e + Select(high, one);
+
+			V s = (m - one)/(m + one);
+			V s2 = s*s;
+			V series = (((s2*V::Set(1.0f/9.0f) + V::Set(1.0f/7.0f))*s2 + V::Set(1.0f/5.0f))*s2
+				+ V::Set(1.0f/3.0f))*s2 + one;
+
+			return e + s*series*V::Set(2.88539008f);
+		}
+
+		// 2^y = 2^n*e^(f*ln(2)) with n the nearest integer, so |f| <= 1/2 and a Taylor
+		// series to f^7 is accurate to a few parts in 10^9. Results below 2^-100 are
+		// flushed to zero, which keeps the products they end up in clear of denormals;
+		// those are very slow on most CPUs and a spot light's high power makes plenty.
+		template<class V>
+		V Exp2(V y)
+		{
+			const V smallest = V::Set(-100.0f);
+			typename V::Mask normal = Greater(y, smallest);
+			y = Min(Max(y, smallest), V::Set(127.0f));
+
+			V n = Round(y);
+			V t = (y - n)*V::Set(0.693147181f);
+
+			V series = V::Set(1.0f/5040.0f);
+			series = series*t + V::Set(1.0f/720.0f);
+			series = series*t + V::Set(1.0f/120.0f);
+			series = series*t + V::Set(1.0f/24.0f);
+			series = series*t + V::Set(1.0f/6.0f);
+			series = series*t + V::Set(0.5f);
+			series = series*t + V::Set(1.0f);
+			series = series*t + V::Set(1.0f);
+
+			return Select(normal, series*Pow2(n));
+		}
+
+		// x^power for x >= 0, with 0^power = 0.
+		template<class V>
+		V Pow(V x, float power)
+		{
+			return Select(Greater(x, V::Set(0.0f)), Exp2(Log2(x)*V::Set(power)));
+		}
+#pragma endregion
+
+#pragma region Kernels
+		// The light and material colors multiplied together, per channel.
+		struct LightColors
+		{
+			LightColors(const LightModel::Material& mat, const LightModel::Float4& ambient,
+				const LightModel::Float4& diffuse, const LightModel::Float4& specular)
+			{
+				Set(Ambient, mat.Ambient, ambient);
+				Set(Diffuse, mat.Diffuse, diffuse);
+				Set(Specular, mat.Specular, specular);
+			}
+
+			static void Set(float out[4], const LightModel::Float4& a, const LightModel::Float4& b)
+			{
+				out[0] = a.x*b.x;
+				out[1] = a.y*b.y;
+				out[2] = a.z*b.z;
+				out[3] = a.w*b.w;
+			}
+
+			float Ambient[4];
+			float Diffuse[4];
+			float Specular[4];
+		};
+
+		// Writes the terms of points [i, i + Width) given their per point factors.
+		template<class V>
+		void StoreTerms(const LightModel::TermBatch& out, size_t i, const LightColors& colors,
+			V ambient, V diffuse, V spec)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				Store(out.Ambient[c] + i, ambient*V::Set(colors.Ambient[c]));
+				Store(out.Diffuse[c] + i, diffuse*V::Set(colors.Diffuse[c]));
+				if (out.Spec[0])
+					Store(out.Spec[c] + i, spec*V::Set(colors.Specular[c]));
+			}
+		}
+
+		// Diffuse and specular factors, before attenuation, for unit light vectors l.
+		template<class V>
+		void DiffuseSpecular(const LightModel::PointBatch& points, size_t i, bool specular, float specPower,
+			V lx, V ly, V lz, V nx, V ny, V nz, typename V::Mask active, V& diffuse, V& spec)
+		{
+			V diffuseFactor = lx*nx + ly*ny + lz*nz;
+			typename V::Mask lit = And(active, Greater(diffuseFactor, V::Set(0.0f)));
+
+			diffuse = Select(lit, diffuseFactor);
+			spec = V::Set(0.0f);
+
+			if (specular)
+			{
+				// reflect(-l, n) = 2*dot(l, n)*n - l
+				V twice = diffuseFactor + diffuseFactor;
+				V vDotEye = (twice*nx - lx)*V::Load(points.ToEye[0] + i)
+					+ (twice*ny - ly)*V::Load(points.ToEye[1] + i)
+					+ (twice*nz - lz)*V::Load(points.ToEye[2] + i);
+
+				spec = Select(lit, Pow(Max(vDotEye, V::Set(0.0f)), specPower));
+			}
+		}
+
+		template<class V>
+		void Directional(const LightModel::Material& mat, const LightModel::DirectionalLight& L,
+			const LightModel::PointBatch& points, const LightModel::TermBatch& out)
+		{
+			const LightColors colors(mat, L.Ambient, L.Diffuse, L.Specular);
+			const bool specular = out.Spec[0] != 0;
+
+			const V lx = V::Set(-L.Direction.x);
+			const V ly = V::Set(-L.Direction.y);
+			const V lz = V::Set(-L.Direction.z);
+			const V one = V::Set(1.0f);
+			const typename V::Mask all = LessEqual(one, one);
+
+			for (size_t i = 0; i < points.Count; i += V::Width)
+			{
+				V nx = V::Load(points.Normal[0] + i);
+				V ny = V::Load(points.Normal[1] + i);
+				V nz = V::Load(points.Normal[2] + i);
+
+				V diffuse, spec;
+				DiffuseSpecular(points, i, specular, mat.Specular.w, lx, ly, lz, nx, ny, nz, all, diffuse, spec);
+
+				StoreTerms(out, i, colors, one, diffuse, spec);
+			}
+		}
+
+		// Point and spot lights; spotLight is null for a point light.
+		template<class V>
+		void Local(const LightModel::Material& mat, const LightModel::PointLight& L, const LightModel::SpotLight* spotLight,
+			const LightModel::PointBatch& points, const LightModel::TermBatch& out)
+		{
+			const LightColors colors(mat, L.Ambient, L.Diffuse, L.Specular);
+			const bool specular = out.Spec[0] != 0;
+
+			const V zero = V::Set(0.0f);
+			const V one = V::Set(1.0f);
+			const V range = V::Set(L.Range);
+
+			for (size_t i = 0; i < points.Count; i += V::Width)
+			{
+				V lx = V::Set(L.Position.x) - V::Load(points.Position[0] + i);
+				V ly = V::Set(L.Position.y) - V::Load(points.Position[1] + i);
+				V lz = V::Set(L.Position.z) - V::Load(points.Position[2] + i);
+
+				V d = Sqrt(lx*lx + ly*ly + lz*lz);
+				typename V::Mask inRange = LessEqual(d, range);
+				if (!Any(inRange))
+				{
+					StoreTerms(out, i, colors, zero, zero, zero);
+					continue;
+				}
+
+				V invDistance = one/d;
+				lx = lx*invDistance;
+				ly = ly*invDistance;
+				lz = lz*invDistance;
+
+				V diffuse, spec;
+				DiffuseSpecular(points, i, specular, mat.Specular.w, lx, ly, lz,
+					V::Load(points.Normal[0] + i), V::Load(points.Normal[1] + i), V::Load(points.Normal[2] + i),
+					inRange, diffuse, spec);
+
+				V att = one/(V::Set(L.Att.x) + V::Set(L.Att.y)*d + V::Set(L.Att.z)*d*d);
+				V ambient = Select(inRange, one);
+
+				if (spotLight)
+				{
+					V cosAngle = zero - (lx*V::Set(spotLight->Direction.x) + ly*V::Set(spotLight->Direction.y)
+						+ lz*V::Set(spotLight->Direction.z));
+					V spot = Select(inRange, Pow(Max(cosAngle, zero), spotLight->Spot));
+
+					ambient = spot;
+					att = att*spot;
+				}
+
+				StoreTerms(out, i, colors, ambient, Select(inRange, diffuse*att), Select(inRange, spec*att));
+			}
+		}
+
+		template<class V>
+		void Point(const LightModel::Material& mat, const LightModel::PointLight& L,
+			const LightModel::PointBatch& points, const LightModel::TermBatch& out)
+		{
+			Local<V>(mat, L, 0, points, out);
+		}
+
+		template<class V>
+		void Spot(const LightModel::Material& mat, const LightModel::SpotLight& L,
+			const LightModel::PointBatch& points, const LightModel::TermBatch& out)
+		{
+			// A spot light starts with the members of a point light, except that Att
+			// comes after Direction and Spot.
+			LightModel::PointLight point;
+			point.Ambient = L.Ambient;
+			point.Diffuse = L.Diffuse;
+			point.Specular = L.Specular;
+			point.Position = L.Position;
+			point.Range = L.Range;
+			point.Att = L.Att;
+			point.Pad = 0.0f;
+
+			Local<V>(mat, point, &L, points, out);
+		}
+
+		template<class V>
+		const Kernels* MakeKernels()
+		{
+			static const Kernels kernels = { V::Width, &Directional<V>, &Point<V>, &Spot<V> };
+			return &kernels;
+		}
+#pragma endregion
+	}
+}
+
+#endif // LIGHTMODELSIMD_H
@@ -0,0 +1,49 @@
+//***************************************************************************************
+// MeshBuilder.cpp
+//***************************************************************************************
+
+#include "MeshBuilder.h"
+
+MeshBuilder::Counts MeshBuilder::GridCounts(unsigned int m, unsigned int n)
+{
+	return Counts((size_t)m*n, (size_t)(m - 1)*(n - 1)*6);
+}
+
+MeshBuilder::Counts MeshBuilder::SphereCounts(unsigned int sliceCount, unsigned int stackCount)
+{
+	return Counts(2 + (size_t)(stackCount - 1)*(sliceCount + 1), (size_t)(stackCount - 1)*sliceCount*6);
+}
+
+MeshBuilder::Counts MeshBuilder::CylinderCounts(unsigned int sliceCount, unsigned int stackCount)
+{
+	return Counts((size_t)(stackCount + 1)*(sliceCount + 1) + 2*(sliceCount + 2),
+		(size_t)stackCount*sliceCount*6 + sliceCount*6);
+}
+
+MeshBuilder::Counts MeshBuilder::BoxCounts()
+{
+	return Counts(24, 36);
+}
+
+void MeshBuilder::GridIndices(unsigned int m, unsigned int n, unsigned int* indices, JobSystem* jobs)
+{
+	ForRows(m - 1, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			unsigned int* k = indices + (size_t)i*(n - 1)*6;
+			for (unsigned int j = 0; j < n - 1; ++j)
+			{
+				k[0] = i*n + j;
+				k[1] = i*n + j + 1;
+				k[2] = (i + 1)*n + j;
+
+				k[3] = (i + 1)*n + j;
+				k[4] = i*n + j + 1;
+				k[5] = (i + 1)*n + j + 1;
+
+				k += 6;
+			}
+		}
+	}, jobs);
+}
@@ -0,0 +1,358 @@
+//***************************************************************************************
+// MeshBuilder.h
+//
+// The grid, sphere, cylinder and box of Common's GeometryGenerator, written straight
+// into the caller's vertex and index arrays instead of a MeshData that then has to be
+// copied into them.
+//
+// The caller asks for the counts of every mesh first, sizes its arrays once and hands
+// each generator the place its mesh starts. Vertices are passed to a write functor
+// write(VertexType& out, const MeshBuilder::Attributes& in), which picks the
+// attributes its vertex type wants; indices are relative to the first vertex of the
+// mesh, as in MeshData. Rows, stacks and rings are generated in parallel when a job
+// system is given.
+//***************************************************************************************
+
+#ifndef MESHBUILDER_H
+#define MESHBUILDER_H
+
+#include "JobSystem.h"
+
+#include <cmath>
+#include <cstddef>
+
+namespace MeshBuilder
+{
+	// The members of GeometryGenerator::Vertex.
+	struct Attributes
+	{
+		float Position[3];
+		float Normal[3];
+		float TangentU[3];
+		float TexC[2];
+	};
+
+	struct Counts
+	{
+		Counts() : Vertices(0), Indices(0) {}
+		Counts(size_t vertices, size_t indices) : Vertices(vertices), Indices(indices) {}
+
+		Counts& operator+=(const Counts& rhs)  { Vertices += rhs.Vertices; Indices += rhs.Indices; return *this; }
+
+		size_t Vertices;
+		size_t Indices;
+	};
+
+	Counts GridCounts(unsigned int m, unsigned int n);
+	Counts SphereCounts(unsigned int sliceCount, unsigned int stackCount);
+	Counts CylinderCounts(unsigned int sliceCount, unsigned int stackCount);
+	Counts BoxCounts();
+
+	// Two triangles for each quad of an m x n vertex grid, as CreateGrid makes them.
+	void GridIndices(unsigned int m, unsigned int n, unsigned int* indices, JobSystem* jobs = 0);
+
+	// Calls func(begin, end) on rows [begin, end) of count, split over the jobs if any.
+	template<class F>
+	void ForRows(unsigned int count, const F& func, JobSystem* jobs)
+	{
+		if (jobs == 0)
+			func(0, count);
+		else
+			jobs->ParallelFor(0, count, [&](size_t begin, size_t end) { func((unsigned int)begin, (unsigned int)end); });
+	}
+
+	inline void Set(float* out, float x, float y, float z)
+	{
+		out[0] = x;
+		out[1] = y;
+		out[2] = z;
+	}
+
+	inline void Normalize(float* v)
+	{
+		float invLength = 1.0f/sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+		v[0] *= invLength;
+		v[1] *= invLength;
+		v[2] *= invLength;
+	}
+
+	inline Attributes MakeAttributes(float px, float py, float pz, float nx, float ny, float nz,
+		float tx, float ty, float tz, float u, float v)
+	{
+		Attributes a;
+		Set(a.Position, px, py, pz);
+		Set(a.Normal, nx, ny, nz);
+		Set(a.TangentU, tx, ty, tz);
+		a.TexC[0] = u;
+		a.TexC[1] = v;
+		return a;
+	}
+
+	// An m x n grid in the xz plane, centred on the origin; GridCounts(m, n).
+	template<class V, class W>
+	void CreateGrid(float width, float depth, unsigned int m, unsigned int n,
+		V* vertices, unsigned int* indices, const W& write, JobSystem* jobs = 0)
+	{
+		float halfWidth = 0.5f*width;
+		float halfDepth = 0.5f*depth;
+
+		float dx = width/(n - 1);
+		float dz = depth/(m - 1);
+
+		float du = 1.0f/(n - 1);
+		float dv = 1.0f/(m - 1);
+
+		ForRows(m, [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; ++i)
+			{
+				float z = halfDepth - i*dz;
+				for (unsigned int j = 0; j < n; ++j)
+				{
+					float x = -halfWidth + j*dx;
+					write(vertices[i*n + j], MakeAttributes(x, 0.0f, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, j*du, i*dv));
+				}
+			}
+		}, jobs);
+
+		GridIndices(m, n, indices, jobs);
+	}
+
+	// SphereCounts(sliceCount, stackCount).
+	template<class V, class W>
+	void CreateSphere(float radius, unsigned int sliceCount, unsigned int stackCount,
+		V* vertices, unsigned int* indices, const W& write, JobSystem* jobs = 0)
+	{
+		const float pi = 3.141592654f;
+
+		float phiStep = pi/stackCount;
+		float thetaStep = 2.0f*pi/sliceCount;
+		unsigned int ringVertexCount = sliceCount + 1;
+		unsigned int southPoleIndex = (stackCount - 1)*ringVertexCount + 1;
+
+		// Poles, then the rings in between from top to bottom.
+		write(vertices[0], MakeAttributes(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+		write(vertices[southPoleIndex], MakeAttributes(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f));
+
+		ForRows(stackCount - 1, [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int ring = begin; ring < end; ++ring)
+			{
+				float phi = (ring + 1)*phiStep;
+				for (unsigned int j = 0; j <= sliceCount; ++j)
+				{
+					float theta = j*thetaStep;
+
+					Attributes a;
+					Set(a.Position, radius*sinf(phi)*cosf(theta), radius*cosf(phi), radius*sinf(phi)*sinf(theta));
+
+					// Partial derivative of P with respect to theta.
+					Set(a.TangentU, -radius*sinf(phi)*sinf(theta), 0.0f, radius*sinf(phi)*cosf(theta));
+					Normalize(a.TangentU);
+
+					Set(a.Normal, a.Position[0], a.Position[1], a.Position[2]);
+					Normalize(a.Normal);
+
+					a.TexC[0] = theta/(2.0f*pi);
+					a.TexC[1] = phi/pi;
+
+					write(vertices[1 + ring*ringVertexCount + j], a);
+				}
+			}
+		}, jobs);
+
+		// Fan around the north pole, the quads of the rings, then the fan around the south pole.
+		unsigned int* k = indices;
+		for (unsigned int i = 1; i <= sliceCount; ++i)
+		{
+			*k++ = 0;
+			*k++ = i + 1;
+			*k++ = i;
+		}
+
+		ForRows(stackCount - 2, [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; ++i)
+			{
+				unsigned int* q = k + i*sliceCount*6;
+				for (unsigned int j = 0; j < sliceCount; ++j)
+				{
+					*q++ = 1 + i*ringVertexCount + j;
+					*q++ = 1 + i*ringVertexCount + j + 1;
+					*q++ = 1 + (i + 1)*ringVertexCount + j;
+
+					*q++ = 1 + (i + 1)*ringVertexCount + j;
+					*q++ = 1 + i*ringVertexCount + j + 1;
+					*q++ = 1 + (i + 1)*ringVertexCount + j + 1;
+				}
+			}
+		}, jobs);
+		k += (stackCount - 2)*sliceCount*6;
+
+		unsigned int baseIndex = southPoleIndex - ringVertexCount;
+		for (unsigned int i = 0; i < sliceCount; ++i)
+		{
+			*k++ = southPoleIndex;
+			*k++ = baseIndex + i;
+			*k++ = baseIndex + i + 1;
+		}
+	}
+
+	// CylinderCounts(sliceCount, stackCount); the side, then the top and bottom caps.
+	template<class V, class W>
+	void CreateCylinder(float bottomRadius, float topRadius, float height, unsigned int sliceCount, unsigned int stackCount,
+		V* vertices, unsigned int* indices, const W& write, JobSystem* jobs = 0)
+	{
+		const float pi = 3.141592654f;
+
+		float stackHeight = height/stackCount;
+		float radiusStep = (topRadius - bottomRadius)/stackCount;
+		float dTheta = 2.0f*pi/sliceCount;
+		unsigned int ringCount = stackCount + 1;
+		unsigned int ringVertexCount = sliceCount + 1;
+
+		ForRows(ringCount, [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; ++i)
+			{
+				float y = -0.5f*height + i*stackHeight;
+				float r = bottomRadius + i*radiusStep;
+
+				for (unsigned int j = 0; j <= sliceCount; ++j)
+				{
+					float c = cosf(j*dTheta);
+					float s = sinf(j*dTheta);
+
+					Attributes a;
+					Set(a.Position, r*c, y, r*s);
+					a.TexC[0] = (float)j/sliceCount;
+					a.TexC[1] = 1.0f - (float)i/stackCount;
+
+					// The normal is TangentU x Bitangent, with the bitangent pointing
+					// down the side of the (possibly tapered) cylinder.
+					Set(a.TangentU, -s, 0.0f, c);
+					float dr = bottomRadius - topRadius;
+					float bitangent[3] = { dr*c, -height, dr*s };
+					Set(a.Normal,
+						a.TangentU[1]*bitangent[2] - a.TangentU[2]*bitangent[1],
+						a.TangentU[2]*bitangent[0] - a.TangentU[0]*bitangent[2],
+						a.TangentU[0]*bitangent[1] - a.TangentU[1]*bitangent[0]);
+					Normalize(a.Normal);
+
+					write(vertices[i*ringVertexCount + j], a);
+				}
+			}
+		}, jobs);
+
+		unsigned int* k = indices;
+		for (unsigned int i = 0; i < stackCount; ++i)
+		{
+			for (unsigned int j = 0; j < sliceCount; ++j)
+			{
+				*k++ = i*ringVertexCount + j;
+				*k++ = (i + 1)*ringVertexCount + j;
+				*k++ = (i + 1)*ringVertexCount + j + 1;
+
+				*k++ = i*ringVertexCount + j;
+				*k++ = (i + 1)*ringVertexCount + j + 1;
+				*k++ = i*ringVertexCount + j + 1;
+			}
+		}
+
+		// Caps: a ring duplicated with the cap's normal and planar texture coordinates,
+		// then its centre.
+		unsigned int baseIndex = ringCount*ringVertexCount;
+		for (int cap = 0; cap < 2; ++cap)
+		{
+			bool top = cap == 0;
+			float y = top ? 0.5f*height : -0.5f*height;
+			float r = top ? topRadius : bottomRadius;
+			float ny = top ? 1.0f : -1.0f;
+
+			for (unsigned int i = 0; i <= sliceCount; ++i)
+			{
+				float x = r*cosf(i*dTheta);
+				float z = r*sinf(i*dTheta);
+
+				// Scale down by the height to try and make top cap texture coord area
+				// proportional to base.
+				float u = x/height + 0.5f;
+				float v = z/height + 0.5f;
+
+				write(vertices[baseIndex + i], MakeAttributes(x, y, z, 0.0f, ny, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
+			}
+
+			unsigned int centerIndex = baseIndex + ringVertexCount;
+			write(vertices[centerIndex], MakeAttributes(0.0f, y, 0.0f, 0.0f, ny, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f));
+
+			for (unsigned int i = 0; i < sliceCount; ++i)
+			{
+				*k++ = centerIndex;
+				*k++ = baseIndex + (top ? i + 1 : i);
+				*k++ = baseIndex + (top ? i : i + 1);
+			}
+
+			baseIndex = centerIndex + 1;
+		}
+	}
+
+	// BoxCounts(); four vertices per face so every face has its own normal.
+	template<class V, class W>
+	void CreateBox(float width, float height, float depth, V* vertices, unsigned int* indices, const W& write)
+	{
+		float w2 = 0.5f*width;
+		float h2 = 0.5f*height;
+		float d2 = 0.5f*depth;
+
+		const Attributes box[24] =
+		{
+			// Front face.
+			MakeAttributes(-w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+			MakeAttributes(-w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+			MakeAttributes(+w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+			MakeAttributes(+w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+
+			// Back face.
+			MakeAttributes(-w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+			MakeAttributes(+w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+			MakeAttributes(+w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+			MakeAttributes(-w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+
+			// Top face.
+			MakeAttributes(-w2, +h2, -d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+			MakeAttributes(-w2, +h2, +d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+			MakeAttributes(+w2, +h2, +d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+			MakeAttributes(+w2, +h2, -d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+
+			// Bottom face.
+			MakeAttributes(-w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+			MakeAttributes(+w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+			MakeAttributes(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+			MakeAttributes(-w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+
+			// Left face.
+			MakeAttributes(-w2, -h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f),
+			MakeAttributes(-w2, +h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f),
+			MakeAttributes(-w2, +h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f),
+			MakeAttributes(-w2, -h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f),
+
+			// Right face.
+			MakeAttributes(+w2, -h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f),
+			MakeAttributes(+w2, +h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f),
+			MakeAttributes(+w2, +h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f),
+			MakeAttributes(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f)
+		};
+
+		for (unsigned int i = 0; i < 24; ++i)
+			write(vertices[i], box[i]);
+
+		static const unsigned int faceIndices[6] = { 0, 1, 2, 0, 2, 3 };
+		for (unsigned int face = 0; face < 6; ++face)
+		{
+			for (unsigned int i = 0; i < 6; ++i)
+				indices[face*6 + i] = face*4 + faceIndices[i];
+		}
+	}
+}
+
+#endif // MESHBUILDER_H
@@ -0,0 +1,266 @@
+//***************************************************************************************
+// NoiseVolume.cpp
+//***************************************************************************************
+
+#include "NoiseVolume.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define NOISEVOLUME_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Offset of each octave in noise().
+	const float OctaveOffset[] = { 0.0f, 11.5f };
+
+	float Frac(float x)
+	{
+		return x - floorf(x);
+	}
+
+	float Lerp(float a, float b, float t)
+	{
+		return a + t*(b - a);
+	}
+
+	// The f*f*(3 - 2*f) of noise3, which makes the derivative continuous at cell borders.
+	float Smooth(float f)
+	{
+		return f*f*(3.0f - 2.0f*f);
+	}
+
+	float Wrap(float p, unsigned int period)
+	{
+		return period == 0 ? p : p - period*floorf(p/period);
+	}
+
+	// out[i] = a + b*w[i] for the first octave and out[i] += a + b*w[i] after that.
+	void AccumulateRun(float* out, const float* w, size_t count, float a, float b, bool add)
+	{
+		size_t i = 0;
+#if defined(NOISEVOLUME_SSE2)
+		__m128 va = _mm_set1_ps(a);
+		__m128 vb = _mm_set1_ps(b);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 v = _mm_add_ps(va, _mm_mul_ps(vb, _mm_loadu_ps(w + i)));
+			if (add)
+				v = _mm_add_ps(v, _mm_loadu_ps(out + i));
+			_mm_storeu_ps(out + i, v);
+		}
+#endif
+		for (; i < count; ++i)
+			out[i] = (add ? out[i] : 0.0f) + (a + b*w[i]);
+	}
+}
+
+float NoiseVolume::Hash3(float x, float y, float z)
+{
+	float d = x*1.0f + y*57.0f + z*-13.7f;
+	return Frac(sinf(1000.0f*d)*4375.5453f);
+}
+
+float NoiseVolume::Noise3(float x, float y, float z, unsigned int period)
+{
+	float p[3] = { floorf(x), floorf(y), floorf(z) };
+	float f[3] = { Smooth(Frac(x)), Smooth(Frac(y)), Smooth(Frac(z)) };
+
+	float p0[3], p1[3];
+	for (int j = 0; j < 3; ++j)
+	{
+		p0[j] = Wrap(p[j], period);
+		p1[j] = Wrap(p[j] + 1.0f, period);
+	}
+
+	return Lerp(
+		Lerp(Lerp(Hash3(p0[0], p0[1], p0[2]), Hash3(p1[0], p0[1], p0[2]), f[0]),
+			Lerp(Hash3(p0[0], p1[1], p0[2]), Hash3(p1[0], p1[1], p0[2]), f[0]), f[1]),
+		Lerp(Lerp(Hash3(p0[0], p0[1], p1[2]), Hash3(p1[0], p0[1], p1[2]), f[0]),
+			Lerp(Hash3(p0[0], p1[1], p1[2]), Hash3(p1[0], p1[1], p1[2]), f[0]), f[1]), f[2]);
+}
+
+float NoiseVolume::Noise(float x, float y, float z, unsigned int period)
+{
+	float o = OctaveOffset[1];
+	return (Noise3(x, y, z, period) + Noise3(x + o, y + o, z + o, period))/2.0f;
+}
+
+NoiseVolume::NoiseVolume(unsigned int period, unsigned int texelsPerCell)
+	: mPeriod(period), mTexelsPerCell(texelsPerCell)
+{
+	assert(period > 0 && texelsPerCell > 0);
+
+	mLattice.resize(period*period*period);
+	for (unsigned int z = 0; z < period; ++z)
+	{
+		for (unsigned int y = 0; y < period; ++y)
+		{
+			for (unsigned int x = 0; x < period; ++x)
+				mLattice[(z*period + y)*period + x] = Hash3((float)x, (float)y, (float)z);
+		}
+	}
+
+	BuildAxes();
+
+	size_t size = Size();
+	mTexels.resize(size*size*size);
+}
+
+unsigned int NoiseVolume::Period()const
+{
+	return mPeriod;
+}
+
+unsigned int NoiseVolume::TexelsPerCell()const
+{
+	return mTexelsPerCell;
+}
+
+unsigned int NoiseVolume::Size()const
+{
+	return mPeriod*mTexelsPerCell;
+}
+
+void NoiseVolume::Bake(JobSystem* jobs)
+{
+	unsigned int size = Size();
+
+	if (jobs == 0)
+	{
+		for (unsigned int z = 0; z < size; ++z)
+			BakeSlice(z);
+		return;
+	}
+
+	jobs->ParallelFor(0, size, [&](size_t begin, size_t end)
+	{
+		for (size_t z = begin; z < end; ++z)
+			BakeSlice((unsigned int)z);
+	});
+}
+
+void NoiseVolume::BakeReference()
+{
+	unsigned int size = Size();
+	for (unsigned int z = 0; z < size; ++z)
+	{
+		for (unsigned int y = 0; y < size; ++y)
+		{
+			for (unsigned int x = 0; x < size; ++x)
+			{
+				mTexels[((size_t)z*size + y)*size + x] =
+					Noise(TexelCoordinate(x), TexelCoordinate(y), TexelCoordinate(z), mPeriod);
+			}
+		}
+	}
+}
+
+float NoiseVolume::MaxError(size_t step)const
+{
+	size_t size = Size();
+
+	float maxError = 0.0f;
+	for (size_t i = 0; i < mTexels.size(); i += std::max<size_t>(step, 1))
+	{
+		unsigned int x = (unsigned int)(i % size);
+		unsigned int y = (unsigned int)(i/size % size);
+		unsigned int z = (unsigned int)(i/(size*size));
+
+		float expected = Noise(TexelCoordinate(x), TexelCoordinate(y), TexelCoordinate(z), mPeriod);
+		maxError = std::max(maxError, fabsf(mTexels[i] - expected));
+	}
+
+	return maxError;
+}
+
+const float* NoiseVolume::Texels()const
+{
+	return &mTexels[0];
+}
+
+void NoiseVolume::ToUNorm16(std::vector<unsigned short>& out)const
+{
+	out.resize(mTexels.size());
+	for (size_t i = 0; i < mTexels.size(); ++i)
+	{
+		float v = std::min(std::max(mTexels[i], 0.0f), 1.0f);
+		out[i] = (unsigned short)(v*65535.0f + 0.5f);
+	}
+}
+
+void NoiseVolume::BuildAxes()
+{
+	unsigned int size = Size();
+
+	for (unsigned int o = 0; o < Octaves; ++o)
+	{
+		Axis& axis = mAxes[o];
+		axis.Cell.resize(size);
+		axis.Weight.resize(size);
+
+		for (unsigned int i = 0; i < size; ++i)
+		{
+			float x = TexelCoordinate(i) + OctaveOffset[o];
+			axis.Cell[i] = (unsigned int)Wrap(floorf(x), mPeriod);
+			axis.Weight[i] = Smooth(Frac(x));
+		}
+	}
+}
+
+void NoiseVolume::BakeSlice(unsigned int z)
+{
+	unsigned int size = Size();
+	unsigned int period = mPeriod;
+
+	std::vector<float> edge(period);
+
+	for (unsigned int y = 0; y < size; ++y)
+	{
+		float* row = &mTexels[((size_t)z*size + y)*size];
+
+		for (unsigned int o = 0; o < Octaves; ++o)
+		{
+			const Axis& axis = mAxes[o];
+
+			unsigned int y0 = axis.Cell[y], y1 = (y0 + 1) % period;
+			unsigned int z0 = axis.Cell[z], z1 = (z0 + 1) % period;
+			float wy = axis.Weight[y];
+			float wz = axis.Weight[z];
+
+			// The y and z interpolation of the lattice edges along x that this row crosses.
+			for (unsigned int x = 0; x < period; ++x)
+			{
+				float a = Lerp(mLattice[(z0*period + y0)*period + x], mLattice[(z0*period + y1)*period + x], wy);
+				float b = Lerp(mLattice[(z1*period + y0)*period + x], mLattice[(z1*period + y1)*period + x], wy);
+				edge[x] = Lerp(a, b, wz);
+			}
+
+			// Each run of texels in one cell is a + b*w with the averaging of the two
+			// octaves folded into a and b.
+			for (unsigned int begin = 0; begin < size; )
+			{
+				unsigned int cell = axis.Cell[begin];
+				unsigned int end = begin + 1;
+				while (end < size && axis.Cell[end] == cell)
+					++end;
+
+				float e0 = edge[cell];
+				float e1 = edge[(cell + 1) % period];
+				AccumulateRun(row + begin, &axis.Weight[begin], end - begin, 0.5f*e0, 0.5f*(e1 - e0), o > 0);
+
+				begin = end;
+			}
+		}
+	}
+}
+
+float NoiseVolume::TexelCoordinate(unsigned int i)const
+{
+	return (i + 0.5f)/mTexelsPerCell;
+}
@@ -0,0 +1,82 @@
+//***************************************************************************************
+// NoiseVolume.h
+//
+// Bakes the value noise of Shaders_Intermediate's Lighting.fx (noise(), the average of
+// two noise3() octaves at an offset of 11.5) into a tileable volume, so the pixel
+// shader can replace sixteen sin based hashes with one filtered 3D texture fetch.
+//
+// The lattice wraps every Period cells on each axis, which makes the volume tile
+// seamlessly under WRAP addressing. Texel i along an axis holds the noise at cell
+// coordinate (i + 0.5)/TexelsPerCell, which is where a texture coordinate of
+// x/Period lands on texel centres, so the shader samples at x/Period.
+//
+// The hash is only ever evaluated at the Period^3 lattice points, with the same
+// single precision math as the shader. The texels are then interpolated a row at a
+// time: along a row the y and z weights are fixed and the smoothstep weight along x
+// repeats every cell, so a row is a handful of runs of a + b*w[i], done four texels
+// at a time with SSE2. Slices are spread over a job system when one is given.
+//***************************************************************************************
+
+#ifndef NOISEVOLUME_H
+#define NOISEVOLUME_H
+
+#include <cstddef>
+#include <vector>
+
+class JobSystem;
+
+class NoiseVolume
+{
+public:
+	// Scalar ports of the shader functions. A period of 0 leaves the lattice unwrapped,
+	// which is the shader as written.
+	static float Hash3(float x, float y, float z);
+	static float Noise3(float x, float y, float z, unsigned int period);
+	static float Noise(float x, float y, float z, unsigned int period);
+
+	NoiseVolume(unsigned int period = 8, unsigned int texelsPerCell = 16);
+
+	unsigned int Period()const;
+	unsigned int TexelsPerCell()const;
+
+	// Texels per side, Period*TexelsPerCell.
+	unsigned int Size()const;
+
+	void Bake(JobSystem* jobs = 0);
+	void BakeReference();
+
+	// Largest difference from Noise over every step-th texel.
+	float MaxError(size_t step)const;
+
+	// Size^3 texels in [0, 1), x fastest, then y, then z.
+	const float* Texels()const;
+
+	// The texels quantized for a DXGI_FORMAT_R16_UNORM texture.
+	void ToUNorm16(std::vector<unsigned short>& out)const;
+
+private:
+	// Where each texel along an axis falls in the lattice of one octave.
+	struct Axis
+	{
+		std::vector<unsigned int> Cell;
+		std::vector<float> Weight;
+	};
+
+	static const unsigned int Octaves = 2;
+
+	void BuildAxes();
+	void BakeSlice(unsigned int z);
+	float TexelCoordinate(unsigned int i)const;
+
+private:
+	unsigned int mPeriod;
+	unsigned int mTexelsPerCell;
+
+	// Hash of each lattice point, x fastest.
+	std::vector<float> mLattice;
+	Axis mAxes[Octaves];
+
+	std::vector<float> mTexels;
+};
+
+#endif // NOISEVOLUME_H
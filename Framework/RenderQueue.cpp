@@ -0,0 +1,141 @@
+//***************************************************************************************
+// RenderQueue.cpp
+//***************************************************************************************
+
+#include "RenderQueue.h"
+
+#pragma region RenderKey
+namespace
+{
+	uint64_t Field(unsigned int value, unsigned int bits, unsigned int shift)
+	{
+		return (uint64_t(value) & ((uint64_t(1) << bits) - 1)) << shift;
+	}
+
+	unsigned int Extract(uint64_t key, unsigned int bits, unsigned int shift)
+	{
+		return (unsigned int)((key >> shift) & ((uint64_t(1) << bits) - 1));
+	}
+}
+
+uint64_t RenderKey::Make(unsigned int pass, unsigned int technique, unsigned int texture,
+	unsigned int material, uint32_t depth)
+{
+	return Field(pass, PassBits, PassShift) |
+		Field(technique, TechniqueBits, TechniqueShift) |
+		Field(texture, TextureBits, TextureShift) |
+		Field(material, MaterialBits, MaterialShift) |
+		Field(depth, DepthBits, DepthShift);
+}
+
+uint32_t RenderKey::QuantizeDepth(float viewZ, float farZ, bool backToFront)
+{
+	const uint32_t maxDepth = (uint32_t(1) << DepthBits) - 1;
+
+	float t = farZ > 0.0f ? viewZ / farZ : 0.0f;
+	if (!(t > 0.0f)) t = 0.0f;		// also catches NaN
+	if (t > 1.0f) t = 1.0f;
+
+	uint32_t depth = (uint32_t)(t * (float)maxDepth);
+	if (depth > maxDepth) depth = maxDepth;
+
+	return backToFront ? maxDepth - depth : depth;
+}
+
+unsigned int RenderKey::Pass(uint64_t key)      { return Extract(key, PassBits, PassShift); }
+unsigned int RenderKey::Technique(uint64_t key) { return Extract(key, TechniqueBits, TechniqueShift); }
+unsigned int RenderKey::Texture(uint64_t key)   { return Extract(key, TextureBits, TextureShift); }
+unsigned int RenderKey::Material(uint64_t key)  { return Extract(key, MaterialBits, MaterialShift); }
+uint32_t RenderKey::Depth(uint64_t key)         { return Extract(key, DepthBits, DepthShift); }
+#pragma endregion
+
+#pragma region RenderQueue
+RenderQueue::RenderQueue(size_t reserve)
+	: mLastPasses(0)
+{
+	mItems.reserve(reserve);
+	mScratch.reserve(reserve);
+}
+
+void RenderQueue::Push(uint64_t key, uint32_t payload)
+{
+	Item item = { key, payload };
+	mItems.push_back(item);
+}
+
+void RenderQueue::Sort()
+{
+	mLastPasses = 0;
+
+	size_t count = mItems.size();
+	if (count < 2)
+		return;
+
+	// One sweep builds the histograms of all eight bytes.
+	size_t histograms[8][256] = {};
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint64_t key = mItems[i].Key;
+		for (unsigned int b = 0; b < 8; ++b)
+			++histograms[b][(key >> (b * 8)) & 0xFF];
+	}
+
+	mScratch.resize(count);
+	Item* src = &mItems[0];
+	Item* dst = &mScratch[0];
+
+	for (unsigned int b = 0; b < 8; ++b)
+	{
+		size_t* histogram = histograms[b];
+
+		// Every key has the same byte here; this pass would not move anything.
+		if (histogram[(src[0].Key >> (b * 8)) & 0xFF] == count)
+			continue;
+
+		size_t offsets[256];
+		size_t sum = 0;
+		for (unsigned int i = 0; i < 256; ++i)
+		{
+			offsets[i] = sum;
+			sum += histogram[i];
+		}
+
+		for (size_t i = 0; i < count; ++i)
+			dst[offsets[(src[i].Key >> (b * 8)) & 0xFF]++] = src[i];
+
+		Item* tmp = src;
+		src = dst;
+		dst = tmp;
+		++mLastPasses;
+	}
+
+	// An odd number of passes leaves the result in the scratch buffer.
+	if (src != &mItems[0])
+		mItems.swap(mScratch);
+}
+#pragma endregion
+
+#pragma region RenderStateCache
+void RenderStateCache::Reset()
+{
+	for (int i = 0; i < SlotCount; ++i)
+	{
+		mBound[i] = 0;
+		mValid[i] = false;
+	}
+}
+
+bool RenderStateCache::Bind(Slot slot, uint32_t id)
+{
+	if (mValid[slot] && mBound[slot] == id)
+	{
+		++mStats.Redundant;
+		return false;
+	}
+
+	mBound[slot] = id;
+	mValid[slot] = true;
+	++mStats.Binds;
+	return true;
+}
+#pragma endregion
@@ -0,0 +1,142 @@
+//***************************************************************************************
+// RenderQueue.h
+//
+// State-sorted draw submission. Every draw is described by a 64-bit sort key and a
+// 32-bit payload (normally an index into the caller's own draw records). The queue
+// radix-sorts the keys once per frame, so draws sharing a technique, texture and
+// material end up next to each other, and a RenderStateCache drops the binds that
+// would set what is already bound.
+//
+// Like the rest of Framework this never talks to Direct3D; the ids in the key and
+// the state cache are whatever small integers the caller assigns to its resources.
+//***************************************************************************************
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#pragma region RenderKey
+// Key layout, most significant first:
+//
+//   63..60  pass        (4 bits)   e.g. opaque before reflective before transparent
+//   59..52  technique   (8 bits)
+//   51..40  texture     (12 bits)
+//   39..28  material    (12 bits)
+//   27..0   depth       (28 bits)  quantized view depth, front to back
+//
+// Sorting ascending therefore groups by pass, then state, and draws near objects
+// first within one state so early-z rejects more of the far ones.
+namespace RenderKey
+{
+	const unsigned int PassBits      = 4;
+	const unsigned int TechniqueBits = 8;
+	const unsigned int TextureBits   = 12;
+	const unsigned int MaterialBits  = 12;
+	const unsigned int DepthBits     = 28;
+
+	const unsigned int DepthShift     = 0;
+	const unsigned int MaterialShift  = DepthShift + DepthBits;
+	const unsigned int TextureShift   = MaterialShift + MaterialBits;
+	const unsigned int TechniqueShift = TextureShift + TextureBits;
+	const unsigned int PassShift      = TechniqueShift + TechniqueBits;
+
+	// Fields wider than their bit range are masked, not clamped.
+	uint64_t Make(unsigned int pass, unsigned int technique, unsigned int texture,
+		unsigned int material, uint32_t depth);
+
+	// Maps a view space depth in [0, farZ] to the depth field. Depths outside the
+	// range are clamped. Pass backToFront for blended draws.
+	uint32_t QuantizeDepth(float viewZ, float farZ, bool backToFront = false);
+
+	unsigned int Pass(uint64_t key);
+	unsigned int Technique(uint64_t key);
+	unsigned int Texture(uint64_t key);
+	unsigned int Material(uint64_t key);
+	uint32_t Depth(uint64_t key);
+}
+#pragma endregion
+
+#pragma region RenderQueue
+class RenderQueue
+{
+public:
+	struct Item
+	{
+		uint64_t Key;
+		uint32_t Payload;
+	};
+
+	RenderQueue() : mLastPasses(0) {}
+	explicit RenderQueue(size_t reserve);
+
+	void Clear()                           { mItems.clear(); }
+	void Push(uint64_t key, uint32_t payload);
+
+	// Stable LSD radix sort on the key, one byte per pass. Passes over a byte that
+	// is the same for every item are skipped, which is the common case for the pass
+	// and technique bytes.
+	void Sort();
+
+	size_t Size()const                     { return mItems.size(); }
+	bool Empty()const                      { return mItems.empty(); }
+	const Item& operator[](size_t i)const  { return mItems[i]; }
+	const std::vector<Item>& Items()const  { return mItems; }
+
+	// Byte passes the last Sort() actually performed, out of 8.
+	unsigned int LastSortPasses()const     { return mLastPasses; }
+
+private:
+	std::vector<Item> mItems;
+	std::vector<Item> mScratch;
+	unsigned int mLastPasses;
+};
+#pragma endregion
+
+#pragma region RenderStateCache
+// Remembers what is bound in each state slot so binds of the current value can be
+// skipped. Ids are the caller's; 0 is a valid id, nothing bound is tracked apart.
+class RenderStateCache
+{
+public:
+	enum Slot
+	{
+		Technique,
+		Texture,
+		CubeMap,
+		Material,
+		Geometry,
+
+		SlotCount
+	};
+
+	struct Stats
+	{
+		Stats() : Binds(0), Redundant(0) {}
+
+		size_t Binds;			// binds that changed state and were passed on
+		size_t Redundant;		// binds that matched the bound value and were dropped
+	};
+
+	RenderStateCache()                     { Reset(); }
+
+	// Forgets everything bound, e.g. at the start of a pass or after other code
+	// touched the device state. Stats are kept.
+	void Reset();
+
+	// Returns true if the caller must issue the bind.
+	bool Bind(Slot slot, uint32_t id);
+
+	const Stats& GetStats()const           { return mStats; }
+	void ResetStats()                      { mStats = Stats(); }
+
+private:
+	uint32_t mBound[SlotCount];
+	bool mValid[SlotCount];
+	Stats mStats;
+};
+#pragma endregion
+
+#endif // RENDERQUEUE_H
@@ -0,0 +1,221 @@
+//***************************************************************************************
+// ResourceRegistry.cpp
+//***************************************************************************************
+
+#include "ResourceRegistry.h"
+
+#include <cassert>
+
+uint64_t ContentHash(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+uint64_t ContentKey(ResourceKind kind, const void* data, size_t size)
+{
+	uint32_t header[3] = { (uint32_t)kind, (uint32_t)size, (uint32_t)((uint64_t)size >> 32) };
+	return ContentHash(data, size, ContentHash(header, sizeof(header)));
+}
+
+ResourceRegistry::Table::Table(size_t slots)
+	: Slots(slots), Mask(slots - 1)
+{
+	for (size_t i = 0; i < slots; ++i)
+		Slots[i].store(0, std::memory_order_relaxed);
+}
+
+ResourceRegistry::ResourceRegistry(size_t capacity)
+	: mEntries(0), mLive(0), mCreated(0)
+{
+	// Twice the capacity rounded up to a power of two keeps the probes short.
+	size_t slots = 2;
+	while (slots < 2*capacity)
+		slots *= 2;
+
+	mTables.push_back(new Table(slots));
+	mTable.store(mTables.back(), std::memory_order_relaxed);
+}
+
+ResourceRegistry::~ResourceRegistry()
+{
+	Table* table = mTable.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < table->Slots.size(); ++i)
+	{
+		Entry* entry = table->Slots[i].load(std::memory_order_relaxed);
+		if (entry == 0)
+			continue;
+
+		assert(entry->Refs.load(std::memory_order_relaxed) != Creating);
+		if (entry->Refs.load(std::memory_order_relaxed) >= 0 && entry->Resource)
+			entry->Destroy(entry->Resource);
+		delete entry;
+	}
+
+	for (size_t i = 0; i < mTables.size(); ++i)
+		delete mTables[i];
+}
+
+ResourceRegistry::Entry* ResourceRegistry::Acquire(uint64_t key, uint64_t size, const CreateFunction& create, DestroyFunction destroy)
+{
+	Entry* entry = Find(key, size);
+	if (entry && TryAddRef(entry))
+		return entry;
+
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	entry = Find(key, size);
+	if (entry == 0)
+		entry = Insert(key, size);
+
+	// Another thread may have created it since the lookup above, or be creating it
+	// now; then wait for that create rather than run another.
+	for (;;)
+	{
+		if (TryAddRef(entry))
+			return entry;
+		if (entry->Refs.load(std::memory_order_relaxed) != Creating)
+			break;
+		mCreateDone.wait(lock);
+	}
+
+	entry->Refs.store(Creating, std::memory_order_relaxed);
+	lock.unlock();
+
+	void* resource = create();
+
+	lock.lock();
+	if (resource)
+	{
+		entry->Resource = resource;
+		entry->Destroy = destroy;
+		mLive.fetch_add(1, std::memory_order_relaxed);
+		++mCreated;
+	}
+
+	// A failed create leaves the entry destroyed, and the next acquire tries again.
+	entry->Refs.store(resource ? 1 : (int)Destroyed, std::memory_order_release);
+	mCreateDone.notify_all();
+	return resource ? entry : 0;
+}
+
+void ResourceRegistry::AddRef(Entry* entry)
+{
+	// Only called through a handle, so the resource is alive.
+	int refs = entry->Refs.fetch_add(1, std::memory_order_relaxed);
+	assert(refs > 0);
+	(void)refs;
+}
+
+void ResourceRegistry::Release(Entry* entry)
+{
+	if (entry->Refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPendingRelease.push_back(entry);
+	}
+}
+
+void ResourceRegistry::EndFrame()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	for (size_t i = 0; i < mPendingRelease.size(); ++i)
+	{
+		Entry* entry = mPendingRelease[i];
+
+		// An entry reacquired since it was released keeps its resource; one released
+		// twice in the frame is only destroyed the first time.
+		int expected = 0;
+		if (entry->Refs.compare_exchange_strong(expected, (int)Destroyed, std::memory_order_acq_rel))
+		{
+			entry->Destroy(entry->Resource);
+			entry->Resource = 0;
+			mLive.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+	mPendingRelease.clear();
+}
+
+size_t ResourceRegistry::LiveCount()const
+{
+	return mLive.load(std::memory_order_relaxed);
+}
+
+size_t ResourceRegistry::CreatedCount()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mCreated;
+}
+
+ResourceRegistry::Entry* ResourceRegistry::Find(uint64_t key, uint64_t size)const
+{
+	const Table* table = mTable.load(std::memory_order_acquire);
+	for (size_t i = (size_t)key & table->Mask; ; i = (i + 1) & table->Mask)
+	{
+		Entry* entry = table->Slots[i].load(std::memory_order_acquire);
+		if (entry == 0)
+			return 0;
+		if (entry->Key == key && entry->Size == size)
+			return entry;
+	}
+}
+
+ResourceRegistry::Entry* ResourceRegistry::Insert(uint64_t key, uint64_t size)
+{
+	// Keep at least half the table empty so probes for missing keys end quickly.
+	Table* table = mTable.load(std::memory_order_relaxed);
+	if (2*(mEntries + 1) > table->Slots.size())
+	{
+		Table* grown = new Table(2*table->Slots.size());
+		for (size_t i = 0; i < table->Slots.size(); ++i)
+		{
+			Entry* entry = table->Slots[i].load(std::memory_order_relaxed);
+			if (entry)
+				Place(*grown, entry);
+		}
+
+		// Threads still probing the old table find what they did before, or miss and
+		// come here under the lock.
+		mTables.push_back(grown);
+		mTable.store(grown, std::memory_order_release);
+		table = grown;
+	}
+
+	Entry* entry = new Entry;
+	entry->Key = key;
+	entry->Size = size;
+	entry->Refs.store(Destroyed, std::memory_order_relaxed);
+	entry->Resource = 0;
+	entry->Destroy = 0;
+
+	Place(*table, entry);
+	++mEntries;
+	return entry;
+}
+
+void ResourceRegistry::Place(Table& table, Entry* entry)
+{
+	size_t i = (size_t)entry->Key & table.Mask;
+	while (table.Slots[i].load(std::memory_order_relaxed) != 0)
+		i = (i + 1) & table.Mask;
+	table.Slots[i].store(entry, std::memory_order_release);
+}
+
+bool ResourceRegistry::TryAddRef(Entry* entry)
+{
+	int refs = entry->Refs.load(std::memory_order_relaxed);
+	while (refs >= 0)
+	{
+		if (entry->Refs.compare_exchange_weak(refs, refs + 1, std::memory_order_acquire, std::memory_order_relaxed))
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,194 @@
+//***************************************************************************************
+// ResourceRegistry.h
+//
+// Creates every distinct resource once. Resources are looked up by a 64-bit key,
+// normally the content hash of what they are created from (a compiled effect, the
+// bytes of a texture file, an input layout description plus its shader signature,
+// the initial data of an immutable buffer), so two requests for the same content
+// share one resource. Acquire hands out refcounted ResourceHandles.
+//
+// A resource whose last handle is released is not destroyed right away but at the
+// next EndFrame, and only if nothing acquired it again meanwhile; a resource that is
+// dropped and reloaded within a frame is never recreated.
+//
+// An entry matches on its key and the size of the content it was made from, so two
+// contents that hash alike collide only if their sizes are equal too.
+//
+// Acquire of a live resource, copying and releasing handles take no lock: entries
+// live in an open addressing table that is only ever appended to, and an entry stays
+// in place after its resource is destroyed, ready to be recreated under the same
+// key. A table half full is replaced by one twice its size; the old tables are kept
+// until the registry goes, as threads may still be probing them.
+//
+// The create function runs without the registry's lock, so it may acquire other
+// resources from the same registry. Meanwhile the entry is marked as being created,
+// and other threads acquiring that key wait for it; threads after other keys do not.
+//
+// The registry never talks to Direct3D itself; the caller passes the functions that
+// create and destroy its resources.
+//***************************************************************************************
+
+#ifndef RESOURCEREGISTRY_H
+#define RESOURCEREGISTRY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+enum ResourceKind
+{
+	EffectResource,
+	TextureResource,
+	InputLayoutResource,
+	BufferResource
+};
+
+// 64-bit FNV-1a; chain calls through seed to hash several pieces of content.
+uint64_t ContentHash(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+// Hash of the kind, the size and the content, so different kinds of resource made
+// from the same bytes get different keys.
+uint64_t ContentKey(ResourceKind kind, const void* data, size_t size);
+
+template<class T> class ResourceHandle;
+
+class ResourceRegistry
+{
+public:
+	typedef std::function<void*()> CreateFunction;
+	typedef void (*DestroyFunction)(void* resource);
+
+	// Refs of an entry without a live resource.
+	enum { Destroyed = -1, Creating = -2 };
+
+	struct Entry
+	{
+		uint64_t Key;
+		uint64_t Size;
+
+		// Handles held, Destroyed, or Creating while a thread runs create.
+		std::atomic<int> Refs;
+
+		void* Resource;
+		DestroyFunction Destroy;
+	};
+
+	// Room for capacity keys before the table first grows.
+	explicit ResourceRegistry(size_t capacity = 1024);
+
+	// Destroys every resource still alive, handles or not.
+	~ResourceRegistry();
+
+	// The resource under key and size, the size of the content key was hashed from,
+	// with a handle added; created with create if there is none. Returns 0 if create
+	// returns 0.
+	Entry* Acquire(uint64_t key, uint64_t size, const CreateFunction& create, DestroyFunction destroy);
+
+	template<class T>
+	ResourceHandle<T> Acquire(uint64_t key, uint64_t size, const std::function<T*()>& create, DestroyFunction destroy);
+
+	void AddRef(Entry* entry);
+	void Release(Entry* entry);
+
+	// Destroys the resources released since the last call that nothing acquired again.
+	void EndFrame();
+
+	// Resources alive now, and created over the life of the registry.
+	size_t LiveCount()const;
+	size_t CreatedCount()const;
+
+private:
+	ResourceRegistry(const ResourceRegistry& rhs);
+	ResourceRegistry& operator=(const ResourceRegistry& rhs);
+
+	struct Table
+	{
+		explicit Table(size_t slots);
+
+		std::vector<std::atomic<Entry*> > Slots;
+		size_t Mask;
+	};
+
+	Entry* Find(uint64_t key, uint64_t size)const;
+	Entry* Insert(uint64_t key, uint64_t size);
+	static void Place(Table& table, Entry* entry);
+	static bool TryAddRef(Entry* entry);
+
+	// The table probed now, and every table before it.
+	std::atomic<Table*> mTable;
+	std::vector<Table*> mTables;
+	size_t mEntries;
+
+	std::vector<Entry*> mPendingRelease;
+	std::atomic<size_t> mLive;
+	size_t mCreated;
+
+	mutable std::mutex mMutex;
+
+	// Signalled whenever a create finishes.
+	std::condition_variable mCreateDone;
+};
+
+// Counted reference to a registry resource. Copying adds a reference, destruction or
+// Reset releases it.
+template<class T>
+class ResourceHandle
+{
+public:
+	ResourceHandle() : mRegistry(0), mEntry(0) {}
+
+	// Takes over a reference already added to entry.
+	ResourceHandle(ResourceRegistry* registry, ResourceRegistry::Entry* entry)
+		: mRegistry(registry), mEntry(entry) {}
+
+	ResourceHandle(const ResourceHandle& rhs)
+		: mRegistry(rhs.mRegistry), mEntry(rhs.mEntry)
+	{
+		if (mEntry)
+			mRegistry->AddRef(mEntry);
+	}
+
+	~ResourceHandle()
+	{
+		Reset();
+	}
+
+	ResourceHandle& operator=(const ResourceHandle& rhs)
+	{
+		if (rhs.mEntry)
+			rhs.mRegistry->AddRef(rhs.mEntry);
+		Reset();
+		mRegistry = rhs.mRegistry;
+		mEntry = rhs.mEntry;
+		return *this;
+	}
+
+	void Reset()
+	{
+		if (mEntry)
+			mRegistry->Release(mEntry);
+		mRegistry = 0;
+		mEntry = 0;
+	}
+
+	T* Get()const              { return mEntry ? static_cast<T*>(mEntry->Resource) : 0; }
+	T* operator->()const       { return Get(); }
+	bool IsNull()const         { return mEntry == 0; }
+
+private:
+	ResourceRegistry* mRegistry;
+	ResourceRegistry::Entry* mEntry;
+};
+
+template<class T>
+ResourceHandle<T> ResourceRegistry::Acquire(uint64_t key, uint64_t size, const std::function<T*()>& create, DestroyFunction destroy)
+{
+	Entry* entry = Acquire(key, size, [&create]() -> void* { return create(); }, destroy);
+	return ResourceHandle<T>(entry ? this : 0, entry);
+}
+
+#endif // RESOURCEREGISTRY_H
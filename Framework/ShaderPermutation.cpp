@@ -0,0 +1,158 @@
+//***************************************************************************************
+// ShaderPermutation.cpp
+//***************************************************************************************
+
+#include "ShaderPermutation.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#pragma region PermutationKey
+PermutationKey PermutationKey::Make(unsigned int lightCount, bool texture,
+	bool alphaClip, bool fog, bool reflect)
+{
+	unsigned int bits = std::min(lightCount, 3u);
+	if (texture)   bits |= Texture;
+	if (alphaClip) bits |= AlphaClip;
+	if (fog)       bits |= Fog;
+	if (reflect)   bits |= Reflect;
+
+	return PermutationKey(bits);
+}
+
+PermutationKey PermutationKey::WithLightCount(unsigned int lightCount)const
+{
+	return PermutationKey((Bits & ~LightCountMask) | std::min(lightCount, 3u));
+}
+
+bool PermutationKey::IsValid()const
+{
+	if (Has(AlphaClip) && !Has(Texture))
+		return false;
+
+	if (LightCount() == 0 && !Has(Texture))
+		return false;
+
+	if (Has(Clustered) && (LightCount() == 0 || Has(AlphaClip) || Has(Fog)))
+		return false;
+
+	return true;
+}
+
+std::string PermutationKey::TechniqueName()const
+{
+	std::ostringstream name;
+	name << "Light" << LightCount();
+
+	if (Has(Texture))   name << "Tex";
+	if (Has(AlphaClip)) name << "AlphaClip";
+	if (Has(Fog))       name << "Fog";
+	if (Has(Reflect))   name << "Reflect";
+	if (Has(Clustered)) name << "Clustered";
+
+	return name.str();
+}
+
+bool PermutationKey::FromTechniqueName(const std::string& name, PermutationKey& key)
+{
+	// "Light" + digit, followed by the feature suffixes in the fixed order used
+	// by TechniqueName().
+	if (name.size() < 6 || name.compare(0, 5, "Light") != 0)
+		return false;
+
+	char digit = name[5];
+	if (digit < '0' || digit > '3')
+		return false;
+
+	static const struct { const char* Suffix; Feature Bit; } suffixes[] =
+	{
+		{ "Tex",       Texture   },
+		{ "AlphaClip", AlphaClip },
+		{ "Fog",       Fog       },
+		{ "Reflect",   Reflect   },
+		{ "Clustered", Clustered }
+	};
+
+	unsigned int bits = (unsigned int)(digit - '0');
+	size_t pos = 6;
+	for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i)
+	{
+		size_t len = std::char_traits<char>::length(suffixes[i].Suffix);
+		if (name.compare(pos, len, suffixes[i].Suffix) == 0)
+		{
+			bits |= suffixes[i].Bit;
+			pos += len;
+		}
+	}
+
+	if (pos != name.size())
+		return false;
+
+	PermutationKey parsed(bits);
+	if (!parsed.IsValid())
+		return false;
+
+	key = parsed;
+	return true;
+}
+#pragma endregion
+
+#pragma region WarmupList
+bool WarmupList::Add(PermutationKey key)
+{
+	if (Contains(key))
+		return false;
+
+	mKeys.push_back(key);
+	return true;
+}
+
+bool WarmupList::Contains(PermutationKey key)const
+{
+	return std::find(mKeys.begin(), mKeys.end(), key) != mKeys.end();
+}
+
+bool WarmupList::Load(const std::string& filename)
+{
+	mKeys.clear();
+
+	std::ifstream fin(filename.c_str());
+	if (!fin)
+		return false;
+
+	Read(fin);
+	return true;
+}
+
+bool WarmupList::Save(const std::string& filename)const
+{
+	std::ofstream fout(filename.c_str());
+	if (!fout)
+		return false;
+
+	Write(fout);
+	return fout.good();
+}
+
+void WarmupList::Read(std::istream& in)
+{
+	std::string line;
+	while (std::getline(in, line))
+	{
+		// Tolerate files edited on Windows.
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+
+		PermutationKey key;
+		if (PermutationKey::FromTechniqueName(line, key))
+			Add(key);
+	}
+}
+
+void WarmupList::Write(std::ostream& out)const
+{
+	for (size_t i = 0; i < mKeys.size(); ++i)
+		out << mKeys[i].TechniqueName() << '\n';
+}
+#pragma endregion
@@ -0,0 +1,250 @@
+//***************************************************************************************
+// ShaderPermutation.h
+//
+// Feature-bitfield keys for effect technique permutations, a cache that builds each
+// permutation the first time it is requested, and a warm-up list that records which
+// permutations a run actually used so the next startup only builds those.
+//
+// Nothing in here touches Direct3D; the cache is parameterized on what a "compiled"
+// permutation is, so the key/caching/warm-up logic can be exercised headless.
+//***************************************************************************************
+
+#ifndef SHADERPERMUTATION_H
+#define SHADERPERMUTATION_H
+
+#include <condition_variable>
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#pragma region PermutationKey
+class PermutationKey
+{
+public:
+	// Bit layout: the light count (0..3) lives in the low two bits, the remaining
+	// bits each switch one feature of the Basic.fx pixel shader on.
+	enum Feature
+	{
+		LightCountMask = 0x03,
+		Texture        = 1 << 2,
+		AlphaClip      = 1 << 3,
+		Fog            = 1 << 4,
+		Reflect        = 1 << 5,
+		Clustered      = 1 << 6,
+
+		AllBits        = 0x7F
+	};
+
+	PermutationKey() : Bits(0) {}
+	explicit PermutationKey(unsigned int bits) : Bits(bits & AllBits) {}
+
+	static PermutationKey Make(unsigned int lightCount, bool texture = false,
+		bool alphaClip = false, bool fog = false, bool reflect = false);
+
+	unsigned int LightCount()const           { return Bits & LightCountMask; }
+	bool Has(Feature feature)const           { return (Bits & feature) != 0; }
+
+	PermutationKey With(Feature feature)const    { return PermutationKey(Bits | feature); }
+	PermutationKey Without(Feature feature)const { return PermutationKey(Bits & ~feature); }
+	PermutationKey WithLightCount(unsigned int lightCount)const;
+
+	// Alpha clipping needs a texture, and an untextured surface needs at least one
+	// light; clustered lights are only added to lit surfaces without alpha clipping
+	// or fog. Basic.fx has no technique for the other combinations.
+	bool IsValid()const;
+
+	// Technique name in Basic.fx, e.g. "Light2TexFog" or "Light3ReflectClustered".
+	std::string TechniqueName()const;
+	static bool FromTechniqueName(const std::string& name, PermutationKey& key);
+
+	bool operator==(const PermutationKey& rhs)const { return Bits == rhs.Bits; }
+	bool operator!=(const PermutationKey& rhs)const { return Bits != rhs.Bits; }
+	bool operator<(const PermutationKey& rhs)const  { return Bits < rhs.Bits; }
+
+	unsigned int Bits;
+};
+#pragma endregion
+
+#pragma region WarmupList
+// Ordered, duplicate-free list of permutation keys, stored on disk as one
+// technique name per line so it can be inspected and edited by hand.
+class WarmupList
+{
+public:
+	// Returns true if the key was not in the list yet.
+	bool Add(PermutationKey key);
+	bool Contains(PermutationKey key)const;
+
+	const std::vector<PermutationKey>& Keys()const { return mKeys; }
+	size_t Size()const                              { return mKeys.size(); }
+	void Clear()                                    { mKeys.clear(); }
+
+	// Unknown or invalid lines are skipped. A missing file yields an empty list.
+	bool Load(const std::string& filename);
+	bool Save(const std::string& filename)const;
+
+	void Read(std::istream& in);
+	void Write(std::ostream& out)const;
+
+private:
+	std::vector<PermutationKey> mKeys;
+};
+#pragma endregion
+
+#pragma region PermutationCache
+// Builds a permutation on first use and hands the cached result out afterwards.
+// Concurrent requests for a key that is still being built wait for that build
+// instead of starting a second one.
+//
+// The compile function fails by throwing or by returning T(). A failed build is
+// not cached: the key goes back to unbuilt, the requests that waited on it get
+// T(), and the next request tries again.
+template <typename T>
+class PermutationCache
+{
+public:
+	typedef std::function<T(PermutationKey)> CompileFunc;
+
+	struct Stats
+	{
+		Stats() : Requests(0), Compiles(0), Deduplicated(0) {}
+
+		size_t Requests;		// calls to Get()
+		size_t Compiles;		// times the compile function ran
+		size_t Deduplicated;	// requests served by waiting on an in-flight build
+	};
+
+	explicit PermutationCache(CompileFunc compile) : mCompile(compile) {}
+
+	T Get(PermutationKey key)
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		++mStats.Requests;
+
+		Entry& entry = mEntries[key];
+		if (!entry.Used)
+		{
+			entry.Used = true;
+			mUsed.Add(key);
+		}
+
+		if (entry.State == Ready)
+			return entry.Value;
+
+		if (entry.State == Building)
+		{
+			++mStats.Deduplicated;
+			mBuilt.wait(lock, [&entry]() { return entry.State != Building; });
+			return entry.State == Ready ? entry.Value : T();
+		}
+
+		return Build(entry, key, lock);
+	}
+
+	// Builds every key in the list that is not cached yet without marking it as used,
+	// so a warm-up list that is saved again only keeps what the run really touched.
+	void Warm(const WarmupList& list)
+	{
+		for (size_t i = 0; i < list.Keys().size(); ++i)
+		{
+			PermutationKey key = list.Keys()[i];
+			if (!key.IsValid())
+				continue;
+
+			std::unique_lock<std::mutex> lock(mMutex);
+			Entry& entry = mEntries[key];
+			if (entry.State == Empty)
+				Build(entry, key, lock);
+		}
+	}
+
+	bool IsCompiled(PermutationKey key)const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		typename std::map<PermutationKey, Entry>::const_iterator it = mEntries.find(key);
+		return it != mEntries.end() && it->second.State == Ready;
+	}
+
+	// Keys requested through Get(), in first-use order.
+	WarmupList UsedKeys()const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mUsed;
+	}
+
+	Stats GetStats()const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mStats;
+	}
+
+	// Visits every built permutation, e.g. to release what the compile function created.
+	template <typename F>
+	void ForEach(F func)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (typename std::map<PermutationKey, Entry>::iterator it = mEntries.begin(); it != mEntries.end(); ++it)
+		{
+			if (it->second.State == Ready)
+				func(it->first, it->second.Value);
+		}
+	}
+
+private:
+	enum EntryState { Empty, Building, Ready };
+
+	struct Entry
+	{
+		Entry() : Value(), State(Empty), Used(false) {}
+
+		T Value;
+		EntryState State;
+		bool Used;
+	};
+
+	// Called with the lock held; compiles outside of it so other keys stay available.
+	// std::map nodes are stable, so the entry reference survives the unlock.
+	T Build(Entry& entry, PermutationKey key, std::unique_lock<std::mutex>& lock)
+	{
+		entry.State = Building;
+		++mStats.Compiles;
+		lock.unlock();
+
+		T value;
+		try
+		{
+			value = mCompile(key);
+		}
+		catch (...)
+		{
+			lock.lock();
+			entry.State = Empty;
+			mBuilt.notify_all();
+			throw;
+		}
+
+		lock.lock();
+		entry.State = value == T() ? Empty : Ready;
+		entry.Value = value;
+		mBuilt.notify_all();
+		return value;
+	}
+
+private:
+	PermutationCache(const PermutationCache& rhs);
+	PermutationCache& operator=(const PermutationCache& rhs);
+
+	CompileFunc mCompile;
+
+	mutable std::mutex mMutex;
+	std::condition_variable mBuilt;
+	std::map<PermutationKey, Entry> mEntries;
+	WarmupList mUsed;
+	Stats mStats;
+};
+#pragma endregion
+
+#endif // SHADERPERMUTATION_H
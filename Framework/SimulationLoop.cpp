@@ -0,0 +1,89 @@
+//***************************************************************************************
+// SimulationLoop.cpp
+//***************************************************************************************
+
+#include "SimulationLoop.h"
+
+#pragma region FixedStepThread
+FixedStepThread::FixedStepThread()
+	: mStepSeconds(0.0), mQuit(false), mSteps(0), mDropped(0)
+{
+}
+
+FixedStepThread::~FixedStepThread()
+{
+	Stop();
+}
+
+void FixedStepThread::Start(double stepSeconds, const StepFunction& step)
+{
+	Stop();
+
+	mStep = step;
+	mStepSeconds = stepSeconds;
+	mStart = Clock::now();
+	mQuit = false;
+	mSteps.store(0, std::memory_order_relaxed);
+	mDropped.store(0, std::memory_order_relaxed);
+
+	mThread = std::thread(&FixedStepThread::Main, this);
+}
+
+void FixedStepThread::Stop()
+{
+	if (!mThread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_one();
+	mThread.join();
+}
+
+double FixedStepThread::Now()const
+{
+	return std::chrono::duration<double>(Clock::now() - mStart).count();
+}
+
+void FixedStepThread::Main()
+{
+	// Step k is due at skipped + k*step seconds; skipped grows as backlogs are dropped.
+	uint64_t next = 1;
+	double skipped = 0.0;
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	for (;;)
+	{
+		double due = skipped + next*mStepSeconds;
+		Clock::time_point wake = mStart +
+			std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(due));
+		if (mWake.wait_until(lock, wake, [this]() { return mQuit; }))
+			break;
+		lock.unlock();
+
+		double now = Now();
+		for (unsigned int i = 0; i < MaxCatchUp && now >= due; ++i)
+		{
+			mStep(due);
+			mSteps.fetch_add(1, std::memory_order_relaxed);
+
+			++next;
+			due = skipped + next*mStepSeconds;
+			now = Now();
+		}
+
+		// Still behind: give up the steps that are due, and schedule the next one
+		// a step from now.
+		if (now >= due)
+		{
+			uint64_t dropped = (uint64_t)((now - due) / mStepSeconds) + 1;
+			skipped += dropped*mStepSeconds;
+			mDropped.fetch_add(dropped, std::memory_order_relaxed);
+		}
+
+		lock.lock();
+	}
+}
+#pragma endregion
@@ -0,0 +1,238 @@
+//***************************************************************************************
+// SimulationLoop.h
+//
+// Runs a simulation at a fixed tick on a thread of its own and hands its state to
+// the render thread, so neither waits on the other and the simulation advances by
+// the same step whatever the frame rate.
+//
+// TripleBuffer passes values from one producer thread to one consumer thread without
+// locks. Of its three slots the producer fills one, the consumer reads another, and
+// the third holds the latest published value. Publishing and acquiring each trade a
+// slot for the shared one in a single atomic exchange, so neither side ever waits;
+// the consumer always gets the newest value, skipping any published in between.
+//
+// FixedStepThread calls a function on its own thread once per step, at the times
+// start + k*step on the steady clock. When it falls behind it runs up to MaxCatchUp
+// steps back to back; past that it drops the rest of the backlog, so an overloaded
+// simulation slows down instead of falling ever further behind.
+//
+// SimulationLoop ties the two together. Each tick advances the simulation's own
+// state and publishes a copy, stamped with the time the tick was due. Sample, on the
+// render thread, takes the newest snapshot and says where the render time lies
+// between it and the one before, for interpolating. The render time trails the
+// clock by one tick, so the later of the two snapshots has normally arrived.
+//***************************************************************************************
+
+#ifndef SIMULATIONLOOP_H
+#define SIMULATIONLOOP_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#pragma region TripleBuffer
+template<class T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : mShared(1), mWrite(0), mRead(2) {}
+
+	// Sets every slot; only while neither thread uses the buffer.
+	void Reset(const T& value)
+	{
+		for (int i = 0; i < 3; ++i)
+			mSlots[i] = value;
+		mShared.store(1, std::memory_order_release);
+		mWrite = 0;
+		mRead = 2;
+	}
+
+	// Producer: fill the write slot, then publish it.
+	T& Write()                             { return mSlots[mWrite]; }
+
+	void Publish()
+	{
+		mWrite = mShared.exchange(mWrite | Fresh, std::memory_order_acq_rel) & SlotMask;
+	}
+
+	// Consumer: returns false, keeping the slot it has, when nothing was published
+	// since the last call.
+	bool Acquire()
+	{
+		if ((mShared.load(std::memory_order_relaxed) & Fresh) == 0)
+			return false;
+
+		mRead = mShared.exchange(mRead, std::memory_order_acq_rel) & SlotMask;
+		return true;
+	}
+
+	const T& Read()const                   { return mSlots[mRead]; }
+
+private:
+	TripleBuffer(const TripleBuffer& rhs);
+	TripleBuffer& operator=(const TripleBuffer& rhs);
+
+	// The shared slot's index, plus Fresh while the consumer has not taken it.
+	static const uint32_t SlotMask = 3;
+	static const uint32_t Fresh = 4;
+
+	T mSlots[3];
+	std::atomic<uint32_t> mShared;
+
+	// Owned by the producer and the consumer respectively.
+	uint32_t mWrite;
+	uint32_t mRead;
+};
+#pragma endregion
+
+#pragma region FixedStepThread
+class FixedStepThread
+{
+public:
+	// time is when the step was due, in seconds since Start.
+	typedef std::function<void(double time)> StepFunction;
+
+	// Steps run back to back when behind, before the backlog is dropped.
+	static const unsigned int MaxCatchUp = 4;
+
+	FixedStepThread();
+	~FixedStepThread();
+
+	// The first step is due one step after Start.
+	void Start(double stepSeconds, const StepFunction& step);
+	void Stop();
+
+	bool Running()const                    { return mThread.joinable(); }
+	double StepSeconds()const              { return mStepSeconds; }
+
+	// Seconds since Start, on the clock the steps are scheduled by.
+	double Now()const;
+
+	// Steps run and dropped so far; may be read from any thread.
+	uint64_t Steps()const                  { return mSteps.load(std::memory_order_relaxed); }
+	uint64_t Dropped()const                { return mDropped.load(std::memory_order_relaxed); }
+
+private:
+	FixedStepThread(const FixedStepThread& rhs);
+	FixedStepThread& operator=(const FixedStepThread& rhs);
+
+	typedef std::chrono::steady_clock Clock;
+
+	void Main();
+
+	StepFunction mStep;
+	double mStepSeconds;
+	Clock::time_point mStart;
+
+	// Only for sleeping between steps and being woken to stop.
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	bool mQuit;
+
+	std::atomic<uint64_t> mSteps;
+	std::atomic<uint64_t> mDropped;
+
+	std::thread mThread;
+};
+#pragma endregion
+
+#pragma region SimulationLoop
+template<class T>
+class SimulationLoop
+{
+public:
+	// Advances state by dt seconds.
+	typedef std::function<void(T& state, float dt)> TickFunction;
+
+	SimulationLoop() : mTickSeconds(0.0f) {}
+	~SimulationLoop()                      { Stop(); }
+
+	// Previous and Current hold initial until the first ticks arrive.
+	void Start(float tickSeconds, const T& initial, const TickFunction& tick)
+	{
+		Stop();
+
+		mTick = tick;
+		mTickSeconds = tickSeconds;
+		mState = initial;
+
+		mPrevious.State = initial;
+		mPrevious.Time = 0.0;
+		mCurrent = mPrevious;
+		mBuffer.Reset(mPrevious);
+
+		mThread.Start(tickSeconds, [this](double time) { Tick(time); });
+	}
+
+	void Stop()                            { mThread.Stop(); }
+	bool Running()const                    { return mThread.Running(); }
+
+	// Render thread. Takes the newest snapshot, and returns where the render time
+	// lies between Previous and Current: 0 at Previous, 1 at Current. Holds at 1
+	// when the simulation thread falls behind.
+	float Sample()
+	{
+		if (mBuffer.Acquire())
+		{
+			std::swap(mPrevious, mCurrent);
+			mCurrent = mBuffer.Read();
+		}
+
+		double span = mCurrent.Time - mPrevious.Time;
+		if (span <= 0.0)
+			return 1.0f;
+
+		double renderTime = mThread.Now() - mTickSeconds;
+		double alpha = (renderTime - mPrevious.Time) / span;
+		return alpha < 0.0 ? 0.0f : alpha > 1.0 ? 1.0f : (float)alpha;
+	}
+
+	const T& Previous()const               { return mPrevious.State; }
+	const T& Current()const                { return mCurrent.State; }
+
+	const FixedStepThread& Thread()const   { return mThread; }
+
+private:
+	SimulationLoop(const SimulationLoop& rhs);
+	SimulationLoop& operator=(const SimulationLoop& rhs);
+
+	struct Snapshot
+	{
+		T State;
+		double Time;
+	};
+
+	// Simulation thread.
+	void Tick(double time)
+	{
+		mTick(mState, mTickSeconds);
+
+		Snapshot& snapshot = mBuffer.Write();
+		snapshot.State = mState;
+		snapshot.Time = time;
+		mBuffer.Publish();
+	}
+
+	TickFunction mTick;
+	float mTickSeconds;
+
+	// Owned by the simulation thread while it runs.
+	T mState;
+
+	TripleBuffer<Snapshot> mBuffer;
+
+	// Owned by the render thread.
+	Snapshot mPrevious;
+	Snapshot mCurrent;
+
+	// Last, so the thread stops before the rest is destroyed.
+	FixedStepThread mThread;
+};
+#pragma endregion
+
+#endif // SIMULATIONLOOP_H
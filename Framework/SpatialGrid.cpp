@@ -0,0 +1,493 @@
+//***************************************************************************************
+// SpatialGrid.cpp
+//***************************************************************************************
+
+#include "SpatialGrid.h"
+
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	// Cell coordinates are packed as three biased 21-bit fields, which covers a
+	// million cells either side of the origin.
+	const int CoordBias = 1 << 20;
+	const uint64_t CoordMask = (1 << 21) - 1;
+
+	int CellCoord(float x)
+	{
+		float c = floorf(x);
+		if (c < (float)-CoordBias)
+			return -CoordBias;
+		if (c > (float)(CoordBias - 1))
+			return CoordBias - 1;
+		return (int)c;
+	}
+
+	uint64_t PackKey(int x, int y, int z)
+	{
+		return ((uint64_t)(x + CoordBias) << 42) | ((uint64_t)(y + CoordBias) << 21) | (uint64_t)(z + CoordBias);
+	}
+
+	void UnpackKey(uint64_t key, int& x, int& y, int& z)
+	{
+		x = (int)((key >> 42) & CoordMask) - CoordBias;
+		y = (int)((key >> 21) & CoordMask) - CoordBias;
+		z = (int)(key & CoordMask) - CoordBias;
+	}
+
+	size_t HashOf(uint64_t key, unsigned int bits)
+	{
+		return (size_t)((key*0x9E3779B97F4A7C15ull) >> (64 - bits));
+	}
+
+	bool SphereInFrustum(const SpatialGrid::Frustum& frustum, const float center[3], float radius)
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			const float* p = frustum.Planes[i];
+			if (p[0]*center[0] + p[1]*center[1] + p[2]*center[2] + p[3] < -radius)
+				return false;
+		}
+		return true;
+	}
+
+	void Cross(const float a[3], const float b[3], float out[3])
+	{
+		out[0] = a[1]*b[2] - a[2]*b[1];
+		out[1] = a[2]*b[0] - a[0]*b[2];
+		out[2] = a[0]*b[1] - a[1]*b[0];
+	}
+
+	// The point where three planes meet.
+	void Intersect(const float* a, const float* b, const float* c, float out[3])
+	{
+		float bc[3], ca[3], ab[3];
+		Cross(b, c, bc);
+		Cross(c, a, ca);
+		Cross(a, b, ab);
+
+		float det = a[0]*bc[0] + a[1]*bc[1] + a[2]*bc[2];
+		for (int k = 0; k < 3; ++k)
+			out[k] = -(a[3]*bc[k] + b[3]*ca[k] + c[3]*ab[k])/det;
+	}
+}
+
+#pragma region Frustum
+void SpatialGrid::Frustum::Set(const float* m)
+{
+	enum { Left, Right, Bottom, Top, Near, Far };
+
+	// Clip coordinates are p*M, so each is p dotted with a column of M.
+	for (int k = 0; k < 4; ++k)
+	{
+		float x = m[k*4 + 0];
+		float y = m[k*4 + 1];
+		float z = m[k*4 + 2];
+		float w = m[k*4 + 3];
+
+		Planes[Left][k] = w + x;
+		Planes[Right][k] = w - x;
+		Planes[Bottom][k] = w + y;
+		Planes[Top][k] = w - y;
+		Planes[Near][k] = z;
+		Planes[Far][k] = w - z;
+	}
+
+	// Unit normals, so plane distances are world distances and compare with radii.
+	for (int i = 0; i < 6; ++i)
+	{
+		float* p = Planes[i];
+		float length = sqrtf(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+		for (int k = 0; k < 4; ++k)
+			p[k] /= length;
+	}
+
+	for (int k = 0; k < 3; ++k)
+	{
+		Min[k] = +FLT_MAX;
+		Max[k] = -FLT_MAX;
+	}
+
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		float p[3];
+		Intersect(Planes[corner & 1 ? Right : Left], Planes[corner & 2 ? Top : Bottom],
+			Planes[corner & 4 ? Far : Near], p);
+
+		for (int k = 0; k < 3; ++k)
+		{
+			Min[k] = p[k] < Min[k] ? p[k] : Min[k];
+			Max[k] = p[k] > Max[k] ? p[k] : Max[k];
+		}
+	}
+}
+#pragma endregion
+
+SpatialGrid::SpatialGrid(float cellSize)
+	: mCellSize(cellSize), mInvCellSize(1.0f/cellSize), mHashBits(0), mFree(None), mLive(0)
+{
+	assert(cellSize > 0.0f);
+	ResetHash(0);
+}
+
+#pragma region Cells
+uint64_t SpatialGrid::KeyOf(const float center[3])const
+{
+	return PackKey(CellCoord(center[0]*mInvCellSize), CellCoord(center[1]*mInvCellSize), CellCoord(center[2]*mInvCellSize));
+}
+
+uint32_t SpatialGrid::FindCell(uint64_t key)const
+{
+	size_t mask = mHash.size() - 1;
+	for (size_t i = HashOf(key, mHashBits); ; i = (i + 1) & mask)
+	{
+		const HashSlot& slot = mHash[i];
+		if (slot.Cell == None || slot.Key == key)
+			return slot.Cell;
+	}
+}
+
+uint32_t SpatialGrid::FindOrAddCell(uint64_t key)
+{
+	// At most half full, so probes stay short.
+	if (2*(mCells.size() + 1) > mHash.size())
+		GrowHash();
+
+	size_t mask = mHash.size() - 1;
+	size_t i = HashOf(key, mHashBits);
+	while (mHash[i].Cell != None)
+	{
+		if (mHash[i].Key == key)
+			return mHash[i].Cell;
+		i = (i + 1) & mask;
+	}
+
+	mHash[i].Key = key;
+	mHash[i].Cell = (uint32_t)mCells.size();
+
+	mCells.push_back(Cell());
+	mCells.back().Key = key;
+	return mHash[i].Cell;
+}
+
+void SpatialGrid::GrowHash()
+{
+	ResetHash(mHash.size());
+
+	size_t mask = mHash.size() - 1;
+	for (uint32_t cell = 0; cell < mCells.size(); ++cell)
+	{
+		size_t i = HashOf(mCells[cell].Key, mHashBits);
+		while (mHash[i].Cell != None)
+			i = (i + 1) & mask;
+
+		mHash[i].Key = mCells[cell].Key;
+		mHash[i].Cell = cell;
+	}
+}
+
+void SpatialGrid::ResetHash(size_t cells)
+{
+	mHashBits = 4;
+	while (((size_t)1 << mHashBits) < 2*cells + 2)
+		++mHashBits;
+
+	HashSlot empty = { 0, None };
+	mHash.assign((size_t)1 << mHashBits, empty);
+}
+
+SpatialGrid::CellRange SpatialGrid::RangeOf(const float min[3], const float max[3])const
+{
+	// An object in cell c has its center in c and sticks out by at most half a cell.
+	CellRange range;
+	for (int k = 0; k < 3; ++k)
+	{
+		range.Min[k] = CellCoord(min[k]*mInvCellSize - 0.5f);
+		range.Max[k] = CellCoord(max[k]*mInvCellSize + 0.5f);
+	}
+	return range;
+}
+
+template<class Visit>
+void SpatialGrid::ForEachCell(const CellRange& range, Visit visit)const
+{
+	double cells = 1.0;
+	for (int k = 0; k < 3; ++k)
+		cells *= (double)range.Max[k] - range.Min[k] + 1.0;
+
+	// A wide query looks at the occupied cells instead of probing every cell it spans.
+	if (cells > (double)mCells.size())
+	{
+		for (size_t i = 0; i < mCells.size(); ++i)
+		{
+			int x, y, z;
+			UnpackKey(mCells[i].Key, x, y, z);
+			if (x >= range.Min[0] && x <= range.Max[0] &&
+				y >= range.Min[1] && y <= range.Max[1] &&
+				z >= range.Min[2] && z <= range.Max[2])
+			{
+				visit(mCells[i], x, y, z);
+			}
+		}
+		return;
+	}
+
+	for (int z = range.Min[2]; z <= range.Max[2]; ++z)
+	{
+		for (int y = range.Min[1]; y <= range.Max[1]; ++y)
+		{
+			for (int x = range.Min[0]; x <= range.Max[0]; ++x)
+			{
+				uint32_t cell = FindCell(PackKey(x, y, z));
+				if (cell != None)
+					visit(mCells[cell], x, y, z);
+			}
+		}
+	}
+}
+#pragma endregion
+
+#pragma region Objects
+std::vector<SpatialGrid::Entry>& SpatialGrid::ListOf(const Object& object)
+{
+	return object.Cell == Large ? mLarge : mCells[object.Cell].Entries;
+}
+
+void SpatialGrid::Place(Handle object, const float center[3], float radius)
+{
+	Object& o = mObjects[object];
+	o.Cell = 2.0f*radius > mCellSize ? Large : FindOrAddCell(KeyOf(center));
+
+	std::vector<Entry>& list = ListOf(o);
+	o.Slot = (uint32_t)list.size();
+
+	Entry entry = { { center[0], center[1], center[2] }, radius, object };
+	list.push_back(entry);
+}
+
+void SpatialGrid::Unplace(Handle object)
+{
+	Object& o = mObjects[object];
+	std::vector<Entry>& list = ListOf(o);
+
+	// The last entry fills the gap.
+	list[o.Slot] = list.back();
+	mObjects[list[o.Slot].Object].Slot = o.Slot;
+	list.pop_back();
+}
+
+SpatialGrid::Handle SpatialGrid::Insert(const float center[3], float radius)
+{
+	Handle object = mFree;
+	if (object != None)
+	{
+		mFree = mObjects[object].Slot;
+	}
+	else
+	{
+		object = (Handle)mObjects.size();
+		mObjects.push_back(Object());
+	}
+
+	Place(object, center, radius);
+	++mLive;
+	return object;
+}
+
+void SpatialGrid::Move(Handle object, const float center[3], float radius)
+{
+	Object& o = mObjects[object];
+	assert(o.Cell != Free);
+
+	// Staying in the same cell, or on the large list, only rewrites the sphere.
+	bool large = 2.0f*radius > mCellSize;
+	if (large ? o.Cell == Large : o.Cell != Large && mCells[o.Cell].Key == KeyOf(center))
+	{
+		Entry& entry = ListOf(o)[o.Slot];
+		entry.Center[0] = center[0];
+		entry.Center[1] = center[1];
+		entry.Center[2] = center[2];
+		entry.Radius = radius;
+		return;
+	}
+
+	Unplace(object);
+	Place(object, center, radius);
+}
+
+void SpatialGrid::Remove(Handle object)
+{
+	assert(mObjects[object].Cell != Free);
+
+	Unplace(object);
+	mObjects[object].Cell = Free;
+	mObjects[object].Slot = mFree;
+	mFree = object;
+	--mLive;
+}
+
+void SpatialGrid::GetSphere(Handle object, float center[3], float& radius)const
+{
+	const Object& o = mObjects[object];
+	assert(o.Cell != Free);
+
+	const Entry& entry = (o.Cell == Large ? mLarge : mCells[o.Cell].Entries)[o.Slot];
+	center[0] = entry.Center[0];
+	center[1] = entry.Center[1];
+	center[2] = entry.Center[2];
+	radius = entry.Radius;
+}
+#pragma endregion
+
+#pragma region Build
+void SpatialGrid::Build(const float* spheres, size_t stride, size_t count)
+{
+	std::vector<Entry> entries(count);
+
+	const char* p = reinterpret_cast<const char*>(spheres);
+	for (size_t i = 0; i < count; ++i, p += stride)
+	{
+		const float* sphere = reinterpret_cast<const float*>(p);
+
+		Entry& entry = entries[i];
+		entry.Center[0] = sphere[0];
+		entry.Center[1] = sphere[1];
+		entry.Center[2] = sphere[2];
+		entry.Radius = sphere[3];
+		entry.Object = (Handle)i;
+	}
+
+	mObjects.assign(count, Object());
+	mFree = None;
+	mLive = count;
+
+	Bucket(entries);
+}
+
+void SpatialGrid::Rebuild(float cellSize)
+{
+	std::vector<Entry> entries;
+	entries.reserve(mLive);
+
+	entries.insert(entries.end(), mLarge.begin(), mLarge.end());
+	for (size_t i = 0; i < mCells.size(); ++i)
+		entries.insert(entries.end(), mCells[i].Entries.begin(), mCells[i].Entries.end());
+
+	if (cellSize > 0.0f)
+	{
+		mCellSize = cellSize;
+		mInvCellSize = 1.0f/cellSize;
+	}
+
+	Bucket(entries);
+}
+
+void SpatialGrid::Bucket(const std::vector<Entry>& entries)
+{
+	mCells.clear();
+	mLarge.clear();
+	ResetHash(entries.size());
+
+	// Find every object's cell and count the cells, so each list is sized once.
+	std::vector<uint32_t> counts;
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		const Entry& entry = entries[i];
+		Object& o = mObjects[entry.Object];
+
+		if (2.0f*entry.Radius > mCellSize)
+		{
+			o.Cell = Large;
+			continue;
+		}
+
+		o.Cell = FindOrAddCell(KeyOf(entry.Center));
+		if (o.Cell == counts.size())
+			counts.push_back(0);
+		++counts[o.Cell];
+	}
+
+	for (size_t i = 0; i < mCells.size(); ++i)
+		mCells[i].Entries.reserve(counts[i]);
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		Object& o = mObjects[entries[i].Object];
+		std::vector<Entry>& list = ListOf(o);
+
+		o.Slot = (uint32_t)list.size();
+		list.push_back(entries[i]);
+	}
+}
+#pragma endregion
+
+#pragma region Queries
+void SpatialGrid::QuerySphere(const float center[3], float radius, std::vector<Handle>& results)const
+{
+	for (size_t i = 0; i < mLarge.size(); ++i)
+	{
+		const Entry& entry = mLarge[i];
+		float dx = entry.Center[0] - center[0];
+		float dy = entry.Center[1] - center[1];
+		float dz = entry.Center[2] - center[2];
+		float r = entry.Radius + radius;
+		if (dx*dx + dy*dy + dz*dz <= r*r)
+			results.push_back(entry.Object);
+	}
+
+	float min[3] = { center[0] - radius, center[1] - radius, center[2] - radius };
+	float max[3] = { center[0] + radius, center[1] + radius, center[2] + radius };
+
+	ForEachCell(RangeOf(min, max), [&](const Cell& cell, int, int, int)
+	{
+		const Entry* entries = cell.Entries.data();
+		for (size_t i = 0, n = cell.Entries.size(); i < n; ++i)
+		{
+			float dx = entries[i].Center[0] - center[0];
+			float dy = entries[i].Center[1] - center[1];
+			float dz = entries[i].Center[2] - center[2];
+			float r = entries[i].Radius + radius;
+			if (dx*dx + dy*dy + dz*dz <= r*r)
+				results.push_back(entries[i].Object);
+		}
+	});
+}
+
+void SpatialGrid::QueryFrustum(const Frustum& frustum, std::vector<Handle>& results)const
+{
+	for (size_t i = 0; i < mLarge.size(); ++i)
+	{
+		if (SphereInFrustum(frustum, mLarge[i].Center, mLarge[i].Radius))
+			results.push_back(mLarge[i].Object);
+	}
+
+	float size = mCellSize;
+	ForEachCell(RangeOf(frustum.Min, frustum.Max), [&](const Cell& cell, int x, int y, int z)
+	{
+		// The loose bounds of the cell: its own, grown by half a cell on each side.
+		float center[3] = { (x + 0.5f)*size, (y + 0.5f)*size, (z + 0.5f)*size };
+
+		bool inside = true;
+		for (int i = 0; i < 6; ++i)
+		{
+			const float* p = frustum.Planes[i];
+			float distance = p[0]*center[0] + p[1]*center[1] + p[2]*center[2] + p[3];
+			float extent = size*(fabsf(p[0]) + fabsf(p[1]) + fabsf(p[2]));
+
+			if (distance < -extent)
+				return;
+			if (distance < extent)
+				inside = false;
+		}
+
+		const Entry* entries = cell.Entries.data();
+		for (size_t i = 0, n = cell.Entries.size(); i < n; ++i)
+		{
+			if (inside || SphereInFrustum(frustum, entries[i].Center, entries[i].Radius))
+				results.push_back(entries[i].Object);
+		}
+	});
+}
+#pragma endregion
@@ -0,0 +1,150 @@
+//***************************************************************************************
+// SpatialGrid.h
+//
+// Broadphase index over the bounding spheres of the objects of a scene, for culling
+// and proximity queries in scenes where objects keep moving.
+//
+// It is a loose uniform grid kept in a hash table, so only occupied cells cost memory
+// and the world has no fixed extent. An object lives in the cell holding its center,
+// and may stick out of it by up to half a cell; a query therefore tests every cell
+// whose bounds, grown by half a cell on each side, touch the query volume. Objects
+// wider than a cell go on a short list that every query tests.
+//
+// Each cell keeps its objects' spheres inline, so a query walks contiguous memory.
+// Moving an object within its cell rewrites its sphere; moving it to another cell
+// swaps it out of the old cell's list and appends it to the new one. Both are O(1)
+// and allocate only while a list grows past its high-water mark.
+//
+// Build replaces every object at once and sizes each cell exactly, which is faster
+// than inserting one at a time; Rebuild re-buckets the objects in place, dropping
+// cells that emptied out and optionally changing the cell size.
+//
+// Queries are const and may run on several threads at once, but not alongside a
+// change to the grid.
+//***************************************************************************************
+
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class SpatialGrid
+{
+public:
+	typedef uint32_t Handle;
+	static const Handle None = 0xffffffff;
+
+	// The six planes of a view volume, facing inwards, and its bounding box.
+	struct Frustum
+	{
+		float Planes[6][4];
+		float Min[3];
+		float Max[3];
+
+		// From a row-major view projection matrix applied as p*M, as in XNA Math, with
+		// depth in [0, 1]. The far plane must be finite.
+		void Set(const float* viewProj);
+	};
+
+	// Objects up to half a cell in radius go in cells. Cells should also hold several
+	// objects each: with one apiece, a wide query visits nearly as many cells as a
+	// linear scan visits objects.
+	explicit SpatialGrid(float cellSize);
+
+	// Handles of removed objects are reused.
+	Handle Insert(const float center[3], float radius);
+	void Move(Handle object, const float center[3], float radius);
+	void Remove(Handle object);
+
+	// Replaces every object: spheres holds count spheres of four floats (center and
+	// radius), stride bytes apart, and sphere i gets handle i.
+	void Build(const float* spheres, size_t stride, size_t count);
+
+	// Re-buckets the objects, keeping their handles; a cell size of 0 keeps the size.
+	void Rebuild(float cellSize = 0.0f);
+
+	// Append the objects whose spheres may touch the query volume to results.
+	// Objects are tested as spheres against the query, so a few just outside a
+	// frustum's corners pass.
+	void QuerySphere(const float center[3], float radius, std::vector<Handle>& results)const;
+	void QueryFrustum(const Frustum& frustum, std::vector<Handle>& results)const;
+
+	void GetSphere(Handle object, float center[3], float& radius)const;
+
+	size_t Size()const                     { return mLive; }
+	size_t CellCount()const                { return mCells.size(); }
+	size_t LargeCount()const               { return mLarge.size(); }
+	float CellSize()const                  { return mCellSize; }
+
+private:
+	// Where an object lives: a cell, the large list, or nowhere, with its place in
+	// the list. Free handles chain through Slot.
+	static const uint32_t Large = 0xffffffff;
+	static const uint32_t Free = 0xfffffffe;
+
+	struct Entry
+	{
+		float Center[3];
+		float Radius;
+		Handle Object;
+	};
+
+	struct Cell
+	{
+		uint64_t Key;
+		std::vector<Entry> Entries;
+	};
+
+	struct Object
+	{
+		uint32_t Cell;
+		uint32_t Slot;
+	};
+
+	struct HashSlot
+	{
+		uint64_t Key;
+		uint32_t Cell;
+	};
+
+	struct CellRange
+	{
+		int Min[3];
+		int Max[3];
+	};
+
+	uint64_t KeyOf(const float center[3])const;
+	uint32_t FindCell(uint64_t key)const;
+	uint32_t FindOrAddCell(uint64_t key);
+	void GrowHash();
+	void ResetHash(size_t cells);
+
+	std::vector<Entry>& ListOf(const Object& object);
+	void Place(Handle object, const float center[3], float radius);
+	void Unplace(Handle object);
+	void Bucket(const std::vector<Entry>& entries);
+
+	CellRange RangeOf(const float min[3], const float max[3])const;
+
+	template<class Visit>
+	void ForEachCell(const CellRange& range, Visit visit)const;
+
+	float mCellSize;
+	float mInvCellSize;
+
+	std::vector<Cell> mCells;
+	std::vector<Entry> mLarge;
+
+	// Open addressing with linear probing; cells are only dropped by Rebuild, so
+	// there are no tombstones.
+	std::vector<HashSlot> mHash;
+	unsigned int mHashBits;
+
+	std::vector<Object> mObjects;
+	Handle mFree;
+	size_t mLive;
+};
+
+#endif // SPATIALGRID_H
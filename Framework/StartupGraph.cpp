@@ -0,0 +1,209 @@
+//***************************************************************************************
+// StartupGraph.cpp
+//***************************************************************************************
+
+#include "StartupGraph.h"
+#include "AllocationProfiler.h"
+#include "Telemetry.h"
+
+#include <cassert>
+#include <cstdio>
+#include <thread>
+
+StartupGraph::StartupGraph()
+	: mRemaining(0), mJobs(0), mCounter(0), mStart(0), mEnd(0)
+{
+}
+
+StartupGraph::StepId StartupGraph::Add(const char* name, const StepFunction& function, Affinity where)
+{
+	Step step;
+	step.Name = name;
+	step.Function = function;
+	step.Where = where;
+	step.Begin = 0;
+	step.End = 0;
+	step.Thread = 0;
+
+	mSteps.push_back(step);
+	mDependents.push_back(std::vector<StepId>());
+	return (StepId)mSteps.size() - 1;
+}
+
+void StartupGraph::DependsOn(StepId step, StepId dependency)
+{
+	assert(dependency < step && step < mSteps.size() && "Steps can only depend on earlier steps");
+
+	mSteps[step].Dependencies.push_back(dependency);
+	mDependents[dependency].push_back(step);
+}
+
+void StartupGraph::Run(JobSystem& jobs)
+{
+	JobCounter counter;
+	mJobs = &jobs;
+	mCounter = &counter;
+
+	std::vector<std::atomic<int> > pending(mSteps.size());
+	mPending.swap(pending);
+	for (size_t i = 0; i < mSteps.size(); ++i)
+		mPending[i].store((int)mSteps[i].Dependencies.size(), std::memory_order_relaxed);
+	mRemaining.store((unsigned int)mSteps.size(), std::memory_order_relaxed);
+	mReady.clear();
+
+	mStart = Telemetry::Now();
+
+	for (StepId i = 0; i < mSteps.size(); ++i)
+	{
+		if (mSteps[i].Dependencies.empty())
+			Dispatch(i);
+	}
+
+	while (mRemaining.load(std::memory_order_acquire) > 0)
+	{
+		StepId step = 0;
+		bool ready = false;
+		{
+			std::lock_guard<std::mutex> lock(mReadyMutex);
+			if (!mReady.empty())
+			{
+				// First come, first served, so a step that became ready early doesn't
+				// wait behind ones that became ready later.
+				step = mReady.front();
+				mReady.erase(mReady.begin());
+				ready = true;
+			}
+		}
+
+		if (ready)
+			Execute(step);
+		else if (!jobs.RunPending())
+			std::this_thread::yield();
+	}
+
+	// The last jobs may still be returning from Execute.
+	jobs.Wait(counter);
+
+	mEnd = Telemetry::Now();
+	mJobs = 0;
+	mCounter = 0;
+}
+
+void StartupGraph::Dispatch(StepId step)
+{
+	if (mSteps[step].Where == OwningThread)
+	{
+		std::lock_guard<std::mutex> lock(mReadyMutex);
+		mReady.push_back(step);
+	}
+	else
+	{
+		mJobs->Submit([this, step]() { Execute(step); }, mCounter);
+	}
+}
+
+void StartupGraph::Execute(StepId step)
+{
+	Step& s = mSteps[step];
+
+	s.Thread = mJobs->ThreadIndex();
+	s.Begin = Telemetry::Now() - mStart;
+	{
+		Telemetry::ScopedTimer timer(s.Name);
+		AllocationProfiler::ScopedTag tag(s.Name);
+		s.Function();
+	}
+	s.End = Telemetry::Now() - mStart;
+
+	const std::vector<StepId>& dependents = mDependents[step];
+	for (size_t i = 0; i < dependents.size(); ++i)
+	{
+		if (mPending[dependents[i]].fetch_sub(1, std::memory_order_acq_rel) == 1)
+			Dispatch(dependents[i]);
+	}
+
+	mRemaining.fetch_sub(1, std::memory_order_release);
+}
+
+double StartupGraph::WallMilliseconds()const
+{
+	return (mEnd - mStart)*1e-6;
+}
+
+std::vector<StartupGraph::StepId> StartupGraph::CriticalPath()const
+{
+	std::vector<StepId> path;
+	if (mSteps.empty())
+		return path;
+
+	// Dependencies come before their dependents, so one pass in order sees every
+	// step after all of its dependencies.
+	std::vector<uint64_t> finish(mSteps.size());
+	std::vector<StepId> previous(mSteps.size());
+
+	StepId last = 0;
+	for (StepId i = 0; i < mSteps.size(); ++i)
+	{
+		const Step& s = mSteps[i];
+
+		uint64_t start = 0;
+		previous[i] = i;
+		for (size_t d = 0; d < s.Dependencies.size(); ++d)
+		{
+			StepId dependency = s.Dependencies[d];
+			if (finish[dependency] > start || previous[i] == i)
+			{
+				start = finish[dependency];
+				previous[i] = dependency;
+			}
+		}
+
+		finish[i] = start + (s.End - s.Begin);
+		if (finish[i] > finish[last])
+			last = i;
+	}
+
+	for (StepId i = last; ; i = previous[i])
+	{
+		path.insert(path.begin(), i);
+		if (previous[i] == i)
+			break;
+	}
+	return path;
+}
+
+double StartupGraph::CriticalPathMilliseconds()const
+{
+	std::vector<StepId> path = CriticalPath();
+
+	uint64_t total = 0;
+	for (size_t i = 0; i < path.size(); ++i)
+		total += mSteps[path[i]].End - mSteps[path[i]].Begin;
+	return total*1e-6;
+}
+
+std::string StartupGraph::Report()const
+{
+	std::string report;
+	char line[256];
+
+	for (size_t i = 0; i < mSteps.size(); ++i)
+	{
+		const Step& s = mSteps[i];
+		snprintf(line, sizeof(line), "%-28s start %8.2f ms  took %8.2f ms  thread %u\n",
+			s.Name, s.Begin*1e-6, (s.End - s.Begin)*1e-6, s.Thread);
+		report += line;
+	}
+
+	snprintf(line, sizeof(line), "Startup %.2f ms, critical path %.2f ms:", WallMilliseconds(), CriticalPathMilliseconds());
+	report += line;
+
+	std::vector<StepId> path = CriticalPath();
+	for (size_t i = 0; i < path.size(); ++i)
+	{
+		report += i > 0 ? " > " : " ";
+		report += mSteps[path[i]].Name;
+	}
+	report += "\n";
+	return report;
+}
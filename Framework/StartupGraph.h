@@ -0,0 +1,99 @@
+//***************************************************************************************
+// StartupGraph.h
+//
+// The steps of an app's Init as a graph. Each step is added with a name and the
+// steps it depends on, and Run starts every step as soon as its dependencies have
+// finished, so steps that don't depend on each other overlap.
+//
+// Steps that create device objects are added as OwningThread and run on the thread
+// that calls Run, in the order they become ready; the others run as jobs. While no
+// owning thread step is ready, the calling thread runs jobs itself.
+//
+// Run times every step, and Report lists them together with the critical path: the
+// chain of dependent steps that took longest, which bounds how fast Init can get
+// without splitting or shortening one of its steps.
+//***************************************************************************************
+
+#ifndef STARTUPGRAPH_H
+#define STARTUPGRAPH_H
+
+#include "JobSystem.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class StartupGraph
+{
+public:
+	typedef std::function<void()> StepFunction;
+	typedef unsigned int StepId;
+
+	enum Affinity { AnyThread, OwningThread };
+
+	struct Step
+	{
+		const char* Name;
+		StepFunction Function;
+		Affinity Where;
+		std::vector<StepId> Dependencies;
+
+		// Nanoseconds since the start of Run, and the job system thread the step ran on.
+		uint64_t Begin;
+		uint64_t End;
+		unsigned int Thread;
+	};
+
+	StartupGraph();
+
+	StepId Add(const char* name, const StepFunction& function, Affinity where = AnyThread);
+
+	// A step can only depend on steps added before it, which keeps the graph acyclic.
+	void DependsOn(StepId step, StepId dependency);
+
+	// Runs every step once and returns when all have finished. Must be called from
+	// the thread that created jobs.
+	void Run(JobSystem& jobs);
+
+	const std::vector<Step>& Steps()const  { return mSteps; }
+
+	// Time from the start of Run to the end of the last step, in milliseconds.
+	double WallMilliseconds()const;
+
+	// The chain of dependent steps with the longest total duration in the last Run,
+	// first step first, and that duration in milliseconds.
+	std::vector<StepId> CriticalPath()const;
+	double CriticalPathMilliseconds()const;
+
+	// One line per step with its start, duration and thread, then the wall time and
+	// the critical path.
+	std::string Report()const;
+
+private:
+	StartupGraph(const StartupGraph& rhs);
+	StartupGraph& operator=(const StartupGraph& rhs);
+
+	void Dispatch(StepId step);
+	void Execute(StepId step);
+
+	std::vector<Step> mSteps;
+	std::vector<std::vector<StepId> > mDependents;
+
+	// Per step: dependencies that have not finished yet.
+	std::vector<std::atomic<int> > mPending;
+	std::atomic<unsigned int> mRemaining;
+
+	// Owning thread steps whose dependencies have finished.
+	std::vector<StepId> mReady;
+	std::mutex mReadyMutex;
+
+	JobSystem* mJobs;
+	JobCounter* mCounter;
+	uint64_t mStart;
+	uint64_t mEnd;
+};
+
+#endif // STARTUPGRAPH_H
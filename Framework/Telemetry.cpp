@@ -0,0 +1,251 @@
+//***************************************************************************************
+// Telemetry.cpp
+//***************************************************************************************
+
+#include "Telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+namespace
+{
+	// Rings are never freed, so a thread that exits leaves its events to be drained.
+	std::mutex gRingsMutex;
+	std::vector<Telemetry::EventRing*> gRings;
+
+	Telemetry::FrameHistogram gFrameTimes;
+	uint64_t gLastFrame = 0;
+
+	std::vector<Telemetry::Event> gCapture;
+	std::vector<uint64_t> gFrameMarks;
+	size_t gCaptureLimit = 1 << 18;
+	size_t gCaptureDropped = 0;
+
+	thread_local Telemetry::EventRing* tRing = 0;
+
+	const std::chrono::steady_clock::time_point gStart = std::chrono::steady_clock::now();
+	const uint64_t gStartTicks = Telemetry::Ticks();
+}
+
+uint64_t Telemetry::Now()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - gStart).count();
+}
+
+namespace
+{
+	double NanosecondsPerTick()
+	{
+#if defined(TELEMETRY_TSC)
+		// Assumes an invariant counter, as on every x86 of the last decade.
+		uint64_t elapsedTicks = Telemetry::Ticks() - gStartTicks;
+		if (elapsedTicks != 0)
+			return (double)Telemetry::Now()/(double)elapsedTicks;
+#endif
+		return 1.0;
+	}
+}
+
+double Telemetry::TicksToNanoseconds(uint64_t ticks)
+{
+	return (double)(int64_t)(ticks - gStartTicks)*NanosecondsPerTick();
+}
+
+#pragma region EventRing
+Telemetry::EventRing::EventRing(uint32_t thread)
+	: mEvents(Capacity), mThread(thread), mHead(0), mTail(0), mDropped(0)
+{
+}
+
+void Telemetry::EventRing::Drain(std::vector<Event>& out)
+{
+	uint32_t tail = mTail.load(std::memory_order_relaxed);
+	uint32_t head = mHead.load(std::memory_order_acquire);
+
+	for (; tail != head; ++tail)
+		out.push_back(mEvents[tail & (Capacity - 1)]);
+
+	mTail.store(tail, std::memory_order_release);
+}
+
+Telemetry::EventRing& Telemetry::ThreadRing()
+{
+	if (tRing == 0)
+	{
+		std::lock_guard<std::mutex> lock(gRingsMutex);
+		tRing = new EventRing((uint32_t)gRings.size());
+		gRings.push_back(tRing);
+	}
+	return *tRing;
+}
+#pragma endregion
+
+#pragma region FrameHistogram
+Telemetry::FrameHistogram::FrameHistogram()
+{
+	Clear();
+}
+
+void Telemetry::FrameHistogram::Add(uint64_t nanoseconds)
+{
+	++mBuckets[Bucket(nanoseconds/1000)];
+	++mCount;
+}
+
+void Telemetry::FrameHistogram::Clear()
+{
+	for (unsigned int i = 0; i < BucketCount; ++i)
+		mBuckets[i] = 0;
+	mCount = 0;
+}
+
+uint64_t Telemetry::FrameHistogram::Count()const
+{
+	return mCount;
+}
+
+double Telemetry::FrameHistogram::Percentile(double p)const
+{
+	if (mCount == 0)
+		return 0.0;
+
+	// The rank of the sample at the percentile, counting from 1.
+	uint64_t rank = (uint64_t)(p/100.0*mCount + 0.5);
+	if (rank < 1) rank = 1;
+	if (rank > mCount) rank = mCount;
+
+	uint64_t seen = 0;
+	unsigned int b = 0;
+	for (; b < BucketCount - 1; ++b)
+	{
+		seen += mBuckets[b];
+		if (seen >= rank)
+			break;
+	}
+	return BucketLimit(b)/1000.0;
+}
+
+unsigned int Telemetry::FrameHistogram::Bucket(uint64_t microseconds)
+{
+	// Values below SubBuckets get a bucket each; above that, the top four bits
+	// pick the octave's sub-bucket.
+	if (microseconds < SubBuckets)
+		return (unsigned int)microseconds;
+
+	unsigned int octave = 0;
+	while ((microseconds >> octave) >= 2*SubBuckets)
+		++octave;
+
+	unsigned int bucket = (octave + 1)*SubBuckets + (unsigned int)((microseconds >> octave) - SubBuckets);
+	return bucket < BucketCount ? bucket : BucketCount - 1;
+}
+
+uint64_t Telemetry::FrameHistogram::BucketLimit(unsigned int bucket)
+{
+	if (bucket < SubBuckets)
+		return bucket + 1;
+
+	unsigned int octave = bucket/SubBuckets - 1;
+	uint64_t sub = bucket%SubBuckets + SubBuckets;
+	return (sub + 1) << octave;
+}
+#pragma endregion
+
+void Telemetry::EndFrame()
+{
+	uint64_t now = Now();
+	if (gLastFrame != 0)
+		gFrameTimes.Add(now - gLastFrame);
+	gLastFrame = now;
+
+	// Drain every ring even when the capture is full, so the rings never fill up.
+	size_t before = gCapture.size();
+	{
+		std::lock_guard<std::mutex> lock(gRingsMutex);
+		for (size_t i = 0; i < gRings.size(); ++i)
+			gRings[i]->Drain(gCapture);
+	}
+
+	if (gCapture.size() > gCaptureLimit)
+	{
+		gCaptureDropped += gCapture.size() - std::max(before, gCaptureLimit);
+		gCapture.resize(std::max(before, gCaptureLimit));
+	}
+	else
+	{
+		gFrameMarks.push_back(now);
+	}
+}
+
+const Telemetry::FrameHistogram& Telemetry::FrameTimes()
+{
+	return gFrameTimes;
+}
+
+void Telemetry::SetCaptureLimit(size_t events)
+{
+	gCaptureLimit = events;
+}
+
+const std::vector<Telemetry::Event>& Telemetry::Capture()
+{
+	return gCapture;
+}
+
+size_t Telemetry::DroppedEvents()
+{
+	size_t dropped = gCaptureDropped;
+
+	std::lock_guard<std::mutex> lock(gRingsMutex);
+	for (size_t i = 0; i < gRings.size(); ++i)
+		dropped += gRings[i]->Dropped();
+	return dropped;
+}
+
+bool Telemetry::WriteChromeTrace(const char* path)
+{
+	std::ofstream fout(path);
+	if (!fout)
+		return false;
+
+	// Complete events ("X") in microseconds; nesting follows from the times.
+	fout << std::fixed << std::setprecision(3);
+
+	// One scale for the whole export.
+	double nsPerTick = NanosecondsPerTick();
+
+	fout << "{\"traceEvents\":[\n";
+	const char* separator = "";
+	for (size_t i = 0; i < gCapture.size(); ++i)
+	{
+		const Event& e = gCapture[i];
+		fout << separator << "{\"name\":\"" << e.Name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.Thread
+			<< ",\"ts\":" << (double)(int64_t)(e.Begin - gStartTicks)*nsPerTick/1000.0
+			<< ",\"dur\":" << (double)(e.End - e.Begin)*nsPerTick/1000.0 << "}";
+		separator = ",\n";
+	}
+	for (size_t i = 0; i < gFrameMarks.size(); ++i)
+	{
+		fout << separator << "{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":"
+			<< gFrameMarks[i]/1000.0 << "}";
+		separator = ",\n";
+	}
+	fout << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	return fout.good();
+}
+
+std::string Telemetry::Summary()
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2);
+	out << gFrameTimes.Count() << " frames, p50 " << gFrameTimes.Percentile(50.0) << " ms, p95 "
+		<< gFrameTimes.Percentile(95.0) << " ms, p99 " << gFrameTimes.Percentile(99.0) << " ms, "
+		<< DroppedEvents() << " events dropped\n";
+	return out.str();
+}
@@ -0,0 +1,171 @@
+//***************************************************************************************
+// Telemetry.h
+//
+// Where the time of a frame goes. A ScopedTimer (or TELEMETRY_SCOPE) records the
+// time from its construction to its destruction as an event; timers nest, and a
+// trace viewer shows a nested timer under the one it ran in.
+//
+// Every thread writes its events into its own ring, which only that thread writes
+// and only EndFrame reads, so recording takes no lock. EndFrame is called once per
+// frame from the main thread: it adds the frame time to the frame histogram and
+// moves the events of all rings into the capture, which WriteChromeTrace exports as
+// Chrome trace-event JSON (chrome://tracing, Perfetto).
+//
+// Names must outlive the capture; string literals are the intended use.
+//***************************************************************************************
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TELEMETRY_TSC
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace Telemetry
+{
+	// Nanoseconds on a steady clock since the process started.
+	uint64_t Now();
+
+	// Event timestamps: the time stamp counter where there is one, since reading it
+	// costs a fraction of a clock call, else Now(). Converted to nanoseconds only
+	// when exported, against the steady clock over the whole run.
+	inline uint64_t Ticks()
+	{
+#if defined(TELEMETRY_TSC)
+		return __rdtsc();
+#else
+		return Now();
+#endif
+	}
+
+	double TicksToNanoseconds(uint64_t ticks);
+
+	// Begin and End are in Ticks.
+	struct Event
+	{
+		const char* Name;
+		uint64_t Begin;
+		uint64_t End;
+		uint32_t Thread;
+	};
+
+	// Single producer, single consumer ring of events.
+	class EventRing
+	{
+	public:
+		static const uint32_t Capacity = 1 << 14;
+
+		explicit EventRing(uint32_t thread);
+
+		// Owning thread only. Events that do not fit are counted and dropped.
+		void Push(const char* name, uint64_t begin, uint64_t end)
+		{
+			uint32_t head = mHead.load(std::memory_order_relaxed);
+			if (head - mTail.load(std::memory_order_acquire) == Capacity)
+			{
+				mDropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			Event& e = mEvents[head & (Capacity - 1)];
+			e.Name = name;
+			e.Begin = begin;
+			e.End = end;
+			e.Thread = mThread;
+			mHead.store(head + 1, std::memory_order_release);
+		}
+
+		// Reader only. Appends the pending events to out.
+		void Drain(std::vector<Event>& out);
+
+		uint32_t Thread()const { return mThread; }
+		uint32_t Dropped()const { return mDropped.load(std::memory_order_relaxed); }
+
+	private:
+		EventRing(const EventRing& rhs);
+		EventRing& operator=(const EventRing& rhs);
+
+		std::vector<Event> mEvents;
+		uint32_t mThread;
+		std::atomic<uint32_t> mHead;
+		std::atomic<uint32_t> mTail;
+		std::atomic<uint32_t> mDropped;
+	};
+
+	// The calling thread's ring, created and registered on first use.
+	EventRing& ThreadRing();
+
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(const char* name) : mName(name), mBegin(Ticks()) {}
+		~ScopedTimer() { ThreadRing().Push(mName, mBegin, Ticks()); }
+
+	private:
+		ScopedTimer(const ScopedTimer& rhs);
+		ScopedTimer& operator=(const ScopedTimer& rhs);
+
+		const char* mName;
+		uint64_t mBegin;
+	};
+
+	// Frame times on log-linear buckets: eight per power of two from 1us up, so a
+	// percentile is off by at most 1/8th of its value.
+	class FrameHistogram
+	{
+	public:
+		static const unsigned int SubBuckets = 8;
+		static const unsigned int BucketCount = 32*SubBuckets;
+
+		FrameHistogram();
+
+		void Add(uint64_t nanoseconds);
+		void Clear();
+
+		uint64_t Count()const;
+
+		// Upper bound of the bucket holding the p-th percentile, p in [0, 100], in
+		// milliseconds. 0 when empty.
+		double Percentile(double p)const;
+
+	private:
+		static unsigned int Bucket(uint64_t microseconds);
+		static uint64_t BucketLimit(unsigned int bucket);
+
+		uint64_t mBuckets[BucketCount];
+		uint64_t mCount;
+	};
+
+	// Main thread, once per frame.
+	void EndFrame();
+
+	const FrameHistogram& FrameTimes();
+
+	// The capture keeps at most this many events; later ones are counted as dropped.
+	void SetCaptureLimit(size_t events);
+	const std::vector<Event>& Capture();
+	size_t DroppedEvents();
+
+	// Writes the capture and frame markers. Returns false if the file can't be written.
+	bool WriteChromeTrace(const char* path);
+
+	// One line with the frame count, p50/p95/p99 frame times and dropped events.
+	std::string Summary();
+}
+
+#define TELEMETRY_CONCAT_(a, b) a##b
+#define TELEMETRY_CONCAT(a, b) TELEMETRY_CONCAT_(a, b)
+#define TELEMETRY_SCOPE(name) Telemetry::ScopedTimer TELEMETRY_CONCAT(telemetryScope, __LINE__)(name)
+
+#endif // TELEMETRY_H
@@ -0,0 +1,416 @@
+//***************************************************************************************
+// AllocationProfilerTests.cpp
+//
+// Built into AllocationProfilerTests, with ALLOCATION_PROFILER defined, so every
+// operator new of the executable goes through the profiler.
+//***************************************************************************************
+
+#include "Test.h"
+#include "AllocationProfiler.h"
+#include "DemoScenes.h"
+#include "FrameMemory.h"
+#include "JobSystem.h"
+#include "LightGrid.h"
+#include "MeshBuilder.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// Blocks are stored here so that the compiler cannot drop a new and its delete.
+	void* volatile gEscaped;
+
+	template<class T>
+	T* Escape(T* p)
+	{
+		gEscaped = p;
+		return p;
+	}
+
+	AllocationProfiler::TagStats FindTag(const char* name)
+	{
+		std::vector<AllocationProfiler::TagStats> tags = AllocationProfiler::Tags();
+		for (size_t i = 0; i < tags.size(); ++i)
+		{
+			if (strcmp(tags[i].Name, name) == 0)
+				return tags[i];
+		}
+		AllocationProfiler::TagStats none = { name, 0, 0, 0, 0 };
+		return none;
+	}
+
+	AllocationProfiler::PhaseStats FindPhase(const char* name)
+	{
+		std::vector<AllocationProfiler::PhaseStats> phases = AllocationProfiler::Phases();
+		for (size_t i = phases.size(); i-- > 0; )
+		{
+			if (strcmp(phases[i].Name, name) == 0)
+				return phases[i];
+		}
+		AllocationProfiler::PhaseStats none = { name, 0, 0, 0, 0, 0 };
+		return none;
+	}
+
+	// One callsite for the profiler to find.
+#if defined(_MSC_VER)
+	__declspec(noinline)
+#else
+	__attribute__((noinline))
+#endif
+	char* AllocateMegabyte()
+	{
+		return new char[1 << 20];
+	}
+
+	// Lighting_Advanced's vertex.
+	struct Vertex
+	{
+		float Pos[3];
+		float Normal[3];
+		float Texture[2];
+		float Color[4];
+	};
+}
+
+#pragma region Tests
+TEST(AllocationProfiler, Enabled)
+{
+	CHECK(AllocationProfiler::Enabled());
+
+	uint64_t live = AllocationProfiler::LiveBytes();
+	int* p = Escape(new int[1000]);
+	CHECK(AllocationProfiler::LiveBytes() == live + 4000);
+	CHECK(AllocationProfiler::PeakBytes() >= live + 4000);
+	delete[] p;
+	CHECK(AllocationProfiler::LiveBytes() == live);
+}
+
+// The innermost tag takes the allocation, wherever it is freed.
+TEST(AllocationProfiler, NestedTags)
+{
+	std::vector<char>* outer = 0;
+	std::vector<char>* inner = 0;
+	{
+		ALLOCATION_TAG("Test.Outer");
+		outer = new std::vector<char>(100);
+		{
+			ALLOCATION_TAG("Test.Inner");
+			inner = new std::vector<char>(1000);
+		}
+	}
+
+	AllocationProfiler::TagStats o = FindTag("Test.Outer");
+	AllocationProfiler::TagStats i = FindTag("Test.Inner");
+	CHECK(o.Allocations == 2 && o.Bytes == sizeof(std::vector<char>) + 100 && o.LiveBytes == o.Bytes);
+	CHECK(i.Allocations == 2 && i.Bytes == sizeof(std::vector<char>) + 1000 && i.Frees == 0);
+
+	delete outer;
+	delete inner;
+	CHECK(FindTag("Test.Outer").LiveBytes == 0 && FindTag("Test.Outer").Frees == 2);
+	CHECK(FindTag("Test.Inner").LiveBytes == 0);
+}
+
+TEST(AllocationProfiler, FrameCounts)
+{
+	AllocationProfiler::EndFrame();
+
+	int* blocks[5];
+	for (int i = 0; i < 5; ++i)
+		blocks[i] = Escape(new int);
+	delete blocks[0];
+	delete blocks[1];
+
+	AllocationProfiler::FrameStats frame = AllocationProfiler::EndFrame();
+	CHECK(frame.Allocations == 5 && frame.Frees == 2 && frame.Bytes == 5*sizeof(int));
+
+	for (int i = 2; i < 5; ++i)
+		delete blocks[i];
+	frame = AllocationProfiler::EndFrame();
+	CHECK(frame.Allocations == 0 && frame.Frees == 3 && frame.Bytes == 0);
+}
+
+TEST(AllocationProfiler, Callsites)
+{
+	std::vector<char*> blocks;
+	blocks.reserve(8);
+	{
+		ALLOCATION_TAG("Test.Callsite");
+		for (int i = 0; i < 8; ++i)
+			blocks.push_back(AllocateMegabyte());
+	}
+	for (size_t i = 0; i < blocks.size(); ++i)
+		delete[] blocks[i];
+
+	std::vector<AllocationProfiler::CallsiteStats> sites = AllocationProfiler::Callsites(AllocationProfiler::MaxCallsites);
+	size_t found = 0;
+	for (size_t i = 0; i < sites.size(); ++i)
+	{
+		if (strcmp(sites[i].Tag, "Test.Callsite") == 0)
+		{
+			++found;
+			CHECK(sites[i].Address != 0 && sites[i].Allocations == 8 && sites[i].Bytes == 8 << 20);
+		}
+	}
+	CHECK(found == 1);
+
+	// Sorted by bytes.
+	for (size_t i = 1; i < sites.size(); ++i)
+		CHECK(sites[i - 1].Bytes >= sites[i].Bytes);
+}
+
+// An inner phase starts its peak from where the heap is; the outer one still sees
+// the inner's peak on top of its own.
+TEST(AllocationProfiler, NestedPhases)
+{
+	const uint64_t MB = 1 << 20;
+	{
+		ALLOCATION_PHASE("Test.Outer");
+		char* kept = Escape(new char[MB]);
+		{
+			ALLOCATION_PHASE("Test.Inner");
+			char* temporary = Escape(new char[4*MB]);
+			delete[] temporary;
+		}
+		delete[] kept;
+	}
+
+	AllocationProfiler::PhaseStats inner = FindPhase("Test.Inner");
+	AllocationProfiler::PhaseStats outer = FindPhase("Test.Outer");
+	CHECK(inner.Allocations == 1 && inner.Bytes == 4*MB);
+	CHECK(inner.PeakGrowth == 4*MB && inner.RetainedBytes == 0);
+	CHECK(inner.StartBytes >= outer.StartBytes + MB);
+
+	// The outer phase also holds the record of the inner one.
+	CHECK(outer.Allocations >= 2 && outer.Bytes >= 5*MB);
+	CHECK(outer.PeakGrowth >= 5*MB && outer.PeakGrowth < 5*MB + 64*1024);
+	CHECK(outer.RetainedBytes > -64*1024 && outer.RetainedBytes < 64*1024);
+}
+
+// Blocks allocated on workers and freed on the main thread: each thread holds half of
+// every block's count, and the sums come out right.
+TEST(AllocationProfiler, ThreadsFreeEachOthersBlocks)
+{
+	const int threadCount = 4;
+	const int count = 1000;
+	std::vector<int*> blocks[threadCount];
+	for (int t = 0; t < threadCount; ++t)
+		blocks[t].reserve(count);
+
+	std::thread threads[threadCount];
+	for (int t = 0; t < threadCount; ++t)
+	{
+		threads[t] = std::thread([&blocks, t]()
+		{
+			ALLOCATION_TAG("Test.Worker");
+			for (int i = 0; i < count; ++i)
+				blocks[t].push_back(new int[16]);
+		});
+	}
+	for (int t = 0; t < threadCount; ++t)
+		threads[t].join();
+
+	AllocationProfiler::TagStats worker = FindTag("Test.Worker");
+	CHECK(worker.Allocations == threadCount*count && worker.LiveBytes == threadCount*count*64);
+
+	for (int t = 0; t < threadCount; ++t)
+	{
+		for (int i = 0; i < count; ++i)
+			delete[] blocks[t][i];
+	}
+
+	worker = FindTag("Test.Worker");
+	CHECK(worker.Frees == threadCount*count && worker.LiveBytes == 0);
+}
+
+// Shaders_Basics's light grid, built each frame on two workers with its temporaries
+// in a frame arena: once the arena has grown to fit, no frame touches the heap.
+TEST(AllocationProfiler, LightGridFramesDoNotAllocate)
+{
+	std::vector<ClusterLight> lights(1024);
+	for (size_t i = 0; i < lights.size(); ++i)
+	{
+		ClusterLight& light = lights[i];
+		memset(&light, 0, sizeof(light));
+		float angle = i*0.37f;
+		light.Position[0] = 20.0f*cosf(angle);
+		light.Position[1] = 2.0f;
+		light.Position[2] = 20.0f*sinf(angle) + 30.0f;
+		light.Range = 4.0f;
+		light.SpotCos = -1.0f;
+	}
+	const float view[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+	JobSystem jobs(2);
+	LightGrid grid;
+	grid.SetView(view, 1.3f, 1.7f, 1.0f, 1000.0f);
+	FrameArena frames(1024);
+
+	uint64_t allocations = 0;
+	for (int frame = 0; frame < 100; ++frame)
+	{
+		frames.BeginFrame();
+		grid.Build(&lights[0], lights.size(), &jobs, &frames);
+
+		AllocationProfiler::FrameStats stats = AllocationProfiler::EndFrame();
+		if (frame >= 10)
+			allocations += stats.Allocations;
+	}
+	CHECK(allocations == 0);
+	CHECK(frames.Current().Used() > 0);
+}
+
+TEST(AllocationProfiler, Report)
+{
+	{
+		ALLOCATION_PHASE("Test.Reported");
+		ALLOCATION_TAG("Test.Reported");
+		std::vector<int> v(10);
+	}
+	AllocationProfiler::EndFrame();
+
+	std::string report = AllocationProfiler::Report(4);
+	CHECK(report.find(" allocations, ") != std::string::npos);
+	CHECK(report.find(" frames: ") != std::string::npos);
+	CHECK(report.find("\nTest.Reported ") != std::string::npos);
+	CHECK(report.find("\nphase Test.Reported ") != std::string::npos);
+	CHECK(report.find("\ncallsite ") != std::string::npos);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+namespace
+{
+	// The sizes of the small vectors and strings a frame churns through.
+	const size_t ChurnSizes[] = { 16, 24, 40, 64, 96, 128, 200, 256 };
+	const int ChurnCount = 200000;
+
+	void ChurnNew()
+	{
+		for (int i = 0; i < ChurnCount; ++i)
+			delete[] Escape(new char[ChurnSizes[i & 7]]);
+	}
+
+	void ChurnMalloc()
+	{
+		for (int i = 0; i < ChurnCount; ++i)
+			free(Escape(malloc(ChurnSizes[i & 7])));
+	}
+
+	void Threaded(void (*churn)())
+	{
+		std::thread threads[4];
+		for (int t = 0; t < 4; ++t)
+			threads[t] = std::thread(churn);
+		for (int t = 0; t < 4; ++t)
+			threads[t].join();
+	}
+}
+
+// A new/delete pair through the profiler, against the malloc/free it wraps.
+BENCH(AllocationProfiler, Overhead)
+{
+	double hooked = Test::MedianMs(9, ChurnNew)*1e6 / ChurnCount;
+	double plain = Test::MedianMs(9, ChurnMalloc)*1e6 / ChurnCount;
+	double hookedThreads = Test::MedianMs(5, []() { Threaded(ChurnNew); })*1e6 / (4*ChurnCount);
+	double plainThreads = Test::MedianMs(5, []() { Threaded(ChurnMalloc); })*1e6 / (4*ChurnCount);
+
+	printf("  new/delete %.1f ns, malloc/free %.1f ns; 4 threads: %.1f ns, %.1f ns\n",
+		hooked, plain, hookedThreads, plainThreads);
+}
+
+// Lighting_Advanced's BuildGeometryBuffers for the 1000x1000 grid, as phases: the old
+// way through a MeshData and a staging copy, and generated straight into vectors sized
+// once. The app now stages in scratch memory, which the heap does not see at all.
+BENCH(AllocationProfiler, GridPhases)
+{
+	const unsigned int n = 1000;
+	MeshBuilder::Counts counts = MeshBuilder::GridCounts(n, n);
+
+	{
+		ALLOCATION_PHASE("MeshData + copy");
+		std::vector<MeshBuilder::Attributes> meshVertices;
+		std::vector<unsigned int> meshIndices;
+		meshVertices.resize(counts.Vertices);
+		meshIndices.resize(counts.Indices);
+		MeshBuilder::CreateGrid(1000.0f, 1000.0f, n, n, &meshVertices[0], &meshIndices[0],
+			[](MeshBuilder::Attributes& out, const MeshBuilder::Attributes& in) { out = in; });
+
+		std::vector<Vertex> vertices;
+		for (size_t i = 0; i < meshVertices.size(); ++i)
+		{
+			Vertex v = {};
+			memcpy(v.Pos, meshVertices[i].Position, sizeof(v.Pos));
+			v.Normal[1] = 1.0f;
+			memcpy(v.Texture, meshVertices[i].TexC, sizeof(v.Texture));
+			vertices.push_back(v);
+		}
+		std::vector<unsigned int> indices;
+		indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+	}
+
+	{
+		ALLOCATION_PHASE("Sized once");
+		std::vector<Vertex> vertices(counts.Vertices);
+		std::vector<unsigned int> indices(counts.Indices);
+		MeshBuilder::CreateGrid(1000.0f, 1000.0f, n, n, &vertices[0], &indices[0],
+			[](Vertex& v, const MeshBuilder::Attributes& a)
+			{
+				memcpy(v.Pos, a.Position, sizeof(v.Pos));
+				v.Normal[0] = v.Normal[2] = 0.0f;
+				v.Normal[1] = 1.0f;
+				memcpy(v.Texture, a.TexC, sizeof(v.Texture));
+			});
+	}
+
+	const char* names[] = { "MeshData + copy", "Sized once" };
+	for (int i = 0; i < 2; ++i)
+	{
+		AllocationProfiler::PhaseStats phase = FindPhase(names[i]);
+		printf("  %-16s %5llu allocations, %6.1f MB allocated, %6.1f MB peak growth\n", names[i],
+			(unsigned long long)phase.Allocations, phase.Bytes/1048576.0, phase.PeakGrowth/1048576.0);
+	}
+}
+
+// The allocations of staging each demo scene that builds through GeometryArena, the
+// old way and the arena's; GeometryArenaTests times the same.
+BENCH(AllocationProfiler, SceneStaging)
+{
+	{
+		ALLOCATION_PHASE("Textures_Advanced vectors");
+		std::vector<DemoScenes::Basic32> vertices;
+		std::vector<unsigned int> indices;
+		DemoScenes::TexturesAdvancedVectors(vertices, indices);
+	}
+	{
+		ALLOCATION_PHASE("Textures_Advanced arena");
+		GeometryArena<DemoScenes::Basic32> arena;
+		DemoScenes::TexturesAdvancedArena(arena);
+	}
+	{
+		ALLOCATION_PHASE("Lighting_Intermediate vectors");
+		std::vector<DemoScenes::LitVertex> vertices;
+		std::vector<unsigned int> indices;
+		DemoScenes::LightingIntermediateVectors(vertices, indices);
+	}
+	{
+		ALLOCATION_PHASE("Lighting_Intermediate arena");
+		GeometryArena<DemoScenes::LitVertex> arena;
+		DemoScenes::LightingIntermediateArena(arena);
+	}
+
+	const char* names[] = { "Textures_Advanced vectors", "Textures_Advanced arena",
+		"Lighting_Intermediate vectors", "Lighting_Intermediate arena" };
+	for (int i = 0; i < 4; ++i)
+	{
+		AllocationProfiler::PhaseStats phase = FindPhase(names[i]);
+		printf("  %-29s %3llu allocations, %7.1f KB allocated, %7.1f KB peak growth\n", names[i],
+			(unsigned long long)phase.Allocations, phase.Bytes/1024.0, phase.PeakGrowth/1024.0);
+	}
+}
+#pragma endregion
@@ -0,0 +1,268 @@
+//***************************************************************************************
+// CommandBufferTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "CommandBuffer.h"
+#include "JobSystem.h"
+#include "RenderQueue.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	// The size of cbPerObject in Basic.fx: four matrices and a material.
+	struct PerObject
+	{
+		float World[16];
+		float WorldInvTranspose[16];
+		float WorldViewProj[16];
+		float TexTransform[16];
+		float Material[16];
+	};
+
+	// Shaders_Basics' seven traversals: the six cube map faces, then the main view.
+	const unsigned int ViewCount = 7;
+
+	const uint32_t DiffuseMapSlot = 0;
+	const uint32_t PerObjectConstants = 0;
+
+	// Records one view of a scene of count objects the way Shaders_Basics does: each
+	// object queued under its technique, texture and material, then submitted in key
+	// order with the binds the state cache lets through, its constants inline.
+	void RecordView(unsigned int view, size_t count, RenderQueue& queue, CommandBuffer& commands)
+	{
+		queue.Clear();
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint32_t depth = (uint32_t)((i*2654435761u + view*40503u) % 100000);
+			queue.Push(RenderKey::Make(0, (unsigned int)(i % 3), (unsigned int)(i % 5), (unsigned int)(i % 7), depth), (uint32_t)i);
+		}
+		queue.Sort();
+
+		RenderStateCache states;
+		for (size_t q = 0; q < queue.Size(); ++q)
+		{
+			uint64_t key = queue[q].Key;
+			uint32_t object = queue[q].Payload;
+
+			if (states.Bind(RenderStateCache::Technique, RenderKey::Technique(key)))
+				commands.BindTechnique(RenderKey::Technique(key));
+			if (states.Bind(RenderStateCache::Geometry, object % 4))
+				commands.BindGeometry(object % 4);
+			if (states.Bind(RenderStateCache::Texture, RenderKey::Texture(key)))
+				commands.BindResource(DiffuseMapSlot, RenderKey::Texture(key));
+
+			PerObject constants;
+			memset(&constants, 0, sizeof(constants));
+			for (int k = 0; k < 16; k += 5)
+				constants.World[k] = constants.WorldInvTranspose[k] = constants.TexTransform[k] = 1.0f;
+			constants.World[12] = (float)object;
+			constants.WorldViewProj[0] = (float)view;
+			constants.WorldViewProj[12] = (float)object*0.5f + (float)view;
+			constants.Material[0] = (float)RenderKey::Material(key);
+			commands.SetConstants(PerObjectConstants, constants);
+
+			commands.DrawIndexed(36 + object % 100, (uint32_t)(object*36), (int32_t)(object % 24));
+		}
+	}
+
+	// One buffer per view, each recorded as a job; returns once all are recorded.
+	void RecordViewsInParallel(JobSystem& jobs, size_t count, std::vector<RenderQueue>& queues, std::vector<CommandBuffer>& buffers)
+	{
+		JobCounter counter;
+		for (unsigned int v = 0; v < ViewCount; ++v)
+		{
+			jobs.Submit([v, count, &queues, &buffers]()
+			{
+				buffers[v].Reset();
+				RecordView(v, count, queues[v], buffers[v]);
+			}, &counter);
+		}
+		jobs.Wait(counter);
+	}
+
+	// The index of the first command where two recordings differ, or the shorter
+	// length if one is the start of the other.
+	size_t FirstDifference(const RecordingBackend& a, const RecordingBackend& b)
+	{
+		size_t count = a.Commands().size() < b.Commands().size() ? a.Commands().size() : b.Commands().size();
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (a.Commands()[i] != b.Commands()[i])
+				return i;
+		}
+		return count;
+	}
+
+	// Checks where constants arrive: every payload 8 byte aligned.
+	class AlignmentBackend : public RecordingBackend
+	{
+	public:
+		AlignmentBackend() : Misaligned(0) {}
+
+		void SetConstants(uint32_t slot, const void* data, size_t size)
+		{
+			Misaligned += reinterpret_cast<uintptr_t>(data) % 8 != 0;
+			RecordingBackend::SetConstants(slot, data, size);
+		}
+
+		size_t Misaligned;
+	};
+}
+
+#pragma region Tests
+TEST(CommandBuffer, ReplaysInRecordingOrder)
+{
+	CommandBuffer commands;
+	float constants[3] = { 1.0f, 2.0f, 3.0f };
+	commands.BindTechnique(4);
+	commands.BindGeometry(2);
+	commands.BindResource(1, 9);
+	commands.SetConstants(5, constants);
+	commands.DrawIndexed(36, 72, -3);
+	CHECK(commands.CommandCount() == 5 && commands.DrawCount() == 1);
+	CHECK(commands.SizeBytes() % 8 == 0);
+
+	RecordingBackend recording;
+	commands.Replay(recording);
+	const std::vector<RecordingBackend::Command>& c = recording.Commands();
+	REQUIRE(c.size() == 5);
+	CHECK(c[0].Op == CommandBuffer::OpBindTechnique && c[0].Args[0] == 4);
+	CHECK(c[1].Op == CommandBuffer::OpBindGeometry && c[1].Args[0] == 2);
+	CHECK(c[2].Op == CommandBuffer::OpBindResource && c[2].Args[0] == 1 && c[2].Args[1] == 9);
+	CHECK(c[3].Op == CommandBuffer::OpSetConstants && c[3].Args[0] == 5 && c[3].Args[1] == sizeof(constants));
+	CHECK(c[3].Data.size() == sizeof(constants) && memcmp(&c[3].Data[0], constants, sizeof(constants)) == 0);
+	CHECK(c[4].Op == CommandBuffer::OpDrawIndexed && c[4].Args[0] == 36 && c[4].Args[1] == 72 && (int32_t)c[4].Args[2] == -3);
+
+	NullBackend counts;
+	commands.Replay(counts);
+	CHECK(counts.GetStats().Commands == 5 && counts.GetStats().Binds == 3 && counts.GetStats().Draws == 1);
+	CHECK(counts.GetStats().ConstantUpdates == 1 && counts.GetStats().ConstantBytes == sizeof(constants));
+	CHECK(counts.GetStats().Indices == 36);
+
+	// Reset drops the commands, and nothing is replayed.
+	commands.Reset();
+	CHECK(commands.CommandCount() == 0 && commands.DrawCount() == 0 && commands.SizeBytes() == 0);
+	recording.Clear();
+	commands.Replay(recording);
+	CHECK(recording.Commands().empty());
+}
+
+// Constants of any size, between other commands: each payload reaches the backend 8
+// byte aligned, whole, and the commands after it are read correctly.
+TEST(CommandBuffer, ConstantsStayAligned)
+{
+	CommandBuffer commands;
+	unsigned char bytes[70];
+	for (int i = 0; i < 70; ++i)
+		bytes[i] = (unsigned char)(i*7 + 1);
+
+	for (size_t size = 1; size <= 70; ++size)
+	{
+		commands.SetConstants((uint32_t)size, bytes, size);
+		commands.BindResource((uint32_t)size, (uint32_t)(size*3));
+		CHECK(commands.SizeBytes() % 8 == 0);
+	}
+
+	AlignmentBackend backend;
+	commands.Replay(backend);
+	CHECK(backend.Misaligned == 0);
+
+	const std::vector<RecordingBackend::Command>& c = backend.Commands();
+	REQUIRE(c.size() == 140);
+	size_t wrong = 0;
+	for (size_t size = 1; size <= 70; ++size)
+	{
+		const RecordingBackend::Command& constants = c[2*(size - 1)];
+		const RecordingBackend::Command& bind = c[2*(size - 1) + 1];
+		wrong += constants.Op != CommandBuffer::OpSetConstants || constants.Args[0] != size;
+		wrong += constants.Data.size() != size || memcmp(&constants.Data[0], bytes, size) != 0;
+		wrong += bind.Op != CommandBuffer::OpBindResource || bind.Args[0] != size || bind.Args[1] != size*3;
+	}
+	CHECK(wrong == 0);
+}
+
+// The seven views recorded on jobs, one buffer each, and replayed in view order give
+// the same commands as all seven recorded on one thread into one buffer, frame after
+// frame of reused buffers.
+TEST(CommandBuffer, ParallelViewsReplayLikeSerial)
+{
+	const size_t objects = 500;
+	JobSystem jobs(3);
+	std::vector<RenderQueue> queues(ViewCount);
+	std::vector<CommandBuffer> buffers(ViewCount);
+
+	RenderQueue queue;
+	CommandBuffer serial;
+	for (unsigned int v = 0; v < ViewCount; ++v)
+		RecordView(v, objects, queue, serial);
+	RecordingBackend expected;
+	serial.Replay(expected);
+	CHECK(expected.Commands().size() == serial.CommandCount());
+
+	size_t wrongFrames = 0;
+	for (int frame = 0; frame < 10; ++frame)
+	{
+		RecordViewsInParallel(jobs, objects, queues, buffers);
+
+		RecordingBackend replayed;
+		size_t draws = 0;
+		for (unsigned int v = 0; v < ViewCount; ++v)
+		{
+			buffers[v].Replay(replayed);
+			draws += buffers[v].DrawCount();
+		}
+
+		bool same = replayed.Commands().size() == expected.Commands().size() &&
+			FirstDifference(replayed, expected) == expected.Commands().size();
+		wrongFrames += !same || draws != ViewCount*objects;
+	}
+	CHECK(wrongFrames == 0);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+// Seven views of 2000 objects each: recording on one thread and on jobs, and replaying
+// into the null backend.
+BENCH(CommandBuffer, RecordAndReplay)
+{
+	const size_t objects = 2000;
+	JobSystem jobs;
+	std::vector<RenderQueue> queues(ViewCount, RenderQueue(objects));
+	std::vector<CommandBuffer> buffers(ViewCount, CommandBuffer(1 << 20));
+
+	double serial = Test::MedianMs(21, [&queues, &buffers]()
+	{
+		for (unsigned int v = 0; v < ViewCount; ++v)
+		{
+			buffers[v].Reset();
+			RecordView(v, objects, queues[v], buffers[v]);
+		}
+	});
+
+	double parallel = Test::MedianMs(21, [&jobs, &queues, &buffers]()
+	{
+		RecordViewsInParallel(jobs, objects, queues, buffers);
+	});
+
+	NullBackend backend;
+	double replay = Test::MedianMs(21, [&buffers, &backend]()
+	{
+		backend.ResetStats();
+		for (unsigned int v = 0; v < ViewCount; ++v)
+			buffers[v].Replay(backend);
+	});
+
+	size_t bytes = 0;
+	for (unsigned int v = 0; v < ViewCount; ++v)
+		bytes += buffers[v].SizeBytes();
+	size_t commands = backend.GetStats().Commands;
+
+	printf("  %zu commands, %.2f MB: record %.2f ms serial, %.2f ms on %u threads; replay %.2f ms (%.1fM commands/s)\n",
+		commands, bytes/1048576.0, serial, parallel, jobs.ThreadCount(), replay, commands/(replay*1000.0));
+}
+#pragma endregion
@@ -0,0 +1,232 @@
+//***************************************************************************************
+// DemoScenes.h
+//
+// The meshes of the demos that build their scenes through GeometryArena, staged the
+// way BuildGeometryBuffers did before (GeometryGenerator's MeshData, one vector of
+// vertices and indices appended mesh by mesh) and the way it does now. Shared by the
+// GeometryArena timings and the allocation counts of AllocationProfilerTests.
+//
+// The old path's MeshData vectors are sized once and filled by MeshBuilder, which
+// makes the same allocations GeometryGenerator made.
+//***************************************************************************************
+
+#ifndef DEMOSCENES_H
+#define DEMOSCENES_H
+
+#include "GeometryArena.h"
+#include "MeshBuilder.h"
+
+#include <cstring>
+#include <vector>
+
+namespace DemoScenes
+{
+	// Textures_Advanced's Vertex::Basic32.
+	struct Basic32
+	{
+		float Pos[3];
+		float Normal[3];
+		float Tex01[2];
+		float Tex02[2];
+	};
+
+	// Lighting_Intermediate's vertex; the color holds the baked directional light.
+	struct LitVertex
+	{
+		float Pos[3];
+		float Normal[3];
+		float Color[4];
+	};
+
+	// Textures_Advanced's phone: six faces of two triangles, unindexed.
+	const Basic32 PhoneVertices[36] =
+	{
+		{ 3.65f, 0.0f, 7.35f, 0.0f, -1.0f, 0.0f, 0.501f, 0.05f, 0.0f, 0.0f },
+		{ -3.65f, 0.0f, 7.35f, 0.0f, -1.0f, 0.0f, 0.8894f, 0.05f, 0.0f, 0.0f },
+		{ -3.65f, 0.0f, -7.35f, 0.0f, -1.0f, 0.0f, 0.8894f, 0.9348f, 0.0f, 0.0f },
+		{ -3.65f, 0.0f, -7.35f, 0.0f, -1.0f, 0.0f, 0.8894f, 0.9348f, 0.0f, 0.0f },
+		{ 3.65f, 0.0f, -7.35f, 0.0f, -1.0f, 0.0f, 0.501f, 0.9348f, 0.0f, 0.0f },
+		{ 3.65f, 0.0f, 7.35f, 0.0f, -1.0f, 0.0f, 0.501f, 0.05f, 0.0f, 0.0f },
+		{ 3.65f, 0.8f, 7.35f, 0.0f, 1.0f, 0.0f, 0.432f, 0.0513f, -0.093f, -0.0227f },
+		{ 3.65f, 0.8f, -7.35f, 0.0f, 1.0f, 0.0f, 0.432f, 0.9277f, 1.12f, -0.0227f },
+		{ -3.65f, 0.8f, -7.35f, 0.0f, 1.0f, 0.0f, 0.0135f, 0.9277f, 1.12f, 1.0227f },
+		{ -3.65f, 0.8f, -7.35f, 0.0f, 1.0f, 0.0f, 0.0135f, 0.9277f, 1.12f, 1.0227f },
+		{ -3.65f, 0.8f, 7.35f, 0.0f, 1.0f, 0.0f, 0.0135f, 0.0513f, -0.093f, 1.0227f },
+		{ 3.65f, 0.8f, 7.35f, 0.0f, 1.0f, 0.0f, 0.432f, 0.0513f, -0.093f, -0.0227f },
+		{ 3.65f, 0.8f, -7.35f, 0.0f, 0.0f, -1.0f, 0.8931f, 0.9605f, 0.0f, 0.0f },
+		{ 3.65f, 0.0f, -7.35f, 0.0f, 0.0f, -1.0f, 0.8931f, 0.9921f, 0.0f, 0.0f },
+		{ -3.65f, 0.0f, -7.35f, 0.0f, 0.0f, -1.0f, 0.4987f, 0.9921f, 0.0f, 0.0f },
+		{ -3.65f, 0.0f, -7.35f, 0.0f, 0.0f, -1.0f, 0.4987f, 0.9921f, 0.0f, 0.0f },
+		{ -3.65f, 0.8f, -7.35f, 0.0f, 0.0f, -1.0f, 0.4987f, 0.9605f, 0.0f, 0.0f },
+		{ 3.65f, 0.8f, -7.35f, 0.0f, 0.0f, -1.0f, 0.8931f, 0.9605f, 0.0f, 0.0f },
+		{ 3.65f, 0.8f, 7.35f, 1.0f, 0.0f, 0.0f, 0.4508f, 0.0489f, 0.0f, 0.0f },
+		{ 3.65f, 0.0f, 7.35f, 1.0f, 0.0f, 0.0f, 0.4868f, 0.0489f, 0.0f, 0.0f },
+		{ 3.65f, 0.0f, -7.35f, 1.0f, 0.0f, 0.0f, 0.4868f, 0.9436f, 0.0f, 0.0f },
+		{ 3.65f, 0.0f, -7.35f, 1.0f, 0.0f, 0.0f, 0.4868f, 0.9436f, 0.0f, 0.0f },
+		{ 3.65f, 0.8f, -7.35f, 1.0f, 0.0f, 0.0f, 0.4508f, 0.9436f, 0.0f, 0.0f },
+		{ 3.65f, 0.8f, 7.35f, 1.0f, 0.0f, 0.0f, 0.4508f, 0.0489f, 0.0f, 0.0f },
+		{ -3.65f, 0.8f, 7.35f, 0.0f, 0.0f, 1.0f, 0.8949f, 0.00330001f, 0.0f, 0.0f },
+		{ -3.65f, 0.0f, 7.35f, 0.0f, 0.0f, 1.0f, 0.8949f, 0.0319f, 0.0f, 0.0f },
+		{ 3.65f, 0.0f, 7.35f, 0.0f, 0.0f, 1.0f, 0.5027f, 0.0319f, 0.0f, 0.0f },
+		{ 3.65f, 0.0f, 7.35f, 0.0f, 0.0f, 1.0f, 0.5027f, 0.0319f, 0.0f, 0.0f },
+		{ 3.65f, 0.8f, 7.35f, 0.0f, 0.0f, 1.0f, 0.5027f, 0.00330001f, 0.0f, 0.0f },
+		{ -3.65f, 0.8f, 7.35f, 0.0f, 0.0f, 1.0f, 0.8949f, 0.00330001f, 0.0f, 0.0f },
+		{ -3.65f, 0.8f, -7.35f, -1.0f, 0.0f, 0.0f, 0.944f, 0.943f, 0.0f, 0.0f },
+		{ -3.65f, 0.0f, -7.35f, -1.0f, 0.0f, 0.0f, 0.9047f, 0.943f, 0.0f, 0.0f },
+		{ -3.65f, 0.0f, 7.35f, -1.0f, 0.0f, 0.0f, 0.9047f, 0.0561f, 0.0f, 0.0f },
+		{ -3.65f, 0.0f, 7.35f, -1.0f, 0.0f, 0.0f, 0.9047f, 0.0561f, 0.0f, 0.0f },
+		{ -3.65f, 0.8f, 7.35f, -1.0f, 0.0f, 0.0f, 0.944f, 0.0561f, 0.0f, 0.0f },
+		{ -3.65f, 0.8f, -7.35f, -1.0f, 0.0f, 0.0f, 0.944f, 0.943f, 0.0f, 0.0f },
+	};
+
+	struct MeshData
+	{
+		std::vector<MeshBuilder::Attributes> Vertices;
+		std::vector<unsigned int> Indices;
+	};
+
+	inline void CopyAttributes(MeshBuilder::Attributes& out, const MeshBuilder::Attributes& in)
+	{
+		out = in;
+	}
+
+	inline void CreateBox(float width, float height, float depth, MeshData& mesh)
+	{
+		MeshBuilder::Counts counts = MeshBuilder::BoxCounts();
+		mesh.Vertices.resize(counts.Vertices);
+		mesh.Indices.resize(counts.Indices);
+		MeshBuilder::CreateBox(width, height, depth, &mesh.Vertices[0], &mesh.Indices[0], CopyAttributes);
+	}
+
+	inline void CreateGrid(float width, float depth, unsigned int m, unsigned int n, MeshData& mesh)
+	{
+		MeshBuilder::Counts counts = MeshBuilder::GridCounts(m, n);
+		mesh.Vertices.resize(counts.Vertices);
+		mesh.Indices.resize(counts.Indices);
+		MeshBuilder::CreateGrid(width, depth, m, n, &mesh.Vertices[0], &mesh.Indices[0], CopyAttributes);
+	}
+
+	template<class V>
+	void SetPositionNormal(V& v, const float* position, float nx, float ny, float nz)
+	{
+		memset(&v, 0, sizeof(v));
+		memcpy(v.Pos, position, sizeof(v.Pos));
+		v.Normal[0] = nx;
+		v.Normal[1] = ny;
+		v.Normal[2] = nz;
+	}
+
+#pragma region Textures_Advanced
+	// The phone, a 200x100x10 wall box and a 10x10 grid over 200x200.
+	inline void TexturesAdvancedVectors(std::vector<Basic32>& vertices, std::vector<unsigned int>& indices)
+	{
+		MeshData wall;
+		MeshData grid;
+		CreateBox(200.0f, 100.0f, 10.0f, wall);
+		CreateGrid(200.0f, 200.0f, 10, 10, grid);
+
+		vertices.assign(36 + wall.Vertices.size() + grid.Vertices.size(), Basic32());
+		size_t k = 0;
+		for (size_t i = 0; i < 36; ++i, ++k)
+			vertices[k] = PhoneVertices[i];
+		for (size_t i = 0; i < wall.Vertices.size(); ++i, ++k)
+			SetPositionNormal(vertices[k], wall.Vertices[i].Position, 0.0f, 0.0f, 1.0f);
+		for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
+			SetPositionNormal(vertices[k], grid.Vertices[i].Position, 0.0f, 1.0f, 0.0f);
+
+		indices.clear();
+		for (unsigned int i = 0; i < 36; ++i)
+			indices.push_back(i);
+		indices.insert(indices.end(), wall.Indices.begin(), wall.Indices.end());
+		indices.insert(indices.end(), grid.Indices.begin(), grid.Indices.end());
+	}
+
+	inline void TexturesAdvancedArena(GeometryArena<Basic32>& arena)
+	{
+		arena.Reserve(3);
+
+		unsigned int phoneIndices[36];
+		for (unsigned int i = 0; i < 36; ++i)
+			phoneIndices[i] = i;
+		arena.Add(std::vector<Basic32>(PhoneVertices, PhoneVertices + 36),
+			std::vector<unsigned int>(phoneIndices, phoneIndices + 36));
+
+		MeshBuilder::Counts wall = MeshBuilder::BoxCounts();
+		arena.Add((unsigned int)wall.Vertices, (unsigned int)wall.Indices, [](Basic32* vertices, unsigned int* indices)
+		{
+			MeshBuilder::CreateBox(200.0f, 100.0f, 10.0f, vertices, indices, [](Basic32& v, const MeshBuilder::Attributes& a)
+			{
+				SetPositionNormal(v, a.Position, 0.0f, 0.0f, 1.0f);
+			});
+		});
+
+		MeshBuilder::Counts grid = MeshBuilder::GridCounts(10, 10);
+		arena.Add((unsigned int)grid.Vertices, (unsigned int)grid.Indices, [](Basic32* vertices, unsigned int* indices)
+		{
+			MeshBuilder::CreateGrid(200.0f, 200.0f, 10, 10, vertices, indices, [](Basic32& v, const MeshBuilder::Attributes& a)
+			{
+				SetPositionNormal(v, a.Position, 0.0f, 1.0f, 0.0f);
+			});
+		});
+
+		arena.Build();
+	}
+#pragma endregion
+
+#pragma region Lighting_Intermediate
+	// Four copies of a 200x100x10 wall box, each lit on its own, and a 200x200 grid
+	// over 200x200. The light baking that follows is left out.
+	inline void LightingIntermediateVectors(std::vector<LitVertex>& vertices, std::vector<unsigned int>& indices)
+	{
+		MeshData wall;
+		MeshData grid;
+		CreateBox(200.0f, 100.0f, 10.0f, wall);
+		CreateGrid(200.0f, 200.0f, 200, 200, grid);
+
+		vertices.assign(4*wall.Vertices.size() + grid.Vertices.size(), LitVertex());
+		size_t k = 0;
+		for (int w = 0; w < 4; ++w)
+		{
+			for (size_t i = 0; i < wall.Vertices.size(); ++i, ++k)
+				SetPositionNormal(vertices[k], wall.Vertices[i].Position, 0.0f, 0.0f, 1.0f);
+		}
+		for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
+			SetPositionNormal(vertices[k], grid.Vertices[i].Position, 0.0f, 1.0f, 0.0f);
+
+		indices.clear();
+		indices.insert(indices.end(), wall.Indices.begin(), wall.Indices.end());
+		indices.insert(indices.end(), grid.Indices.begin(), grid.Indices.end());
+	}
+
+	// The app generates the grid on its job system; this is the single-threaded path.
+	inline void LightingIntermediateArena(GeometryArena<LitVertex>& arena)
+	{
+		arena.Reserve(5);
+
+		MeshBuilder::Counts wall = MeshBuilder::BoxCounts();
+		for (int w = 0; w < 4; ++w)
+		{
+			arena.Add((unsigned int)wall.Vertices, (unsigned int)wall.Indices, [](LitVertex* vertices, unsigned int* indices)
+			{
+				MeshBuilder::CreateBox(200.0f, 100.0f, 10.0f, vertices, indices, [](LitVertex& v, const MeshBuilder::Attributes& a)
+				{
+					SetPositionNormal(v, a.Position, 0.0f, 0.0f, 1.0f);
+				});
+			});
+		}
+
+		MeshBuilder::Counts grid = MeshBuilder::GridCounts(200, 200);
+		arena.Add((unsigned int)grid.Vertices, (unsigned int)grid.Indices, [](LitVertex* vertices, unsigned int* indices)
+		{
+			MeshBuilder::CreateGrid(200.0f, 200.0f, 200, 200, vertices, indices, [](LitVertex& v, const MeshBuilder::Attributes& a)
+			{
+				SetPositionNormal(v, a.Position, 0.0f, 1.0f, 0.0f);
+			});
+		});
+
+		arena.Build();
+	}
+#pragma endregion
+}
+
+#endif // DEMOSCENES_H
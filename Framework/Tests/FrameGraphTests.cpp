@@ -0,0 +1,390 @@
+//***************************************************************************************
+// FrameGraphTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "FrameGraph.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	// Formats and flags only have to compare equal, so these stand for D3D11's.
+	const unsigned int ColorFormat = 28;		// DXGI_FORMAT_R8G8B8A8_UNORM
+	const unsigned int DepthFormat = 40;		// DXGI_FORMAT_D32_FLOAT
+	const unsigned int ColorBind = 0x28;		// D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE
+	const unsigned int DepthBind = 0x40;		// D3D11_BIND_DEPTH_STENCIL
+	const unsigned int CubeMips = 0x84;			// D3D11_RESOURCE_MISC_GENERATE_MIPS | D3D11_RESOURCE_MISC_TEXTURECUBE
+
+	TransientDesc Color(unsigned int width, unsigned int height)
+	{
+		TransientDesc desc = { width, height, 1, 1, ColorFormat, 4, ColorBind, 0 };
+		return desc;
+	}
+
+	TransientDesc Depth(unsigned int width, unsigned int height)
+	{
+		TransientDesc desc = { width, height, 1, 1, DepthFormat, 4, DepthBind, 0 };
+		return desc;
+	}
+
+	// A deferred frame with bloom and a debug view nothing reads.
+	struct DeferredFrame
+	{
+		FrameGraph Graph;
+		FrameGraph::ResourceId BackBuffer, GBuffer, SceneDepth, Light, Bloom0, Bloom1, Debug;
+		FrameGraph::PassId GBufferPass, LightingPass, DebugPass, BloomDownPass, BloomBlurPass, CompositePass;
+		unsigned int Ran;
+
+		DeferredFrame(unsigned int width, unsigned int height)
+			: Ran(0)
+		{
+			BackBuffer = Graph.Import("BackBuffer");
+			GBuffer = Graph.CreateTransient("GBuffer", Color(width, height));
+			SceneDepth = Graph.CreateTransient("Depth", Depth(width, height));
+			Light = Graph.CreateTransient("Light", Color(width, height));
+			Bloom0 = Graph.CreateTransient("Bloom0", Color(width/2, height/2));
+			Bloom1 = Graph.CreateTransient("Bloom1", Color(width/2, height/2));
+			Debug = Graph.CreateTransient("Debug", Color(width, height));
+
+			GBufferPass = Graph.AddPass("GBuffer", [this]() { Ran |= 1; });
+			Graph.Write(GBufferPass, GBuffer);
+			Graph.Write(GBufferPass, SceneDepth, FrameGraph::DepthWrite);
+
+			LightingPass = Graph.AddPass("Lighting", [this]() { Ran |= 2; });
+			Graph.Read(LightingPass, GBuffer);
+			Graph.Read(LightingPass, SceneDepth);
+			Graph.Write(LightingPass, Light);
+
+			DebugPass = Graph.AddPass("DebugView", [this]() { Ran |= 64; });
+			Graph.Read(DebugPass, GBuffer);
+			Graph.Write(DebugPass, Debug);
+
+			BloomDownPass = Graph.AddPass("BloomDown", [this]() { Ran |= 4; });
+			Graph.Read(BloomDownPass, Light);
+			Graph.Write(BloomDownPass, Bloom0);
+
+			BloomBlurPass = Graph.AddPass("BloomBlur", [this]() { Ran |= 8; });
+			Graph.Read(BloomBlurPass, Bloom0);
+			Graph.Write(BloomBlurPass, Bloom1);
+
+			CompositePass = Graph.AddPass("Composite", [this]() { Ran |= 16; });
+			Graph.Read(CompositePass, Light);
+			Graph.Read(CompositePass, Bloom1);
+			Graph.Write(CompositePass, BackBuffer);
+
+			Graph.Compile();
+		}
+	};
+
+	// count same-size passes, each reading the last one's target; the last writes
+	// the back buffer.
+	void PingPong(FrameGraph& graph, unsigned int count, unsigned int width, unsigned int height)
+	{
+		FrameGraph::ResourceId backBuffer = graph.Import("BackBuffer");
+		FrameGraph::ResourceId last = 0;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			FrameGraph::ResourceId target = graph.CreateTransient("PingPong", Color(width, height));
+			FrameGraph::PassId pass = graph.AddPass("Filter", FrameGraph::PassFunction());
+			if (i > 0)
+				graph.Read(pass, last);
+			graph.Write(pass, target);
+			last = target;
+		}
+		FrameGraph::PassId out = graph.AddPass("Present", FrameGraph::PassFunction());
+		graph.Read(out, last);
+		graph.Write(out, backBuffer);
+		graph.Compile();
+	}
+
+	// The graphs the demos build in BuildFrameGraph.
+	void TexturesAdvanced(FrameGraph& graph, unsigned int width, unsigned int height)
+	{
+		FrameGraph::ResourceId screen = graph.CreateTransient("PhoneScreen", Color(width, height));
+		FrameGraph::ResourceId backBuffer = graph.Import("BackBuffer");
+		FrameGraph::ResourceId depthStencil = graph.Import("DepthStencil");
+
+		FrameGraph::PassId screenPass = graph.AddPass("PhoneScreen", FrameGraph::PassFunction());
+		graph.Write(screenPass, screen);
+		graph.Write(screenPass, depthStencil, FrameGraph::DepthWrite);
+
+		FrameGraph::PassId mainPass = graph.AddPass("Main", FrameGraph::PassFunction());
+		graph.Read(mainPass, screen);
+		graph.Write(mainPass, backBuffer);
+		graph.Write(mainPass, depthStencil, FrameGraph::DepthWrite);
+		graph.Compile();
+	}
+
+	void ShadersBasics(FrameGraph& graph, unsigned int cubeMapSize)
+	{
+		TransientDesc cubeDesc = { cubeMapSize, cubeMapSize, 6, 0, ColorFormat, 4, ColorBind, CubeMips };
+		FrameGraph::ResourceId cube = graph.CreateTransient("DynamicCubeMap", cubeDesc);
+		FrameGraph::ResourceId cubeDepth = graph.CreateTransient("DynamicCubeMapDepth", Depth(cubeMapSize, cubeMapSize));
+		FrameGraph::ResourceId backBuffer = graph.Import("BackBuffer");
+		FrameGraph::ResourceId depthStencil = graph.Import("DepthStencil");
+
+		FrameGraph::PassId faces = graph.AddPass("CubeMapFaces", FrameGraph::PassFunction());
+		graph.Write(faces, cube);
+		graph.Write(faces, cubeDepth, FrameGraph::DepthWrite);
+
+		FrameGraph::PassId mips = graph.AddPass("GenerateMips", FrameGraph::PassFunction());
+		graph.Write(mips, cube);
+
+		FrameGraph::PassId mainView = graph.AddPass("MainView", FrameGraph::PassFunction());
+		graph.Read(mainView, cube);
+		graph.Write(mainView, backBuffer);
+		graph.Write(mainView, depthStencil, FrameGraph::DepthWrite);
+		graph.Compile();
+	}
+
+	double Megabytes(uint64_t bytes)
+	{
+		return bytes/(1024.0*1024.0);
+	}
+}
+
+#pragma region Tests
+TEST(FrameGraph, DescBytes)
+{
+	CHECK(Color(800, 600).Bytes() == 800*600*4);
+
+	// 256, 128, ... 1: nine levels of six faces.
+	TransientDesc cube = { 256, 256, 6, 0, ColorFormat, 4, ColorBind, CubeMips };
+	uint64_t chain = 0;
+	for (unsigned int size = 256; size >= 1; size /= 2)
+		chain += size*size*4;
+	CHECK(cube.Bytes() == chain*6);
+
+	CHECK(Color(800, 600) == Color(800, 600));
+	CHECK(Color(800, 600) != Depth(800, 600));
+}
+
+// A pass is culled when nothing kept reads what it writes, and passes writing only
+// what a culled pass reads go with it; imports keep their writers.
+TEST(FrameGraph, Culling)
+{
+	DeferredFrame frame(1280, 720);
+	FrameGraph& graph = frame.Graph;
+
+	CHECK(graph.IsCulled(frame.DebugPass));
+	CHECK(!graph.IsCulled(frame.GBufferPass) && !graph.IsCulled(frame.LightingPass));
+	CHECK(!graph.IsCulled(frame.BloomDownPass) && !graph.IsCulled(frame.BloomBlurPass));
+	CHECK(!graph.IsCulled(frame.CompositePass));
+
+	graph.Execute();
+	CHECK(frame.Ran == 31);
+
+	// Without the composite nothing reaches the back buffer, so nothing is kept.
+	FrameGraph chain;
+	FrameGraph::ResourceId a = chain.CreateTransient("A", Color(64, 64));
+	FrameGraph::ResourceId b = chain.CreateTransient("B", Color(64, 64));
+	FrameGraph::PassId first = chain.AddPass("First", FrameGraph::PassFunction());
+	chain.Write(first, a);
+	FrameGraph::PassId second = chain.AddPass("Second", FrameGraph::PassFunction());
+	chain.Read(second, a);
+	chain.Write(second, b);
+	chain.Compile();
+	CHECK(chain.IsCulled(first) && chain.IsCulled(second));
+	CHECK(chain.PhysicalCount() == 0);
+}
+
+// Lifetimes run from the first to the last kept pass using a transient; a transient
+// only culled passes use has none.
+TEST(FrameGraph, Lifetimes)
+{
+	DeferredFrame frame(1280, 720);
+	FrameGraph& graph = frame.Graph;
+
+	CHECK(graph.FirstUse(frame.GBuffer) == frame.GBufferPass && graph.LastUse(frame.GBuffer) == frame.LightingPass);
+	CHECK(graph.FirstUse(frame.Light) == frame.LightingPass && graph.LastUse(frame.Light) == frame.CompositePass);
+	CHECK(graph.FirstUse(frame.Bloom0) == frame.BloomDownPass && graph.LastUse(frame.Bloom0) == frame.BloomBlurPass);
+	CHECK(graph.FirstUse(frame.Bloom1) == frame.BloomBlurPass && graph.LastUse(frame.Bloom1) == frame.CompositePass);
+	CHECK(graph.FirstUse(frame.Debug) == 6);
+	CHECK(!graph.IsTransient(frame.BackBuffer) && graph.IsTransient(frame.Light));
+}
+
+// Transients share a physical target only with matching descriptions and lifetimes
+// that don't overlap.
+TEST(FrameGraph, Aliasing)
+{
+	DeferredFrame frame(1280, 720);
+	FrameGraph& graph = frame.Graph;
+
+	// The G-buffer ends with lighting, which writes the light target meanwhile.
+	CHECK(graph.Physical(frame.GBuffer) != graph.Physical(frame.Light));
+	CHECK(graph.Physical(frame.Bloom0) != graph.Physical(frame.Bloom1));
+	CHECK(graph.PhysicalCount() == 5);
+
+	// Once the G-buffer is done the bloom chain at full size can take it.
+	FrameGraph full;
+	FrameGraph::ResourceId backBuffer = full.Import("BackBuffer");
+	FrameGraph::ResourceId gbuffer = full.CreateTransient("GBuffer", Color(640, 480));
+	FrameGraph::ResourceId light = full.CreateTransient("Light", Color(640, 480));
+	FrameGraph::ResourceId blur = full.CreateTransient("Blur", Color(640, 480));
+	FrameGraph::ResourceId depth = full.CreateTransient("Depth", Depth(640, 480));
+	FrameGraph::PassId p0 = full.AddPass("GBuffer", FrameGraph::PassFunction());
+	full.Write(p0, gbuffer);
+	full.Write(p0, depth, FrameGraph::DepthWrite);
+	FrameGraph::PassId p1 = full.AddPass("Lighting", FrameGraph::PassFunction());
+	full.Read(p1, gbuffer);
+	full.Write(p1, light);
+	FrameGraph::PassId p2 = full.AddPass("Blur", FrameGraph::PassFunction());
+	full.Read(p2, light);
+	full.Write(p2, blur);
+	FrameGraph::PassId p3 = full.AddPass("Composite", FrameGraph::PassFunction());
+	full.Read(p3, blur);
+	full.Read(p3, depth);
+	full.Write(p3, backBuffer);
+	full.Compile();
+
+	CHECK(full.Physical(blur) == full.Physical(gbuffer));
+	CHECK(full.Physical(light) != full.Physical(gbuffer));
+	CHECK(full.Physical(depth) != full.Physical(gbuffer));
+	CHECK(full.PhysicalCount() == 3);
+	CHECK(full.PhysicalDesc(full.Physical(depth)) == Depth(640, 480));
+
+	// A chain of passes ping-pongs between two targets.
+	FrameGraph chain;
+	PingPong(chain, 6, 256, 256);
+	CHECK(chain.PhysicalCount() == 2);
+	FrameGraph::MemoryStats stats = chain.Memory();
+	CHECK(stats.Transients == 6 && stats.Unaliased == 3*stats.Pooled);
+}
+
+// Transients alive at the same time never overlap in the heap, every offset is
+// aligned, and the heap is no larger than the pooled targets.
+TEST(FrameGraph, HeapPlacement)
+{
+	DeferredFrame frame(1280, 720);
+	FrameGraph& graph = frame.Graph;
+
+	const FrameGraph::ResourceId placed[] = { frame.GBuffer, frame.SceneDepth, frame.Light, frame.Bloom0, frame.Bloom1 };
+	const int count = 5;
+	const uint64_t bytes[] = { Color(1280, 720).Bytes(), Depth(1280, 720).Bytes(), Color(1280, 720).Bytes(),
+		Color(640, 360).Bytes(), Color(640, 360).Bytes() };
+	FrameGraph::MemoryStats stats = graph.Memory();
+
+	size_t overlaps = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		FrameGraph::ResourceId a = placed[i];
+		uint64_t aEnd = graph.HeapOffset(a) + bytes[i];
+		CHECK(graph.HeapOffset(a) % FrameGraph::HeapAlignment == 0);
+		CHECK(aEnd <= stats.Heap);
+
+		for (int k = i + 1; k < count; ++k)
+		{
+			FrameGraph::ResourceId b = placed[k];
+			uint64_t bEnd = graph.HeapOffset(b) + bytes[k];
+			bool together = graph.FirstUse(a) <= graph.LastUse(b) && graph.FirstUse(b) <= graph.LastUse(a);
+			bool apart = aEnd <= graph.HeapOffset(b) || bEnd <= graph.HeapOffset(a);
+			overlaps += together && !apart;
+		}
+	}
+	CHECK(overlaps == 0);
+	CHECK(stats.Heap <= stats.Pooled + count*FrameGraph::HeapAlignment);
+	CHECK(stats.Heap < stats.Unaliased);
+
+	// The bloom targets fit where the G-buffer was, after lighting.
+	CHECK(stats.Heap < stats.Pooled);
+}
+
+// Each kept pass lists the transitions it needs, from where the last kept pass left
+// each resource; transients start undefined, and culled passes need none.
+TEST(FrameGraph, TransitionOrder)
+{
+	DeferredFrame frame(1280, 720);
+	FrameGraph& graph = frame.Graph;
+
+	const std::vector<FrameGraph::Transition>& gbuffer = graph.Transitions(frame.GBufferPass);
+	REQUIRE(gbuffer.size() == 2);
+	CHECK(gbuffer[0].Resource == frame.GBuffer && gbuffer[0].Before == FrameGraph::Undefined && gbuffer[0].After == FrameGraph::RenderTargetWrite);
+	CHECK(gbuffer[1].Resource == frame.SceneDepth && gbuffer[1].Before == FrameGraph::Undefined && gbuffer[1].After == FrameGraph::DepthWrite);
+
+	const std::vector<FrameGraph::Transition>& lighting = graph.Transitions(frame.LightingPass);
+	REQUIRE(lighting.size() == 3);
+	CHECK(lighting[0].Resource == frame.GBuffer && lighting[0].Before == FrameGraph::RenderTargetWrite && lighting[0].After == FrameGraph::ShaderRead);
+	CHECK(lighting[1].Resource == frame.SceneDepth && lighting[1].Before == FrameGraph::DepthWrite && lighting[1].After == FrameGraph::ShaderRead);
+	CHECK(lighting[2].Resource == frame.Light && lighting[2].After == FrameGraph::RenderTargetWrite);
+
+	CHECK(graph.Transitions(frame.DebugPass).empty());
+
+	// Light was last written by lighting; the composite reads it, and bloom down read
+	// it already, so the composite needs no transition for it.
+	const std::vector<FrameGraph::Transition>& composite = graph.Transitions(frame.CompositePass);
+	size_t light = 0;
+	for (size_t i = 0; i < composite.size(); ++i)
+		light += composite[i].Resource == frame.Light;
+	CHECK(light == 0);
+
+	// Execute hands them over in pass order, before each pass runs.
+	std::vector<FrameGraph::Transition> seen;
+	graph.Execute([&seen](const FrameGraph::Transition& t) { seen.push_back(t); });
+	size_t expected = 0;
+	for (FrameGraph::PassId p = frame.GBufferPass; p <= frame.CompositePass; ++p)
+		expected += graph.Transitions(p).size();
+	REQUIRE(seen.size() == expected);
+	CHECK(seen[0].Resource == frame.GBuffer && seen[2].Resource == frame.GBuffer && seen[2].After == FrameGraph::ShaderRead);
+
+	// Reset leaves nothing behind for the next description.
+	graph.Reset();
+	CHECK(graph.PhysicalCount() == 0 && graph.Memory().Transients == 0);
+}
+
+// The demos' own graphs: nothing culled, each transient its own target.
+TEST(FrameGraph, DemoGraphs)
+{
+	FrameGraph textures;
+	TexturesAdvanced(textures, 800, 600);
+	CHECK(!textures.IsCulled(0) && !textures.IsCulled(1));
+	CHECK(textures.PhysicalCount() == 1);
+
+	FrameGraph shaders;
+	ShadersBasics(shaders, 256);
+	CHECK(!shaders.IsCulled(0) && !shaders.IsCulled(1) && !shaders.IsCulled(2));
+	CHECK(shaders.PhysicalCount() == 2);
+	CHECK(shaders.Memory().Pooled == shaders.Memory().Unaliased);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+namespace
+{
+	void PrintMemory(const char* name, const FrameGraph& graph)
+	{
+		FrameGraph::MemoryStats stats = graph.Memory();
+		printf("  %-30s %u transients %6.2f MB unaliased, %6.2f MB in %u pooled targets (%+5.1f%%), %6.2f MB as a heap (%+5.1f%%)\n",
+			name, stats.Transients, Megabytes(stats.Unaliased), Megabytes(stats.Pooled), stats.PhysicalTargets,
+			100.0*((double)stats.Pooled/stats.Unaliased - 1.0), Megabytes(stats.Heap),
+			100.0*((double)stats.Heap/stats.Unaliased - 1.0));
+	}
+}
+
+// Transient memory per demo, as BuildFrameGraph describes it at an 800x600 window,
+// next to graphs that have lifetimes to alias; and the cost of compiling.
+BENCH(FrameGraph, MemoryReport)
+{
+	FrameGraph textures;
+	TexturesAdvanced(textures, 800, 600);
+	PrintMemory("Textures_Advanced (800x600)", textures);
+
+	FrameGraph shaders;
+	ShadersBasics(shaders, 256);
+	PrintMemory("Shaders_Basics (256 cube map)", shaders);
+
+	DeferredFrame deferred(1280, 720);
+	PrintMemory("G-buffer + bloom (1280x720)", deferred.Graph);
+
+	FrameGraph chain;
+	PingPong(chain, 4, 1280, 720);
+	PrintMemory("4 pass ping-pong (1280x720)", chain);
+
+	double compile = Test::MedianMs(101, []()
+	{
+		DeferredFrame frame(1280, 720);
+	});
+	printf("  G-buffer + bloom build and compile: %.1f us\n", compile*1000.0);
+}
+#pragma endregion
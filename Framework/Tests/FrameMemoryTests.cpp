@@ -0,0 +1,321 @@
+//***************************************************************************************
+// FrameMemoryTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "FrameMemory.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	bool Aligned(const void* p, size_t alignment)
+	{
+		return reinterpret_cast<uintptr_t>(p) % alignment == 0;
+	}
+
+	// A draw packet, as the render queue records them.
+	struct Packet
+	{
+		float World[16];
+		unsigned int Geometry;
+		unsigned int IndexCount;
+		unsigned int StartIndex;
+		int BaseVertex;
+	};
+
+	struct Counted
+	{
+		static int Live;
+
+		explicit Counted(int value) : Value(value) { ++Live; }
+		~Counted() { --Live; }
+
+		int Value;
+	};
+
+	int Counted::Live = 0;
+
+	// Written through, so that the compiler keeps every allocation.
+	void* volatile gSink;
+}
+
+#pragma region Tests
+TEST(FrameMemory, LinearArenaAligns)
+{
+	LinearArena arena(4096);
+	char* a = static_cast<char*>(arena.Allocate(3, 1));
+	char* b = static_cast<char*>(arena.Allocate(8));
+	char* c = static_cast<char*>(arena.Allocate(5, 64));
+	double* d = arena.Allocate<double>(4);
+
+	CHECK(Aligned(b, DefaultArenaAlignment) && Aligned(c, 64) && Aligned(d, DefaultArenaAlignment));
+	CHECK(a + 3 <= b && b + 8 <= c && c + 5 <= reinterpret_cast<char*>(d));
+	CHECK(arena.Used() <= 3 + (8 + 15) + (5 + 63) + (32 + 15));
+	CHECK(arena.Overflows() == 0);
+
+	arena.Reset();
+	CHECK(arena.Used() == 0 && arena.HighWater() > 0);
+	CHECK(arena.Allocate(3, 1) == a);
+}
+
+// A round that outgrows the block spills onto the heap; the next Reset grows the block,
+// and the same load then fits.
+TEST(FrameMemory, LinearArenaOverflowGrows)
+{
+	LinearArena arena(256);
+	for (int round = 0; round < 3; ++round)
+	{
+		std::vector<char*> blocks;
+		for (int i = 0; i < 16; ++i)
+		{
+			blocks.push_back(static_cast<char*>(arena.Allocate(64)));
+			memset(blocks.back(), i, 64);
+		}
+
+		size_t wrong = 0;
+		for (int i = 0; i < 16; ++i)
+			wrong += blocks[i][0] != i || blocks[i][63] != i;
+		CHECK(wrong == 0);
+		CHECK(arena.Used() >= 16*64);
+
+		arena.Reset();
+		CHECK(arena.Overflows() == 1);
+	}
+	CHECK(arena.Capacity() >= arena.HighWater());
+}
+
+// Threads claim disjoint ranges, in the block and past it.
+TEST(FrameMemory, LinearArenaConcurrent)
+{
+	const int threadCount = 4;
+	const int count = 2000;
+	LinearArena arena(threadCount*count*32/2);
+	std::vector<unsigned char*> blocks[threadCount];
+
+	std::thread threads[threadCount];
+	for (int t = 0; t < threadCount; ++t)
+	{
+		blocks[t].resize(count);
+		threads[t] = std::thread([&arena, &blocks, t]()
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				blocks[t][i] = static_cast<unsigned char*>(arena.Allocate(32));
+				memset(blocks[t][i], t + 1, 32);
+			}
+		});
+	}
+	for (int t = 0; t < threadCount; ++t)
+		threads[t].join();
+
+	size_t wrong = 0;
+	for (int t = 0; t < threadCount; ++t)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			for (int k = 0; k < 32; ++k)
+				wrong += blocks[t][i][k] != t + 1;
+		}
+	}
+	CHECK(wrong == 0);
+
+	arena.Reset();
+	CHECK(arena.Overflows() == 1 && arena.Capacity() >= (size_t)threadCount*count*32);
+}
+
+// What a frame allocates lives through the next frame, and is taken back the frame
+// after.
+TEST(FrameMemory, FrameArenaAlternates)
+{
+	FrameArena frames(1024);
+	frames.BeginFrame();
+	int* first = frames.Allocate<int>(4);
+	first[0] = 7;
+
+	frames.BeginFrame();
+	int* second = frames.Allocate<int>(4);
+	second[0] = 8;
+	CHECK(first != second && first[0] == 7);
+	CHECK(frames.Previous().Used() > 0);
+
+	frames.BeginFrame();
+	CHECK(frames.Current().Used() == 0);
+	CHECK(frames.Allocate<int>(4) == first);
+	CHECK(second[0] == 8);
+}
+
+TEST(FrameMemory, PoolRecycles)
+{
+	{
+		Pool<Counted> pool(4);
+		std::vector<Counted*> records;
+		for (int i = 0; i < 6; ++i)
+			records.push_back(pool.Create(i));
+		CHECK(Counted::Live == 6 && pool.Live() == 6 && pool.Capacity() == 8);
+		CHECK(records[5]->Value == 5);
+
+		Counted* freed = records[2];
+		pool.Destroy(freed);
+		CHECK(Counted::Live == 5 && pool.Live() == 5);
+		CHECK(pool.Create(42) == freed && freed->Value == 42);
+
+		records[2] = freed;
+		for (size_t i = 0; i < records.size(); ++i)
+			pool.Destroy(records[i]);
+		pool.Destroy(0);
+		CHECK(Counted::Live == 0 && pool.Live() == 0 && pool.Capacity() == 8);
+	}
+
+	Pool<Packet> packets;
+	Packet* p = packets.Create();
+	CHECK(Aligned(p, std::alignment_of<Packet>::value));
+	packets.Destroy(p);
+}
+
+TEST(FrameMemory, ScratchRewinds)
+{
+	ScratchAllocator scratch(1024);
+	CHECK(scratch.Reserved() == 0);
+
+	void* a = scratch.Allocate(100);
+	ScratchAllocator::Marker marker = scratch.Mark();
+	size_t used = scratch.Used();
+	{
+		ScopedScratch scope(scratch);
+		scratch.Allocate(500);
+
+		// Larger than a block: a block of its own.
+		char* large = scratch.Allocate<char>(4000);
+		memset(large, 1, 4000);
+		CHECK(scratch.Reserved() >= 1024 + 4000);
+	}
+	CHECK(scratch.Used() == used);
+	CHECK(scratch.HighWater() >= 100 + 500 + 4000);
+
+	// Rewound, the next staging reuses the same memory.
+	scratch.Rewind(marker);
+	void* b = scratch.Allocate(16);
+	CHECK(b > a && b < static_cast<char*>(a) + 1024);
+
+	scratch.Trim();
+	CHECK(scratch.Reserved() == 1024);
+
+	scratch.Rewind(ScratchAllocator::Marker());
+	scratch.Trim();
+	CHECK(scratch.Reserved() == 0);
+}
+
+TEST(FrameMemory, ArenaVectors)
+{
+	FrameArena frames(4096);
+	frames.BeginFrame();
+	{
+		FrameVector<Packet> packets((FrameAllocator<Packet>(&frames)));
+		packets.reserve(16);
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			Packet p = {};
+			p.Geometry = i;
+			packets.push_back(p);
+		}
+		CHECK(packets[15].Geometry == 15);
+		CHECK(frames.Current().Used() >= 16*sizeof(Packet));
+	}
+
+	ScratchAllocator scratch;
+	{
+		ScopedScratch scope(scratch);
+		StagingVector<unsigned int> indices(1000, 3, StagingAllocator<unsigned int>(&scratch));
+		CHECK(indices[999] == 3 && scratch.Used() >= 4000);
+	}
+	CHECK(scratch.Used() == 0);
+
+	// Without an arena, the allocator is the heap's.
+	FrameVector<int> heap;
+	heap.push_back(1);
+	CHECK(heap.get_allocator() != FrameAllocator<int>(&frames));
+	CHECK(heap.get_allocator() == FrameAllocator<int>());
+}
+#pragma endregion
+
+#pragma region Benchmarks
+// One allocation of a 96 byte record: from the heap, from a linear arena (reset every
+// 4096), and from a pool.
+BENCH(FrameMemory, PerOperation)
+{
+	const int count = 1000000;
+	double heap = Test::MedianMs(9, []()
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			void* p = ::operator new(96);
+			gSink = p;
+			::operator delete(p);
+		}
+	}) * 1e6 / count;
+
+	LinearArena arena(1 << 20);
+	double linear = Test::MedianMs(9, [&arena]()
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			if ((i & 4095) == 0)
+				arena.Reset();
+			gSink = arena.Allocate(96);
+		}
+	}) * 1e6 / count;
+
+	Pool<Packet> pool;
+	double pooled = Test::MedianMs(9, [&pool]()
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			Packet* p = pool.Create();
+			gSink = p;
+			pool.Destroy(p);
+		}
+	}) * 1e6 / count;
+
+	printf("  heap new/delete %.1f ns, arena allocation %.1f ns, pool create/destroy %.1f ns\n", heap, linear, pooled);
+}
+
+// 512 packets recorded a frame, into a vector reserved on the heap and in the frame
+// arena.
+BENCH(FrameMemory, PacketsPerFrame)
+{
+	const int frames = 2000;
+	double heap = Test::MedianMs(9, []()
+	{
+		for (int f = 0; f < frames; ++f)
+		{
+			std::vector<Packet> packets;
+			packets.reserve(512);
+			for (int i = 0; i < 512; ++i)
+				packets.push_back(Packet());
+			gSink = &packets[0];
+		}
+	}) * 1000.0 / frames;
+
+	FrameArena arena(64 << 10);
+	double framed = Test::MedianMs(9, [&arena]()
+	{
+		for (int f = 0; f < frames; ++f)
+		{
+			arena.BeginFrame();
+			FrameVector<Packet> packets((FrameAllocator<Packet>(&arena)));
+			packets.reserve(512);
+			for (int i = 0; i < 512; ++i)
+				packets.push_back(Packet());
+			gSink = &packets[0];
+		}
+	}) * 1000.0 / frames;
+
+	printf("  std::vector %.2f us, FrameVector %.2f us a frame; the arena grew %u times\n",
+		heap, framed, arena.Current().Overflows() + arena.Previous().Overflows());
+}
+#pragma endregion
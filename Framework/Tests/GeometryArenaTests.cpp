@@ -0,0 +1,260 @@
+//***************************************************************************************
+// GeometryArenaTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "GeometryArena.h"
+#include "MeshBuilder.h"
+#include "DemoScenes.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	// Lighting_Intermediate's vertex.
+	struct Vertex
+	{
+		float Pos[3];
+		float Normal[3];
+		float Color[4];
+	};
+
+	Vertex MakeVertex(float marker)
+	{
+		Vertex v;
+		memset(&v, 0, sizeof(v));
+		v.Pos[0] = marker;
+		return v;
+	}
+
+	// A mesh of count vertices marked first, first + 1, ... and count indices 0, 1, ...
+	void Mesh(unsigned int count, float first, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+	{
+		vertices.clear();
+		indices.clear();
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			vertices.push_back(MakeVertex(first + i));
+			indices.push_back(i);
+		}
+	}
+
+	struct WritePosition
+	{
+		void operator()(Vertex& out, const MeshBuilder::Attributes& in)const
+		{
+			memset(&out, 0, sizeof(out));
+			memcpy(out.Pos, in.Position, sizeof(out.Pos));
+			memcpy(out.Normal, in.Normal, sizeof(out.Normal));
+		}
+	};
+}
+
+#pragma region Tests
+// Ranges follow each other, and each draws the mesh that was added.
+TEST(GeometryArena, RangesDrawTheirMeshes)
+{
+	GeometryArena<Vertex> arena;
+	arena.Reserve(3);
+
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	Mesh(5, 100.0f, vertices, indices);
+	DrawRange<Vertex> a = arena.Add(std::move(vertices), std::move(indices));
+	Mesh(7, 200.0f, vertices, indices);
+	DrawRange<Vertex> b = arena.Add(std::move(vertices), std::move(indices));
+
+	MeshBuilder::Counts box = MeshBuilder::BoxCounts();
+	DrawRange<Vertex> c = arena.Add((unsigned int)box.Vertices, (unsigned int)box.Indices, [](Vertex* v, unsigned int* i)
+	{
+		MeshBuilder::CreateBox(2.0f, 2.0f, 2.0f, v, i, WritePosition());
+	});
+
+	CHECK(a.StartIndex == 0 && a.IndexCount == 5 && a.BaseVertex == 0);
+	CHECK(b.StartIndex == 5 && b.IndexCount == 7 && b.BaseVertex == 5);
+	CHECK(c.StartIndex == 12 && c.IndexCount == 36 && c.BaseVertex == 12);
+	CHECK(arena.VertexCount() == 36 && arena.IndexCount() == 48);
+
+	arena.Build();
+
+	const Vertex* v = static_cast<const Vertex*>(arena.VertexData());
+	const unsigned int* k = static_cast<const unsigned int*>(arena.IndexData());
+	size_t wrong = 0;
+	for (unsigned int i = 0; i < b.IndexCount; ++i)
+		wrong += v[b.BaseVertex + k[b.StartIndex + i]].Pos[0] != 200.0f + i;
+	for (unsigned int i = 0; i < c.IndexCount; ++i)
+		wrong += fabsf(v[c.BaseVertex + k[c.StartIndex + i]].Pos[0]) != 1.0f;
+	CHECK(wrong == 0);
+	CHECK(arena.Vertices(a)[4].Pos[0] == 104.0f);
+	CHECK(arena.Indices(c)[35] < 24);
+	CHECK(arena.VertexBytes() == 36*sizeof(Vertex) && arena.IndexBytes() == 48*sizeof(unsigned int));
+}
+
+TEST(GeometryArena, StagingBlockIsAligned)
+{
+	GeometryArena<Vertex> arena;
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+
+	// 3 vertices of 40 bytes: the indices start on the next 16 byte boundary.
+	Mesh(3, 0.0f, vertices, indices);
+	arena.Add(std::move(vertices), std::move(indices));
+	arena.Build();
+
+	uintptr_t vertexData = reinterpret_cast<uintptr_t>(arena.VertexData());
+	uintptr_t indexData = reinterpret_cast<uintptr_t>(arena.IndexData());
+	CHECK(vertexData % GeometryArena<Vertex>::BlockAlignment == 0);
+	CHECK(indexData % GeometryArena<Vertex>::BlockAlignment == 0);
+	CHECK(indexData - vertexData == 128);
+
+	// The padding between them is zeroed.
+	const unsigned char* padding = static_cast<const unsigned char*>(arena.VertexData()) + arena.VertexBytes();
+	size_t set = 0;
+	for (size_t i = 0; i < 128 - arena.VertexBytes(); ++i)
+		set += padding[i] != 0;
+	CHECK(set == 0);
+}
+
+// Aligned placements leave zeroed gaps; rebased meshes draw with base vertex 0.
+TEST(GeometryArena, PlacementAlignsAndRebases)
+{
+	GeometryArena<Vertex> arena;
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+
+	Mesh(3, 10.0f, vertices, indices);
+	DrawRange<Vertex> a = arena.Add(std::move(vertices), std::move(indices));
+
+	Placement placement;
+	placement.VertexAlignment = 8;
+	placement.IndexAlignment = 4;
+	placement.Rebase = true;
+	Mesh(5, 20.0f, vertices, indices);
+	DrawRange<Vertex> b = arena.Add(std::move(vertices), std::move(indices), placement);
+
+	CHECK(b.FirstVertex == 8 && b.VertexCount == 5);
+	CHECK(b.StartIndex == 4 && b.BaseVertex == 0);
+	CHECK(a.FirstVertex == 0 && a.BaseVertex == 0);
+
+	arena.Build();
+
+	const Vertex* v = static_cast<const Vertex*>(arena.VertexData());
+	const unsigned int* k = static_cast<const unsigned int*>(arena.IndexData());
+	CHECK(k[3] == 0);
+	for (unsigned int i = 3; i < 8; ++i)
+		CHECK(v[i].Pos[0] == 0.0f);
+
+	size_t wrong = 0;
+	for (unsigned int i = 0; i < b.IndexCount; ++i)
+		wrong += k[b.StartIndex + i] != 8 + i || v[k[b.StartIndex + i]].Pos[0] != 20.0f + i;
+	CHECK(wrong == 0);
+}
+
+// The vectors moved in are taken over, and the functions called once, in Build.
+TEST(GeometryArena, BuildConsumesMeshes)
+{
+	GeometryArena<Vertex> arena;
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	Mesh(4, 0.0f, vertices, indices);
+	arena.Add(std::move(vertices), std::move(indices));
+	CHECK(vertices.empty() && indices.empty());
+
+	int calls = 0;
+	arena.Add(2, 3, [&calls](Vertex* v, unsigned int* i)
+	{
+		++calls;
+		v[0] = v[1] = MakeVertex(7.0f);
+		i[0] = 0;
+		i[1] = 1;
+		i[2] = 0;
+	});
+	CHECK(calls == 0);
+
+	arena.Build();
+	CHECK(calls == 1);
+	CHECK(static_cast<const Vertex*>(arena.VertexData())[5].Pos[0] == 7.0f);
+
+	arena.Release();
+	CHECK(arena.VertexData() == 0);
+}
+
+TEST(GeometryArena, EmptyArena)
+{
+	GeometryArena<Vertex> arena;
+	arena.Build();
+	CHECK(arena.VertexData() != 0);
+	CHECK(arena.VertexBytes() == 0 && arena.IndexBytes() == 0);
+}
+
+// Both ways of staging each demo scene give the same vertices, and the arena's ranges
+// draw the indices the old offsets did.
+TEST(GeometryArena, DemoScenesMatchVectors)
+{
+	std::vector<DemoScenes::Basic32> texturedVertices;
+	std::vector<unsigned int> texturedIndices;
+	DemoScenes::TexturesAdvancedVectors(texturedVertices, texturedIndices);
+	GeometryArena<DemoScenes::Basic32> textured;
+	DemoScenes::TexturesAdvancedArena(textured);
+
+	REQUIRE(textured.VertexCount() == texturedVertices.size() && textured.IndexCount() == texturedIndices.size());
+	CHECK(memcmp(textured.VertexData(), &texturedVertices[0], textured.VertexBytes()) == 0);
+	CHECK(memcmp(textured.IndexData(), &texturedIndices[0], textured.IndexBytes()) == 0);
+
+	// The old buffer held the wall's indices once, drawn four times at different
+	// base vertices; the arena holds a copy per wall.
+	std::vector<DemoScenes::LitVertex> litVertices;
+	std::vector<unsigned int> litIndices;
+	DemoScenes::LightingIntermediateVectors(litVertices, litIndices);
+	GeometryArena<DemoScenes::LitVertex> lit;
+	DemoScenes::LightingIntermediateArena(lit);
+
+	const unsigned int wallIndices = (unsigned int)MeshBuilder::BoxCounts().Indices;
+	REQUIRE(lit.VertexCount() == litVertices.size() && lit.IndexCount() == litIndices.size() + 3*wallIndices);
+	CHECK(memcmp(lit.VertexData(), &litVertices[0], lit.VertexBytes()) == 0);
+	const unsigned int* arenaIndices = static_cast<const unsigned int*>(lit.IndexData());
+	size_t wrong = 0;
+	for (unsigned int w = 0; w < 4; ++w)
+		wrong += memcmp(arenaIndices + w*wallIndices, &litIndices[0], wallIndices*sizeof(unsigned int)) != 0;
+	wrong += memcmp(arenaIndices + 4*wallIndices, &litIndices[wallIndices], (litIndices.size() - wallIndices)*sizeof(unsigned int)) != 0;
+	CHECK(wrong == 0);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+// Staging each demo scene that builds through the arena, the old way and the arena's;
+// AllocationProfilerTests counts the allocations of the same.
+BENCH(GeometryArena, Scenes)
+{
+	double texturedBefore = Test::MedianMs(51, []()
+	{
+		std::vector<DemoScenes::Basic32> vertices;
+		std::vector<unsigned int> indices;
+		DemoScenes::TexturesAdvancedVectors(vertices, indices);
+	});
+	double texturedAfter = Test::MedianMs(51, []()
+	{
+		GeometryArena<DemoScenes::Basic32> arena;
+		DemoScenes::TexturesAdvancedArena(arena);
+	});
+	printf("  Textures_Advanced (phone, wall box, 10x10 grid):  vectors %8.1f us, arena %8.1f us\n",
+		texturedBefore*1000.0, texturedAfter*1000.0);
+
+	double litBefore = Test::MedianMs(51, []()
+	{
+		std::vector<DemoScenes::LitVertex> vertices;
+		std::vector<unsigned int> indices;
+		DemoScenes::LightingIntermediateVectors(vertices, indices);
+	});
+	double litAfter = Test::MedianMs(51, []()
+	{
+		GeometryArena<DemoScenes::LitVertex> arena;
+		DemoScenes::LightingIntermediateArena(arena);
+	});
+	printf("  Lighting_Intermediate (4 walls, 200x200 grid):    vectors %8.1f us, arena %8.1f us\n",
+		litBefore*1000.0, litAfter*1000.0);
+}
+#pragma endregion
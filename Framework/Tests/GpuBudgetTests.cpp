@@ -0,0 +1,260 @@
+//***************************************************************************************
+// GpuBudgetTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "GpuBudget.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// Stands in for the D3D device the way GpuResources uses it: a resource is tracked
+	// when it is created, and a destroyed one is only released once the frame that
+	// used it is done, at the next EndFrame.
+	class FakeDevice
+	{
+	public:
+		FakeDevice(GpuBudget& budget) : mBudget(budget) {}
+
+		GpuBudget::AllocationId Create(GpuSubsystem subsystem, const char* name, uint64_t bytes)
+		{
+			return mBudget.Track(subsystem, name, bytes);
+		}
+
+		void Destroy(GpuBudget::AllocationId id)
+		{
+			mDestroyed.push_back(id);
+		}
+
+		void EndFrame()
+		{
+			mBudget.EndFrame();
+			for (size_t i = 0; i < mReleasing.size(); ++i)
+				mBudget.Release(mReleasing[i]);
+			mReleasing.swap(mDestroyed);
+			mDestroyed.clear();
+		}
+
+	private:
+		GpuBudget& mBudget;
+		std::vector<GpuBudget::AllocationId> mDestroyed;
+		std::vector<GpuBudget::AllocationId> mReleasing;
+	};
+
+	// Lighting_Advanced's terrain grid: a vertex and an index buffer for n x n vertices,
+	// rebuilt at half the resolution by its downgrade, down to a smallest size.
+	class Terrain
+	{
+	public:
+		Terrain(FakeDevice& device, unsigned int n, unsigned int smallest)
+			: mDevice(device), mN(n), mSmallest(smallest)
+		{
+			Build();
+		}
+
+		bool Downgrade()
+		{
+			if (mN/2 < mSmallest)
+				return false;
+			mN /= 2;
+			mDevice.Destroy(mVertices);
+			mDevice.Destroy(mIndices);
+			Build();
+			return true;
+		}
+
+		unsigned int Size()const { return mN; }
+
+		static uint64_t Bytes(unsigned int n) { return (uint64_t)n*n*32 + (uint64_t)(n - 1)*(n - 1)*6*4; }
+
+	private:
+		void Build()
+		{
+			mVertices = mDevice.Create(GeometryMemory, "terrain vb", (uint64_t)mN*mN*32);
+			mIndices = mDevice.Create(GeometryMemory, "terrain ib", (uint64_t)(mN - 1)*(mN - 1)*6*4);
+		}
+
+		FakeDevice& mDevice;
+		unsigned int mN;
+		unsigned int mSmallest;
+		GpuBudget::AllocationId mVertices;
+		GpuBudget::AllocationId mIndices;
+	};
+
+	const uint64_t MB = 1 << 20;
+}
+
+#pragma region Tests
+TEST(GpuBudget, LiveAndHighWater)
+{
+	GpuBudget budget;
+	GpuBudget::AllocationId a = budget.Track(TextureMemory, "a", 100);
+	GpuBudget::AllocationId b = budget.Track(TextureMemory, "b", 50);
+	budget.Track(GeometryMemory, "c", 7);
+	budget.Release(a);
+
+	GpuBudget::Usage textures = budget.GetUsage(TextureMemory);
+	CHECK(textures.Live == 50 && textures.HighWater == 150 && textures.Allocations == 1);
+	GpuBudget::Usage total = budget.Total();
+	CHECK(total.Live == 57 && total.HighWater == 157 && total.Allocations == 2);
+
+	// Released ids are reused.
+	CHECK(budget.Track(DynamicMemory, "d", 1) == a);
+	budget.Release(b);
+	CHECK(budget.GetUsage(TextureMemory).Live == 0 && budget.GetUsage(TextureMemory).HighWater == 150);
+	CHECK(!budget.OverBudget(TextureMemory) && !budget.OverTotalBudget());
+}
+
+// Over its budget, the terrain steps down one resolution per frame. The old buffers
+// count until the device releases them a frame later, so the high-water mark holds
+// three sizes, and the terrain is asked for one more step than it needs.
+TEST(GpuBudget, SubsystemBudgetStepsOncePerFrame)
+{
+	GpuBudget budget;
+	FakeDevice device(budget);
+	Terrain terrain(device, 1024, 256);
+	budget.AddDowngrade(GeometryMemory, [&terrain]() { return terrain.Downgrade(); });
+	budget.SetBudget(GeometryMemory, 4*MB);
+
+	const unsigned int sizes[] = { 512, 256, 256, 256 };
+	for (int frame = 0; frame < 4; ++frame)
+	{
+		device.EndFrame();
+		CHECK(terrain.Size() == sizes[frame]);
+	}
+
+	GpuBudget::Usage geometry = budget.GetUsage(GeometryMemory);
+	CHECK(geometry.Live == Terrain::Bytes(256));
+	CHECK(geometry.HighWater == Terrain::Bytes(1024) + Terrain::Bytes(512) + Terrain::Bytes(256));
+	CHECK(geometry.Downgrades == 2 && geometry.Allocations == 2);
+	CHECK(!budget.OverBudget(GeometryMemory));
+}
+
+// A downgrade with nothing left is skipped for the next one of its subsystem; over the
+// total, the largest subsystem gives first, unless it already gave this frame.
+TEST(GpuBudget, TotalBudgetDowngradesLargest)
+{
+	GpuBudget budget;
+	FakeDevice device(budget);
+	Terrain terrain(device, 512, 512);
+
+	uint64_t textureBytes = 16*MB;
+	GpuBudget::AllocationId texture = device.Create(TextureMemory, "sand.dds", textureBytes);
+	int topMips = 0;
+	budget.AddDowngrade(GeometryMemory, [&terrain]() { return terrain.Downgrade(); });
+	budget.AddDowngrade(TextureMemory, [&]()
+	{
+		if (topMips == 2)
+			return false;
+		++topMips;
+		textureBytes /= 4;
+		device.Destroy(texture);
+		texture = device.Create(TextureMemory, "sand.dds", textureBytes);
+		return true;
+	});
+	int fallbacks = 0;
+	budget.AddDowngrade(TextureMemory, [&fallbacks]() { ++fallbacks; return false; });
+	budget.SetTotalBudget(2*MB);
+
+	for (int frame = 0; frame < 6; ++frame)
+		device.EndFrame();
+
+	// Textures dropped two mips and then had nothing left; the terrain is at its
+	// smallest, so the total stays over with every downgrade tried once.
+	CHECK(topMips == 2);
+	CHECK(budget.GetUsage(TextureMemory).Live == MB);
+	CHECK(budget.GetUsage(TextureMemory).Downgrades == 2);
+	CHECK(budget.GetUsage(GeometryMemory).Downgrades == 0);
+	CHECK(fallbacks == 1);
+	CHECK(budget.Total().Downgrades == 2);
+	CHECK(budget.OverTotalBudget());
+}
+
+TEST(GpuBudget, ConcurrentTrackRelease)
+{
+	GpuBudget budget;
+	budget.Track(TextureMemory, "kept", 64);
+
+	std::thread threads[4];
+	for (int t = 0; t < 4; ++t)
+	{
+		threads[t] = std::thread([&budget, t]()
+		{
+			for (int i = 0; i < 10000; ++i)
+			{
+				GpuBudget::AllocationId id = budget.Track(DynamicMemory, "constants", 256 + t);
+				budget.Release(id);
+			}
+		});
+	}
+	for (int t = 0; t < 4; ++t)
+		threads[t].join();
+
+	GpuBudget::Usage dynamic = budget.GetUsage(DynamicMemory);
+	CHECK(dynamic.Live == 0 && dynamic.Allocations == 0);
+	CHECK(dynamic.HighWater >= 256 && dynamic.HighWater <= 4*259);
+	CHECK(budget.Total().Live == 64 && budget.Total().Allocations == 1);
+}
+
+// The usage is that of the last EndFrame; the largest allocations are those live now.
+TEST(GpuBudget, Snapshot)
+{
+	GpuBudget budget;
+	budget.SetBudget(TextureMemory, 1000);
+	budget.Track(TextureMemory, "Textures/\"floor\".dds", 300);
+	budget.EndFrame();
+	budget.Track(GeometryMemory, "skull vb", 500);
+	budget.Track(DynamicMemory, "small", 1);
+
+	std::string json = budget.Snapshot(2);
+	CHECK(json.find("\"frame\": 1,") != std::string::npos);
+	CHECK(json.find("\"textures\": {\"live\": 300, \"highWater\": 300, \"budget\": 1000, \"allocations\": 1, \"downgrades\": 0}") != std::string::npos);
+	CHECK(json.find("\"geometry\": {\"live\": 0,") != std::string::npos);
+	CHECK(json.find("\"total\": {\"live\": 300,") != std::string::npos);
+
+	size_t skull = json.find("{\"name\": \"skull vb\", \"subsystem\": \"geometry\", \"bytes\": 500}");
+	size_t floor = json.find("{\"name\": \"Textures/\\\"floor\\\".dds\", \"subsystem\": \"textures\", \"bytes\": 300}");
+	CHECK(skull != std::string::npos && floor != std::string::npos && skull < floor);
+	CHECK(json.find("\"small\"") == std::string::npos);
+	CHECK(json.compare(json.size() - 7, 7, "\n  ]\n}\n") == 0);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+// Track and Release of a dynamic buffer, single-threaded and from four threads at
+// once, with the 500 allocations of a demo live.
+BENCH(GpuBudget, TrackRelease)
+{
+	GpuBudget budget;
+	for (int i = 0; i < 500; ++i)
+		budget.Track(TextureMemory, "texture", 4096);
+
+	const int count = 100000;
+	double single = Test::MedianMs(9, [&budget]()
+	{
+		for (int i = 0; i < count; ++i)
+			budget.Release(budget.Track(DynamicMemory, "constants", 256));
+	}) * 1e6 / count;
+
+	double contended = Test::MedianMs(9, [&budget]()
+	{
+		std::thread threads[4];
+		for (int t = 0; t < 4; ++t)
+		{
+			threads[t] = std::thread([&budget]()
+			{
+				for (int i = 0; i < count/4; ++i)
+					budget.Release(budget.Track(DynamicMemory, "constants", 256));
+			});
+		}
+		for (int t = 0; t < 4; ++t)
+			threads[t].join();
+	}) * 1e6 / count;
+
+	printf("  Track + Release: %.1f ns, 4 threads: %.1f ns\n", single, contended);
+}
+#pragma endregion
@@ -0,0 +1,200 @@
+//***************************************************************************************
+// HeightfieldTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "Heightfield.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	// Laid out like Vertex::Basic32, as in Lighting_Basics.
+	struct Vertex
+	{
+		float Position[3];
+		float Normal[3];
+		float Tex[2];
+	};
+
+	// A rows x cols grid over [-15, 15] x [-10, 10], with the texture coordinates
+	// marking each vertex.
+	std::vector<Vertex> MakeGrid(size_t rows, size_t cols)
+	{
+		std::vector<Vertex> vertices(rows*cols);
+		for (size_t i = 0; i < rows; ++i)
+		{
+			for (size_t j = 0; j < cols; ++j)
+			{
+				Vertex& v = vertices[i*cols + j];
+				v.Position[0] = -15.0f + 30.0f*j/(cols - 1);
+				v.Position[1] = 0.0f;
+				v.Position[2] = -10.0f + 20.0f*i/(rows - 1);
+				v.Normal[0] = v.Normal[1] = v.Normal[2] = 0.0f;
+				v.Tex[0] = (float)i;
+				v.Tex[1] = (float)j;
+			}
+		}
+		return vertices;
+	}
+
+	Heightfield::Mesh MakeMesh(std::vector<Vertex>& vertices, bool writeHeights)
+	{
+		Heightfield::Mesh mesh;
+		mesh.Positions = vertices[0].Position;
+		mesh.Stride = sizeof(Vertex);
+		mesh.Count = vertices.size();
+		mesh.WriteHeights = writeHeights;
+		mesh.Normals = vertices[0].Normal;
+		mesh.NormalStride = sizeof(Vertex);
+		return mesh;
+	}
+
+	// The per vertex path Lighting_Basics had: the book's GetNormal with the C
+	// library's sinf and cosf.
+	void ReferenceNormal(float x, float z, float n[3])
+	{
+		n[0] = -0.03f*z*cosf(0.1f*x) - 0.3f*cosf(0.1f*z);
+		n[1] = 1.0f;
+		n[2] = -0.3f*sinf(0.1f*x) + 0.03f*x*sinf(0.1f*z);
+		float length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		n[0] /= length;
+		n[1] /= length;
+		n[2] /= length;
+	}
+
+	float ReferenceHeight(float x, float z)
+	{
+		return 0.3f*(z*sinf(0.1f*x) + x*cosf(0.1f*z));
+	}
+
+	float MaxNormalError(const std::vector<Vertex>& vertices)
+	{
+		float error = 0.0f;
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			float n[3];
+			ReferenceNormal(vertices[i].Position[0], vertices[i].Position[2], n);
+			for (int k = 0; k < 3; ++k)
+				error = std::max(error, fabsf(vertices[i].Normal[k] - n[k]));
+		}
+		return error;
+	}
+}
+
+#pragma region Tests
+TEST(Heightfield, SinCosMatchesLibrary)
+{
+	// Every hundredth from -2000 to 2000, in runs with a partial last group of four.
+	std::vector<float> x;
+	for (int i = -200000; i <= 200000; ++i)
+		x.push_back(i*0.01f);
+
+	std::vector<float> s(x.size());
+	std::vector<float> c(x.size());
+	Heightfield::SinCos(&x[0], x.size(), &s[0], &c[0]);
+
+	float error = 0.0f;
+	for (size_t i = 0; i < x.size(); ++i)
+		error = std::max(error, std::max(fabsf(s[i] - sinf(x[i])), fabsf(c[i] - cosf(x[i]))));
+	CHECK(error < 1e-6f);
+
+	// Single values go through the tail.
+	float one = 1.0f, s1, c1;
+	Heightfield::SinCos(&one, 1, &s1, &c1);
+	CHECK(fabsf(s1 - sinf(1.0f)) < 1e-6f && fabsf(c1 - cosf(1.0f)) < 1e-6f);
+}
+
+// Chunks, SIMD and threads against the per vertex path. The vertex count is no
+// multiple of a chunk.
+TEST(Heightfield, HillsMatchesPerVertexPath)
+{
+	JobSystem jobs(3);
+	for (int threaded = 0; threaded < 2; ++threaded)
+	{
+		std::vector<Vertex> vertices = MakeGrid(101, 67);
+		Heightfield::Evaluate(Heightfield::Hills(), MakeMesh(vertices, true), threaded ? &jobs : 0);
+
+		CHECK(MaxNormalError(vertices) < 1e-6f);
+
+		float heights = 0.0f;
+		size_t moved = 0;
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			const Vertex& v = vertices[i];
+			heights = std::max(heights, fabsf(v.Position[1] - ReferenceHeight(v.Position[0], v.Position[2])));
+			moved += v.Tex[0] != (float)(i/67) || v.Tex[1] != (float)(i % 67);
+		}
+		CHECK(heights < 1e-4f);
+		CHECK(moved == 0);
+	}
+}
+
+TEST(Heightfield, PointFunctionMatchesHills)
+{
+	std::vector<Vertex> vertices = MakeGrid(30, 31);
+	Heightfield::Evaluate(Heightfield::MakePointFunction(&Heightfield::Hills::Evaluate), MakeMesh(vertices, true));
+	CHECK(MaxNormalError(vertices) < 1e-6f);
+
+	float x = 3.0f, z = -4.0f, height, dfdx, dfdz;
+	Heightfield::Hills::Evaluate(x, z, height, dfdx, dfdz);
+	CHECK(fabsf(height - ReferenceHeight(x, z)) < 1e-6f);
+}
+
+// Without WriteHeights positions stay as they are; without Normals only heights
+// are written.
+TEST(Heightfield, OutputsAreOptional)
+{
+	std::vector<Vertex> vertices = MakeGrid(20, 20);
+	Heightfield::Evaluate(Heightfield::Hills(), MakeMesh(vertices, false));
+
+	size_t raised = 0;
+	for (size_t i = 0; i < vertices.size(); ++i)
+		raised += vertices[i].Position[1] != 0.0f;
+	CHECK(raised == 0);
+	CHECK(MaxNormalError(vertices) < 1e-6f);
+
+	std::vector<Vertex> heightsOnly = MakeGrid(20, 20);
+	Heightfield::Mesh mesh = MakeMesh(heightsOnly, true);
+	mesh.Normals = 0;
+	Heightfield::Evaluate(Heightfield::Hills(), mesh);
+
+	size_t normals = 0;
+	float heights = 0.0f;
+	for (size_t i = 0; i < heightsOnly.size(); ++i)
+	{
+		const Vertex& v = heightsOnly[i];
+		normals += v.Normal[0] != 0.0f || v.Normal[1] != 0.0f || v.Normal[2] != 0.0f;
+		heights = std::max(heights, fabsf(v.Position[1] - ReferenceHeight(v.Position[0], v.Position[2])));
+	}
+	CHECK(normals == 0);
+	CHECK(heights < 1e-4f);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+// The 1000x1000 grid of interleaved vertices the user-036 numbers were taken on.
+BENCH(Heightfield, Normals1M)
+{
+	JobSystem jobs;
+	std::vector<Vertex> vertices = MakeGrid(1000, 1000);
+	Heightfield::Mesh mesh = MakeMesh(vertices, false);
+
+	double reference = Test::MedianMs(5, [&vertices]()
+	{
+		for (size_t i = 0; i < vertices.size(); ++i)
+			ReferenceNormal(vertices[i].Position[0], vertices[i].Position[2], vertices[i].Normal);
+	});
+	double point = Test::MedianMs(5, [&mesh]()
+	{
+		Heightfield::Evaluate(Heightfield::MakePointFunction(&Heightfield::Hills::Evaluate), mesh);
+	});
+	double hills = Test::MedianMs(5, [&mesh]() { Heightfield::Evaluate(Heightfield::Hills(), mesh); });
+	double threaded = Test::MedianMs(5, [&mesh, &jobs]() { Heightfield::Evaluate(Heightfield::Hills(), mesh, &jobs); });
+
+	printf("  per vertex sinf/cosf %.1f ms, point functor %.1f ms, Hills %.1f ms, %u threads %.1f ms, max error %.2g\n",
+		reference, point, hills, jobs.ThreadCount(), threaded, MaxNormalError(vertices));
+}
+#pragma endregion
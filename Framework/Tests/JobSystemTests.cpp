@@ -0,0 +1,216 @@
+//***************************************************************************************
+// JobSystemTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#pragma region Tests
+TEST(JobSystem, ParallelForCoversRange)
+{
+	JobSystem jobs(3);
+
+	for (size_t size = 0; size < 2000; size += 97)
+	{
+		std::vector<int> hits(size, 0);
+		jobs.ParallelFor(0, size, [&hits](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+				++hits[i];
+		}, size % 3);
+
+		size_t wrong = 0;
+		for (size_t i = 0; i < size; ++i)
+			wrong += hits[i] != 1;
+		CHECK(wrong == 0);
+	}
+}
+
+TEST(JobSystem, NestedParallelFor)
+{
+	JobSystem jobs(3);
+	std::atomic<long> sum(0);
+
+	jobs.ParallelFor(0, 64, [&jobs, &sum](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			jobs.ParallelFor(0, 1000, [&sum](size_t b, size_t e) { sum += (long)(e - b); });
+		}
+	});
+
+	CHECK(sum == 64*1000);
+}
+
+TEST(JobSystem, ParentWaitsForChildren)
+{
+	JobSystem jobs(3);
+	std::atomic<int> children(0);
+
+	JobSystem::Job* root = jobs.CreateJob(JobSystem::JobFunction());
+	for (int i = 0; i < 1000; ++i)
+		jobs.Run(jobs.CreateChild(root, [&children]() { ++children; }));
+	jobs.Run(root);
+	jobs.Wait(root);
+
+	CHECK(children == 1000);
+	CHECK(jobs.IsFinished(root));
+}
+
+TEST(JobSystem, CountersWaitForTheirJobs)
+{
+	JobSystem jobs(3);
+
+	for (int round = 0; round < 50; ++round)
+	{
+		JobCounter counter;
+		std::atomic<int> ran(0);
+		for (int i = 0; i < 500; ++i)
+			jobs.Submit([&ran]() { ++ran; }, &counter);
+		jobs.Wait(counter);
+
+		CHECK(ran == 500);
+		CHECK(counter.Done());
+	}
+}
+
+// More jobs in flight than the pool holds: the submitting thread has to run jobs
+// until slots free up, instead of reusing a slot whose job has not run yet.
+TEST(JobSystem, FullPoolWaitsForSlots)
+{
+	JobSystem jobs(1);
+	const int count = 3*JobSystem::JobPoolSize + 17;
+
+	std::vector<int> runs(count, 0);
+	JobCounter counter;
+	for (int i = 0; i < count; ++i)
+		jobs.Submit([&runs, i]() { ++runs[i]; }, &counter);
+	jobs.Wait(counter);
+
+	int wrong = 0;
+	for (int i = 0; i < count; ++i)
+		wrong += runs[i] != 1;
+	CHECK(wrong == 0);
+
+	// A job that creates more children than the pool holds skips its own slot.
+	std::atomic<int> children(0);
+	JobSystem::Job* parent = jobs.CreateJob([&jobs, &children]()
+	{
+		JobCounter inner;
+		for (unsigned int i = 0; i < 2*JobSystem::JobPoolSize; ++i)
+			jobs.Submit([&children]() { ++children; }, &inner);
+		jobs.Wait(inner);
+	});
+	jobs.Run(parent);
+	jobs.Wait(parent);
+	CHECK(children == 2*(int)JobSystem::JobPoolSize);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+namespace
+{
+	void Spin(unsigned int iterations)
+	{
+		volatile unsigned int sink = 0;
+		for (unsigned int i = 0; i < iterations; ++i)
+			sink = sink + i;
+	}
+}
+
+// The cost of one fork-join round: a parent with empty children, queued and waited
+// on, against a ParallelFor over a range of empty elements.
+BENCH(JobSystem, ForkJoin)
+{
+	JobSystem jobs;
+	printf("  %u threads\n", jobs.ThreadCount());
+
+	const unsigned int counts[] = { 1, 16, 256 };
+	for (unsigned int c = 0; c < 3; ++c)
+	{
+		unsigned int children = counts[c];
+		double ms = Test::MedianMs(200, [&jobs, children]()
+		{
+			JobSystem::Job* root = jobs.CreateJob(JobSystem::JobFunction());
+			for (unsigned int i = 0; i < children; ++i)
+				jobs.Run(jobs.CreateChild(root, JobSystem::JobFunction()));
+			jobs.Run(root);
+			jobs.Wait(root);
+		});
+		printf("  fork-join, %3u children: %7.2f us, %.3f us per job\n", children, ms*1000.0, ms*1000.0 / (children + 1));
+	}
+
+	double ms = Test::MedianMs(200, [&jobs]()
+	{
+		jobs.ParallelFor(0, 4096, [](size_t, size_t) {}, 16);
+	});
+	printf("  ParallelFor, 256 chunks:    %7.2f us\n", ms*1000.0);
+}
+
+// A fixed amount of work, split across 1..N threads.
+BENCH(JobSystem, ParallelForScaling)
+{
+	unsigned int hardware = std::thread::hardware_concurrency();
+	unsigned int maxThreads = hardware > 1 ? hardware : 2;
+	const size_t items = 1 << 16;
+
+	double single = 0.0;
+	for (unsigned int threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		JobSystem jobs(threads > 1 ? threads - 1 : 1);
+		double ms = Test::MedianMs(15, [&jobs, items, threads]()
+		{
+			if (threads == 1)
+			{
+				for (size_t i = 0; i < items; ++i)
+					Spin(200);
+				return;
+			}
+			jobs.ParallelFor(0, items, [](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+					Spin(200);
+			});
+		});
+
+		if (threads == 1)
+			single = ms;
+		printf("  %2u threads: %8.2f ms, speedup %.2fx\n", threads, ms, single / ms);
+	}
+	printf("  (%u hardware threads)\n", hardware);
+}
+
+// Many tiny jobs submitted from inside jobs, so every deque is pushed, popped and
+// stolen from at once.
+BENCH(JobSystem, Contention)
+{
+	JobSystem jobs;
+	const unsigned int producers = 64;
+	const unsigned int perProducer = 1000;
+
+	double ms = Test::MedianMs(9, [&jobs, producers, perProducer]()
+	{
+		std::atomic<unsigned int> ran(0);
+		JobCounter counter;
+		for (unsigned int p = 0; p < producers; ++p)
+		{
+			jobs.Submit([&jobs, &ran, perProducer]()
+			{
+				JobCounter inner;
+				for (unsigned int i = 0; i < perProducer; ++i)
+					jobs.Submit([&ran]() { ran.fetch_add(1, std::memory_order_relaxed); }, &inner);
+				jobs.Wait(inner);
+			}, &counter);
+		}
+		jobs.Wait(counter);
+	});
+
+	unsigned int total = producers*perProducer;
+	printf("  %u threads, %u jobs from %u producer jobs: %.2f ms, %.3f us per job\n",
+		jobs.ThreadCount(), total, producers, ms, ms*1000.0 / total);
+}
+#pragma endregion
@@ -0,0 +1,177 @@
+//***************************************************************************************
+// LightBakerTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "LightBaker.h"
+#include "JobSystem.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace
+{
+	// Laid out like Vertex::Basic32 plus a baked color, as in the Lighting demos.
+	struct Vertex
+	{
+		float Position[3];
+		float Normal[3];
+		float Tex[2];
+		float Color[4];
+	};
+
+	std::vector<Vertex> MakeVertices(size_t count)
+	{
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+
+		std::vector<Vertex> vertices(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			Vertex& v = vertices[i];
+			float n[3] = { u(rng), u(rng), u(rng) };
+			float length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]) + 1e-6f;
+			for (int k = 0; k < 3; ++k)
+			{
+				v.Position[k] = u(rng)*20.0f;
+				v.Normal[k] = n[k] / length;
+			}
+			v.Tex[0] = v.Tex[1] = 0.0f;
+			v.Color[0] = v.Color[1] = v.Color[2] = v.Color[3] = 0.0f;
+		}
+		return vertices;
+	}
+
+	// One light of each kind, like the Lighting demos'.
+	void AddLights(LightBaker& baker)
+	{
+		LightModel::DirectionalLight directional =
+		{
+			{ 0.2f, 0.2f, 0.2f, 1.0f }, { 0.5f, 0.4f, 0.3f, 1.0f }, { 0.5f, 0.5f, 0.5f, 1.0f },
+			{ 0.57735f, -0.57735f, 0.57735f }, 0.0f
+		};
+		LightModel::PointLight point =
+		{
+			{ 0.1f, 0.1f, 0.1f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f },
+			{ 1.0f, 2.0f, 3.0f }, 15.0f, { 1.0f, 0.1f, 0.01f }, 0.0f
+		};
+		LightModel::SpotLight spot =
+		{
+			{ 0.3f, 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f, 1.0f }, { 0.4f, 0.4f, 0.4f, 1.0f },
+			{ 0.0f, 10.0f, 0.0f }, 40.0f, { 0.0f, -1.0f, 0.0f }, 8.0f, { 1.0f, 0.0f, 0.0f }, 0.0f
+		};
+
+		baker.AddLight(directional);
+		baker.AddLight(point);
+		baker.AddLight(spot);
+	}
+
+	LightBaker::Surface MakeSurface(std::vector<Vertex>& vertices, const float* world)
+	{
+		LightModel::Material material =
+		{
+			{ 0.48f, 0.77f, 0.46f, 1.0f }, { 0.48f, 0.77f, 0.46f, 0.7f }, { 0.1f, 0.1f, 0.1f, 16.0f }, { 0, 0, 0, 0 }
+		};
+
+		LightBaker::Surface surface;
+		surface.Positions = vertices[0].Position;
+		surface.Normals = vertices[0].Normal;
+		surface.Stride = sizeof(Vertex);
+		surface.Count = vertices.size();
+		surface.World = world;
+		surface.Material = material;
+		surface.Colors = vertices[0].Color;
+		surface.ColorStride = sizeof(Vertex);
+		return surface;
+	}
+
+	// A rotation about y, a stretch in x and a translation.
+	const float World[16] = { 0, 0, -2, 0,  0, 1, 0, 0,  1, 0, 0, 0,  5, -3, 2, 1 };
+}
+
+#pragma region Tests
+// The batch bake at every SIMD level the CPU has, with and without specular and a
+// job system, against the scalar reference. The count is no multiple of a chunk.
+TEST(LightBaker, MatchesScalarReference)
+{
+	JobSystem jobs(3);
+	std::vector<Vertex> vertices = MakeVertices(10007);
+	LightBaker::Surface surface = MakeSurface(vertices, World);
+
+	LightBaker baker;
+	AddLights(baker);
+
+	LightModel::SimdLevel initial = LightModel::CurrentSimdLevel();
+	const float eye[3] = { 3.0f, 4.0f, -5.0f };
+	for (int specular = 0; specular < 2; ++specular)
+	{
+		baker.SetEye(specular ? eye : 0);
+		for (int level = 0; level <= LightModel::SupportedSimdLevel(); ++level)
+		{
+			LightModel::SetSimdLevel((LightModel::SimdLevel)level);
+			for (int threaded = 0; threaded < 2; ++threaded)
+			{
+				for (size_t i = 0; i < vertices.size(); ++i)
+					vertices[i].Color[0] = -1.0f;
+
+				baker.Bake(surface, threaded ? &jobs : 0);
+				float error = baker.MaxError(surface);
+				if (!(error < 1e-4f))
+					printf("  %s, specular %d, threaded %d: error %g\n",
+						LightModel::SimdLevelName((LightModel::SimdLevel)level), specular, threaded, error);
+				CHECK(error < 1e-4f);
+			}
+		}
+	}
+	LightModel::SetSimdLevel(initial);
+}
+
+TEST(LightBaker, WorldSpaceSurfaces)
+{
+	std::vector<Vertex> vertices = MakeVertices(300);
+	LightBaker::Surface surface = MakeSurface(vertices, 0);
+
+	LightBaker baker;
+	AddLights(baker);
+	baker.Bake(surface);
+	CHECK(baker.MaxError(surface) < 1e-4f);
+
+	// Alpha is the material's diffuse alpha.
+	CHECK(vertices[17].Color[3] == 0.7f);
+
+	// Without lights only black is left.
+	baker.ClearLights();
+	baker.Bake(surface);
+	CHECK(vertices[17].Color[0] == 0.0f && vertices[17].Color[1] == 0.0f && vertices[17].Color[2] == 0.0f);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+BENCH(LightBaker, Bake1M)
+{
+	JobSystem jobs;
+	std::vector<Vertex> vertices = MakeVertices(1000000);
+	LightBaker::Surface surface = MakeSurface(vertices, World);
+
+	LightBaker baker;
+	AddLights(baker);
+	const float eye[3] = { 3.0f, 4.0f, -5.0f };
+	baker.SetEye(eye);
+
+	double reference = Test::MedianMs(3, [&baker, &surface]() { baker.BakeReference(surface); });
+	printf("  1M vertices, 3 lights with specular: reference %.1f ms\n", reference);
+
+	LightModel::SimdLevel initial = LightModel::CurrentSimdLevel();
+	for (int level = 0; level <= LightModel::SupportedSimdLevel(); ++level)
+	{
+		LightModel::SetSimdLevel((LightModel::SimdLevel)level);
+		double serial = Test::MedianMs(5, [&baker, &surface]() { baker.Bake(surface); });
+		double threaded = Test::MedianMs(5, [&baker, &surface, &jobs]() { baker.Bake(surface, &jobs); });
+		printf("  %-7s %.1f ms, %u threads %.1f ms, max error %.2g\n",
+			LightModel::SimdLevelName((LightModel::SimdLevel)level), serial, jobs.ThreadCount(), threaded,
+			baker.MaxError(surface, 97));
+	}
+	LightModel::SetSimdLevel(initial);
+}
+#pragma endregion
@@ -0,0 +1,214 @@
+//***************************************************************************************
+// LightGridTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "LightGrid.h"
+#include "JobSystem.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <random>
+
+namespace
+{
+	const float AspectRatio = 16.0f / 9.0f;
+	const float NearZ = 1.0f;
+	const float FarZ = 1000.0f;
+
+	// A camera turned 0.3 radians about y and moved off the origin, as a p*V view
+	// matrix, with the rotation it applies.
+	struct Camera
+	{
+		Camera()
+		{
+			float c = cosf(0.3f), s = sinf(0.3f);
+			float view[16] = { c, 0, -s, 0,  0, 1, 0, 0,  s, 0, c, 0,  3, -2, 5, 1 };
+			for (int i = 0; i < 16; ++i)
+				View[i] = view[i];
+
+			ProjScaleY = 1.0f / tanf(0.5f);
+			ProjScaleX = ProjScaleY / AspectRatio;
+		}
+
+		// World position of a view space point: undo the translation, then the rotation.
+		void ToWorld(const float v[3], float w[3])const
+		{
+			float p[3] = { v[0] - View[12], v[1] - View[13], v[2] - View[14] };
+			for (int i = 0; i < 3; ++i)
+				w[i] = p[0]*View[i*4 + 0] + p[1]*View[i*4 + 1] + p[2]*View[i*4 + 2];
+		}
+
+		float View[16];
+		float ProjScaleX;
+		float ProjScaleY;
+	};
+
+	// Lights spread through the view, three in ten of them spots.
+	std::vector<ClusterLight> MakeLights(size_t count, unsigned int seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> u(0.0f, 1.0f);
+
+		std::vector<ClusterLight> lights(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			ClusterLight& light = lights[i];
+			light.Position[0] = u(rng)*400.0f - 200.0f;
+			light.Position[1] = u(rng)*100.0f - 50.0f;
+			light.Position[2] = u(rng)*600.0f - 100.0f;
+			light.Range = 1.0f + u(rng)*10.0f;
+			light.Direction[0] = light.Direction[1] = light.Direction[2] = 0.0f;
+			light.SpotCos = -1.0f;
+			light.Color[0] = light.Color[1] = light.Color[2] = 1.0f;
+			light.Pad = 0.0f;
+
+			if (u(rng) < 0.3f)
+			{
+				float d[3] = { u(rng) - 0.5f, u(rng) - 0.5f, u(rng) - 0.5f };
+				float length = sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+				for (int k = 0; k < 3; ++k)
+					light.Direction[k] = d[k] / length;
+				light.SpotCos = cosf(0.1f + u(rng)*1.2f);
+			}
+		}
+		return lights;
+	}
+
+	bool Lights(const ClusterLight& light, const float p[3])
+	{
+		float d[3] = { p[0] - light.Position[0], p[1] - light.Position[1], p[2] - light.Position[2] };
+		float distance = sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+
+		// Just inside the range, to stay clear of rounding at the boundary.
+		if (distance >= light.Range*0.999f)
+			return false;
+		if (light.SpotCos > -1.0f && distance > 1e-4f)
+			return (d[0]*light.Direction[0] + d[1]*light.Direction[1] + d[2]*light.Direction[2]) / distance >= light.SpotCos;
+		return true;
+	}
+}
+
+#pragma region Tests
+// Every light that reaches a point must be in the list of the point's cluster.
+TEST(LightGrid, NoMissedLights)
+{
+	Camera camera;
+	std::vector<ClusterLight> lights = MakeLights(10000, 1);
+
+	LightGrid grid;
+	grid.SetView(camera.View, camera.ProjScaleX, camera.ProjScaleY, NearZ, FarZ);
+	grid.Build(&lights[0], lights.size());
+
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> u(0.0f, 1.0f);
+	size_t checked = 0;
+	size_t missed = 0;
+	for (int sample = 0; sample < 20000; ++sample)
+	{
+		// A point in the frustum, found through its normalized device x and y.
+		float nx = u(rng)*2.0f - 1.0f;
+		float ny = u(rng)*2.0f - 1.0f;
+		float z = NearZ*powf(FarZ / NearZ, u(rng));
+		float view[3] = { nx*z / camera.ProjScaleX, ny*z / camera.ProjScaleY, z };
+		float world[3];
+		camera.ToWorld(view, world);
+
+		unsigned int x = std::min(grid.TilesX() - 1, (unsigned int)((nx + 1.0f)*0.5f*grid.TilesX()));
+		unsigned int y = std::min(grid.TilesY() - 1, (unsigned int)((1.0f - ny)*0.5f*grid.TilesY()));
+		int slice = std::min((int)grid.Slices() - 1, std::max(0, grid.Slice(z)));
+		const LightGrid::Range& range = grid.Ranges()[grid.ClusterIndex(x, y, (unsigned int)slice)];
+		const uint32_t* first = range.Count ? &grid.LightIndices()[range.Offset] : 0;
+
+		for (size_t i = 0; i < lights.size(); ++i)
+		{
+			if (!Lights(lights[i], world))
+				continue;
+
+			++checked;
+			if (std::find(first, first + range.Count, (uint32_t)i) == first + range.Count)
+				++missed;
+		}
+	}
+
+	CHECK(checked > 1000);
+	CHECK(missed == 0);
+}
+
+TEST(LightGrid, ParallelBuildMatchesSerial)
+{
+	Camera camera;
+	std::vector<ClusterLight> lights = MakeLights(5000, 3);
+
+	LightGrid serial;
+	serial.SetView(camera.View, camera.ProjScaleX, camera.ProjScaleY, NearZ, FarZ);
+	serial.Build(&lights[0], lights.size());
+
+	JobSystem jobs(3);
+	LightGrid parallel;
+	parallel.SetView(camera.View, camera.ProjScaleX, camera.ProjScaleY, NearZ, FarZ);
+	parallel.Build(&lights[0], lights.size(), &jobs);
+
+	REQUIRE(serial.Ranges().size() == parallel.Ranges().size());
+	size_t different = 0;
+	for (size_t i = 0; i < serial.Ranges().size(); ++i)
+	{
+		different += serial.Ranges()[i].Offset != parallel.Ranges()[i].Offset ||
+			serial.Ranges()[i].Count != parallel.Ranges()[i].Count;
+	}
+	CHECK(different == 0);
+	CHECK(serial.LightIndices() == parallel.LightIndices());
+	CHECK(!serial.LightIndices().empty());
+}
+
+TEST(LightGrid, SlicesFollowDepth)
+{
+	Camera camera;
+	LightGrid grid;
+	grid.SetView(camera.View, camera.ProjScaleX, camera.ProjScaleY, NearZ, FarZ);
+
+	CHECK(grid.Slice(NearZ*1.0001f) == 0);
+	CHECK(grid.Slice(FarZ*0.9999f) == (int)grid.Slices() - 1);
+
+	// Slices never go back, and the shader's formula lands in the same slice
+	// up to rounding at the boundaries.
+	int previous = 0;
+	int backwards = 0;
+	int apart = 0;
+	for (float z = NearZ; z < FarZ; z *= 1.01f)
+	{
+		int slice = grid.Slice(z);
+		backwards += slice < previous;
+		previous = slice;
+
+		int shader = (int)floorf(logf(z)*grid.SliceScale() + grid.SliceBias());
+		apart += std::abs(shader - slice) > 1;
+	}
+	CHECK(backwards == 0);
+	CHECK(apart == 0);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+BENCH(LightGrid, Build)
+{
+	Camera camera;
+	JobSystem jobs;
+
+	const size_t counts[] = { 1000, 10000, 50000 };
+	for (int c = 0; c < 3; ++c)
+	{
+		std::vector<ClusterLight> lights = MakeLights(counts[c], 1);
+
+		LightGrid grid;
+		grid.SetView(camera.View, camera.ProjScaleX, camera.ProjScaleY, NearZ, FarZ);
+
+		double serial = Test::MedianMs(21, [&grid, &lights]() { grid.Build(&lights[0], lights.size()); });
+		double parallel = Test::MedianMs(21, [&grid, &lights, &jobs]() { grid.Build(&lights[0], lights.size(), &jobs); });
+
+		printf("  %5zu lights: serial %.3f ms, %u threads %.3f ms, %zu indices\n",
+			lights.size(), serial, jobs.ThreadCount(), parallel, grid.LightIndices().size());
+	}
+}
+#pragma endregion
@@ -0,0 +1,216 @@
+//***************************************************************************************
+// LightModelTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "LightModel.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace LightModel;
+
+namespace
+{
+	// Points with unit normals and eye vectors, in structure-of-arrays form, and room
+	// for the twelve result channels.
+	struct Points
+	{
+		explicit Points(size_t count)
+		{
+			std::mt19937 rng(11);
+			std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+
+			for (int k = 0; k < 3; ++k)
+			{
+				Position[k].resize(count);
+				Normal[k].resize(count);
+				ToEye[k].resize(count);
+			}
+			for (size_t i = 0; i < count; ++i)
+			{
+				float n[3] = { u(rng), u(rng), u(rng) };
+				float e[3] = { u(rng), u(rng), u(rng) };
+				float nl = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]) + 1e-6f;
+				float el = sqrtf(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]) + 1e-6f;
+				for (int k = 0; k < 3; ++k)
+				{
+					Position[k][i] = u(rng)*20.0f;
+					Normal[k][i] = n[k] / nl;
+					ToEye[k][i] = e[k] / el;
+				}
+			}
+
+			for (int k = 0; k < 3; ++k)
+			{
+				Batch.Position[k] = &Position[k][0];
+				Batch.Normal[k] = &Normal[k][0];
+				Batch.ToEye[k] = &ToEye[k][0];
+			}
+			Batch.Count = count;
+		}
+
+		std::vector<float> Position[3];
+		std::vector<float> Normal[3];
+		std::vector<float> ToEye[3];
+		PointBatch Batch;
+	};
+
+	struct Terms
+	{
+		explicit Terms(size_t count)
+		{
+			for (int c = 0; c < 12; ++c)
+				Channels[c].assign(count, 0.0f);
+			for (int c = 0; c < 4; ++c)
+			{
+				Batch.Ambient[c] = &Channels[c][0];
+				Batch.Diffuse[c] = &Channels[4 + c][0];
+				Batch.Spec[c] = &Channels[8 + c][0];
+			}
+		}
+
+		std::vector<float> Channels[12];
+		TermBatch Batch;
+	};
+
+	const Material TestMaterial =
+	{
+		{ 0.48f, 0.77f, 0.46f, 1.0f }, { 0.48f, 0.77f, 0.46f, 0.7f }, { 0.6f, 0.6f, 0.6f, 16.0f }, { 0, 0, 0, 0 }
+	};
+	const DirectionalLight TestDirectional =
+	{
+		{ 0.2f, 0.2f, 0.2f, 1.0f }, { 0.5f, 0.4f, 0.3f, 1.0f }, { 0.5f, 0.5f, 0.5f, 1.0f },
+		{ 0.57735f, -0.57735f, 0.57735f }, 0.0f
+	};
+	const PointLight TestPoint =
+	{
+		{ 0.1f, 0.1f, 0.1f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f },
+		{ 1.0f, 2.0f, 3.0f }, 15.0f, { 1.0f, 0.1f, 0.01f }, 0.0f
+	};
+	const SpotLight TestSpot =
+	{
+		{ 0.3f, 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f, 1.0f }, { 0.4f, 0.4f, 0.4f, 1.0f },
+		{ 0.0f, 10.0f, 0.0f }, 40.0f, { 0.0f, -1.0f, 0.0f }, 96.0f, { 1.0f, 0.0f, 0.0f }, 0.0f
+	};
+
+	const char* LightNames[3] = { "directional", "point", "spot" };
+
+	void Light(int light, const PointBatch& points, const TermBatch& out)
+	{
+		if (light == 0)
+			BatchDirectionalLight(TestMaterial, TestDirectional, points, out);
+		else if (light == 1)
+			BatchPointLight(TestMaterial, TestPoint, points, out);
+		else
+			BatchSpotLight(TestMaterial, TestSpot, points, out);
+	}
+}
+
+#pragma region Tests
+// The scalar batch level runs the Compute* functions point by point.
+TEST(LightModel, ScalarBatchIsReference)
+{
+	Points points(101);
+	Terms terms(101);
+
+	SimdLevel initial = CurrentSimdLevel();
+	SetSimdLevel(SimdScalar);
+	BatchPointLight(TestMaterial, TestPoint, points.Batch, terms.Batch);
+	SetSimdLevel(initial);
+
+	size_t wrong = 0;
+	for (size_t i = 0; i < 101; ++i)
+	{
+		Float3 pos = { points.Position[0][i], points.Position[1][i], points.Position[2][i] };
+		Float3 normal = { points.Normal[0][i], points.Normal[1][i], points.Normal[2][i] };
+		Float3 toEye = { points.ToEye[0][i], points.ToEye[1][i], points.ToEye[2][i] };
+		Float4 ambient, diffuse, spec;
+		ComputePointLight(TestMaterial, TestPoint, pos, normal, toEye, ambient, diffuse, spec);
+
+		wrong += terms.Channels[0][i] != ambient.x || terms.Channels[5][i] != diffuse.y ||
+			terms.Channels[11][i] != spec.w;
+	}
+	CHECK(wrong == 0);
+}
+
+// Every SIMD level against the scalar reference, on a count with a partial last
+// batch. pow is approximated, so results agree to a small relative error.
+TEST(LightModel, SimdMatchesScalar)
+{
+	const size_t count = 10007;
+	Points points(count);
+	Terms reference(count);
+	Terms simd(count);
+
+	SimdLevel initial = CurrentSimdLevel();
+	for (int light = 0; light < 3; ++light)
+	{
+		SetSimdLevel(SimdScalar);
+		Light(light, points.Batch, reference.Batch);
+
+		for (int level = SimdSSE2; level <= SupportedSimdLevel(); ++level)
+		{
+			SetSimdLevel((SimdLevel)level);
+			Light(light, points.Batch, simd.Batch);
+
+			double maxError = 0.0;
+			for (int c = 0; c < 12; ++c)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					double error = fabs(simd.Channels[c][i] - reference.Channels[c][i]) /
+						(fabs(reference.Channels[c][i]) + 1e-3);
+					maxError = std::max(maxError, error);
+				}
+			}
+
+			if (!(maxError < 1e-3))
+				printf("  %s, %s light: relative error %g\n", SimdLevelName((SimdLevel)level), LightNames[light], maxError);
+			CHECK(maxError < 1e-3);
+		}
+	}
+	SetSimdLevel(initial);
+}
+
+// Leaving Spec out of the output only drops the specular term.
+TEST(LightModel, SpecularIsOptional)
+{
+	Points points(64);
+	Terms full(64);
+	Terms noSpec(64);
+	for (int c = 0; c < 4; ++c)
+		noSpec.Batch.Spec[c] = 0;
+
+	BatchSpotLight(TestMaterial, TestSpot, points.Batch, full.Batch);
+	BatchSpotLight(TestMaterial, TestSpot, points.Batch, noSpec.Batch);
+
+	size_t different = 0;
+	for (int c = 0; c < 8; ++c)
+		for (size_t i = 0; i < 64; ++i)
+			different += full.Channels[c][i] != noSpec.Channels[c][i];
+	CHECK(different == 0);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+BENCH(LightModel, Throughput)
+{
+	const size_t count = 100003;
+	Points points(count);
+	Terms terms(count);
+
+	SimdLevel initial = CurrentSimdLevel();
+	for (int light = 0; light < 3; ++light)
+	{
+		for (int level = SimdScalar; level <= SupportedSimdLevel(); ++level)
+		{
+			SetSimdLevel((SimdLevel)level);
+			double ms = Test::MedianMs(9, [light, &points, &terms]() { Light(light, points.Batch, terms.Batch); });
+			printf("  %-11s %-7s %7.1f Mpoints/s\n", LightNames[light], SimdLevelName((SimdLevel)level), count / ms / 1000.0);
+		}
+	}
+	SetSimdLevel(initial);
+}
+#pragma endregion
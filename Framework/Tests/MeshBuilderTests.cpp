@@ -0,0 +1,452 @@
+//***************************************************************************************
+// MeshBuilderTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "MeshBuilder.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	// Common's GeometryGenerator, with its XNA math spelled out, as the reference.
+	namespace Reference
+	{
+		struct MeshData
+		{
+			std::vector<MeshBuilder::Attributes> Vertices;
+			std::vector<unsigned int> Indices;
+		};
+
+		void Normalize(float* v)
+		{
+			float length = sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		}
+
+		void CreateGrid(float width, float depth, unsigned int m, unsigned int n, MeshData& meshData)
+		{
+			float halfWidth = 0.5f*width;
+			float halfDepth = 0.5f*depth;
+			float dx = width/(n - 1);
+			float dz = depth/(m - 1);
+			float du = 1.0f/(n - 1);
+			float dv = 1.0f/(m - 1);
+
+			meshData.Vertices.resize(m*n);
+			for (unsigned int i = 0; i < m; ++i)
+			{
+				float z = halfDepth - i*dz;
+				for (unsigned int j = 0; j < n; ++j)
+				{
+					float x = -halfWidth + j*dx;
+					meshData.Vertices[i*n + j] = MeshBuilder::MakeAttributes(x, 0.0f, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, j*du, i*dv);
+				}
+			}
+
+			meshData.Indices.resize((m - 1)*(n - 1)*6);
+			unsigned int k = 0;
+			for (unsigned int i = 0; i < m - 1; ++i)
+			{
+				for (unsigned int j = 0; j < n - 1; ++j)
+				{
+					meshData.Indices[k] = i*n + j;
+					meshData.Indices[k + 1] = i*n + j + 1;
+					meshData.Indices[k + 2] = (i + 1)*n + j;
+					meshData.Indices[k + 3] = (i + 1)*n + j;
+					meshData.Indices[k + 4] = i*n + j + 1;
+					meshData.Indices[k + 5] = (i + 1)*n + j + 1;
+					k += 6;
+				}
+			}
+		}
+
+		void CreateSphere(float radius, unsigned int sliceCount, unsigned int stackCount, MeshData& meshData)
+		{
+			const float pi = 3.141592654f;
+
+			meshData.Vertices.push_back(MeshBuilder::MakeAttributes(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+
+			float phiStep = pi/stackCount;
+			float thetaStep = 2.0f*pi/sliceCount;
+			for (unsigned int i = 1; i <= stackCount - 1; ++i)
+			{
+				float phi = i*phiStep;
+				for (unsigned int j = 0; j <= sliceCount; ++j)
+				{
+					float theta = j*thetaStep;
+
+					MeshBuilder::Attributes v;
+					MeshBuilder::Set(v.Position, radius*sinf(phi)*cosf(theta), radius*cosf(phi), radius*sinf(phi)*sinf(theta));
+					MeshBuilder::Set(v.TangentU, -radius*sinf(phi)*sinf(theta), 0.0f, radius*sinf(phi)*cosf(theta));
+					Normalize(v.TangentU);
+					MeshBuilder::Set(v.Normal, v.Position[0], v.Position[1], v.Position[2]);
+					Normalize(v.Normal);
+					v.TexC[0] = theta/(2.0f*pi);
+					v.TexC[1] = phi/pi;
+
+					meshData.Vertices.push_back(v);
+				}
+			}
+
+			meshData.Vertices.push_back(MeshBuilder::MakeAttributes(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f));
+
+			for (unsigned int i = 1; i <= sliceCount; ++i)
+			{
+				meshData.Indices.push_back(0);
+				meshData.Indices.push_back(i + 1);
+				meshData.Indices.push_back(i);
+			}
+
+			unsigned int baseIndex = 1;
+			unsigned int ringVertexCount = sliceCount + 1;
+			for (unsigned int i = 0; i < stackCount - 2; ++i)
+			{
+				for (unsigned int j = 0; j < sliceCount; ++j)
+				{
+					meshData.Indices.push_back(baseIndex + i*ringVertexCount + j);
+					meshData.Indices.push_back(baseIndex + i*ringVertexCount + j + 1);
+					meshData.Indices.push_back(baseIndex + (i + 1)*ringVertexCount + j);
+
+					meshData.Indices.push_back(baseIndex + (i + 1)*ringVertexCount + j);
+					meshData.Indices.push_back(baseIndex + i*ringVertexCount + j + 1);
+					meshData.Indices.push_back(baseIndex + (i + 1)*ringVertexCount + j + 1);
+				}
+			}
+
+			unsigned int southPoleIndex = (unsigned int)meshData.Vertices.size() - 1;
+			baseIndex = southPoleIndex - ringVertexCount;
+			for (unsigned int i = 0; i < sliceCount; ++i)
+			{
+				meshData.Indices.push_back(southPoleIndex);
+				meshData.Indices.push_back(baseIndex + i);
+				meshData.Indices.push_back(baseIndex + i + 1);
+			}
+		}
+
+		void BuildCylinderCap(float radius, float height, unsigned int sliceCount, bool top, MeshData& meshData)
+		{
+			const float pi = 3.141592654f;
+
+			unsigned int baseIndex = (unsigned int)meshData.Vertices.size();
+			float y = top ? 0.5f*height : -0.5f*height;
+			float ny = top ? 1.0f : -1.0f;
+			float dTheta = 2.0f*pi/sliceCount;
+
+			for (unsigned int i = 0; i <= sliceCount; ++i)
+			{
+				float x = radius*cosf(i*dTheta);
+				float z = radius*sinf(i*dTheta);
+				float u = x/height + 0.5f;
+				float v = z/height + 0.5f;
+				meshData.Vertices.push_back(MeshBuilder::MakeAttributes(x, y, z, 0.0f, ny, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
+			}
+
+			meshData.Vertices.push_back(MeshBuilder::MakeAttributes(0.0f, y, 0.0f, 0.0f, ny, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f));
+
+			unsigned int centerIndex = (unsigned int)meshData.Vertices.size() - 1;
+			for (unsigned int i = 0; i < sliceCount; ++i)
+			{
+				meshData.Indices.push_back(centerIndex);
+				meshData.Indices.push_back(baseIndex + (top ? i + 1 : i));
+				meshData.Indices.push_back(baseIndex + (top ? i : i + 1));
+			}
+		}
+
+		void CreateCylinder(float bottomRadius, float topRadius, float height, unsigned int sliceCount,
+			unsigned int stackCount, MeshData& meshData)
+		{
+			const float pi = 3.141592654f;
+
+			float stackHeight = height/stackCount;
+			float radiusStep = (topRadius - bottomRadius)/stackCount;
+			unsigned int ringCount = stackCount + 1;
+			float dTheta = 2.0f*pi/sliceCount;
+
+			for (unsigned int i = 0; i < ringCount; ++i)
+			{
+				float y = -0.5f*height + i*stackHeight;
+				float r = bottomRadius + i*radiusStep;
+				for (unsigned int j = 0; j <= sliceCount; ++j)
+				{
+					float c = cosf(j*dTheta);
+					float s = sinf(j*dTheta);
+
+					MeshBuilder::Attributes v;
+					MeshBuilder::Set(v.Position, r*c, y, r*s);
+					v.TexC[0] = (float)j/sliceCount;
+					v.TexC[1] = 1.0f - (float)i/stackCount;
+					MeshBuilder::Set(v.TangentU, -s, 0.0f, c);
+
+					float dr = bottomRadius - topRadius;
+					float b[3] = { dr*c, -height, dr*s };
+					float* t = v.TangentU;
+					MeshBuilder::Set(v.Normal, t[1]*b[2] - t[2]*b[1], t[2]*b[0] - t[0]*b[2], t[0]*b[1] - t[1]*b[0]);
+					Normalize(v.Normal);
+
+					meshData.Vertices.push_back(v);
+				}
+			}
+
+			unsigned int ringVertexCount = sliceCount + 1;
+			for (unsigned int i = 0; i < stackCount; ++i)
+			{
+				for (unsigned int j = 0; j < sliceCount; ++j)
+				{
+					meshData.Indices.push_back(i*ringVertexCount + j);
+					meshData.Indices.push_back((i + 1)*ringVertexCount + j);
+					meshData.Indices.push_back((i + 1)*ringVertexCount + j + 1);
+
+					meshData.Indices.push_back(i*ringVertexCount + j);
+					meshData.Indices.push_back((i + 1)*ringVertexCount + j + 1);
+					meshData.Indices.push_back(i*ringVertexCount + j + 1);
+				}
+			}
+
+			BuildCylinderCap(topRadius, height, sliceCount, true, meshData);
+			BuildCylinderCap(bottomRadius, height, sliceCount, false, meshData);
+		}
+	}
+
+	// The Lighting demos' vertex: position, normal, texture coordinates and a baked
+	// color the write functor leaves alone.
+	struct Vertex
+	{
+		float Pos[3];
+		float Normal[3];
+		float Tex[2];
+		float Color[4];
+	};
+
+	struct WriteVertex
+	{
+		void operator()(Vertex& out, const MeshBuilder::Attributes& in)const
+		{
+			memcpy(out.Pos, in.Position, sizeof(out.Pos));
+			memcpy(out.Normal, in.Normal, sizeof(out.Normal));
+			memcpy(out.Tex, in.TexC, sizeof(out.Tex));
+			out.Color[0] += 1.0f;
+		}
+	};
+
+	// Builds a mesh with MeshBuilder into arrays sized from its counts, with every
+	// color and index set to a marker first.
+	struct Built
+	{
+		explicit Built(const MeshBuilder::Counts& counts)
+			: Vertices(counts.Vertices), Indices(counts.Indices, 0xffffffffu)
+		{
+			for (size_t i = 0; i < Vertices.size(); ++i)
+				Vertices[i].Color[0] = 0.0f;
+		}
+
+		std::vector<Vertex> Vertices;
+		std::vector<unsigned int> Indices;
+	};
+
+	// The largest difference from the reference, or 1 if the sizes, indices or number
+	// of writes differ.
+	float Compare(const Built& built, const Reference::MeshData& reference)
+	{
+		if (built.Vertices.size() != reference.Vertices.size() || built.Indices != reference.Indices)
+			return 1.0f;
+
+		float error = 0.0f;
+		for (size_t i = 0; i < built.Vertices.size(); ++i)
+		{
+			const Vertex& v = built.Vertices[i];
+			const MeshBuilder::Attributes& r = reference.Vertices[i];
+			if (v.Color[0] != 1.0f)
+				return 1.0f;
+			for (int k = 0; k < 3; ++k)
+			{
+				error = std::max(error, fabsf(v.Pos[k] - r.Position[k]));
+				error = std::max(error, fabsf(v.Normal[k] - r.Normal[k]));
+			}
+			for (int k = 0; k < 2; ++k)
+				error = std::max(error, fabsf(v.Tex[k] - r.TexC[k]));
+		}
+		return error;
+	}
+
+	// Triangles whose clockwise winding does not face the way their vertex normals do.
+	size_t InwardTriangles(const Built& built)
+	{
+		size_t inward = 0;
+		for (size_t t = 0; t + 2 < built.Indices.size(); t += 3)
+		{
+			const Vertex& a = built.Vertices[built.Indices[t]];
+			const Vertex& b = built.Vertices[built.Indices[t + 1]];
+			const Vertex& c = built.Vertices[built.Indices[t + 2]];
+
+			float e1[3], e2[3], n[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				e1[k] = b.Pos[k] - a.Pos[k];
+				e2[k] = c.Pos[k] - a.Pos[k];
+				n[k] = a.Normal[k] + b.Normal[k] + c.Normal[k];
+			}
+			float cross[3] = { e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0] };
+			inward += cross[0]*n[0] + cross[1]*n[1] + cross[2]*n[2] <= 0.0f;
+		}
+		return inward;
+	}
+}
+
+#pragma region Tests
+TEST(MeshBuilder, GridMatchesGeometryGenerator)
+{
+	JobSystem jobs(3);
+	for (int threaded = 0; threaded < 2; ++threaded)
+	{
+		Built built(MeshBuilder::GridCounts(37, 53));
+		MeshBuilder::CreateGrid(160.0f, 120.0f, 37, 53, &built.Vertices[0], &built.Indices[0], WriteVertex(),
+			threaded ? &jobs : 0);
+
+		Reference::MeshData reference;
+		Reference::CreateGrid(160.0f, 120.0f, 37, 53, reference);
+		CHECK(Compare(built, reference) == 0.0f);
+		CHECK(InwardTriangles(built) == 0);
+	}
+}
+
+TEST(MeshBuilder, SphereMatchesGeometryGenerator)
+{
+	JobSystem jobs(3);
+	for (int threaded = 0; threaded < 2; ++threaded)
+	{
+		Built built(MeshBuilder::SphereCounts(20, 13));
+		MeshBuilder::CreateSphere(25.0f, 20, 13, &built.Vertices[0], &built.Indices[0], WriteVertex(),
+			threaded ? &jobs : 0);
+
+		Reference::MeshData reference;
+		Reference::CreateSphere(25.0f, 20, 13, reference);
+		CHECK(Compare(built, reference) < 1e-6f);
+		CHECK(InwardTriangles(built) == 0);
+	}
+}
+
+TEST(MeshBuilder, CylinderMatchesGeometryGenerator)
+{
+	JobSystem jobs(3);
+	for (int threaded = 0; threaded < 2; ++threaded)
+	{
+		Built built(MeshBuilder::CylinderCounts(20, 7));
+		MeshBuilder::CreateCylinder(0.5f, 0.3f, 3.0f, 20, 7, &built.Vertices[0], &built.Indices[0], WriteVertex(),
+			threaded ? &jobs : 0);
+
+		Reference::MeshData reference;
+		Reference::CreateCylinder(0.5f, 0.3f, 3.0f, 20, 7, reference);
+		CHECK(Compare(built, reference) < 1e-6f);
+		CHECK(InwardTriangles(built) == 0);
+	}
+}
+
+TEST(MeshBuilder, BoxFacesOutward)
+{
+	Built built(MeshBuilder::BoxCounts());
+	REQUIRE(built.Vertices.size() == 24 && built.Indices.size() == 36);
+	MeshBuilder::CreateBox(1.0f, 2.0f, 3.0f, &built.Vertices[0], &built.Indices[0], WriteVertex());
+
+	size_t unwritten = 0;
+	for (size_t i = 0; i < built.Vertices.size(); ++i)
+		unwritten += built.Vertices[i].Color[0] != 1.0f;
+	CHECK(unwritten == 0);
+	CHECK(InwardTriangles(built) == 0);
+
+	// Every corner is half the size out from the centre.
+	size_t inside = 0;
+	for (size_t i = 0; i < built.Vertices.size(); ++i)
+	{
+		const Vertex& v = built.Vertices[i];
+		inside += fabsf(v.Pos[0]) != 0.5f || fabsf(v.Pos[1]) != 1.0f || fabsf(v.Pos[2]) != 1.5f;
+	}
+	CHECK(inside == 0);
+}
+
+// Meshes built back to back into arrays sized from the summed counts, as the demos
+// do, fill them exactly.
+TEST(MeshBuilder, CountsSizeSharedArrays)
+{
+	MeshBuilder::Counts grid = MeshBuilder::GridCounts(10, 12);
+	MeshBuilder::Counts sphere = MeshBuilder::SphereCounts(16, 9);
+	MeshBuilder::Counts cylinder = MeshBuilder::CylinderCounts(11, 4);
+	MeshBuilder::Counts total;
+	total += grid;
+	total += sphere;
+	total += cylinder;
+	total += MeshBuilder::BoxCounts();
+
+	Built built(total);
+	Vertex* v = &built.Vertices[0];
+	unsigned int* k = &built.Indices[0];
+	MeshBuilder::CreateGrid(10.0f, 10.0f, 10, 12, v, k, WriteVertex());
+	MeshBuilder::CreateSphere(1.0f, 16, 9, v + grid.Vertices, k + grid.Indices, WriteVertex());
+	v += grid.Vertices + sphere.Vertices;
+	k += grid.Indices + sphere.Indices;
+	MeshBuilder::CreateCylinder(1.0f, 1.0f, 2.0f, 11, 4, v, k, WriteVertex());
+	MeshBuilder::CreateBox(1.0f, 1.0f, 1.0f, v + cylinder.Vertices, k + cylinder.Indices, WriteVertex());
+
+	size_t wrongWrites = 0;
+	for (size_t i = 0; i < built.Vertices.size(); ++i)
+		wrongWrites += built.Vertices[i].Color[0] != 1.0f;
+	size_t unset = 0;
+	for (size_t i = 0; i < built.Indices.size(); ++i)
+		unset += built.Indices[i] == 0xffffffffu;
+	CHECK(wrongWrites == 0);
+	CHECK(unset == 0);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+// Lighting_Advanced's 1000x1000 grid, the way it used to be built (a MeshData, a copy
+// loop and an index insert) against MeshBuilder.
+BENCH(MeshBuilder, Grid1000)
+{
+	JobSystem jobs;
+	const unsigned int n = 1000;
+
+	double before = Test::MedianMs(5, [n]()
+	{
+		Reference::MeshData grid;
+		Reference::CreateGrid(1000.0f, 1000.0f, n, n, grid);
+
+		std::vector<Vertex> vertices(grid.Vertices.size());
+		for (size_t i = 0; i < grid.Vertices.size(); ++i)
+		{
+			memcpy(vertices[i].Pos, grid.Vertices[i].Position, sizeof(vertices[i].Pos));
+			memcpy(vertices[i].Normal, grid.Vertices[i].Normal, sizeof(vertices[i].Normal));
+			memcpy(vertices[i].Tex, grid.Vertices[i].TexC, sizeof(vertices[i].Tex));
+		}
+		std::vector<unsigned int> indices;
+		indices.insert(indices.end(), grid.Indices.begin(), grid.Indices.end());
+	});
+
+	double serial = 0.0, threaded = 0.0;
+	for (int t = 0; t < 2; ++t)
+	{
+		JobSystem* pool = t ? &jobs : 0;
+		double ms = Test::MedianMs(5, [n, pool]()
+		{
+			MeshBuilder::Counts counts = MeshBuilder::GridCounts(n, n);
+			std::vector<Vertex> vertices(counts.Vertices);
+			std::vector<unsigned int> indices(counts.Indices);
+			MeshBuilder::CreateGrid(1000.0f, 1000.0f, n, n, &vertices[0], &indices[0], WriteVertex(), pool);
+		});
+		(t ? threaded : serial) = ms;
+	}
+
+	MeshBuilder::Counts counts = MeshBuilder::GridCounts(n, n);
+	double output = (counts.Vertices*sizeof(Vertex) + counts.Indices*sizeof(unsigned int)) / 1048576.0;
+	double meshData = (counts.Vertices*sizeof(MeshBuilder::Attributes) + counts.Indices*sizeof(unsigned int)) / 1048576.0;
+
+	printf("  GeometryGenerator + copy %.1f ms, MeshBuilder %.1f ms, %u threads %.1f ms\n",
+		before, serial, jobs.ThreadCount(), threaded);
+	printf("  peak: %.1f MB output + %.1f MB MeshData before, %.1f MB after\n", output, meshData, output);
+}
+#pragma endregion
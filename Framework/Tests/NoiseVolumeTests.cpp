@@ -0,0 +1,85 @@
+//***************************************************************************************
+// NoiseVolumeTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "NoiseVolume.h"
+#include "JobSystem.h"
+
+#include <cmath>
+#include <cstdio>
+
+#pragma region Tests
+TEST(NoiseVolume, BakeMatchesScalarPort)
+{
+	JobSystem jobs(3);
+
+	// Uneven sizes, so rows are no multiple of four texels.
+	NoiseVolume small(3, 5);
+	small.Bake();
+	CHECK(small.MaxError(1) < 1e-5f);
+
+	NoiseVolume volume(8, 8);
+	volume.Bake(&jobs);
+	CHECK(volume.Size() == 64);
+	CHECK(volume.MaxError(1) < 1e-5f);
+
+	// The reference bake is the scalar port itself.
+	volume.BakeReference();
+	CHECK(volume.MaxError(1) == 0.0f);
+}
+
+TEST(NoiseVolume, LatticeWraps)
+{
+	const unsigned int period = 8;
+
+	// Inside the first period the wrapped lattice is the shader's.
+	CHECK(NoiseVolume::Noise3(1.3f, 2.7f, 0.4f, 0) == NoiseVolume::Noise3(1.3f, 2.7f, 0.4f, period));
+
+	// One period further along any axis is the same noise, so the volume tiles.
+	float worst = 0.0f;
+	for (int i = 0; i < 100; ++i)
+	{
+		float x = 0.37f*i, y = 0.11f*i + 1.0f, z = 0.53f*i;
+		float n = NoiseVolume::Noise(x, y, z, period);
+		worst = std::max(worst, fabsf(n - NoiseVolume::Noise(x + period, y, z, period)));
+		worst = std::max(worst, fabsf(n - NoiseVolume::Noise(x, y + period, z, period)));
+		worst = std::max(worst, fabsf(n - NoiseVolume::Noise(x, y, z + period, period)));
+	}
+	CHECK(worst < 1e-4f);
+
+	// No jump across the seam.
+	CHECK(fabsf(NoiseVolume::Noise(7.9999f, 1.0f, 1.0f, period) - NoiseVolume::Noise(-0.0001f, 1.0f, 1.0f, period)) < 1e-3f);
+}
+
+TEST(NoiseVolume, Quantizes)
+{
+	NoiseVolume volume(2, 4);
+	volume.Bake();
+
+	std::vector<unsigned short> texels;
+	volume.ToUNorm16(texels);
+	REQUIRE(texels.size() == 8*8*8);
+
+	float worst = 0.0f;
+	for (size_t i = 0; i < texels.size(); ++i)
+		worst = std::max(worst, fabsf(texels[i] / 65535.0f - volume.Texels()[i]));
+	CHECK(worst <= 1.0f / 65535.0f);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+BENCH(NoiseVolume, Bake128)
+{
+	JobSystem jobs;
+	NoiseVolume volume(8, 16);
+
+	double serial = Test::MedianMs(9, [&volume]() { volume.Bake(); });
+	double threaded = Test::MedianMs(9, [&volume, &jobs]() { volume.Bake(&jobs); });
+	double reference = Test::MedianMs(1, [&volume]() { volume.BakeReference(); });
+	volume.Bake();
+
+	printf("  %u^3: bake %.2f ms, %u threads %.2f ms, scalar port %.1f ms, max error %.2g\n",
+		volume.Size(), serial, jobs.ThreadCount(), threaded, reference, volume.MaxError(1));
+}
+#pragma endregion
@@ -0,0 +1,255 @@
+//***************************************************************************************
+// RenderQueueTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+	bool KeyLess(const RenderQueue::Item& a, const RenderQueue::Item& b)
+	{
+		return a.Key < b.Key;
+	}
+
+	// Sorts a copy of the queue's items with std::stable_sort, and compares key and
+	// payload of every item with the queue's after its own Sort.
+	bool MatchesStableSort(RenderQueue& queue)
+	{
+		std::vector<RenderQueue::Item> expected = queue.Items();
+		std::stable_sort(expected.begin(), expected.end(), KeyLess);
+		queue.Sort();
+
+		for (size_t i = 0; i < expected.size(); ++i)
+		{
+			if (queue[i].Key != expected[i].Key || queue[i].Payload != expected[i].Payload)
+				return false;
+		}
+		return queue.Size() == expected.size();
+	}
+
+	// A frame of a scene: one pass holding most draws, a few techniques, textures and
+	// materials, and depths anywhere in view.
+	void PushScene(RenderQueue& queue, size_t count, std::minstd_rand& random)
+	{
+		std::uniform_real_distribution<float> depth(0.0f, 1000.0f);
+		for (size_t i = 0; i < count; ++i)
+		{
+			unsigned int pass = random() % 16 == 0 ? 1 : 0;
+			uint64_t key = RenderKey::Make(pass, random() % 4, random() % 64, random() % 256,
+				RenderKey::QuantizeDepth(depth(random), 1000.0f, pass == 1));
+			queue.Push(key, (uint32_t)i);
+		}
+	}
+}
+
+#pragma region Tests
+TEST(RenderQueue, KeyFields)
+{
+	uint64_t key = RenderKey::Make(3, 200, 4000, 17, 123456);
+	CHECK(RenderKey::Pass(key) == 3 && RenderKey::Technique(key) == 200);
+	CHECK(RenderKey::Texture(key) == 4000 && RenderKey::Material(key) == 17);
+	CHECK(RenderKey::Depth(key) == 123456);
+
+	// Wider fields are masked, and leave their neighbours alone.
+	key = RenderKey::Make(0, 0x1ff, 0, 0x1001, 0);
+	CHECK(RenderKey::Technique(key) == 0xff && RenderKey::Material(key) == 1);
+	CHECK(RenderKey::Pass(key) == 0 && RenderKey::Texture(key) == 0);
+
+	// A pass outranks every other field.
+	CHECK(RenderKey::Make(1, 0, 0, 0, 0) > RenderKey::Make(0, 255, 4095, 4095, 0xfffffff));
+
+	const uint32_t maxDepth = (uint32_t(1) << RenderKey::DepthBits) - 1;
+	CHECK(RenderKey::QuantizeDepth(-5.0f, 100.0f) == 0);
+	CHECK(RenderKey::QuantizeDepth(500.0f, 100.0f) == maxDepth);
+	CHECK(RenderKey::QuantizeDepth(10.0f, 100.0f) < RenderKey::QuantizeDepth(20.0f, 100.0f));
+	CHECK(RenderKey::QuantizeDepth(10.0f, 100.0f, true) > RenderKey::QuantizeDepth(20.0f, 100.0f, true));
+	CHECK(RenderKey::QuantizeDepth(10.0f, 100.0f, true) == maxDepth - RenderKey::QuantizeDepth(10.0f, 100.0f));
+}
+
+// Random keys over all 64 bits, and keys drawn from a few values so that many are
+// equal: the order and the payloads of equal keys are std::stable_sort's.
+TEST(RenderQueue, SortMatchesStableSort)
+{
+	std::minstd_rand random(1);
+	const size_t counts[] = { 0, 1, 2, 255, 1000, 20000 };
+	for (size_t c = 0; c < sizeof(counts)/sizeof(counts[0]); ++c)
+	{
+		RenderQueue wide;
+		RenderQueue repeated;
+		for (size_t i = 0; i < counts[c]; ++i)
+		{
+			wide.Push((uint64_t)random() << 33 ^ (uint64_t)random() << 11 ^ random(), (uint32_t)i);
+			repeated.Push(RenderKey::Make(random() % 2, 0, random() % 3, random() % 5, 0), (uint32_t)i);
+		}
+		CHECK(MatchesStableSort(wide));
+		CHECK(MatchesStableSort(repeated));
+	}
+
+	RenderQueue scene(5000);
+	PushScene(scene, 5000, random);
+	CHECK(MatchesStableSort(scene));
+}
+
+// Bytes that are the same in every key are skipped: all of them when every key is
+// equal, all but one when keys differ in one byte, which also leaves the result in
+// the scratch buffer after an odd number of passes.
+TEST(RenderQueue, SortSkipsEqualBytes)
+{
+	RenderQueue equal;
+	for (uint32_t i = 0; i < 100; ++i)
+		equal.Push(0x1122334455667788ULL, i);
+	equal.Sort();
+	CHECK(equal.LastSortPasses() == 0);
+	size_t moved = 0;
+	for (uint32_t i = 0; i < 100; ++i)
+		moved += equal[i].Payload != i || equal[i].Key != 0x1122334455667788ULL;
+	CHECK(moved == 0);
+
+	std::minstd_rand random(2);
+	RenderQueue oneByte;
+	for (uint32_t i = 0; i < 1000; ++i)
+		oneByte.Push(0x1100000000000088ULL | (uint64_t)(random() % 256) << 24, i);
+	CHECK(MatchesStableSort(oneByte));
+	CHECK(oneByte.LastSortPasses() == 1);
+
+	RenderQueue twoBytes;
+	for (uint32_t i = 0; i < 1000; ++i)
+		twoBytes.Push((uint64_t)(random() % 256) << 56 | (random() % 256), i);
+	CHECK(MatchesStableSort(twoBytes));
+	CHECK(twoBytes.LastSortPasses() == 2);
+
+	// Scene keys: the pass and technique share the top byte, and that byte differs.
+	RenderQueue scene;
+	PushScene(scene, 1000, random);
+	scene.Sort();
+	CHECK(scene.LastSortPasses() <= 8);
+
+	// Sorting again, or clearing and pushing again, works on what is there now.
+	scene.Sort();
+	CHECK(std::is_sorted(scene.Items().begin(), scene.Items().end(), KeyLess));
+	scene.Clear();
+	CHECK(scene.Empty());
+	scene.Push(2, 0);
+	scene.Push(1, 1);
+	scene.Sort();
+	CHECK(scene[0].Payload == 1 && scene[1].Payload == 0);
+}
+
+TEST(RenderQueue, StateCacheDropsRepeatedBinds)
+{
+	RenderStateCache cache;
+
+	// Id 0 is an id like any other; nothing bound is not the same as 0 bound.
+	CHECK(cache.Bind(RenderStateCache::Texture, 0));
+	CHECK(!cache.Bind(RenderStateCache::Texture, 0));
+	CHECK(cache.Bind(RenderStateCache::Texture, 3));
+	CHECK(!cache.Bind(RenderStateCache::Texture, 3));
+	CHECK(cache.Bind(RenderStateCache::Texture, 0));
+
+	// Slots are apart.
+	CHECK(cache.Bind(RenderStateCache::Material, 3));
+	CHECK(cache.Bind(RenderStateCache::CubeMap, 0));
+	CHECK(!cache.Bind(RenderStateCache::Material, 3));
+	CHECK(cache.GetStats().Binds == 5 && cache.GetStats().Redundant == 3);
+
+	// After Reset everything is bound again; the stats go on.
+	cache.Reset();
+	CHECK(cache.Bind(RenderStateCache::Texture, 0));
+	CHECK(cache.Bind(RenderStateCache::Material, 3));
+	CHECK(cache.GetStats().Binds == 7);
+
+	cache.ResetStats();
+	CHECK(cache.GetStats().Binds == 0 && cache.GetStats().Redundant == 0);
+}
+
+// Submitting a sorted scene binds each technique, texture and material about once per
+// run of equal state; the unsorted order binds nearly every draw.
+TEST(RenderQueue, SortedSubmissionBindsLess)
+{
+	std::minstd_rand random(3);
+	RenderQueue queue;
+	PushScene(queue, 10000, random);
+
+	size_t binds[2];
+	for (int sorted = 0; sorted < 2; ++sorted)
+	{
+		if (sorted)
+			queue.Sort();
+
+		RenderStateCache cache;
+		for (size_t i = 0; i < queue.Size(); ++i)
+		{
+			uint64_t key = queue[i].Key;
+			cache.Bind(RenderStateCache::Technique, RenderKey::Technique(key));
+			cache.Bind(RenderStateCache::Texture, RenderKey::Texture(key));
+			cache.Bind(RenderStateCache::Material, RenderKey::Material(key));
+		}
+		CHECK(cache.GetStats().Binds + cache.GetStats().Redundant == 3*queue.Size());
+		binds[sorted] = cache.GetStats().Binds;
+	}
+
+	// Sorted, a texture is only rebound where the pass, technique or texture changes.
+	CHECK(binds[1] < binds[0]/2);
+	CHECK(binds[1] <= 2*4*64 + 2*4 + 10000);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+// 100k draws a frame: pushing and radix-sorting them, against std::stable_sort and
+// std::sort of the same items, and submitting them through the state cache.
+BENCH(RenderQueue, Draws100k)
+{
+	const size_t count = 100000;
+	std::minstd_rand random(4);
+	RenderQueue frame(count);
+	PushScene(frame, count, random);
+	const std::vector<RenderQueue::Item> items = frame.Items();
+
+	RenderQueue queue(count);
+	double radix = Test::MedianMs(21, [&queue, &items]()
+	{
+		queue.Clear();
+		for (size_t i = 0; i < items.size(); ++i)
+			queue.Push(items[i].Key, items[i].Payload);
+		queue.Sort();
+	});
+
+	std::vector<RenderQueue::Item> sorted;
+	double stable = Test::MedianMs(21, [&sorted, &items]()
+	{
+		sorted = items;
+		std::stable_sort(sorted.begin(), sorted.end(), KeyLess);
+	});
+	double unstable = Test::MedianMs(21, [&sorted, &items]()
+	{
+		sorted = items;
+		std::sort(sorted.begin(), sorted.end(), KeyLess);
+	});
+
+	RenderStateCache cache;
+	double submit = Test::MedianMs(21, [&queue, &cache]()
+	{
+		cache.Reset();
+		cache.ResetStats();
+		for (size_t i = 0; i < queue.Size(); ++i)
+		{
+			uint64_t key = queue[i].Key;
+			cache.Bind(RenderStateCache::Technique, RenderKey::Technique(key));
+			cache.Bind(RenderStateCache::Texture, RenderKey::Texture(key));
+			cache.Bind(RenderStateCache::Material, RenderKey::Material(key));
+			cache.Bind(RenderStateCache::Geometry, queue[i].Payload % 32);
+		}
+	});
+
+	printf("  push + radix sort %.2f ms (%u passes), std::stable_sort %.2f ms, std::sort %.2f ms\n",
+		radix, queue.LastSortPasses(), stable, unstable);
+	printf("  submission through the state cache %.2f ms: %zu binds, %zu dropped\n",
+		submit, cache.GetStats().Binds, cache.GetStats().Redundant);
+}
+#pragma endregion
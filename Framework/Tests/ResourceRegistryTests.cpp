@@ -0,0 +1,287 @@
+//***************************************************************************************
+// ResourceRegistryTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "ResourceRegistry.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// Stands in for the device: counts what it creates and destroys.
+	struct FakeTexture
+	{
+		size_t Size;
+	};
+
+	struct FakeDevice
+	{
+		static std::atomic<int> Creates;
+		static std::atomic<int> Destroys;
+
+		static void Reset()
+		{
+			Creates = 0;
+			Destroys = 0;
+		}
+
+		static FakeTexture* Create(size_t size)
+		{
+			++Creates;
+			FakeTexture* texture = new FakeTexture;
+			texture->Size = size;
+			return texture;
+		}
+
+		static void Destroy(void* resource)
+		{
+			++Destroys;
+			delete static_cast<FakeTexture*>(resource);
+		}
+
+		// A texture from the bytes of a file, through the registry.
+		static ResourceHandle<FakeTexture> Load(ResourceRegistry& registry, const void* bytes, size_t size)
+		{
+			uint64_t key = ContentKey(TextureResource, bytes, size);
+			return registry.Acquire<FakeTexture>(key, size, [size]() { return Create(size); }, &FakeDevice::Destroy);
+		}
+	};
+
+	std::atomic<int> FakeDevice::Creates(0);
+	std::atomic<int> FakeDevice::Destroys(0);
+}
+
+#pragma region Tests
+// Two loads of the same bytes share one resource; other bytes, or the same bytes as
+// another kind, get their own.
+TEST(ResourceRegistry, DedupByContentKey)
+{
+	FakeDevice::Reset();
+	{
+		ResourceRegistry registry;
+		const char floor[] = "floor.dds bytes";
+		char copy[sizeof(floor)];
+		memcpy(copy, floor, sizeof(floor));
+
+		ResourceHandle<FakeTexture> a = FakeDevice::Load(registry, floor, sizeof(floor));
+		ResourceHandle<FakeTexture> b = FakeDevice::Load(registry, copy, sizeof(copy));
+		CHECK(a.Get() == b.Get());
+		CHECK(FakeDevice::Creates == 1 && registry.LiveCount() == 1);
+
+		ResourceHandle<FakeTexture> c = FakeDevice::Load(registry, "bricks.dds bytes", 17);
+		CHECK(c.Get() != a.Get());
+		CHECK(FakeDevice::Creates == 2 && registry.CreatedCount() == 2);
+
+		CHECK(ContentKey(TextureResource, floor, sizeof(floor)) != ContentKey(EffectResource, floor, sizeof(floor)));
+	}
+
+	// The registry destroys what is still alive when it goes.
+	CHECK(FakeDevice::Destroys == 2);
+}
+
+// The last handle going does not destroy the resource; the next EndFrame does.
+TEST(ResourceRegistry, DeferredDestroyAtEndFrame)
+{
+	FakeDevice::Reset();
+	ResourceRegistry registry;
+	{
+		ResourceHandle<FakeTexture> a = FakeDevice::Load(registry, "color.fxo", 9);
+		ResourceHandle<FakeTexture> b = a;
+		a.Reset();
+		registry.EndFrame();
+		CHECK(FakeDevice::Destroys == 0);
+	}
+	CHECK(FakeDevice::Destroys == 0 && registry.LiveCount() == 1);
+
+	registry.EndFrame();
+	CHECK(FakeDevice::Destroys == 1 && registry.LiveCount() == 0);
+
+	// Loaded again after that, it is created again.
+	ResourceHandle<FakeTexture> again = FakeDevice::Load(registry, "color.fxo", 9);
+	CHECK(FakeDevice::Creates == 2 && !again.IsNull());
+}
+
+// Dropped and reloaded within a frame, a resource is neither destroyed nor recreated.
+TEST(ResourceRegistry, ReacquireBeforeEndFrameKeepsResource)
+{
+	FakeDevice::Reset();
+	ResourceRegistry registry;
+
+	ResourceHandle<FakeTexture> a = FakeDevice::Load(registry, "stone.dds", 9);
+	FakeTexture* first = a.Get();
+	a.Reset();
+	a = FakeDevice::Load(registry, "stone.dds", 9);
+	registry.EndFrame();
+
+	CHECK(a.Get() == first);
+	CHECK(FakeDevice::Creates == 1 && FakeDevice::Destroys == 0);
+
+	a.Reset();
+	registry.EndFrame();
+	CHECK(FakeDevice::Destroys == 1);
+}
+
+// Contents whose hashes are equal are told apart by their size; only the same key
+// and size share a resource.
+TEST(ResourceRegistry, SameKeyOtherSizeIsAnotherResource)
+{
+	FakeDevice::Reset();
+	ResourceRegistry registry;
+	const uint64_t key = 0x1234;
+
+	ResourceHandle<FakeTexture> a = registry.Acquire<FakeTexture>(key, 16, []() { return FakeDevice::Create(16); }, &FakeDevice::Destroy);
+	ResourceHandle<FakeTexture> b = registry.Acquire<FakeTexture>(key, 17, []() { return FakeDevice::Create(17); }, &FakeDevice::Destroy);
+	ResourceHandle<FakeTexture> c = registry.Acquire<FakeTexture>(key, 16, []() { return FakeDevice::Create(16); }, &FakeDevice::Destroy);
+	REQUIRE(!a.IsNull() && !b.IsNull());
+	CHECK(a.Get() != b.Get() && a->Size == 16 && b->Size == 17);
+	CHECK(c.Get() == a.Get());
+	CHECK(FakeDevice::Creates == 2);
+}
+
+// Far more keys than the capacity asked for: the table grows, and every resource is
+// still found under its key afterwards.
+TEST(ResourceRegistry, GrowsPastCapacity)
+{
+	FakeDevice::Reset();
+	ResourceRegistry registry(4);
+
+	const int count = 1000;
+	std::vector<ResourceHandle<FakeTexture> > handles;
+	for (int i = 0; i < count; ++i)
+		handles.push_back(FakeDevice::Load(registry, &i, sizeof(i)));
+
+	size_t lost = 0;
+	for (int i = 0; i < count; ++i)
+		lost += FakeDevice::Load(registry, &i, sizeof(i)).Get() != handles[i].Get();
+	CHECK(lost == 0);
+	CHECK(FakeDevice::Creates == count && registry.LiveCount() == (size_t)count);
+}
+
+// A slow create runs once however many threads want its key; they wait for it and
+// share what it made, while a key of its own is acquired meanwhile without waiting.
+TEST(ResourceRegistry, ConcurrentAcquireCreatesOnce)
+{
+	FakeDevice::Reset();
+	ResourceRegistry registry;
+	std::atomic<bool> otherLoaded(false);
+
+	// Waits for the other key, so it only finishes if that acquire is not held up.
+	std::function<FakeTexture*()> slow = [&otherLoaded]() -> FakeTexture*
+	{
+		double start = Test::Now();
+		while (!otherLoaded && Test::Now() - start < 5.0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return otherLoaded ? FakeDevice::Create(8) : 0;
+	};
+
+	const int threads = 4;
+	std::vector<FakeTexture*> seen(threads, 0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; ++t)
+	{
+		workers.push_back(std::thread([&registry, &slow, &seen, t]()
+		{
+			ResourceHandle<FakeTexture> handle = registry.Acquire<FakeTexture>(42, 8, slow, &FakeDevice::Destroy);
+			seen[t] = handle.Get();
+		}));
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	ResourceHandle<FakeTexture> other = FakeDevice::Load(registry, "sky.dds", 7);
+	otherLoaded = true;
+	for (size_t t = 0; t < workers.size(); ++t)
+		workers[t].join();
+
+	size_t different = 0;
+	for (int t = 0; t < threads; ++t)
+		different += seen[t] == 0 || seen[t] != seen[0];
+	CHECK(different == 0);
+	CHECK(FakeDevice::Creates == 2 && !other.IsNull());
+}
+
+// A create may acquire what it is made from out of the same registry.
+TEST(ResourceRegistry, CreateAcquiresFromRegistry)
+{
+	FakeDevice::Reset();
+	ResourceRegistry registry;
+	ResourceHandle<FakeTexture> inner;
+
+	ResourceHandle<FakeTexture> outer = registry.Acquire<FakeTexture>(7, 4, [&registry, &inner]()
+	{
+		inner = FakeDevice::Load(registry, "base", 4);
+		return FakeDevice::Create(4);
+	}, &FakeDevice::Destroy);
+
+	CHECK(!outer.IsNull() && !inner.IsNull() && outer.Get() != inner.Get());
+	CHECK(FakeDevice::Creates == 2 && registry.LiveCount() == 2);
+}
+
+// Threads acquire, copy and release handles over a few keys while another ends
+// frames; every resource created is destroyed exactly once.
+TEST(ResourceRegistry, ConcurrentAcquireRelease)
+{
+	FakeDevice::Reset();
+	ResourceRegistry registry;
+
+	const int threads = 4;
+	const int iterations = 50000;
+	std::atomic<int> nulls(0);
+	std::atomic<bool> done(false);
+
+	std::thread frames([&registry, &done]()
+	{
+		while (!done)
+			registry.EndFrame();
+	});
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; ++t)
+	{
+		workers.push_back(std::thread([&registry, &nulls]()
+		{
+			for (int i = 0; i < iterations; ++i)
+			{
+				char key = (char)(i % 8);
+				ResourceHandle<FakeTexture> handle = FakeDevice::Load(registry, &key, 1);
+				ResourceHandle<FakeTexture> copy = handle;
+				if (copy.IsNull() || copy->Size != 1)
+					++nulls;
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); ++t)
+		workers[t].join();
+	done = true;
+	frames.join();
+
+	registry.EndFrame();
+	CHECK(nulls == 0);
+	CHECK(registry.LiveCount() == 0);
+	CHECK(FakeDevice::Creates == FakeDevice::Destroys);
+	CHECK(FakeDevice::Creates >= 8 && (size_t)FakeDevice::Creates == registry.CreatedCount());
+}
+#pragma endregion
+
+#pragma region Benchmarks
+// Acquire and release of a resource that stays alive, the lock-free path.
+BENCH(ResourceRegistry, AcquireLive)
+{
+	ResourceRegistry registry;
+	ResourceHandle<FakeTexture> keep = FakeDevice::Load(registry, "x", 1);
+
+	const int count = 1000000;
+	double ms = Test::MedianMs(5, [&registry]()
+	{
+		for (int i = 0; i < count; ++i)
+			ResourceHandle<FakeTexture> handle = FakeDevice::Load(registry, "x", 1);
+	});
+
+	printf("  acquire + release: %.1f ns\n", ms*1e6/count);
+}
+#pragma endregion
@@ -0,0 +1,227 @@
+//***************************************************************************************
+// ShaderPermutationTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "ShaderPermutation.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#pragma region PermutationKey
+TEST(ShaderPermutation, KeyPacking)
+{
+	PermutationKey key = PermutationKey::Make(2, true, false, true);
+	CHECK(key.LightCount() == 2);
+	CHECK(key.Has(PermutationKey::Texture));
+	CHECK(!key.Has(PermutationKey::AlphaClip));
+	CHECK(key.Has(PermutationKey::Fog));
+	CHECK(!key.Has(PermutationKey::Reflect));
+	CHECK(key.TechniqueName() == "Light2TexFog");
+
+	// Light counts clamp to 3, and changing one field leaves the others alone.
+	CHECK(PermutationKey::Make(7).LightCount() == 3);
+	CHECK(key.WithLightCount(0).Bits == (key.Bits & ~PermutationKey::LightCountMask));
+	CHECK(key.With(PermutationKey::Reflect).Without(PermutationKey::Reflect) == key);
+	CHECK(PermutationKey(0xffffffff).Bits == PermutationKey::AllBits);
+}
+
+TEST(ShaderPermutation, ValidKeys)
+{
+	CHECK(!PermutationKey::Make(0).IsValid());
+	CHECK(PermutationKey::Make(0, true).IsValid());
+	CHECK(!PermutationKey::Make(1, false, true).IsValid());
+	CHECK(PermutationKey::Make(1, true, true).IsValid());
+	CHECK(PermutationKey::Make(3).With(PermutationKey::Clustered).IsValid());
+	CHECK(!PermutationKey::Make(3, false, false, true).With(PermutationKey::Clustered).IsValid());
+	CHECK(!PermutationKey::Make(0, true).With(PermutationKey::Clustered).IsValid());
+}
+
+TEST(ShaderPermutation, TechniqueNamesRoundTrip)
+{
+	unsigned int valid = 0;
+	for (unsigned int bits = 0; bits <= PermutationKey::AllBits; ++bits)
+	{
+		PermutationKey key(bits);
+		PermutationKey parsed;
+		bool ok = PermutationKey::FromTechniqueName(key.TechniqueName(), parsed);
+
+		// Names of invalid keys do not parse back.
+		CHECK(ok == key.IsValid());
+		if (ok)
+		{
+			CHECK(parsed == key);
+			++valid;
+		}
+	}
+
+	// Light0..3 x Tex x AlphaClip x Fog x Reflect, plus the clustered ones.
+	CHECK(valid == 56);
+
+	PermutationKey key;
+	CHECK(!PermutationKey::FromTechniqueName("Light4", key));
+	CHECK(!PermutationKey::FromTechniqueName("Light1FogTex", key));
+	CHECK(!PermutationKey::FromTechniqueName("Light1Texx", key));
+	CHECK(!PermutationKey::FromTechniqueName("Sky", key));
+}
+#pragma endregion
+
+#pragma region PermutationCache
+TEST(ShaderPermutation, CacheCompilesOnce)
+{
+	std::atomic<int> compiles(0);
+	PermutationCache<int> cache([&compiles](PermutationKey key)
+	{
+		++compiles;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		return (int)key.Bits + 1;
+	});
+
+	PermutationKey key = PermutationKey::Make(2, true);
+	std::atomic<int> wrong(0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 8; ++i)
+	{
+		threads.push_back(std::thread([&cache, &wrong, key]()
+		{
+			if (cache.Get(key) != (int)key.Bits + 1)
+				++wrong;
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+
+	CHECK(wrong == 0);
+	CHECK(compiles == 1);
+	CHECK(cache.IsCompiled(key));
+
+	PermutationCache<int>::Stats stats = cache.GetStats();
+	CHECK(stats.Requests == 8);
+	CHECK(stats.Compiles == 1);
+	CHECK(stats.Deduplicated <= 7);
+
+	CHECK(cache.Get(key) == (int)key.Bits + 1);
+	CHECK(compiles == 1);
+}
+
+TEST(ShaderPermutation, FailedBuildIsNotCached)
+{
+	int compiles = 0;
+	bool fail = true;
+	PermutationCache<int> cache([&compiles, &fail](PermutationKey key)
+	{
+		++compiles;
+		return fail ? 0 : (int)key.Bits;
+	});
+
+	PermutationKey key = PermutationKey::Make(1);
+	CHECK(cache.Get(key) == 0);
+	CHECK(!cache.IsCompiled(key));
+
+	fail = false;
+	CHECK(cache.Get(key) == (int)key.Bits);
+	CHECK(cache.IsCompiled(key));
+	CHECK(compiles == 2);
+}
+
+TEST(ShaderPermutation, ThrowingBuildReleasesWaiters)
+{
+	std::atomic<int> compiles(0);
+	PermutationCache<int> cache([&compiles](PermutationKey key) -> int
+	{
+		if (++compiles == 1)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			throw std::runtime_error("compile failed");
+		}
+		return (int)key.Bits;
+	});
+
+	PermutationKey key = PermutationKey::Make(3, true);
+	bool threw = false;
+	std::thread builder([&cache, &threw, key]()
+	{
+		try
+		{
+			cache.Get(key);
+		}
+		catch (const std::runtime_error&)
+		{
+			threw = true;
+		}
+	});
+
+	// A request that waits on the failing build gets nothing, and must not hang.
+	while (cache.GetStats().Compiles == 0)
+		std::this_thread::yield();
+	int waited = cache.Get(key);
+	builder.join();
+
+	CHECK(threw);
+	CHECK(waited == 0 || waited == (int)key.Bits);
+
+	// The key is unbuilt again, so the next request compiles it.
+	CHECK(cache.Get(key) == (int)key.Bits);
+	CHECK(cache.IsCompiled(key));
+}
+#pragma endregion
+
+#pragma region WarmupList
+TEST(ShaderPermutation, WarmupListRoundTrip)
+{
+	WarmupList list;
+	CHECK(list.Add(PermutationKey::Make(3, true, false, true)));
+	CHECK(list.Add(PermutationKey::Make(1)));
+	CHECK(!list.Add(PermutationKey::Make(1)));
+
+	std::stringstream file;
+	list.Write(file);
+	CHECK(file.str() == "Light3TexFog\nLight1\n");
+
+	// Unknown and invalid lines are skipped, Windows line ends tolerated.
+	std::stringstream edited("Light3TexFog\r\nLight0\nBogus\nLight1\nLight2Reflect\n");
+	WarmupList read;
+	read.Read(edited);
+	REQUIRE(read.Size() == 3);
+	CHECK(read.Keys()[0] == PermutationKey::Make(3, true, false, true));
+	CHECK(read.Keys()[1] == PermutationKey::Make(1));
+	CHECK(read.Keys()[2] == PermutationKey::Make(2, false, false, false, true));
+
+	WarmupList missing;
+	CHECK(!missing.Load("does-not-exist.warmup"));
+	CHECK(missing.Size() == 0);
+
+	CHECK(list.Save("ShaderPermutationTests.warmup"));
+	CHECK(read.Load("ShaderPermutationTests.warmup"));
+	CHECK(read.Keys() == list.Keys());
+	remove("ShaderPermutationTests.warmup");
+}
+
+TEST(ShaderPermutation, WarmDoesNotMarkUsed)
+{
+	int compiles = 0;
+	PermutationCache<int> cache([&compiles](PermutationKey key) { ++compiles; return (int)key.Bits; });
+
+	WarmupList list;
+	list.Add(PermutationKey::Make(2, true));
+	list.Add(PermutationKey::Make(0));
+	list.Add(PermutationKey::Make(1, true, true));
+	cache.Warm(list);
+
+	// The invalid key is skipped.
+	CHECK(compiles == 2);
+	CHECK(cache.IsCompiled(PermutationKey::Make(2, true)));
+	CHECK(!cache.IsCompiled(PermutationKey::Make(0)));
+	CHECK(cache.UsedKeys().Size() == 0);
+
+	// A warmed key is served without compiling, and only now counts as used.
+	cache.Get(PermutationKey::Make(2, true));
+	CHECK(compiles == 2);
+	REQUIRE(cache.UsedKeys().Size() == 1);
+	CHECK(cache.UsedKeys().Keys()[0] == PermutationKey::Make(2, true));
+}
+#pragma endregion
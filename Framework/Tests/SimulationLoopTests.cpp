@@ -0,0 +1,283 @@
+//***************************************************************************************
+// SimulationLoopTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "SimulationLoop.h"
+
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// 256 bytes, every word the same, so a read that mixes two publishes shows.
+	struct Wide
+	{
+		uint64_t Words[32];
+	};
+
+	struct Torn
+	{
+		uint64_t Acquired;
+		uint64_t Torn;
+		uint64_t Backwards;
+	};
+
+	// One thread publishes 1..count while this one acquires until it sees count. Both
+	// yield now and then, so that they interleave on a single core too.
+	Torn PublishAndRead(uint64_t count)
+	{
+		TripleBuffer<Wide> buffer;
+		Wide zero = {};
+		buffer.Reset(zero);
+
+		std::thread producer([&buffer, count]()
+		{
+			for (uint64_t k = 1; k <= count; ++k)
+			{
+				Wide& value = buffer.Write();
+				for (int i = 0; i < 32; ++i)
+					value.Words[i] = k;
+				buffer.Publish();
+				if (k % 16 == 0)
+					std::this_thread::yield();
+			}
+		});
+
+		Torn result = {};
+		uint64_t last = 0;
+		while (last < count)
+		{
+			if (!buffer.Acquire())
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			const Wide& value = buffer.Read();
+			for (int i = 1; i < 32; ++i)
+				result.Torn += value.Words[i] != value.Words[0];
+			result.Backwards += value.Words[0] <= last;
+			last = value.Words[0];
+			++result.Acquired;
+		}
+		producer.join();
+		return result;
+	}
+
+	struct Stamped
+	{
+		uint64_t Tick;
+		double Published;
+	};
+}
+
+#pragma region Tests
+TEST(SimulationLoop, TripleBufferHandsOverNewest)
+{
+	TripleBuffer<int> buffer;
+	buffer.Reset(0);
+	CHECK(!buffer.Acquire() && buffer.Read() == 0);
+
+	buffer.Write() = 1;
+	buffer.Publish();
+	CHECK(buffer.Acquire() && buffer.Read() == 1);
+	CHECK(!buffer.Acquire() && buffer.Read() == 1);
+
+	// Values published in between are skipped.
+	for (int i = 2; i <= 5; ++i)
+	{
+		buffer.Write() = i;
+		buffer.Publish();
+	}
+	CHECK(buffer.Read() == 1);
+	CHECK(buffer.Acquire() && buffer.Read() == 5);
+}
+
+// A producer and a consumer thread at full speed: no read mixes two publishes, and
+// none goes back to an older one.
+TEST(SimulationLoop, TripleBufferReadsAreWhole)
+{
+	Torn result = PublishAndRead(500000);
+	CHECK(result.Torn == 0);
+	CHECK(result.Backwards == 0);
+	CHECK(result.Acquired > 0);
+}
+
+// The first step stalls for ten steps. MaxCatchUp steps then run back to back, the
+// rest of the backlog is dropped, and the steps after keep to the schedule.
+TEST(SimulationLoop, FixedStepThreadDropsBacklog)
+{
+	const double step = 0.01;
+	FixedStepThread thread;
+	std::vector<double> due;
+	std::vector<uint64_t> dropped;
+	double stallEnd = 0.0;
+	due.reserve(64);
+	dropped.reserve(64);
+
+	thread.Start(step, [&](double time)
+	{
+		if (due.empty())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			stallEnd = thread.Now();
+		}
+		if (due.size() < 64)
+		{
+			due.push_back(time);
+			dropped.push_back(thread.Dropped());
+		}
+	});
+
+	double start = Test::Now();
+	while (thread.Steps() < 12 && Test::Now() - start < 5.0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	thread.Stop();
+	REQUIRE(due.size() >= 12);
+
+	size_t behind = 0;
+	for (size_t i = 0; i < due.size(); ++i)
+		behind += due[i] < stallEnd;
+	CHECK(behind == FixedStepThread::MaxCatchUp);
+	CHECK(dropped[FixedStepThread::MaxCatchUp] >= 5);
+
+	// Step i is due at the (i + 1 + dropped)th step, whatever was dropped before it.
+	size_t offSchedule = 0;
+	for (size_t i = 0; i < due.size(); ++i)
+		offSchedule += fabs(due[i]/step - (double)(i + 1 + dropped[i])) > 1e-6;
+	CHECK(offSchedule == 0);
+	CHECK(!thread.Running());
+}
+
+// Every step takes two and a half: steps run back to back, the backlog is dropped
+// over and over, and Stop still returns.
+TEST(SimulationLoop, FixedStepThreadOverloaded)
+{
+	FixedStepThread thread;
+	thread.Start(0.01, [](double)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(25));
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(400));
+	double elapsed = thread.Now();
+	thread.Stop();
+
+	CHECK(thread.Steps() > 0 && thread.Steps() <= elapsed/0.025 + 2);
+	CHECK(thread.Dropped() > 0);
+	CHECK(!thread.Running());
+}
+
+// A value moving at one unit a second: interpolated between the two newest ticks, it
+// is where it was one tick ago.
+TEST(SimulationLoop, InterpolatesOneTickBehind)
+{
+	struct Position
+	{
+		double X;
+	};
+
+	const float tick = 0.01f;
+	SimulationLoop<Position> loop;
+	Position origin = { 0.0 };
+	loop.Start(tick, origin, [](Position& p, float dt) { p.X += dt; });
+	CHECK(loop.Sample() == 1.0f && loop.Current().X == 0.0);
+
+	std::vector<double> errors;
+	size_t outside = 0;
+	double start = Test::Now();
+	while (Test::Now() - start < 0.5)
+	{
+		float alpha = loop.Sample();
+		double renderTime = loop.Thread().Now() - tick;
+		outside += alpha < 0.0f || alpha > 1.0f;
+		if (renderTime > 0.1)
+			errors.push_back(fabs(loop.Previous().X + alpha*(loop.Current().X - loop.Previous().X) - renderTime));
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	loop.Stop();
+
+	CHECK(outside == 0);
+	REQUIRE(!errors.empty());
+	CHECK(Test::Percentile(errors, 50.0) < 0.001);
+	CHECK(loop.Thread().Steps() > 0);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+BENCH(SimulationLoop, TornReads)
+{
+	const uint64_t count = 2000000;
+	double start = Test::Now();
+	Torn result = PublishAndRead(count);
+	double ms = (Test::Now() - start)*1000.0;
+
+	printf("  %llu publishes of 256 bytes in %.0f ms, %llu acquired: %llu torn, %llu out of order\n",
+		(unsigned long long)count, ms, (unsigned long long)result.Acquired,
+		(unsigned long long)result.Torn, (unsigned long long)result.Backwards);
+}
+
+// How late steps run after they are due, over two seconds each at 60 and 120 Hz.
+BENCH(SimulationLoop, TickLateness)
+{
+	const double rates[] = { 60.0, 120.0 };
+	for (int r = 0; r < 2; ++r)
+	{
+		FixedStepThread thread;
+		std::vector<double> late;
+		late.reserve(1024);
+		thread.Start(1.0/rates[r], [&thread, &late](double due) { late.push_back(thread.Now() - due); });
+		std::this_thread::sleep_for(std::chrono::seconds(2));
+		thread.Stop();
+
+		double p50 = Test::Percentile(late, 50.0);
+		double p99 = Test::Percentile(late, 99.0);
+		printf("  %.0f Hz: %llu steps, %llu dropped, late p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", rates[r],
+			(unsigned long long)thread.Steps(), (unsigned long long)thread.Dropped(),
+			p50*1000.0, p99*1000.0, late.back()*1000.0);
+	}
+}
+
+// From a tick publishing its snapshot to the render thread's Sample taking it, with
+// the render thread polling as fast as it can, at 120 and 1000 ticks a second.
+BENCH(SimulationLoop, PublishToSample)
+{
+	const float ticks[] = { 1.0f/120.0f, 0.001f };
+	for (int t = 0; t < 2; ++t)
+	{
+		SimulationLoop<Stamped> loop;
+		Stamped initial = { 0, 0.0 };
+		loop.Start(ticks[t], initial, [](Stamped& s, float)
+		{
+			++s.Tick;
+			s.Published = Test::Now();
+		});
+
+		std::vector<double> latency;
+		latency.reserve(4096);
+		uint64_t seen = 0;
+		uint64_t skipped = 0;
+		double start = Test::Now();
+		while (Test::Now() - start < 2.0)
+		{
+			loop.Sample();
+			const Stamped& current = loop.Current();
+			if (current.Tick != seen)
+			{
+				latency.push_back(Test::Now() - current.Published);
+				skipped += current.Tick - seen - 1;
+				seen = current.Tick;
+			}
+			std::this_thread::yield();
+		}
+		loop.Stop();
+
+		double p50 = Test::Percentile(latency, 50.0);
+		double p99 = Test::Percentile(latency, 99.0);
+		printf("  %.0f Hz: %zu snapshots sampled, %llu skipped, latency p50 %.1f us, p99 %.1f us, max %.1f us\n",
+			1.0/ticks[t], latency.size(), (unsigned long long)skipped, p50*1e6, p99*1e6, latency.back()*1e6);
+	}
+}
+#pragma endregion
@@ -0,0 +1,374 @@
+//***************************************************************************************
+// SpatialGridTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "SpatialGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+	struct Sphere
+	{
+		float Center[3];
+		float Radius;
+	};
+
+	// count spheres of radius 0.5 to 3 in a cube holding about one per 1000 units,
+	// with one in 500 of radius 20.
+	std::vector<Sphere> RandomSpheres(size_t count, unsigned int seed, float& extent)
+	{
+		std::minstd_rand random(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		extent = powf((float)count, 1.0f/3.0f)*10.0f;
+
+		std::vector<Sphere> spheres(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			for (int a = 0; a < 3; ++a)
+				spheres[i].Center[a] = unit(random)*extent;
+			spheres[i].Radius = unit(random) < 0.002f ? 20.0f : 0.5f + 2.5f*unit(random);
+		}
+		return spheres;
+	}
+
+	// A left-handed look-at view and perspective projection, row-major and applied as
+	// p*M, as XNA Math makes them.
+	void ViewProj(const float eye[3], const float target[3], float fovY, float aspect, float nearZ, float farZ, float out[16])
+	{
+		float z[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+		float length = sqrtf(z[0]*z[0] + z[1]*z[1] + z[2]*z[2]);
+		for (int a = 0; a < 3; ++a)
+			z[a] /= length;
+		float x[3] = { z[2], 0.0f, -z[0] };
+		length = sqrtf(x[0]*x[0] + x[2]*x[2]);
+		x[0] /= length;
+		x[2] /= length;
+		float y[3] = { z[1]*x[2] - z[2]*x[1], z[2]*x[0] - z[0]*x[2], z[0]*x[1] - z[1]*x[0] };
+
+		float view[16] = { x[0], y[0], z[0], 0.0f, x[1], y[1], z[1], 0.0f, x[2], y[2], z[2], 0.0f,
+			-(x[0]*eye[0] + x[1]*eye[1] + x[2]*eye[2]), -(y[0]*eye[0] + y[1]*eye[1] + y[2]*eye[2]),
+			-(z[0]*eye[0] + z[1]*eye[1] + z[2]*eye[2]), 1.0f };
+
+		float ys = 1.0f/tanf(0.5f*fovY);
+		float proj[16] = { ys/aspect, 0.0f, 0.0f, 0.0f, 0.0f, ys, 0.0f, 0.0f,
+			0.0f, 0.0f, farZ/(farZ - nearZ), 1.0f, 0.0f, 0.0f, -nearZ*farZ/(farZ - nearZ), 0.0f };
+
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int j = 0; j < 4; ++j)
+			{
+				float sum = 0.0f;
+				for (int k = 0; k < 4; ++k)
+					sum += view[i*4 + k]*proj[k*4 + j];
+				out[i*4 + j] = sum;
+			}
+		}
+	}
+
+	// A view orbiting the middle of the cube, looking at it.
+	SpatialGrid::Frustum OrbitView(float extent, float angle)
+	{
+		float eye[3] = { extent*(0.5f + 0.6f*cosf(angle)), 0.5f*extent, extent*(0.5f + 0.6f*sinf(angle)) };
+		float target[3] = { 0.5f*extent, 0.5f*extent, 0.5f*extent };
+		float viewProj[16];
+		ViewProj(eye, target, 0.7854f, 16.0f/9.0f, 1.0f, 0.5f*extent, viewProj);
+
+		SpatialGrid::Frustum frustum;
+		frustum.Set(viewProj);
+		return frustum;
+	}
+
+	std::vector<SpatialGrid::Handle> LinearSphere(const std::vector<Sphere>& spheres, const float center[3], float radius)
+	{
+		std::vector<SpatialGrid::Handle> found;
+		for (size_t i = 0; i < spheres.size(); ++i)
+		{
+			float dx = spheres[i].Center[0] - center[0];
+			float dy = spheres[i].Center[1] - center[1];
+			float dz = spheres[i].Center[2] - center[2];
+			float r = spheres[i].Radius + radius;
+			if (dx*dx + dy*dy + dz*dz <= r*r)
+				found.push_back((SpatialGrid::Handle)i);
+		}
+		return found;
+	}
+
+	std::vector<SpatialGrid::Handle> LinearFrustum(const std::vector<Sphere>& spheres, const SpatialGrid::Frustum& frustum)
+	{
+		std::vector<SpatialGrid::Handle> found;
+		for (size_t i = 0; i < spheres.size(); ++i)
+		{
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; ++p)
+			{
+				const float* plane = frustum.Planes[p];
+				const float* c = spheres[i].Center;
+				inside = plane[0]*c[0] + plane[1]*c[1] + plane[2]*c[2] + plane[3] >= -spheres[i].Radius;
+			}
+			if (inside)
+				found.push_back((SpatialGrid::Handle)i);
+		}
+		return found;
+	}
+
+	std::vector<SpatialGrid::Handle> Sorted(std::vector<SpatialGrid::Handle> handles)
+	{
+		std::sort(handles.begin(), handles.end());
+		return handles;
+	}
+
+	// The plane test passes spheres just outside the frustum's edges. The grid skips
+	// cells outside the frustum's bounding box, so it may leave out some of those, but
+	// only those; anything else it finds or misses is wrong.
+	size_t FrustumErrors(const std::vector<Sphere>& spheres, const SpatialGrid::Frustum& frustum,
+		const std::vector<SpatialGrid::Handle>& found)
+	{
+		std::vector<SpatialGrid::Handle> grid = Sorted(found);
+		std::vector<SpatialGrid::Handle> linear = LinearFrustum(spheres, frustum);
+
+		size_t errors = 0;
+		size_t g = 0;
+		for (size_t l = 0; l < linear.size(); ++l)
+		{
+			for (; g < grid.size() && grid[g] < linear[l]; ++g)
+				++errors;
+			if (g < grid.size() && grid[g] == linear[l])
+			{
+				++g;
+				continue;
+			}
+
+			const Sphere& s = spheres[linear[l]];
+			bool touchesBox = true;
+			for (int a = 0; a < 3; ++a)
+				touchesBox = touchesBox && s.Center[a] + s.Radius >= frustum.Min[a] && s.Center[a] - s.Radius <= frustum.Max[a];
+			errors += touchesBox;
+		}
+		return errors + (grid.size() - g);
+	}
+}
+
+#pragma region Tests
+TEST(SpatialGrid, InsertMoveRemove)
+{
+	SpatialGrid grid(8.0f);
+	float a[3] = { 1.0f, 1.0f, 1.0f };
+	float b[3] = { 100.0f, 0.0f, 0.0f };
+	SpatialGrid::Handle first = grid.Insert(a, 1.0f);
+	SpatialGrid::Handle second = grid.Insert(b, 2.0f);
+	SpatialGrid::Handle wide = grid.Insert(a, 10.0f);
+	CHECK(first != second && grid.Size() == 3);
+	CHECK(grid.CellCount() == 2 && grid.LargeCount() == 1);
+
+	// Within its cell, then to another cell, then wider than half a cell.
+	float moved[3] = { 2.0f, 1.0f, 1.0f };
+	grid.Move(first, moved, 1.0f);
+	moved[0] = -50.0f;
+	grid.Move(first, moved, 1.5f);
+	float center[3];
+	float radius;
+	grid.GetSphere(first, center, radius);
+	CHECK(center[0] == -50.0f && radius == 1.5f);
+	grid.Move(first, moved, 5.0f);
+	CHECK(grid.LargeCount() == 2);
+
+	std::vector<SpatialGrid::Handle> found;
+	grid.QuerySphere(moved, 0.5f, found);
+	CHECK(found.size() == 1 && found[0] == first);
+
+	grid.Remove(wide);
+	grid.Remove(first);
+	CHECK(grid.Size() == 1 && grid.LargeCount() == 0);
+	found.clear();
+	grid.QuerySphere(a, 50.0f, found);
+	CHECK(found.empty());
+
+	// Handles of removed objects are reused.
+	SpatialGrid::Handle again = grid.Insert(a, 1.0f);
+	CHECK(again == first || again == wide);
+	grid.GetSphere(second, center, radius);
+	CHECK(center[0] == 100.0f && radius == 2.0f);
+}
+
+// Frames of moving objects: sphere queries return exactly what a scan of every object
+// returns, and frustum queries the same up to spheres outside the frustum's box.
+TEST(SpatialGrid, QueriesMatchLinearScan)
+{
+	float extent;
+	std::vector<Sphere> spheres = RandomSpheres(5000, 1, extent);
+	SpatialGrid grid(16.0f);
+	for (size_t i = 0; i < spheres.size(); ++i)
+		CHECK(grid.Insert(spheres[i].Center, spheres[i].Radius) == i);
+
+	std::minstd_rand random(2);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	size_t wrong = 0;
+	size_t visible = 0;
+	for (int frame = 0; frame < 40; ++frame)
+	{
+		for (size_t m = 0; m < spheres.size()/10; ++m)
+		{
+			size_t i = (m*7919 + frame*500) % spheres.size();
+			for (int a = 0; a < 3; ++a)
+				spheres[i].Center[a] += 4.0f*(unit(random) - 0.5f);
+			grid.Move((SpatialGrid::Handle)i, spheres[i].Center, spheres[i].Radius);
+		}
+
+		SpatialGrid::Frustum frustum = OrbitView(extent, frame*0.15f);
+		std::vector<SpatialGrid::Handle> found;
+		grid.QueryFrustum(frustum, found);
+		wrong += FrustumErrors(spheres, frustum, found);
+		visible += found.size();
+
+		float center[3] = { unit(random)*extent, unit(random)*extent, unit(random)*extent };
+		found.clear();
+		grid.QuerySphere(center, 15.0f, found);
+		wrong += Sorted(found) != LinearSphere(spheres, center, 15.0f);
+	}
+	CHECK(wrong == 0);
+	CHECK(visible > 0 && visible < 40*spheres.size());
+}
+
+// Build gives sphere i handle i; Rebuild drops emptied cells and may change the cell
+// size, keeping handles.
+TEST(SpatialGrid, BuildAndRebuild)
+{
+	float extent;
+	std::vector<Sphere> spheres = RandomSpheres(2000, 3, extent);
+	SpatialGrid grid(16.0f);
+	grid.Build(&spheres[0].Center[0], sizeof(Sphere), spheres.size());
+	CHECK(grid.Size() == spheres.size());
+
+	float center[3] = { 0.5f*extent, 0.5f*extent, 0.5f*extent };
+	std::vector<SpatialGrid::Handle> found;
+	grid.QuerySphere(center, 30.0f, found);
+	CHECK(Sorted(found) == LinearSphere(spheres, center, 30.0f));
+
+	// Everything moves into one corner; the old cells stay until Rebuild.
+	for (size_t i = 0; i < spheres.size(); ++i)
+	{
+		for (int a = 0; a < 3; ++a)
+			spheres[i].Center[a] *= 0.1f;
+		grid.Move((SpatialGrid::Handle)i, spheres[i].Center, spheres[i].Radius);
+	}
+	size_t cells = grid.CellCount();
+	grid.Rebuild();
+	CHECK(grid.CellCount() < cells);
+
+	grid.Rebuild(4.0f);
+	CHECK(grid.CellSize() == 4.0f && grid.Size() == spheres.size());
+	CHECK(grid.LargeCount() > 0);
+
+	SpatialGrid::Frustum frustum = OrbitView(0.1f*extent, 0.3f);
+	found.clear();
+	grid.QueryFrustum(frustum, found);
+	CHECK(FrustumErrors(spheres, frustum, found) == 0);
+}
+
+TEST(SpatialGrid, FrustumPlanes)
+{
+	float eye[3] = { 0.0f, 0.0f, 0.0f };
+	float target[3] = { 0.0f, 0.0f, 1.0f };
+	float viewProj[16];
+	ViewProj(eye, target, 1.5708f, 1.0f, 1.0f, 100.0f, viewProj);
+	SpatialGrid::Frustum frustum;
+	frustum.Set(viewProj);
+
+	// A 90 degree frustum along +z: the far corners are at (+-100, +-100, 100).
+	CHECK(fabsf(frustum.Min[0] + 100.0f) < 0.1f && fabsf(frustum.Max[0] - 100.0f) < 0.1f);
+	CHECK(fabsf(frustum.Min[2] - 1.0f) < 0.01f && fabsf(frustum.Max[2] - 100.0f) < 0.1f);
+
+	std::vector<Sphere> spheres(4);
+	const float centers[4][3] = { { 0, 0, 50 }, { 0, 0, -5 }, { 60, 0, 50 }, { 0, 0, 101 } };
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int a = 0; a < 3; ++a)
+			spheres[i].Center[a] = centers[i][a];
+		spheres[i].Radius = 0.5f;
+	}
+	std::vector<SpatialGrid::Handle> inside = LinearFrustum(spheres, frustum);
+	CHECK(inside.size() == 1 && inside[0] == 0);
+
+	// Just outside the far plane, but reaching into it.
+	spheres[3].Radius = 2.0f;
+	CHECK(LinearFrustum(spheres, frustum).size() == 2);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+// 10% of the objects move a frame, over 100 frames; a view orbits the scene and a
+// sphere of radius 15 is queried at random. Against a scan of every object.
+BENCH(SpatialGrid, MovingScene)
+{
+	const size_t counts[] = { 10000, 100000 };
+	const float cellSizes[] = { 32.0f, 8.0f };
+	for (int c = 0; c < 2; ++c)
+	{
+		for (int s = 0; s < 2; ++s)
+		{
+			float extent;
+			std::vector<Sphere> spheres = RandomSpheres(counts[c], 1, extent);
+			SpatialGrid grid(cellSizes[s]);
+			double build = Test::MedianMs(5, [&]() { grid.Build(&spheres[0].Center[0], sizeof(Sphere), spheres.size()); });
+
+			std::minstd_rand random(2);
+			std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+			const int frames = 100;
+			size_t moving = spheres.size()/10;
+			double moves = 0.0;
+			double frustumMs = 0.0;
+			double linearMs = 0.0;
+			double sphereUs = 0.0;
+			size_t wrong = 0;
+			std::vector<SpatialGrid::Handle> found;
+			found.reserve(spheres.size());
+
+			for (int frame = 0; frame < frames; ++frame)
+			{
+				double start = Test::Now();
+				for (size_t m = 0; m < moving; ++m)
+				{
+					size_t i = (m*7919 + frame*moving) % spheres.size();
+					for (int a = 0; a < 3; ++a)
+						spheres[i].Center[a] += 0.2f*(unit(random) - 0.5f);
+					grid.Move((SpatialGrid::Handle)i, spheres[i].Center, spheres[i].Radius);
+				}
+				moves += Test::Now() - start;
+
+				SpatialGrid::Frustum frustum = OrbitView(extent, frame*0.03f);
+				found.clear();
+				start = Test::Now();
+				grid.QueryFrustum(frustum, found);
+				frustumMs += (Test::Now() - start)*1000.0;
+
+				start = Test::Now();
+				LinearFrustum(spheres, frustum);
+				linearMs += (Test::Now() - start)*1000.0;
+				wrong += FrustumErrors(spheres, frustum, found);
+
+				float center[3] = { unit(random)*extent, unit(random)*extent, unit(random)*extent };
+				start = Test::Now();
+				for (int q = 0; q < 100; ++q)
+				{
+					found.clear();
+					grid.QuerySphere(center, 15.0f, found);
+				}
+				sphereUs += (Test::Now() - start)*1e6/100;
+				wrong += Sorted(found) != LinearSphere(spheres, center, 15.0f);
+			}
+
+			double rebuild = Test::MedianMs(5, [&]() { grid.Rebuild(); });
+
+			printf("  %6zu objects, cell %2.0f: build %.2f ms, %.1fM moves/s, frustum %.3f ms (scan %.3f ms), sphere %.1f us, rebuild %.2f ms; %zu differ\n",
+				spheres.size(), cellSizes[s], build, moving*frames/moves*1e-6, frustumMs/frames, linearMs/frames,
+				sphereUs/frames, rebuild, wrong);
+		}
+	}
+}
+#pragma endregion
@@ -0,0 +1,216 @@
+//***************************************************************************************
+// StartupGraphTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "StartupGraph.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	void Sleep(int ms)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+	}
+
+	// The order steps finished in.
+	struct Log
+	{
+		std::mutex Mutex;
+		std::vector<int> Order;
+
+		void Add(int step)
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			Order.push_back(step);
+		}
+
+		size_t Position(int step)const
+		{
+			for (size_t i = 0; i < Order.size(); ++i)
+			{
+				if (Order[i] == step)
+					return i;
+			}
+			return Order.size();
+		}
+	};
+}
+
+#pragma region Tests
+// A diamond with a step hanging off each side: every step runs once, after all of
+// its dependencies.
+TEST(StartupGraph, DependenciesRunFirst)
+{
+	JobSystem jobs(3);
+	StartupGraph graph;
+	Log log;
+
+	typedef StartupGraph Graph;
+	Graph::StepId a = graph.Add("A", [&log]() { log.Add(0); });
+	Graph::StepId b = graph.Add("B", [&log]() { Sleep(2); log.Add(1); });
+	Graph::StepId c = graph.Add("C", [&log]() { log.Add(2); }, Graph::OwningThread);
+	Graph::StepId d = graph.Add("D", [&log]() { log.Add(3); }, Graph::OwningThread);
+	Graph::StepId e = graph.Add("E", [&log]() { log.Add(4); });
+	graph.DependsOn(b, a);
+	graph.DependsOn(c, a);
+	graph.DependsOn(d, b);
+	graph.DependsOn(d, c);
+	graph.DependsOn(e, c);
+
+	graph.Run(jobs);
+
+	REQUIRE(log.Order.size() == 5);
+	CHECK(log.Position(0) < log.Position(1) && log.Position(0) < log.Position(2));
+	CHECK(log.Position(1) < log.Position(3) && log.Position(2) < log.Position(3));
+	CHECK(log.Position(2) < log.Position(4));
+
+	const std::vector<Graph::Step>& steps = graph.Steps();
+	for (size_t i = 0; i < steps.size(); ++i)
+	{
+		CHECK(steps[i].Begin <= steps[i].End);
+		for (size_t k = 0; k < steps[i].Dependencies.size(); ++k)
+			CHECK(steps[steps[i].Dependencies[k]].End <= steps[i].Begin);
+	}
+}
+
+// Owning thread steps run on the thread that called Run, the others wherever.
+TEST(StartupGraph, OwningThreadStepsRunOnCaller)
+{
+	JobSystem jobs(3);
+	StartupGraph graph;
+	std::thread::id caller = std::this_thread::get_id();
+	std::atomic<int> elsewhere(0);
+
+	for (int i = 0; i < 16; ++i)
+	{
+		graph.Add("Device", [caller, &elsewhere]()
+		{
+			if (std::this_thread::get_id() != caller)
+				++elsewhere;
+		}, StartupGraph::OwningThread);
+		graph.Add("Job", []() { Sleep(1); });
+	}
+	graph.Run(jobs);
+
+	CHECK(elsewhere == 0);
+	for (size_t i = 0; i < graph.Steps().size(); i += 2)
+		CHECK(graph.Steps()[i].Thread == 0);
+}
+
+// A 30 ms chain beside a 5 ms step: the chain is the critical path and the wall
+// time is about its length, not the sum.
+TEST(StartupGraph, CriticalPath)
+{
+	JobSystem jobs(3);
+	StartupGraph graph;
+
+	typedef StartupGraph Graph;
+	Graph::StepId read = graph.Add("Read", []() { Sleep(20); });
+	Graph::StepId create = graph.Add("Create", []() { Sleep(10); }, Graph::OwningThread);
+	graph.Add("Other", []() { Sleep(5); });
+	graph.DependsOn(create, read);
+
+	graph.Run(jobs);
+
+	std::vector<Graph::StepId> path = graph.CriticalPath();
+	REQUIRE(path.size() == 2);
+	CHECK(path[0] == read && path[1] == create);
+	CHECK(graph.CriticalPathMilliseconds() >= 30.0);
+	CHECK(graph.WallMilliseconds() >= graph.CriticalPathMilliseconds());
+	CHECK(graph.WallMilliseconds() < 35.0 + 30.0);
+
+	std::string report = graph.Report();
+	CHECK(report.find("Read") != std::string::npos && report.find("Other") != std::string::npos);
+
+	// It runs again with fresh timings.
+	graph.Run(jobs);
+	CHECK(graph.CriticalPath().size() == 2);
+}
+
+TEST(StartupGraph, Empty)
+{
+	JobSystem jobs(1);
+	StartupGraph graph;
+	graph.Run(jobs);
+	CHECK(graph.CriticalPath().empty());
+	CHECK(graph.WallMilliseconds() >= 0.0);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+namespace
+{
+	// Shaders_Basics' Init steps in the order and with the dependencies ShadersApp::Init
+	// gives them, each standing in for its work by sleeping; the costs are rough
+	// figures for the demo on a desktop GPU.
+	struct InitStep
+	{
+		const char* Name;
+		int Milliseconds;
+		StartupGraph::Affinity Where;
+		int Dependencies[4];
+	};
+
+	const InitStep ShadersInit[] =
+	{
+		{ "Effects::InitAll",      45, StartupGraph::OwningThread, { -1 } },
+		{ "InputLayouts::InitAll",  3, StartupGraph::OwningThread, { 0, -1 } },
+		{ "Sky",                   12, StartupGraph::OwningThread, { -1 } },
+		{ "ReadTextures",          15, StartupGraph::AnyThread,    { -1 } },
+		{ "CreateTextures",         4, StartupGraph::OwningThread, { 3, -1 } },
+		{ "BuildFrameGraph",        2, StartupGraph::OwningThread, { -1 } },
+		{ "GenerateShapeGeometry", 20, StartupGraph::AnyThread,    { -1 } },
+		{ "CreateShapeBuffers",     1, StartupGraph::OwningThread, { 6, -1 } },
+		{ "BuildShapePickMeshes",   5, StartupGraph::AnyThread,    { 6, -1 } },
+		{ "LoadSkullGeometry",     30, StartupGraph::AnyThread,    { -1 } },
+		{ "CreateSkullBuffers",     1, StartupGraph::OwningThread, { 9, -1 } },
+		{ "BuildSkullPickMesh",     8, StartupGraph::AnyThread,    { 9, -1 } },
+		{ "RegisterResources",      1, StartupGraph::OwningThread, { 4, 5, 7, 10 } }
+	};
+}
+
+// Time to first frame: the steps one after another, as Init ran them before, against
+// the graph.
+BENCH(StartupGraph, ShadersBasicsInit)
+{
+	const size_t count = sizeof(ShadersInit)/sizeof(ShadersInit[0]);
+
+	double sequential = Test::Now();
+	for (size_t i = 0; i < count; ++i)
+		Sleep(ShadersInit[i].Milliseconds);
+	sequential = (Test::Now() - sequential)*1000.0;
+
+	JobSystem jobs(3);
+	StartupGraph graph;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const InitStep& step = ShadersInit[i];
+		StartupGraph::StepId id = graph.Add(step.Name, [&step]() { Sleep(step.Milliseconds); }, step.Where);
+		for (int k = 0; k < 4 && step.Dependencies[k] >= 0; ++k)
+			graph.DependsOn(id, step.Dependencies[k]);
+	}
+
+	std::vector<double> wall;
+	for (int run = 0; run < 5; ++run)
+	{
+		graph.Run(jobs);
+		wall.push_back(graph.WallMilliseconds());
+	}
+
+	std::vector<StartupGraph::StepId> path = graph.CriticalPath();
+	std::string names;
+	for (size_t i = 0; i < path.size(); ++i)
+		names += (i > 0 ? " > " : "") + std::string(graph.Steps()[path[i]].Name);
+
+	printf("  sequential %.1f ms, graph %.1f ms (median of 5, %u threads)\n",
+		sequential, Test::Percentile(wall, 50.0), jobs.ThreadCount());
+	printf("  critical path %.1f ms: %s\n", graph.CriticalPathMilliseconds(), names.c_str());
+}
+#pragma endregion
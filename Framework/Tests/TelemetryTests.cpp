@@ -0,0 +1,205 @@
+//***************************************************************************************
+// TelemetryTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "Telemetry.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	// The events of the capture from first on with the given name.
+	std::vector<Telemetry::Event> Find(size_t first, const char* name)
+	{
+		std::vector<Telemetry::Event> found;
+		const std::vector<Telemetry::Event>& capture = Telemetry::Capture();
+		for (size_t i = first; i < capture.size(); ++i)
+		{
+			if (strcmp(capture[i].Name, name) == 0)
+				found.push_back(capture[i]);
+		}
+		return found;
+	}
+}
+
+#pragma region Tests
+// Frame times from 0.1 to 100 ms: every percentile is the upper bound of its bucket,
+// so at most 1/8th above the exact value and never below it.
+TEST(Telemetry, HistogramPercentiles)
+{
+	Telemetry::FrameHistogram histogram;
+	CHECK(histogram.Percentile(50.0) == 0.0);
+
+	for (uint64_t i = 1; i <= 1000; ++i)
+		histogram.Add(i*100000);
+	CHECK(histogram.Count() == 1000);
+
+	const double percentiles[] = { 1.0, 50.0, 95.0, 99.0, 100.0 };
+	for (int i = 0; i < 5; ++i)
+	{
+		double exact = percentiles[i];
+		double p = histogram.Percentile(percentiles[i]);
+		if (!(p >= exact && p <= exact*1.125))
+			printf("  p%g: %g ms\n", percentiles[i], p);
+		CHECK(p >= exact && p <= exact*1.125);
+	}
+
+	// Below 8 us every microsecond has a bucket; far above the top everything lands
+	// in the last one, which ends at 2^34 us.
+	Telemetry::FrameHistogram small;
+	small.Add(3000);
+	CHECK(small.Percentile(50.0) == 0.004);
+	small.Clear();
+	CHECK(small.Count() == 0);
+	small.Add((uint64_t)1 << 62);
+	CHECK(small.Percentile(50.0) == (double)((uint64_t)1 << 34)/1000.0);
+}
+
+TEST(Telemetry, RingDropsWhenFull)
+{
+	Telemetry::EventRing ring(7);
+	for (uint32_t i = 0; i < Telemetry::EventRing::Capacity + 5; ++i)
+		ring.Push("event", i, i + 1);
+	CHECK(ring.Dropped() == 5);
+
+	std::vector<Telemetry::Event> events;
+	ring.Drain(events);
+	REQUIRE(events.size() == Telemetry::EventRing::Capacity);
+	CHECK(events[0].Begin == 0 && events.back().Begin == Telemetry::EventRing::Capacity - 1);
+	CHECK(events[3].Thread == 7);
+
+	// Drained, the ring takes events again, across the wrap.
+	ring.Push("again", 1, 2);
+	events.clear();
+	ring.Drain(events);
+	CHECK(events.size() == 1 && strcmp(events[0].Name, "again") == 0);
+	CHECK(ring.Dropped() == 5);
+}
+
+// Nested timers lie inside the timer they ran in; another thread's land in the
+// capture under a thread of their own at the next EndFrame.
+TEST(Telemetry, TimersNestAcrossThreads)
+{
+	Telemetry::EndFrame();
+	size_t first = Telemetry::Capture().size();
+
+	{
+		TELEMETRY_SCOPE("Test.Outer");
+		{
+			TELEMETRY_SCOPE("Test.Inner");
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	}
+	std::thread worker([]() { TELEMETRY_SCOPE("Test.Worker"); });
+	worker.join();
+
+	CHECK(Find(first, "Test.Outer").empty());
+	Telemetry::EndFrame();
+
+	std::vector<Telemetry::Event> outer = Find(first, "Test.Outer");
+	std::vector<Telemetry::Event> inner = Find(first, "Test.Inner");
+	std::vector<Telemetry::Event> work = Find(first, "Test.Worker");
+	REQUIRE(outer.size() == 1 && inner.size() == 1 && work.size() == 1);
+
+	CHECK(outer[0].Begin <= inner[0].Begin && inner[0].End <= outer[0].End);
+	CHECK(outer[0].Thread == inner[0].Thread);
+	CHECK(work[0].Thread != outer[0].Thread);
+
+	double ns = Telemetry::TicksToNanoseconds(inner[0].End) - Telemetry::TicksToNanoseconds(inner[0].Begin);
+	CHECK(ns >= 150000.0 && ns < 100000000.0);
+}
+
+// Events past the capture limit are counted as dropped, not kept.
+TEST(Telemetry, CaptureLimit)
+{
+	Telemetry::EndFrame();
+	size_t first = Telemetry::Capture().size();
+	size_t dropped = Telemetry::DroppedEvents();
+
+	Telemetry::SetCaptureLimit(first + 2);
+	for (int i = 0; i < 5; ++i)
+		TELEMETRY_SCOPE("Test.Limited");
+	Telemetry::EndFrame();
+
+	CHECK(Telemetry::Capture().size() == first + 2);
+	CHECK(Telemetry::DroppedEvents() == dropped + 3);
+
+	Telemetry::SetCaptureLimit(1 << 18);
+}
+
+TEST(Telemetry, ChromeTrace)
+{
+	{
+		TELEMETRY_SCOPE("Test.Traced");
+	}
+	Telemetry::EndFrame();
+	Telemetry::EndFrame();
+
+	REQUIRE(Telemetry::WriteChromeTrace("telemetry_test_trace.json"));
+	std::ifstream fin("telemetry_test_trace.json");
+	std::stringstream text;
+	text << fin.rdbuf();
+	std::string json = text.str();
+
+	CHECK(json.compare(0, 16, "{\"traceEvents\":[") == 0);
+	CHECK(json.find("{\"name\":\"Test.Traced\",\"ph\":\"X\",\"pid\":1,\"tid\":") != std::string::npos);
+	CHECK(json.find("{\"name\":\"Frame\",\"ph\":\"i\"") != std::string::npos);
+	CHECK(json.find("],\"displayTimeUnit\":\"ms\"}") != std::string::npos);
+	CHECK(json.find(",\n]") == std::string::npos);
+
+	CHECK(!Telemetry::WriteChromeTrace("no/such/directory/trace.json"));
+
+	std::string summary = Telemetry::Summary();
+	CHECK(summary.find(" frames, p50 ") != std::string::npos);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+// The cost of one probe (two counter reads and a ring push), 1000 per frame, against
+// reading the steady clock once.
+BENCH(Telemetry, ProbeOverhead)
+{
+	const int frames = 2000;
+	const int probes = 1000;
+
+	Telemetry::EndFrame();
+	size_t limit = Telemetry::Capture().size();
+	Telemetry::SetCaptureLimit(limit);
+
+	std::vector<double> perProbe;
+	for (int f = 0; f < frames; ++f)
+	{
+		double begin = Test::Now();
+		for (int i = 0; i < probes; ++i)
+		{
+			TELEMETRY_SCOPE("probe");
+		}
+		perProbe.push_back((Test::Now() - begin)*1e9 / probes);
+		Telemetry::EndFrame();
+	}
+
+	double clock = Test::MedianMs(9, []()
+	{
+		volatile long long sink = 0;
+		for (int i = 0; i < 100000; ++i)
+			sink = sink + std::chrono::steady_clock::now().time_since_epoch().count();
+	}) * 1e6 / 100000;
+	double ticks = Test::MedianMs(9, []()
+	{
+		volatile uint64_t sink = 0;
+		for (int i = 0; i < 100000; ++i)
+			sink = sink + Telemetry::Ticks();
+	}) * 1e6 / 100000;
+
+	printf("  per probe: p50 %.1f ns, p99 %.1f ns; Ticks() %.1f ns, steady_clock %.1f ns\n",
+		Test::Percentile(perProbe, 50.0), Test::Percentile(perProbe, 99.0), ticks, clock);
+
+	Telemetry::SetCaptureLimit(1 << 18);
+}
+#pragma endregion
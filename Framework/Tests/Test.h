@@ -0,0 +1,79 @@
+//***************************************************************************************
+// Test.h
+//
+// What the Framework tests and benchmarks share. TEST(Suite, Name) defines a test and
+// BENCH(Suite, Name) a benchmark; both register themselves with the runner in
+// TestMain.cpp. CHECK records a failure and carries on, REQUIRE also leaves the test.
+//
+// FrameworkTests runs the tests of the suites named on its command line, or of every
+// suite; with --bench it runs their benchmarks instead, which print what they
+// measured.
+//***************************************************************************************
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace Test
+{
+	typedef void (*Function)();
+
+	struct Registrar
+	{
+		Registrar(const char* suite, const char* name, Function function, bool bench);
+	};
+
+	void Fail(const char* file, int line, const char* expression);
+
+	// Seconds on the steady clock.
+	inline double Now()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// The median of runs timings of f, in milliseconds.
+	template<class F>
+	double MedianMs(unsigned int runs, F f)
+	{
+		std::vector<double> times(runs);
+		for (unsigned int i = 0; i < runs; ++i)
+		{
+			double start = Now();
+			f();
+			times[i] = (Now() - start)*1000.0;
+		}
+
+		std::sort(times.begin(), times.end());
+		return times[runs / 2];
+	}
+
+	// The p-th percentile (0..100) of a set of samples; sorts them.
+	inline double Percentile(std::vector<double>& samples, double p)
+	{
+		if (samples.empty())
+			return 0.0;
+
+		std::sort(samples.begin(), samples.end());
+		size_t i = (size_t)(p / 100.0*(samples.size() - 1) + 0.5);
+		return samples[i];
+	}
+}
+
+#define TEST_DEFINE(suite, name, bench) \
+	static void suite##_##name(); \
+	static Test::Registrar suite##_##name##_registrar(#suite, #name, suite##_##name, bench); \
+	static void suite##_##name()
+
+#define TEST(suite, name)  TEST_DEFINE(suite, name, false)
+#define BENCH(suite, name) TEST_DEFINE(suite, name##Bench, true)
+
+#define CHECK(expression) \
+	do { if (!(expression)) Test::Fail(__FILE__, __LINE__, #expression); } while (0)
+
+#define REQUIRE(expression) \
+	do { if (!(expression)) { Test::Fail(__FILE__, __LINE__, #expression); return; } } while (0)
+
+#endif // TEST_H
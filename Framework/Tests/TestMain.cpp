@@ -0,0 +1,77 @@
+//***************************************************************************************
+// TestMain.cpp
+//***************************************************************************************
+
+#include "Test.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace
+{
+	struct Case
+	{
+		const char* Suite;
+		const char* Name;
+		Test::Function Function;
+		bool Bench;
+	};
+
+	// Function-local, so registrars in other files may run first.
+	std::vector<Case>& Cases()
+	{
+		static std::vector<Case> cases;
+		return cases;
+	}
+
+	unsigned int gFailures = 0;
+}
+
+Test::Registrar::Registrar(const char* suite, const char* name, Function function, bool bench)
+{
+	Case c = { suite, name, function, bench };
+	Cases().push_back(c);
+}
+
+void Test::Fail(const char* file, int line, const char* expression)
+{
+	printf("  %s(%d): failed: %s\n", file, line, expression);
+	++gFailures;
+}
+
+int main(int argc, char* argv[])
+{
+	bool bench = false;
+	std::vector<std::string> suites;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--bench") == 0)
+			bench = true;
+		else
+			suites.push_back(argv[i]);
+	}
+
+	unsigned int ran = 0;
+	unsigned int failed = 0;
+	for (size_t i = 0; i < Cases().size(); ++i)
+	{
+		const Case& c = Cases()[i];
+		if (c.Bench != bench)
+			continue;
+		if (!suites.empty() && std::find(suites.begin(), suites.end(), c.Suite) == suites.end())
+			continue;
+
+		printf("%s.%s\n", c.Suite, c.Name);
+		fflush(stdout);
+
+		unsigned int before = gFailures;
+		c.Function();
+		++ran;
+		if (gFailures != before)
+			++failed;
+	}
+
+	printf("%u ran, %u failed\n", ran, failed);
+	return ran == 0 || failed != 0 ? 1 : 0;
+}
@@ -0,0 +1,346 @@
+//***************************************************************************************
+// TransformHierarchyTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "TransformHierarchy.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// A rotation about y, a uniform scale near 1 and a translation, as the demos'
+	// objects have.
+	void RandomLocal(std::minstd_rand& random, float m[16])
+	{
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		float angle = 3.0f*unit(random);
+		float scale = 1.0f + 0.1f*unit(random);
+		float c = cosf(angle)*scale;
+		float s = sinf(angle)*scale;
+		float local[16] = { c, 0.0f, -s, 0.0f, 0.0f, scale, 0.0f, 0.0f, s, 0.0f, c, 0.0f,
+			5.0f*unit(random), 5.0f*unit(random), 5.0f*unit(random), 1.0f };
+		std::copy(local, local + 16, m);
+	}
+
+	// A forest of random trees, as they were added: parents come before their
+	// children, about half of them among the last few nodes, so that some branches
+	// run deep.
+	struct Forest
+	{
+		std::vector<uint32_t> Parents;
+		std::vector<float> Locals;
+		std::vector<TransformHierarchy::Node> Nodes;
+	};
+
+	Forest MakeForest(TransformHierarchy& hierarchy, size_t count, size_t trees, unsigned int seed)
+	{
+		std::minstd_rand random(seed);
+		Forest forest;
+		forest.Parents.resize(count);
+		forest.Locals.resize(count*16);
+		forest.Nodes.resize(count);
+
+		size_t perTree = count/trees;
+		for (size_t i = 0; i < count; ++i)
+		{
+			size_t first = i/perTree*perTree;
+			uint32_t parent = TransformHierarchy::None;
+			if (i != first)
+			{
+				parent = (uint32_t)(first + random() % (i - first));
+				if (i - first > 8 && random() % 2)
+					parent = (uint32_t)(i - 1 - random() % 8);
+			}
+			forest.Parents[i] = parent;
+			RandomLocal(random, &forest.Locals[i*16]);
+			forest.Nodes[i] = hierarchy.Add(parent == TransformHierarchy::None ? TransformHierarchy::None : forest.Nodes[parent],
+				&forest.Locals[i*16]);
+		}
+		return forest;
+	}
+
+	// The naive recompute, in double: every node's local times its parent's world, in
+	// the order the nodes were added.
+	std::vector<double> NaiveWorlds(const Forest& forest)
+	{
+		size_t count = forest.Parents.size();
+		std::vector<double> worlds(count*16);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const float* local = &forest.Locals[i*16];
+			double* world = &worlds[i*16];
+			if (forest.Parents[i] == TransformHierarchy::None)
+			{
+				std::copy(local, local + 16, world);
+				continue;
+			}
+
+			const double* parent = &worlds[forest.Parents[i]*16];
+			for (int r = 0; r < 4; ++r)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					double sum = 0.0;
+					for (int k = 0; k < 4; ++k)
+						sum += local[r*4 + k]*parent[k*4 + c];
+					world[r*4 + c] = sum;
+				}
+			}
+		}
+		return worlds;
+	}
+
+	// The largest error of the hierarchy's worlds, relative to the naive ones.
+	double WorldError(const TransformHierarchy& hierarchy, const Forest& forest)
+	{
+		std::vector<double> expected = NaiveWorlds(forest);
+		double error = 0.0;
+		for (size_t i = 0; i < forest.Nodes.size(); ++i)
+		{
+			const float* world = hierarchy.World(forest.Nodes[i]);
+			for (int k = 0; k < 16; ++k)
+				error = std::max(error, fabs(world[k] - expected[i*16 + k])/(1.0 + fabs(expected[i*16 + k])));
+		}
+		return error;
+	}
+
+	// How far the upper 3x3 of the world times the transpose of the inverse-transpose
+	// is from identity.
+	double InverseTransposeError(const TransformHierarchy& hierarchy, TransformHierarchy::Node node)
+	{
+		const float* world = hierarchy.World(node);
+		const float* invTranspose = hierarchy.WorldInvTranspose(node);
+		double error = 0.0;
+		for (int a = 0; a < 3; ++a)
+		{
+			for (int b = 0; b < 3; ++b)
+			{
+				double sum = 0.0;
+				for (int k = 0; k < 3; ++k)
+					sum += world[a*4 + k]*invTranspose[b*4 + k];
+				error = std::max(error, fabs(sum - (a == b ? 1.0 : 0.0)));
+			}
+		}
+		return error;
+	}
+
+	// Nodes in the subtree of node, itself included.
+	size_t SubtreeSize(const Forest& forest, uint32_t node)
+	{
+		size_t size = 0;
+		for (size_t i = 0; i < forest.Parents.size(); ++i)
+		{
+			uint32_t j = (uint32_t)i;
+			while (j != TransformHierarchy::None && j != node)
+				j = forest.Parents[j];
+			size += j == node;
+		}
+		return size;
+	}
+}
+
+#pragma region Tests
+TEST(TransformHierarchy, ChainComposes)
+{
+	const float spin[16] = { 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+	const float offset[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 3.0f, 0.0f, 0.0f, 1.0f };
+	const float scale[16] = { 2.0f, 0.0f, 0.0f, 0.0f, 0.0f, 2.0f, 0.0f, 0.0f, 0.0f, 0.0f, 2.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f };
+
+	TransformHierarchy hierarchy;
+	TransformHierarchy::Node orbit = hierarchy.Add(TransformHierarchy::None, spin);
+	TransformHierarchy::Node arm = hierarchy.Add(orbit, offset);
+	TransformHierarchy::Node skull = hierarchy.Add(arm, scale);
+	hierarchy.Update();
+	CHECK(hierarchy.Size() == 3 && hierarchy.ChangedCount() == 3);
+	CHECK(hierarchy.Parent(skull) == arm && hierarchy.Parent(orbit) == TransformHierarchy::None);
+
+	// The offset (3, 0, 0) turned a quarter about y ends up at (0, 0, -3), and the
+	// skull's own (0, 1, 0) is added after its scale.
+	const float* world = hierarchy.World(skull);
+	CHECK(world[0] == 0.0f && world[2] == -2.0f && world[8] == 2.0f && world[5] == 2.0f);
+	CHECK(world[12] == 0.0f && world[13] == 1.0f && world[14] == -3.0f);
+
+	// Normals undo the scale.
+	CHECK(InverseTransposeError(hierarchy, skull) < 1e-6);
+	CHECK(fabsf(hierarchy.WorldInvTranspose(skull)[5] - 0.5f) < 1e-6f);
+
+	const float* worlds = hierarchy.Worlds();
+	CHECK(worlds + 16*hierarchy.IndexOf(skull) == world);
+}
+
+// Setting a leaf recomputes it alone, setting a root its whole tree, and an update
+// with nothing set recomputes nothing.
+TEST(TransformHierarchy, OnlyDirtySubtreesRecompute)
+{
+	TransformHierarchy hierarchy;
+	Forest forest = MakeForest(hierarchy, 20000, 4, 5);
+	hierarchy.Update();
+	CHECK(hierarchy.ChangedCount() == 20000);
+
+	hierarchy.Update();
+	CHECK(hierarchy.ChangedCount() == 0);
+
+	std::minstd_rand random(6);
+	uint32_t leaf = 19999;
+	RandomLocal(random, &forest.Locals[leaf*16]);
+	hierarchy.SetLocal(forest.Nodes[leaf], &forest.Locals[leaf*16]);
+	hierarchy.Update();
+	CHECK(hierarchy.ChangedCount() == 1 && hierarchy.Changed(forest.Nodes[leaf]));
+	CHECK(!hierarchy.Changed(forest.Nodes[0]));
+
+	uint32_t inner = 5000 + 37;
+	RandomLocal(random, &forest.Locals[inner*16]);
+	hierarchy.SetLocal(forest.Nodes[inner], &forest.Locals[inner*16]);
+	hierarchy.Update();
+	CHECK(hierarchy.ChangedCount() == SubtreeSize(forest, inner));
+
+	RandomLocal(random, &forest.Locals[0]);
+	hierarchy.SetLocal(forest.Nodes[0], &forest.Locals[0]);
+	hierarchy.Update();
+	CHECK(hierarchy.ChangedCount() == 5000);
+	CHECK(WorldError(hierarchy, forest) < 1e-5);
+}
+
+// Trees larger than Grain split into runs; serial and on jobs, frame after frame of
+// changed locals, the worlds are those of the naive recompute.
+TEST(TransformHierarchy, MatchesNaiveRecompute)
+{
+	JobSystem jobs(3);
+	for (int threaded = 0; threaded < 2; ++threaded)
+	{
+		TransformHierarchy hierarchy;
+		Forest forest = MakeForest(hierarchy, 30000, 3, 7);
+		hierarchy.Update(threaded ? &jobs : 0);
+		CHECK(WorldError(hierarchy, forest) < 1e-5);
+
+		std::minstd_rand random(8);
+		for (int frame = 0; frame < 10; ++frame)
+		{
+			for (size_t i = frame; i < forest.Nodes.size(); i += 97)
+			{
+				RandomLocal(random, &forest.Locals[i*16]);
+				hierarchy.SetLocal(forest.Nodes[i], &forest.Locals[i*16]);
+			}
+			hierarchy.Update(threaded ? &jobs : 0);
+		}
+		CHECK(WorldError(hierarchy, forest) < 1e-5);
+
+		double invTranspose = 0.0;
+		for (size_t i = 0; i < forest.Nodes.size(); i += 13)
+			invTranspose = std::max(invTranspose, InverseTransposeError(hierarchy, forest.Nodes[i]));
+		CHECK(invTranspose < 1e-5);
+	}
+}
+
+// Nodes added after an update keep the handles of those before, and lay the
+// hierarchy out again on the next one.
+TEST(TransformHierarchy, AddAfterUpdate)
+{
+	TransformHierarchy hierarchy;
+	Forest forest = MakeForest(hierarchy, 1000, 10, 9);
+	hierarchy.Update();
+
+	std::minstd_rand random(10);
+	for (size_t i = 0; i < 100; ++i)
+	{
+		uint32_t parent = (uint32_t)(random() % forest.Nodes.size());
+		forest.Parents.push_back(parent);
+		forest.Locals.resize(forest.Locals.size() + 16);
+		RandomLocal(random, &forest.Locals[forest.Locals.size() - 16]);
+		forest.Nodes.push_back(hierarchy.Add(forest.Nodes[parent], &forest.Locals[forest.Locals.size() - 16]));
+	}
+	hierarchy.Update();
+
+	CHECK(hierarchy.Size() == 1100);
+	CHECK(WorldError(hierarchy, forest) < 1e-5);
+	size_t wrongParents = 0;
+	for (size_t i = 1000; i < 1100; ++i)
+		wrongParents += hierarchy.Parent(forest.Nodes[i]) != forest.Nodes[forest.Parents[i]];
+	CHECK(wrongParents == 0);
+}
+#pragma endregion
+
+#pragma region Benchmarks
+// 100k nodes in 500 trees, serial and on jobs: every node dirty, 10% of the locals
+// set, and nothing set, against the naive recompute of every world in float.
+BENCH(TransformHierarchy, Propagate100k)
+{
+	JobSystem jobs;
+	TransformHierarchy hierarchy;
+	Forest forest = MakeForest(hierarchy, 100000, 500, 3);
+	size_t perTree = forest.Nodes.size()/500;
+
+	double start = Test::Now();
+	hierarchy.Update();
+	double layout = (Test::Now() - start)*1000.0;
+
+	std::minstd_rand random(4);
+	const int frames = 100;
+	const char* names[] = { "all dirty", "10% set  ", "static   " };
+	for (int mode = 0; mode < 3; ++mode)
+	{
+		for (int threaded = 0; threaded < 2; ++threaded)
+		{
+			double ms = 0.0;
+			size_t changed = 0;
+			for (int frame = 0; frame < frames; ++frame)
+			{
+				if (mode == 0)
+				{
+					for (size_t i = 0; i < forest.Nodes.size(); i += perTree)
+						hierarchy.SetLocal(forest.Nodes[i], &forest.Locals[i*16]);
+				}
+				else if (mode == 1)
+				{
+					for (size_t i = frame % 10; i < forest.Nodes.size(); i += 10)
+					{
+						RandomLocal(random, &forest.Locals[i*16]);
+						hierarchy.SetLocal(forest.Nodes[i], &forest.Locals[i*16]);
+					}
+				}
+
+				start = Test::Now();
+				hierarchy.Update(threaded ? &jobs : 0);
+				ms += (Test::Now() - start)*1000.0;
+				changed += hierarchy.ChangedCount();
+			}
+			printf("  %s %s: %.3f ms a frame, %zu nodes recomputed\n",
+				names[mode], threaded ? "jobs  " : "serial", ms/frames, changed/frames);
+		}
+	}
+
+	std::vector<float> worlds(forest.Nodes.size()*16);
+	double naive = Test::MedianMs(5, [&forest, &worlds]()
+	{
+		for (size_t i = 0; i < forest.Nodes.size(); ++i)
+		{
+			const float* local = &forest.Locals[i*16];
+			float* world = &worlds[i*16];
+			if (forest.Parents[i] == TransformHierarchy::None)
+			{
+				std::copy(local, local + 16, world);
+				continue;
+			}
+
+			const float* parent = &worlds[forest.Parents[i]*16];
+			for (int r = 0; r < 4; ++r)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					world[r*4 + c] = local[r*4]*parent[c] + local[r*4 + 1]*parent[4 + c] +
+						local[r*4 + 2]*parent[8 + c] + local[r*4 + 3]*parent[12 + c];
+				}
+			}
+		}
+	});
+
+	printf("  first update and layout %.2f ms; naive recompute of every world %.3f ms; %u threads; max error %.2g\n",
+		layout, naive, jobs.ThreadCount(), WorldError(hierarchy, forest));
+}
+#pragma endregion
@@ -0,0 +1,444 @@
+//***************************************************************************************
+// TriangleBvhTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "TriangleBvh.h"
+#include "JobSystem.h"
+#include "MeshBuilder.h"
+#include "TextModel.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+	struct Mesh
+	{
+		std::vector<float> Positions;
+		std::vector<uint32_t> Indices;
+
+		size_t TriangleCount()const { return Indices.size()/3; }
+
+		void Build(TriangleBvh& bvh, JobSystem* jobs = 0)const
+		{
+			bvh.Build(&Positions[0], 3*sizeof(float), Positions.size()/3, &Indices[0], TriangleCount(), jobs);
+		}
+	};
+
+	// A sphere from MeshBuilder and a soup of small random triangles around it.
+	Mesh TestMesh(unsigned int soup)
+	{
+		Mesh mesh;
+		MeshBuilder::Counts counts = MeshBuilder::SphereCounts(40, 40);
+		std::vector<MeshBuilder::Attributes> vertices(counts.Vertices);
+		mesh.Indices.resize(counts.Indices);
+		MeshBuilder::CreateSphere(4.0f, 40, 40, &vertices[0], &mesh.Indices[0],
+			[](MeshBuilder::Attributes& out, const MeshBuilder::Attributes& in) { out = in; });
+		for (size_t i = 0; i < vertices.size(); ++i)
+			mesh.Positions.insert(mesh.Positions.end(), vertices[i].Position, vertices[i].Position + 3);
+
+		std::minstd_rand random(3);
+		std::uniform_real_distribution<float> place(-20.0f, 20.0f);
+		std::uniform_real_distribution<float> offset(-1.5f, 1.5f);
+		for (unsigned int t = 0; t < soup; ++t)
+		{
+			float center[3] = { place(random), place(random), place(random) };
+			for (int k = 0; k < 3; ++k)
+			{
+				mesh.Indices.push_back((uint32_t)(mesh.Positions.size()/3));
+				for (int a = 0; a < 3; ++a)
+					mesh.Positions.push_back(center[a] + offset(random));
+			}
+		}
+		return mesh;
+	}
+
+	// Lighting_Advanced's terrain: an n x n grid with rolling hills.
+	Mesh HillGrid(unsigned int n, JobSystem* jobs)
+	{
+		struct Position
+		{
+			float P[3];
+		};
+
+		MeshBuilder::Counts counts = MeshBuilder::GridCounts(n, n);
+		std::vector<Position> vertices(counts.Vertices);
+		Mesh mesh;
+		mesh.Indices.resize(counts.Indices);
+		MeshBuilder::CreateGrid(1000.0f, 1000.0f, n, n, &vertices[0], &mesh.Indices[0],
+			[](Position& v, const MeshBuilder::Attributes& a)
+			{
+				v.P[0] = a.Position[0];
+				v.P[1] = 5.0f*sinf(a.Position[0]*0.05f)*cosf(a.Position[2]*0.05f);
+				v.P[2] = a.Position[2];
+			}, jobs);
+		mesh.Positions.resize(3*vertices.size());
+		memcpy(&mesh.Positions[0], &vertices[0], mesh.Positions.size()*sizeof(float));
+		return mesh;
+	}
+
+	// Every triangle, two-sided, closest hit in (0, MaxT).
+	bool BruteForce(const Mesh& mesh, const BvhRay& ray, BvhHit& hit)
+	{
+		bool found = false;
+		float best = ray.MaxT;
+		const float* d = ray.Direction;
+		const float* o = ray.Origin;
+
+		for (size_t t = 0; t < mesh.TriangleCount(); ++t)
+		{
+			const float* a = &mesh.Positions[3*mesh.Indices[3*t]];
+			const float* b = &mesh.Positions[3*mesh.Indices[3*t + 1]];
+			const float* c = &mesh.Positions[3*mesh.Indices[3*t + 2]];
+			float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+			float p[3] = { d[1]*e2[2] - d[2]*e2[1], d[2]*e2[0] - d[0]*e2[2], d[0]*e2[1] - d[1]*e2[0] };
+			float det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+			if (fabsf(det) < 1e-20f)
+				continue;
+
+			float inv = 1.0f/det;
+			float s[3] = { o[0] - a[0], o[1] - a[1], o[2] - a[2] };
+			float u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2])*inv;
+			if (u < 0.0f || u > 1.0f)
+				continue;
+
+			float q[3] = { s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0] };
+			float v = (d[0]*q[0] + d[1]*q[1] + d[2]*q[2])*inv;
+			if (v < 0.0f || u + v > 1.0f)
+				continue;
+
+			float hitT = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2])*inv;
+			if (hitT > 0.0f && hitT < best)
+			{
+				best = hitT;
+				hit.T = hitT;
+				hit.U = u;
+				hit.V = v;
+				hit.Triangle = (uint32_t)t;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	// Agree on whether there is a hit and where; triangles may differ only where two
+	// meet at the same distance.
+	bool SameHit(bool foundA, const BvhHit& a, bool foundB, const BvhHit& b)
+	{
+		if (foundA != foundB)
+			return false;
+		if (!foundA)
+			return true;
+		if (fabsf(a.T - b.T) > 1e-4f*b.T)
+			return false;
+		return a.Triangle == b.Triangle || fabsf(a.T - b.T) <= 1e-5f*b.T;
+	}
+
+	std::vector<BvhRay> RandomRays(size_t count, float radius, unsigned int seed)
+	{
+		std::minstd_rand random(seed);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> target(-12.0f, 12.0f);
+
+		std::vector<BvhRay> rays(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			BvhRay& ray = rays[i];
+			for (int a = 0; a < 3; ++a)
+			{
+				ray.Origin[a] = radius*unit(random);
+				ray.Direction[a] = target(random) - ray.Origin[a];
+			}
+			ray.MaxT = i % 5 == 0 ? 0.5f : 1e30f;
+		}
+		return rays;
+	}
+
+	// 2x2 blocks of pixels stored one after the other, as Intersect4 wants them.
+	std::vector<BvhRay> CameraRays(int width, int height, const float eye[3], const float target[3], float fovY)
+	{
+		float f[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+		float length = sqrtf(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+		for (int a = 0; a < 3; ++a)
+			f[a] /= length;
+		float r[3] = { f[2], 0.0f, -f[0] };
+		length = sqrtf(r[0]*r[0] + r[2]*r[2]);
+		r[0] /= length;
+		r[2] /= length;
+		float u[3] = { f[1]*r[2] - f[2]*r[1], f[2]*r[0] - f[0]*r[2], f[0]*r[1] - f[1]*r[0] };
+
+		float s = tanf(0.5f*fovY);
+		std::vector<BvhRay> rays(width*height);
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				BvhRay& ray = rays[((y/2)*(width/2) + x/2)*4 + (y & 1)*2 + (x & 1)];
+				float px = (2.0f*(x + 0.5f)/width - 1.0f)*s;
+				float py = (1.0f - 2.0f*(y + 0.5f)/height)*s;
+				for (int a = 0; a < 3; ++a)
+				{
+					ray.Origin[a] = eye[a];
+					ray.Direction[a] = f[a] + px*r[a] + py*u[a];
+				}
+				ray.MaxT = 1e30f;
+			}
+		}
+		return rays;
+	}
+
+	void Translation(float x, float y, float z, float scale, float m[16])
+	{
+		memset(m, 0, 16*sizeof(float));
+		m[0] = m[5] = m[10] = scale;
+		m[12] = x;
+		m[13] = y;
+		m[14] = z;
+		m[15] = 1.0f;
+	}
+}
+
+#pragma region Tests
+TEST(TriangleBvh, MatchesBruteForce)
+{
+	Mesh mesh = TestMesh(3000);
+	TriangleBvh bvh;
+	mesh.Build(bvh);
+	CHECK(bvh.TriangleCount() == mesh.TriangleCount());
+
+	std::vector<BvhRay> rays = RandomRays(2000, 30.0f, 1);
+	size_t hits = 0;
+	size_t wrong = 0;
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		BvhHit a, b;
+		bool foundA = bvh.Intersect(rays[i], a);
+		bool foundB = BruteForce(mesh, rays[i], b);
+		hits += foundB;
+		if (!SameHit(foundA, a, foundB, b))
+			++wrong;
+		else if (foundA && a.Triangle == b.Triangle && (fabsf(a.U - b.U) > 1e-3f || fabsf(a.V - b.V) > 1e-3f))
+			++wrong;
+	}
+	CHECK(wrong == 0);
+	CHECK(hits > 500 && hits < rays.size());
+}
+
+TEST(TriangleBvh, PacketsMatchSingleRays)
+{
+	Mesh mesh = TestMesh(3000);
+	TriangleBvh bvh;
+	mesh.Build(bvh);
+
+	const float eye[3] = { 0.0f, 5.0f, -40.0f };
+	const float target[3] = { 0.0f, 0.0f, 0.0f };
+	std::vector<BvhRay> rays = CameraRays(64, 64, eye, target, 0.9f);
+	std::vector<BvhRay> incoherent = RandomRays(400, 30.0f, 2);
+	rays.insert(rays.end(), incoherent.begin(), incoherent.end());
+
+	size_t wrong = 0;
+	for (size_t i = 0; i < rays.size(); i += 4)
+	{
+		BvhHit packet[4];
+		unsigned int mask = bvh.Intersect4(&rays[i], packet);
+		for (int k = 0; k < 4; ++k)
+		{
+			BvhHit single;
+			bool found = bvh.Intersect(rays[i + k], single);
+			if (!SameHit((mask >> k & 1) != 0, packet[k], found, single))
+				++wrong;
+		}
+	}
+	CHECK(wrong == 0);
+}
+
+// Interior nodes hold their children, leaves cover every triangle once, and a build
+// on a job system finds the same hits.
+TEST(TriangleBvh, TreeIsWellFormed)
+{
+	Mesh mesh = HillGrid(200, 0);
+	TriangleBvh bvh;
+	mesh.Build(bvh);
+
+	const std::vector<TriangleBvh::Node>& nodes = bvh.Nodes();
+	std::vector<unsigned char> covered(bvh.TriangleCount(), 0);
+	size_t badBounds = 0;
+	size_t badLeaves = 0;
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		const TriangleBvh::Node& node = nodes[i];
+		if (node.Count > 0)
+		{
+			badLeaves += node.Count > TriangleBvh::MaxLeafSize || node.Offset + node.Count > covered.size();
+			for (uint32_t t = node.Offset; t < node.Offset + node.Count && t < covered.size(); ++t)
+				++covered[t];
+			continue;
+		}
+
+		const size_t children[2] = { i + 1, node.Offset };
+		for (int c = 0; c < 2; ++c)
+		{
+			if (children[c] >= nodes.size() || children[c] <= i)
+			{
+				++badBounds;
+				continue;
+			}
+			for (int a = 0; a < 3; ++a)
+				badBounds += nodes[children[c]].Min[a] < node.Min[a] || nodes[children[c]].Max[a] > node.Max[a];
+		}
+	}
+
+	size_t badCover = 0;
+	for (size_t t = 0; t < covered.size(); ++t)
+		badCover += covered[t] != 1;
+	CHECK(badBounds == 0 && badLeaves == 0 && badCover == 0);
+	CHECK(bvh.Depth() > 0 && bvh.Depth() <= TriangleBvh::MaxDepth);
+	CHECK(bvh.SahCost() > 0.0f);
+
+	JobSystem jobs(2);
+	TriangleBvh parallel;
+	mesh.Build(parallel, &jobs);
+	CHECK(parallel.TriangleCount() == bvh.TriangleCount());
+
+	const float eye[3] = { 0.0f, 60.0f, -400.0f };
+	const float target[3] = { 0.0f, 0.0f, 0.0f };
+	std::vector<BvhRay> rays = CameraRays(32, 32, eye, target, 0.9f);
+	size_t wrong = 0;
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		BvhHit a, b;
+		bool foundA = bvh.Intersect(rays[i], a);
+		bool foundB = parallel.Intersect(rays[i], b);
+		wrong += !SameHit(foundA, a, foundB, b);
+	}
+	CHECK(wrong == 0);
+}
+
+TEST(TriangleBvh, Empty)
+{
+	TriangleBvh bvh;
+	float position[3] = { 0.0f, 0.0f, 0.0f };
+	uint32_t index = 0;
+	bvh.Build(position, sizeof(position), 1, &index, 0);
+	CHECK(bvh.Empty() && bvh.SahCost() == 0.0f);
+
+	BvhRay ray = { { 0.0f, 0.0f, -1.0f }, { 0.0f, 0.0f, 1.0f }, 10.0f };
+	BvhHit hit;
+	CHECK(!bvh.Intersect(ray, hit));
+}
+
+// Instances of one mesh hit as their objects, with T in world space lengths, and
+// follow their world matrices without a rebuild.
+TEST(TriangleBvh, SceneInstances)
+{
+	Mesh mesh = TestMesh(0);
+	TriangleBvh bvh;
+	mesh.Build(bvh);
+
+	float world[16];
+	BvhScene scene;
+	Translation(50.0f, 0.0f, 0.0f, 1.0f, world);
+	size_t moved = scene.Add(&bvh, world, 7);
+	Translation(-50.0f, 0.0f, 0.0f, 2.0f, world);
+	scene.Add(&bvh, world, 9);
+	CHECK(scene.InstanceCount() == 2);
+
+	// The sphere has radius 4: the scaled one is hit 8 short of its center.
+	BvhRay ray = { { -50.0f, 0.0f, -100.0f }, { 0.0f, 0.0f, 2.0f }, 1e30f };
+	BvhHit hit;
+	REQUIRE(scene.Intersect(ray, hit));
+	CHECK(hit.Object == 9 && fabsf(hit.T - 46.0f) < 0.05f);
+
+	ray.Origin[0] = 50.0f;
+	REQUIRE(scene.Intersect(ray, hit));
+	CHECK(hit.Object == 7 && fabsf(hit.T - 48.0f) < 0.05f);
+
+	Translation(50.0f, 30.0f, 0.0f, 1.0f, world);
+	scene.SetWorld(moved, world);
+	CHECK(!scene.Intersect(ray, hit));
+
+	ray.Origin[1] = 30.0f;
+	ray.MaxT = 40.0f;
+	CHECK(!scene.Intersect(ray, hit));
+}
+#pragma endregion
+
+#pragma region Benchmarks
+namespace
+{
+	void Measure(const char* name, const Mesh& mesh, const float eye[3], const float target[3], JobSystem& jobs)
+	{
+		TriangleBvh bvh;
+		double serial = Test::MedianMs(3, [&]() { mesh.Build(bvh); });
+		double parallel = Test::MedianMs(3, [&]() { mesh.Build(bvh, &jobs); });
+
+		std::vector<BvhRay> rays = CameraRays(512, 512, eye, target, 0.9f);
+		std::vector<BvhHit> hits(rays.size());
+		size_t found = 0;
+		double single = Test::MedianMs(3, [&]()
+		{
+			found = 0;
+			for (size_t i = 0; i < rays.size(); ++i)
+				found += bvh.Intersect(rays[i], hits[i]);
+		});
+		double packets = Test::MedianMs(3, [&]()
+		{
+			for (size_t i = 0; i < rays.size(); i += 4)
+				bvh.Intersect4(&rays[i], &hits[i]);
+		});
+
+		// Brute force on a sample of the rays, and its cost per ray.
+		const size_t sample = mesh.TriangleCount() > 100000 ? 16 : 256;
+		size_t wrong = 0;
+		double start = Test::Now();
+		for (size_t i = 0; i < sample; ++i)
+		{
+			const BvhRay& ray = rays[i*(rays.size()/sample)];
+			BvhHit a, b;
+			bool foundA = bvh.Intersect(ray, a);
+			bool foundB = BruteForce(mesh, ray, b);
+			wrong += !SameHit(foundA, a, foundB, b);
+		}
+		double brute = (Test::Now() - start)/sample;
+
+		printf("  %s, %zu triangles: build %.1f ms serial, %.1f ms on %u threads; %zu nodes, depth %u, SAH %.1f\n",
+			name, mesh.TriangleCount(), serial, parallel, jobs.ThreadCount(), bvh.Nodes().size(), bvh.Depth(), bvh.SahCost());
+		printf("    %zu rays, %zu hit: %.2f Mrays/s single, %.2f Mrays/s in packets; brute force %.0f rays/s, %zu of %zu differ\n",
+			rays.size(), found, rays.size()/single*1e-3, rays.size()/packets*1e-3, 1.0/brute, wrong, sample);
+	}
+}
+
+// The skull of Shaders_Basics and Lighting_Advanced's 1000x1000 grid, 512x512 primary
+// rays each.
+BENCH(TriangleBvh, Picking)
+{
+	JobSystem jobs;
+
+	TextModel skull;
+	if (LoadTextModel(FRAMEWORK_SOURCE_DIR "/../04Shaders/Shaders_Basics/Models/skull.txt", jobs, skull))
+	{
+		Mesh mesh;
+		for (size_t i = 0; i < skull.Vertices.size(); ++i)
+			mesh.Positions.insert(mesh.Positions.end(), skull.Vertices[i].Position, skull.Vertices[i].Position + 3);
+		mesh.Indices = skull.Indices;
+
+		const float eye[3] = { 0.0f, 5.0f, -20.0f };
+		const float target[3] = { 0.0f, 1.0f, 0.0f };
+		Measure("skull", mesh, eye, target, jobs);
+	}
+	else
+	{
+		printf("  skull.txt not found\n");
+	}
+
+	const float eye[3] = { 0.0f, 60.0f, -400.0f };
+	const float target[3] = { 0.0f, 0.0f, 0.0f };
+	Measure("1000x1000 grid", HillGrid(1000, &jobs), eye, target, jobs);
+}
+#pragma endregion
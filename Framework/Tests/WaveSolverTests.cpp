@@ -0,0 +1,234 @@
+//***************************************************************************************
+// WaveSolverTests.cpp
+//***************************************************************************************
+
+#include "Test.h"
+#include "WaveSolver.h"
+#include "JobSystem.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	// Common's Waves::Update and its normals, on plain arrays: the solution it is
+	// stepping from is in curr, the previous one in prev.
+	struct Waves
+	{
+		Waves(unsigned int rows, unsigned int cols, float dx, float dt, float speed, float damping)
+			: Rows(rows), Cols(cols), Dx(dx), Prev(rows*cols, 0.0f), Curr(rows*cols, 0.0f),
+			NormalX(rows*cols, 0.0f), NormalY(rows*cols, 1.0f), NormalZ(rows*cols, 0.0f)
+		{
+			float d = damping*dt + 2.0f;
+			float e = (speed*speed)*(dt*dt)/(dx*dx);
+			K1 = (damping*dt - 4.0f)/d;
+			K2 = (4.0f - 8.0f*e)/d;
+			K3 = (2.0f*e)/d;
+		}
+
+		void Step()
+		{
+			for (unsigned int i = 1; i < Rows - 1; ++i)
+			{
+				for (unsigned int j = 1; j < Cols - 1; ++j)
+				{
+					Prev[i*Cols + j] = K1*Prev[i*Cols + j] + K2*Curr[i*Cols + j] +
+						K3*(Curr[(i + 1)*Cols + j] + Curr[(i - 1)*Cols + j] + Curr[i*Cols + j + 1] + Curr[i*Cols + j - 1]);
+				}
+			}
+			Prev.swap(Curr);
+		}
+
+		void ComputeNormals()
+		{
+			for (unsigned int i = 1; i < Rows - 1; ++i)
+			{
+				for (unsigned int j = 1; j < Cols - 1; ++j)
+				{
+					float l = Curr[i*Cols + j - 1];
+					float r = Curr[i*Cols + j + 1];
+					float t = Curr[(i - 1)*Cols + j];
+					float b = Curr[(i + 1)*Cols + j];
+					float nx = l - r, ny = 2.0f*Dx, nz = b - t;
+					float length = sqrtf(nx*nx + ny*ny + nz*nz);
+					NormalX[i*Cols + j] = nx / length;
+					NormalY[i*Cols + j] = ny / length;
+					NormalZ[i*Cols + j] = nz / length;
+				}
+			}
+		}
+
+		void Disturb(unsigned int i, unsigned int j, float magnitude)
+		{
+			Curr[i*Cols + j] += magnitude;
+			Curr[i*Cols + j + 1] += 0.5f*magnitude;
+			Curr[i*Cols + j - 1] += 0.5f*magnitude;
+			Curr[(i + 1)*Cols + j] += 0.5f*magnitude;
+			Curr[(i - 1)*Cols + j] += 0.5f*magnitude;
+		}
+
+		unsigned int Rows;
+		unsigned int Cols;
+		float Dx;
+		float K1, K2, K3;
+		std::vector<float> Prev;
+		std::vector<float> Curr;
+		std::vector<float> NormalX;
+		std::vector<float> NormalY;
+		std::vector<float> NormalZ;
+	};
+
+	// Vertices as the Lighting demo stages them: position, normal, then the caller's
+	// texture coordinates and baked color.
+	const size_t Stride = 12*sizeof(float);
+
+	const float* Vertex(const WaveSolver& solver, unsigned int i, unsigned int j)
+	{
+		return reinterpret_cast<const float*>(static_cast<const unsigned char*>(solver.FrontVertices()) +
+			((size_t)i*solver.ColumnCount() + j)*Stride);
+	}
+}
+
+#pragma region Tests
+// Uneven sizes, so rows end in a partial group of four cells, and enough rows for
+// several bands.
+TEST(WaveSolver, StepMatchesReference)
+{
+	JobSystem jobs(3);
+	const unsigned int rows = 130, cols = 131;
+	WaveSolver simd(rows, cols, 0.5f, 0.03f, 3.25f, 0.4f, Stride);
+	WaveSolver reference(rows, cols, 0.5f, 0.03f, 3.25f, 0.4f, Stride);
+
+	for (int step = 0; step < 200; ++step)
+	{
+		if (step % 10 == 0)
+		{
+			simd.Disturb(5 + step % 100, 7 + step % 90, 0.7f);
+			reference.Disturb(5 + step % 100, 7 + step % 90, 0.7f);
+		}
+		simd.Step(step % 2 ? &jobs : 0);
+		reference.StepReference();
+	}
+
+	float heights = 0.0f;
+	float vertices = 0.0f;
+	for (unsigned int i = 0; i < rows; ++i)
+	{
+		for (unsigned int j = 0; j < cols; ++j)
+		{
+			heights = std::max(heights, fabsf(simd.Height(i, j) - reference.Height(i, j)));
+			for (int k = 0; k < 6; ++k)
+				vertices = std::max(vertices, fabsf(Vertex(simd, i, j)[k] - Vertex(reference, i, j)[k]));
+		}
+	}
+	CHECK(heights < 1e-6f);
+	CHECK(vertices < 1e-6f);
+}
+
+// Heights against Common's Waves, and the staged normals against the ones Waves
+// computes for the solution the step started from.
+TEST(WaveSolver, MatchesWaves)
+{
+	const unsigned int rows = 64, cols = 67;
+	const float dx = 1.0f;
+	WaveSolver solver(rows, cols, dx, 0.03f, 3.25f, 0.4f, Stride);
+	Waves waves(rows, cols, dx, 0.03f, 3.25f, 0.4f);
+
+	float heights = 0.0f;
+	float normals = 0.0f;
+	for (int step = 0; step < 100; ++step)
+	{
+		if (step % 7 == 0)
+		{
+			solver.Disturb(3 + step % 50, 4 + step % 55, 0.5f);
+			waves.Disturb(3 + step % 50, 4 + step % 55, 0.5f);
+		}
+
+		waves.ComputeNormals();
+		solver.Step();
+		for (unsigned int i = 1; i < rows - 1; ++i)
+		{
+			for (unsigned int j = 1; j < cols - 1; ++j)
+			{
+				const float* v = Vertex(solver, i, j);
+				size_t k = (size_t)i*cols + j;
+				normals = std::max(normals, fabsf(v[3] - waves.NormalX[k]));
+				normals = std::max(normals, fabsf(v[4] - waves.NormalY[k]));
+				normals = std::max(normals, fabsf(v[5] - waves.NormalZ[k]));
+			}
+		}
+
+		waves.Step();
+		for (unsigned int i = 0; i < rows; ++i)
+			for (unsigned int j = 0; j < cols; ++j)
+				heights = std::max(heights, fabsf(solver.Height(i, j) - waves.Curr[(size_t)i*cols + j]));
+	}
+	CHECK(heights < 1e-5f);
+	CHECK(normals < 1e-5f);
+}
+
+TEST(WaveSolver, StagingKeepsCallerAttributes)
+{
+	JobSystem jobs(3);
+	WaveSolver solver(40, 41, 1.0f, 0.03f, 3.25f, 0.4f, Stride);
+	for (unsigned int s = 0; s < 2; ++s)
+	{
+		float* v = static_cast<float*>(solver.StagingVertices(s));
+		for (unsigned int i = 0; i < solver.VertexCount(); ++i)
+			for (int k = 6; k < 12; ++k)
+				v[i*12 + k] = (float)(i + k);
+	}
+
+	solver.Disturb(20, 20, 1.0f);
+	for (int step = 0; step < 5; ++step)
+		solver.Step(step % 2 ? &jobs : 0);
+
+	size_t changed = 0;
+	for (unsigned int s = 0; s < 2; ++s)
+	{
+		const float* v = static_cast<const float*>(solver.StagingVertices(s));
+		for (unsigned int i = 0; i < solver.VertexCount(); ++i)
+			for (int k = 6; k < 12; ++k)
+				changed += v[i*12 + k] != (float)(i + k);
+	}
+	CHECK(changed == 0);
+
+	// The grid is centred on the origin with row 0 at the back.
+	CHECK(Vertex(solver, 0, 0)[0] == -20.0f && Vertex(solver, 0, 0)[2] == 19.5f);
+	CHECK(Vertex(solver, 39, 40)[0] == 20.0f && Vertex(solver, 39, 40)[2] == -19.5f);
+}
+
+TEST(WaveSolver, UpdateWaitsForTimeStep)
+{
+	WaveSolver solver(16, 16, 1.0f, 0.03f, 3.25f, 0.4f);
+	const void* front = solver.FrontVertices();
+
+	CHECK(!solver.Update(0.02f));
+	CHECK(solver.FrontVertices() == front);
+	CHECK(solver.Update(0.02f));
+	CHECK(solver.FrontVertices() != front);
+	CHECK(!solver.Update(0.01f));
+}
+#pragma endregion
+
+#pragma region Benchmarks
+BENCH(WaveSolver, Step)
+{
+	JobSystem jobs;
+	const unsigned int sizes[] = { 160, 512, 2048 };
+	for (int s = 0; s < 3; ++s)
+	{
+		unsigned int n = sizes[s];
+		WaveSolver solver(n, n, 0.5f, 0.03f, 3.25f, 0.4f, Stride);
+		solver.Disturb(n/2, n/2, 1.0f);
+
+		double reference = Test::MedianMs(9, [&solver]() { solver.StepReference(); });
+		double serial = Test::MedianMs(9, [&solver]() { solver.Step(); });
+		double threaded = Test::MedianMs(9, [&solver, &jobs]() { solver.Step(&jobs); });
+
+		printf("  %4u^2: reference %7.3f ms, step %7.3f ms (%.0f Mcells/s), %u threads %7.3f ms\n",
+			n, reference, serial, (double)n*n / serial / 1000.0, jobs.ThreadCount(), threaded);
+	}
+}
+#pragma endregion
@@ -0,0 +1,134 @@
+//***************************************************************************************
+// TextModel.cpp
+//***************************************************************************************
+
+#include "TextModel.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+	// Reads "Name: value" and returns the value, or -1.
+	long ReadCount(const char*& cursor, const char* name)
+	{
+		const char* found = std::strstr(cursor, name);
+		if (!found)
+			return -1;
+
+		char* end = 0;
+		long count = std::strtol(found + std::strlen(name), &end, 10);
+		cursor = end;
+		return count;
+	}
+
+	// Collects the start of every non-empty line inside the next { } block.
+	bool FindBlockLines(const char*& cursor, const char* last, size_t count, std::vector<const char*>& lines)
+	{
+		const char* open = static_cast<const char*>(std::memchr(cursor, '{', last - cursor));
+		if (!open)
+			return false;
+
+		lines.clear();
+		lines.reserve(count);
+
+		const char* line = open + 1;
+		while (line < last && lines.size() < count)
+		{
+			const char* eol = static_cast<const char*>(std::memchr(line, '\n', last - line));
+			if (!eol)
+				eol = last;
+
+			const char* p = line;
+			while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+				++p;
+			if (p < eol)
+				lines.push_back(p);
+
+			line = eol + 1;
+		}
+
+		cursor = line;
+		return lines.size() == count;
+	}
+}
+
+bool LoadTextModel(const std::string& filename, JobSystem& jobs, TextModel& model)
+{
+	std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!fin)
+		return false;
+
+	std::stringstream buffer;
+	buffer << fin.rdbuf();
+	const std::string text = buffer.str();
+
+	const char* cursor = text.c_str();
+	const char* last = cursor + text.size();
+
+	long vcount = ReadCount(cursor, "VertexCount:");
+	long tcount = ReadCount(cursor, "TriangleCount:");
+	if (vcount < 0 || tcount < 0)
+		return false;
+
+	std::vector<const char*> lines;
+	if (!FindBlockLines(cursor, last, (size_t)vcount, lines))
+		return false;
+
+	// strtof stops at whitespace, including the newline, so a line never reads
+	// into the next one as long as it holds all of its numbers.
+	std::atomic<bool> valid(true);
+
+	model.Vertices.resize(vcount);
+	jobs.ParallelFor(0, lines.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const char* p = lines[i];
+			char* next = 0;
+			float values[6];
+			for (int c = 0; c < 6; ++c, p = next)
+			{
+				values[c] = std::strtof(p, &next);
+				if (next == p)
+				{
+					valid = false;
+					return;
+				}
+			}
+
+			TextModelVertex& v = model.Vertices[i];
+			std::memcpy(v.Position, values, sizeof(v.Position));
+			std::memcpy(v.Normal, values + 3, sizeof(v.Normal));
+		}
+	});
+
+	if (!valid || !FindBlockLines(cursor, last, (size_t)tcount, lines))
+		return false;
+
+	model.Indices.resize(3 * tcount);
+	jobs.ParallelFor(0, lines.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const char* p = lines[i];
+			char* next = 0;
+			for (int c = 0; c < 3; ++c, p = next)
+			{
+				unsigned long index = std::strtoul(p, &next, 10);
+				if (next == p || index >= (unsigned long)vcount)
+				{
+					valid = false;
+					return;
+				}
+				model.Indices[3 * i + c] = (uint32_t)index;
+			}
+		}
+	});
+
+	return valid;
+}
@@ -0,0 +1,45 @@
+//***************************************************************************************
+// TextModel.h
+//
+// Loader for the plain text models shipped with the demos (Models/skull.txt, car.txt):
+//
+//   VertexCount: N
+//   TriangleCount: M
+//   VertexList (pos, normal)
+//   {
+//       px py pz nx ny nz        (N lines)
+//   }
+//   TriangleList
+//   {
+//       i0 i1 i2                 (M lines)
+//   }
+//
+// The file is read in one go and the line starts are found in a single pass; the
+// lines themselves are then parsed in parallel on the job system.
+//***************************************************************************************
+
+#ifndef TEXTMODEL_H
+#define TEXTMODEL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class JobSystem;
+
+struct TextModelVertex
+{
+	float Position[3];
+	float Normal[3];
+};
+
+struct TextModel
+{
+	std::vector<TextModelVertex> Vertices;
+	std::vector<uint32_t> Indices;
+};
+
+// Returns false if the file cannot be read or is not in the format above.
+bool LoadTextModel(const std::string& filename, JobSystem& jobs, TextModel& model);
+
+#endif // TEXTMODEL_H
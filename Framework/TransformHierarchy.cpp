@@ -0,0 +1,348 @@
+//***************************************************************************************
+// TransformHierarchy.cpp
+//***************************************************************************************
+
+#include "TransformHierarchy.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define TRANSFORMHIERARCHY_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+#ifdef TRANSFORMHIERARCHY_SSE
+	// out = a*b. Each row of the product is a row of a spread over the rows of b.
+	void Multiply(const float* a, const float* b, float* out)
+	{
+		__m128 b0 = _mm_loadu_ps(b + 0);
+		__m128 b1 = _mm_loadu_ps(b + 4);
+		__m128 b2 = _mm_loadu_ps(b + 8);
+		__m128 b3 = _mm_loadu_ps(b + 12);
+
+		for (int i = 0; i < 4; ++i)
+		{
+			__m128 row = _mm_loadu_ps(a + i*4);
+			__m128 r = _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+			r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+			r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+			r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+			_mm_storeu_ps(out + i*4, r);
+		}
+	}
+
+	// The w of the result is 0 whatever the inputs' w.
+	__m128 Cross(__m128 a, __m128 b)
+	{
+		__m128 aYzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 bYzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYzx), _mm_mul_ps(aYzx, b));
+		return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+	}
+
+	// The inverse-transpose of the upper 3x3: its rows are the cross products of
+	// pairs of rows, over the determinant.
+	void InverseTranspose(const float* m, float* out)
+	{
+		__m128 r0 = _mm_loadu_ps(m + 0);
+		__m128 r1 = _mm_loadu_ps(m + 4);
+		__m128 r2 = _mm_loadu_ps(m + 8);
+
+		__m128 c0 = Cross(r1, r2);
+		__m128 c1 = Cross(r2, r0);
+		__m128 c2 = Cross(r0, r1);
+
+		__m128 d = _mm_mul_ps(r0, c0);
+		d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+		d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+		float det = _mm_cvtss_f32(d);
+
+		__m128 scale = _mm_set1_ps(det != 0.0f ? 1.0f/det : 0.0f);
+		_mm_storeu_ps(out + 0, _mm_mul_ps(c0, scale));
+		_mm_storeu_ps(out + 4, _mm_mul_ps(c1, scale));
+		_mm_storeu_ps(out + 8, _mm_mul_ps(c2, scale));
+		_mm_storeu_ps(out + 12, _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+	}
+#else
+	void Multiply(const float* a, const float* b, float* out)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int j = 0; j < 4; ++j)
+			{
+				out[i*4 + j] = a[i*4 + 0]*b[0*4 + j] + a[i*4 + 1]*b[1*4 + j] +
+					a[i*4 + 2]*b[2*4 + j] + a[i*4 + 3]*b[3*4 + j];
+			}
+		}
+	}
+
+	void Cross(const float* a, const float* b, float* out)
+	{
+		out[0] = a[1]*b[2] - a[2]*b[1];
+		out[1] = a[2]*b[0] - a[0]*b[2];
+		out[2] = a[0]*b[1] - a[1]*b[0];
+		out[3] = 0.0f;
+	}
+
+	void InverseTranspose(const float* m, float* out)
+	{
+		Cross(m + 4, m + 8, out + 0);
+		Cross(m + 8, m + 0, out + 4);
+		Cross(m + 0, m + 4, out + 8);
+
+		float det = m[0]*out[0] + m[1]*out[1] + m[2]*out[2];
+		float scale = det != 0.0f ? 1.0f/det : 0.0f;
+		for (int i = 0; i < 12; ++i)
+			out[i] *= scale;
+
+		out[12] = 0.0f;
+		out[13] = 0.0f;
+		out[14] = 0.0f;
+		out[15] = 1.0f;
+	}
+#endif
+}
+
+TransformHierarchy::TransformHierarchy()
+	: mLaidOut(true), mChangedCount(0)
+{
+}
+
+TransformHierarchy::Node TransformHierarchy::Add(Node parent, const float* local)
+{
+	assert(parent == None || parent < mIndexOf.size());
+
+	// Appended for now; the parent is already in the arrays, so it still comes first.
+	uint32_t index = (uint32_t)mParents.size();
+	Node node = (Node)mIndexOf.size();
+
+	Matrix m;
+	memcpy(m.M, local, sizeof(m.M));
+
+	mParents.push_back(parent != None ? mIndexOf[parent] : (uint32_t)None);
+	mLocals.push_back(m);
+	mWorlds.push_back(m);
+	mInvTransposes.push_back(m);
+	mFlags.push_back(LocalDirty);
+
+	mIndexOf.push_back(index);
+	mNodeOf.push_back(node);
+
+	mLaidOut = false;
+	return node;
+}
+
+void TransformHierarchy::SetLocal(Node node, const float* local)
+{
+	uint32_t index = mIndexOf[node];
+	memcpy(mLocals[index].M, local, sizeof(mLocals[index].M));
+	mFlags[index] |= LocalDirty;
+
+	// Until the next layout there are no runs, and every node is visited.
+	if (mLaidOut && mRunOf[index] != None)
+		mRunFlags[mRunOf[index]] |= LocalDirty;
+}
+
+TransformHierarchy::Node TransformHierarchy::Parent(Node node)const
+{
+	uint32_t parent = mParents[mIndexOf[node]];
+	return parent != None ? mNodeOf[parent] : (Node)None;
+}
+
+#pragma region Layout
+void TransformHierarchy::Layout()
+{
+	uint32_t count = (uint32_t)mParents.size();
+
+	// Children lists, each in descending order so the stack below pops them in
+	// ascending order, keeping siblings in the order they were added.
+	std::vector<uint32_t> firstChild(count, None);
+	std::vector<uint32_t> nextSibling(count, None);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t parent = mParents[i];
+		if (parent != None)
+		{
+			nextSibling[i] = firstChild[parent];
+			firstChild[parent] = i;
+		}
+	}
+
+	// Depth-first order, roots in the order they were added.
+	std::vector<uint32_t> order;
+	order.reserve(count);
+	std::vector<uint32_t> stack;
+	for (uint32_t root = count; root-- > 0; )
+	{
+		if (mParents[root] == None)
+			stack.push_back(root);
+	}
+
+	while (!stack.empty())
+	{
+		uint32_t i = stack.back();
+		stack.pop_back();
+		order.push_back(i);
+
+		for (uint32_t child = firstChild[i]; child != None; child = nextSibling[child])
+			stack.push_back(child);
+	}
+	assert(order.size() == count);
+
+	std::vector<uint32_t> newIndex(count);
+	for (uint32_t i = 0; i < count; ++i)
+		newIndex[order[i]] = i;
+
+	std::vector<uint32_t> parents(count);
+	std::vector<Matrix> locals(count);
+	std::vector<Matrix> worlds(count);
+	std::vector<Matrix> invTransposes(count);
+	std::vector<uint8_t> flags(count);
+	std::vector<Node> nodeOf(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t old = order[i];
+		parents[i] = mParents[old] != None ? newIndex[mParents[old]] : (uint32_t)None;
+		locals[i] = mLocals[old];
+		worlds[i] = mWorlds[old];
+		invTransposes[i] = mInvTransposes[old];
+		flags[i] = mFlags[old];
+		nodeOf[i] = mNodeOf[old];
+		mIndexOf[nodeOf[i]] = i;
+	}
+
+	mParents.swap(parents);
+	mLocals.swap(locals);
+	mWorlds.swap(worlds);
+	mInvTransposes.swap(invTransposes);
+	mFlags.swap(flags);
+	mNodeOf.swap(nodeOf);
+
+	// Subtree sizes, children first.
+	std::vector<uint32_t> sizes(count, 1);
+	for (uint32_t i = count; i-- > 0; )
+	{
+		if (mParents[i] != None)
+			sizes[mParents[i]] += sizes[i];
+	}
+
+	Plan(sizes);
+	mLaidOut = true;
+}
+
+void TransformHierarchy::Plan(const std::vector<uint32_t>& sizes)
+{
+	mTop.clear();
+	mRuns.clear();
+
+	uint32_t count = (uint32_t)sizes.size();
+	mRunOf.assign(count, None);
+
+	// A subtree small enough is skipped over as one run; a larger one puts its root
+	// on top and goes on with its first child, which is the next node.
+	for (uint32_t i = 0; i < count; )
+	{
+		if (sizes[i] > Grain)
+		{
+			mTop.push_back(i);
+			++i;
+			continue;
+		}
+
+		// Small sibling subtrees share a run.
+		uint32_t end = i + sizes[i];
+		if (!mRuns.empty() && mRuns.back().End == i && mRuns.back().Parent == mParents[i] &&
+			end - mRuns.back().Begin <= Grain)
+		{
+			mRuns.back().End = end;
+		}
+		else
+		{
+			Run run = { i, end, mParents[i] };
+			mRuns.push_back(run);
+		}
+
+		for (uint32_t j = i; j < end; ++j)
+			mRunOf[j] = (uint32_t)(mRuns.size() - 1);
+		i = end;
+	}
+
+	// Nodes may have been set before the layout, so every run is visited once.
+	mRunFlags.assign(mRuns.size(), LocalDirty);
+}
+#pragma endregion
+
+#pragma region Update
+void TransformHierarchy::Update(JobSystem* jobs)
+{
+	if (!mLaidOut)
+		Layout();
+
+	size_t changed = 0;
+	for (size_t i = 0; i < mTop.size(); ++i)
+		changed += PropagateNode(mTop[i]);
+
+	if (jobs && mRuns.size() > 1)
+	{
+		std::atomic<size_t> changedInRuns(0);
+		jobs->ParallelFor(0, mRuns.size(), [this, &changedInRuns](size_t begin, size_t end)
+		{
+			size_t changed = 0;
+			for (size_t i = begin; i < end; ++i)
+				changed += PropagateRun(i);
+			changedInRuns.fetch_add(changed, std::memory_order_relaxed);
+		}, 1);
+		changed += changedInRuns.load(std::memory_order_relaxed);
+	}
+	else
+	{
+		for (size_t i = 0; i < mRuns.size(); ++i)
+			changed += PropagateRun(i);
+	}
+
+	mChangedCount = changed;
+}
+
+size_t TransformHierarchy::PropagateRun(size_t run)
+{
+	// Nothing in the run was set, nothing changed last time that needs its flags
+	// cleared, and its parent stayed put: the run stays as it is.
+	const Run& r = mRuns[run];
+	if (mRunFlags[run] == 0 && (r.Parent == None || (mFlags[r.Parent] & WorldChanged) == 0))
+		return 0;
+
+	size_t changed = 0;
+	for (uint32_t i = r.Begin; i < r.End; ++i)
+		changed += PropagateNode(i);
+
+	mRunFlags[run] = changed > 0 ? WorldChanged : 0;
+	return changed;
+}
+
+size_t TransformHierarchy::PropagateNode(uint32_t index)
+{
+	// The parent has already been through this update.
+	uint32_t parent = mParents[index];
+	uint8_t flags = mFlags[index];
+	bool dirty = (flags & LocalDirty) != 0 || (parent != None && (mFlags[parent] & WorldChanged) != 0);
+	if (!dirty)
+	{
+		mFlags[index] = 0;
+		return 0;
+	}
+
+	if (parent == None)
+		mWorlds[index] = mLocals[index];
+	else
+		Multiply(mLocals[index].M, mWorlds[parent].M, mWorlds[index].M);
+
+	InverseTranspose(mWorlds[index].M, mInvTransposes[index].M);
+	mFlags[index] = WorldChanged;
+	return 1;
+}
+#pragma endregion
@@ -0,0 +1,123 @@
+//***************************************************************************************
+// TransformHierarchy.h
+//
+// Parent-child transform hierarchy. Every node has a local transform relative to its
+// parent; Update turns them into world transforms, and into the inverse-transposes
+// normals are transformed with, both ready to be copied into constant buffers.
+//
+// Nodes are stored as separate arrays (parents, locals, worlds, inverse-transposes,
+// flags) in depth-first order, so a parent always comes before its children and
+// every subtree is one contiguous run. Update is then a single forward pass: each
+// node multiplies its local transform by its parent's world transform, which the
+// pass has already produced. Large subtrees are split into runs of about Grain
+// nodes; the few nodes above those runs go first, and the runs, which no longer
+// depend on each other, are propagated as parallel jobs.
+//
+// A node is only recomputed when its local transform or an ancestor's world
+// transform changed since the last update. Runs keep flags of their own, so a run
+// where nothing moved is skipped without looking at its nodes.
+//
+// Matrices are row-major, 16 floats, and applied as p*M, as in XNA Math: a world
+// transform is local*parentWorld. The inverse-transpose ignores translation, like
+// MathHelper::InverseTranspose.
+//
+// Nodes can be added but not removed. Adding nodes lays the arrays out again on
+// the next Update, which costs a pass over every node; node handles stay valid,
+// but indices into Worlds() do not.
+//***************************************************************************************
+
+#ifndef TRANSFORMHIERARCHY_H
+#define TRANSFORMHIERARCHY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+class TransformHierarchy
+{
+public:
+	typedef uint32_t Node;
+	static const Node None = 0xffffffff;
+
+	// Subtrees of about this many nodes are propagated as one job.
+	static const size_t Grain = 4096;
+
+	TransformHierarchy();
+
+	// The parent must already exist, or be None for a root.
+	Node Add(Node parent, const float* local);
+	void SetLocal(Node node, const float* local);
+
+	// Recomputes the world transforms that are out of date. Runs on the calling
+	// thread without a job system.
+	void Update(JobSystem* jobs = 0);
+
+	const float* Local(Node node)const             { return mLocals[mIndexOf[node]].M; }
+	const float* World(Node node)const             { return mWorlds[mIndexOf[node]].M; }
+	const float* WorldInvTranspose(Node node)const { return mInvTransposes[mIndexOf[node]].M; }
+	Node Parent(Node node)const;
+
+	// Whether the last Update recomputed the node's world transform.
+	bool Changed(Node node)const                   { return (mFlags[mIndexOf[node]] & WorldChanged) != 0; }
+
+	// Every world transform, 16 floats apiece, in layout order, for uploading all at
+	// once. Valid after Update until nodes are added.
+	const float* Worlds()const                     { return reinterpret_cast<const float*>(mWorlds.data()); }
+	const float* WorldInvTransposes()const         { return reinterpret_cast<const float*>(mInvTransposes.data()); }
+	size_t IndexOf(Node node)const                 { return mIndexOf[node]; }
+
+	size_t Size()const                             { return mParents.size(); }
+
+	// Nodes the last Update recomputed.
+	size_t ChangedCount()const                     { return mChangedCount; }
+
+private:
+	enum Flags
+	{
+		LocalDirty = 1,
+		WorldChanged = 2
+	};
+
+	struct Matrix
+	{
+		float M[16];
+	};
+
+	// A contiguous run of whole subtrees with the same parent.
+	struct Run
+	{
+		uint32_t Begin;
+		uint32_t End;
+		uint32_t Parent;
+	};
+
+	void Layout();
+	void Plan(const std::vector<uint32_t>& sizes);
+	size_t PropagateRun(size_t run);
+	size_t PropagateNode(uint32_t index);
+
+	// In layout order. mParents holds indices, not handles.
+	std::vector<uint32_t> mParents;
+	std::vector<Matrix> mLocals;
+	std::vector<Matrix> mWorlds;
+	std::vector<Matrix> mInvTransposes;
+	std::vector<uint8_t> mFlags;
+
+	// Handle to index, and back.
+	std::vector<uint32_t> mIndexOf;
+	std::vector<Node> mNodeOf;
+
+	// Nodes above the runs, in layout order, and the runs below them. Run flags
+	// say whether a node in the run was set, or changed in the last update.
+	std::vector<uint32_t> mTop;
+	std::vector<Run> mRuns;
+	std::vector<uint8_t> mRunFlags;
+	std::vector<uint32_t> mRunOf;
+
+	bool mLaidOut;
+	size_t mChangedCount;
+};
+
+#endif // TRANSFORMHIERARCHY_H
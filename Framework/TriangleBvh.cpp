@@ -0,0 +1,902 @@
+//***************************************************************************************
+// TriangleBvh.cpp
+//***************************************************************************************
+
+#include "TriangleBvh.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <memory>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define TRIANGLEBVH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Cost of visiting a node, in triangle tests.
+	const float TraversalCost = 1.0f;
+
+	// Ranges of more triangles than this bin in chunks of BinChunk on the job system
+	// and build their two halves as separate jobs.
+	const size_t ParallelThreshold = 16384;
+	const size_t BinChunk = 16384;
+
+	struct Box
+	{
+		float Min[3];
+		float Max[3];
+
+		void Clear()
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				Min[a] = FLT_MAX;
+				Max[a] = -FLT_MAX;
+			}
+		}
+
+		void Grow(const float* p)
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				Min[a] = std::min(Min[a], p[a]);
+				Max[a] = std::max(Max[a], p[a]);
+			}
+		}
+
+		void Grow(const Box& b)
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				Min[a] = std::min(Min[a], b.Min[a]);
+				Max[a] = std::max(Max[a], b.Max[a]);
+			}
+		}
+
+		// Half the surface area; 0 for an empty box.
+		float Area()const
+		{
+			float dx = Max[0] - Min[0];
+			float dy = Max[1] - Min[1];
+			float dz = Max[2] - Min[2];
+			if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+				return 0.0f;
+			return dx*dy + dy*dz + dz*dx;
+		}
+	};
+
+	struct Bins
+	{
+		Box Bounds[3][TriangleBvh::BinCount];
+		uint32_t Counts[3][TriangleBvh::BinCount];
+
+		void Clear()
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				for (unsigned int b = 0; b < TriangleBvh::BinCount; ++b)
+				{
+					Bounds[a][b].Clear();
+					Counts[a][b] = 0;
+				}
+			}
+		}
+	};
+
+	// Zero components become tiny ones, so the slab test never multiplies 0 by infinity.
+	float SafeInverse(float d)
+	{
+		if (fabsf(d) < 1e-20f)
+			d = d < 0.0f ? -1e-20f : 1e-20f;
+		return 1.0f / d;
+	}
+
+	bool HitBox(const float* minB, const float* maxB, const float* origin, const float* inverse, float tMax)
+	{
+		float tNear = 0.0f;
+		float tFar = tMax;
+		for (int a = 0; a < 3; ++a)
+		{
+			float t1 = (minB[a] - origin[a])*inverse[a];
+			float t2 = (maxB[a] - origin[a])*inverse[a];
+			tNear = std::max(tNear, std::min(t1, t2));
+			tFar = std::min(tFar, std::max(t1, t2));
+		}
+		return tNear <= tFar;
+	}
+
+	// Row-major affine transform p*W of a point or direction.
+	void TransformPoint(const float* m, const float* p, float* out)
+	{
+		for (int j = 0; j < 3; ++j)
+			out[j] = p[0]*m[j] + p[1]*m[4 + j] + p[2]*m[8 + j] + m[12 + j];
+	}
+}
+
+#pragma region Builder
+struct TriangleBvh::BuildNode
+{
+	// The root of a subtree built in parallel; its halves are subtrees of their
+	// own. A subtree built on one thread is in Nodes, in final layout, with
+	// offsets counted from its first node.
+	Node Root;
+	std::unique_ptr<BuildNode> Left;
+	std::unique_ptr<BuildNode> Right;
+
+	std::vector<Node> Nodes;
+	unsigned int Depth;
+};
+
+class TriangleBvh::Builder
+{
+public:
+	Builder(const float* positions, size_t stride, const uint32_t* indices, size_t triangleCount, JobSystem* jobs)
+		: mPositions(reinterpret_cast<const char*>(positions)), mStride(stride), mIndices(indices), mJobs(jobs),
+		mBounds(triangleCount), mCentroids(3*triangleCount), mOrder(triangleCount)
+	{
+		JobSystem::RangeFunction prepare = [this](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				Box& box = mBounds[i];
+				box.Clear();
+				for (int k = 0; k < 3; ++k)
+					box.Grow(Vertex(i, k));
+
+				for (int a = 0; a < 3; ++a)
+					mCentroids[3*i + a] = 0.5f*(box.Min[a] + box.Max[a]);
+				mOrder[i] = (uint32_t)i;
+			}
+		};
+
+		if (mJobs)
+			mJobs->ParallelFor(0, triangleCount, prepare);
+		else
+			prepare(0, triangleCount);
+	}
+
+	const float* Vertex(size_t triangle, int corner)const
+	{
+		return reinterpret_cast<const float*>(mPositions + mIndices[3*triangle + corner]*mStride);
+	}
+
+	const std::vector<uint32_t>& Order()const { return mOrder; }
+
+	void Build(uint32_t first, uint32_t count, unsigned int depth, BuildNode& out)
+	{
+		if (!mJobs || count <= ParallelThreshold)
+		{
+			out.Depth = BuildSerial(first, count, depth, out.Nodes);
+			return;
+		}
+
+		uint32_t middle = Split(first, count, depth, true, out.Root);
+		if (out.Root.Count)
+		{
+			out.Nodes.push_back(out.Root);
+			out.Depth = 1;
+			return;
+		}
+
+		out.Left.reset(new BuildNode);
+		out.Right.reset(new BuildNode);
+
+		BuildNode* left = out.Left.get();
+		JobCounter built;
+		mJobs->Submit([this, left, first, middle, depth]() { Build(first, middle - first, depth + 1, *left); }, &built);
+		Build(middle, first + count - middle, depth + 1, *out.Right);
+		mJobs->Wait(built);
+
+		out.Depth = 1 + std::max(out.Left->Depth, out.Right->Depth);
+	}
+
+	static size_t NodeCount(const BuildNode& subtree)
+	{
+		return subtree.Left ? 1 + NodeCount(*subtree.Left) + NodeCount(*subtree.Right) : subtree.Nodes.size();
+	}
+
+	// Appends the subtree in depth-first order, each first child right after its parent.
+	static void Emit(const BuildNode& subtree, std::vector<Node>& nodes)
+	{
+		if (!subtree.Left)
+		{
+			uint32_t base = (uint32_t)nodes.size();
+			for (size_t i = 0; i < subtree.Nodes.size(); ++i)
+			{
+				Node node = subtree.Nodes[i];
+				if (node.Count == 0)
+					node.Offset += base;
+				nodes.push_back(node);
+			}
+			return;
+		}
+
+		size_t index = nodes.size();
+		nodes.push_back(subtree.Root);
+		Emit(*subtree.Left, nodes);
+		nodes[index].Offset = (uint32_t)nodes.size();
+		Emit(*subtree.Right, nodes);
+	}
+
+private:
+	unsigned int BuildSerial(uint32_t first, uint32_t count, unsigned int depth, std::vector<Node>& nodes)
+	{
+		size_t index = nodes.size();
+		nodes.push_back(Node());
+
+		uint32_t middle = Split(first, count, depth, false, nodes[index]);
+		if (nodes[index].Count)
+			return 1;
+
+		unsigned int left = BuildSerial(first, middle - first, depth + 1, nodes);
+		nodes[index].Offset = (uint32_t)nodes.size();
+		unsigned int right = BuildSerial(middle, first + count - middle, depth + 1, nodes);
+		return 1 + std::max(left, right);
+	}
+
+	// Fills in the bounds of the node and decides it: either a leaf over the range,
+	// or an axis and the reordered range's first triangle of the second child.
+	uint32_t Split(uint32_t first, uint32_t count, unsigned int depth, bool parallel, Node& node)
+	{
+		size_t chunks = parallel ? (count + BinChunk - 1) / BinChunk : 1;
+
+		// One chunk, the common case far down the tree, needs no heap.
+		Box singleBox;
+		Box singleCentroidBox;
+		Bins singleBins;
+		std::vector<Box> chunkBoxes;
+		std::vector<Box> chunkCentroidBoxes;
+		std::vector<Bins> chunkBins;
+
+		Box* boxes = &singleBox;
+		Box* centroidBoxes = &singleCentroidBox;
+		Bins* bins = &singleBins;
+		if (chunks > 1)
+		{
+			chunkBoxes.resize(chunks);
+			chunkCentroidBoxes.resize(chunks);
+			chunkBins.resize(chunks);
+			boxes = &chunkBoxes[0];
+			centroidBoxes = &chunkCentroidBoxes[0];
+			bins = &chunkBins[0];
+		}
+
+		//
+		// Bounds of the triangles and of their centroids.
+		//
+
+		Run(chunks, [&](size_t c)
+		{
+			uint32_t begin = first + (uint32_t)(count*c/chunks);
+			uint32_t end = first + (uint32_t)(count*(c + 1)/chunks);
+			boxes[c].Clear();
+			centroidBoxes[c].Clear();
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				boxes[c].Grow(mBounds[mOrder[i]]);
+				centroidBoxes[c].Grow(&mCentroids[3*mOrder[i]]);
+			}
+		});
+
+		Box bounds = boxes[0];
+		Box centroids = centroidBoxes[0];
+		for (size_t c = 1; c < chunks; ++c)
+		{
+			bounds.Grow(boxes[c]);
+			centroids.Grow(centroidBoxes[c]);
+		}
+
+		for (int a = 0; a < 3; ++a)
+		{
+			node.Min[a] = bounds.Min[a];
+			node.Max[a] = bounds.Max[a];
+		}
+		node.Offset = first;
+		node.Count = (uint16_t)count;
+		node.Axis = 0;
+
+		assert((depth + 1 < MaxDepth || count <= 0xffff) && "Leaf too large");
+		if (count == 1 || depth + 1 >= MaxDepth)
+			return first + count;
+
+		//
+		// Bin the centroids along every axis and find the cheapest split between bins.
+		//
+
+		float scale[3];
+		for (int a = 0; a < 3; ++a)
+		{
+			float extent = centroids.Max[a] - centroids.Min[a];
+			scale[a] = extent > 0.0f ? BinCount*(1.0f - 1e-5f) / extent : 0.0f;
+		}
+
+		Run(chunks, [&](size_t c)
+		{
+			uint32_t begin = first + (uint32_t)(count*c/chunks);
+			uint32_t end = first + (uint32_t)(count*(c + 1)/chunks);
+			bins[c].Clear();
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				uint32_t t = mOrder[i];
+				for (int a = 0; a < 3; ++a)
+				{
+					unsigned int b = BinOf(mCentroids[3*t + a], centroids.Min[a], scale[a]);
+					bins[c].Bounds[a][b].Grow(mBounds[t]);
+					++bins[c].Counts[a][b];
+				}
+			}
+		});
+
+		for (size_t c = 1; c < chunks; ++c)
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				for (unsigned int b = 0; b < BinCount; ++b)
+				{
+					bins[0].Bounds[a][b].Grow(bins[c].Bounds[a][b]);
+					bins[0].Counts[a][b] += bins[c].Counts[a][b];
+				}
+			}
+		}
+
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		unsigned int bestBin = 0;
+		for (int a = 0; a < 3; ++a)
+		{
+			if (scale[a] == 0.0f)
+				continue;
+
+			float leftArea[BinCount];
+			uint32_t leftCount[BinCount];
+			Box box;
+			box.Clear();
+			uint32_t n = 0;
+			for (unsigned int b = 0; b + 1 < BinCount; ++b)
+			{
+				box.Grow(bins[0].Bounds[a][b]);
+				n += bins[0].Counts[a][b];
+				leftArea[b] = box.Area();
+				leftCount[b] = n;
+			}
+
+			box.Clear();
+			n = 0;
+			for (unsigned int b = BinCount - 1; b > 0; --b)
+			{
+				box.Grow(bins[0].Bounds[a][b]);
+				n += bins[0].Counts[a][b];
+				if (n == 0 || leftCount[b - 1] == 0)
+					continue;
+
+				float cost = leftArea[b - 1]*leftCount[b - 1] + box.Area()*n;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = a;
+					bestBin = b;
+				}
+			}
+		}
+
+		float area = bounds.Area();
+		if (bestAxis >= 0)
+			bestCost = TraversalCost + (area > 0.0f ? bestCost / area : 0.0f);
+
+		if (count <= MaxLeafSize && (bestAxis < 0 || (float)count <= bestCost))
+			return first + count;
+
+		node.Count = 0;
+
+		//
+		// Reorder the range so the first child's triangles come first.
+		//
+
+		uint32_t* begin = &mOrder[first];
+		uint32_t* end = begin + count;
+		uint32_t* middle = begin;
+
+		if (bestAxis >= 0)
+		{
+			node.Axis = (uint16_t)bestAxis;
+			float minC = centroids.Min[bestAxis];
+			float s = scale[bestAxis];
+			middle = std::partition(begin, end, [&](uint32_t t)
+			{
+				return BinOf(mCentroids[3*t + bestAxis], minC, s) < bestBin;
+			});
+		}
+
+		if (middle == begin || middle == end)
+		{
+			// Every centroid in one place: halve the range along the longest axis.
+			int axis = 0;
+			for (int a = 1; a < 3; ++a)
+			{
+				if (centroids.Max[a] - centroids.Min[a] > centroids.Max[axis] - centroids.Min[axis])
+					axis = a;
+			}
+
+			node.Axis = (uint16_t)axis;
+			middle = begin + count/2;
+			std::nth_element(begin, middle, end, [&](uint32_t x, uint32_t y)
+			{
+				return mCentroids[3*x + axis] < mCentroids[3*y + axis];
+			});
+		}
+
+		return first + (uint32_t)(middle - begin);
+	}
+
+	static unsigned int BinOf(float centroid, float minC, float scale)
+	{
+		int b = (int)((centroid - minC)*scale);
+		return (unsigned int)std::min(std::max(b, 0), (int)BinCount - 1);
+	}
+
+	template<class F>
+	void Run(size_t chunks, const F& chunk)
+	{
+		if (chunks == 1)
+		{
+			chunk(0);
+			return;
+		}
+
+		mJobs->ParallelFor(0, chunks, [&chunk](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; ++c)
+				chunk(c);
+		}, 1);
+	}
+
+	const char* mPositions;
+	size_t mStride;
+	const uint32_t* mIndices;
+	JobSystem* mJobs;
+
+	std::vector<Box> mBounds;
+	std::vector<float> mCentroids;
+	std::vector<uint32_t> mOrder;
+};
+#pragma endregion
+
+#pragma region TriangleBvh
+TriangleBvh::TriangleBvh()
+	: mDepth(0)
+{
+}
+
+void TriangleBvh::Build(const float* positions, size_t stride, size_t vertexCount,
+	const uint32_t* indices, size_t triangleCount, JobSystem* jobs)
+{
+	mNodes.clear();
+	mTriangles.clear();
+	mDepth = 0;
+
+	if (triangleCount == 0)
+		return;
+
+#ifndef NDEBUG
+	for (size_t i = 0; i < 3*triangleCount; ++i)
+		assert(indices[i] < vertexCount);
+#else
+	(void)vertexCount;
+#endif
+
+	Builder builder(positions, stride, indices, triangleCount, jobs);
+
+	BuildNode root;
+	builder.Build(0, (uint32_t)triangleCount, 0, root);
+
+	mNodes.reserve(Builder::NodeCount(root));
+	Builder::Emit(root, mNodes);
+	mDepth = root.Depth;
+
+	//
+	// Store the triangles in leaf order.
+	//
+
+	mTriangles.resize(triangleCount);
+	const std::vector<uint32_t>& order = builder.Order();
+
+	JobSystem::RangeFunction store = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			uint32_t t = order[i];
+			const float* v0 = builder.Vertex(t, 0);
+			const float* v1 = builder.Vertex(t, 1);
+			const float* v2 = builder.Vertex(t, 2);
+
+			Triangle& tri = mTriangles[i];
+			for (int a = 0; a < 3; ++a)
+			{
+				tri.V0[a] = v0[a];
+				tri.E1[a] = v1[a] - v0[a];
+				tri.E2[a] = v2[a] - v0[a];
+			}
+			tri.Index = t;
+		}
+	};
+
+	if (jobs)
+		jobs->ParallelFor(0, triangleCount, store);
+	else
+		store(0, triangleCount);
+}
+
+bool TriangleBvh::Intersect(const BvhRay& ray, BvhHit& hit)const
+{
+	if (mNodes.empty())
+		return false;
+
+	const float* o = ray.Origin;
+	const float* d = ray.Direction;
+	float inverse[3] = { SafeInverse(d[0]), SafeInverse(d[1]), SafeInverse(d[2]) };
+
+	float tMax = ray.MaxT;
+	uint32_t found = BvhHit::None;
+	float foundU = 0.0f;
+	float foundV = 0.0f;
+
+	uint32_t stack[MaxDepth];
+	unsigned int size = 0;
+	uint32_t index = 0;
+
+	for (;;)
+	{
+		const Node& node = mNodes[index];
+		if (HitBox(node.Min, node.Max, o, inverse, tMax))
+		{
+			if (node.Count == 0)
+			{
+				// Near child first, so its hits cut the far one short.
+				uint32_t nearChild = index + 1;
+				uint32_t farChild = node.Offset;
+				if (d[node.Axis] < 0.0f)
+					std::swap(nearChild, farChild);
+
+				stack[size++] = farChild;
+				index = nearChild;
+				continue;
+			}
+
+			// Moller-Trumbore, from both sides.
+			for (uint32_t i = node.Offset; i < node.Offset + node.Count; ++i)
+			{
+				const Triangle& tri = mTriangles[i];
+
+				float p[3] = { d[1]*tri.E2[2] - d[2]*tri.E2[1], d[2]*tri.E2[0] - d[0]*tri.E2[2], d[0]*tri.E2[1] - d[1]*tri.E2[0] };
+				float det = tri.E1[0]*p[0] + tri.E1[1]*p[1] + tri.E1[2]*p[2];
+				if (fabsf(det) < 1e-20f)
+					continue;
+
+				float inv = 1.0f / det;
+				float s[3] = { o[0] - tri.V0[0], o[1] - tri.V0[1], o[2] - tri.V0[2] };
+				float u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2])*inv;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+
+				float q[3] = { s[1]*tri.E1[2] - s[2]*tri.E1[1], s[2]*tri.E1[0] - s[0]*tri.E1[2], s[0]*tri.E1[1] - s[1]*tri.E1[0] };
+				float v = (d[0]*q[0] + d[1]*q[1] + d[2]*q[2])*inv;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+
+				float t = (tri.E2[0]*q[0] + tri.E2[1]*q[1] + tri.E2[2]*q[2])*inv;
+				if (t > 0.0f && t < tMax)
+				{
+					tMax = t;
+					found = tri.Index;
+					foundU = u;
+					foundV = v;
+				}
+			}
+		}
+
+		if (size == 0)
+			break;
+		index = stack[--size];
+	}
+
+	if (found == BvhHit::None)
+		return false;
+
+	hit.T = tMax;
+	hit.U = foundU;
+	hit.V = foundV;
+	hit.Triangle = found;
+	hit.Object = BvhHit::None;
+	return true;
+}
+
+unsigned int TriangleBvh::Intersect4(const BvhRay rays[4], BvhHit hits[4])const
+{
+	if (mNodes.empty())
+		return 0;
+
+#ifdef TRIANGLEBVH_SSE
+	//
+	// The four rays side by side, one per lane.
+	//
+
+	__m128 ox = _mm_setr_ps(rays[0].Origin[0], rays[1].Origin[0], rays[2].Origin[0], rays[3].Origin[0]);
+	__m128 oy = _mm_setr_ps(rays[0].Origin[1], rays[1].Origin[1], rays[2].Origin[1], rays[3].Origin[1]);
+	__m128 oz = _mm_setr_ps(rays[0].Origin[2], rays[1].Origin[2], rays[2].Origin[2], rays[3].Origin[2]);
+	__m128 dx = _mm_setr_ps(rays[0].Direction[0], rays[1].Direction[0], rays[2].Direction[0], rays[3].Direction[0]);
+	__m128 dy = _mm_setr_ps(rays[0].Direction[1], rays[1].Direction[1], rays[2].Direction[1], rays[3].Direction[1]);
+	__m128 dz = _mm_setr_ps(rays[0].Direction[2], rays[1].Direction[2], rays[2].Direction[2], rays[3].Direction[2]);
+
+	__m128 ix = _mm_setr_ps(SafeInverse(rays[0].Direction[0]), SafeInverse(rays[1].Direction[0]),
+		SafeInverse(rays[2].Direction[0]), SafeInverse(rays[3].Direction[0]));
+	__m128 iy = _mm_setr_ps(SafeInverse(rays[0].Direction[1]), SafeInverse(rays[1].Direction[1]),
+		SafeInverse(rays[2].Direction[1]), SafeInverse(rays[3].Direction[1]));
+	__m128 iz = _mm_setr_ps(SafeInverse(rays[0].Direction[2]), SafeInverse(rays[1].Direction[2]),
+		SafeInverse(rays[2].Direction[2]), SafeInverse(rays[3].Direction[2]));
+
+	__m128 tMax = _mm_setr_ps(rays[0].MaxT, rays[1].MaxT, rays[2].MaxT, rays[3].MaxT);
+	__m128 bestU = _mm_setzero_ps();
+	__m128 bestV = _mm_setzero_ps();
+	__m128i best = _mm_set1_epi32(-1);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	uint32_t stack[MaxDepth];
+	unsigned int size = 0;
+	uint32_t index = 0;
+
+	for (;;)
+	{
+		const Node& node = mNodes[index];
+
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min[0]), ox), ix);
+		__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max[0]), ox), ix);
+		__m128 tNear = _mm_max_ps(zero, _mm_min_ps(t1, t2));
+		__m128 tFar = _mm_min_ps(tMax, _mm_max_ps(t1, t2));
+
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min[1]), oy), iy);
+		t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max[1]), oy), iy);
+		tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+		tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min[2]), oz), iz);
+		t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max[2]), oz), iz);
+		tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+		tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+
+		if (_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)))
+		{
+			if (node.Count == 0)
+			{
+				// The packet is taken to be coherent: the first ray orders the children.
+				uint32_t nearChild = index + 1;
+				uint32_t farChild = node.Offset;
+				if (rays[0].Direction[node.Axis] < 0.0f)
+					std::swap(nearChild, farChild);
+
+				stack[size++] = farChild;
+				index = nearChild;
+				continue;
+			}
+
+			for (uint32_t i = node.Offset; i < node.Offset + node.Count; ++i)
+			{
+				const Triangle& tri = mTriangles[i];
+				__m128 e1x = _mm_set1_ps(tri.E1[0]), e1y = _mm_set1_ps(tri.E1[1]), e1z = _mm_set1_ps(tri.E1[2]);
+				__m128 e2x = _mm_set1_ps(tri.E2[0]), e2y = _mm_set1_ps(tri.E2[1]), e2z = _mm_set1_ps(tri.E2[2]);
+
+				__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+				__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+				__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+				__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+
+				// A zero determinant gives infinite or NaN barycentrics, which fail the tests below.
+				__m128 inv = _mm_div_ps(one, det);
+
+				__m128 sx = _mm_sub_ps(ox, _mm_set1_ps(tri.V0[0]));
+				__m128 sy = _mm_sub_ps(oy, _mm_set1_ps(tri.V0[1]));
+				__m128 sz = _mm_sub_ps(oz, _mm_set1_ps(tri.V0[2]));
+				__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv);
+
+				__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+				__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+				__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+				__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+				__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+
+				__m128 hit = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+				hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+				hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, tMax)));
+				if (!_mm_movemask_ps(hit))
+					continue;
+
+				tMax = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, tMax));
+				bestU = _mm_or_ps(_mm_and_ps(hit, u), _mm_andnot_ps(hit, bestU));
+				bestV = _mm_or_ps(_mm_and_ps(hit, v), _mm_andnot_ps(hit, bestV));
+				__m128i hitMask = _mm_castps_si128(hit);
+				best = _mm_or_si128(_mm_and_si128(hitMask, _mm_set1_epi32((int)tri.Index)), _mm_andnot_si128(hitMask, best));
+			}
+		}
+
+		if (size == 0)
+			break;
+		index = stack[--size];
+	}
+
+	float ts[4];
+	float us[4];
+	float vs[4];
+	uint32_t triangles[4];
+	_mm_storeu_ps(ts, tMax);
+	_mm_storeu_ps(us, bestU);
+	_mm_storeu_ps(vs, bestV);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(triangles), best);
+
+	unsigned int mask = 0;
+	for (int r = 0; r < 4; ++r)
+	{
+		if (triangles[r] == BvhHit::None)
+			continue;
+
+		hits[r].T = ts[r];
+		hits[r].U = us[r];
+		hits[r].V = vs[r];
+		hits[r].Triangle = triangles[r];
+		hits[r].Object = BvhHit::None;
+		mask |= 1u << r;
+	}
+	return mask;
+#else
+	unsigned int mask = 0;
+	for (int r = 0; r < 4; ++r)
+	{
+		if (Intersect(rays[r], hits[r]))
+			mask |= 1u << r;
+	}
+	return mask;
+#endif
+}
+
+float TriangleBvh::SahCost()const
+{
+	if (mNodes.empty())
+		return 0.0f;
+
+	const Node& root = mNodes[0];
+	Box rootBox;
+	for (int a = 0; a < 3; ++a)
+	{
+		rootBox.Min[a] = root.Min[a];
+		rootBox.Max[a] = root.Max[a];
+	}
+
+	float rootArea = rootBox.Area();
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	float cost = 0.0f;
+	for (size_t i = 0; i < mNodes.size(); ++i)
+	{
+		Box box;
+		for (int a = 0; a < 3; ++a)
+		{
+			box.Min[a] = mNodes[i].Min[a];
+			box.Max[a] = mNodes[i].Max[a];
+		}
+		cost += box.Area() / rootArea*(mNodes[i].Count ? (float)mNodes[i].Count : TraversalCost);
+	}
+	return cost;
+}
+#pragma endregion
+
+#pragma region BvhScene
+size_t BvhScene::Add(const TriangleBvh* mesh, const float* world, uint32_t object)
+{
+	Instance instance;
+	instance.Mesh = mesh;
+	instance.Object = object;
+	mInstances.push_back(instance);
+
+	SetWorld(mInstances.size() - 1, world);
+	return mInstances.size() - 1;
+}
+
+void BvhScene::SetWorld(size_t index, const float* world)
+{
+	Instance& instance = mInstances[index];
+
+	// Inverse of the upper 3x3 by cofactors; the translation row follows from it.
+	const float* m = world;
+	float c00 = m[5]*m[10] - m[6]*m[9];
+	float c01 = m[6]*m[8] - m[4]*m[10];
+	float c02 = m[4]*m[9] - m[5]*m[8];
+	float det = m[0]*c00 + m[1]*c01 + m[2]*c02;
+
+	// A singular matrix flattens the mesh; it is left out of every query.
+	if (det == 0.0f || instance.Mesh->Empty())
+	{
+		for (int a = 0; a < 3; ++a)
+		{
+			instance.Min[a] = FLT_MAX;
+			instance.Max[a] = -FLT_MAX;
+		}
+		return;
+	}
+
+	float inv = 1.0f / det;
+	float* r = instance.ToObject;
+	r[0] = c00*inv;
+	r[1] = (m[2]*m[9] - m[1]*m[10])*inv;
+	r[2] = (m[1]*m[6] - m[2]*m[5])*inv;
+	r[3] = c01*inv;
+	r[4] = (m[0]*m[10] - m[2]*m[8])*inv;
+	r[5] = (m[2]*m[4] - m[0]*m[6])*inv;
+	r[6] = c02*inv;
+	r[7] = (m[1]*m[8] - m[0]*m[9])*inv;
+	r[8] = (m[0]*m[5] - m[1]*m[4])*inv;
+	for (int j = 0; j < 3; ++j)
+		r[9 + j] = -(m[12]*r[j] + m[13]*r[3 + j] + m[14]*r[6 + j]);
+
+	// World bounds of the mesh bounds: the center moves, the extents add up per axis.
+	const float* minB = instance.Mesh->Min();
+	const float* maxB = instance.Mesh->Max();
+	float center[3];
+	float extent[3];
+	for (int a = 0; a < 3; ++a)
+	{
+		center[a] = 0.5f*(minB[a] + maxB[a]);
+		extent[a] = 0.5f*(maxB[a] - minB[a]);
+	}
+
+	float worldCenter[3];
+	TransformPoint(world, center, worldCenter);
+	for (int j = 0; j < 3; ++j)
+	{
+		float e = fabsf(extent[0]*m[j]) + fabsf(extent[1]*m[4 + j]) + fabsf(extent[2]*m[8 + j]);
+		instance.Min[j] = worldCenter[j] - e;
+		instance.Max[j] = worldCenter[j] + e;
+	}
+}
+
+bool BvhScene::Intersect(const BvhRay& ray, BvhHit& hit)const
+{
+	float inverse[3] = { SafeInverse(ray.Direction[0]), SafeInverse(ray.Direction[1]), SafeInverse(ray.Direction[2]) };
+
+	BvhRay local;
+	local.MaxT = ray.MaxT;
+	bool found = false;
+
+	for (size_t i = 0; i < mInstances.size(); ++i)
+	{
+		const Instance& instance = mInstances[i];
+		if (!HitBox(instance.Min, instance.Max, ray.Origin, inverse, local.MaxT))
+			continue;
+
+		// The map to object space is affine, so t carries over unchanged.
+		const float* r = instance.ToObject;
+		const float* o = ray.Origin;
+		const float* d = ray.Direction;
+		for (int j = 0; j < 3; ++j)
+		{
+			local.Origin[j] = o[0]*r[j] + o[1]*r[3 + j] + o[2]*r[6 + j] + r[9 + j];
+			local.Direction[j] = d[0]*r[j] + d[1]*r[3 + j] + d[2]*r[6 + j];
+		}
+
+		BvhHit candidate;
+		if (instance.Mesh->Intersect(local, candidate))
+		{
+			hit = candidate;
+			hit.Object = instance.Object;
+			local.MaxT = candidate.T;
+			found = true;
+		}
+	}
+	return found;
+}
+#pragma endregion
@@ -0,0 +1,148 @@
+//***************************************************************************************
+// TriangleBvh.h
+//
+// Bounding volume hierarchy over the triangles of one mesh, for picking and other
+// CPU ray queries. The builder bins triangle centroids into BinCount buckets along
+// each axis and splits where the surface area heuristic is lowest; the top levels,
+// where a range holds many triangles, bin in parallel and build their subtrees as
+// separate jobs.
+//
+// The built tree is one array of 32-byte nodes in depth-first order, two to a cache
+// line: the first child of a node is the node after it, and only the second child
+// needs an offset. Leaves point into a copy of their triangles stored in leaf order
+// as a vertex and two edges, which is what the ray test wants.
+//
+// Intersect finds the closest hit of one ray, visiting the near child first.
+// Intersect4 traces four rays as a packet, testing each node and triangle against
+// all four with SSE; it pays off for coherent rays such as a 2x2 block of pixels.
+//
+// A BvhScene places meshes in the world as instances, so one tree serves every
+// object drawn with the mesh and moving an object needs no rebuild; a hit names the
+// object it belongs to. Matrices are row-major and applied as p*W, as in XNA Math.
+//***************************************************************************************
+
+#ifndef TRIANGLEBVH_H
+#define TRIANGLEBVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+struct BvhRay
+{
+	float Origin[3];
+
+	// Need not be normalized; T is measured in lengths of it.
+	float Direction[3];
+
+	// Hits beyond it are ignored.
+	float MaxT;
+};
+
+struct BvhHit
+{
+	static const uint32_t None = 0xffffffff;
+
+	float T;
+
+	// Barycentrics of the hit point: weight of the second and third vertex.
+	float U;
+	float V;
+
+	// The triangle, counted in the index list the mesh was built from, and the
+	// object of a BvhScene; None where nothing was hit.
+	uint32_t Triangle;
+	uint32_t Object;
+};
+
+class TriangleBvh
+{
+public:
+	static const unsigned int BinCount = 16;
+	static const unsigned int MaxLeafSize = 8;
+	static const unsigned int MaxDepth = 64;
+
+	struct Node
+	{
+		float Min[3];
+		uint32_t Offset;		// leaves: first triangle; interior nodes: second child
+		float Max[3];
+		uint16_t Count;			// triangles of a leaf; 0 for interior nodes
+		uint16_t Axis;			// interior nodes: axis the children were split along
+	};
+
+	TriangleBvh();
+
+	// positions holds vertexCount points of three floats, stride bytes apart; every
+	// three indices make a triangle. The mesh is copied, so it need not outlive the
+	// tree. Subtrees are built in parallel when a job system is given.
+	void Build(const float* positions, size_t stride, size_t vertexCount,
+		const uint32_t* indices, size_t triangleCount, JobSystem* jobs = 0);
+
+	// Closest hit of the ray; hit is only written when there is one.
+	bool Intersect(const BvhRay& ray, BvhHit& hit)const;
+
+	// Closest hits of four rays; returns a mask of the rays that hit something.
+	unsigned int Intersect4(const BvhRay rays[4], BvhHit hits[4])const;
+
+	bool Empty()const                      { return mNodes.empty(); }
+	const std::vector<Node>& Nodes()const  { return mNodes; }
+	size_t TriangleCount()const            { return mTriangles.size(); }
+	unsigned int Depth()const              { return mDepth; }
+
+	// Bounds of the whole mesh.
+	const float* Min()const                { return mNodes[0].Min; }
+	const float* Max()const                { return mNodes[0].Max; }
+
+	// Expected cost of a random ray per the heuristic, in triangle tests.
+	float SahCost()const;
+
+private:
+	// A vertex and the two edges from it, plus the triangle's place in the index list.
+	struct Triangle
+	{
+		float V0[3];
+		float E1[3];
+		float E2[3];
+		uint32_t Index;
+	};
+
+	struct BuildNode;
+	class Builder;
+
+	std::vector<Node> mNodes;
+	std::vector<Triangle> mTriangles;
+	unsigned int mDepth;
+};
+
+class BvhScene
+{
+public:
+	// The mesh must outlive the scene and must not be rebuilt while in it.
+	size_t Add(const TriangleBvh* mesh, const float* world, uint32_t object);
+	void SetWorld(size_t instance, const float* world);
+
+	size_t InstanceCount()const            { return mInstances.size(); }
+
+	// Closest hit over every instance. T is in lengths of the world space direction,
+	// so hits of different instances compare.
+	bool Intersect(const BvhRay& ray, BvhHit& hit)const;
+
+private:
+	struct Instance
+	{
+		const TriangleBvh* Mesh;
+		uint32_t Object;
+
+		// World to object space, and the world space bounds of the mesh.
+		float ToObject[12];
+		float Min[3];
+		float Max[3];
+	};
+
+	std::vector<Instance> mInstances;
+};
+
+#endif // TRIANGLEBVH_H
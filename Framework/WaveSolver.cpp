@@ -0,0 +1,266 @@
+//***************************************************************************************
+// WaveSolver.cpp
+//***************************************************************************************
+
+#include "WaveSolver.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define WAVESOLVER_SSE2
+#include <emmintrin.h>
+#endif
+
+WaveSolver::WaveSolver(unsigned int rows, unsigned int cols, float spatialStep, float timeStep,
+	float speed, float damping, size_t vertexStride)
+	: mRows(rows), mCols(cols), mStride(vertexStride), mSpatialStep(spatialStep),
+	mTimeStep(timeStep), mTime(0.0f), mFront(0)
+{
+	assert(rows >= 3 && cols >= 3 && vertexStride >= 6*sizeof(float));
+
+	float d = damping*timeStep + 2.0f;
+	float e = (speed*speed)*(timeStep*timeStep)/(spatialStep*spatialStep);
+	mK1 = (damping*timeStep - 4.0f)/d;
+	mK2 = (4.0f - 8.0f*e)/d;
+	mK3 = (2.0f*e)/d;
+
+	mPrev.assign((size_t)rows*cols, 0.0f);
+	mCurr.assign((size_t)rows*cols, 0.0f);
+
+	// Flat water, centred on the origin in the xz plane with row 0 at the back.
+	float halfWidth = 0.5f*Width();
+	float halfDepth = 0.5f*Depth();
+	for (int s = 0; s < 2; ++s)
+	{
+		mStaging[s].assign(VertexCount()*mStride, 0);
+		for (unsigned int i = 0; i < rows; ++i)
+		{
+			for (unsigned int j = 0; j < cols; ++j)
+			{
+				float* v = reinterpret_cast<float*>(&mStaging[s][((size_t)i*cols + j)*mStride]);
+				v[0] = -halfWidth + j*spatialStep;
+				v[2] = halfDepth - i*spatialStep;
+				v[4] = 1.0f;
+			}
+		}
+	}
+}
+
+unsigned int WaveSolver::RowCount()const
+{
+	return mRows;
+}
+
+unsigned int WaveSolver::ColumnCount()const
+{
+	return mCols;
+}
+
+unsigned int WaveSolver::VertexCount()const
+{
+	return mRows*mCols;
+}
+
+size_t WaveSolver::VertexStride()const
+{
+	return mStride;
+}
+
+float WaveSolver::Width()const
+{
+	return (mCols - 1)*mSpatialStep;
+}
+
+float WaveSolver::Depth()const
+{
+	return (mRows - 1)*mSpatialStep;
+}
+
+bool WaveSolver::Update(float dt, JobSystem* jobs)
+{
+	mTime += dt;
+	if (mTime < mTimeStep)
+		return false;
+
+	Step(jobs);
+	mTime = 0.0f;
+	return true;
+}
+
+void WaveSolver::Step(JobSystem* jobs)
+{
+	unsigned char* vertices = &mStaging[1 - mFront][0];
+
+	// Only the interior is stepped; the boundary stays at rest.
+	if (jobs == 0)
+	{
+		StepRows(1, mRows - 1, vertices);
+	}
+	else
+	{
+		// Bands of at least 16 rows, so a band is worth a job even on small grids.
+		size_t grain = std::max<size_t>((mRows - 2)/(8*jobs->ThreadCount()), 16);
+		jobs->ParallelFor(1, mRows - 1, [&](size_t begin, size_t end)
+		{
+			StepRows((unsigned int)begin, (unsigned int)end, vertices);
+		}, grain);
+	}
+
+	Swap();
+}
+
+void WaveSolver::StepReference()
+{
+	unsigned char* vertices = &mStaging[1 - mFront][0];
+	float twoDx = 2.0f*mSpatialStep;
+
+	for (unsigned int i = 1; i < mRows - 1; ++i)
+	{
+		for (unsigned int j = 1; j < mCols - 1; ++j)
+		{
+			size_t k = (size_t)i*mCols + j;
+
+			float l = mCurr[k - 1];
+			float r = mCurr[k + 1];
+			float t = mCurr[k - mCols];
+			float b = mCurr[k + mCols];
+
+			mPrev[k] = mK1*mPrev[k] + mK2*mCurr[k] + mK3*(b + t + r + l);
+
+			float nx = l - r, ny = twoDx, nz = b - t;
+			float invLength = 1.0f/sqrtf(nx*nx + ny*ny + nz*nz);
+			WriteVertex(vertices, k, mCurr[k], nx*invLength, ny*invLength, nz*invLength);
+		}
+	}
+
+	Swap();
+}
+
+void WaveSolver::Disturb(unsigned int i, unsigned int j, float magnitude)
+{
+	// Don't disturb boundaries.
+	assert(i > 1 && i < mRows - 2);
+	assert(j > 1 && j < mCols - 2);
+
+	float halfMag = 0.5f*magnitude;
+
+	size_t k = (size_t)i*mCols + j;
+	mCurr[k] += magnitude;
+	mCurr[k + 1] += halfMag;
+	mCurr[k - 1] += halfMag;
+	mCurr[k + mCols] += halfMag;
+	mCurr[k - mCols] += halfMag;
+}
+
+float WaveSolver::Height(unsigned int i, unsigned int j)const
+{
+	return mCurr[(size_t)i*mCols + j];
+}
+
+const void* WaveSolver::FrontVertices()const
+{
+	return &mStaging[mFront][0];
+}
+
+void* WaveSolver::StagingVertices(unsigned int index)
+{
+	return &mStaging[index][0];
+}
+
+void WaveSolver::StepRows(unsigned int begin, unsigned int end, unsigned char* vertices)
+{
+	float twoDx = 2.0f*mSpatialStep;
+
+	for (unsigned int i = begin; i < end; ++i)
+	{
+		size_t row = (size_t)i*mCols;
+		float* prev = &mPrev[row];
+		const float* curr = &mCurr[row];
+		const float* up = curr - mCols;
+		const float* down = curr + mCols;
+
+		unsigned int j = 1;
+#if defined(WAVESOLVER_SSE2)
+		const __m128 k1 = _mm_set1_ps(mK1);
+		const __m128 k2 = _mm_set1_ps(mK2);
+		const __m128 k3 = _mm_set1_ps(mK3);
+		const __m128 ny = _mm_set1_ps(twoDx);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 rowZ = _mm_set1_ps(reinterpret_cast<const float*>(vertices + row*mStride)[2]);
+
+		for (; j + 4 <= mCols - 1; j += 4)
+		{
+			__m128 c = _mm_loadu_ps(curr + j);
+			__m128 l = _mm_loadu_ps(curr + j - 1);
+			__m128 r = _mm_loadu_ps(curr + j + 1);
+			__m128 t = _mm_loadu_ps(up + j);
+			__m128 b = _mm_loadu_ps(down + j);
+
+			__m128 neighbours = _mm_add_ps(_mm_add_ps(_mm_add_ps(b, t), r), l);
+			__m128 next = _mm_add_ps(_mm_add_ps(_mm_mul_ps(k1, _mm_loadu_ps(prev + j)), _mm_mul_ps(k2, c)),
+				_mm_mul_ps(k3, neighbours));
+			_mm_storeu_ps(prev + j, next);
+
+			__m128 nx = _mm_sub_ps(l, r);
+			__m128 nz = _mm_sub_ps(b, t);
+			__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+				_mm_mul_ps(nz, nz))));
+
+			// Every vertex of a row has the same z, so (y, z, nx, ny) is one transposed
+			// row of four registers and nz the only separate store.
+			__m128 v0 = c;
+			__m128 v1 = rowZ;
+			__m128 v2 = _mm_mul_ps(nx, invLength);
+			__m128 v3 = _mm_mul_ps(ny, invLength);
+			_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+
+			float z[4];
+			_mm_storeu_ps(z, _mm_mul_ps(nz, invLength));
+
+			float* v = reinterpret_cast<float*>(vertices + (row + j)*mStride);
+			_mm_storeu_ps(v + 1, v0);
+			v[5] = z[0];
+			v = reinterpret_cast<float*>(reinterpret_cast<unsigned char*>(v) + mStride);
+			_mm_storeu_ps(v + 1, v1);
+			v[5] = z[1];
+			v = reinterpret_cast<float*>(reinterpret_cast<unsigned char*>(v) + mStride);
+			_mm_storeu_ps(v + 1, v2);
+			v[5] = z[2];
+			v = reinterpret_cast<float*>(reinterpret_cast<unsigned char*>(v) + mStride);
+			_mm_storeu_ps(v + 1, v3);
+			v[5] = z[3];
+		}
+#endif
+		for (; j < mCols - 1; ++j)
+		{
+			float l = curr[j - 1];
+			float r = curr[j + 1];
+			float t = up[j];
+			float b = down[j];
+
+			prev[j] = mK1*prev[j] + mK2*curr[j] + mK3*(b + t + r + l);
+
+			float nx = l - r, nz = b - t;
+			float invLength = 1.0f/sqrtf(nx*nx + twoDx*twoDx + nz*nz);
+			WriteVertex(vertices, row + j, curr[j], nx*invLength, twoDx*invLength, nz*invLength);
+		}
+	}
+}
+
+void WaveSolver::WriteVertex(unsigned char* vertices, size_t index, float height, float nx, float ny, float nz)const
+{
+	float* v = reinterpret_cast<float*>(vertices + index*mStride);
+	v[1] = height;
+	v[3] = nx;
+	v[4] = ny;
+	v[5] = nz;
+}
+
+void WaveSolver::Swap()
+{
+	mPrev.swap(mCurr);
+	mFront = 1 - mFront;
+}
@@ -0,0 +1,92 @@
+//***************************************************************************************
+// WaveSolver.h
+//
+// The finite difference wave equation of Common's Waves, on structure-of-arrays
+// height grids so a row is stepped four cells at a time with SSE2. Rows are split
+// into bands over a job system when one is given.
+//
+// The pass that steps a row also computes the normals of the solution it steps from
+// (the stencil reads the same four neighbours) and writes heights and normals into
+// one of two vertex staging areas, so the vertices of a dynamic buffer never have
+// to be built separately. The staging areas alternate: a step writes the back one
+// and makes it the front one, which stays untouched while the caller copies it into
+// a mapped buffer during the next step.
+//
+// Staged vertices begin with a float3 position and a float3 normal, Stride bytes
+// apart; anything after those is the caller's and is never written.
+//***************************************************************************************
+
+#ifndef WAVESOLVER_H
+#define WAVESOLVER_H
+
+#include <cstddef>
+#include <vector>
+
+class JobSystem;
+
+class WaveSolver
+{
+public:
+	WaveSolver(unsigned int rows, unsigned int cols, float spatialStep, float timeStep,
+		float speed, float damping, size_t vertexStride = 6*sizeof(float));
+
+	unsigned int RowCount()const;
+	unsigned int ColumnCount()const;
+	unsigned int VertexCount()const;
+	size_t VertexStride()const;
+
+	float Width()const;
+	float Depth()const;
+
+	// Takes a step once timeStep has passed since the last one, as Waves::Update.
+	// Returns whether it did.
+	bool Update(float dt, JobSystem* jobs = 0);
+
+	void Step(JobSystem* jobs = 0);
+
+	// Step one cell at a time on the calling thread, for checking and timing Step.
+	void StepReference();
+
+	// Raises cell (i, j) by magnitude and its neighbours by half of it.
+	void Disturb(unsigned int i, unsigned int j, float magnitude);
+
+	// Height of cell (i, j) in the current solution.
+	float Height(unsigned int i, unsigned int j)const;
+
+	// The vertices written by the last step, i.e. of the solution it stepped from.
+	const void* FrontVertices()const;
+
+	// Both staging areas, for filling in the caller's attributes once.
+	void* StagingVertices(unsigned int index);
+
+private:
+	WaveSolver(const WaveSolver& rhs);
+	WaveSolver& operator=(const WaveSolver& rhs);
+
+	void StepRows(unsigned int begin, unsigned int end, unsigned char* vertices);
+	void WriteVertex(unsigned char* vertices, size_t index, float height, float nx, float ny, float nz)const;
+	void Swap();
+
+private:
+	unsigned int mRows;
+	unsigned int mCols;
+	size_t mStride;
+
+	float mSpatialStep;
+	float mTimeStep;
+	float mTime;
+
+	// Simulation constants, see Waves::Init.
+	float mK1;
+	float mK2;
+	float mK3;
+
+	// Row-major heights; a step overwrites the previous solution with the next one.
+	std::vector<float> mPrev;
+	std::vector<float> mCurr;
+
+	std::vector<unsigned char> mStaging[2];
+	unsigned int mFront;
+};
+
+#endif // WAVESOLVER_H